@@ -0,0 +1,3 @@
+// prepended to every shader in the editor, add library files here.
+#include "snoise.hlsl"
+#include "qnoise.hlsl"
@@ -0,0 +1,55 @@
+#include "common.hpp"
+#include "cached_shader_compiler.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CachedShaderCompiler::CachedShaderCompiler(ShaderCompilerPtr compiler, ShaderCachePtr cache)
+	: m_compiler(compiler)
+	, m_cache(cache)
+{
+
+}
+
+CachedShaderCompiler::~CachedShaderCompiler()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool CachedShaderCompiler::Compile(const ShaderCompileInput& input, ShaderCompileOutput& output)
+{
+	// the key hashes the whole source, a miss must not take it twice.
+	ContentHash key = ShaderCache::MakeKey(input);
+	if (Lookup(key, output)) return true;
+
+	// failures are not cached, their diagnostics are cheap to reproduce.
+	// the warnings of a success are, a hit shows them as the compile did.
+	if (!m_compiler->Compile(input, output)) return false;
+
+	m_cache->Insert(key, output.bytecode, output.error_message);
+	output.from_cache = false;
+	return true;
+}
+
+bool CachedShaderCompiler::Probe(const ShaderCompileInput& input, ShaderCompileOutput& output)
+{
+	return Lookup(ShaderCache::MakeKey(input), output);
+}
+
+ShaderCachePtr CachedShaderCompiler::GetCache() const
+{
+	return m_cache;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+bool CachedShaderCompiler::Lookup(const ContentHash& key, ShaderCompileOutput& output)
+{
+	if (!m_cache->Lookup(key, output.bytecode, output.error_message)) return false;
+	output.from_cache = true;
+	return true;
+}
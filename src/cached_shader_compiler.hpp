@@ -0,0 +1,29 @@
+#ifndef _CACHED_SHADER_COMPILER_HPP_INCLUDED_
+#define _CACHED_SHADER_COMPILER_HPP_INCLUDED_
+
+#include "shader_compiler.hpp"
+#include "shader_cache.hpp"
+
+// answers from the cache when the exact same input was compiled before,
+// otherwise forwards to the wrapped compiler and remembers its bytecode.
+class CachedShaderCompiler : public ShaderCompiler
+{
+public:
+	CachedShaderCompiler(ShaderCompilerPtr compiler, ShaderCachePtr cache);
+	virtual ~CachedShaderCompiler();
+
+public:
+	virtual bool Compile(const ShaderCompileInput& input, ShaderCompileOutput& output);
+	virtual bool Probe(const ShaderCompileInput& input, ShaderCompileOutput& output);
+
+	ShaderCachePtr GetCache() const;
+
+private:
+	bool Lookup(const ContentHash& key, ShaderCompileOutput& output);
+
+private:
+	ShaderCompilerPtr m_compiler;
+	ShaderCachePtr m_cache;
+};
+
+#endif  // _CACHED_SHADER_COMPILER_HPP_INCLUDED_
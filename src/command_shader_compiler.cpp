@@ -0,0 +1,107 @@
+#include "common.hpp"
+#include "command_shader_compiler.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <cstdio>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CommandShaderCompiler::CommandShaderCompiler(const std::string& command, const std::string& work_directory)
+	: m_command(command)
+	, m_work_directory(work_directory)
+	, m_num_temp_files(0)
+{
+	if (!m_work_directory.empty()) MakeDirectory(m_work_directory);
+}
+
+CommandShaderCompiler::~CommandShaderCompiler()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool CommandShaderCompiler::Compile(const ShaderCompileInput& input, ShaderCompileOutput& output)
+{
+	output.from_cache = false;
+	output.bytecode.clear();
+	output.error_message.clear();
+
+	std::string input_path = MakeTempPath(".hlsl");
+	std::string output_path = MakeTempPath(".cso");
+	{
+		std::ofstream ofs(input_path.c_str(), std::ios::binary | std::ios::trunc);
+		ofs.write(input.GetSource().data(), input.GetSource().length());
+		if (!ofs.good())
+		{
+			output.error_message = "error: can not write " + input_path + "\n";
+			return false;
+		}
+	}
+
+	bool succeeded = RunCommand(MakeCommandLine(input, input_path, output_path), output.error_message);
+	if (succeeded)
+	{
+		std::ifstream ifs(output_path.c_str(), std::ios::binary);
+		output.bytecode.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+		succeeded = !output.bytecode.empty();
+	}
+
+	std::remove(input_path.c_str());
+	std::remove(output_path.c_str());
+	return succeeded;
+}
+
+const std::string& CommandShaderCompiler::GetCommand() const
+{
+	return m_command;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+std::string CommandShaderCompiler::MakeTempPath(const char* extension)
+{
+	size_t index = 0;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		index = m_num_temp_files++;
+	}
+
+	// the process id keeps concurrent runs sharing a directory apart.
+	std::ostringstream oss;
+	if (!m_work_directory.empty()) oss << m_work_directory << "/";
+	oss << "compile_" << getpid() << "_" << index << extension;
+	return oss.str();
+}
+
+std::string CommandShaderCompiler::MakeCommandLine(const ShaderCompileInput& input,
+	const std::string& input_path, const std::string& output_path) const
+{
+	std::string command_line = m_command;
+	ReplaceAll(command_line, "{input}", "\"" + input_path + "\"");
+	ReplaceAll(command_line, "{output}", "\"" + output_path + "\"");
+	ReplaceAll(command_line, "{entry}", input.entry_point);
+	ReplaceAll(command_line, "{profile}", input.profile);
+	ReplaceAll(command_line, "{flags}", MakeFlagSwitches(input.flags));
+	return command_line;
+}
+
+std::string CommandShaderCompiler::MakeFlagSwitches(unsigned int flags)
+{
+	std::string switches;
+	if (flags & SCF_Debug) switches += " -Zi";
+	if (flags & SCF_SkipOptimization) switches += " -Od";
+	if (flags & SCF_OptimizationLevel3) switches += " -O3";
+	return switches.empty() ? switches : switches.substr(1);
+}
@@ -0,0 +1,43 @@
+#ifndef _COMMAND_SHADER_COMPILER_HPP_INCLUDED_
+#define _COMMAND_SHADER_COMPILER_HPP_INCLUDED_
+
+#include "shader_compiler.hpp"
+#include <boost/thread/mutex.hpp>
+
+// runs a locally installed compiler through the shell, e.g. dxc, or fxc
+// under wine. the command line is a template, with these placeholders
+// replaced for every compile:
+//   {input}    a file holding the compile input
+//   {output}   the file the bytecode is expected in
+//   {entry}    the entry point
+//   {profile}  the target profile
+//   {flags}    the compile flags as -Zi / -Od / -O3 switches
+// everything the command prints becomes the error message.
+class CommandShaderCompiler : public ShaderCompiler
+{
+public:
+	// temporary files go to work_directory, created if missing.
+	CommandShaderCompiler(const std::string& command, const std::string& work_directory);
+	virtual ~CommandShaderCompiler();
+
+public:
+	virtual bool Compile(const ShaderCompileInput& input, ShaderCompileOutput& output);
+
+	const std::string& GetCommand() const;
+
+private:
+	std::string MakeTempPath(const char* extension);
+	std::string MakeCommandLine(const ShaderCompileInput& input,
+		const std::string& input_path, const std::string& output_path) const;
+
+	static std::string MakeFlagSwitches(unsigned int flags);
+
+private:
+	std::string m_command;
+	std::string m_work_directory;
+
+	boost::mutex m_mutex;
+	size_t m_num_temp_files;
+};
+
+#endif  // _COMMAND_SHADER_COMPILER_HPP_INCLUDED_
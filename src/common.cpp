@@ -1,5 +1,18 @@
 #include "common.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define popen _popen
+#define pclose _pclose
+#else
+#include <dirent.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef _WIN32
 void MessageBoxf(tstring format, ...)
 {
 	va_list args;
@@ -9,3 +22,84 @@ void MessageBoxf(tstring format, ...)
 	va_end(args);
 	MessageBox(NULL, msg, TEXT("debug"), MB_OK);
 }
+#endif
+
+void MakeDirectory(const std::string& path)
+{
+	// create every missing level, ignoring failures of the existing ones.
+	for (size_t i = 1; i <= path.length(); ++i)
+	{
+		if (i == path.length() || path[i] == '/' || path[i] == '\\')
+		{
+			std::string sub_path = path.substr(0, i);
+#ifdef _WIN32
+			_mkdir(sub_path.c_str());
+#else
+			mkdir(sub_path.c_str(), 0755);
+#endif
+		}
+	}
+}
+
+bool IsDirectory(const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFDIR) != 0;
+}
+
+void ListShaderFiles(const std::string& directory, std::vector<std::string>& files)
+{
+	std::vector<std::string> names;
+#ifdef _WIN32
+	WIN32_FIND_DATAA find_data;
+	HANDLE find = FindFirstFileA((directory + "/*.hlsl").c_str(), &find_data);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do names.push_back(find_data.cFileName); while (FindNextFileA(find, &find_data));
+		FindClose(find);
+	}
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir != NULL)
+	{
+		while (dirent* entry = readdir(dir)) names.push_back(entry->d_name);
+		closedir(dir);
+	}
+#endif
+
+	std::sort(names.begin(), names.end());
+	for (size_t i = 0; i != names.size(); ++i)
+	{
+		const std::string& name = names[i];
+		if (name.length() > 5 && name.compare(name.length() - 5, 5, ".hlsl") == 0) files.push_back(directory + "/" + name);
+	}
+}
+
+void ReplaceAll(std::string& text, const std::string& from, const std::string& to)
+{
+	for (size_t pos = text.find(from); pos != std::string::npos; pos = text.find(from, pos + to.length()))
+	{
+		text.replace(pos, from.length(), to);
+	}
+}
+
+bool RunCommand(const std::string& command_line, std::string& output)
+{
+	FILE* pipe = popen((command_line + " 2>&1").c_str(), "r");
+	if (pipe == NULL)
+	{
+		output = "error: can not run " + command_line + "\n";
+		return false;
+	}
+
+	char buffer[4096];
+	size_t length = 0;
+	while ((length = fread(buffer, 1, sizeof(buffer), pipe)) != 0) output.append(buffer, length);
+
+	int status = pclose(pipe);
+#ifdef _WIN32
+	return status == 0;
+#else
+	return status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
@@ -1,6 +1,7 @@
 #ifndef _COMMON_HPP_INCLUDED_
 #define _COMMON_HPP_INCLUDED_
 
+#ifdef _WIN32
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 
@@ -14,7 +15,6 @@
 #include <dxgi.h>
 #include <d2d1.h>
 #include <dwrite.h>
-#include <cassert>
 
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "d3d10_1.lib")
@@ -23,6 +23,13 @@
 #pragma comment(lib, "dxgi.lib")
 #pragma comment(lib, "d2d1.lib")
 #pragma comment(lib, "dwrite.lib")
+#else
+// the portable modules also build elsewhere, for the command line tools.
+#define TEXT(quote) quote
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#include <cassert>
 
 #include "ayw/vector.hpp"
 using Ayw::float2;
@@ -30,6 +37,7 @@ using Ayw::float3;
 using Ayw::float4;
 
 #include <string>
+#include <vector>
 #include <boost/lexical_cast.hpp>
 
 #ifdef UNICODE
@@ -53,11 +61,28 @@ DestType lexical_cast_no_exception(const SrcType& arg)
 	}
 }
 
+#ifdef _WIN32
+// elsewhere these would clash with the standard library's to_string.
 #define to_string(arg) lexical_cast_no_exception<std::string>(arg)
 #define to_wstring(arg) lexical_cast_no_exception<std::wstring>(arg)
 #define to_tstring(arg) lexical_cast_no_exception<tstring>(arg)
 
 void MessageBoxf(tstring format, ...);
+#endif
+
+// creates every missing directory along path.
+void MakeDirectory(const std::string& path);
+
+bool IsDirectory(const std::string& path);
+
+// the shader files directly inside directory, sorted by name.
+void ListShaderFiles(const std::string& directory, std::vector<std::string>& files);
+
+void ReplaceAll(std::string& text, const std::string& from, const std::string& to);
+
+// runs command_line through the shell, appending what it prints, errors
+// included, to output. returns true if it exited with 0.
+bool RunCommand(const std::string& command_line, std::string& output);
 
 #define SAFE_RELEASE(p) if (p != NULL) {p->Release(); p = NULL;}
 
@@ -0,0 +1,211 @@
+#include "common.hpp"
+#include "compile_protocol.hpp"
+
+static void WriteUInt32(std::string& out, unsigned int value)
+{
+	for (int i = 0; i != 4; ++i) out.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+static void WriteBytes(std::string& out, const char* data, size_t size)
+{
+	WriteUInt32(out, static_cast<unsigned int>(size));
+	out.append(data, size);
+}
+
+static void WriteString(std::string& out, const std::string& str)
+{
+	WriteBytes(out, str.data(), str.length());
+}
+
+// the payload length is patched in once the payload is written.
+static size_t BeginFrame(std::string& frame, CompileFrameType type)
+{
+	size_t begin = frame.length();
+	WriteUInt32(frame, 0);
+	frame.push_back(static_cast<char>(type));
+	return begin;
+}
+
+static void EndFrame(std::string& frame, size_t begin)
+{
+	size_t size = frame.length() - begin - compile_frame_header_size;
+	for (int i = 0; i != 4; ++i) frame[begin + i] = static_cast<char>((size >> (i * 8)) & 0xFF);
+}
+
+static unsigned int ReadUInt32(const char* data)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<unsigned int>(bytes[3]) << 24);
+}
+
+// reads fields in order, failing for good once the payload runs out.
+class PayloadReader
+{
+public:
+	explicit PayloadReader(const std::string& payload)
+		: m_payload(payload)
+		, m_pos(0)
+		, m_good(true)
+	{
+
+	}
+
+public:
+	unsigned int ReadUInt32()
+	{
+		if (!Require(4)) return 0;
+		unsigned int value = ::ReadUInt32(m_payload.data() + m_pos);
+		m_pos += 4;
+		return value;
+	}
+
+	unsigned char ReadUInt8()
+	{
+		if (!Require(1)) return 0;
+		return static_cast<unsigned char>(m_payload[m_pos++]);
+	}
+
+	template <typename Container>
+	void ReadBytes(Container& out)
+	{
+		size_t size = ReadUInt32();
+		if (!Require(size)) return;
+		out.assign(m_payload.begin() + m_pos, m_payload.begin() + m_pos + size);
+		m_pos += size;
+	}
+
+	// every byte must have been read, too.
+	bool IsGood() const
+	{
+		return m_good && m_pos == m_payload.length();
+	}
+
+private:
+	bool Require(size_t size)
+	{
+		if (m_good && m_payload.length() - m_pos >= size) return true;
+		m_good = false;
+		return false;
+	}
+
+private:
+	const std::string& m_payload;
+	size_t m_pos;
+	bool m_good;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// encoding / decoding
+//////////////////////////////////////////////////////////////////////////
+void EncodeReadyFrame(std::string& frame)
+{
+	size_t begin = BeginFrame(frame, CF_Ready);
+	WriteUInt32(frame, compile_protocol_version);
+	EndFrame(frame, begin);
+}
+
+void EncodeRequestFrame(const CompileRequest& request, std::string& frame)
+{
+	const std::string& source = request.input.GetSource();
+	frame.reserve(frame.length() + compile_frame_header_size + source.length() + 64);
+
+	size_t begin = BeginFrame(frame, CF_Request);
+	WriteUInt32(frame, request.id);
+	WriteUInt32(frame, request.input.flags);
+	WriteString(frame, request.input.entry_point);
+	WriteString(frame, request.input.profile);
+	WriteString(frame, source);
+	EndFrame(frame, begin);
+}
+
+void EncodeResponseFrame(const CompileResponse& response, std::string& frame)
+{
+	size_t begin = BeginFrame(frame, CF_Response);
+	WriteUInt32(frame, response.id);
+	frame.push_back(response.succeeded ? 1 : 0);
+	WriteBytes(frame, response.bytecode.empty() ? NULL : &response.bytecode[0], response.bytecode.size());
+	WriteString(frame, response.error_message);
+	EndFrame(frame, begin);
+}
+
+bool DecodeReadyPayload(const std::string& payload, unsigned int& version)
+{
+	PayloadReader reader(payload);
+	version = reader.ReadUInt32();
+	return reader.IsGood();
+}
+
+bool DecodeRequestPayload(const std::string& payload, CompileRequest& request)
+{
+	PayloadReader reader(payload);
+	request.id = reader.ReadUInt32();
+	request.input.flags = reader.ReadUInt32();
+	reader.ReadBytes(request.input.entry_point);
+	reader.ReadBytes(request.input.profile);
+
+	boost::shared_ptr<std::string> source(new std::string);
+	reader.ReadBytes(*source);
+	request.input.source = source;
+	return reader.IsGood();
+}
+
+bool DecodeResponsePayload(const std::string& payload, CompileResponse& response)
+{
+	PayloadReader reader(payload);
+	response.id = reader.ReadUInt32();
+	response.succeeded = reader.ReadUInt8() != 0;
+	reader.ReadBytes(response.bytecode);
+	reader.ReadBytes(response.error_message);
+	return reader.IsGood();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// compile frame reader
+//////////////////////////////////////////////////////////////////////////
+CompileFrameReader::CompileFrameReader()
+	: m_offset(0)
+	, m_broken(false)
+{
+
+}
+
+void CompileFrameReader::Append(const char* data, size_t size)
+{
+	// drop the consumed frames before the buffer grows.
+	if (m_offset != 0)
+	{
+		m_buffer.erase(0, m_offset);
+		m_offset = 0;
+	}
+	m_buffer.append(data, size);
+}
+
+bool CompileFrameReader::NextFrame(CompileFrameType& type, std::string& payload)
+{
+	if (m_broken || m_buffer.length() - m_offset < compile_frame_header_size) return false;
+
+	size_t size = ReadUInt32(m_buffer.data() + m_offset);
+	if (size > max_compile_frame_size)
+	{
+		m_broken = true;
+		return false;
+	}
+	if (m_buffer.length() - m_offset < compile_frame_header_size + size) return false;
+
+	type = static_cast<CompileFrameType>(static_cast<unsigned char>(m_buffer[m_offset + 4]));
+	payload.assign(m_buffer, m_offset + compile_frame_header_size, size);
+	m_offset += compile_frame_header_size + size;
+	return true;
+}
+
+bool CompileFrameReader::IsBroken() const
+{
+	return m_broken;
+}
+
+void CompileFrameReader::Clear()
+{
+	m_buffer.clear();
+	m_offset = 0;
+	m_broken = false;
+}
@@ -0,0 +1,73 @@
+#ifndef _COMPILE_PROTOCOL_HPP_INCLUDED_
+#define _COMPILE_PROTOCOL_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+#include "shader_compiler.hpp"
+
+// the messages between the compile server and its worker processes.
+// every frame is a 4 byte payload length, a 1 byte frame type, then the
+// payload. integers are little endian, strings and blobs are prefixed by
+// their 4 byte length.
+//   ready:    protocol version			(worker, once started up)
+//   request:  id, flags, entry point, profile, source
+//   response: id, succeeded, bytecode, error message
+
+static const unsigned int compile_protocol_version = 1;
+static const size_t compile_frame_header_size = 5;
+static const size_t max_compile_frame_size = 64 * 1024 * 1024;
+
+enum CompileFrameType
+{
+	CF_Ready = 1,
+	CF_Request = 2,
+	CF_Response = 3,
+};
+
+struct CompileRequest
+{
+	unsigned int id;
+	ShaderCompileInput input;
+};
+
+struct CompileResponse
+{
+	unsigned int id;
+	bool succeeded;
+	std::vector<char> bytecode;
+	std::string error_message;
+};
+
+// frames are appended to frame.
+void EncodeReadyFrame(std::string& frame);
+void EncodeRequestFrame(const CompileRequest& request, std::string& frame);
+void EncodeResponseFrame(const CompileResponse& response, std::string& frame);
+
+bool DecodeReadyPayload(const std::string& payload, unsigned int& version);
+bool DecodeRequestPayload(const std::string& payload, CompileRequest& request);
+bool DecodeResponsePayload(const std::string& payload, CompileResponse& response);
+
+// cuts whole frames out of a byte stream which arrives in pieces.
+class CompileFrameReader
+{
+public:
+	CompileFrameReader();
+
+public:
+	void Append(const char* data, size_t size);
+
+	// returns false until a whole frame arrived.
+	bool NextFrame(CompileFrameType& type, std::string& payload);
+
+	// the stream announced a frame larger than any valid one.
+	bool IsBroken() const;
+
+	void Clear();
+
+private:
+	std::string m_buffer;
+	size_t m_offset;
+	bool m_broken;
+};
+
+#endif  // _COMPILE_PROTOCOL_HPP_INCLUDED_
@@ -0,0 +1,432 @@
+#include "common.hpp"
+#include "compile_server.hpp"
+#include "compile_protocol.hpp"
+#include "worker_process.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// how long a fresh worker may take to report ready.
+static const unsigned int worker_startup_timeout = 10000;
+
+// waits are cut into slices this long, so a stop is noticed quickly.
+static const unsigned int worker_poll_interval = 50;
+
+// how long a worker which failed to start waits before trying again.
+static const unsigned int worker_restart_delay = 1000;
+
+static const unsigned int default_compile_timeout = 10000;
+
+typedef boost::posix_time::ptime TimePoint;
+
+static TimePoint Now()
+{
+	return boost::posix_time::microsec_clock::universal_time();
+}
+
+static double Milliseconds(const TimePoint& begin, const TimePoint& end)
+{
+	return (end - begin).total_microseconds() / 1000.0;
+}
+
+class CompileServer::Worker
+{
+public:
+	Worker() : is_ready(false) {}
+
+public:
+	WorkerProcess process;
+	CompileFrameReader reader;
+	bool is_ready;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// compile server result
+//////////////////////////////////////////////////////////////////////////
+CompileServer::Result::Result()
+	: id(0)
+	, succeeded(false)
+	, timed_out(false)
+	, crashed(false)
+	, compile_time(0)
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CompileServer::CompileServer(const std::vector<std::string>& worker_command, size_t num_workers)
+	: m_worker_command(worker_command)
+	, m_next_id(1)
+	, m_timeout(default_compile_timeout)
+	, m_num_ready(0)
+	, m_num_starting(0)
+	, m_quit(false)
+{
+	memset(&m_statistics, 0, sizeof(m_statistics));
+
+	if (num_workers == 0) num_workers = 1;
+	for (size_t i = 0; i != num_workers; ++i) m_workers.push_back(WorkerPtr(new Worker));
+}
+
+CompileServer::~CompileServer()
+{
+	Stop();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool CompileServer::Start()
+{
+	if (!m_threads.empty()) return GetNumReadyWorkers() != 0;
+
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_quit = false;
+	m_num_starting = m_workers.size();
+	for (size_t i = 0; i != m_workers.size(); ++i)
+	{
+		m_threads.push_back(boost::shared_ptr<boost::thread>(
+			new boost::thread(boost::bind(&CompileServer::WorkerProc, this, m_workers[i]))));
+	}
+
+	while (m_num_starting != 0) m_result_condition.wait(lock);
+	return m_num_ready != 0;
+}
+
+void CompileServer::Stop()
+{
+	if (m_threads.empty()) return;
+
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_quit = true;
+	}
+	m_request_condition.notify_all();
+	for (size_t i = 0; i != m_threads.size(); ++i) m_threads[i]->join();
+	m_threads.clear();
+
+	// nobody serves the requests left, so they fail.
+	boost::mutex::scoped_lock lock(m_mutex);
+	while (!m_requests.empty())
+	{
+		Result& result = m_results[m_requests.front().id];
+		result.id = m_requests.front().id;
+		result.crashed = true;
+		result.error_message = "error: the compile server stopped\n";
+		ParseShaderDiagnostics(result.error_message, result.diagnostics);
+		m_requests.pop_front();
+	}
+	m_result_condition.notify_all();
+}
+
+void CompileServer::SetTimeout(unsigned int milliseconds)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_timeout = milliseconds;
+}
+
+unsigned int CompileServer::GetTimeout() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_timeout;
+}
+
+unsigned int CompileServer::Submit(const ShaderCompileInput& input)
+{
+	return SubmitRequest(input, false);
+}
+
+bool CompileServer::FetchResult(Result& result)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	// the oldest result which nobody waits for.
+	for (auto it = m_results.begin(); it != m_results.end(); ++it)
+	{
+		if (m_awaited.find(it->first) != m_awaited.end()) continue;
+
+		std::swap(result, it->second);
+		m_results.erase(it);
+		return true;
+	}
+	return false;
+}
+
+bool CompileServer::WaitResult(unsigned int id, Result& result)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	if (id == 0 || id >= m_next_id) return false;
+
+	m_awaited.insert(id);
+	while (m_results.find(id) == m_results.end())
+	{
+		// fetched already, or it would be queued, served or answered.
+		bool is_queued = false;
+		for (size_t i = 0; i != m_requests.size() && !is_queued; ++i) is_queued = m_requests[i].id == id;
+		if (!is_queued && m_serving.find(id) == m_serving.end()) break;
+
+		m_result_condition.wait(lock);
+	}
+	m_awaited.erase(id);
+
+	auto it = m_results.find(id);
+	if (it == m_results.end()) return false;
+
+	std::swap(result, it->second);
+	m_results.erase(it);
+	return true;
+}
+
+bool CompileServer::Compile(const ShaderCompileInput& input, ShaderCompileOutput& output)
+{
+	output.from_cache = false;
+	output.bytecode.clear();
+	output.error_message.clear();
+
+	Result result;
+	if (!WaitResult(SubmitRequest(input, true), result)) return false;
+
+	output.bytecode.swap(result.bytecode);
+	output.error_message.swap(result.error_message);
+	return result.succeeded;
+}
+
+size_t CompileServer::GetNumWorkers() const
+{
+	return m_workers.size();
+}
+
+size_t CompileServer::GetNumReadyWorkers() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_num_ready;
+}
+
+CompileServer::Statistics CompileServer::GetStatistics() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_statistics;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// worker threads
+//////////////////////////////////////////////////////////////////////////
+void CompileServer::WorkerProc(WorkerPtr worker)
+{
+	bool is_starting = true;
+	while (true)
+	{
+		// a worker is restarted right away, not when the next request comes.
+		if (!worker->is_ready)
+		{
+			bool is_ready = StartWorker(*worker);
+
+			boost::mutex::scoped_lock lock(m_mutex);
+			worker->is_ready = is_ready;
+			if (is_ready) ++m_num_ready;
+			if (is_starting)
+			{
+				is_starting = false;
+				--m_num_starting;
+				m_result_condition.notify_all();
+			}
+			if (m_quit) break;
+
+			// while others serve, a worker which can not start tries again later.
+			if (!is_ready && m_num_ready != 0)
+			{
+				m_request_condition.timed_wait(lock, boost::posix_time::milliseconds(worker_restart_delay));
+				continue;
+			}
+		}
+
+		Request request;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			while (m_requests.empty() && !m_quit) m_request_condition.wait(lock);
+			if (m_quit) break;
+
+			request = m_requests.front();
+			m_requests.pop_front();
+			m_serving.insert(request.id);
+		}
+
+		Result result;
+		result.id = request.id;
+		if (!worker->is_ready)
+		{
+			// no worker is up at all, failing beats waiting forever.
+			result.crashed = true;
+			result.error_message = "error: the compile worker could not be started\n";
+		}
+		else if (!Serve(*worker, request, result))
+		{
+			// it died while idle, which is no fault of this request.
+			worker->process.Kill();
+			if (!StartWorker(*worker) || !Serve(*worker, request, result))
+			{
+				result.crashed = true;
+				result.error_message = "error: the compile worker could not be started\n";
+			}
+		}
+
+		if (!result.succeeded && (result.timed_out || result.crashed) && worker->is_ready)
+		{
+			worker->process.Kill();
+
+			boost::mutex::scoped_lock lock(m_mutex);
+			worker->is_ready = false;
+			--m_num_ready;
+		}
+		PostResult(result);
+	}
+
+	worker->process.Kill();
+	boost::mutex::scoped_lock lock(m_mutex);
+	if (worker->is_ready) --m_num_ready;
+	worker->is_ready = false;
+}
+
+bool CompileServer::StartWorker(Worker& worker)
+{
+	worker.reader.Clear();
+	if (!worker.process.Start(m_worker_command)) return false;
+
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		++m_statistics.num_started;
+	}
+
+	// the worker reports ready once its compiler is loaded.
+	TimePoint begin = Now();
+	char buffer[256];
+	while (Milliseconds(begin, Now()) < worker_startup_timeout)
+	{
+		CompileFrameType type;
+		std::string payload;
+		unsigned int version = 0;
+		if (worker.reader.NextFrame(type, payload))
+		{
+			if (type == CF_Ready && DecodeReadyPayload(payload, version) && version == compile_protocol_version) return true;
+			break;
+		}
+		if (worker.reader.IsBroken()) break;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if (m_quit) break;
+		}
+
+		int num_read = worker.process.Read(buffer, sizeof(buffer), worker_poll_interval);
+		if (num_read < 0) break;
+		worker.reader.Append(buffer, num_read);
+	}
+
+	worker.process.Kill();
+	return false;
+}
+
+bool CompileServer::Serve(Worker& worker, const Request& request, Result& result)
+{
+	unsigned int timeout = GetTimeout();
+	TimePoint begin = Now();
+
+	CompileRequest compile_request = {request.id, request.input};
+	std::string frame;
+	EncodeRequestFrame(compile_request, frame);
+
+	if (!worker.process.Write(frame.data(), frame.length())) return false;
+
+	bool is_answered = false;
+	bool is_stopped = false;
+	std::vector<char> buffer(64 * 1024);
+	while (!is_answered)
+	{
+		CompileFrameType type;
+		std::string payload;
+		if (worker.reader.NextFrame(type, payload))
+		{
+			CompileResponse response;
+			if (type != CF_Response || !DecodeResponsePayload(payload, response)) break;
+			if (response.id != request.id) continue;
+
+			result.succeeded = response.succeeded;
+			result.bytecode.swap(response.bytecode);
+			result.error_message.swap(response.error_message);
+			is_answered = true;
+			break;
+		}
+		if (worker.reader.IsBroken()) break;
+
+		double elapsed = Milliseconds(begin, Now());
+		if (elapsed >= timeout)
+		{
+			result.timed_out = true;
+			break;
+		}
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			is_stopped = m_quit;
+		}
+		if (is_stopped) break;
+
+		unsigned int wait_time = std::min(worker_poll_interval, static_cast<unsigned int>(timeout - elapsed) + 1);
+		int num_read = worker.process.Read(&buffer[0], buffer.size(), wait_time);
+		if (num_read < 0) break;
+		worker.reader.Append(&buffer[0], num_read);
+	}
+	result.compile_time = Milliseconds(begin, Now());
+
+	boost::mutex::scoped_lock lock(m_mutex);
+	if (is_answered)
+	{
+		++m_statistics.num_completed;
+	}
+	else if (result.timed_out)
+	{
+		std::ostringstream oss;
+		oss << "error: the compile timed out after " << timeout << " ms\n";
+		result.error_message = oss.str();
+		++m_statistics.num_timeouts;
+	}
+	else
+	{
+		result.crashed = true;
+		result.error_message = is_stopped ? "error: the compile server stopped\n" : "error: the compile worker crashed\n";
+		if (!is_stopped) ++m_statistics.num_crashes;
+	}
+	return true;
+}
+
+unsigned int CompileServer::SubmitRequest(const ShaderCompileInput& input, bool is_awaited)
+{
+	unsigned int id = 0;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		id = m_next_id++;
+
+		Request request = {id, input};
+		m_requests.push_back(request);
+		if (is_awaited) m_awaited.insert(id);
+	}
+	// all of them, a worker waiting to restart must not swallow the wake up.
+	m_request_condition.notify_all();
+	return id;
+}
+
+void CompileServer::PostResult(Result& result)
+{
+	ParseShaderDiagnostics(result.error_message, result.diagnostics);
+
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_serving.erase(result.id);
+		std::swap(m_results[result.id], result);
+	}
+	m_result_condition.notify_all();
+}
@@ -0,0 +1,113 @@
+#ifndef _COMPILE_SERVER_HPP_INCLUDED_
+#define _COMPILE_SERVER_HPP_INCLUDED_
+
+#include <deque>
+#include <map>
+#include <set>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include "shader_compiler.hpp"
+#include "shader_diagnostics.hpp"
+
+class CompileServer;
+typedef boost::shared_ptr<CompileServer> CompileServerPtr;
+
+// compiles in a pool of worker processes (see compile_worker_main.cpp), so
+// a compiler which crashes or hangs only costs that compile. workers are
+// started ahead of time and restarted as soon as one dies or is killed
+// for running past the timeout, so a warm one is always at hand.
+// every worker is driven by its own thread, taking requests from a queue
+// shared by all of them. results come back asynchronously through
+// FetchResult, or synchronously through the ShaderCompiler interface.
+class CompileServer : public ShaderCompiler
+{
+public:
+	struct Result
+	{
+		unsigned int id;
+		bool succeeded;
+		bool timed_out;
+		bool crashed;				// the worker died or spoke nonsense
+		std::vector<char> bytecode;
+		std::string error_message;
+		ShaderDiagnostics diagnostics;
+		double compile_time;		// milliseconds, as waited for by the server
+
+		Result();
+	};
+
+	struct Statistics
+	{
+		size_t num_started;			// worker processes
+		size_t num_completed;		// requests answered by a worker
+		size_t num_timeouts;
+		size_t num_crashes;
+	};
+
+public:
+	// worker_command is the worker program followed by its arguments.
+	CompileServer(const std::vector<std::string>& worker_command, size_t num_workers);
+	virtual ~CompileServer();
+
+public:
+	// starts the workers and waits until they are ready to compile.
+	// returns false if none of them came up.
+	bool Start();
+	void Stop();
+
+	void SetTimeout(unsigned int milliseconds);
+	unsigned int GetTimeout() const;
+
+	unsigned int Submit(const ShaderCompileInput& input);
+	bool FetchResult(Result& result);
+
+	// waits for a submitted request; its result is not fetched any more.
+	bool WaitResult(unsigned int id, Result& result);
+
+	virtual bool Compile(const ShaderCompileInput& input, ShaderCompileOutput& output);
+
+	size_t GetNumWorkers() const;
+	size_t GetNumReadyWorkers() const;
+	Statistics GetStatistics() const;
+
+private:
+	struct Request
+	{
+		unsigned int id;
+		ShaderCompileInput input;
+	};
+
+	class Worker;
+	typedef boost::shared_ptr<Worker> WorkerPtr;
+
+	void WorkerProc(WorkerPtr worker);
+	bool StartWorker(Worker& worker);
+	// returns false if the request could not even be sent.
+	bool Serve(Worker& worker, const Request& request, Result& result);
+
+	unsigned int SubmitRequest(const ShaderCompileInput& input, bool is_awaited);
+	void PostResult(Result& result);
+
+private:
+	std::vector<std::string> m_worker_command;
+	std::vector<WorkerPtr> m_workers;
+	std::vector<boost::shared_ptr<boost::thread> > m_threads;
+
+	mutable boost::mutex m_mutex;
+	boost::condition_variable m_request_condition;
+	boost::condition_variable m_result_condition;
+
+	std::deque<Request> m_requests;
+	std::map<unsigned int, Result> m_results;
+	std::set<unsigned int> m_serving;
+	std::set<unsigned int> m_awaited;
+	unsigned int m_next_id;
+	unsigned int m_timeout;
+	size_t m_num_ready;
+	size_t m_num_starting;
+	bool m_quit;
+
+	Statistics m_statistics;
+};
+
+#endif  // _COMPILE_SERVER_HPP_INCLUDED_
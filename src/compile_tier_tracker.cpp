@@ -0,0 +1,77 @@
+#include "common.hpp"
+#include "compile_tier_tracker.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// constructor
+//////////////////////////////////////////////////////////////////////////
+CompileTierTracker::CompileTierTracker()
+	: m_has_applied(false)
+{
+	m_applied.version = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void CompileTierTracker::OnSubmitted(const Compile& compile)
+{
+	m_inflight.push_back(compile);
+}
+
+void CompileTierTracker::OnCompiledInPlace(const Compile& compile)
+{
+	m_inflight.clear();
+	m_applied = compile;
+	m_has_applied = true;
+}
+
+void CompileTierTracker::OnUnchanged(const ContentHash& fingerprint)
+{
+	auto it = m_inflight.begin();
+	while (it != m_inflight.end())
+	{
+		if (it->fingerprint != fingerprint) it = m_inflight.erase(it);
+		else ++it;
+	}
+}
+
+bool CompileTierTracker::OnResult(size_t version, CompileTier tier, bool succeeded)
+{
+	// a compile in place may have overtaken this result.
+	if (version < m_applied.version) return false;
+
+	// so may an edit which reverted to the compiled code.
+	auto it = m_inflight.begin();
+	while (it != m_inflight.end() && it->version != version) ++it;
+	if (it == m_inflight.end()) return false;
+
+	// keep the entry itself, its optimized tier may still follow.
+	m_inflight.erase(m_inflight.begin(), it);
+
+	// a failed optimized compile leaves the fast shader running.
+	if (!succeeded && tier != CT_Fast) return false;
+
+	m_applied = m_inflight.front();
+	m_has_applied = true;
+	return true;
+}
+
+void CompileTierTracker::ForgetApplied()
+{
+	m_has_applied = false;
+}
+
+bool CompileTierTracker::IsApplied(const ContentHash& fingerprint) const
+{
+	return m_has_applied && m_applied.fingerprint == fingerprint;
+}
+
+const CompileTierTracker::Compile& CompileTierTracker::GetApplied() const
+{
+	return m_applied;
+}
+
+size_t CompileTierTracker::GetNumInflight() const
+{
+	return m_inflight.size();
+}
@@ -0,0 +1,66 @@
+#ifndef _COMPILE_TIER_TRACKER_HPP_INCLUDED_
+#define _COMPILE_TIER_TRACKER_HPP_INCLUDED_
+
+#include <deque>
+#include "content_hash.hpp"
+#include "shader_source_map.hpp"
+
+enum CompileTier
+{
+	CT_Fast,		// optimization skipped, gets pixels on screen quickly
+	CT_Optimized,	// fully optimized, replaces the fast one once ready
+	Num_CompileTiers,
+};
+
+// decides which finished live compiles the editor acts on. it is told of
+// every compile handed to the live compiler, of every compile done in
+// place, and of every edit which left the code as compiled, and drops the
+// results those overtook. a failed optimized compile is dropped as well,
+// the fast shader keeps running. it knows nothing about threads, compilers
+// or the device.
+class CompileTierTracker
+{
+public:
+	// a compile of one version of the document, and how its header was laid
+	// out, which its errors are mapped with.
+	struct Compile
+	{
+		size_t version;
+		ContentHash fingerprint;
+		ShaderSourceMapPtr header_map;
+	};
+
+public:
+	CompileTierTracker();
+
+public:
+	// handed to the live compiler, its tiers come back through OnResult.
+	void OnSubmitted(const Compile& compile);
+
+	// compiled in place, which overtakes everything in flight.
+	void OnCompiledInPlace(const Compile& compile);
+
+	// the text changed but its fingerprint is the applied one. results in
+	// flight for other code are stale, a later tier of this code is not.
+	void OnUnchanged(const ContentHash& fingerprint);
+
+	// a finished compile of the live compiler. returns true if the editor
+	// should act on it, by swapping it in or by showing its errors, after
+	// which the compile it came from is the applied one.
+	bool OnResult(size_t version, CompileTier tier, bool succeeded);
+
+	// the applied compile can not be compared with the text any more.
+	void ForgetApplied();
+
+	// whether the applied compile is of this fingerprint.
+	bool IsApplied(const ContentHash& fingerprint) const;
+	const Compile& GetApplied() const;
+	size_t GetNumInflight() const;
+
+private:
+	std::deque<Compile> m_inflight;
+	Compile m_applied;
+	bool m_has_applied;
+};
+
+#endif  // _COMPILE_TIER_TRACKER_HPP_INCLUDED_
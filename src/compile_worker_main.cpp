@@ -0,0 +1,129 @@
+#include "common.hpp"
+#include "compile_protocol.hpp"
+#include "stub_shader_compiler.hpp"
+#include "command_shader_compiler.hpp"
+#ifdef _WIN32
+#include "fxc_shader_compiler.hpp"
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <iostream>
+
+// a compile server worker: reads compile requests from the standard input
+// and answers each on the standard output, until the input is closed.
+//   compile_worker [--compiler stub|command|fxc] [--command TEMPLATE] [--delay MS]
+// it is started by CompileServer, never by hand. the stub worker dies on a
+// source containing stub_crash_marker, to exercise the restarts.
+
+static const char command_work_directory[] = "cache/worker";
+static const char stub_crash_marker[] = "compile_worker: crash here";
+
+static int ReadInput(char* buffer, size_t size)
+{
+#ifdef _WIN32
+	return _read(0, buffer, static_cast<unsigned int>(size));
+#else
+	return static_cast<int>(read(STDIN_FILENO, buffer, size));
+#endif
+}
+
+static bool WriteOutput(const std::string& data)
+{
+	return fwrite(data.data(), 1, data.length(), stdout) == data.length() && fflush(stdout) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef _WIN32
+	// frames are binary, newlines must pass untouched.
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+	std::string compiler_name = "fxc";
+#else
+	std::string compiler_name = "stub";
+#endif
+	std::string command;
+	unsigned int delay = 0;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--compiler" && has_value) compiler_name = argv[++i];
+		else if (arg == "--command" && has_value) {command = argv[++i]; compiler_name = "command";}
+		else if (arg == "--delay" && has_value) delay = lexical_cast_no_exception<unsigned int>(std::string(argv[++i]));
+		else
+		{
+			std::cerr << "compile_worker: unknown argument '" << arg << "'\n";
+			return 2;
+		}
+	}
+
+	ShaderCompilerPtr compiler;
+	if (compiler_name == "stub")
+	{
+		// the delay mimics a real compile, e.g. to exercise timeouts.
+		boost::shared_ptr<StubShaderCompiler> stub(new StubShaderCompiler);
+		stub->SetDefaultDelay(delay);
+		compiler = stub;
+	}
+	else if (compiler_name == "command" && !command.empty())
+	{
+		compiler = ShaderCompilerPtr(new CommandShaderCompiler(command, command_work_directory));
+	}
+#ifdef _WIN32
+	else if (compiler_name == "fxc")
+	{
+		compiler = ShaderCompilerPtr(new FxcShaderCompiler);
+	}
+#endif
+	if (!compiler)
+	{
+		std::cerr << "compile_worker: unknown compiler '" << compiler_name << "'\n";
+		return 2;
+	}
+
+	// only now is the worker warm.
+	std::string frame;
+	EncodeReadyFrame(frame);
+	if (!WriteOutput(frame)) return 1;
+
+	CompileFrameReader reader;
+	char buffer[64 * 1024];
+	while (true)
+	{
+		CompileFrameType type;
+		std::string payload;
+		while (reader.NextFrame(type, payload))
+		{
+			CompileRequest request;
+			if (type != CF_Request || !DecodeRequestPayload(payload, request))
+			{
+				std::cerr << "compile_worker: malformed request\n";
+				return 1;
+			}
+			if (compiler_name == "stub" && request.input.GetSource().find(stub_crash_marker) != std::string::npos) return 3;
+
+			ShaderCompileOutput output;
+			CompileResponse response;
+			response.id = request.id;
+			response.succeeded = compiler->Compile(request.input, output);
+			response.bytecode.swap(output.bytecode);
+			response.error_message.swap(output.error_message);
+
+			frame.clear();
+			EncodeResponseFrame(response, frame);
+			if (!WriteOutput(frame)) return 1;
+		}
+		if (reader.IsBroken()) return 1;
+
+		int num_read = ReadInput(buffer, sizeof(buffer));
+		if (num_read <= 0) break;
+		reader.Append(buffer, num_read);
+	}
+	return 0;
+}
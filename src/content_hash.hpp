@@ -0,0 +1,110 @@
+#ifndef _CONTENT_HASH_HPP_INCLUDED_
+#define _CONTENT_HASH_HPP_INCLUDED_
+
+#include <string>
+
+// a 128 bit content hash, built from two independent 64 bit lanes
+// (FNV-1a and a multiply-rotate mix). not cryptographic, but wide enough
+// to address cached data by content.
+struct ContentHash
+{
+	unsigned long long hi;
+	unsigned long long lo;
+
+	ContentHash() : hi(0), lo(0) {}
+
+	bool operator == (const ContentHash& rhs) const {return hi == rhs.hi && lo == rhs.lo;}
+	bool operator != (const ContentHash& rhs) const {return !(*this == rhs);}
+	bool operator <  (const ContentHash& rhs) const {return hi < rhs.hi || (hi == rhs.hi && lo < rhs.lo);}
+
+	std::string ToString() const
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string str(32, '0');
+		for (int i = 0; i != 16; ++i)
+		{
+			str[15 - i] = digits[(hi >> (i * 4)) & 0xF];
+			str[31 - i] = digits[(lo >> (i * 4)) & 0xF];
+		}
+		return str;
+	}
+
+	bool FromString(const std::string& str)
+	{
+		if (str.length() != 32) return false;
+
+		unsigned long long parts[2] = {0, 0};
+		for (int i = 0; i != 32; ++i)
+		{
+			char c = str[i];
+			unsigned long long v = 0;
+			if (c >= '0' && c <= '9') v = c - '0';
+			else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+			else return false;
+			parts[i / 16] = (parts[i / 16] << 4) | v;
+		}
+		hi = parts[0];
+		lo = parts[1];
+		return true;
+	}
+};
+
+class ContentHasher
+{
+public:
+	ContentHasher()
+		: m_fnv(14695981039346656037ULL)
+		, m_mix(0x9E3779B97F4A7C15ULL)
+		, m_length(0)
+	{
+
+	}
+
+public:
+	void Update(const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		unsigned long long fnv = m_fnv;
+		unsigned long long mix = m_mix;
+		for (size_t i = 0; i != size; ++i)
+		{
+			fnv = (fnv ^ bytes[i]) * 1099511628211ULL;
+			mix = (mix ^ bytes[i]) * 0xFF51AFD7ED558CCDULL;
+			mix = (mix << 29) | (mix >> 35);
+		}
+		m_fnv = fnv;
+		m_mix = mix;
+		m_length += size;
+	}
+
+	// length prefixed, so consecutive fields can not run into each other.
+	void Update(const std::string& str)
+	{
+		UpdateValue(str.length());
+		Update(str.data(), str.length());
+	}
+
+	void UpdateValue(unsigned long long value)
+	{
+		Update(&value, sizeof(value));
+	}
+
+	ContentHash Finish() const
+	{
+		ContentHash hash;
+		hash.lo = m_fnv ^ m_length;
+		unsigned long long mix = m_mix ^ (m_length * 0xC4CEB9FE1A85EC53ULL);
+		mix ^= mix >> 33;
+		mix *= 0xFF51AFD7ED558CCDULL;
+		mix ^= mix >> 33;
+		hash.hi = mix;
+		return hash;
+	}
+
+private:
+	unsigned long long m_fnv;
+	unsigned long long m_mix;
+	unsigned long long m_length;
+};
+
+#endif  // _CONTENT_HASH_HPP_INCLUDED_
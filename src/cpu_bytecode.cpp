@@ -0,0 +1,145 @@
+#include "common.hpp"
+#include "cpu_bytecode.hpp"
+
+#include <ostream>
+
+static const char* opcode_names[] =
+{
+	"move", "swizzle", "scatter",
+	"ftoi", "tobool",
+	"add", "sub", "mul", "div", "mod", "idiv", "imod", "neg",
+	"lt", "le", "gt", "ge", "eq", "ne", "and", "or", "not",
+	"bitand", "bitor", "bitxor", "shl", "shr", "bitnot", "select",
+	"abs", "acos", "asin", "atan", "atan2", "ceil", "clamp", "cos",
+	"cosh", "degrees", "exp", "exp2", "floor", "fmod", "frac", "isinf",
+	"isnan", "lerp", "log", "log10", "log2", "max", "min", "pow",
+	"radians", "round", "rsqrt", "saturate", "sign", "sin", "sinh", "smoothstep",
+	"sqrt", "step", "tan", "tanh", "trunc", "ddx", "ddy", "fwidth",
+	"dot", "length", "distance", "any", "all", "snoise", "qnoise", "normalize",
+	"reflect", "refract", "cross", "hash", "grad4", "sample",
+	"if", "else", "endif", "loop", "break", "breakifnot", "continue", "continuepoint",
+	"endloop", "begincall", "return", "endcall", "discard", "end",
+};
+
+const unsigned int CpuBytecode::no_register;
+
+static const char register_kind_names[] = "cuiv";
+static const char component_names[] = "xyzw";
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+const char* CpuBytecode::GetOpcodeName(Opcode opcode)
+{
+	return opcode_names[opcode];
+}
+
+unsigned char CpuBytecode::MakeSwizzle(unsigned int x, unsigned int y, unsigned int z, unsigned int w)
+{
+	return static_cast<unsigned char>(x | y << 2 | z << 4 | w << 6);
+}
+
+unsigned int CpuBytecode::GetSwizzleComponent(unsigned char swizzle, unsigned int i)
+{
+	return swizzle >> (i * 2) & 3;
+}
+
+unsigned int CpuBytecode::GetNumArgs(Opcode opcode)
+{
+	switch (opcode)
+	{
+	case OC_Add: case OC_Subtract: case OC_Multiply: case OC_Divide: case OC_Modulo:
+	case OC_IntDivide: case OC_IntModulo:
+	case OC_Less: case OC_LessEqual: case OC_Greater: case OC_GreaterEqual: case OC_Equal: case OC_NotEqual:
+	case OC_And: case OC_Or: case OC_BitAnd: case OC_BitOr: case OC_BitXor: case OC_ShiftLeft: case OC_ShiftRight:
+	case OC_Atan2: case OC_Fmod: case OC_Max: case OC_Min: case OC_Pow: case OC_Step:
+	case OC_Dot: case OC_Distance: case OC_Reflect: case OC_Cross: case OC_Grad4: case OC_Sample:
+		return 2;
+
+	case OC_Select: case OC_Clamp: case OC_Lerp: case OC_Smoothstep: case OC_Refract:
+		return 3;
+
+	case OC_Else: case OC_EndIf: case OC_Loop: case OC_Break: case OC_Continue:
+	case OC_ContinuePoint: case OC_EndLoop: case OC_BeginCall: case OC_Return: case OC_EndCall:
+	case OC_Discard: case OC_End:
+		return 0;
+
+	default:
+		return 1;
+	}
+}
+
+bool CpuBytecode::WritesDest(Opcode opcode)
+{
+	// the loop ops count their iterations in dest.
+	return opcode < OC_If || opcode == OC_Loop || opcode == OC_EndLoop;
+}
+
+float CpuBytecode::BitOp(Opcode opcode, unsigned int flags, float a, float b)
+{
+	bool is_unsigned = (flags & IF_Unsigned) != 0;
+	long long x = static_cast<long long>(a), y = static_cast<long long>(b);
+	long long z = 0;
+	if (opcode == OC_BitAnd) z = x & y;
+	else if (opcode == OC_BitOr) z = x | y;
+	else if (opcode == OC_BitXor) z = x ^ y;
+	else if (opcode == OC_ShiftLeft) z = x << (y & 31);
+	else if (opcode == OC_ShiftRight) z = x >> (y & 31);
+	else return is_unsigned ? static_cast<float>(~static_cast<unsigned int>(a)) : static_cast<float>(~static_cast<int>(a));
+	return is_unsigned ? static_cast<float>(static_cast<unsigned int>(z)) : static_cast<float>(static_cast<int>(z));
+}
+
+void CpuBytecode::Dump(std::ostream& os) const
+{
+	for (size_t i = 0; i != registers.size(); ++i)
+	{
+		const Register& reg = registers[i];
+		if (reg.kind == RK_Variable) continue;
+		os << "  " << register_kind_names[reg.kind] << i << ": " << CpuShaderProgram::GetTypeName(reg.type);
+		if (reg.kind == RK_Constant)
+		{
+			os << " (";
+			for (unsigned int j = 0; j != reg.type.size; ++j) os << (j == 0 ? "" : ", ") << reg.value[j];
+			os << ")";
+		}
+		else if (reg.kind == RK_Uniform) os << " at " << reg.offset;
+		os << "\n";
+	}
+
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		const Instruction& ins = code[i];
+		Opcode opcode = static_cast<Opcode>(ins.opcode);
+		os << "  " << i << ": " << GetOpcodeName(opcode);
+		if (opcode < OC_If) os << "." << static_cast<unsigned int>(ins.size);
+		if (opcode == OC_Swizzle || opcode == OC_Scatter)
+		{
+			os << " ";
+			for (unsigned int j = 0; j != ins.size; ++j) os << component_names[GetSwizzleComponent(ins.swizzle, j)];
+		}
+
+		const char* separator = " ";
+		if (WritesDest(opcode))
+		{
+			os << separator << register_kind_names[registers[ins.dest].kind] << ins.dest;
+			separator = ", ";
+		}
+		for (unsigned int j = 0; j != GetNumArgs(opcode); ++j)
+		{
+			os << separator << register_kind_names[registers[ins.args[j]].kind] << ins.args[j];
+			separator = ", ";
+		}
+		if (opcode == OC_Sample) os << separator << "t" << ins.target << ((ins.flags & IF_ImplicitLevel) != 0 ? " implicit" : "");
+		else if (opcode >= OC_If && opcode != OC_EndIf && opcode != OC_ContinuePoint && opcode != OC_EndCall && opcode != OC_Discard && opcode != OC_End)
+		{
+			os << separator << "-> " << ins.target;
+		}
+		os << "\n";
+	}
+
+	if (prologue)
+	{
+		os << "  once a frame, to " << hoisted.size() << " uniforms from " << hoisted_offset << ":\n";
+		prologue->Dump(os);
+	}
+}
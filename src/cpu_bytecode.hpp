@@ -0,0 +1,196 @@
+#ifndef _CPU_BYTECODE_HPP_INCLUDED_
+#define _CPU_BYTECODE_HPP_INCLUDED_
+
+#include <iosfwd>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "cpu_shader_math.hpp"
+#include "cpu_shader_program.hpp"
+
+// a shader lowered for the cpu engines: a flat list of instructions on
+// vector registers of up to four floats. every call is inlined, HLSL has no
+// recursion, so the code is straight through but for the structured control
+// flow ops, which a scalar engine takes as jumps and a wide one as masks.
+struct CpuBytecode
+{
+	enum Opcode
+	{
+		// moves. swizzle holds 2 bits per component.
+		OC_Move,				// dest = a
+		OC_Swizzle,				// dest[i] = a[swizzle[i]]
+		OC_Scatter,				// dest[swizzle[i]] = a[i], the rest kept
+
+		// conversions, ints and bools are floats already.
+		OC_FloatToInt,			// truncates
+		OC_ToBool,
+
+		// arithmetic and logic, componentwise.
+		OC_Add,
+		OC_Subtract,
+		OC_Multiply,
+		OC_Divide,
+		OC_Modulo,
+		OC_IntDivide,
+		OC_IntModulo,
+		OC_Negate,
+		OC_Less,
+		OC_LessEqual,
+		OC_Greater,
+		OC_GreaterEqual,
+		OC_Equal,
+		OC_NotEqual,
+		OC_And,
+		OC_Or,
+		OC_Not,
+		OC_BitAnd,				// the bit ops take IF_Unsigned
+		OC_BitOr,
+		OC_BitXor,
+		OC_ShiftLeft,
+		OC_ShiftRight,
+		OC_BitNot,
+		OC_Select,				// dest = a ? b : c, a scalar if IF_ScalarCondition
+
+		// componentwise intrinsics.
+		OC_Abs,
+		OC_Acos,
+		OC_Asin,
+		OC_Atan,
+		OC_Atan2,
+		OC_Ceil,
+		OC_Clamp,
+		OC_Cos,
+		OC_Cosh,
+		OC_Degrees,
+		OC_Exp,
+		OC_Exp2,
+		OC_Floor,
+		OC_Fmod,
+		OC_Frac,
+		OC_Isinf,
+		OC_Isnan,
+		OC_Lerp,
+		OC_Log,
+		OC_Log10,
+		OC_Log2,
+		OC_Max,
+		OC_Min,
+		OC_Pow,
+		OC_Radians,
+		OC_Round,
+		OC_Rsqrt,
+		OC_Saturate,
+		OC_Sign,
+		OC_Sin,
+		OC_Sinh,
+		OC_Smoothstep,
+		OC_Sqrt,
+		OC_Step,
+		OC_Tan,
+		OC_Tanh,
+		OC_Trunc,
+		OC_Ddx,
+		OC_Ddy,
+		OC_Fwidth,
+
+		// size is of the arguments, the result of the first seven is a scalar.
+		OC_Dot,
+		OC_Length,
+		OC_Distance,
+		OC_Any,
+		OC_All,
+		OC_Snoise,				// fx/snoise.hlsl at a
+		OC_Qnoise,				// fx/qnoise.hlsl at a
+		OC_Normalize,
+		OC_Reflect,
+		OC_Refract,				// c is the scalar eta
+		OC_Cross,
+		OC_Hash,				// __hash of fx/qnoise.hlsl, of size 4
+		OC_Grad4,				// __grad4 of fx/snoise.hlsl, of the scalar a and b.xyz
+		OC_Sample,				// dest = texture target at a.xy, level b or by IF_ImplicitLevel
+
+		// structured control flow. target is where a scalar engine jumps.
+		OC_If,					// on a false a, to past the else or endif
+		OC_Else,				// to past the endif
+		OC_EndIf,
+		OC_Loop,				// dest is the iteration counter, target past the endloop
+		OC_Break,				// to past the endloop
+		OC_BreakIfNot,			// on a false a
+		OC_Continue,			// to the continue point
+		OC_ContinuePoint,
+		OC_EndLoop,				// to past the loop, or out if cut off
+		OC_BeginCall,			// target past the endcall
+		OC_Return,				// to the endcall
+		OC_EndCall,
+		OC_Discard,
+		OC_End,
+
+		Num_Opcodes,
+	};
+
+	enum InstructionFlag
+	{
+		IF_Unsigned			= 1,
+		IF_ScalarCondition	= 2,
+		IF_ImplicitLevel	= 4,	// a Sample's level is of the quad's derivatives of a
+	};
+
+	struct Instruction
+	{
+		unsigned char opcode;
+		unsigned char size;		// components written, or read by a reduction
+		unsigned char flags;
+		unsigned char swizzle;
+		unsigned int dest;
+		unsigned int args[3];
+		unsigned int target;	// of a jump, or the texture slot
+	};
+
+	enum RegisterKind
+	{
+		RK_Constant,			// value, never written
+		RK_Uniform,				// offset in the cbuffer, never written
+		RK_Input,				// a parameter of the entry point
+		RK_Variable,			// a variable, or a temporary
+	};
+
+	struct Register
+	{
+		RegisterKind kind;
+		CpuShaderProgram::Type type;
+		float value[4];
+		size_t offset;
+	};
+
+	std::vector<Instruction> code;
+	std::vector<Register> registers;
+	std::vector<unsigned int> inputs;	// by parameter of the entry point, or none
+	unsigned int output;				// the color, of output_size components
+	unsigned int output_size;
+	size_t num_textures;
+	bool uses_derivatives;
+	CpuShaderMath::Precision precision;	// of the transcendental ops
+
+	// what the optimizer hoisted out of the code, to run once a frame. it
+	// reads the cbuffer, and leaves in its registers of hoisted the values
+	// the code reads as uniforms, four floats each from hoisted_offset.
+	boost::shared_ptr<CpuBytecode> prologue;
+	std::vector<unsigned int> hoisted;
+	size_t hoisted_offset;
+
+	static const unsigned int no_register = static_cast<unsigned int>(-1);
+
+	static const char* GetOpcodeName(Opcode opcode);
+	static unsigned char MakeSwizzle(unsigned int x, unsigned int y, unsigned int z, unsigned int w);
+	static unsigned int GetSwizzleComponent(unsigned char swizzle, unsigned int i);
+
+	// how many of a, b and c an op reads, and whether it writes dest.
+	static unsigned int GetNumArgs(Opcode opcode);
+	static bool WritesDest(Opcode opcode);
+
+	// the bitwise ops, on the integers the floats hold.
+	static float BitOp(Opcode opcode, unsigned int flags, float a, float b);
+
+	void Dump(std::ostream& os) const;
+};
+
+#endif  // _CPU_BYTECODE_HPP_INCLUDED_
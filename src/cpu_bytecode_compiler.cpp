@@ -0,0 +1,1026 @@
+#include "common.hpp"
+#include "cpu_bytecode_compiler.hpp"
+#include "cpu_bytecode_optimizer.hpp"
+#include "cpu_shader_math.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+typedef CpuShaderProgram Program;
+typedef CpuBytecode Bytecode;
+
+static const unsigned char identity_swizzle = 0xe4;
+
+static Bytecode::Opcode BinaryOpcode(Program::Operator op, bool is_integer)
+{
+	switch (op)
+	{
+	case Program::OP_Add: return Bytecode::OC_Add;
+	case Program::OP_Subtract: return Bytecode::OC_Subtract;
+	case Program::OP_Multiply: return Bytecode::OC_Multiply;
+	case Program::OP_Divide: return is_integer ? Bytecode::OC_IntDivide : Bytecode::OC_Divide;
+	case Program::OP_Modulo: return is_integer ? Bytecode::OC_IntModulo : Bytecode::OC_Modulo;
+	case Program::OP_Less: return Bytecode::OC_Less;
+	case Program::OP_LessEqual: return Bytecode::OC_LessEqual;
+	case Program::OP_Greater: return Bytecode::OC_Greater;
+	case Program::OP_GreaterEqual: return Bytecode::OC_GreaterEqual;
+	case Program::OP_Equal: return Bytecode::OC_Equal;
+	case Program::OP_NotEqual: return Bytecode::OC_NotEqual;
+	case Program::OP_And: return Bytecode::OC_And;
+	case Program::OP_Or: return Bytecode::OC_Or;
+	case Program::OP_BitAnd: return Bytecode::OC_BitAnd;
+	case Program::OP_BitOr: return Bytecode::OC_BitOr;
+	case Program::OP_BitXor: return Bytecode::OC_BitXor;
+	case Program::OP_ShiftLeft: return Bytecode::OC_ShiftLeft;
+	default: return Bytecode::OC_ShiftRight;
+	}
+}
+
+// sincos and the texture methods are lowered by hand.
+static Bytecode::Opcode IntrinsicOpcode(Program::Intrinsic intrinsic)
+{
+	switch (intrinsic)
+	{
+	case Program::IN_Abs: return Bytecode::OC_Abs;
+	case Program::IN_Acos: return Bytecode::OC_Acos;
+	case Program::IN_All: return Bytecode::OC_All;
+	case Program::IN_Any: return Bytecode::OC_Any;
+	case Program::IN_Asin: return Bytecode::OC_Asin;
+	case Program::IN_Atan: return Bytecode::OC_Atan;
+	case Program::IN_Atan2: return Bytecode::OC_Atan2;
+	case Program::IN_Ceil: return Bytecode::OC_Ceil;
+	case Program::IN_Clamp: return Bytecode::OC_Clamp;
+	case Program::IN_Cos: return Bytecode::OC_Cos;
+	case Program::IN_Cosh: return Bytecode::OC_Cosh;
+	case Program::IN_Cross: return Bytecode::OC_Cross;
+	case Program::IN_Ddx: return Bytecode::OC_Ddx;
+	case Program::IN_Ddy: return Bytecode::OC_Ddy;
+	case Program::IN_Degrees: return Bytecode::OC_Degrees;
+	case Program::IN_Distance: return Bytecode::OC_Distance;
+	case Program::IN_Dot: return Bytecode::OC_Dot;
+	case Program::IN_Exp: return Bytecode::OC_Exp;
+	case Program::IN_Exp2: return Bytecode::OC_Exp2;
+	case Program::IN_Floor: return Bytecode::OC_Floor;
+	case Program::IN_Fmod: return Bytecode::OC_Fmod;
+	case Program::IN_Frac: return Bytecode::OC_Frac;
+	case Program::IN_Fwidth: return Bytecode::OC_Fwidth;
+	case Program::IN_Isinf: return Bytecode::OC_Isinf;
+	case Program::IN_Isnan: return Bytecode::OC_Isnan;
+	case Program::IN_Length: return Bytecode::OC_Length;
+	case Program::IN_Lerp: return Bytecode::OC_Lerp;
+	case Program::IN_Log: return Bytecode::OC_Log;
+	case Program::IN_Log10: return Bytecode::OC_Log10;
+	case Program::IN_Log2: return Bytecode::OC_Log2;
+	case Program::IN_Max: return Bytecode::OC_Max;
+	case Program::IN_Min: return Bytecode::OC_Min;
+	case Program::IN_Normalize: return Bytecode::OC_Normalize;
+	case Program::IN_Pow: return Bytecode::OC_Pow;
+	case Program::IN_Radians: return Bytecode::OC_Radians;
+	case Program::IN_Reflect: return Bytecode::OC_Reflect;
+	case Program::IN_Refract: return Bytecode::OC_Refract;
+	case Program::IN_Round: return Bytecode::OC_Round;
+	case Program::IN_Rsqrt: return Bytecode::OC_Rsqrt;
+	case Program::IN_Saturate: return Bytecode::OC_Saturate;
+	case Program::IN_Sign: return Bytecode::OC_Sign;
+	case Program::IN_Sin: return Bytecode::OC_Sin;
+	case Program::IN_Sinh: return Bytecode::OC_Sinh;
+	case Program::IN_Smoothstep: return Bytecode::OC_Smoothstep;
+	case Program::IN_Sqrt: return Bytecode::OC_Sqrt;
+	case Program::IN_Step: return Bytecode::OC_Step;
+	case Program::IN_Tan: return Bytecode::OC_Tan;
+	case Program::IN_Tanh: return Bytecode::OC_Tanh;
+	case Program::IN_Trunc: return Bytecode::OC_Trunc;
+	default: return Bytecode::Num_Opcodes;
+	}
+}
+
+// the functions of the fx headers with ops of their own, by the digest of
+// their tokens. a shader that edits one, or a macro it uses, digests to
+// something else and has its own version inlined.
+struct LibraryFunction
+{
+	const char* name;
+	const char* digest;
+	Bytecode::Opcode opcode;
+};
+
+static const LibraryFunction library_functions[] =
+{
+	{"snoise(float2)", "e0efaba420be087b21165deb61f3189c", Bytecode::OC_Snoise},
+	{"snoise(float3)", "6dd97e65dbb9aef925f294bc906cb88b", Bytecode::OC_Snoise},
+	{"snoise(float4)", "97dcaa6c7fa3348ba0e1d4e8a668fc20", Bytecode::OC_Snoise},
+	{"__grad4", "d5e1e68f6f8a2415c29f16e2fcbdc6a1", Bytecode::OC_Grad4},
+	{"qnoise(float2)", "ccdbef3e14195c47d2c91c2eb2b49993", Bytecode::OC_Qnoise},
+	{"qnoise(float3)", "2709a1a3670947fead47728a4e33a1c3", Bytecode::OC_Qnoise},
+	{"__hash", "e34234d960b03d382b7dacba71570d67", Bytecode::OC_Hash},
+};
+
+static Bytecode::Opcode LibraryOpcode(const Program::Function& function)
+{
+	std::string digest = function.digest.ToString();
+	for (size_t i = 0; i != sizeof(library_functions) / sizeof(library_functions[0]); ++i)
+	{
+		if (digest == library_functions[i].digest) return library_functions[i].opcode;
+	}
+	return Bytecode::Num_Opcodes;
+}
+
+// whether an intrinsic reads whole vectors rather than one component at a time.
+static bool IsReduction(Bytecode::Opcode opcode)
+{
+	return opcode >= Bytecode::OC_Dot && opcode <= Bytecode::OC_Cross;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuBytecodeCompiler::CpuBytecodeCompiler()
+	: m_program(NULL)
+	, m_bytecode(NULL)
+	, m_optimizer(NULL)
+	, m_precision(CpuShaderMath::PR_Precise)
+	, m_is_library_enabled(true)
+{
+
+}
+
+CpuBytecodeCompiler::~CpuBytecodeCompiler()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool CpuBytecodeCompiler::Compile(const CpuShaderProgram& program, CpuBytecode& bytecode)
+{
+	m_program = &program;
+	m_bytecode = &bytecode;
+	m_error.clear();
+	m_roles.clear();
+	m_calls.clear();
+	m_loops.clear();
+
+	bytecode.code.clear();
+	bytecode.registers.clear();
+	bytecode.inputs.clear();
+	bytecode.output = CpuBytecode::no_register;
+	bytecode.output_size = 0;
+	bytecode.num_textures = program.GetNumTextures();
+	bytecode.uses_derivatives = program.UsesDerivatives();
+	bytecode.precision = m_precision;
+	bytecode.prologue.reset();
+	bytecode.hoisted.clear();
+	bytecode.hoisted_offset = 0;
+
+	// the cbuffer is read in place, the statics get a register each.
+	const std::vector<Program::Variable>& variables = program.GetVariables();
+	m_variable_registers.assign(variables.size(), CpuBytecode::no_register);
+	for (size_t i = 0; i != variables.size(); ++i)
+	{
+		const Program::Variable& variable = variables[i];
+		if (!variable.is_global || variable.type.base == Program::BT_Texture || variable.type.base == Program::BT_Sampler) continue;
+		if (variable.is_uniform)
+		{
+			m_variable_registers[i] = NewRegister(CpuBytecode::RK_Uniform, variable.type);
+			bytecode.registers.back().offset = variable.offset;
+		}
+		else m_variable_registers[i] = NewRegister(CpuBytecode::RK_Variable, variable.type, RR_Static);
+	}
+
+	const std::vector<Program::Function>& functions = program.GetFunctions();
+	m_writes.assign(functions.size(), std::set<size_t>());
+	for (size_t i = 0; i != functions.size(); ++i)
+	{
+		if (functions[i].body) FindWrites(*functions[i].body, m_writes[i]);
+	}
+
+	const std::vector<Program::StmtPtr>& inits = program.GetGlobalInits();
+	for (size_t i = 0; i != inits.size(); ++i) CompileStatement(*inits[i]);
+
+	// the parameters of the entry point come in registers of their own.
+	const Program::Function& entry = functions[program.GetEntryPoint()];
+	bytecode.inputs.assign(entry.params.size(), CpuBytecode::no_register);
+	for (size_t i = 0; i != entry.params.size(); ++i)
+	{
+		const Program::Variable& param = variables[entry.params[i]];
+		if (param.mode != Program::PM_Out)
+		{
+			bytecode.inputs[i] = NewRegister(CpuBytecode::RK_Input, param.type, RR_Local);
+			m_variable_registers[entry.params[i]] = bytecode.inputs[i];
+		}
+		else
+		{
+			m_variable_registers[entry.params[i]] = NewRegister(CpuBytecode::RK_Variable, param.type, RR_Local);
+			Emit(CpuBytecode::OC_Move, param.type.size, m_variable_registers[entry.params[i]], Zero(param.type));
+		}
+	}
+
+	unsigned int result = CpuBytecode::no_register;
+	if (entry.return_type.base != Program::BT_Void) result = NewRegister(CpuBytecode::RK_Variable, entry.return_type);
+	CompileBody(program.GetEntryPoint(), result);
+	Emit(CpuBytecode::OC_End, 0, 0);
+
+	// a void entry point writes its color to the first out parameter.
+	bytecode.output = result;
+	bytecode.output_size = entry.return_type.size;
+	for (size_t i = 0; i != entry.params.size() && bytecode.output == CpuBytecode::no_register; ++i)
+	{
+		const Program::Variable& param = variables[entry.params[i]];
+		if (param.mode == Program::PM_In) continue;
+		bytecode.output = m_variable_registers[entry.params[i]];
+		bytecode.output_size = param.type.size;
+	}
+	if (bytecode.output == CpuBytecode::no_register)
+	{
+		bytecode.output = Zero(Program::MakeType(Program::BT_Float, 4));
+		bytecode.output_size = 4;
+	}
+
+	if (m_optimizer && m_error.empty()) m_optimizer->Optimize(bytecode);
+	AllocateRegisters();
+	return m_error.empty();
+}
+
+const std::string& CpuBytecodeCompiler::GetError() const
+{
+	return m_error;
+}
+
+void CpuBytecodeCompiler::SetOptimizer(CpuBytecodeOptimizer* optimizer)
+{
+	m_optimizer = optimizer;
+}
+
+void CpuBytecodeCompiler::SetPrecision(CpuShaderMath::Precision precision)
+{
+	m_precision = precision;
+}
+
+void CpuBytecodeCompiler::EnableLibrary(bool is_enabled)
+{
+	m_is_library_enabled = is_enabled;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void CpuBytecodeCompiler::CompileStatement(const Stmt& stmt)
+{
+	std::vector<CpuBytecode::Instruction>& code = m_bytecode->code;
+	switch (stmt.kind)
+	{
+	case Program::SK_Block:
+		for (size_t i = 0; i != stmt.body.size(); ++i) CompileStatement(*stmt.body[i]);
+		break;
+
+	case Program::SK_Expression:
+		CompileExpression(*stmt.expr);
+		break;
+
+	case Program::SK_Declare:
+		{
+			// a fresh register for every declaration, the allocator packs them.
+			const Program::Variable& variable = m_program->GetVariables()[stmt.variable];
+			unsigned int reg = m_variable_registers[stmt.variable];
+			if (!variable.is_global) reg = m_variable_registers[stmt.variable] = NewRegister(CpuBytecode::RK_Variable, variable.type, RR_Local);
+			if (stmt.expr) CompileExpression(*stmt.expr, reg);
+			else Emit(CpuBytecode::OC_Move, variable.type.size, reg, Zero(variable.type));
+		}
+		break;
+
+	case Program::SK_If:
+		{
+			size_t branch = Emit(CpuBytecode::OC_If, 0, 0, CompileExpression(*stmt.expr));
+			CompileStatement(*stmt.body[0]);
+			if (stmt.body.size() > 1)
+			{
+				size_t otherwise = Emit(CpuBytecode::OC_Else, 0, 0);
+				code[branch].target = static_cast<unsigned int>(otherwise);
+				branch = otherwise;
+				CompileStatement(*stmt.body[1]);
+			}
+			code[branch].target = static_cast<unsigned int>(Emit(CpuBytecode::OC_EndIf, 0, 0));
+		}
+		break;
+
+	case Program::SK_For:
+	case Program::SK_While:
+	case Program::SK_Do:
+		CompileLoop(stmt);
+		break;
+
+	case Program::SK_Return:
+		{
+			// the calls inlined into the value may grow m_calls.
+			unsigned int result = m_calls.back().result;
+			if (stmt.expr) CompileExpression(*stmt.expr, result);
+			if (m_calls.back().has_early_return) m_calls.back().returns.push_back(Emit(CpuBytecode::OC_Return, 0, 0));
+		}
+		break;
+
+	case Program::SK_Break:
+		m_loops.back().breaks.push_back(Emit(CpuBytecode::OC_Break, 0, 0));
+		break;
+
+	case Program::SK_Continue:
+		m_loops.back().continues.push_back(Emit(CpuBytecode::OC_Continue, 0, 0));
+		break;
+
+	case Program::SK_Discard:
+		Emit(CpuBytecode::OC_Discard, 0, 0);
+		break;
+	}
+}
+
+void CpuBytecodeCompiler::CompileLoop(const Stmt& stmt)
+{
+	std::vector<CpuBytecode::Instruction>& code = m_bytecode->code;
+	if (stmt.kind == Program::SK_For) CompileStatement(*stmt.body[0]);
+
+	// the iterations are counted to cut off a loop that runs away.
+	unsigned int counter = NewRegister(CpuBytecode::RK_Variable, Program::MakeType(Program::BT_Int, 1));
+	size_t begin = Emit(CpuBytecode::OC_Loop, 1, counter);
+	m_loops.push_back(Loop());
+	if (stmt.kind != Program::SK_Do && stmt.expr)
+	{
+		unsigned int condition = CompileExpression(*stmt.expr);
+		m_loops.back().breaks.push_back(Emit(CpuBytecode::OC_BreakIfNot, 0, 0, condition));
+	}
+	CompileStatement(*stmt.body.back());
+
+	size_t continue_point = Emit(CpuBytecode::OC_ContinuePoint, 0, 0);
+	if (stmt.step) CompileExpression(*stmt.step);
+	if (stmt.kind == Program::SK_Do)
+	{
+		unsigned int condition = CompileExpression(*stmt.expr);
+		m_loops.back().breaks.push_back(Emit(CpuBytecode::OC_BreakIfNot, 0, 0, condition));
+	}
+	size_t end = Emit(CpuBytecode::OC_EndLoop, 1, counter);
+
+	code[begin].target = static_cast<unsigned int>(end);
+	code[end].target = static_cast<unsigned int>(begin);
+	const Loop& loop = m_loops.back();
+	for (size_t i = 0; i != loop.breaks.size(); ++i) code[loop.breaks[i]].target = static_cast<unsigned int>(end);
+	for (size_t i = 0; i != loop.continues.size(); ++i) code[loop.continues[i]].target = static_cast<unsigned int>(continue_point);
+	m_loops.pop_back();
+}
+
+unsigned int CpuBytecodeCompiler::CompileExpression(const Expr& expr, unsigned int dest)
+{
+	const std::vector<CpuBytecode::Register>& registers = m_bytecode->registers;
+	unsigned int value = CpuBytecode::no_register;
+	switch (expr.kind)
+	{
+	case Program::EK_Constant:
+		value = NewConstant(expr.type, expr.value);
+		break;
+
+	case Program::EK_Variable:
+		value = m_variable_registers[expr.variable];
+		if (value == CpuBytecode::no_register) value = Zero(expr.type);
+		break;
+
+	case Program::EK_Swizzle:
+		{
+			unsigned int object = CompileExpression(*expr.args[0]);
+			bool is_prefix = true;
+			unsigned char swizzle = 0;
+			for (unsigned int i = 0; i != expr.type.size; ++i)
+			{
+				is_prefix = is_prefix && expr.components[i] == i;
+				swizzle |= expr.components[i] << (i * 2);
+			}
+
+			// a prefix is the same register read shorter.
+			if (is_prefix) value = object;
+			else if (registers[object].kind == CpuBytecode::RK_Constant)
+			{
+				float swizzled[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+				for (unsigned int i = 0; i != expr.type.size; ++i) swizzled[i] = registers[object].value[expr.components[i]];
+				value = NewConstant(expr.type, swizzled);
+			}
+			else
+			{
+				value = Fresh(dest, expr.type);
+				m_bytecode->code[Emit(CpuBytecode::OC_Swizzle, expr.type.size, value, object)].swizzle = swizzle;
+			}
+		}
+		break;
+
+	case Program::EK_Convert:
+		value = Convert(CompileExpression(*expr.args[0]), expr.args[0]->type, expr.type, dest);
+		break;
+
+	case Program::EK_Construct:
+		value = CompileConstruct(expr, dest);
+		break;
+
+	case Program::EK_Unary:
+		{
+			unsigned int operand = CompileExpression(*expr.args[0]);
+			Opcode opcode = CpuBytecode::OC_BitNot;
+			if (expr.op == Program::OP_Negate) opcode = CpuBytecode::OC_Negate;
+			else if (expr.op == Program::OP_Not) opcode = CpuBytecode::OC_Not;
+			value = Fresh(dest, expr.type);
+			size_t at = Emit(opcode, expr.type.size, value, operand);
+			if (expr.type.base == Program::BT_Uint) m_bytecode->code[at].flags |= CpuBytecode::IF_Unsigned;
+		}
+		break;
+
+	case Program::EK_Binary:
+		value = CompileBinary(expr, dest);
+		break;
+
+	case Program::EK_Conditional:
+		{
+			// both sides, as the gpu does.
+			std::vector<unsigned int> args;
+			CompileArguments(expr.args, args);
+			value = Fresh(dest, expr.type);
+			size_t at = Emit(CpuBytecode::OC_Select, expr.type.size, value, args[0], args[1], args[2]);
+			if (expr.args[0]->type.size == 1) m_bytecode->code[at].flags |= CpuBytecode::IF_ScalarCondition;
+		}
+		break;
+
+	case Program::EK_Assign:
+		{
+			// straight into a variable, through a scatter into a swizzle.
+			const Expr& target = *expr.args[0];
+			if (target.kind == Program::EK_Variable) value = CompileExpression(*expr.args[1], m_variable_registers[target.variable]);
+			else
+			{
+				value = CompileExpression(*expr.args[1]);
+				Store(target, value);
+			}
+		}
+		break;
+
+	case Program::EK_Increment:
+		value = CompileIncrement(expr);
+		break;
+
+	case Program::EK_Call:
+		value = CompileCall(expr);
+		break;
+
+	case Program::EK_Intrinsic:
+		value = CompileIntrinsic(expr, dest);
+		break;
+
+	case Program::EK_Comma:
+		CompileExpression(*expr.args[0]);
+		value = CompileExpression(*expr.args[1], dest);
+		break;
+	}
+
+	if (dest == CpuBytecode::no_register || value == CpuBytecode::no_register) return value;
+	if (value != dest) Emit(CpuBytecode::OC_Move, expr.type.size, dest, value);
+	return dest;
+}
+
+unsigned int CpuBytecodeCompiler::CompileBinary(const Expr& expr, unsigned int dest)
+{
+	std::vector<unsigned int> args;
+	CompileArguments(expr.args, args);
+
+	const Type& type = expr.args[0]->type;
+	bool is_integer = type.base == Program::BT_Int || type.base == Program::BT_Uint || type.base == Program::BT_Bool;
+	unsigned int value = Fresh(dest, expr.type);
+	size_t at = Emit(BinaryOpcode(expr.op, is_integer), type.size, value, args[0], args[1]);
+	if (type.base == Program::BT_Uint) m_bytecode->code[at].flags |= CpuBytecode::IF_Unsigned;
+	return value;
+}
+
+unsigned int CpuBytecodeCompiler::CompileConstruct(const Expr& expr, unsigned int dest)
+{
+	const std::vector<CpuBytecode::Register>& registers = m_bytecode->registers;
+	std::vector<unsigned int> parts;
+	CompileArguments(expr.args, parts);
+
+	bool is_constant = true;
+	for (size_t i = 0; i != parts.size(); ++i) is_constant = is_constant && registers[parts[i]].kind == CpuBytecode::RK_Constant;
+	if (is_constant)
+	{
+		float value[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		unsigned int size = 0;
+		for (size_t i = 0; i != parts.size(); ++i)
+		{
+			for (unsigned int j = 0; j != expr.args[i]->type.size; ++j) value[size++] = registers[parts[i]].value[j];
+		}
+		return NewConstant(expr.type, value);
+	}
+
+	// the parts are scattered in one by one, so none may read what an
+	// earlier one wrote.
+	unsigned int value = dest;
+	unsigned int offset = 0;
+	for (size_t i = 0; i != parts.size() && value != CpuBytecode::no_register; ++i)
+	{
+		if (parts[i] == value && offset != 0) value = CpuBytecode::no_register;
+		offset += expr.args[i]->type.size;
+	}
+	if (value == CpuBytecode::no_register) value = NewRegister(CpuBytecode::RK_Variable, expr.type);
+
+	offset = 0;
+	for (size_t i = 0; i != parts.size(); ++i)
+	{
+		unsigned int size = expr.args[i]->type.size;
+		unsigned char swizzle = 0;
+		for (unsigned int j = 0; j != size; ++j) swizzle |= (offset + j) << (j * 2);
+		m_bytecode->code[Emit(CpuBytecode::OC_Scatter, size, value, parts[i])].swizzle = swizzle;
+		offset += size;
+	}
+	return value;
+}
+
+unsigned int CpuBytecodeCompiler::CompileCall(const Expr& expr)
+{
+	const Program::Function& function = m_program->GetFunctions()[expr.function];
+	const std::vector<Program::Variable>& variables = m_program->GetVariables();
+	for (size_t i = 0; i != m_calls.size(); ++i)
+	{
+		if (m_calls[i].function != expr.function) continue;
+		if (m_error.empty()) m_error = "recursion is not supported on the cpu, in " + std::string(function.name.begin(), function.name.end());
+		return function.return_type.base == Program::BT_Void ? CpuBytecode::no_register : Zero(function.return_type);
+	}
+	if (m_is_library_enabled && function.body)
+	{
+		Opcode opcode = LibraryOpcode(function);
+		if (opcode != CpuBytecode::Num_Opcodes) return CompileLibraryCall(expr, opcode);
+	}
+
+	// an in parameter the body never writes reads its argument in place.
+	std::vector<bool> later_side_effects = FindLaterSideEffects(expr.args);
+	std::vector<unsigned int> params(expr.args.size());
+	for (size_t i = 0; i != expr.args.size(); ++i)
+	{
+		const Program::Variable& param = variables[function.params[i]];
+		if (param.mode == Program::PM_Out)
+		{
+			params[i] = NewRegister(CpuBytecode::RK_Variable, param.type, RR_Local);
+			Emit(CpuBytecode::OC_Move, param.type.size, params[i], Zero(param.type));
+			continue;
+		}
+
+		unsigned int value = CompileExpression(*expr.args[i]);
+		if (param.mode == Program::PM_InOut)
+		{
+			params[i] = NewRegister(CpuBytecode::RK_Variable, param.type, RR_Local);
+			Convert(value, expr.args[i]->type, param.type, params[i]);
+		}
+		else if (m_writes[expr.function].count(function.params[i]) == 0 && m_roles[value] != RR_Static && !(later_side_effects[i] && m_roles[value] != RR_Temporary))
+		{
+			params[i] = value;
+		}
+		else
+		{
+			params[i] = NewRegister(CpuBytecode::RK_Variable, param.type, RR_Local);
+			Emit(CpuBytecode::OC_Move, param.type.size, params[i], value);
+		}
+	}
+	for (size_t i = 0; i != params.size(); ++i) m_variable_registers[function.params[i]] = params[i];
+
+	unsigned int result = CpuBytecode::no_register;
+	if (function.return_type.base != Program::BT_Void) result = NewRegister(CpuBytecode::RK_Variable, function.return_type);
+	CompileBody(expr.function, result);
+
+	// out arguments are written back converted to their own type.
+	for (size_t i = 0; i != params.size(); ++i)
+	{
+		const Program::Variable& param = variables[function.params[i]];
+		if (param.mode != Program::PM_In) Store(*expr.args[i], Convert(params[i], param.type, expr.args[i]->type));
+	}
+	return result;
+}
+
+// the op sizes itself as an intrinsic does, by its last argument: the
+// point of a noise, or the vector of __hash and __grad4.
+unsigned int CpuBytecodeCompiler::CompileLibraryCall(const Expr& expr, Opcode opcode)
+{
+	std::vector<unsigned int> args;
+	CompileArguments(expr.args, args);
+	args.resize(2, 0);
+	unsigned int result = NewRegister(CpuBytecode::RK_Variable, expr.type);
+	Emit(opcode, expr.args.back()->type.size, result, args[0], args[1]);
+	return result;
+}
+
+unsigned int CpuBytecodeCompiler::CompileIncrement(const Expr& expr)
+{
+	const Expr& target = *expr.args[0];
+	float one[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+	Opcode opcode = expr.op == Program::OP_Add ? CpuBytecode::OC_Add : CpuBytecode::OC_Subtract;
+	unsigned int current = CompileExpression(target);
+
+	// the old value of a variable has to be copied before it changes.
+	unsigned int old = current;
+	if (!expr.is_prefix && m_roles[current] != RR_Temporary)
+	{
+		old = NewRegister(CpuBytecode::RK_Variable, expr.type);
+		Emit(CpuBytecode::OC_Move, expr.type.size, old, current);
+	}
+
+	unsigned int updated = current;
+	if (target.kind != Program::EK_Variable) updated = NewRegister(CpuBytecode::RK_Variable, expr.type);
+	Emit(opcode, expr.type.size, updated, current, NewConstant(expr.type, one));
+	if (target.kind != Program::EK_Variable) Store(target, updated);
+	return expr.is_prefix ? updated : old;
+}
+
+unsigned int CpuBytecodeCompiler::CompileIntrinsic(const Expr& expr, unsigned int dest)
+{
+	Program::Intrinsic intrinsic = static_cast<Program::Intrinsic>(expr.function);
+	std::vector<unsigned int> args;
+	if (intrinsic == Program::IN_Sample || intrinsic == Program::IN_SampleLevel)
+	{
+		// the texture and sampler are variables naming their slots.
+		std::vector<Program::ExprPtr> coordinates(expr.args.begin() + 2, expr.args.end());
+		CompileArguments(coordinates, args);
+		unsigned int level = args.size() > 1 ? args[1] : Zero(Program::MakeType(Program::BT_Float, 1));
+		unsigned int value = Fresh(dest, expr.type);
+		size_t at = Emit(CpuBytecode::OC_Sample, 4, value, args[0], level);
+		m_bytecode->code[at].target = static_cast<unsigned int>(m_program->GetVariables()[expr.args[0]->variable].offset);
+		if (intrinsic == Program::IN_Sample) m_bytecode->code[at].flags = CpuBytecode::IF_ImplicitLevel;
+		return value;
+	}
+
+	if (intrinsic == Program::IN_Sincos)
+	{
+		const Type& type = expr.args[0]->type;
+		unsigned int angle = CompileExpression(*expr.args[0]);
+		unsigned int sine = NewRegister(CpuBytecode::RK_Variable, type);
+		unsigned int cosine = NewRegister(CpuBytecode::RK_Variable, type);
+		Emit(CpuBytecode::OC_Sin, type.size, sine, angle);
+		Emit(CpuBytecode::OC_Cos, type.size, cosine, angle);
+		Store(*expr.args[1], Convert(sine, type, expr.args[1]->type));
+		Store(*expr.args[2], Convert(cosine, type, expr.args[2]->type));
+		return CpuBytecode::no_register;
+	}
+
+	CompileArguments(expr.args, args);
+	args.resize(3, 0);
+	Opcode opcode = IntrinsicOpcode(intrinsic);
+	unsigned int size = IsReduction(opcode) ? expr.args[0]->type.size : expr.type.size;
+	unsigned int value = Fresh(dest, expr.type);
+	Emit(opcode, size, value, args[0], args[1], args[2]);
+	return value;
+}
+
+void CpuBytecodeCompiler::CompileArguments(const std::vector<CpuShaderProgram::ExprPtr>& args, std::vector<unsigned int>& registers)
+{
+	// left to right, and a variable read before a later argument writes it
+	// is read into a copy.
+	std::vector<bool> later_side_effects = FindLaterSideEffects(args);
+	registers.resize(args.size());
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		registers[i] = CompileExpression(*args[i]);
+		if (later_side_effects[i] && m_roles[registers[i]] != RR_Temporary)
+		{
+			unsigned int copy = NewRegister(CpuBytecode::RK_Variable, args[i]->type);
+			Emit(CpuBytecode::OC_Move, args[i]->type.size, copy, registers[i]);
+			registers[i] = copy;
+		}
+	}
+}
+
+void CpuBytecodeCompiler::CompileBody(size_t function, unsigned int result)
+{
+	// a return before the end jumps past the body, which is then marked
+	// for the engines running many pixels at once.
+	const Stmt& body = *m_program->GetFunctions()[function].body;
+	Call call;
+	call.function = function;
+	call.result = result;
+	call.has_early_return = HasEarlyReturn(body, true);
+	m_calls.push_back(call);
+
+	size_t begin = call.has_early_return ? Emit(CpuBytecode::OC_BeginCall, 0, 0) : 0;
+	CompileStatement(body);
+	if (call.has_early_return)
+	{
+		std::vector<CpuBytecode::Instruction>& code = m_bytecode->code;
+		size_t end = Emit(CpuBytecode::OC_EndCall, 0, 0);
+		code[begin].target = static_cast<unsigned int>(end);
+		const std::vector<size_t>& returns = m_calls.back().returns;
+		for (size_t i = 0; i != returns.size(); ++i) code[returns[i]].target = static_cast<unsigned int>(end);
+	}
+	m_calls.pop_back();
+}
+
+std::vector<bool> CpuBytecodeCompiler::FindLaterSideEffects(const std::vector<CpuShaderProgram::ExprPtr>& args) const
+{
+	std::vector<bool> later(args.size(), false);
+	bool found = false;
+	for (size_t i = args.size(); i-- != 0; )
+	{
+		later[i] = found;
+		found = found || HasSideEffects(*args[i]);
+	}
+	return later;
+}
+
+unsigned int CpuBytecodeCompiler::Convert(unsigned int value, const Type& from, const Type& to, unsigned int dest)
+{
+	const std::vector<CpuBytecode::Register>& registers = m_bytecode->registers;
+	bool to_bool = to.base == Program::BT_Bool && from.base != Program::BT_Bool;
+	bool to_integer = (to.base == Program::BT_Int || to.base == Program::BT_Uint) && from.base == Program::BT_Float;
+	bool is_splat = from.size == 1 && to.size > 1;
+
+	if ((to_bool || to_integer || is_splat) && registers[value].kind == CpuBytecode::RK_Constant)
+	{
+		float converted[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		for (unsigned int i = 0; i != to.size; ++i)
+		{
+			float x = registers[value].value[is_splat ? 0 : i];
+			if (to_bool) x = x != 0.0f ? 1.0f : 0.0f;
+			else if (to_integer) x = CpuShaderMath::Truncate(x);
+			converted[i] = x;
+		}
+		value = NewConstant(to, converted);
+	}
+	else
+	{
+		if (to_bool || to_integer)
+		{
+			Type type = Program::MakeType(to.base, std::min(from.size, to.size));
+			unsigned int converted = is_splat ? NewRegister(CpuBytecode::RK_Variable, type) : Fresh(dest, type);
+			Emit(to_bool ? CpuBytecode::OC_ToBool : CpuBytecode::OC_FloatToInt, type.size, converted, value);
+			value = converted;
+		}
+		if (is_splat)
+		{
+			unsigned int splatted = Fresh(dest, to);
+			m_bytecode->code[Emit(CpuBytecode::OC_Swizzle, to.size, splatted, value)].swizzle = 0;
+			value = splatted;
+		}
+	}
+
+	if (dest == CpuBytecode::no_register) return value;
+	if (value != dest) Emit(CpuBytecode::OC_Move, to.size, dest, value);
+	return dest;
+}
+
+void CpuBytecodeCompiler::Store(const Expr& target, unsigned int value)
+{
+	if (target.kind == Program::EK_Variable)
+	{
+		unsigned int reg = m_variable_registers[target.variable];
+		if (reg != value) Emit(CpuBytecode::OC_Move, target.type.size, reg, value);
+		return;
+	}
+
+	// a swizzle, always of a variable, once built.
+	unsigned char swizzle = 0;
+	for (unsigned int i = 0; i != target.type.size; ++i) swizzle |= target.components[i] << (i * 2);
+	unsigned int object = m_variable_registers[target.args[0]->variable];
+	m_bytecode->code[Emit(CpuBytecode::OC_Scatter, target.type.size, object, value)].swizzle = swizzle;
+}
+
+size_t CpuBytecodeCompiler::Emit(Opcode opcode, unsigned int size, unsigned int dest, unsigned int a, unsigned int b, unsigned int c)
+{
+	CpuBytecode::Instruction ins;
+	ins.opcode = static_cast<unsigned char>(opcode);
+	ins.size = static_cast<unsigned char>(size);
+	ins.flags = 0;
+	ins.swizzle = identity_swizzle;
+	ins.dest = dest;
+	ins.args[0] = a;
+	ins.args[1] = b;
+	ins.args[2] = c;
+	ins.target = 0;
+	m_bytecode->code.push_back(ins);
+	return m_bytecode->code.size() - 1;
+}
+
+unsigned int CpuBytecodeCompiler::NewRegister(CpuBytecode::RegisterKind kind, const Type& type, RegisterRole role)
+{
+	CpuBytecode::Register reg;
+	reg.kind = kind;
+	reg.type = type;
+	std::fill(reg.value, reg.value + 4, 0.0f);
+	reg.offset = 0;
+	m_bytecode->registers.push_back(reg);
+	m_roles.push_back(role);
+	return static_cast<unsigned int>(m_bytecode->registers.size() - 1);
+}
+
+unsigned int CpuBytecodeCompiler::NewConstant(const Type& type, const float* value)
+{
+	// shared by value, bit for bit, so that -0 and 0 stay apart.
+	float padded[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	std::copy(value, value + type.size, padded);
+	const std::vector<CpuBytecode::Register>& registers = m_bytecode->registers;
+	for (size_t i = 0; i != registers.size(); ++i)
+	{
+		const CpuBytecode::Register& reg = registers[i];
+		if (reg.kind == CpuBytecode::RK_Constant && Program::IsSameType(reg.type, type) && std::memcmp(reg.value, padded, sizeof(padded)) == 0)
+		{
+			return static_cast<unsigned int>(i);
+		}
+	}
+
+	unsigned int constant = NewRegister(CpuBytecode::RK_Constant, type);
+	std::copy(padded, padded + 4, m_bytecode->registers[constant].value);
+	return constant;
+}
+
+unsigned int CpuBytecodeCompiler::Zero(const Type& type)
+{
+	float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	return NewConstant(type, zero);
+}
+
+unsigned int CpuBytecodeCompiler::Fresh(unsigned int dest, const Type& type)
+{
+	return dest != CpuBytecode::no_register ? dest : NewRegister(CpuBytecode::RK_Variable, type);
+}
+
+bool CpuBytecodeCompiler::HasSideEffects(const Expr& expr) const
+{
+	// a call may write the statics.
+	if (expr.kind == Program::EK_Assign || expr.kind == Program::EK_Increment || expr.kind == Program::EK_Call) return true;
+	if (expr.kind == Program::EK_Intrinsic && expr.function == Program::IN_Sincos) return true;
+	for (size_t i = 0; i != expr.args.size(); ++i)
+	{
+		if (HasSideEffects(*expr.args[i])) return true;
+	}
+	return false;
+}
+
+bool CpuBytecodeCompiler::HasEarlyReturn(const Stmt& stmt, bool is_last) const
+{
+	// a return at the very end of the body, even in both branches of a
+	// final if, falls through to the end anyway.
+	switch (stmt.kind)
+	{
+	case Program::SK_Return:
+		return !is_last;
+
+	case Program::SK_Block:
+		for (size_t i = 0; i != stmt.body.size(); ++i)
+		{
+			if (HasEarlyReturn(*stmt.body[i], is_last && i + 1 == stmt.body.size())) return true;
+		}
+		return false;
+
+	case Program::SK_If:
+		for (size_t i = 0; i != stmt.body.size(); ++i)
+		{
+			if (HasEarlyReturn(*stmt.body[i], is_last)) return true;
+		}
+		return false;
+
+	case Program::SK_For:
+	case Program::SK_While:
+	case Program::SK_Do:
+		for (size_t i = 0; i != stmt.body.size(); ++i)
+		{
+			if (HasEarlyReturn(*stmt.body[i], false)) return true;
+		}
+		return false;
+
+	default:
+		return false;
+	}
+}
+
+void CpuBytecodeCompiler::FindWrites(const Stmt& stmt, std::set<size_t>& variables) const
+{
+	if (stmt.expr) FindWrites(*stmt.expr, variables);
+	if (stmt.step) FindWrites(*stmt.step, variables);
+	for (size_t i = 0; i != stmt.body.size(); ++i) FindWrites(*stmt.body[i], variables);
+}
+
+void CpuBytecodeCompiler::FindWrites(const Expr& expr, std::set<size_t>& variables) const
+{
+	std::vector<size_t> targets;
+	if (expr.kind == Program::EK_Assign || expr.kind == Program::EK_Increment) targets.push_back(0);
+	else if (expr.kind == Program::EK_Intrinsic && expr.function == Program::IN_Sincos)
+	{
+		targets.push_back(1);
+		targets.push_back(2);
+	}
+	else if (expr.kind == Program::EK_Call)
+	{
+		const Program::Function& function = m_program->GetFunctions()[expr.function];
+		for (size_t i = 0; i != function.params.size(); ++i)
+		{
+			if (m_program->GetVariables()[function.params[i]].mode != Program::PM_In) targets.push_back(i);
+		}
+	}
+
+	for (size_t i = 0; i != targets.size(); ++i)
+	{
+		const Expr& target = *expr.args[targets[i]];
+		variables.insert(target.kind == Program::EK_Variable ? target.variable : target.args[0]->variable);
+	}
+	for (size_t i = 0; i != expr.args.size(); ++i) FindWrites(*expr.args[i], variables);
+}
+
+void CpuBytecodeCompiler::AllocateRegisters()
+{
+	std::vector<CpuBytecode::Instruction>& code = m_bytecode->code;
+	std::vector<CpuBytecode::Register>& registers = m_bytecode->registers;
+	const size_t none = static_cast<size_t>(-1);
+
+	// the live range of a register runs from where it is first touched to
+	// where it is last.
+	std::vector<size_t> first(registers.size(), none), last(registers.size(), 0);
+	std::vector<std::pair<size_t, size_t> > loops;
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		const CpuBytecode::Instruction& ins = code[i];
+		Opcode opcode = static_cast<Opcode>(ins.opcode);
+		unsigned int touched[4];
+		unsigned int count = 0;
+		if (CpuBytecode::WritesDest(opcode)) touched[count++] = ins.dest;
+		for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(opcode); ++j) touched[count++] = ins.args[j];
+		for (unsigned int j = 0; j != count; ++j)
+		{
+			first[touched[j]] = std::min(first[touched[j]], i);
+			last[touched[j]] = std::max(last[touched[j]], i);
+		}
+		if (opcode == CpuBytecode::OC_Loop) loops.push_back(std::make_pair(i, static_cast<size_t>(ins.target)));
+	}
+	first[m_bytecode->output] = std::min(first[m_bytecode->output], code.size());
+	last[m_bytecode->output] = code.size();
+
+	// what is live into a loop and read in it is live until the loop ends,
+	// the next iteration reads it again.
+	for (bool changed = true; changed; )
+	{
+		changed = false;
+		for (size_t i = 0; i != registers.size(); ++i)
+		{
+			if (first[i] == none) continue;
+			for (size_t j = 0; j != loops.size(); ++j)
+			{
+				if (first[i] < loops[j].first && last[i] >= loops[j].first && last[i] < loops[j].second)
+				{
+					last[i] = loops[j].second;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	// the constants and uniforms read and the inputs keep a slot each, the
+	// rest share slots by linear scan.
+	std::vector<CpuBytecode::Register> slots;
+	std::vector<unsigned int> slot_of(registers.size(), CpuBytecode::no_register);
+	std::vector<unsigned int> order;
+	for (size_t i = 0; i != registers.size(); ++i)
+	{
+		if (registers[i].kind == CpuBytecode::RK_Input || (registers[i].kind != CpuBytecode::RK_Variable && first[i] != none))
+		{
+			slot_of[i] = static_cast<unsigned int>(slots.size());
+			slots.push_back(registers[i]);
+		}
+		else if (first[i] != none) order.push_back(static_cast<unsigned int>(i));
+	}
+	std::stable_sort(order.begin(), order.end(), [&first](unsigned int lhs, unsigned int rhs) { return first[lhs] < first[rhs]; });
+
+	typedef std::pair<size_t, unsigned int> Active;
+	std::priority_queue<Active, std::vector<Active>, std::greater<Active> > active;
+	std::vector<unsigned int> free_slots;
+	for (size_t i = 0; i != order.size(); ++i)
+	{
+		unsigned int reg = order[i];
+		while (!active.empty() && active.top().first < first[reg])
+		{
+			free_slots.push_back(active.top().second);
+			active.pop();
+		}
+		if (free_slots.empty())
+		{
+			slot_of[reg] = static_cast<unsigned int>(slots.size());
+			slots.push_back(registers[reg]);
+			slots.back().type = Program::MakeType(Program::BT_Float, 4);
+		}
+		else
+		{
+			slot_of[reg] = free_slots.back();
+			free_slots.pop_back();
+		}
+		active.push(Active(last[reg], slot_of[reg]));
+	}
+
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		CpuBytecode::Instruction& ins = code[i];
+		Opcode opcode = static_cast<Opcode>(ins.opcode);
+		if (CpuBytecode::WritesDest(opcode)) ins.dest = slot_of[ins.dest];
+		else ins.dest = 0;
+		for (unsigned int j = 0; j != 3; ++j) ins.args[j] = j < CpuBytecode::GetNumArgs(opcode) ? slot_of[ins.args[j]] : 0;
+	}
+	for (size_t i = 0; i != m_bytecode->inputs.size(); ++i)
+	{
+		if (m_bytecode->inputs[i] != CpuBytecode::no_register) m_bytecode->inputs[i] = slot_of[m_bytecode->inputs[i]];
+	}
+	m_bytecode->output = slot_of[m_bytecode->output];
+	registers.swap(slots);
+}
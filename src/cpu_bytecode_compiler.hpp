@@ -0,0 +1,110 @@
+#ifndef _CPU_BYTECODE_COMPILER_HPP_INCLUDED_
+#define _CPU_BYTECODE_COMPILER_HPP_INCLUDED_
+
+#include <set>
+#include <string>
+#include <vector>
+#include "cpu_bytecode.hpp"
+
+class CpuBytecodeOptimizer;
+
+// lowers a built program to bytecode. the calls are inlined, the in
+// parameters a function never writes alias their arguments, and values are
+// computed straight into the variables they are assigned to. the registers
+// are then packed by their live ranges, so that a loop of many calls still
+// runs on a few dozen of them.
+class CpuBytecodeCompiler
+{
+public:
+	CpuBytecodeCompiler();
+	virtual ~CpuBytecodeCompiler();
+
+public:
+	// false if the program can not be lowered, as a recursive one could not
+	// be. the program refuses to call what is not defined yet, so none is.
+	bool Compile(const CpuShaderProgram& program, CpuBytecode& bytecode);
+	const std::string& GetError() const;
+
+	// run on the code before its registers are packed, none by default.
+	void SetOptimizer(CpuBytecodeOptimizer* optimizer);
+
+	// how the transcendental ops are computed, precisely by default.
+	void SetPrecision(CpuShaderMath::Precision precision);
+
+	// whether the noise functions of fx/snoise.hlsl and fx/qnoise.hlsl run
+	// as ops of their own rather than inlined, as they do by default.
+	void EnableLibrary(bool is_enabled);
+
+private:
+	typedef CpuShaderProgram::Expr Expr;
+	typedef CpuShaderProgram::Stmt Stmt;
+	typedef CpuShaderProgram::Type Type;
+	typedef CpuBytecode::Opcode Opcode;
+
+	// what writes a register, to know when a read of it must be copied.
+	enum RegisterRole
+	{
+		RR_Temporary,			// written once, or never
+		RR_Local,				// a variable of the function, or a parameter
+		RR_Static,				// a static global, which any call may write
+	};
+
+	// a function being inlined.
+	struct Call
+	{
+		size_t function;
+		unsigned int result;
+		bool has_early_return;
+		std::vector<size_t> returns;
+	};
+
+	struct Loop
+	{
+		std::vector<size_t> breaks;
+		std::vector<size_t> continues;
+	};
+
+	void CompileStatement(const Stmt& stmt);
+	void CompileLoop(const Stmt& stmt);
+	unsigned int CompileExpression(const Expr& expr, unsigned int dest = CpuBytecode::no_register);
+	unsigned int CompileBinary(const Expr& expr, unsigned int dest);
+	unsigned int CompileConstruct(const Expr& expr, unsigned int dest);
+	unsigned int CompileCall(const Expr& expr);
+	unsigned int CompileLibraryCall(const Expr& expr, Opcode opcode);
+	unsigned int CompileIncrement(const Expr& expr);
+	unsigned int CompileIntrinsic(const Expr& expr, unsigned int dest);
+	void CompileArguments(const std::vector<CpuShaderProgram::ExprPtr>& args, std::vector<unsigned int>& registers);
+	void CompileBody(size_t function, unsigned int result);
+	std::vector<bool> FindLaterSideEffects(const std::vector<CpuShaderProgram::ExprPtr>& args) const;
+	unsigned int Convert(unsigned int value, const Type& from, const Type& to, unsigned int dest = CpuBytecode::no_register);
+	void Store(const Expr& target, unsigned int value);
+
+	size_t Emit(Opcode opcode, unsigned int size, unsigned int dest, unsigned int a = 0, unsigned int b = 0, unsigned int c = 0);
+	unsigned int NewRegister(CpuBytecode::RegisterKind kind, const Type& type, RegisterRole role = RR_Temporary);
+	unsigned int NewConstant(const Type& type, const float* value);
+	unsigned int Zero(const Type& type);
+	unsigned int Fresh(unsigned int dest, const Type& type);
+
+	bool HasSideEffects(const Expr& expr) const;
+	bool HasEarlyReturn(const Stmt& stmt, bool is_last) const;
+	void FindWrites(const Stmt& stmt, std::set<size_t>& variables) const;
+	void FindWrites(const Expr& expr, std::set<size_t>& variables) const;
+
+	void AllocateRegisters();
+
+private:
+	const CpuShaderProgram* m_program;
+	CpuBytecode* m_bytecode;
+	CpuBytecodeOptimizer* m_optimizer;
+	CpuShaderMath::Precision m_precision;
+	bool m_is_library_enabled;
+	std::string m_error;
+
+	std::vector<unsigned int> m_variable_registers;	// by variable of the program
+	std::vector<RegisterRole> m_roles;				// by register
+	std::vector<std::set<size_t> > m_writes;		// by function
+	std::vector<Call> m_calls;
+	std::vector<Loop> m_loops;
+};
+
+#endif  // _CPU_BYTECODE_COMPILER_HPP_INCLUDED_
@@ -0,0 +1,818 @@
+#include "common.hpp"
+#include "cpu_bytecode_optimizer.hpp"
+#include "cpu_bytecode_vm.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+typedef CpuShaderProgram Program;
+typedef CpuBytecode Bytecode;
+
+static const unsigned char identity_swizzle = 0xe4;
+static const size_t none = static_cast<size_t>(-1);
+
+// a loop is unrolled if it runs no more than this, and grows the code by
+// no more than the size.
+static const size_t max_unrolled_iterations = 16;
+static const size_t max_unrolled_size = 256;
+
+static const char* pass_names[] = {"unroll", "fold", "cse", "hoist", "dce"};
+
+// the ops whose target is an instruction, rather than a texture slot.
+static bool IsJump(Bytecode::Opcode opcode)
+{
+	switch (opcode)
+	{
+	case Bytecode::OC_If: case Bytecode::OC_Else: case Bytecode::OC_Loop: case Bytecode::OC_Break:
+	case Bytecode::OC_BreakIfNot: case Bytecode::OC_Continue: case Bytecode::OC_EndLoop:
+	case Bytecode::OC_BeginCall: case Bytecode::OC_Return:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool IsControl(Bytecode::Opcode opcode)
+{
+	return opcode >= Bytecode::OC_If;
+}
+
+// a derivative is of the neighbouring pixels, which a wide engine has and
+// a constant or once a frame value does not.
+static bool IsDerivative(Bytecode::Opcode opcode)
+{
+	return opcode == Bytecode::OC_Ddx || opcode == Bytecode::OC_Ddy || opcode == Bytecode::OC_Fwidth;
+}
+
+// so is the level of a Sample without one.
+static bool IsImplicitSample(const Bytecode::Instruction& ins)
+{
+	return ins.opcode == Bytecode::OC_Sample && (ins.flags & Bytecode::IF_ImplicitLevel) != 0;
+}
+
+// whether an op is the same whenever its registers are, and writes dest whole.
+static bool IsPure(Bytecode::Opcode opcode)
+{
+	return !IsControl(opcode) && opcode != Bytecode::OC_Scatter && !IsDerivative(opcode);
+}
+
+static unsigned int GetWrittenSize(const Bytecode::Instruction& ins)
+{
+	Bytecode::Opcode opcode = static_cast<Bytecode::Opcode>(ins.opcode);
+	return opcode >= Bytecode::OC_Dot && opcode <= Bytecode::OC_Qnoise ? 1 : ins.size;
+}
+
+static Bytecode::Instruction MakeInstruction(Bytecode::Opcode opcode, unsigned int size, unsigned int dest, unsigned int a)
+{
+	Bytecode::Instruction ins;
+	ins.opcode = static_cast<unsigned char>(opcode);
+	ins.size = static_cast<unsigned char>(size);
+	ins.flags = 0;
+	ins.swizzle = identity_swizzle;
+	ins.dest = dest;
+	ins.args[0] = a;
+	ins.args[1] = 0;
+	ins.args[2] = 0;
+	ins.target = 0;
+	return ins;
+}
+
+static bool IsSameOperation(const Bytecode::Instruction& lhs, const Bytecode::Instruction& rhs)
+{
+	if (lhs.opcode != rhs.opcode || lhs.size != rhs.size || lhs.flags != rhs.flags) return false;
+	if (lhs.swizzle != rhs.swizzle || lhs.target != rhs.target) return false;
+	unsigned int num_args = Bytecode::GetNumArgs(static_cast<Bytecode::Opcode>(lhs.opcode));
+	for (unsigned int i = 0; i != num_args; ++i)
+	{
+		if (lhs.args[i] != rhs.args[i]) return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuBytecodeOptimizer::CpuBytecodeOptimizer()
+	: m_bytecode(NULL)
+	, m_num_unrolled_loops(0)
+	, m_num_hoisted(0)
+{
+	std::fill(m_is_enabled, m_is_enabled + Num_Passes, true);
+	std::fill(m_num_before, m_num_before + Num_Passes, 0);
+	std::fill(m_num_after, m_num_after + Num_Passes, 0);
+}
+
+CpuBytecodeOptimizer::~CpuBytecodeOptimizer()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void CpuBytecodeOptimizer::EnablePass(Pass pass, bool is_enabled)
+{
+	m_is_enabled[pass] = is_enabled;
+}
+
+bool CpuBytecodeOptimizer::IsPassEnabled(Pass pass) const
+{
+	return m_is_enabled[pass];
+}
+
+const char* CpuBytecodeOptimizer::GetPassName(Pass pass)
+{
+	return pass_names[pass];
+}
+
+void CpuBytecodeOptimizer::Optimize(CpuBytecode& bytecode)
+{
+	m_bytecode = &bytecode;
+	m_num_unrolled_loops = 0;
+	m_num_hoisted = 0;
+
+	// unrolled loops leave their counters as constants to fold, folds and
+	// cse leave copies, and hoisting goes last to take no more than it must.
+	for (int i = 0; i != Num_Passes; ++i)
+	{
+		Pass pass = static_cast<Pass>(i);
+		m_num_before[pass] = bytecode.code.size();
+		if (m_is_enabled[pass])
+		{
+			switch (pass)
+			{
+			case OP_Unroll: Unroll(); break;
+			case OP_Fold: Fold(); break;
+			case OP_Cse: Cse(); break;
+			case OP_Hoist: Hoist(); break;
+			default: Dce(); break;
+			}
+		}
+		m_num_after[pass] = bytecode.code.size();
+	}
+	m_bytecode = NULL;
+}
+
+size_t CpuBytecodeOptimizer::GetNumInstructionsBefore(Pass pass) const
+{
+	return m_num_before[pass];
+}
+
+size_t CpuBytecodeOptimizer::GetNumInstructionsAfter(Pass pass) const
+{
+	return m_num_after[pass];
+}
+
+size_t CpuBytecodeOptimizer::GetNumUnrolledLoops() const
+{
+	return m_num_unrolled_loops;
+}
+
+size_t CpuBytecodeOptimizer::GetNumHoisted() const
+{
+	return m_num_hoisted;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+bool CpuBytecodeOptimizer::Unroll()
+{
+	// the body of an unrolled loop is scanned next, for the loops in it.
+	bool changed = false;
+	for (size_t i = 0; i < m_bytecode->code.size(); )
+	{
+		if (m_bytecode->code[i].opcode == CpuBytecode::OC_Loop && UnrollLoop(i))
+		{
+			++m_num_unrolled_loops;
+			changed = true;
+		}
+		else ++i;
+	}
+	return changed;
+}
+
+bool CpuBytecodeOptimizer::UnrollLoop(size_t begin)
+{
+	// the loops of the form for (i = a; i < b; i += c), with a, b and c
+	// constants, i not written in the body and the loop never left early:
+	// loop, the test, breakifnot, the body, continuepoint, the step, endloop.
+	const std::vector<Instruction>& code = m_bytecode->code;
+	size_t end = code[begin].target;
+	if (begin + 3 > end) return false;
+	const Instruction& test = code[begin + 1];
+	const Instruction& exit = code[begin + 2];
+	if (test.opcode < CpuBytecode::OC_Less || test.opcode > CpuBytecode::OC_NotEqual || test.size != 1) return false;
+	if (exit.opcode != CpuBytecode::OC_BreakIfNot || exit.args[0] != test.dest || exit.target != end) return false;
+
+	unsigned int counter = test.args[0];
+	if (m_bytecode->registers[counter].kind == CpuBytecode::RK_Constant) counter = test.args[1];
+	else if (m_bytecode->registers[test.args[1]].kind != CpuBytecode::RK_Constant) return false;
+	if (m_bytecode->registers[counter].kind != CpuBytecode::RK_Variable || m_bytecode->registers[counter].type.size != 1) return false;
+
+	// the breaks and continues of nested loops are theirs.
+	size_t continue_point = none;
+	int depth = 0;
+	for (size_t i = begin + 3; i != end && continue_point == none; ++i)
+	{
+		Opcode opcode = static_cast<Opcode>(code[i].opcode);
+		if (opcode == CpuBytecode::OC_Loop) ++depth;
+		else if (opcode == CpuBytecode::OC_EndLoop) --depth;
+		else if (depth != 0) continue;
+		else if (opcode == CpuBytecode::OC_Break || opcode == CpuBytecode::OC_BreakIfNot || opcode == CpuBytecode::OC_Continue) return false;
+		else if (opcode == CpuBytecode::OC_ContinuePoint) continue_point = i;
+	}
+	if (continue_point == none) return false;
+	for (size_t i = begin + 3; i != continue_point; ++i)
+	{
+		if (CpuBytecode::WritesDest(static_cast<Opcode>(code[i].opcode)) && code[i].dest == counter) return false;
+	}
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		const Instruction& ins = code[i];
+		if (i == begin + 2) continue;
+		for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(static_cast<Opcode>(ins.opcode)); ++j)
+		{
+			if (ins.args[j] == test.dest) return false;
+		}
+	}
+
+	// the step adds a constant to the counter, and does nothing else that lasts.
+	size_t step = none;
+	for (size_t i = continue_point + 1; i != end; ++i)
+	{
+		const Instruction& ins = code[i];
+		Opcode opcode = static_cast<Opcode>(ins.opcode);
+		if (IsControl(opcode) || ins.dest == test.dest) return false;
+		if (ins.dest != counter) continue;
+		if (step != none || ins.size != 1) return false;
+		bool is_add = opcode == CpuBytecode::OC_Add && (ins.args[0] == counter || ins.args[1] == counter);
+		bool is_subtract = opcode == CpuBytecode::OC_Subtract && ins.args[0] == counter;
+		if (!is_add && !is_subtract) return false;
+		if (m_bytecode->registers[ins.args[ins.args[0] == counter ? 1 : 0]].kind != CpuBytecode::RK_Constant) return false;
+		step = i;
+	}
+	if (step == none) return false;
+
+	// the counter is set to a constant right before the loop.
+	size_t init = begin;
+	while (init != 0)
+	{
+		const Instruction& ins = code[--init];
+		if (IsControl(static_cast<Opcode>(ins.opcode))) return false;
+		if (ins.dest == counter) break;
+	}
+	if (init == begin || code[init].dest != counter || code[init].opcode != CpuBytecode::OC_Move) return false;
+	if (m_bytecode->registers[code[init].args[0]].kind != CpuBytecode::RK_Constant) return false;
+
+	// the iterations are counted on the vm, to the bit.
+	Register value = m_bytecode->registers[counter];
+	value.kind = CpuBytecode::RK_Constant;
+	std::copy(m_bytecode->registers[code[init].args[0]].value, m_bytecode->registers[code[init].args[0]].value + 4, value.value);
+	std::vector<float> values;
+	for (;;)
+	{
+		const Register* args[3] = {NULL, NULL, NULL};
+		for (unsigned int j = 0; j != 2; ++j) args[j] = test.args[j] == counter ? &value : &m_bytecode->registers[test.args[j]];
+		float result[4];
+		Evaluate(test, args, result);
+		if (result[0] == 0.0f) break;
+		if (values.size() == max_unrolled_iterations) return false;
+		values.push_back(value.value[0]);
+
+		for (unsigned int j = 0; j != 2; ++j) args[j] = code[step].args[j] == counter ? &value : &m_bytecode->registers[code[step].args[j]];
+		Evaluate(code[step], args, result);
+		value.value[0] = result[0];
+	}
+	size_t body_size = continue_point - (begin + 3) + end - (continue_point + 1);
+	if (values.size() * body_size > max_unrolled_size) return false;
+
+	// a copy of the body and the step per iteration, with the counter read
+	// as the constant it is then. the jumps within the body stay within the
+	// copy, the others are mapped once the code is laid out.
+	std::vector<Instruction> unrolled;
+	std::vector<size_t> where(code.size(), none);
+	std::vector<bool> is_mapped;
+	for (size_t i = 0; i != begin; ++i)
+	{
+		where[i] = unrolled.size();
+		unrolled.push_back(code[i]);
+		is_mapped.push_back(false);
+	}
+	for (size_t k = 0; k != values.size(); ++k)
+	{
+		float padded[4] = {values[k], 0.0f, 0.0f, 0.0f};
+		unsigned int constant = NewConstant(m_bytecode->registers[counter].type, padded);
+		size_t copy = unrolled.size();
+		for (size_t i = begin + 3; i != end; ++i)
+		{
+			if (i == continue_point) continue;
+			Instruction ins = m_bytecode->code[i];
+			Opcode opcode = static_cast<Opcode>(ins.opcode);
+			for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(opcode); ++j)
+			{
+				if (ins.args[j] == counter) ins.args[j] = constant;
+			}
+			bool is_inside = IsJump(opcode) && ins.target > begin + 2 && ins.target < continue_point;
+			if (is_inside) ins.target = static_cast<unsigned int>(copy + ins.target - (begin + 3));
+			unrolled.push_back(ins);
+			is_mapped.push_back(is_inside);
+		}
+	}
+	for (size_t i = end + 1; i != m_bytecode->code.size(); ++i)
+	{
+		where[i] = unrolled.size();
+		unrolled.push_back(m_bytecode->code[i]);
+		is_mapped.push_back(false);
+	}
+	for (size_t i = 0; i != unrolled.size(); ++i)
+	{
+		Instruction& ins = unrolled[i];
+		if (!IsJump(static_cast<Opcode>(ins.opcode)) || is_mapped[i]) continue;
+		if (where[ins.target] == none) return false;
+		ins.target = static_cast<unsigned int>(where[ins.target]);
+	}
+	m_bytecode->code.swap(unrolled);
+	return true;
+}
+
+bool CpuBytecodeOptimizer::Fold()
+{
+	// a folded op becomes a move of a constant, which is then propagated
+	// into the ops that read it, which may fold in turn.
+	bool changed = false;
+	for (bool is_folding = true; is_folding; )
+	{
+		is_folding = false;
+		for (size_t i = 0; i != m_bytecode->code.size(); ++i)
+		{
+			Instruction& ins = m_bytecode->code[i];
+			Opcode opcode = static_cast<Opcode>(ins.opcode);
+			if (!IsPure(opcode) || opcode == CpuBytecode::OC_Move || opcode == CpuBytecode::OC_Sample) continue;
+
+			const Register* args[3] = {NULL, NULL, NULL};
+			bool is_constant = true;
+			for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(opcode); ++j)
+			{
+				args[j] = &m_bytecode->registers[ins.args[j]];
+				if (args[j]->kind != CpuBytecode::RK_Constant) is_constant = false;
+			}
+			if (!is_constant) continue;
+
+			float result[4];
+			Evaluate(ins, args, result);
+			unsigned int size = GetWrittenSize(ins);
+			std::fill(result + size, result + 4, 0.0f);
+			unsigned int constant = NewConstant(m_bytecode->registers[ins.dest].type, result);
+			m_bytecode->code[i] = MakeInstruction(CpuBytecode::OC_Move, size, m_bytecode->code[i].dest, constant);
+			is_folding = true;
+		}
+		if (PropagateCopies()) is_folding = true;
+		if (is_folding) changed = true;
+	}
+	return changed;
+}
+
+bool CpuBytecodeOptimizer::Cse()
+{
+	// the ops done before are kept by the scope they were done in. a scope
+	// is left where lanes come back that may not have done them: at an
+	// else, the end of an if, a continue point and the ends of loops and
+	// calls. a loop forgets on the way in what its body changes.
+	struct Done
+	{
+		size_t index;
+		size_t depth;
+	};
+
+	Analyze();
+	std::vector<Instruction>& code = m_bytecode->code;
+	std::vector<Done> done;
+	size_t depth = 0;
+	bool changed = false;
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		Instruction& ins = code[i];
+		Opcode opcode = static_cast<Opcode>(ins.opcode);
+		if (IsControl(opcode))
+		{
+			bool is_leaving = opcode == CpuBytecode::OC_Else || opcode == CpuBytecode::OC_EndIf || opcode == CpuBytecode::OC_ContinuePoint;
+			is_leaving = is_leaving || opcode == CpuBytecode::OC_EndLoop || opcode == CpuBytecode::OC_EndCall;
+			if (is_leaving)
+			{
+				size_t kept = 0;
+				for (size_t j = 0; j != done.size(); ++j)
+				{
+					if (done[j].depth != depth) done[kept++] = done[j];
+				}
+				done.resize(kept);
+			}
+
+			if (opcode == CpuBytecode::OC_Loop)
+			{
+				std::vector<bool> is_written(m_bytecode->registers.size(), false);
+				for (size_t j = i; j <= ins.target; ++j)
+				{
+					if (CpuBytecode::WritesDest(static_cast<Opcode>(code[j].opcode))) is_written[code[j].dest] = true;
+				}
+				size_t kept = 0;
+				for (size_t j = 0; j != done.size(); ++j)
+				{
+					const Instruction& other = code[done[j].index];
+					bool is_changed = false;
+					for (unsigned int k = 0; k != CpuBytecode::GetNumArgs(static_cast<Opcode>(other.opcode)); ++k)
+					{
+						if (is_written[other.args[k]]) is_changed = true;
+					}
+					if (!is_changed) done[kept++] = done[j];
+				}
+				done.resize(kept);
+			}
+
+			if (opcode == CpuBytecode::OC_If || opcode == CpuBytecode::OC_Loop || opcode == CpuBytecode::OC_BeginCall) ++depth;
+			else if (opcode == CpuBytecode::OC_EndIf || opcode == CpuBytecode::OC_EndLoop || opcode == CpuBytecode::OC_EndCall) --depth;
+			continue;
+		}
+
+		// the earlier result is held by a register written there alone.
+		bool is_candidate = IsPure(opcode) && opcode != CpuBytecode::OC_Move && !IsImplicitSample(ins);
+		bool is_repeated = false;
+		for (size_t j = done.size(); is_candidate && j-- != 0; )
+		{
+			const Instruction& other = code[done[j].index];
+			if (IsSameOperation(ins, other) && m_bytecode->registers[other.dest].type.size == GetWrittenSize(ins))
+			{
+				ins = MakeInstruction(CpuBytecode::OC_Move, GetWrittenSize(ins), ins.dest, other.dest);
+				is_repeated = true;
+				changed = true;
+				break;
+			}
+		}
+
+		size_t kept = 0;
+		for (size_t j = 0; j != done.size(); ++j)
+		{
+			const Instruction& other = code[done[j].index];
+			bool is_changed = false;
+			for (unsigned int k = 0; k != CpuBytecode::GetNumArgs(static_cast<Opcode>(other.opcode)); ++k)
+			{
+				if (other.args[k] == ins.dest) is_changed = true;
+			}
+			if (!is_changed) done[kept++] = done[j];
+		}
+		done.resize(kept);
+
+		if (is_candidate && !is_repeated && IsDefined(ins.dest))
+		{
+			Done entry = {i, depth};
+			done.push_back(entry);
+		}
+	}
+
+	if (changed) PropagateCopies();
+	return changed;
+}
+
+void CpuBytecodeOptimizer::Hoist()
+{
+	// a value of constants and uniforms alone is the same for every pixel,
+	// wherever it is computed. it is computed once by the prologue, and the
+	// values the code still reads become uniforms past the cbuffer. that
+	// takes a register written once, or written part by part in the stretch
+	// before the first control op, where every lane does every write.
+	Analyze();
+	std::vector<Instruction>& code = m_bytecode->code;
+	std::vector<Register>& registers = m_bytecode->registers;
+	size_t straight = 0;
+	while (straight != code.size() && !IsControl(static_cast<Opcode>(code[straight].opcode))) ++straight;
+	std::vector<size_t> first_writes(registers.size(), none);
+	for (size_t i = code.size(); i-- != 0; )
+	{
+		if (CpuBytecode::WritesDest(static_cast<Opcode>(code[i].opcode))) first_writes[code[i].dest] = i;
+	}
+
+	std::vector<bool> is_uniform(registers.size(), false);
+	for (size_t i = 0; i != registers.size(); ++i)
+	{
+		const Register& reg = registers[i];
+		if (reg.kind != CpuBytecode::RK_Variable) is_uniform[i] = reg.kind != CpuBytecode::RK_Input;
+		else if (IsDefined(static_cast<unsigned int>(i))) is_uniform[i] = true;
+		else if (i != m_bytecode->output && m_num_writes[i] != 0 && m_definitions[i] < straight) is_uniform[i] = first_writes[i] < m_first_reads[i];
+	}
+
+	// a register stays uniform if all its writes are hoisted, and the code
+	// left reads it only once they are all done.
+	std::vector<bool> is_hoisted(code.size(), false);
+	for (bool is_shrinking = true; is_shrinking; )
+	{
+		is_shrinking = false;
+		for (size_t i = 0; i != code.size(); ++i)
+		{
+			const Instruction& ins = code[i];
+			Opcode opcode = static_cast<Opcode>(ins.opcode);
+			is_hoisted[i] = false;
+			if (IsControl(opcode) || IsDerivative(opcode) || opcode == CpuBytecode::OC_Sample || !is_uniform[ins.dest]) continue;
+			if (registers[ins.dest].kind != CpuBytecode::RK_Variable) continue;
+			bool is_invariant = opcode != CpuBytecode::OC_Scatter || is_uniform[ins.dest];
+			for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(opcode); ++j)
+			{
+				if (!is_uniform[ins.args[j]]) is_invariant = false;
+			}
+			is_hoisted[i] = is_invariant;
+		}
+
+		for (size_t i = 0; i != code.size(); ++i)
+		{
+			const Instruction& ins = code[i];
+			Opcode opcode = static_cast<Opcode>(ins.opcode);
+			if (CpuBytecode::WritesDest(opcode) && !is_hoisted[i] && is_uniform[ins.dest] && registers[ins.dest].kind == CpuBytecode::RK_Variable)
+			{
+				is_uniform[ins.dest] = false;
+				is_shrinking = true;
+			}
+			if (is_hoisted[i]) continue;
+			for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(opcode); ++j)
+			{
+				unsigned int reg = ins.args[j];
+				if (is_uniform[reg] && registers[reg].kind == CpuBytecode::RK_Variable && m_definitions[reg] > i)
+				{
+					is_uniform[reg] = false;
+					is_shrinking = true;
+				}
+			}
+		}
+	}
+	m_num_hoisted = std::count(is_hoisted.begin(), is_hoisted.end(), true);
+	if (m_num_hoisted == 0) return;
+
+	std::vector<bool> is_exported(registers.size(), false);
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		const Instruction& ins = code[i];
+		if (is_hoisted[i]) continue;
+		for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(static_cast<Opcode>(ins.opcode)); ++j)
+		{
+			if (registers[ins.args[j]].kind == CpuBytecode::RK_Variable && is_uniform[ins.args[j]]) is_exported[ins.args[j]] = true;
+		}
+	}
+
+	// the prologue has the registers it touches, in a file of its own.
+	boost::shared_ptr<CpuBytecode> prologue(new CpuBytecode);
+	std::vector<unsigned int> renamed(registers.size(), CpuBytecode::no_register);
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		if (!is_hoisted[i]) continue;
+		Instruction ins = code[i];
+		unsigned int* touched[4] = {&ins.dest, &ins.args[0], &ins.args[1], &ins.args[2]};
+		for (unsigned int j = 0; j != 1 + CpuBytecode::GetNumArgs(static_cast<Opcode>(ins.opcode)); ++j)
+		{
+			unsigned int& reg = *touched[j];
+			if (renamed[reg] == CpuBytecode::no_register)
+			{
+				renamed[reg] = static_cast<unsigned int>(prologue->registers.size());
+				prologue->registers.push_back(registers[reg]);
+			}
+			reg = renamed[reg];
+		}
+		if (prologue->code.empty()) prologue->output = ins.dest;
+		prologue->code.push_back(ins);
+	}
+	prologue->code.push_back(MakeInstruction(CpuBytecode::OC_End, 0, 0, 0));
+	prologue->output_size = 1;
+	prologue->num_textures = 0;
+	prologue->uses_derivatives = false;
+	prologue->precision = m_bytecode->precision;
+	prologue->hoisted_offset = 0;
+
+	// four floats a value, from past the last uniform of the program.
+	size_t offset = 0;
+	for (size_t i = 0; i != registers.size(); ++i)
+	{
+		if (registers[i].kind == CpuBytecode::RK_Uniform) offset = std::max(offset, registers[i].offset + registers[i].type.size);
+	}
+	offset = (offset + 3) / 4 * 4;
+	m_bytecode->hoisted_offset = offset;
+	m_bytecode->hoisted.clear();
+	for (size_t i = 0; i != registers.size(); ++i)
+	{
+		if (!is_exported[i]) continue;
+		registers[i].kind = CpuBytecode::RK_Uniform;
+		registers[i].offset = offset + m_bytecode->hoisted.size() * 4;
+		m_bytecode->hoisted.push_back(renamed[i]);
+	}
+	m_bytecode->prologue = prologue;
+
+	std::vector<bool> keep(code.size());
+	for (size_t i = 0; i != code.size(); ++i) keep[i] = !is_hoisted[i];
+	Compact(keep);
+}
+
+bool CpuBytecodeOptimizer::Dce()
+{
+	bool changed = false;
+	for (;;)
+	{
+		Analyze();
+		const std::vector<Instruction>& code = m_bytecode->code;
+		std::vector<bool> keep(code.size(), true);
+		bool is_removing = false;
+		for (size_t i = 0; i != code.size(); ++i)
+		{
+			const Instruction& ins = code[i];
+			Opcode opcode = static_cast<Opcode>(ins.opcode);
+			if (IsControl(opcode)) continue;
+			bool is_self_move = opcode == CpuBytecode::OC_Move && ins.args[0] == ins.dest;
+			if (m_first_reads[ins.dest] == none || is_self_move)
+			{
+				keep[i] = false;
+				is_removing = true;
+			}
+		}
+		if (!is_removing) break;
+		Compact(keep);
+		changed = true;
+	}
+	return changed;
+}
+
+bool CpuBytecodeOptimizer::PropagateCopies()
+{
+	// a register that only copies another is read as that one instead, as
+	// long as the two can not part: the other never changes, or changes
+	// only right before the copy, or the copy is read before anything else
+	// happens to the lanes.
+	bool changed = false;
+	for (;;)
+	{
+		Analyze();
+		std::vector<Instruction>& code = m_bytecode->code;
+		const std::vector<Register>& registers = m_bytecode->registers;
+		std::vector<unsigned int> forward(registers.size(), CpuBytecode::no_register);
+		std::vector<bool> keep(code.size(), true);
+		bool is_propagating = false;
+		for (size_t i = 0; i != code.size(); ++i)
+		{
+			const Instruction& ins = code[i];
+			if (ins.opcode != CpuBytecode::OC_Move) continue;
+			unsigned int dest = ins.dest, source = ins.args[0];
+			if (!IsDefined(dest) || forward[source] != CpuBytecode::no_register) continue;
+			if (ins.size != registers[dest].type.size || registers[source].type.size != registers[dest].type.size) continue;
+
+			bool is_same = IsStable(source);
+			if (!is_same && IsDefined(source))
+			{
+				bool is_read_at_once = m_first_reads[dest] == none || !HasControlBetween(i, m_last_reads[dest]);
+				is_same = !HasControlBetween(m_definitions[source], i) || is_read_at_once;
+			}
+			if (!is_same) continue;
+			forward[dest] = source;
+			keep[i] = false;
+			is_propagating = true;
+		}
+		if (!is_propagating) break;
+
+		for (size_t i = 0; i != code.size(); ++i)
+		{
+			Instruction& ins = code[i];
+			for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(static_cast<Opcode>(ins.opcode)); ++j)
+			{
+				if (forward[ins.args[j]] != CpuBytecode::no_register) ins.args[j] = forward[ins.args[j]];
+			}
+		}
+		Compact(keep);
+		changed = true;
+	}
+	return changed;
+}
+
+void CpuBytecodeOptimizer::Analyze()
+{
+	const std::vector<Instruction>& code = m_bytecode->code;
+	size_t num_registers = m_bytecode->registers.size();
+	m_num_writes.assign(num_registers, 0);
+	m_definitions.assign(num_registers, none);
+	m_is_full_write.assign(num_registers, false);
+	m_first_reads.assign(num_registers, none);
+	m_last_reads.assign(num_registers, 0);
+	m_num_controls.assign(code.size() + 1, 0);
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		const Instruction& ins = code[i];
+		Opcode opcode = static_cast<Opcode>(ins.opcode);
+		m_num_controls[i + 1] = m_num_controls[i] + (IsControl(opcode) ? 1 : 0);
+		if (CpuBytecode::WritesDest(opcode))
+		{
+			++m_num_writes[ins.dest];
+			m_definitions[ins.dest] = i;
+			m_is_full_write[ins.dest] = opcode != CpuBytecode::OC_Scatter && GetWrittenSize(ins) >= m_bytecode->registers[ins.dest].type.size;
+		}
+		for (unsigned int j = 0; j != CpuBytecode::GetNumArgs(opcode); ++j)
+		{
+			m_first_reads[ins.args[j]] = std::min(m_first_reads[ins.args[j]], i);
+			m_last_reads[ins.args[j]] = std::max(m_last_reads[ins.args[j]], i);
+		}
+	}
+
+	// the color is read once the code is done.
+	unsigned int output = m_bytecode->output;
+	m_first_reads[output] = std::min(m_first_reads[output], code.size());
+	m_last_reads[output] = code.size();
+}
+
+bool CpuBytecodeOptimizer::IsDefined(unsigned int reg) const
+{
+	// written whole, once, and before it is read: every read sees that one
+	// value, even in a loop. the color is left alone.
+	if (reg == m_bytecode->output || m_bytecode->registers[reg].kind != CpuBytecode::RK_Variable) return false;
+	if (m_num_writes[reg] != 1 || !m_is_full_write[reg]) return false;
+	return m_first_reads[reg] == none || m_definitions[reg] < m_first_reads[reg];
+}
+
+bool CpuBytecodeOptimizer::IsStable(unsigned int reg) const
+{
+	CpuBytecode::RegisterKind kind = m_bytecode->registers[reg].kind;
+	if (kind == CpuBytecode::RK_Constant || kind == CpuBytecode::RK_Uniform) return true;
+	return kind == CpuBytecode::RK_Input && m_num_writes[reg] == 0;
+}
+
+bool CpuBytecodeOptimizer::HasControlBetween(size_t begin, size_t end) const
+{
+	// the control ops strictly between the two.
+	if (end >= m_num_controls.size() - 1) end = m_num_controls.size() - 1;
+	return end > begin + 1 && m_num_controls[end] != m_num_controls[begin + 1];
+}
+
+unsigned int CpuBytecodeOptimizer::NewConstant(const CpuShaderProgram::Type& type, const float* value)
+{
+	// shared by value, bit for bit, the way the compiler shares them.
+	std::vector<Register>& registers = m_bytecode->registers;
+	for (size_t i = 0; i != registers.size(); ++i)
+	{
+		const Register& reg = registers[i];
+		if (reg.kind == CpuBytecode::RK_Constant && Program::IsSameType(reg.type, type) && std::memcmp(reg.value, value, sizeof(reg.value)) == 0)
+		{
+			return static_cast<unsigned int>(i);
+		}
+	}
+
+	Register reg;
+	reg.kind = CpuBytecode::RK_Constant;
+	reg.type = type;
+	std::copy(value, value + 4, reg.value);
+	reg.offset = 0;
+	registers.push_back(reg);
+	return static_cast<unsigned int>(registers.size() - 1);
+}
+
+void CpuBytecodeOptimizer::Evaluate(const Instruction& ins, const Register* const* args, float result[4]) const
+{
+	// the op alone, on a vm of its own, so that it folds to what the
+	// engines would compute.
+	CpuBytecode single;
+	unsigned int num_args = CpuBytecode::GetNumArgs(static_cast<Opcode>(ins.opcode));
+	Instruction op = ins;
+	for (unsigned int i = 0; i != num_args; ++i)
+	{
+		single.registers.push_back(*args[i]);
+		single.registers.back().kind = CpuBytecode::RK_Constant;
+		op.args[i] = i;
+	}
+	Register dest;
+	dest.kind = CpuBytecode::RK_Variable;
+	dest.type = Program::MakeType(Program::BT_Float, 4);
+	std::fill(dest.value, dest.value + 4, 0.0f);
+	dest.offset = 0;
+	single.registers.push_back(dest);
+	op.dest = num_args;
+
+	single.code.push_back(op);
+	single.code.push_back(MakeInstruction(CpuBytecode::OC_End, 0, 0, 0));
+	single.output = num_args;
+	single.output_size = 4;
+	single.num_textures = 0;
+	single.uses_derivatives = false;
+	single.precision = m_bytecode->precision;
+	single.hoisted_offset = 0;
+
+	CpuBytecodeVm vm(single);
+	vm.Run(NULL, result);
+}
+
+void CpuBytecodeOptimizer::Compact(const std::vector<bool>& keep)
+{
+	// the control ops are always kept, and the jumps land on them.
+	std::vector<Instruction>& code = m_bytecode->code;
+	std::vector<size_t> where(code.size(), none);
+	size_t count = 0;
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		if (!keep[i]) continue;
+		where[i] = count;
+		code[count++] = code[i];
+	}
+	code.resize(count);
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		if (IsJump(static_cast<Opcode>(code[i].opcode))) code[i].target = static_cast<unsigned int>(where[code[i].target]);
+	}
+}
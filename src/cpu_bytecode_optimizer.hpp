@@ -0,0 +1,82 @@
+#ifndef _CPU_BYTECODE_OPTIMIZER_HPP_INCLUDED_
+#define _CPU_BYTECODE_OPTIMIZER_HPP_INCLUDED_
+
+#include <vector>
+#include "cpu_bytecode.hpp"
+
+// rewrites bytecode before its registers are allocated, while a value
+// computed once still has a register of its own. every pass keeps the bits
+// of the result: constants are folded on the vm itself, and nothing is
+// reordered or reassociated.
+class CpuBytecodeOptimizer
+{
+public:
+	enum Pass
+	{
+		OP_Unroll,				// loops of a few known iterations
+		OP_Fold,				// ops on constants, and the copies they leave
+		OP_Cse,					// ops done again on the same registers
+		OP_Hoist,				// ops on uniforms alone, to a prologue run once a frame
+		OP_Dce,					// ops whose result is never read
+		Num_Passes,
+	};
+
+public:
+	CpuBytecodeOptimizer();
+	virtual ~CpuBytecodeOptimizer();
+
+public:
+	// every pass runs by default.
+	void EnablePass(Pass pass, bool is_enabled);
+	bool IsPassEnabled(Pass pass) const;
+	static const char* GetPassName(Pass pass);
+
+	void Optimize(CpuBytecode& bytecode);
+
+	// the instructions before and after each pass of the last run, the
+	// same if it did not run.
+	size_t GetNumInstructionsBefore(Pass pass) const;
+	size_t GetNumInstructionsAfter(Pass pass) const;
+	size_t GetNumUnrolledLoops() const;
+	size_t GetNumHoisted() const;
+
+private:
+	typedef CpuBytecode::Instruction Instruction;
+	typedef CpuBytecode::Register Register;
+	typedef CpuBytecode::Opcode Opcode;
+
+	bool Unroll();
+	bool UnrollLoop(size_t begin);
+	bool Fold();
+	bool Cse();
+	void Hoist();
+	bool Dce();
+	bool PropagateCopies();
+
+	// who writes and reads each register.
+	void Analyze();
+	bool IsDefined(unsigned int reg) const;
+	bool IsStable(unsigned int reg) const;
+	bool HasControlBetween(size_t begin, size_t end) const;
+
+	unsigned int NewConstant(const CpuShaderProgram::Type& type, const float* value);
+	void Evaluate(const Instruction& ins, const Register* const* args, float result[4]) const;
+	void Compact(const std::vector<bool>& keep);
+
+private:
+	CpuBytecode* m_bytecode;
+	bool m_is_enabled[Num_Passes];
+	size_t m_num_before[Num_Passes];
+	size_t m_num_after[Num_Passes];
+	size_t m_num_unrolled_loops;
+	size_t m_num_hoisted;
+
+	std::vector<unsigned int> m_num_writes;		// by register
+	std::vector<size_t> m_definitions;			// the write of a register written once
+	std::vector<bool> m_is_full_write;
+	std::vector<size_t> m_first_reads;
+	std::vector<size_t> m_last_reads;
+	std::vector<size_t> m_num_controls;			// control ops before each instruction
+};
+
+#endif  // _CPU_BYTECODE_OPTIMIZER_HPP_INCLUDED_
@@ -0,0 +1,504 @@
+#include "common.hpp"
+#include "cpu_bytecode_vm.hpp"
+#include "cpu_shader_interpreter.hpp"
+#include "cpu_shader_math.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace CpuShaderMath;
+
+// the ops of every step, by opcode. with gcc and clang the table holds the
+// labels of their code and each op ends by jumping to the next one's, so
+// that every op has a branch of its own for the predictor to learn.
+#ifdef __GNUC__
+#define VM_OP(name) op_##name:
+#define VM_NEXT() do { ++step; goto *step->handler; } while (0)
+#define VM_JUMP(to) do { step = (to); goto *step->handler; } while (0)
+#else
+#define VM_OP(name) case CpuBytecode::OC_##name:
+#define VM_NEXT() do { ++step; goto dispatch; } while (0)
+#define VM_JUMP(to) do { step = (to); goto dispatch; } while (0)
+#endif
+
+// the cheap ops do all four components, which the compiler turns into
+// one vector instruction. the components past the size are never read.
+#define VM_BINARY4(name, expression) VM_OP(name) \
+	{ \
+		const float* a = step->args[0]; \
+		const float* b = step->args[1]; \
+		float x0 = expression(a[0], b[0]), x1 = expression(a[1], b[1]); \
+		float x2 = expression(a[2], b[2]), x3 = expression(a[3], b[3]); \
+		float* d = step->dest; \
+		d[0] = x0; d[1] = x1; d[2] = x2; d[3] = x3; \
+	} \
+	VM_NEXT();
+
+#define VM_UNARY(name, expression) VM_OP(name) \
+	{ \
+		const float* a = step->args[0]; \
+		float* d = step->dest; \
+		for (unsigned int i = 0; i != step->size; ++i) d[i] = expression(a[i]); \
+	} \
+	VM_NEXT();
+
+#define VM_BINARY(name, expression) VM_OP(name) \
+	{ \
+		const float* a = step->args[0]; \
+		const float* b = step->args[1]; \
+		float* d = step->dest; \
+		for (unsigned int i = 0; i != step->size; ++i) d[i] = expression(a[i], b[i]); \
+	} \
+	VM_NEXT();
+
+#define VM_TERNARY(name, expression) VM_OP(name) \
+	{ \
+		const float* a = step->args[0]; \
+		const float* b = step->args[1]; \
+		const float* c = step->args[2]; \
+		float* d = step->dest; \
+		for (unsigned int i = 0; i != step->size; ++i) d[i] = expression(a[i], b[i], c[i]); \
+	} \
+	VM_NEXT();
+
+// the transcendental ops, computed as the bytecode was lowered for.
+#define VM_MATH_UNARY(name, function) VM_OP(name) \
+	{ \
+		const float* a = step->args[0]; \
+		float* d = step->dest; \
+		for (unsigned int i = 0; i != step->size; ++i) d[i] = function(a[i], precision); \
+	} \
+	VM_NEXT();
+
+#define VM_MATH_BINARY(name, function) VM_OP(name) \
+	{ \
+		const float* a = step->args[0]; \
+		const float* b = step->args[1]; \
+		float* d = step->dest; \
+		for (unsigned int i = 0; i != step->size; ++i) d[i] = function(a[i], b[i], precision); \
+	} \
+	VM_NEXT();
+
+static inline float Add(float a, float b) { return a + b; }
+static inline float Subtract(float a, float b) { return a - b; }
+static inline float Multiply(float a, float b) { return a * b; }
+static inline float Divide(float a, float b) { return a / b; }
+static inline float Less(float a, float b) { return a < b ? 1.0f : 0.0f; }
+static inline float LessEqual(float a, float b) { return a <= b ? 1.0f : 0.0f; }
+static inline float Greater(float a, float b) { return a > b ? 1.0f : 0.0f; }
+static inline float GreaterEqual(float a, float b) { return a >= b ? 1.0f : 0.0f; }
+static inline float Equal(float a, float b) { return a == b ? 1.0f : 0.0f; }
+static inline float NotEqual(float a, float b) { return a != b ? 1.0f : 0.0f; }
+static inline float And(float a, float b) { return a != 0.0f && b != 0.0f ? 1.0f : 0.0f; }
+static inline float Or(float a, float b) { return a != 0.0f || b != 0.0f ? 1.0f : 0.0f; }
+static inline float Negate(float a) { return -a; }
+static inline float Not(float a) { return a == 0.0f ? 1.0f : 0.0f; }
+static inline float ToBool(float a) { return a != 0.0f ? 1.0f : 0.0f; }
+static inline float Float(bool a) { return a ? 1.0f : 0.0f; }
+static inline float IsInfinite(float a) { return Float(IsInf(a)); }
+static inline float IsNotANumber(float a) { return Float(IsNan(a)); }
+static inline float Zero(float) { return 0.0f; }
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuBytecodeVm::CpuBytecodeVm(const CpuBytecode& bytecode)
+	: m_bytecode(bytecode)
+	, m_registers(bytecode.registers.size() * 4, 0.0f)
+	, m_textures(bytecode.num_textures, static_cast<const CpuTexture*>(NULL))
+	, m_num_cut_off_loops(0)
+{
+	for (size_t i = 0; i != bytecode.registers.size(); ++i)
+	{
+		const CpuBytecode::Register& reg = bytecode.registers[i];
+		if (reg.kind == CpuBytecode::RK_Constant) std::copy(reg.value, reg.value + 4, &m_registers[i * 4]);
+	}
+}
+
+CpuBytecodeVm::~CpuBytecodeVm()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void CpuBytecodeVm::SetConstants(const std::vector<float>& constants)
+{
+	for (size_t i = 0; i != m_bytecode.registers.size(); ++i)
+	{
+		const CpuBytecode::Register& reg = m_bytecode.registers[i];
+		if (reg.kind != CpuBytecode::RK_Uniform) continue;
+		for (unsigned int j = 0; j != reg.type.size; ++j)
+		{
+			m_registers[i * 4 + j] = reg.offset + j < constants.size() ? constants[reg.offset + j] : 0.0f;
+		}
+	}
+}
+
+void CpuBytecodeVm::SetTexture(size_t slot, const CpuTexture* texture)
+{
+	if (slot < m_textures.size()) m_textures[slot] = texture;
+}
+
+bool CpuBytecodeVm::Run(const float* inputs, float output[4])
+{
+	for (size_t i = 0; i != m_bytecode.inputs.size(); ++i)
+	{
+		if (m_bytecode.inputs[i] != CpuBytecode::no_register) std::copy(inputs + i * 4, inputs + i * 4 + 4, &m_registers[m_bytecode.inputs[i] * 4]);
+	}
+	if (!Execute()) return false;
+
+	const float* color = &m_registers[m_bytecode.output * 4];
+	for (unsigned int i = 0; i != 4; ++i) output[i] = i < m_bytecode.output_size ? color[i] : 0.0f;
+	return true;
+}
+
+size_t CpuBytecodeVm::GetNumCutOffLoops() const
+{
+	return m_num_cut_off_loops;
+}
+
+void CpuBytecodeVm::RunPrologue(const CpuBytecode& bytecode, std::vector<float>& constants)
+{
+	if (!bytecode.prologue) return;
+	CpuBytecodeVm vm(*bytecode.prologue);
+	vm.SetConstants(constants);
+	float color[4];
+	vm.Run(NULL, color);
+
+	constants.resize(std::max(constants.size(), bytecode.hoisted_offset + bytecode.hoisted.size() * 4), 0.0f);
+	for (size_t i = 0; i != bytecode.hoisted.size(); ++i)
+	{
+		const float* value = &vm.m_registers[bytecode.hoisted[i] * 4];
+		std::copy(value, value + 4, constants.begin() + bytecode.hoisted_offset + i * 4);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+bool CpuBytecodeVm::Execute()
+{
+	const Precision precision = m_bytecode.precision;
+#ifdef __GNUC__
+	static const void* const handlers[] =
+	{
+		&&op_Move, &&op_Swizzle, &&op_Scatter,
+		&&op_FloatToInt, &&op_ToBool,
+		&&op_Add, &&op_Subtract, &&op_Multiply, &&op_Divide, &&op_Modulo, &&op_IntDivide, &&op_IntModulo, &&op_Negate,
+		&&op_Less, &&op_LessEqual, &&op_Greater, &&op_GreaterEqual, &&op_Equal, &&op_NotEqual, &&op_And, &&op_Or, &&op_Not,
+		&&op_BitAnd, &&op_BitOr, &&op_BitXor, &&op_ShiftLeft, &&op_ShiftRight, &&op_BitNot, &&op_Select,
+		&&op_Abs, &&op_Acos, &&op_Asin, &&op_Atan, &&op_Atan2, &&op_Ceil, &&op_Clamp, &&op_Cos,
+		&&op_Cosh, &&op_Degrees, &&op_Exp, &&op_Exp2, &&op_Floor, &&op_Fmod, &&op_Frac, &&op_Isinf,
+		&&op_Isnan, &&op_Lerp, &&op_Log, &&op_Log10, &&op_Log2, &&op_Max, &&op_Min, &&op_Pow,
+		&&op_Radians, &&op_Round, &&op_Rsqrt, &&op_Saturate, &&op_Sign, &&op_Sin, &&op_Sinh, &&op_Smoothstep,
+		&&op_Sqrt, &&op_Step, &&op_Tan, &&op_Tanh, &&op_Trunc, &&op_Ddx, &&op_Ddy, &&op_Fwidth,
+		&&op_Dot, &&op_Length, &&op_Distance, &&op_Any, &&op_All, &&op_Snoise, &&op_Qnoise, &&op_Normalize,
+		&&op_Reflect, &&op_Refract, &&op_Cross, &&op_Hash, &&op_Grad4, &&op_Sample,
+		&&op_If, &&op_Else, &&op_EndIf, &&op_Loop, &&op_Break, &&op_BreakIfNot, &&op_Continue, &&op_ContinuePoint,
+		&&op_EndLoop, &&op_BeginCall, &&op_Return, &&op_EndCall, &&op_Discard, &&op_End,
+	};
+	static_assert(sizeof(handlers) / sizeof(handlers[0]) == CpuBytecode::Num_Opcodes, "a handler for every opcode");
+	if (m_steps.empty()) Decode(handlers);
+	const Step* step = &m_steps[0];
+	goto *step->handler;
+#else
+	if (m_steps.empty()) Decode(NULL);
+	const Step* step = &m_steps[0];
+dispatch:
+	switch (step->opcode)
+#endif
+	{
+	VM_OP(Move)
+		{
+			const float* a = step->args[0];
+			float x0 = a[0], x1 = a[1], x2 = a[2], x3 = a[3];
+			float* d = step->dest;
+			d[0] = x0; d[1] = x1; d[2] = x2; d[3] = x3;
+		}
+		VM_NEXT();
+
+	VM_OP(Swizzle)
+		{
+			// the source may be the destination, so it is read first.
+			const float* a = step->args[0];
+			float x[4];
+			for (unsigned int i = 0; i != step->size; ++i) x[i] = a[step->components[i]];
+			std::copy(x, x + step->size, step->dest);
+		}
+		VM_NEXT();
+
+	VM_OP(Scatter)
+		{
+			float x[4];
+			std::copy(step->args[0], step->args[0] + step->size, x);
+			for (unsigned int i = 0; i != step->size; ++i) step->dest[step->components[i]] = x[i];
+		}
+		VM_NEXT();
+
+	VM_UNARY(FloatToInt, Truncate)
+	VM_UNARY(ToBool, ToBool)
+
+	VM_BINARY4(Add, Add)
+	VM_BINARY4(Subtract, Subtract)
+	VM_BINARY4(Multiply, Multiply)
+	VM_BINARY4(Divide, Divide)
+	VM_MATH_BINARY(Modulo, Fmod)
+	VM_BINARY(IntDivide, IntDivide)
+	VM_BINARY(IntModulo, IntModulo)
+	VM_UNARY(Negate, Negate)
+	VM_BINARY4(Less, Less)
+	VM_BINARY4(LessEqual, LessEqual)
+	VM_BINARY4(Greater, Greater)
+	VM_BINARY4(GreaterEqual, GreaterEqual)
+	VM_BINARY4(Equal, Equal)
+	VM_BINARY4(NotEqual, NotEqual)
+	VM_BINARY4(And, And)
+	VM_BINARY4(Or, Or)
+	VM_UNARY(Not, Not)
+
+	VM_OP(BitAnd)
+	VM_OP(BitOr)
+	VM_OP(BitXor)
+	VM_OP(ShiftLeft)
+	VM_OP(ShiftRight)
+	VM_OP(BitNot)
+		{
+			CpuBytecode::Opcode opcode = static_cast<CpuBytecode::Opcode>(step->opcode);
+			const float* a = step->args[0];
+			const float* b = opcode == CpuBytecode::OC_BitNot ? a : step->args[1];
+			for (unsigned int i = 0; i != step->size; ++i) step->dest[i] = CpuBytecode::BitOp(opcode, step->flags, a[i], b[i]);
+		}
+		VM_NEXT();
+
+	VM_OP(Select)
+		{
+			const float* a = step->args[0];
+			const float* b = step->args[1];
+			const float* c = step->args[2];
+			float* d = step->dest;
+			if (step->flags & CpuBytecode::IF_ScalarCondition)
+			{
+				const float* chosen = a[0] != 0.0f ? b : c;
+				float x0 = chosen[0], x1 = chosen[1], x2 = chosen[2], x3 = chosen[3];
+				d[0] = x0; d[1] = x1; d[2] = x2; d[3] = x3;
+			}
+			else
+			{
+				for (unsigned int i = 0; i != step->size; ++i) d[i] = a[i] != 0.0f ? b[i] : c[i];
+			}
+		}
+		VM_NEXT();
+
+	VM_UNARY(Abs, std::fabs)
+	VM_MATH_UNARY(Acos, Acos)
+	VM_MATH_UNARY(Asin, Asin)
+	VM_MATH_UNARY(Atan, Atan)
+	VM_MATH_BINARY(Atan2, Atan2)
+	VM_UNARY(Ceil, std::ceil)
+	VM_TERNARY(Clamp, Clamp)
+	VM_MATH_UNARY(Cos, Cos)
+	VM_UNARY(Cosh, std::cosh)
+	VM_UNARY(Degrees, Degrees)
+	VM_MATH_UNARY(Exp, Exp)
+	VM_MATH_UNARY(Exp2, Exp2)
+	VM_UNARY(Floor, std::floor)
+	VM_MATH_BINARY(Fmod, Fmod)
+	VM_UNARY(Frac, Frac)
+	VM_UNARY(Isinf, IsInfinite)
+	VM_UNARY(Isnan, IsNotANumber)
+	VM_TERNARY(Lerp, Lerp)
+	VM_MATH_UNARY(Log, Log)
+	VM_MATH_UNARY(Log10, Log10)
+	VM_MATH_UNARY(Log2, Log2)
+	VM_BINARY(Max, Max)
+	VM_BINARY(Min, Min)
+	VM_MATH_BINARY(Pow, Pow)
+	VM_UNARY(Radians, Radians)
+	VM_UNARY(Round, Round)
+	VM_UNARY(Rsqrt, Rsqrt)
+	VM_UNARY(Saturate, Saturate)
+	VM_UNARY(Sign, Sign)
+	VM_MATH_UNARY(Sin, Sin)
+	VM_UNARY(Sinh, std::sinh)
+	VM_TERNARY(Smoothstep, Smoothstep)
+	VM_UNARY(Sqrt, std::sqrt)
+	VM_BINARY(Step, CpuShaderMath::Step)
+	VM_MATH_UNARY(Tan, Tan)
+	VM_UNARY(Tanh, std::tanh)
+	VM_UNARY(Trunc, Truncate)
+
+	// a pixel at a time, without neighbours to difference with. the simd
+	// vm runs quads and has them.
+	VM_UNARY(Ddx, Zero)
+	VM_UNARY(Ddy, Zero)
+	VM_UNARY(Fwidth, Zero)
+
+	VM_OP(Dot)
+		step->dest[0] = Dot(step->args[0], step->args[1], step->size);
+		VM_NEXT();
+
+	VM_OP(Length)
+		step->dest[0] = std::sqrt(Dot(step->args[0], step->args[0], step->size));
+		VM_NEXT();
+
+	VM_OP(Distance)
+		{
+			const float* a = step->args[0];
+			const float* b = step->args[1];
+			float d[4];
+			for (unsigned int i = 0; i != step->size; ++i) d[i] = a[i] - b[i];
+			step->dest[0] = std::sqrt(Dot(d, d, step->size));
+		}
+		VM_NEXT();
+
+	VM_OP(Any)
+	VM_OP(All)
+		{
+			bool is_all = step->opcode == CpuBytecode::OC_All;
+			bool result = is_all;
+			for (unsigned int i = 0; i != step->size; ++i)
+			{
+				if ((step->args[0][i] != 0.0f) != is_all) result = !is_all;
+			}
+			step->dest[0] = Float(result);
+		}
+		VM_NEXT();
+
+	VM_OP(Snoise)
+		step->dest[0] = Snoise(step->args[0], step->size);
+		VM_NEXT();
+
+	VM_OP(Qnoise)
+		step->dest[0] = Qnoise(step->args[0], step->size, precision);
+		VM_NEXT();
+
+	VM_OP(Normalize)
+		{
+			const float* a = step->args[0];
+			float scale = 1.0f / std::sqrt(Dot(a, a, step->size));
+			for (unsigned int i = 0; i != step->size; ++i) step->dest[i] = a[i] * scale;
+		}
+		VM_NEXT();
+
+	VM_OP(Reflect)
+		{
+			const float* a = step->args[0];
+			const float* b = step->args[1];
+			float d = 2.0f * Dot(a, b, step->size);
+			for (unsigned int i = 0; i != step->size; ++i) step->dest[i] = a[i] - d * b[i];
+		}
+		VM_NEXT();
+
+	VM_OP(Refract)
+		{
+			const float* a = step->args[0];
+			const float* b = step->args[1];
+			float eta = step->args[2][0];
+			float d = Dot(a, b, step->size);
+			float k = 1.0f - eta * eta * (1.0f - d * d);
+			for (unsigned int i = 0; i != step->size; ++i) step->dest[i] = k < 0.0f ? 0.0f : eta * a[i] - (eta * d + std::sqrt(k)) * b[i];
+		}
+		VM_NEXT();
+
+	VM_OP(Cross)
+		{
+			const float* a = step->args[0];
+			const float* b = step->args[1];
+			float x = a[1] * b[2] - a[2] * b[1];
+			float y = a[2] * b[0] - a[0] * b[2];
+			float z = a[0] * b[1] - a[1] * b[0];
+			step->dest[0] = x;
+			step->dest[1] = y;
+			step->dest[2] = z;
+		}
+		VM_NEXT();
+
+	// dest may be an argument, so these fill a copy first.
+	VM_OP(Hash)
+		{
+			float r[4];
+			NoiseHash(step->args[0], r, precision);
+			std::copy(r, r + 4, step->dest);
+		}
+		VM_NEXT();
+
+	VM_OP(Grad4)
+		{
+			float r[4];
+			Grad4(step->args[0][0], step->args[1], r);
+			std::copy(r, r + 4, step->dest);
+		}
+		VM_NEXT();
+
+	// an implicit level is the top one, see CpuTexture::Sample.
+	VM_OP(Sample)
+		{
+			const CpuTexture* texture = step->slot < m_textures.size() ? m_textures[step->slot] : NULL;
+			if (texture != NULL) texture->Sample(step->args[0][0], step->args[0][1], step->args[1][0], step->dest);
+			else std::fill(step->dest, step->dest + 4, 0.0f);
+		}
+		VM_NEXT();
+
+	// the jumps land past the marker they target.
+	VM_OP(If)
+	VM_OP(BreakIfNot)
+		if (step->args[0][0] == 0.0f) VM_JUMP(step->target + 1);
+		VM_NEXT();
+
+	VM_OP(Else)
+	VM_OP(Break)
+	VM_OP(Continue)
+	VM_OP(Return)
+		VM_JUMP(step->target + 1);
+
+	VM_OP(EndIf)
+	VM_OP(ContinuePoint)
+	VM_OP(BeginCall)
+	VM_OP(EndCall)
+		VM_NEXT();
+
+	VM_OP(Loop)
+		step->dest[0] = 0.0f;
+		VM_NEXT();
+
+	VM_OP(EndLoop)
+		step->dest[0] += 1.0f;
+		if (step->dest[0] < CpuShaderInterpreter::max_loop_iterations) VM_JUMP(step->target + 1);
+		++m_num_cut_off_loops;
+		VM_NEXT();
+
+	VM_OP(Discard)
+		return false;
+
+	VM_OP(End)
+		return true;
+
+#ifndef __GNUC__
+	default:
+		return true;
+#endif
+	}
+}
+
+void CpuBytecodeVm::Decode(const void* const* handlers)
+{
+	const std::vector<CpuBytecode::Instruction>& code = m_bytecode.code;
+	m_steps.resize(code.size());
+	for (size_t i = 0; i != code.size(); ++i)
+	{
+		const CpuBytecode::Instruction& ins = code[i];
+		CpuBytecode::Opcode opcode = static_cast<CpuBytecode::Opcode>(ins.opcode);
+		Step& step = m_steps[i];
+		step.handler = handlers != NULL ? handlers[opcode] : NULL;
+		step.opcode = opcode;
+		step.size = ins.size;
+		step.flags = ins.flags;
+		for (unsigned int j = 0; j != 4; ++j) step.components[j] = CpuBytecode::GetSwizzleComponent(ins.swizzle, j);
+		step.dest = CpuBytecode::WritesDest(opcode) ? &m_registers[ins.dest * 4] : NULL;
+		for (unsigned int j = 0; j != 3; ++j) step.args[j] = j < CpuBytecode::GetNumArgs(opcode) ? &m_registers[ins.args[j] * 4] : NULL;
+		step.target = opcode >= CpuBytecode::OC_If ? &m_steps[ins.target] : NULL;
+		step.slot = ins.target;
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef _CPU_BYTECODE_VM_HPP_INCLUDED_
+#define _CPU_BYTECODE_VM_HPP_INCLUDED_
+
+#include <vector>
+#include "cpu_bytecode.hpp"
+#include "cpu_texture.hpp"
+
+// runs bytecode one pixel at a time. the instructions are decoded once into
+// steps holding the addresses of their registers, and with gcc or clang each
+// step jumps straight to the code of the next, without going back through a
+// switch. a drop-in for the interpreter: one vm per thread, the bytecode and
+// the textures may be shared.
+class CpuBytecodeVm
+{
+public:
+	explicit CpuBytecodeVm(const CpuBytecode& bytecode);
+	virtual ~CpuBytecodeVm();
+
+public:
+	// the cbuffer, laid out the way the program packed it.
+	void SetConstants(const std::vector<float>& constants);
+	void SetTexture(size_t slot, const CpuTexture* texture);
+
+	// four floats per parameter of the entry point in, the color out.
+	// false if the pixel was discarded.
+	bool Run(const float* inputs, float output[4]);
+
+	// loops cut off so far.
+	size_t GetNumCutOffLoops() const;
+
+	// runs the prologue of the bytecode, if it has one, on the cbuffer, and
+	// puts the values it hoisted past it.
+	static void RunPrologue(const CpuBytecode& bytecode, std::vector<float>& constants);
+
+private:
+	struct Step
+	{
+		const void* handler;	// the code of the op, when dispatch is threaded
+		unsigned int opcode;
+		unsigned int size;
+		unsigned int flags;
+		unsigned int components[4];	// of the swizzle
+		float* dest;
+		const float* args[3];
+		const Step* target;
+		size_t slot;
+	};
+
+	bool Execute();
+	void Decode(const void* const* handlers);
+
+private:
+	const CpuBytecode& m_bytecode;
+	std::vector<float> m_registers;
+	std::vector<Step> m_steps;
+	std::vector<const CpuTexture*> m_textures;
+	size_t m_num_cut_off_loops;
+};
+
+#endif  // _CPU_BYTECODE_VM_HPP_INCLUDED_
@@ -0,0 +1,536 @@
+#include "common.hpp"
+#include "cpu_renderer.hpp"
+#include "cpu_bytecode_compiler.hpp"
+#include "cpu_bytecode_vm.hpp"
+#include "cpu_shader_interpreter.hpp"
+#include "cpu_simd_vm.hpp"
+
+#include <algorithm>
+#include <cwctype>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+// a multiple of every simd block, so that blocks never straddle two tiles.
+static const size_t tile_size = 16;
+
+// what the entry point gets for a parameter, told by its semantic.
+enum InputKind
+{
+	IK_None,
+	IK_TexCoord,
+	IK_Position,
+};
+
+static void FindInputKinds(const CpuShaderProgram& program, std::vector<InputKind>& input_kinds)
+{
+	const CpuShaderProgram::Function& entry = program.GetFunctions()[program.GetEntryPoint()];
+	const std::vector<CpuShaderProgram::Variable>& variables = program.GetVariables();
+	input_kinds.assign(entry.params.size(), IK_None);
+	for (size_t i = 0; i != entry.params.size(); ++i)
+	{
+		std::wstring semantic = variables[entry.params[i]].semantic;
+		std::transform(semantic.begin(), semantic.end(), semantic.begin(), towupper);
+		if (semantic.compare(0, 8, L"TEXCOORD") == 0) input_kinds[i] = IK_TexCoord;
+		else if (semantic == L"SV_POSITION") input_kinds[i] = IK_Position;
+	}
+}
+
+// a rectangle of the image, in pixels, right and bottom excluded.
+struct Tile
+{
+	size_t left, top, right, bottom;
+};
+
+// the distance along a hilbert curve filling an n by n square, n a power of
+// two, to the cell at x, y.
+static size_t HilbertIndex(size_t n, size_t x, size_t y)
+{
+	size_t index = 0;
+	for (size_t s = n / 2; s != 0; s /= 2)
+	{
+		size_t rx = (x & s) != 0 ? 1 : 0;
+		size_t ry = (y & s) != 0 ? 1 : 0;
+		index += s * s * ((3 * rx) ^ ry);
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return index;
+}
+
+// cuts the image into tiles in the order of a hilbert curve, so that tiles
+// next to each other in the list are next to each other in the image too.
+static void MakeTiles(size_t width, size_t height, std::vector<Tile>& tiles)
+{
+	size_t columns = (width + tile_size - 1) / tile_size;
+	size_t rows = (height + tile_size - 1) / tile_size;
+	size_t n = 1;
+	while (n < columns || n < rows) n *= 2;
+
+	std::vector<std::pair<size_t, size_t> > order;
+	for (size_t row = 0; row != rows; ++row)
+	{
+		for (size_t column = 0; column != columns; ++column)
+		{
+			order.push_back(std::make_pair(HilbertIndex(n, column, row), row * columns + column));
+		}
+	}
+	std::sort(order.begin(), order.end());
+
+	tiles.resize(order.size());
+	for (size_t i = 0; i != order.size(); ++i)
+	{
+		size_t column = order[i].second % columns, row = order[i].second / columns;
+		Tile& tile = tiles[i];
+		tile.left = column * tile_size;
+		tile.top = row * tile_size;
+		tile.right = std::min(tile.left + tile_size, width);
+		tile.bottom = std::min(tile.top + tile_size, height);
+	}
+}
+
+// runs either engine over a tile of the image, with the texcoord from the
+// top left pixel center and the position if asked. returns the pixels
+// discarded.
+template <typename Machine>
+static size_t RenderPixels(Machine& machine, const std::vector<InputKind>& input_kinds, size_t width, size_t height, const Tile& tile, std::vector<float>& pixels)
+{
+	size_t num_discarded = 0;
+	std::vector<float> inputs(input_kinds.size() * 4, 0.0f);
+	for (size_t y = tile.top; y != tile.bottom; ++y)
+	{
+		for (size_t x = tile.left; x != tile.right; ++x)
+		{
+			float px = x + 0.5f, py = y + 0.5f;
+			for (size_t i = 0; i != input_kinds.size(); ++i)
+			{
+				float* input = &inputs[i * 4];
+				if (input_kinds[i] == IK_TexCoord)
+				{
+					input[0] = px / width;
+					input[1] = py / height;
+				}
+				else if (input_kinds[i] == IK_Position)
+				{
+					input[0] = px;
+					input[1] = py;
+					input[3] = 1.0f;
+				}
+			}
+
+			if (!machine.Run(inputs.empty() ? NULL : &inputs[0], &pixels[(y * width + x) * 4])) ++num_discarded;
+		}
+	}
+	return num_discarded;
+}
+
+// runs the simd vm over blocks of 2x2 quads, a lane per pixel: 4 lanes are
+// one quad, 8 two side by side, 16 four in a square. neighbours tend to take
+// the same branches, which keeps the lanes running together. for shaders
+// with derivatives, the lanes of a quad past the edge of the tile run too as
+// helpers, so that every pixel has its neighbours to difference with, but
+// write nothing.
+static size_t RenderBlocks(CpuSimdVm& vm, const std::vector<InputKind>& input_kinds, size_t width, size_t height, const Tile& tile, bool with_helpers, std::vector<float>& pixels)
+{
+	unsigned int lanes = vm.GetWidth();
+	size_t block_width = lanes == 4 ? 2 : 4;
+	size_t block_height = lanes / block_width;
+	size_t num_discarded = 0;
+	std::vector<float> inputs(std::max<size_t>(input_kinds.size(), 1) * 4 * lanes, 0.0f);
+	std::vector<float> outputs(4 * lanes, 0.0f);
+	std::vector<size_t> offsets(lanes);
+	for (size_t y = tile.top; y < tile.bottom; y += block_height)
+	{
+		for (size_t x = tile.left; x < tile.right; x += block_width)
+		{
+			unsigned int running = 0, helpers = 0;
+			for (unsigned int lane = 0; lane != lanes; ++lane)
+			{
+				size_t quad = lane / 4;
+				size_t qx = x + quad % (block_width / 2) * 2, qy = y + quad / (block_width / 2) * 2;
+				size_t lx = qx + (lane & 1), ly = qy + (lane >> 1 & 1);
+				if (lx < tile.right && ly < tile.bottom) running |= 1u << lane;
+				else if (with_helpers && qx < tile.right && qy < tile.bottom) helpers |= 1u << lane;
+				else continue;
+				offsets[lane] = (ly * width + lx) * 4;
+
+				float px = lx + 0.5f, py = ly + 0.5f;
+				for (size_t i = 0; i != input_kinds.size(); ++i)
+				{
+					float* input = &inputs[(lane * input_kinds.size() + i) * 4];
+					if (input_kinds[i] == IK_TexCoord)
+					{
+						input[0] = px / width;
+						input[1] = py / height;
+					}
+					else if (input_kinds[i] == IK_Position)
+					{
+						input[0] = px;
+						input[1] = py;
+						input[3] = 1.0f;
+					}
+				}
+			}
+
+			unsigned int kept = vm.Run(&inputs[0], running | helpers, &outputs[0]);
+			for (unsigned int lane = 0; lane != lanes; ++lane)
+			{
+				if ((running >> lane & 1) == 0) continue;
+				if ((kept >> lane & 1) != 0) std::copy(&outputs[lane * 4], &outputs[lane * 4] + 4, &pixels[offsets[lane]]);
+				else ++num_discarded;
+			}
+		}
+	}
+	return num_discarded;
+}
+
+struct CpuRenderer::Frame
+{
+	// what a worker renders with. only the engine asked for is made.
+	struct Worker
+	{
+		boost::shared_ptr<CpuShaderInterpreter> interpreter;
+		boost::shared_ptr<CpuBytecodeVm> vm;
+		boost::shared_ptr<CpuSimdVm> simd_vm;
+		size_t num_discarded;
+	};
+
+	size_t width;
+	size_t height;
+	std::vector<float>* pixels;
+	std::vector<InputKind> input_kinds;
+	bool with_helpers;
+	std::vector<Tile> tiles;
+	std::vector<Worker> workers;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuRenderer::CpuRenderer()
+	: m_precision(CpuShaderMath::PR_Precise)
+	, m_is_library_enabled(true)
+	, m_is_built(false)
+	, m_engine(EN_Bytecode)
+	, m_instruction_set(CpuSimdVm::GetBestInstructionSet())
+	, m_rendered_engine(EN_Bytecode)
+	, m_num_threads(0)
+	, m_time(0.0f)
+	, m_freq(0, 0, 0, 0)
+	, m_mpos(0, 0, 0, 0)
+	, m_num_discarded(0)
+	, m_num_cut_off_loops(0)
+	, m_num_tiles(0)
+	, m_num_stolen_tiles(0)
+{
+
+}
+
+CpuRenderer::~CpuRenderer()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool CpuRenderer::SetShader(const std::wstring& header, const std::wstring& text)
+{
+	m_is_built = m_program.Build(header, text);
+	m_errors = m_program.GetErrors();
+	m_jit.reset();
+	if (m_is_built)
+	{
+		CpuBytecodeCompiler compiler;
+		compiler.SetOptimizer(&m_optimizer);
+		compiler.SetPrecision(m_precision);
+		compiler.EnableLibrary(m_is_library_enabled);
+		m_is_built = compiler.Compile(m_program, m_bytecode);
+		if (!m_is_built)
+		{
+			CpuShaderProgram::Error error = {0, compiler.GetError()};
+			m_errors.push_back(error);
+		}
+	}
+	return m_is_built;
+}
+
+const CpuShaderProgram& CpuRenderer::GetProgram() const
+{
+	return m_program;
+}
+
+const CpuBytecode& CpuRenderer::GetBytecode() const
+{
+	return m_bytecode;
+}
+
+CpuBytecodeOptimizer& CpuRenderer::GetOptimizer()
+{
+	return m_optimizer;
+}
+
+void CpuRenderer::SetPrecision(CpuShaderMath::Precision precision)
+{
+	m_precision = precision;
+}
+
+CpuShaderMath::Precision CpuRenderer::GetPrecision() const
+{
+	return m_precision;
+}
+
+void CpuRenderer::EnableLibrary(bool is_enabled)
+{
+	m_is_library_enabled = is_enabled;
+}
+
+bool CpuRenderer::IsLibraryEnabled() const
+{
+	return m_is_library_enabled;
+}
+
+const std::vector<CpuShaderProgram::Error>& CpuRenderer::GetErrors() const
+{
+	return m_errors;
+}
+
+void CpuRenderer::SetEngine(Engine engine)
+{
+	m_engine = engine;
+}
+
+void CpuRenderer::SetInstructionSet(CpuSimdVm::InstructionSet instruction_set)
+{
+	m_instruction_set = instruction_set;
+}
+
+void CpuRenderer::SetJitCache(const std::string& directory)
+{
+	m_jit_directory = directory;
+}
+
+bool CpuRenderer::WaitForNative()
+{
+	if (!m_is_built) return false;
+	StartNative();
+	return m_jit->Wait();
+}
+
+const CpuShaderJit* CpuRenderer::GetJit() const
+{
+	return m_jit.get();
+}
+
+void CpuRenderer::SetNumThreads(size_t num_threads)
+{
+	m_num_threads = num_threads;
+}
+
+size_t CpuRenderer::GetNumThreads() const
+{
+	if (m_num_threads != 0) return m_num_threads;
+	return std::max<size_t>(boost::thread::hardware_concurrency(), 1);
+}
+
+void CpuRenderer::SetTexture(size_t slot, const CpuTexturePtr& texture)
+{
+	if (m_textures.size() <= slot) m_textures.resize(slot + 1);
+	m_textures[slot] = texture;
+}
+
+void CpuRenderer::SetTime(float time)
+{
+	m_time = time;
+}
+
+void CpuRenderer::SetFrequencies(const float4& freq)
+{
+	m_freq = freq;
+}
+
+void CpuRenderer::SetMousePosition(const float4& mpos)
+{
+	m_mpos = mpos;
+}
+
+void CpuRenderer::Render(size_t width, size_t height, std::vector<float>& pixels)
+{
+	pixels.assign(width * height * 4, 0.0f);
+	m_num_discarded = 0;
+	m_num_cut_off_loops = 0;
+	m_num_tiles = 0;
+	m_num_stolen_tiles = 0;
+	if (!m_is_built) return;
+
+	std::vector<float> constants;
+	FillConstants(width, height, constants);
+	CpuBytecodeVm::RunPrologue(m_bytecode, constants);
+
+	Frame frame;
+	frame.width = width;
+	frame.height = height;
+	frame.pixels = &pixels;
+	FindInputKinds(m_program, frame.input_kinds);
+	frame.with_helpers = m_bytecode.uses_derivatives;
+	MakeTiles(width, height, frame.tiles);
+	m_num_tiles = frame.tiles.size();
+
+	// the simd vm while the native code builds, the scalar one without simd.
+	Engine engine = m_engine;
+	if (engine == EN_Native)
+	{
+		StartNative();
+		if (!m_jit->IsReady()) engine = EN_Simd;
+	}
+	if (engine == EN_Simd && !CpuSimdVm::IsSupported(CpuSimdVm::GetBestInstructionSet())) engine = EN_Bytecode;
+	m_rendered_engine = engine;
+
+	size_t num_threads = GetNumThreads();
+	frame.workers.resize(num_threads);
+	for (size_t i = 0; i != num_threads; ++i)
+	{
+		Frame::Worker& worker = frame.workers[i];
+		worker.num_discarded = 0;
+		if (engine == EN_Interpreter)
+		{
+			worker.interpreter.reset(new CpuShaderInterpreter(m_program));
+			worker.interpreter->SetPrecision(m_precision);
+			worker.interpreter->SetConstants(constants);
+			for (size_t j = 0; j != m_textures.size(); ++j) worker.interpreter->SetTexture(j, m_textures[j].get());
+		}
+		else if (engine == EN_Simd || engine == EN_Native)
+		{
+			if (engine == EN_Native) worker.simd_vm.reset(new CpuSimdVm(m_jit->CreateKernel(), m_jit->GetInstructionSet()));
+			else worker.simd_vm.reset(new CpuSimdVm(m_bytecode, m_instruction_set));
+			worker.simd_vm->SetConstants(constants);
+			for (size_t j = 0; j != m_textures.size(); ++j) worker.simd_vm->SetTexture(j, m_textures[j].get());
+		}
+		else
+		{
+			worker.vm.reset(new CpuBytecodeVm(m_bytecode));
+			worker.vm->SetConstants(constants);
+			for (size_t j = 0; j != m_textures.size(); ++j) worker.vm->SetTexture(j, m_textures[j].get());
+		}
+	}
+
+	if (num_threads == 1)
+	{
+		for (size_t i = 0; i != frame.tiles.size(); ++i) RenderTile(frame, 0, i);
+	}
+	else
+	{
+		if (!m_pool || m_pool->GetNumThreads() != num_threads) m_pool.reset(new WorkStealingPool(num_threads));
+		WorkStealingPool::Statistics before = m_pool->GetStatistics();
+
+		// a stretch of the curve for each worker, dealt one each. the
+		// stretches split as they go, so that the cheap ones are stolen from.
+		size_t num_tiles = frame.tiles.size();
+		for (size_t i = 0; i != num_threads; ++i)
+		{
+			size_t begin = num_tiles * i / num_threads, end = num_tiles * (i + 1) / num_threads;
+			if (begin != end) m_pool->Submit(boost::bind(&CpuRenderer::RenderTiles, this, &frame, begin, end));
+		}
+		m_pool->Wait();
+		m_num_stolen_tiles = m_pool->GetStatistics().stolen - before.stolen;
+	}
+
+	for (size_t i = 0; i != frame.workers.size(); ++i)
+	{
+		const Frame::Worker& worker = frame.workers[i];
+		m_num_discarded += worker.num_discarded;
+		if (worker.interpreter) m_num_cut_off_loops += worker.interpreter->GetNumCutOffLoops();
+		else if (worker.simd_vm) m_num_cut_off_loops += worker.simd_vm->GetNumCutOffLoops();
+		else m_num_cut_off_loops += worker.vm->GetNumCutOffLoops();
+	}
+}
+
+size_t CpuRenderer::GetNumDiscarded() const
+{
+	return m_num_discarded;
+}
+
+size_t CpuRenderer::GetNumCutOffLoops() const
+{
+	return m_num_cut_off_loops;
+}
+
+size_t CpuRenderer::GetNumTiles() const
+{
+	return m_num_tiles;
+}
+
+size_t CpuRenderer::GetNumStolenTiles() const
+{
+	return m_num_stolen_tiles;
+}
+
+CpuRenderer::Engine CpuRenderer::GetRenderedEngine() const
+{
+	return m_rendered_engine;
+}
+
+void CpuRenderer::ToBytes(const std::vector<float>& pixels, std::vector<unsigned char>& bytes)
+{
+	bytes.resize(pixels.size());
+	for (size_t i = 0; i != pixels.size(); ++i)
+	{
+		float value = pixels[i];
+		if (!(value > 0.0f)) value = 0.0f;
+		else if (value > 1.0f) value = 1.0f;
+		bytes[i] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void CpuRenderer::FillConstants(size_t width, size_t height, std::vector<float>& constants) const
+{
+	// time, view, freq and mpos, as float4s by position, not by name.
+	float parameters[16] =
+	{
+		m_time, 0.0f, 0.0f, 0.0f,
+		static_cast<float>(width), static_cast<float>(height), 1.0f / width, 1.0f / height,
+		m_freq.x, m_freq.y, m_freq.z, m_freq.w,
+		m_mpos.x, m_mpos.y, m_mpos.z, m_mpos.w,
+	};
+	constants.assign(std::max<size_t>(m_program.GetConstantSize(), 16), 0.0f);
+	std::copy(parameters, parameters + 16, constants.begin());
+}
+
+void CpuRenderer::StartNative()
+{
+	if (m_jit) return;
+	m_jit.reset(new CpuShaderJit(m_jit_directory));
+	m_jit->Build(m_bytecode, CpuSimdVm::GetBestInstructionSet());
+}
+
+void CpuRenderer::RenderTiles(Frame* frame, size_t begin, size_t end)
+{
+	// the far half goes back to the queue of this worker, where a thief takes
+	// the oldest, so the largest, and the worker itself carries on with the
+	// near half. both keep to a stretch of tiles that lie together.
+	while (end - begin > 1)
+	{
+		size_t middle = begin + (end - begin) / 2;
+		m_pool->Submit(boost::bind(&CpuRenderer::RenderTiles, this, frame, middle, end));
+		end = middle;
+	}
+	RenderTile(*frame, m_pool->GetWorkerIndex(), begin);
+}
+
+void CpuRenderer::RenderTile(Frame& frame, size_t worker, size_t tile)
+{
+	Frame::Worker& state = frame.workers[worker];
+	const Tile& rect = frame.tiles[tile];
+	if (state.interpreter) state.num_discarded += RenderPixels(*state.interpreter, frame.input_kinds, frame.width, frame.height, rect, *frame.pixels);
+	else if (state.simd_vm) state.num_discarded += RenderBlocks(*state.simd_vm, frame.input_kinds, frame.width, frame.height, rect, frame.with_helpers, *frame.pixels);
+	else state.num_discarded += RenderPixels(*state.vm, frame.input_kinds, frame.width, frame.height, rect, *frame.pixels);
+}
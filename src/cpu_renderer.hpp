@@ -0,0 +1,139 @@
+#ifndef _CPU_RENDERER_HPP_INCLUDED_
+#define _CPU_RENDERER_HPP_INCLUDED_
+
+#include "common.hpp"
+#include <vector>
+#include "cpu_bytecode.hpp"
+#include "cpu_bytecode_optimizer.hpp"
+#include "cpu_shader_jit.hpp"
+#include "cpu_shader_program.hpp"
+#include "cpu_simd_vm.hpp"
+#include "cpu_texture.hpp"
+#include "work_stealing_pool.hpp"
+
+// renders a ps_main shader without a device, the way the editor draws it:
+// the Parameters cbuffer filled in as the editor fills it, texcoords from
+// the top left pixel center, and the textures bound by slot. the pixels are
+// floats as the shader returned them, top row first. the frame is cut into
+// tiles that a pool of threads renders, each with an engine of its own.
+class CpuRenderer
+{
+public:
+	// the interpreter walks the tree, as the reference. the vm runs the
+	// program lowered to bytecode, many times faster. the simd vm runs the
+	// same bytecode on blocks of pixels, a lane each. the native engine
+	// builds it to machine code of the same form with the system compiler,
+	// and the simd vm stands in until the build is done.
+	enum Engine
+	{
+		EN_Interpreter,
+		EN_Bytecode,
+		EN_Simd,
+		EN_Native,
+	};
+
+public:
+	CpuRenderer();
+	virtual ~CpuRenderer();
+
+public:
+	bool SetShader(const std::wstring& header, const std::wstring& text);
+	const CpuShaderProgram& GetProgram() const;
+	const CpuBytecode& GetBytecode() const;
+
+	// the passes the bytecode goes through, set before SetShader, and the
+	// instructions each left.
+	CpuBytecodeOptimizer& GetOptimizer();
+
+	// how every engine takes sin, pow and the like, set before SetShader.
+	// precise by default.
+	void SetPrecision(CpuShaderMath::Precision precision);
+	CpuShaderMath::Precision GetPrecision() const;
+
+	// whether the noise functions of the fx headers run as ops of their
+	// own, set before SetShader. on by default.
+	void EnableLibrary(bool is_enabled);
+	bool IsLibraryEnabled() const;
+
+	// of the program, or the reason it could not be lowered.
+	const std::vector<CpuShaderProgram::Error>& GetErrors() const;
+
+	void SetEngine(Engine engine);
+
+	// for the simd vm, the best the cpu supports by default, and instead of
+	// one it does not. without any, the simd engine is the scalar vm.
+	void SetInstructionSet(CpuSimdVm::InstructionSet instruction_set);
+
+	// where the native engine caches what it builds, the temporary
+	// directory by default.
+	void SetJitCache(const std::string& directory);
+
+	// starts building the native code of the shader, if not yet, and blocks
+	// until it is done. false if it could not be built.
+	bool WaitForNative();
+
+	// the build of the native code, null until the native engine is asked for.
+	const CpuShaderJit* GetJit() const;
+
+	// zero means one per hardware thread, the default. one renders on the
+	// calling thread.
+	void SetNumThreads(size_t num_threads);
+	size_t GetNumThreads() const;
+
+	void SetTexture(size_t slot, const CpuTexturePtr& texture);
+
+	// time goes to time.x, the others come as the editor smoothed them.
+	void SetTime(float time);
+	void SetFrequencies(const float4& freq);
+	void SetMousePosition(const float4& mpos);
+
+	// rgba per pixel. discarded pixels are left black.
+	void Render(size_t width, size_t height, std::vector<float>& pixels);
+
+	// of the last render.
+	size_t GetNumDiscarded() const;
+	size_t GetNumCutOffLoops() const;
+	size_t GetNumTiles() const;
+
+	// the engine that did render, a stand in for one not ready yet.
+	Engine GetRenderedEngine() const;
+	size_t GetNumStolenTiles() const;
+
+	// clamps to [0, 1] and rounds, the way a unorm target stores them.
+	static void ToBytes(const std::vector<float>& pixels, std::vector<unsigned char>& bytes);
+
+private:
+	// the frame being rendered, shared by the workers.
+	struct Frame;
+
+	void FillConstants(size_t width, size_t height, std::vector<float>& constants) const;
+	void StartNative();
+	void RenderTiles(Frame* frame, size_t begin, size_t end);
+	static void RenderTile(Frame& frame, size_t worker, size_t tile);
+
+private:
+	CpuShaderProgram m_program;
+	CpuBytecode m_bytecode;
+	CpuBytecodeOptimizer m_optimizer;
+	CpuShaderMath::Precision m_precision;
+	bool m_is_library_enabled;
+	bool m_is_built;
+	std::vector<CpuShaderProgram::Error> m_errors;
+	Engine m_engine;
+	CpuSimdVm::InstructionSet m_instruction_set;
+	std::string m_jit_directory;
+	CpuShaderJitPtr m_jit;
+	Engine m_rendered_engine;
+	size_t m_num_threads;
+	WorkStealingPoolPtr m_pool;
+	std::vector<CpuTexturePtr> m_textures;
+	float m_time;
+	float4 m_freq;
+	float4 m_mpos;
+	size_t m_num_discarded;
+	size_t m_num_cut_off_loops;
+	size_t m_num_tiles;
+	size_t m_num_stolen_tiles;
+};
+
+#endif  // _CPU_RENDERER_HPP_INCLUDED_
@@ -0,0 +1,586 @@
+#include "common.hpp"
+#include "cpu_shader_interpreter.hpp"
+#include "cpu_shader_math.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+typedef CpuShaderProgram Program;
+
+using namespace CpuShaderMath;
+
+// the intrinsics working on one component at a time.
+static float Componentwise(Program::Intrinsic intrinsic, float a, float b, float c, Precision precision)
+{
+	switch (intrinsic)
+	{
+	case Program::IN_Abs: return std::fabs(a);
+	case Program::IN_Acos: return Acos(a, precision);
+	case Program::IN_Asin: return Asin(a, precision);
+	case Program::IN_Atan: return Atan(a, precision);
+	case Program::IN_Atan2: return Atan2(a, b, precision);
+	case Program::IN_Ceil: return std::ceil(a);
+	case Program::IN_Clamp: return Clamp(a, b, c);
+	case Program::IN_Cos: return Cos(a, precision);
+	case Program::IN_Cosh: return std::cosh(a);
+	case Program::IN_Degrees: return Degrees(a);
+	case Program::IN_Exp: return Exp(a, precision);
+	case Program::IN_Exp2: return Exp2(a, precision);
+	case Program::IN_Floor: return std::floor(a);
+	case Program::IN_Fmod: return Fmod(a, b, precision);
+	case Program::IN_Frac: return Frac(a);
+	case Program::IN_Isinf: return IsInf(a) ? 1.0f : 0.0f;
+	case Program::IN_Isnan: return IsNan(a) ? 1.0f : 0.0f;
+	case Program::IN_Lerp: return Lerp(a, b, c);
+	case Program::IN_Log: return Log(a, precision);
+	case Program::IN_Log10: return Log10(a, precision);
+	case Program::IN_Log2: return Log2(a, precision);
+	case Program::IN_Max: return Max(a, b);
+	case Program::IN_Min: return Min(a, b);
+	case Program::IN_Pow: return Pow(a, b, precision);
+	case Program::IN_Radians: return Radians(a);
+	case Program::IN_Round: return Round(a);
+	case Program::IN_Rsqrt: return Rsqrt(a);
+	case Program::IN_Saturate: return Saturate(a);
+	case Program::IN_Sign: return Sign(a);
+	case Program::IN_Sin: return Sin(a, precision);
+	case Program::IN_Sinh: return std::sinh(a);
+	case Program::IN_Smoothstep: return Smoothstep(a, b, c);
+	case Program::IN_Sqrt: return std::sqrt(a);
+	case Program::IN_Step: return Step(a, b);
+	case Program::IN_Tan: return Tan(a, precision);
+	case Program::IN_Tanh: return std::tanh(a);
+	case Program::IN_Trunc: return Truncate(a);
+
+	// a pixel at a time, without neighbours to difference with. the simd
+	// vm runs quads and has them.
+	default: return 0.0f;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuShaderInterpreter::CpuShaderInterpreter(const CpuShaderProgram& program)
+	: m_program(program)
+	, m_globals(program.GetGlobalSize(), 0.0f)
+	, m_frame(0)
+	, m_top(0)
+	, m_textures(program.GetNumTextures(), static_cast<const CpuTexture*>(NULL))
+	, m_num_cut_off_loops(0)
+	, m_precision(PR_Precise)
+{
+	std::fill(m_return.v, m_return.v + 4, 0.0f);
+}
+
+CpuShaderInterpreter::~CpuShaderInterpreter()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void CpuShaderInterpreter::SetConstants(const std::vector<float>& constants)
+{
+	size_t size = std::min(constants.size(), m_program.GetConstantSize());
+	std::copy(constants.begin(), constants.begin() + size, m_globals.begin());
+}
+
+void CpuShaderInterpreter::SetTexture(size_t slot, const CpuTexture* texture)
+{
+	if (slot < m_textures.size()) m_textures[slot] = texture;
+}
+
+void CpuShaderInterpreter::SetPrecision(CpuShaderMath::Precision precision)
+{
+	m_precision = precision;
+}
+
+bool CpuShaderInterpreter::Run(const float* inputs, float output[4])
+{
+	// the statics start over with every pixel.
+	const std::vector<CpuShaderProgram::StmtPtr>& inits = m_program.GetGlobalInits();
+	for (size_t i = 0; i != inits.size(); ++i) Execute(*inits[i]);
+
+	const CpuShaderProgram::Function& entry = m_program.GetFunctions()[m_program.GetEntryPoint()];
+	const std::vector<CpuShaderProgram::Variable>& variables = m_program.GetVariables();
+	m_frame = 0;
+	m_top = entry.frame_size;
+	if (m_stack.size() < m_top) m_stack.resize(m_top);
+	std::fill(m_stack.begin(), m_stack.begin() + m_top, 0.0f);
+	for (size_t i = 0; i != entry.params.size(); ++i)
+	{
+		const CpuShaderProgram::Variable& param = variables[entry.params[i]];
+		if (param.mode != CpuShaderProgram::PM_Out) std::copy(inputs + i * 4, inputs + i * 4 + param.type.size, &m_stack[param.offset]);
+	}
+
+	Flow flow = Execute(*entry.body);
+	if (flow == FL_Discard) return false;
+
+	// a void entry point writes its color to the first out parameter.
+	Value color = m_return;
+	if (entry.return_type.base == CpuShaderProgram::BT_Void)
+	{
+		for (size_t i = 0; i != entry.params.size(); ++i)
+		{
+			const CpuShaderProgram::Variable& param = variables[entry.params[i]];
+			if (param.mode == CpuShaderProgram::PM_In) continue;
+			std::copy(&m_stack[param.offset], &m_stack[param.offset] + param.type.size, color.v);
+			break;
+		}
+	}
+	std::copy(color.v, color.v + 4, output);
+	return true;
+}
+
+size_t CpuShaderInterpreter::GetNumCutOffLoops() const
+{
+	return m_num_cut_off_loops;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+CpuShaderInterpreter::Flow CpuShaderInterpreter::Execute(const Stmt& stmt)
+{
+	switch (stmt.kind)
+	{
+	case CpuShaderProgram::SK_Block:
+		for (size_t i = 0; i != stmt.body.size(); ++i)
+		{
+			Flow flow = Execute(*stmt.body[i]);
+			if (flow != FL_Normal) return flow;
+		}
+		return FL_Normal;
+
+	case CpuShaderProgram::SK_Expression:
+		{
+			Value value;
+			Evaluate(*stmt.expr, value);
+			return FL_Normal;
+		}
+
+	case CpuShaderProgram::SK_Declare:
+		{
+			// uninitialized variables start at zero, to be deterministic.
+			Value value = {{0.0f, 0.0f, 0.0f, 0.0f}};
+			if (stmt.expr) Evaluate(*stmt.expr, value);
+			const CpuShaderProgram::Variable& variable = m_program.GetVariables()[stmt.variable];
+			std::copy(value.v, value.v + variable.type.size, Address(stmt.variable));
+			return FL_Normal;
+		}
+
+	case CpuShaderProgram::SK_If:
+		{
+			Value condition;
+			Evaluate(*stmt.expr, condition);
+			if (condition.v[0] != 0.0f) return Execute(*stmt.body[0]);
+			if (stmt.body.size() > 1) return Execute(*stmt.body[1]);
+			return FL_Normal;
+		}
+
+	case CpuShaderProgram::SK_For:
+	case CpuShaderProgram::SK_While:
+	case CpuShaderProgram::SK_Do:
+		return ExecuteLoop(stmt);
+
+	case CpuShaderProgram::SK_Return:
+		if (stmt.expr)
+		{
+			// not in place, a call in the value returns through m_return too.
+			Value value;
+			Evaluate(*stmt.expr, value);
+			m_return = value;
+		}
+		return FL_Return;
+
+	case CpuShaderProgram::SK_Break:
+		return FL_Break;
+
+	case CpuShaderProgram::SK_Continue:
+		return FL_Continue;
+
+	case CpuShaderProgram::SK_Discard:
+		return FL_Discard;
+	}
+	return FL_Normal;
+}
+
+CpuShaderInterpreter::Flow CpuShaderInterpreter::ExecuteLoop(const Stmt& stmt)
+{
+	const Stmt* body = stmt.body.back().get();
+	if (stmt.kind == CpuShaderProgram::SK_For)
+	{
+		Flow flow = Execute(*stmt.body[0]);
+		if (flow != FL_Normal) return flow;
+	}
+
+	Value value;
+	for (size_t iteration = 0; ; ++iteration)
+	{
+		if (iteration == max_loop_iterations)
+		{
+			++m_num_cut_off_loops;
+			break;
+		}
+
+		if (stmt.kind != CpuShaderProgram::SK_Do && stmt.expr)
+		{
+			Evaluate(*stmt.expr, value);
+			if (value.v[0] == 0.0f) break;
+		}
+
+		Flow flow = Execute(*body);
+		if (flow == FL_Break) break;
+		if (flow == FL_Return || flow == FL_Discard) return flow;
+
+		if (stmt.step) Evaluate(*stmt.step, value);
+		if (stmt.kind == CpuShaderProgram::SK_Do)
+		{
+			Evaluate(*stmt.expr, value);
+			if (value.v[0] == 0.0f) break;
+		}
+	}
+	return FL_Normal;
+}
+
+void CpuShaderInterpreter::Evaluate(const Expr& expr, Value& value)
+{
+	switch (expr.kind)
+	{
+	case CpuShaderProgram::EK_Constant:
+		std::copy(expr.value, expr.value + 4, value.v);
+		break;
+
+	case CpuShaderProgram::EK_Variable:
+		{
+			const float* address = Address(expr.variable);
+			std::copy(address, address + expr.type.size, value.v);
+		}
+		break;
+
+	case CpuShaderProgram::EK_Swizzle:
+		{
+			Value object;
+			Evaluate(*expr.args[0], object);
+			for (unsigned int i = 0; i != expr.type.size; ++i) value.v[i] = object.v[expr.components[i]];
+		}
+		break;
+
+	case CpuShaderProgram::EK_Convert:
+		Evaluate(*expr.args[0], value);
+		ConvertValue(expr.args[0]->type, expr.type, value);
+		break;
+
+	case CpuShaderProgram::EK_Construct:
+		{
+			unsigned int size = 0;
+			for (size_t i = 0; i != expr.args.size(); ++i)
+			{
+				Value part;
+				Evaluate(*expr.args[i], part);
+				for (unsigned int j = 0; j != expr.args[i]->type.size; ++j) value.v[size++] = part.v[j];
+			}
+		}
+		break;
+
+	case CpuShaderProgram::EK_Unary:
+		Evaluate(*expr.args[0], value);
+		for (unsigned int i = 0; i != expr.type.size; ++i)
+		{
+			float& x = value.v[i];
+			if (expr.op == CpuShaderProgram::OP_Negate) x = -x;
+			else if (expr.op == CpuShaderProgram::OP_Not) x = x == 0.0f ? 1.0f : 0.0f;
+			else if (expr.type.base == CpuShaderProgram::BT_Uint) x = static_cast<float>(~static_cast<unsigned int>(x));
+			else x = static_cast<float>(~static_cast<int>(x));
+		}
+		break;
+
+	case CpuShaderProgram::EK_Binary:
+		EvaluateBinary(expr, value);
+		break;
+
+	case CpuShaderProgram::EK_Conditional:
+		{
+			// both sides, as the gpu does.
+			Value condition, rhs;
+			Evaluate(*expr.args[0], condition);
+			Evaluate(*expr.args[1], value);
+			Evaluate(*expr.args[2], rhs);
+			bool is_scalar = expr.args[0]->type.size == 1;
+			for (unsigned int i = 0; i != expr.type.size; ++i)
+			{
+				if (condition.v[is_scalar ? 0 : i] == 0.0f) value.v[i] = rhs.v[i];
+			}
+		}
+		break;
+
+	case CpuShaderProgram::EK_Assign:
+		Evaluate(*expr.args[1], value);
+		Store(*expr.args[0], value);
+		break;
+
+	case CpuShaderProgram::EK_Increment:
+		{
+			Value updated;
+			Evaluate(*expr.args[0], value);
+			float delta = expr.op == CpuShaderProgram::OP_Add ? 1.0f : -1.0f;
+			for (unsigned int i = 0; i != expr.type.size; ++i) updated.v[i] = value.v[i] + delta;
+			Store(*expr.args[0], updated);
+			if (expr.is_prefix) value = updated;
+		}
+		break;
+
+	case CpuShaderProgram::EK_Call:
+		EvaluateCall(expr, value);
+		break;
+
+	case CpuShaderProgram::EK_Intrinsic:
+		EvaluateIntrinsic(expr, value);
+		break;
+
+	case CpuShaderProgram::EK_Comma:
+		Evaluate(*expr.args[0], value);
+		Evaluate(*expr.args[1], value);
+		break;
+	}
+}
+
+void CpuShaderInterpreter::EvaluateBinary(const Expr& expr, Value& value)
+{
+	Value rhs;
+	Evaluate(*expr.args[0], value);
+	Evaluate(*expr.args[1], rhs);
+
+	const Type& type = expr.args[0]->type;
+	bool is_integer = type.base == CpuShaderProgram::BT_Int || type.base == CpuShaderProgram::BT_Uint || type.base == CpuShaderProgram::BT_Bool;
+	for (unsigned int i = 0; i != type.size; ++i)
+	{
+		float a = value.v[i], b = rhs.v[i];
+		float& r = value.v[i];
+		switch (expr.op)
+		{
+		case CpuShaderProgram::OP_Add: r = a + b; break;
+		case CpuShaderProgram::OP_Subtract: r = a - b; break;
+		case CpuShaderProgram::OP_Multiply: r = a * b; break;
+		case CpuShaderProgram::OP_Divide:
+			r = is_integer ? IntDivide(a, b) : a / b;
+			break;
+		case CpuShaderProgram::OP_Modulo:
+			r = is_integer ? IntModulo(a, b) : Fmod(a, b, m_precision);
+			break;
+		case CpuShaderProgram::OP_Less: r = a < b ? 1.0f : 0.0f; break;
+		case CpuShaderProgram::OP_LessEqual: r = a <= b ? 1.0f : 0.0f; break;
+		case CpuShaderProgram::OP_Greater: r = a > b ? 1.0f : 0.0f; break;
+		case CpuShaderProgram::OP_GreaterEqual: r = a >= b ? 1.0f : 0.0f; break;
+		case CpuShaderProgram::OP_Equal: r = a == b ? 1.0f : 0.0f; break;
+		case CpuShaderProgram::OP_NotEqual: r = a != b ? 1.0f : 0.0f; break;
+		case CpuShaderProgram::OP_And: r = a != 0.0f && b != 0.0f ? 1.0f : 0.0f; break;
+		case CpuShaderProgram::OP_Or: r = a != 0.0f || b != 0.0f ? 1.0f : 0.0f; break;
+		default:
+			{
+				// bitwise, on the integers held by the floats.
+				long long x = static_cast<long long>(a), y = static_cast<long long>(b);
+				long long z = 0;
+				if (expr.op == CpuShaderProgram::OP_BitAnd) z = x & y;
+				else if (expr.op == CpuShaderProgram::OP_BitOr) z = x | y;
+				else if (expr.op == CpuShaderProgram::OP_BitXor) z = x ^ y;
+				else if (expr.op == CpuShaderProgram::OP_ShiftLeft) z = x << (y & 31);
+				else z = x >> (y & 31);
+				r = type.base == CpuShaderProgram::BT_Uint ? static_cast<float>(static_cast<unsigned int>(z)) : static_cast<float>(static_cast<int>(z));
+			}
+			break;
+		}
+	}
+}
+
+void CpuShaderInterpreter::EvaluateCall(const Expr& expr, Value& value)
+{
+	const CpuShaderProgram::Function& function = m_program.GetFunctions()[expr.function];
+	const std::vector<CpuShaderProgram::Variable>& variables = m_program.GetVariables();
+
+	// the arguments are evaluated in the caller's frame.
+	std::vector<Value> args(expr.args.size());
+	for (size_t i = 0; i != expr.args.size(); ++i)
+	{
+		const CpuShaderProgram::Variable& param = variables[function.params[i]];
+		std::fill(args[i].v, args[i].v + 4, 0.0f);
+		if (param.mode == CpuShaderProgram::PM_Out) continue;
+		Evaluate(*expr.args[i], args[i]);
+		if (param.mode == CpuShaderProgram::PM_InOut) ConvertValue(expr.args[i]->type, param.type, args[i]);
+	}
+
+	size_t caller_frame = m_frame;
+	size_t frame = m_top;
+	m_top += function.frame_size;
+	if (m_stack.size() < m_top) m_stack.resize(m_top * 2);
+	std::fill(m_stack.begin() + frame, m_stack.begin() + m_top, 0.0f);
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		const CpuShaderProgram::Variable& param = variables[function.params[i]];
+		std::copy(args[i].v, args[i].v + param.type.size, &m_stack[frame + param.offset]);
+	}
+
+	m_frame = frame;
+	Execute(*function.body);
+	value = m_return;
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		const CpuShaderProgram::Variable& param = variables[function.params[i]];
+		if (param.mode != CpuShaderProgram::PM_In) std::copy(&m_stack[frame + param.offset], &m_stack[frame + param.offset] + param.type.size, args[i].v);
+	}
+	m_frame = caller_frame;
+	m_top = frame;
+
+	// out arguments are written back converted to their own type.
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		const CpuShaderProgram::Variable& param = variables[function.params[i]];
+		if (param.mode == CpuShaderProgram::PM_In) continue;
+		ConvertValue(param.type, expr.args[i]->type, args[i]);
+		Store(*expr.args[i], args[i]);
+	}
+}
+
+void CpuShaderInterpreter::EvaluateIntrinsic(const Expr& expr, Value& value)
+{
+	CpuShaderProgram::Intrinsic intrinsic = static_cast<CpuShaderProgram::Intrinsic>(expr.function);
+	Value args[3];
+	size_t num_evaluated = intrinsic == CpuShaderProgram::IN_Sincos ? 1 : std::min<size_t>(expr.args.size(), 3);
+	if (intrinsic == CpuShaderProgram::IN_Sample || intrinsic == CpuShaderProgram::IN_SampleLevel)
+	{
+		// the texture and sampler are variables naming their slots. Sample
+		// reads the top level, see CpuTexture::Sample.
+		Value level = {{0.0f, 0.0f, 0.0f, 0.0f}};
+		Evaluate(*expr.args[2], args[2]);
+		if (intrinsic == CpuShaderProgram::IN_SampleLevel) Evaluate(*expr.args[3], level);
+		size_t slot = m_program.GetVariables()[expr.args[0]->variable].offset;
+		const CpuTexture* texture = slot < m_textures.size() ? m_textures[slot] : NULL;
+		if (texture != NULL) texture->Sample(args[2].v[0], args[2].v[1], level.v[0], value.v);
+		else std::fill(value.v, value.v + 4, 0.0f);
+		return;
+	}
+	for (size_t i = 0; i != num_evaluated; ++i) Evaluate(*expr.args[i], args[i]);
+
+	unsigned int size = expr.args[0]->type.size;
+	const float* a = args[0].v;
+	const float* b = args[1].v;
+	switch (intrinsic)
+	{
+	case CpuShaderProgram::IN_All:
+	case CpuShaderProgram::IN_Any:
+		{
+			bool is_all = intrinsic == CpuShaderProgram::IN_All;
+			bool result = is_all;
+			for (unsigned int i = 0; i != size; ++i)
+			{
+				if ((a[i] != 0.0f) != is_all) result = !is_all;
+			}
+			value.v[0] = result ? 1.0f : 0.0f;
+		}
+		break;
+
+	case CpuShaderProgram::IN_Cross:
+		value.v[0] = a[1] * b[2] - a[2] * b[1];
+		value.v[1] = a[2] * b[0] - a[0] * b[2];
+		value.v[2] = a[0] * b[1] - a[1] * b[0];
+		break;
+
+	case CpuShaderProgram::IN_Distance:
+		{
+			float d[4];
+			for (unsigned int i = 0; i != size; ++i) d[i] = a[i] - b[i];
+			value.v[0] = std::sqrt(Dot(d, d, size));
+		}
+		break;
+
+	case CpuShaderProgram::IN_Dot:
+		value.v[0] = Dot(a, b, size);
+		break;
+
+	case CpuShaderProgram::IN_Length:
+		value.v[0] = std::sqrt(Dot(a, a, size));
+		break;
+
+	case CpuShaderProgram::IN_Normalize:
+		{
+			float scale = 1.0f / std::sqrt(Dot(a, a, size));
+			for (unsigned int i = 0; i != size; ++i) value.v[i] = a[i] * scale;
+		}
+		break;
+
+	case CpuShaderProgram::IN_Reflect:
+		{
+			float d = 2.0f * Dot(a, b, size);
+			for (unsigned int i = 0; i != size; ++i) value.v[i] = a[i] - d * b[i];
+		}
+		break;
+
+	case CpuShaderProgram::IN_Refract:
+		{
+			float eta = args[2].v[0];
+			float d = Dot(a, b, size);
+			float k = 1.0f - eta * eta * (1.0f - d * d);
+			for (unsigned int i = 0; i != size; ++i) value.v[i] = k < 0.0f ? 0.0f : eta * a[i] - (eta * d + std::sqrt(k)) * b[i];
+		}
+		break;
+
+	case CpuShaderProgram::IN_Sincos:
+		{
+			Value s = args[0], c = args[0];
+			for (unsigned int i = 0; i != size; ++i)
+			{
+				s.v[i] = Sin(a[i], m_precision);
+				c.v[i] = Cos(a[i], m_precision);
+			}
+			ConvertValue(expr.args[0]->type, expr.args[1]->type, s);
+			ConvertValue(expr.args[0]->type, expr.args[2]->type, c);
+			Store(*expr.args[1], s);
+			Store(*expr.args[2], c);
+		}
+		break;
+
+	default:
+		{
+			// the arguments were converted to the size of the result.
+			const float* c = args[2].v;
+			for (unsigned int i = 0; i != expr.type.size; ++i) value.v[i] = Componentwise(intrinsic, a[i], b[i], c[i], m_precision);
+		}
+		break;
+	}
+}
+
+void CpuShaderInterpreter::Store(const Expr& target, const Value& value)
+{
+	if (target.kind == CpuShaderProgram::EK_Variable)
+	{
+		std::copy(value.v, value.v + target.type.size, Address(target.variable));
+		return;
+	}
+
+	// a swizzle, always of a variable, once built.
+	const Expr& object = *target.args[0];
+	float* address = Address(object.variable);
+	for (unsigned int i = 0; i != target.type.size; ++i) address[target.components[i]] = value.v[i];
+}
+
+float* CpuShaderInterpreter::Address(size_t variable)
+{
+	const CpuShaderProgram::Variable& info = m_program.GetVariables()[variable];
+	return info.is_global ? &m_globals[info.offset] : &m_stack[m_frame + info.offset];
+}
+
+void CpuShaderInterpreter::ConvertValue(const Type& from, const Type& to, Value& value)
+{
+	if (from.size == 1) std::fill(value.v + 1, value.v + 4, value.v[0]);
+	for (unsigned int i = 0; i != to.size; ++i)
+	{
+		float& x = value.v[i];
+		if (to.base == CpuShaderProgram::BT_Bool) x = x != 0.0f ? 1.0f : 0.0f;
+		else if (to.base == CpuShaderProgram::BT_Int || to.base == CpuShaderProgram::BT_Uint)
+		{
+			if (from.base == CpuShaderProgram::BT_Float) x = Truncate(x);
+		}
+	}
+}
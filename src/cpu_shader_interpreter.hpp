@@ -0,0 +1,81 @@
+#ifndef _CPU_SHADER_INTERPRETER_HPP_INCLUDED_
+#define _CPU_SHADER_INTERPRETER_HPP_INCLUDED_
+
+#include <vector>
+#include "cpu_shader_math.hpp"
+#include "cpu_shader_program.hpp"
+#include "cpu_texture.hpp"
+
+// runs a built program one pixel at a time by walking its typed tree. it
+// is the reference the faster engines are checked against, so it does
+// every operation in the plainest way. one interpreter per thread, the
+// program and the textures may be shared.
+class CpuShaderInterpreter
+{
+public:
+	// loops running longer than this are cut off, a hung shader would
+	// hang the device as well.
+	static const size_t max_loop_iterations = 1 << 16;
+
+public:
+	explicit CpuShaderInterpreter(const CpuShaderProgram& program);
+	virtual ~CpuShaderInterpreter();
+
+public:
+	// the cbuffer, laid out the way the program packed it.
+	void SetConstants(const std::vector<float>& constants);
+	void SetTexture(size_t slot, const CpuTexture* texture);
+
+	// how the transcendental intrinsics are computed, precisely by default.
+	void SetPrecision(CpuShaderMath::Precision precision);
+
+	// four floats per parameter of the entry point in, the color out.
+	// false if the pixel was discarded.
+	bool Run(const float* inputs, float output[4]);
+
+	// loops cut off so far.
+	size_t GetNumCutOffLoops() const;
+
+private:
+	typedef CpuShaderProgram::Expr Expr;
+	typedef CpuShaderProgram::Stmt Stmt;
+	typedef CpuShaderProgram::Type Type;
+
+	struct Value
+	{
+		float v[4];
+	};
+
+	enum Flow
+	{
+		FL_Normal,
+		FL_Break,
+		FL_Continue,
+		FL_Return,
+		FL_Discard,
+	};
+
+	Flow Execute(const Stmt& stmt);
+	Flow ExecuteLoop(const Stmt& stmt);
+	void Evaluate(const Expr& expr, Value& value);
+	void EvaluateBinary(const Expr& expr, Value& value);
+	void EvaluateCall(const Expr& expr, Value& value);
+	void EvaluateIntrinsic(const Expr& expr, Value& value);
+	void Store(const Expr& target, const Value& value);
+
+	float* Address(size_t variable);
+	static void ConvertValue(const Type& from, const Type& to, Value& value);
+
+private:
+	const CpuShaderProgram& m_program;
+	std::vector<float> m_globals;
+	std::vector<float> m_stack;
+	size_t m_frame;
+	size_t m_top;
+	Value m_return;
+	std::vector<const CpuTexture*> m_textures;
+	size_t m_num_cut_off_loops;
+	CpuShaderMath::Precision m_precision;
+};
+
+#endif  // _CPU_SHADER_INTERPRETER_HPP_INCLUDED_
@@ -0,0 +1,1096 @@
+#include "common.hpp"
+#include "cpu_shader_jit.hpp"
+#include "content_hash.hpp"
+#include "cpu_shader_interpreter.hpp"
+#include "cpu_texture.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#if !defined(_WIN32)
+#define CPU_SHADER_JIT
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#else
+#include <process.h>
+#define getpid _getpid
+#endif
+
+// what the generated code is handed, laid out the same on both sides.
+struct NativeContext
+{
+	const float* constants;
+	const void* const* textures;
+	void (*sample)(const CpuTexture* texture, unsigned int lanes, const float* u, const float* v, const float* level, float* color);
+	float (*bit_op)(int opcode, unsigned int flags, float a, float b);
+	void (*math)(unsigned int opcode, unsigned int precision, const float* a, const float* b, float* result);
+	void (*noise)(unsigned int opcode, unsigned int size, unsigned int precision, const float* a, const float* b, float* result);
+	unsigned long long num_cut_off_loops;
+};
+
+typedef unsigned int (*NativeRun)(NativeContext* context, const float* inputs, unsigned int lanes, float* outputs);
+
+static const char entry_point_name[] = "hlsl_native_run";
+
+// the runtime of the generated code. a V holds a component for every lane,
+// an M a mask, and the compiler turns their ops into vector instructions of
+// the host cpu. every op is the one the simd kernel does, to the bit.
+static const char runtime_head[] =
+	"// generated from the bytecode of a shader by CpuShaderJit.\n"
+	"#include <cmath>\n"
+	"#include <cstring>\n"
+	"\n"
+	"enum { W = ";
+
+static const char runtime_body[] =
+	" };\n"
+	"typedef float V __attribute__((vector_size(W * 4)));\n"
+	"typedef int M __attribute__((vector_size(W * 4)));\n"
+	"\n"
+	"struct Context\n"
+	"{\n"
+	"\tconst float* constants;\n"
+	"\tconst void* const* textures;\n"
+	"\tvoid (*sample)(const void* texture, unsigned int lanes, const float* u, const float* v, const float* level, float* color);\n"
+	"\tfloat (*bit_op)(int opcode, unsigned int flags, float a, float b);\n"
+	"\tvoid (*math)(unsigned int opcode, unsigned int precision, const float* a, const float* b, float* result);\n"
+	"\tvoid (*noise)(unsigned int opcode, unsigned int size, unsigned int precision, const float* a, const float* b, float* result);\n"
+	"\tunsigned long long num_cut_off_loops;\n"
+	"};\n"
+	"\n"
+	"static inline V Splat(float x) { V v; for (int l = 0; l != W; ++l) v[l] = x; return v; }\n"
+	"static inline V Zero() { return Splat(0.0f); }\n"
+	"static inline V Bits(unsigned int bits) { float x; std::memcpy(&x, &bits, 4); return Splat(x); }\n"
+	"static inline V Gather(const float* p, int stride) { V v; for (int l = 0; l != W; ++l) v[l] = p[l * stride]; return v; }\n"
+	"static inline M NoLanes() { return (M)Zero(); }\n"
+	"static inline M FromLanes(unsigned int lanes) { M m; for (int l = 0; l != W; ++l) m[l] = (lanes >> l & 1) != 0 ? -1 : 0; return m; }\n"
+	"static inline unsigned int GetLanes(M m) { unsigned int lanes = 0; for (int l = 0; l != W; ++l) lanes |= (m[l] != 0 ? 1u : 0u) << l; return lanes; }\n"
+	"static inline bool Any(M m) { int x = 0; for (int l = 0; l != W; ++l) x |= m[l]; return x != 0; }\n"
+	"static inline unsigned int Count(M m) { unsigned int n = 0; for (int l = 0; l != W; ++l) n += m[l] != 0 ? 1 : 0; return n; }\n"
+	"\n"
+	"static inline V Select(M m, V a, V b) { return (V)(((M)a & m) | ((M)b & ~m)); }\n"
+	"static inline V Float(M m) { return (V)(m & (M)Splat(1.0f)); }\n"
+	"static inline M IsTrue(V a) { return a != Zero(); }\n"
+	"static inline V Abs(V a) { return (V)((M)a & (M)Bits(0x7fffffffu)); }\n"
+	"static inline V Min(V a, V b) { return Select(b < a, b, a); }\n"
+	"static inline V Max(V a, V b) { return Select(a < b, b, a); }\n"
+	"static inline V Floor(V a) { for (int l = 0; l != W; ++l) a[l] = std::floor(a[l]); return a; }\n"
+	"static inline V Ceil(V a) { for (int l = 0; l != W; ++l) a[l] = std::ceil(a[l]); return a; }\n"
+	"static inline V Truncate(V a) { for (int l = 0; l != W; ++l) a[l] = std::trunc(a[l]); return a; }\n"
+	"static inline V Sqrt(V a) { for (int l = 0; l != W; ++l) a[l] = std::sqrt(a[l]); return a; }\n"
+	"static inline V Saturate(V x) { return Select(x < Zero(), Zero(), Select(x > Splat(1.0f), Splat(1.0f), x)); }\n"
+	"static inline V Sign(V x) { return Select(x > Zero(), Splat(1.0f), Select(x < Zero(), Splat(-1.0f), Zero())); }\n"
+	"\n"
+	"// the lanes of a quad are 0 1 over 2 3, differenced by row and by column.\n"
+	"static inline V Ddx(V a) { V r; for (int l = 0; l != W; ++l) r[l] = a[l | 1] - a[l & ~1]; return r; }\n"
+	"static inline V Ddy(V a) { V r; for (int l = 0; l != W; ++l) r[l] = a[l | 2] - a[l & ~2]; return r; }\n"
+	"static inline V Fwidth(V a) { return Abs(Ddx(a)) + Abs(Ddy(a)); }\n"
+	"\n"
+	"static float Acos(float x) { return std::acos(x); }\n"
+	"static float Asin(float x) { return std::asin(x); }\n"
+	"static float Atan(float x) { return std::atan(x); }\n"
+	"static float Atan2(float y, float x) { return std::atan2(y, x); }\n"
+	"static float Cos(float x) { return std::cos(x); }\n"
+	"static float Cosh(float x) { return std::cosh(x); }\n"
+	"static float Exp(float x) { return std::exp(x); }\n"
+	"static float Exp2(float x) { return std::pow(2.0f, x); }\n"
+	"static float Log(float x) { return std::log(x); }\n"
+	"static float Log10(float x) { return std::log10(x); }\n"
+	"static float Log2(float x) { return std::log(x) * 1.4426950408889634f; }\n"
+	"static float Pow(float x, float y) { return std::pow(x, y); }\n"
+	"static float Sin(float x) { return std::sin(x); }\n"
+	"static float Sinh(float x) { return std::sinh(x); }\n"
+	"static float Tan(float x) { return std::tan(x); }\n"
+	"static float Tanh(float x) { return std::tanh(x); }\n"
+	"\n"
+	"// libm has no vector calls, so only the lanes running make them.\n"
+	"template <float (*F)(float)> static inline V PerLane(M m, V a)\n"
+	"{\n"
+	"\tV r = Zero();\n"
+	"\tfor (int l = 0; l != W; ++l) if (m[l] != 0) r[l] = F(a[l]);\n"
+	"\treturn r;\n"
+	"}\n"
+	"\n"
+	"template <float (*F)(float, float)> static inline V PerLane2(M m, V a, V b)\n"
+	"{\n"
+	"\tV r = Zero();\n"
+	"\tfor (int l = 0; l != W; ++l) if (m[l] != 0) r[l] = F(a[l], b[l]);\n"
+	"\treturn r;\n"
+	"}\n"
+	"\n"
+	"static inline V BitOp(Context* context, M m, int opcode, unsigned int flags, V a, V b)\n"
+	"{\n"
+	"\tV r = Zero();\n"
+	"\tfor (int l = 0; l != W; ++l) if (m[l] != 0) r[l] = context->bit_op(opcode, flags, a[l], b[l]);\n"
+	"\treturn r;\n"
+	"}\n"
+	"\n"
+	"// the approximations of the simd kernel, run by the host on a whole vector.\n"
+	"static inline V Math(Context* context, unsigned int opcode, unsigned int precision, V a, V b)\n"
+	"{\n"
+	"\tV r;\n"
+	"\tcontext->math(opcode, precision, (const float*)&a, (const float*)&b, (float*)&r);\n"
+	"\treturn r;\n"
+	"}\n"
+	"\n"
+	"// and its noise functions, of a whole vector a component.\n"
+	"static inline void Noise(Context* context, unsigned int opcode, unsigned int size, unsigned int precision, const V* a, const V* b, V* r)\n"
+	"{\n"
+	"\tcontext->noise(opcode, size, precision, (const float*)a, (const float*)b, (float*)r);\n"
+	"}\n"
+	"\n"
+	"static inline V FastModulo(V a, V b) { return a - b * Truncate(a / b); }\n"
+	"\n"
+	"// exact in doubles while the quotient is below 2^29, as in the kernel.\n"
+	"static inline float Remainder(float a, float b)\n"
+	"{\n"
+	"\tdouble x = a, y = b;\n"
+	"\treturn std::copysign(static_cast<float>(x - std::trunc(x / y) * y), a);\n"
+	"}\n"
+	"\n"
+	"static inline V Modulo(M m, V a, V b, bool is_int)\n"
+	"{\n"
+	"\tV quotient = Abs(a / b);\n"
+	"\tM is_exact = (quotient < Splat(9007199254740992.0f)) & (Abs(b) < Bits(0x7f800000u));\n"
+	"\tM is_large = m & ~(quotient < Splat(536870912.0f));\n"
+	"\tV x = a;\n"
+	"\tif (Any(is_large))\n"
+	"\t{\n"
+	"\t\tV y = b * Splat(16777216.0f);\n"
+	"\t\tfor (int l = 0; l != W; ++l) if (is_large[l] != 0) x[l] = Remainder(a[l], y[l]);\n"
+	"\t}\n"
+	"\tV r;\n"
+	"\tfor (int l = 0; l != W; ++l) r[l] = Remainder(x[l], b[l]);\n"
+	"\tM rest = m & ~is_exact;\n"
+	"\tif (Any(rest))\n"
+	"\t{\n"
+	"\t\tfor (int l = 0; l != W; ++l) if (rest[l] != 0) r[l] = is_int && b[l] == 0.0f ? 0.0f : std::fmod(a[l], b[l]);\n"
+	"\t}\n"
+	"\treturn r;\n"
+	"}\n"
+	"\n"
+	"static inline void Sample(Context* context, M m, unsigned int slot, V u, V v, const V* level, V* color)\n"
+	"{\n"
+	"\tfor (int i = 0; i != 4; ++i) color[i] = Zero();\n"
+	"\tconst void* texture = context->textures[slot];\n"
+	"\tif (texture != 0) context->sample(texture, GetLanes(m), (const float*)&u, (const float*)&v, (const float*)level, (float*)color);\n"
+	"}\n"
+	"\n";
+
+// the exact float, in C++.
+static std::string Literal(float value)
+{
+	char text[64];
+	if (value - value != 0.0f)
+	{
+		unsigned int bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		std::sprintf(text, "Bits(0x%08xu)", bits);
+		return text;
+	}
+
+	std::sprintf(text, "%.9g", value);
+	std::string number = text;
+	if (number.find_first_of(".e") == std::string::npos) number += ".0";
+	return "Splat(" + number + "f)";
+}
+
+namespace
+{
+	// writes the steps of the bytecode one after the other, each behind a
+	// label if something jumps to it. the scopes the kernel pushes and pops
+	// at run time are known here at every step, and so is where it skips to
+	// once no lane is left running.
+	class SourceWriter
+	{
+	public:
+		SourceWriter(const CpuBytecode& bytecode, std::ostream& os)
+			: m_bytecode(bytecode)
+			, m_code(bytecode.code)
+			, m_os(os)
+			, m_continue_points(bytecode.code.size(), 0)
+			, m_steps(bytecode.code.size())
+		{
+			std::vector<size_t> loops;
+			for (size_t i = 0; i != m_code.size(); ++i)
+			{
+				if (m_code[i].opcode == CpuBytecode::OC_Loop) loops.push_back(i);
+				else if (m_code[i].opcode == CpuBytecode::OC_ContinuePoint) m_continue_points[loops.back()] = i;
+				else if (m_code[i].opcode == CpuBytecode::OC_EndLoop) loops.pop_back();
+			}
+		}
+
+		void Write()
+		{
+			m_os << "extern \"C\" unsigned int " << entry_point_name << "(Context* context, const float* inputs, unsigned int lanes, float* outputs)\n{\n";
+			WriteRegisters();
+
+			for (size_t i = 0; i != m_code.size(); ++i)
+			{
+				std::ostringstream os;
+				WriteStep(os, i);
+				m_steps[i] = os.str();
+			}
+			for (size_t i = 0; i != m_code.size(); ++i)
+			{
+				if (m_targets.count(i) != 0) m_os << "L" << i << ":\n";
+				m_os << m_steps[i];
+			}
+
+			m_os << "finish:\n";
+			m_os << "\tM kept = FromLanes(lanes) & ~discarded;\n";
+			for (unsigned int j = 0; j != 4; ++j)
+			{
+				std::string value = j < m_bytecode.output_size ? Reg(m_bytecode.output, j) : "Zero()";
+				m_os << "\tfor (int l = 0; l != W; ++l) if (kept[l] != 0) outputs[l * 4 + " << j << "] = " << value << "[l];\n";
+			}
+			m_os << "\treturn GetLanes(kept);\n}\n";
+		}
+
+	private:
+		typedef CpuBytecode::Instruction Instruction;
+
+		static std::string Reg(unsigned int index, unsigned int component)
+		{
+			std::ostringstream os;
+			os << "r" << index << "_" << component;
+			return os.str();
+		}
+
+		std::string Arg(const Instruction& ins, unsigned int arg, unsigned int component) const
+		{
+			return Reg(ins.args[arg], component);
+		}
+
+		void WriteRegisters()
+		{
+			size_t num_inputs = m_bytecode.inputs.size();
+			std::vector<int> input_of(m_bytecode.registers.size(), -1);
+			for (size_t i = 0; i != num_inputs; ++i)
+			{
+				if (m_bytecode.inputs[i] != CpuBytecode::no_register) input_of[m_bytecode.inputs[i]] = static_cast<int>(i);
+			}
+
+			for (size_t i = 0; i != m_bytecode.registers.size(); ++i)
+			{
+				const CpuBytecode::Register& reg = m_bytecode.registers[i];
+				for (unsigned int j = 0; j != 4; ++j)
+				{
+					std::string name = Reg(static_cast<unsigned int>(i), j);
+					if (reg.kind == CpuBytecode::RK_Constant) m_os << "\tconst V " << name << " = " << Literal(reg.value[j]) << ";\n";
+					else if (reg.kind == CpuBytecode::RK_Uniform)
+					{
+						if (j < reg.type.size) m_os << "\tconst V " << name << " = Splat(context->constants[" << reg.offset + j << "]);\n";
+						else m_os << "\tconst V " << name << " = Zero();\n";
+					}
+					else if (input_of[i] >= 0) m_os << "\tV " << name << " = Gather(inputs + " << input_of[i] * 4 + j << ", " << num_inputs * 4 << ");\n";
+					else m_os << "\tV " << name << " = Zero();\n";
+				}
+			}
+
+			// the lanes of the scopes, by the step that opens them.
+			for (size_t i = 0; i != m_code.size(); ++i)
+			{
+				unsigned int opcode = m_code[i].opcode;
+				if (opcode == CpuBytecode::OC_If || opcode == CpuBytecode::OC_Loop || opcode == CpuBytecode::OC_BeginCall)
+				{
+					m_os << "\tM w" << i << " = NoLanes(), d" << i << " = NoLanes();\n";
+				}
+			}
+			m_os << "\tM m = FromLanes(lanes), discarded = NoLanes();\n";
+			m_os << "\tif (!Any(m)) goto finish;\n";
+		}
+
+		// the running lanes keep the value, the others what they had.
+		static void Put(std::ostream& os, unsigned int dest, unsigned int component, const std::string& value)
+		{
+			std::string name = Reg(dest, component);
+			os << "\t" << name << " = Select(m, " << value << ", " << name << ");\n";
+		}
+
+		void Unary(std::ostream& os, const Instruction& ins, const std::string& before, const std::string& after)
+		{
+			for (unsigned int i = 0; i != ins.size; ++i) Put(os, ins.dest, i, before + Arg(ins, 0, i) + after);
+		}
+
+		void Binary(std::ostream& os, const Instruction& ins, const std::string& before, const std::string& middle, const std::string& after)
+		{
+			for (unsigned int i = 0; i != ins.size; ++i) Put(os, ins.dest, i, before + Arg(ins, 0, i) + middle + Arg(ins, 1, i) + after);
+		}
+
+		// libm a lane at a time, or the approximations of the bytecode's
+		// precision through the host.
+		void Transcendental(std::ostream& os, const Instruction& ins, const std::string& function)
+		{
+			bool is_binary = CpuBytecode::GetNumArgs(static_cast<CpuBytecode::Opcode>(ins.opcode)) == 2;
+			if (m_bytecode.precision == CpuShaderMath::PR_Libm)
+			{
+				if (is_binary) Binary(os, ins, "PerLane2<" + function + ">(m, ", ", ", ")");
+				else Unary(os, ins, "PerLane<" + function + ">(m, ", ")");
+				return;
+			}
+
+			std::ostringstream call;
+			call << "Math(context, " << static_cast<unsigned int>(ins.opcode) << ", " << static_cast<unsigned int>(m_bytecode.precision) << ", ";
+			for (unsigned int i = 0; i != ins.size; ++i)
+			{
+				std::string a = Arg(ins, 0, i);
+				Put(os, ins.dest, i, call.str() + a + ", " + (is_binary ? Arg(ins, 1, i) : a) + ")");
+			}
+		}
+
+		void FloatModulo(std::ostream& os, const Instruction& ins)
+		{
+			if (m_bytecode.precision == CpuShaderMath::PR_Fast) Binary(os, ins, "FastModulo(", ", ", ")");
+			else Binary(os, ins, "Modulo(m, ", ", ", ", false)");
+		}
+
+		// the noise ops through the host, their vectors in arrays.
+		void Noise(std::ostream& os, const Instruction& ins)
+		{
+			bool is_scalar = ins.opcode == CpuBytecode::OC_Snoise || ins.opcode == CpuBytecode::OC_Qnoise;
+			unsigned int num_read = ins.opcode == CpuBytecode::OC_Grad4 ? 1 : ins.size;
+			std::string a, b;
+			for (unsigned int i = 0; i != 4; ++i)
+			{
+				a += (i != 0 ? ", " : "") + (i < num_read ? Arg(ins, 0, i) : "Zero()");
+				b += (i != 0 ? ", " : "") + (ins.opcode == CpuBytecode::OC_Grad4 ? Arg(ins, 1, i) : "Zero()");
+			}
+			os << "\t{\n\tV a[4] = {" << a << "}, b[4] = {" << b << "}, r[4];\n";
+			os << "\tNoise(context, " << static_cast<unsigned int>(ins.opcode) << ", " << static_cast<unsigned int>(ins.size) << ", ";
+			os << static_cast<unsigned int>(m_bytecode.precision) << ", a, b, r);\n";
+			for (unsigned int i = 0; i != (is_scalar ? 1u : 4u); ++i)
+			{
+				std::ostringstream value;
+				value << "r[" << i << "]";
+				Put(os, ins.dest, i, value.str());
+			}
+			os << "\t}\n";
+		}
+
+		void Ternary(std::ostream& os, const Instruction& ins, const std::string& function)
+		{
+			for (unsigned int i = 0; i != ins.size; ++i)
+			{
+				Put(os, ins.dest, i, function + "(" + Arg(ins, 0, i) + ", " + Arg(ins, 1, i) + ", " + Arg(ins, 2, i) + ")");
+			}
+		}
+
+		std::string Dot(const Instruction& ins, unsigned int a, unsigned int b) const
+		{
+			std::string sum = "Zero()";
+			for (unsigned int i = 0; i != ins.size; ++i) sum = "(" + sum + " + " + Arg(ins, a, i) + " * " + Arg(ins, b, i) + ")";
+			return sum;
+		}
+
+		// where the kernel goes on from at once no lane runs.
+		void Skip(std::ostream& os, size_t at)
+		{
+			if (m_scopes.empty())
+			{
+				os << "\tif (!Any(m)) goto finish;\n";
+				return;
+			}
+
+			size_t begin = m_scopes.back();
+			const Instruction& opener = m_code[begin];
+			size_t target = opener.target;
+			size_t continue_point = m_continue_points[begin];
+			if (opener.opcode == CpuBytecode::OC_If)
+			{
+				// the else if still ahead, or the endif.
+				const Instruction& next = m_code[opener.target];
+				if (next.opcode == CpuBytecode::OC_Else && at >= opener.target) target = next.target;
+			}
+			else if (opener.opcode == CpuBytecode::OC_Loop && continue_point != 0 && at < continue_point)
+			{
+				// the continue point if some lanes wait there.
+				os << "\tif (!Any(m)) { if (Any(w" << begin << ")) goto L" << continue_point << "; goto L" << target << "; }\n";
+				m_targets.insert(continue_point);
+				m_targets.insert(target);
+				return;
+			}
+			os << "\tif (!Any(m)) goto L" << target << ";\n";
+			m_targets.insert(target);
+		}
+
+		size_t Innermost(unsigned int opcode) const
+		{
+			size_t i = m_scopes.size() - 1;
+			while (m_code[m_scopes[i]].opcode != opcode) --i;
+			return m_scopes[i];
+		}
+
+		void WriteStep(std::ostream& os, size_t at);
+
+	private:
+		const CpuBytecode& m_bytecode;
+		const std::vector<Instruction>& m_code;
+		std::ostream& m_os;
+		std::vector<size_t> m_continue_points;	// by loop
+		std::vector<size_t> m_scopes;			// the steps that opened them
+		std::vector<std::string> m_steps;
+		std::set<size_t> m_targets;
+	};
+
+	void SourceWriter::WriteStep(std::ostream& os, size_t at)
+	{
+		const Instruction& ins = m_code[at];
+		CpuBytecode::Opcode opcode = static_cast<CpuBytecode::Opcode>(ins.opcode);
+		switch (opcode)
+		{
+		case CpuBytecode::OC_Move: Unary(os, ins, "", ""); break;
+
+		case CpuBytecode::OC_Swizzle:
+		case CpuBytecode::OC_Scatter:
+			{
+				// the source may be the destination, so it is read first.
+				bool is_swizzle = opcode == CpuBytecode::OC_Swizzle;
+				os << "\t{\n";
+				for (unsigned int i = 0; i != ins.size; ++i)
+				{
+					os << "\tV x" << i << " = " << Arg(ins, 0, is_swizzle ? CpuBytecode::GetSwizzleComponent(ins.swizzle, i) : i) << ";\n";
+				}
+				for (unsigned int i = 0; i != ins.size; ++i)
+				{
+					std::ostringstream value;
+					value << "x" << i;
+					Put(os, ins.dest, is_swizzle ? i : CpuBytecode::GetSwizzleComponent(ins.swizzle, i), value.str());
+				}
+				os << "\t}\n";
+			}
+			break;
+
+		case CpuBytecode::OC_FloatToInt: Unary(os, ins, "Truncate(", ")"); break;
+		case CpuBytecode::OC_ToBool: Unary(os, ins, "Float(IsTrue(", "))"); break;
+
+		case CpuBytecode::OC_Add: Binary(os, ins, "", " + ", ""); break;
+		case CpuBytecode::OC_Subtract: Binary(os, ins, "", " - ", ""); break;
+		case CpuBytecode::OC_Multiply: Binary(os, ins, "", " * ", ""); break;
+		case CpuBytecode::OC_Divide: Binary(os, ins, "", " / ", ""); break;
+		case CpuBytecode::OC_Modulo: FloatModulo(os, ins); break;
+		case CpuBytecode::OC_IntModulo: Binary(os, ins, "Modulo(m, ", ", ", ", true)"); break;
+		case CpuBytecode::OC_Fmod: FloatModulo(os, ins); break;
+		case CpuBytecode::OC_Negate: Unary(os, ins, "-", ""); break;
+		case CpuBytecode::OC_Less: Binary(os, ins, "Float(", " < ", ")"); break;
+		case CpuBytecode::OC_LessEqual: Binary(os, ins, "Float(", " <= ", ")"); break;
+		case CpuBytecode::OC_Greater: Binary(os, ins, "Float(", " > ", ")"); break;
+		case CpuBytecode::OC_GreaterEqual: Binary(os, ins, "Float(", " >= ", ")"); break;
+		case CpuBytecode::OC_Equal: Binary(os, ins, "Float(", " == ", ")"); break;
+		case CpuBytecode::OC_NotEqual: Binary(os, ins, "Float(", " != ", ")"); break;
+		case CpuBytecode::OC_And: Binary(os, ins, "Float(IsTrue(", ") & IsTrue(", "))"); break;
+		case CpuBytecode::OC_Or: Binary(os, ins, "Float(IsTrue(", ") | IsTrue(", "))"); break;
+		case CpuBytecode::OC_Not: Unary(os, ins, "Float(", " == Zero())"); break;
+
+		case CpuBytecode::OC_IntDivide:
+			for (unsigned int i = 0; i != ins.size; ++i)
+			{
+				Put(os, ins.dest, i, "Select(IsTrue(" + Arg(ins, 1, i) + "), Truncate(" + Arg(ins, 0, i) + " / " + Arg(ins, 1, i) + "), Zero())");
+			}
+			break;
+
+		case CpuBytecode::OC_BitAnd:
+		case CpuBytecode::OC_BitOr:
+		case CpuBytecode::OC_BitXor:
+		case CpuBytecode::OC_ShiftLeft:
+		case CpuBytecode::OC_ShiftRight:
+		case CpuBytecode::OC_BitNot:
+			for (unsigned int i = 0; i != ins.size; ++i)
+			{
+				std::ostringstream value;
+				value << "BitOp(context, m, " << static_cast<int>(ins.opcode) << ", " << static_cast<unsigned int>(ins.flags) << ", " << Arg(ins, 0, i) << ", "
+					<< Arg(ins, opcode == CpuBytecode::OC_BitNot ? 0 : 1, i) << ")";
+				Put(os, ins.dest, i, value.str());
+			}
+			break;
+
+		case CpuBytecode::OC_Select:
+			for (unsigned int i = 0; i != ins.size; ++i)
+			{
+				unsigned int condition = (ins.flags & CpuBytecode::IF_ScalarCondition) != 0 ? 0 : i;
+				Put(os, ins.dest, i, "Select(IsTrue(" + Arg(ins, 0, condition) + "), " + Arg(ins, 1, i) + ", " + Arg(ins, 2, i) + ")");
+			}
+			break;
+
+		case CpuBytecode::OC_Abs: Unary(os, ins, "Abs(", ")"); break;
+		case CpuBytecode::OC_Acos: Transcendental(os, ins, "Acos"); break;
+		case CpuBytecode::OC_Asin: Transcendental(os, ins, "Asin"); break;
+		case CpuBytecode::OC_Atan: Transcendental(os, ins, "Atan"); break;
+		case CpuBytecode::OC_Atan2: Transcendental(os, ins, "Atan2"); break;
+		case CpuBytecode::OC_Ceil: Unary(os, ins, "Ceil(", ")"); break;
+		case CpuBytecode::OC_Clamp:
+			for (unsigned int i = 0; i != ins.size; ++i) Put(os, ins.dest, i, "Min(Max(" + Arg(ins, 0, i) + ", " + Arg(ins, 1, i) + "), " + Arg(ins, 2, i) + ")");
+			break;
+		case CpuBytecode::OC_Cos: Transcendental(os, ins, "Cos"); break;
+		case CpuBytecode::OC_Cosh: Unary(os, ins, "PerLane<Cosh>(m, ", ")"); break;
+		case CpuBytecode::OC_Degrees: Unary(os, ins, "", " * Splat(57.295779513082321f)"); break;
+		case CpuBytecode::OC_Exp: Transcendental(os, ins, "Exp"); break;
+		case CpuBytecode::OC_Exp2: Transcendental(os, ins, "Exp2"); break;
+		case CpuBytecode::OC_Floor: Unary(os, ins, "Floor(", ")"); break;
+		case CpuBytecode::OC_Frac:
+			for (unsigned int i = 0; i != ins.size; ++i) Put(os, ins.dest, i, Arg(ins, 0, i) + " - Floor(" + Arg(ins, 0, i) + ")");
+			break;
+		case CpuBytecode::OC_Isinf:
+			for (unsigned int i = 0; i != ins.size; ++i)
+			{
+				std::string a = Arg(ins, 0, i);
+				Put(os, ins.dest, i, "Float((" + a + " == " + a + ") & (" + a + " - " + a + " != Zero()))");
+			}
+			break;
+		case CpuBytecode::OC_Isnan:
+			for (unsigned int i = 0; i != ins.size; ++i) Put(os, ins.dest, i, "Float(" + Arg(ins, 0, i) + " != " + Arg(ins, 0, i) + ")");
+			break;
+		case CpuBytecode::OC_Lerp:
+			for (unsigned int i = 0; i != ins.size; ++i)
+			{
+				std::string a = Arg(ins, 0, i);
+				Put(os, ins.dest, i, a + " + (" + Arg(ins, 1, i) + " - " + a + ") * " + Arg(ins, 2, i));
+			}
+			break;
+		case CpuBytecode::OC_Log: Transcendental(os, ins, "Log"); break;
+		case CpuBytecode::OC_Log10: Transcendental(os, ins, "Log10"); break;
+		case CpuBytecode::OC_Log2: Transcendental(os, ins, "Log2"); break;
+		case CpuBytecode::OC_Max: Binary(os, ins, "Max(", ", ", ")"); break;
+		case CpuBytecode::OC_Min: Binary(os, ins, "Min(", ", ", ")"); break;
+		case CpuBytecode::OC_Pow: Transcendental(os, ins, "Pow"); break;
+		case CpuBytecode::OC_Radians: Unary(os, ins, "", " * Splat(0.017453292519943295f)"); break;
+		case CpuBytecode::OC_Round: Unary(os, ins, "Floor(", " + Splat(0.5f))"); break;
+		case CpuBytecode::OC_Rsqrt: Unary(os, ins, "Splat(1.0f) / Sqrt(", ")"); break;
+		case CpuBytecode::OC_Saturate: Unary(os, ins, "Saturate(", ")"); break;
+		case CpuBytecode::OC_Sign: Unary(os, ins, "Sign(", ")"); break;
+		case CpuBytecode::OC_Sin: Transcendental(os, ins, "Sin"); break;
+		case CpuBytecode::OC_Sinh: Unary(os, ins, "PerLane<Sinh>(m, ", ")"); break;
+		case CpuBytecode::OC_Smoothstep:
+			for (unsigned int i = 0; i != ins.size; ++i)
+			{
+				std::string lo = Arg(ins, 0, i);
+				os << "\t{\n\tV t = Saturate((" << Arg(ins, 2, i) << " - " << lo << ") / (" << Arg(ins, 1, i) << " - " << lo << "));\n";
+				Put(os, ins.dest, i, "t * t * (Splat(3.0f) - Splat(2.0f) * t)");
+				os << "\t}\n";
+			}
+			break;
+		case CpuBytecode::OC_Sqrt: Unary(os, ins, "Sqrt(", ")"); break;
+		case CpuBytecode::OC_Step: Binary(os, ins, "Float(", " <= ", ")"); break;
+		case CpuBytecode::OC_Tan: Transcendental(os, ins, "Tan"); break;
+		case CpuBytecode::OC_Tanh: Unary(os, ins, "PerLane<Tanh>(m, ", ")"); break;
+		case CpuBytecode::OC_Trunc: Unary(os, ins, "Truncate(", ")"); break;
+
+		case CpuBytecode::OC_Ddx: Unary(os, ins, "Ddx(", ")"); break;
+		case CpuBytecode::OC_Ddy: Unary(os, ins, "Ddy(", ")"); break;
+		case CpuBytecode::OC_Fwidth: Unary(os, ins, "Fwidth(", ")"); break;
+
+		case CpuBytecode::OC_Dot: Put(os, ins.dest, 0, Dot(ins, 0, 1)); break;
+		case CpuBytecode::OC_Length: Put(os, ins.dest, 0, "Sqrt(" + Dot(ins, 0, 0) + ")"); break;
+
+		case CpuBytecode::OC_Distance:
+			{
+				os << "\t{\n\tV sum = Zero();\n";
+				for (unsigned int i = 0; i != ins.size; ++i) os << "\t{ V x = " << Arg(ins, 0, i) << " - " << Arg(ins, 1, i) << "; sum = sum + x * x; }\n";
+				Put(os, ins.dest, 0, "Sqrt(sum)");
+				os << "\t}\n";
+			}
+			break;
+
+		case CpuBytecode::OC_Any:
+		case CpuBytecode::OC_All:
+			{
+				std::string result = "IsTrue(" + Arg(ins, 0, 0) + ")";
+				for (unsigned int i = 1; i != ins.size; ++i) result += (opcode == CpuBytecode::OC_All ? " & IsTrue(" : " | IsTrue(") + Arg(ins, 0, i) + ")";
+				Put(os, ins.dest, 0, "Float(" + result + ")");
+			}
+			break;
+
+		case CpuBytecode::OC_Snoise:
+		case CpuBytecode::OC_Qnoise:
+		case CpuBytecode::OC_Hash:
+		case CpuBytecode::OC_Grad4:
+			Noise(os, ins);
+			break;
+
+		case CpuBytecode::OC_Normalize:
+			os << "\t{\n\tV scale = Splat(1.0f) / Sqrt(" << Dot(ins, 0, 0) << ");\n";
+			for (unsigned int i = 0; i != ins.size; ++i) Put(os, ins.dest, i, Arg(ins, 0, i) + " * scale");
+			os << "\t}\n";
+			break;
+
+		case CpuBytecode::OC_Reflect:
+			os << "\t{\n\tV twice = Splat(2.0f) * " << Dot(ins, 0, 1) << ";\n";
+			for (unsigned int i = 0; i != ins.size; ++i) Put(os, ins.dest, i, Arg(ins, 0, i) + " - twice * " + Arg(ins, 1, i));
+			os << "\t}\n";
+			break;
+
+		case CpuBytecode::OC_Refract:
+			{
+				std::string eta = Arg(ins, 2, 0);
+				os << "\t{\n\tV dot = " << Dot(ins, 0, 1) << ";\n";
+				os << "\tV k = Splat(1.0f) - " << eta << " * " << eta << " * (Splat(1.0f) - dot * dot);\n";
+				os << "\tM is_total = k < Zero();\n";
+				os << "\tV scale = " << eta << " * dot + Sqrt(k);\n";
+				for (unsigned int i = 0; i != ins.size; ++i)
+				{
+					Put(os, ins.dest, i, "Select(is_total, Zero(), " + eta + " * " + Arg(ins, 0, i) + " - scale * " + Arg(ins, 1, i) + ")");
+				}
+				os << "\t}\n";
+			}
+			break;
+
+		case CpuBytecode::OC_Cross:
+			os << "\t{\n";
+			os << "\tV x = " << Arg(ins, 0, 1) << " * " << Arg(ins, 1, 2) << " - " << Arg(ins, 0, 2) << " * " << Arg(ins, 1, 1) << ";\n";
+			os << "\tV y = " << Arg(ins, 0, 2) << " * " << Arg(ins, 1, 0) << " - " << Arg(ins, 0, 0) << " * " << Arg(ins, 1, 2) << ";\n";
+			os << "\tV z = " << Arg(ins, 0, 0) << " * " << Arg(ins, 1, 1) << " - " << Arg(ins, 0, 1) << " * " << Arg(ins, 1, 0) << ";\n";
+			Put(os, ins.dest, 0, "x");
+			Put(os, ins.dest, 1, "y");
+			Put(os, ins.dest, 2, "z");
+			os << "\t}\n";
+			break;
+
+		case CpuBytecode::OC_Sample:
+			os << "\t{\n";
+			if (ins.target < m_bytecode.num_textures)
+			{
+				os << "\tV color[4];\n";
+				// no level leaves it to the quad's derivatives.
+				std::string level = (ins.flags & CpuBytecode::IF_ImplicitLevel) != 0 ? "0" : "&" + Arg(ins, 1, 0);
+				os << "\tSample(context, m, " << ins.target << ", " << Arg(ins, 0, 0) << ", " << Arg(ins, 0, 1) << ", " << level << ", color);\n";
+			}
+			else os << "\tV color[4] = {Zero(), Zero(), Zero(), Zero()};\n";
+			for (unsigned int i = 0; i != 4; ++i)
+			{
+				std::ostringstream value;
+				value << "color[" << i << "]";
+				Put(os, ins.dest, i, value.str());
+			}
+			os << "\t}\n";
+			break;
+
+		// as the kernel does them, the lanes a branch turns off waiting in
+		// the scope they are to come back at.
+		case CpuBytecode::OC_If:
+			os << "\t{ M taken = m & IsTrue(" << Arg(ins, 0, 0) << "); w" << at << " = m & ~taken; d" << at << " = NoLanes(); m = taken; }\n";
+			m_scopes.push_back(at);
+			Skip(os, at);
+			break;
+
+		case CpuBytecode::OC_Else:
+			{
+				size_t scope = m_scopes.back();
+				os << "\td" << scope << " = m; m = w" << scope << "; w" << scope << " = NoLanes();\n";
+				Skip(os, at);
+			}
+			break;
+
+		case CpuBytecode::OC_EndIf:
+			{
+				size_t scope = m_scopes.back();
+				os << "\tm = m | w" << scope << " | d" << scope << ";\n";
+				m_scopes.pop_back();
+				Skip(os, at);
+			}
+			break;
+
+		case CpuBytecode::OC_Loop:
+			Put(os, ins.dest, 0, "Zero()");
+			os << "\tw" << at << " = NoLanes(); d" << at << " = NoLanes();\n";
+			m_scopes.push_back(at);
+			break;
+
+		case CpuBytecode::OC_Break:
+			os << "\td" << Innermost(CpuBytecode::OC_Loop) << " |= m; m = NoLanes();\n";
+			Skip(os, at);
+			break;
+
+		case CpuBytecode::OC_BreakIfNot:
+			os << "\t{ M staying = m & IsTrue(" << Arg(ins, 0, 0) << "); d" << Innermost(CpuBytecode::OC_Loop) << " |= m & ~staying; m = staying; }\n";
+			Skip(os, at);
+			break;
+
+		case CpuBytecode::OC_Continue:
+			os << "\tw" << Innermost(CpuBytecode::OC_Loop) << " |= m; m = NoLanes();\n";
+			Skip(os, at);
+			break;
+
+		case CpuBytecode::OC_ContinuePoint:
+			{
+				size_t scope = m_scopes.back();
+				os << "\tm = m | w" << scope << "; w" << scope << " = NoLanes();\n";
+				Skip(os, at);
+			}
+			break;
+
+		case CpuBytecode::OC_EndLoop:
+			{
+				size_t scope = m_scopes.back();
+				std::string count = Reg(ins.dest, 0);
+				os << "\t{\n";
+				os << "\tV count = " << count << " + Splat(1.0f);\n";
+				Put(os, ins.dest, 0, "count");
+				os << "\tM cut_off = m & (count >= " << Literal(static_cast<float>(CpuShaderInterpreter::max_loop_iterations)) << ");\n";
+				os << "\tcontext->num_cut_off_loops += Count(cut_off);\n";
+				os << "\td" << scope << " |= cut_off; m = m & ~cut_off;\n";
+				os << "\tif (Any(m)) goto L" << ins.target + 1 << ";\n";
+				os << "\tm = d" << scope << ";\n";
+				os << "\t}\n";
+				m_targets.insert(ins.target + 1);
+				m_scopes.pop_back();
+				Skip(os, at);
+			}
+			break;
+
+		case CpuBytecode::OC_BeginCall:
+			os << "\tw" << at << " = NoLanes();\n";
+			m_scopes.push_back(at);
+			break;
+
+		case CpuBytecode::OC_Return:
+			os << "\tw" << Innermost(CpuBytecode::OC_BeginCall) << " |= m; m = NoLanes();\n";
+			Skip(os, at);
+			break;
+
+		case CpuBytecode::OC_EndCall:
+			{
+				size_t scope = m_scopes.back();
+				os << "\tm = m | w" << scope << ";\n";
+				m_scopes.pop_back();
+				Skip(os, at);
+			}
+			break;
+
+		// the simd kernel's helper lanes, see there.
+		case CpuBytecode::OC_Discard:
+			if (m_bytecode.uses_derivatives)
+			{
+				os << "\tdiscarded |= m;\n";
+				break;
+			}
+			os << "\tdiscarded |= m; m = NoLanes();\n";
+			Skip(os, at);
+			break;
+
+		case CpuBytecode::OC_End:
+		default:
+			os << "\tgoto finish;\n";
+			break;
+		}
+	}
+}
+
+static float BitOpLane(int opcode, unsigned int flags, float a, float b)
+{
+	return CpuBytecode::BitOp(static_cast<CpuBytecode::Opcode>(opcode), flags, a, b);
+}
+
+static bool FileExists(const std::string& path)
+{
+	std::ifstream ifs(path.c_str(), std::ios::binary);
+	return ifs.is_open();
+}
+
+struct CpuShaderJit::Module
+{
+	void* handle;
+	NativeRun run;
+
+	Module() : handle(NULL), run(NULL) {}
+
+	~Module()
+	{
+#ifdef CPU_SHADER_JIT
+		if (handle != NULL) dlclose(handle);
+#endif
+	}
+};
+
+namespace
+{
+	// the built code as a kernel of CpuSimdVm. the module stays loaded for
+	// as long as a kernel runs on it.
+	class NativeKernel : public CpuSimdVm::Kernel
+	{
+	public:
+		NativeKernel(const boost::shared_ptr<void>& module, NativeRun run, CpuSimdVm::InstructionSet instruction_set, size_t num_constants, size_t num_textures)
+			: m_module(module)
+			, m_run(run)
+			, m_constants(std::max<size_t>(num_constants, 1), 0.0f)
+			, m_textures(std::max<size_t>(num_textures, 1), static_cast<const void*>(NULL))
+		{
+			m_context.constants = &m_constants[0];
+			m_context.textures = &m_textures[0];
+			m_context.sample = CpuSimdVm::GetSampleFunction(instruction_set);
+			m_context.bit_op = BitOpLane;
+			m_context.math = CpuSimdVm::GetMathFunction(instruction_set);
+			m_context.noise = CpuSimdVm::GetNoiseFunction(instruction_set);
+			m_context.num_cut_off_loops = 0;
+		}
+
+		virtual void SetConstants(const std::vector<float>& constants)
+		{
+			for (size_t i = 0; i != m_constants.size(); ++i) m_constants[i] = i < constants.size() ? constants[i] : 0.0f;
+		}
+
+		virtual void SetTexture(size_t slot, const CpuTexture* texture)
+		{
+			if (slot < m_textures.size()) m_textures[slot] = texture;
+		}
+
+		virtual unsigned int Run(const float* inputs, unsigned int lanes, float* outputs)
+		{
+			return m_run(&m_context, inputs, lanes, outputs);
+		}
+
+		virtual size_t GetNumCutOffLoops() const
+		{
+			return static_cast<size_t>(m_context.num_cut_off_loops);
+		}
+
+	private:
+		boost::shared_ptr<void> m_module;
+		NativeRun m_run;
+		std::vector<float> m_constants;
+		std::vector<const void*> m_textures;
+		NativeContext m_context;
+	};
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuShaderJit::CpuShaderJit(const std::string& cache_directory /*= ""*/)
+	: m_directory(cache_directory)
+	, m_instruction_set(CpuSimdVm::GetBestInstructionSet())
+	, m_num_constants(0)
+	, m_num_textures(0)
+{
+	const char* compiler = std::getenv("CXX");
+	m_command = std::string(compiler != NULL && *compiler != '\0' ? compiler : "c++")
+		+ " -std=c++11 -O2 -march=native -ffp-contract=off -fno-math-errno -fPIC -shared -o {output} {input}";
+}
+
+CpuShaderJit::~CpuShaderJit()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool CpuShaderJit::IsSupported()
+{
+#ifdef CPU_SHADER_JIT
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CpuShaderJit::SetCommand(const std::string& command)
+{
+	m_command = command;
+}
+
+const std::string& CpuShaderJit::GetCommand() const
+{
+	return m_command;
+}
+
+void CpuShaderJit::Build(const CpuBytecode& bytecode, CpuSimdVm::InstructionSet instruction_set)
+{
+	m_instruction_set = CpuSimdVm::IsSupported(instruction_set) ? instruction_set : CpuSimdVm::GetBestInstructionSet();
+	m_num_textures = bytecode.num_textures;
+	m_num_constants = 0;
+	for (size_t i = 0; i != bytecode.registers.size(); ++i)
+	{
+		const CpuBytecode::Register& reg = bytecode.registers[i];
+		if (reg.kind == CpuBytecode::RK_Uniform) m_num_constants = std::max(m_num_constants, reg.offset + reg.type.size);
+	}
+
+	m_job.reset(new Job);
+	m_job->state = JS_Building;
+	m_job->is_cached = false;
+	m_job->build_time = 0;
+
+	std::string source;
+	Generate(bytecode, CpuSimdVm::GetWidth(m_instruction_set), source);
+
+	// the object is only good for the cpu and the compiler it was built for.
+	ContentHasher hasher;
+	hasher.Update(source);
+	hasher.Update(m_command);
+	hasher.Update(CpuSimdVm::GetInstructionSetName(m_instruction_set));
+	std::string directory = m_directory;
+	if (directory.empty())
+	{
+		const char* temp = std::getenv("TMPDIR");
+		directory = temp != NULL && *temp != '\0' ? temp : "/tmp";
+	}
+	else MakeDirectory(directory);
+	std::string object_path = directory + "/" + hasher.Finish().ToString() + ".so";
+
+	if (FileExists(object_path))
+	{
+		std::string error;
+		ModulePtr module = Load(object_path, error);
+		if (module)
+		{
+			m_job->module = module;
+			m_job->state = JS_Ready;
+			m_job->is_cached = true;
+			return;
+		}
+	}
+
+	boost::thread thread(boost::bind(&CpuShaderJit::BuildProc, m_job, source, m_command, object_path));
+	thread.detach();
+}
+
+CpuShaderJit::State CpuShaderJit::GetState() const
+{
+	if (!m_job) return JS_Idle;
+	boost::mutex::scoped_lock lock(m_job->mutex);
+	return m_job->state;
+}
+
+bool CpuShaderJit::IsReady() const
+{
+	return GetState() == JS_Ready;
+}
+
+bool CpuShaderJit::Wait()
+{
+	if (!m_job) return false;
+	boost::mutex::scoped_lock lock(m_job->mutex);
+	while (m_job->state == JS_Building) m_job->condition.wait(lock);
+	return m_job->state == JS_Ready;
+}
+
+bool CpuShaderJit::IsCached() const
+{
+	if (!m_job) return false;
+	boost::mutex::scoped_lock lock(m_job->mutex);
+	return m_job->is_cached;
+}
+
+double CpuShaderJit::GetBuildTime() const
+{
+	if (!m_job) return 0;
+	boost::mutex::scoped_lock lock(m_job->mutex);
+	return m_job->build_time;
+}
+
+std::string CpuShaderJit::GetError() const
+{
+	if (!m_job) return std::string();
+	boost::mutex::scoped_lock lock(m_job->mutex);
+	return m_job->error;
+}
+
+boost::shared_ptr<CpuSimdVm::Kernel> CpuShaderJit::CreateKernel() const
+{
+	boost::shared_ptr<CpuSimdVm::Kernel> kernel;
+	if (!m_job) return kernel;
+
+	ModulePtr module;
+	{
+		boost::mutex::scoped_lock lock(m_job->mutex);
+		if (m_job->state == JS_Ready) module = m_job->module;
+	}
+	if (module) kernel.reset(new NativeKernel(module, module->run, m_instruction_set, m_num_constants, m_num_textures));
+	return kernel;
+}
+
+CpuSimdVm::InstructionSet CpuShaderJit::GetInstructionSet() const
+{
+	return m_instruction_set;
+}
+
+void CpuShaderJit::Generate(const CpuBytecode& bytecode, unsigned int width, std::string& source)
+{
+	std::ostringstream os;
+	os << runtime_head << width << runtime_body;
+	SourceWriter writer(bytecode, os);
+	writer.Write();
+	source = os.str();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void CpuShaderJit::BuildProc(JobPtr job, std::string source, std::string command, std::string object_path)
+{
+	boost::posix_time::ptime begin = boost::posix_time::microsec_clock::universal_time();
+
+	// built under a name of its own and renamed, so that a run sharing the
+	// cache never loads half an object.
+	std::ostringstream oss;
+	oss << object_path.substr(0, object_path.length() - 3) << "_" << getpid();
+	std::string source_path = oss.str() + ".cpp";
+	std::string temp_path = oss.str() + ".so";
+
+	std::string error;
+	ModulePtr module;
+	{
+		std::ofstream ofs(source_path.c_str(), std::ios::binary | std::ios::trunc);
+		ofs.write(source.data(), source.length());
+		if (!ofs.good()) error = "error: can not write " + source_path + "\n";
+	}
+	if (error.empty())
+	{
+#ifdef CPU_SHADER_JIT
+		std::string command_line = command;
+		ReplaceAll(command_line, "{input}", "\"" + source_path + "\"");
+		ReplaceAll(command_line, "{output}", "\"" + temp_path + "\"");
+		if (!RunCommand(command_line, error)) std::remove(temp_path.c_str());
+		else if (std::rename(temp_path.c_str(), object_path.c_str()) != 0) error = "error: can not write " + object_path + "\n";
+		else module = Load(object_path, error);
+#else
+		error = "error: the native engine is not supported in this build, " + command + " is not run\n";
+#endif
+	}
+	std::remove(source_path.c_str());
+
+	boost::posix_time::ptime end = boost::posix_time::microsec_clock::universal_time();
+	{
+		boost::mutex::scoped_lock lock(job->mutex);
+		job->module = module;
+		job->error = error;
+		job->state = module ? JS_Ready : JS_Failed;
+		job->build_time = static_cast<double>((end - begin).total_microseconds());
+	}
+	job->condition.notify_all();
+}
+
+CpuShaderJit::ModulePtr CpuShaderJit::Load(const std::string& object_path, std::string& error)
+{
+	ModulePtr module;
+#ifdef CPU_SHADER_JIT
+	// a relative path would be looked up in the library path instead.
+	std::string path = object_path[0] == '/' ? object_path : "./" + object_path;
+	void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (handle == NULL)
+	{
+		const char* reason = dlerror();
+		error = std::string("error: ") + (reason != NULL ? reason : "can not load " + object_path) + "\n";
+		return module;
+	}
+
+	module.reset(new Module);
+	module->handle = handle;
+	module->run = reinterpret_cast<NativeRun>(dlsym(handle, entry_point_name));
+	if (module->run == NULL)
+	{
+		error = "error: " + object_path + " has no " + entry_point_name + "\n";
+		module.reset();
+	}
+#else
+	error = "error: the native engine is not supported in this build, " + object_path + " is not loaded\n";
+#endif
+	return module;
+}
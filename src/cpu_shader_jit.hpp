@@ -0,0 +1,98 @@
+#ifndef _CPU_SHADER_JIT_HPP_INCLUDED_
+#define _CPU_SHADER_JIT_HPP_INCLUDED_
+
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "cpu_bytecode.hpp"
+#include "cpu_simd_vm.hpp"
+
+class CpuShaderJit;
+typedef boost::shared_ptr<CpuShaderJit> CpuShaderJitPtr;
+
+// compiles bytecode to machine code. the bytecode is written out as C++ in
+// the form of the simd kernel, registers as vectors of a lane per pixel and
+// branches as masks, with the registers, the constants and the jumps known
+// at compile time. the system compiler builds it into a shared object on a
+// thread of its own, and the object is loaded in. the objects are cached by
+// a hash of the source, so that a shader built once loads at once.
+class CpuShaderJit
+{
+public:
+	enum State
+	{
+		JS_Idle,
+		JS_Building,
+		JS_Ready,
+		JS_Failed,
+	};
+
+public:
+	// an empty directory keeps the objects in the temporary directory.
+	explicit CpuShaderJit(const std::string& cache_directory = "");
+	virtual ~CpuShaderJit();
+
+public:
+	// whether this build can load what it compiles.
+	static bool IsSupported();
+
+	// the shell command that builds the object, {input} and {output}
+	// replaced. c++ with the flags of the host cpu by default.
+	void SetCommand(const std::string& command);
+	const std::string& GetCommand() const;
+
+	// loads the object if cached, or starts building it. the kernels run as
+	// many lanes as the instruction set has.
+	void Build(const CpuBytecode& bytecode, CpuSimdVm::InstructionSet instruction_set);
+
+	State GetState() const;
+	bool IsReady() const;
+
+	// blocks until the build is done, true if it succeeded.
+	bool Wait();
+
+	// whether the object came from the cache, and how long a build took.
+	bool IsCached() const;
+	double GetBuildTime() const;
+
+	// what the compiler said, when it failed.
+	std::string GetError() const;
+
+	// a kernel on the built code, for CpuSimdVm. null unless ready.
+	boost::shared_ptr<CpuSimdVm::Kernel> CreateKernel() const;
+	CpuSimdVm::InstructionSet GetInstructionSet() const;
+
+	// the C++ the bytecode becomes, for a width of 4, 8 or 16 lanes.
+	static void Generate(const CpuBytecode& bytecode, unsigned int width, std::string& source);
+
+private:
+	struct Module;
+	typedef boost::shared_ptr<Module> ModulePtr;
+
+	// what the build thread shares with the jit, which may go first.
+	struct Job
+	{
+		mutable boost::mutex mutex;
+		boost::condition_variable condition;
+		State state;
+		ModulePtr module;
+		std::string error;
+		bool is_cached;
+		double build_time;
+	};
+	typedef boost::shared_ptr<Job> JobPtr;
+
+	static void BuildProc(JobPtr job, std::string source, std::string command, std::string object_path);
+	static ModulePtr Load(const std::string& object_path, std::string& error);
+
+private:
+	std::string m_directory;
+	std::string m_command;
+	JobPtr m_job;
+	CpuSimdVm::InstructionSet m_instruction_set;
+	size_t m_num_constants;
+	size_t m_num_textures;
+};
+
+#endif  // _CPU_SHADER_JIT_HPP_INCLUDED_
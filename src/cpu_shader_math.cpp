@@ -0,0 +1,189 @@
+#include "common.hpp"
+#include "cpu_shader_math.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// one lane, for the scalar engines to run SimdMath on.
+	struct Scalar
+	{
+		enum { width = 1 };
+		typedef float Value;
+		typedef bool Mask;
+
+		static Value Load(const float* p) { return *p; }
+		static void Store(float* p, Value a) { *p = a; }
+		static Value Splat(float a) { return a; }
+		static Value Zero() { return 0.0f; }
+
+		static Value Add(Value a, Value b) { return a + b; }
+		static Value Subtract(Value a, Value b) { return a - b; }
+		static Value Multiply(Value a, Value b) { return a * b; }
+		static Value Divide(Value a, Value b) { return a / b; }
+		static Value Sqrt(Value a) { return std::sqrt(a); }
+		static Value Min(Value a, Value b) { return CpuShaderMath::Min(a, b); }
+		static Value Max(Value a, Value b) { return CpuShaderMath::Max(a, b); }
+		static Value Abs(Value a) { return std::fabs(a); }
+		static Value Negate(Value a) { return -a; }
+		static Value Truncate(Value a) { return CpuShaderMath::Truncate(a); }
+		static Value Floor(Value a) { return std::floor(a); }
+
+		static Value Pow2(Value n)
+		{
+			unsigned int bits = static_cast<unsigned int>(static_cast<int>(n) + 127) << 23;
+			float x;
+			std::memcpy(&x, &bits, 4);
+			return x;
+		}
+
+		static Value Exponent(Value a)
+		{
+			unsigned int bits;
+			std::memcpy(&bits, &a, 4);
+			return static_cast<float>(static_cast<int>(bits >> 23) - 127);
+		}
+
+		static Value Mantissa(Value a)
+		{
+			unsigned int bits;
+			std::memcpy(&bits, &a, 4);
+			bits = (bits & 0x007fffffu) | 0x3f800000u;
+			float x;
+			std::memcpy(&x, &bits, 4);
+			return x;
+		}
+
+		static Mask Less(Value a, Value b) { return a < b; }
+		static Mask LessEqual(Value a, Value b) { return a <= b; }
+		static Mask Greater(Value a, Value b) { return a > b; }
+		static Mask GreaterEqual(Value a, Value b) { return a >= b; }
+		static Mask Equal(Value a, Value b) { return a == b; }
+		static Mask NotEqual(Value a, Value b) { return a != b; }
+		static Mask And(Mask a, Mask b) { return a && b; }
+		static Mask Or(Mask a, Mask b) { return a || b; }
+		static Value Select(Mask m, Value a, Value b) { return m ? a : b; }
+
+		static unsigned int GetLanes(Mask m) { return m ? 1u : 0u; }
+	};
+}
+
+#include "cpu_simd_math.hpp"
+#include "cpu_simd_noise.hpp"
+
+typedef SimdMath<Scalar> Math;
+typedef SimdNoise<Scalar> Noise;
+
+namespace CpuShaderMath
+{
+	const char* GetPrecisionName(Precision precision)
+	{
+		static const char* names[] = {"libm", "precise", "fast"};
+		return names[precision];
+	}
+
+	float Acos(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::acos(x);
+		return precision == PR_Fast ? Math::FastAcos(x) : Math::Acos(x);
+	}
+
+	float Asin(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::asin(x);
+		return precision == PR_Fast ? Math::FastAsin(x) : Math::Asin(x);
+	}
+
+	float Atan(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::atan(x);
+		return precision == PR_Fast ? Math::FastAtan(x) : Math::Atan(x);
+	}
+
+	float Atan2(float y, float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::atan2(y, x);
+		return precision == PR_Fast ? Math::FastAtan2(y, x) : Math::Atan2(y, x);
+	}
+
+	float Cos(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::cos(x);
+		return precision == PR_Fast ? Math::FastCos(x) : Math::Cos(x);
+	}
+
+	float Exp(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::exp(x);
+		return precision == PR_Fast ? Math::FastExp(x) : Math::Exp(x);
+	}
+
+	float Exp2(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return Exp2(x);
+		return precision == PR_Fast ? Math::FastExp2(x) : Math::Exp2(x);
+	}
+
+	float Fmod(float x, float y, Precision precision)
+	{
+		return precision == PR_Fast ? Math::FastModulo(x, y) : std::fmod(x, y);
+	}
+
+	float Log(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::log(x);
+		return precision == PR_Fast ? Math::FastLog(x) : Math::Log(x);
+	}
+
+	float Log10(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::log10(x);
+		return precision == PR_Fast ? Math::FastLog10(x) : Math::Log10(x);
+	}
+
+	float Log2(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return Log2(x);
+		return precision == PR_Fast ? Math::FastLog2(x) : Math::Log2(x);
+	}
+
+	float Pow(float x, float y, Precision precision)
+	{
+		if (precision == PR_Libm) return std::pow(x, y);
+		return precision == PR_Fast ? Math::FastPow(x, y) : Math::Pow(x, y);
+	}
+
+	float Sin(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::sin(x);
+		return precision == PR_Fast ? Math::FastSin(x) : Math::Sin(x);
+	}
+
+	float Tan(float x, Precision precision)
+	{
+		if (precision == PR_Libm) return std::tan(x);
+		return precision == PR_Fast ? Math::FastTan(x) : Math::Tan(x);
+	}
+
+	float Snoise(const float* v, unsigned int size)
+	{
+		if (size == 2) return Noise::Snoise2(v);
+		return size == 3 ? Noise::Snoise3(v) : Noise::Snoise4(v);
+	}
+
+	float Qnoise(const float* x, unsigned int size, Precision precision)
+	{
+		return size == 2 ? Noise::Qnoise2(x, precision) : Noise::Qnoise3(x, precision);
+	}
+
+	void NoiseHash(const float* n, float* result, Precision precision)
+	{
+		Noise::Hash(n, result, precision);
+	}
+
+	void Grad4(float j, const float* ip, float* result)
+	{
+		Noise::Grad4(j, ip, result);
+	}
+}
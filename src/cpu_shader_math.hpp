@@ -0,0 +1,155 @@
+#ifndef _CPU_SHADER_MATH_HPP_INCLUDED_
+#define _CPU_SHADER_MATH_HPP_INCLUDED_
+
+#include <cmath>
+
+// the scalar definitions of the intrinsics, shared by every cpu engine so
+// that they agree to the bit. they follow the HLSL documentation, not
+// what a given gpu happens to round to.
+namespace CpuShaderMath
+{
+	// how the transcendental intrinsics are computed: by libm, or by the
+	// polynomials of SimdMath, to a few ulps or fast. a program is lowered
+	// for one, and every engine computes it that way, so they still agree.
+	enum Precision
+	{
+		PR_Libm,
+		PR_Precise,
+		PR_Fast,
+		Num_Precisions,
+	};
+
+	const char* GetPrecisionName(Precision precision);
+
+	float Acos(float x, Precision precision);
+	float Asin(float x, Precision precision);
+	float Atan(float x, Precision precision);
+	float Atan2(float y, float x, Precision precision);
+	float Cos(float x, Precision precision);
+	float Exp(float x, Precision precision);
+	float Exp2(float x, Precision precision);
+	float Fmod(float x, float y, Precision precision);
+	float Log(float x, Precision precision);
+	float Log10(float x, Precision precision);
+	float Log2(float x, Precision precision);
+	float Pow(float x, float y, Precision precision);
+	float Sin(float x, Precision precision);
+	float Tan(float x, Precision precision);
+
+	// the functions of fx/snoise.hlsl and fx/qnoise.hlsl, by SimdNoise.
+	float Snoise(const float* v, unsigned int size);
+	float Qnoise(const float* x, unsigned int size, Precision precision);
+	void NoiseHash(const float* n, float* result, Precision precision);
+	void Grad4(float j, const float* ip, float* result);
+
+	inline float Frac(float x)
+	{
+		return x - std::floor(x);
+	}
+
+	inline float Saturate(float x)
+	{
+		return x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x;
+	}
+
+	inline float Truncate(float x)
+	{
+		return x < 0.0f ? std::ceil(x) : std::floor(x);
+	}
+
+	inline float Round(float x)
+	{
+		return std::floor(x + 0.5f);
+	}
+
+	inline float Sign(float x)
+	{
+		return x > 0.0f ? 1.0f : x < 0.0f ? -1.0f : 0.0f;
+	}
+
+	inline float Min(float a, float b)
+	{
+		return b < a ? b : a;
+	}
+
+	inline float Max(float a, float b)
+	{
+		return a < b ? b : a;
+	}
+
+	inline float Clamp(float x, float lo, float hi)
+	{
+		return Min(Max(x, lo), hi);
+	}
+
+	inline float Lerp(float a, float b, float t)
+	{
+		return a + (b - a) * t;
+	}
+
+	inline float Step(float edge, float x)
+	{
+		return x >= edge ? 1.0f : 0.0f;
+	}
+
+	inline float Smoothstep(float lo, float hi, float x)
+	{
+		float t = Saturate((x - lo) / (hi - lo));
+		return t * t * (3.0f - 2.0f * t);
+	}
+
+	inline float Rsqrt(float x)
+	{
+		return 1.0f / std::sqrt(x);
+	}
+
+	inline float Exp2(float x)
+	{
+		return std::pow(2.0f, x);
+	}
+
+	inline float Log2(float x)
+	{
+		return std::log(x) * 1.4426950408889634f;
+	}
+
+	inline float Degrees(float x)
+	{
+		return x * 57.295779513082321f;
+	}
+
+	inline float Radians(float x)
+	{
+		return x * 0.017453292519943295f;
+	}
+
+	inline bool IsNan(float x)
+	{
+		return x != x;
+	}
+
+	inline bool IsInf(float x)
+	{
+		return x == x && x - x != 0.0f;
+	}
+
+	// integer division truncates, and by zero gives zero here.
+	inline float IntDivide(float a, float b)
+	{
+		return b != 0.0f ? Truncate(a / b) : 0.0f;
+	}
+
+	inline float IntModulo(float a, float b)
+	{
+		return b != 0.0f ? std::fmod(a, b) : 0.0f;
+	}
+
+	inline float Dot(const float* a, const float* b, unsigned int size)
+	{
+		float sum = 0.0f;
+		for (unsigned int i = 0; i != size; ++i) sum += a[i] * b[i];
+		return sum;
+	}
+}
+
+#endif  // _CPU_SHADER_MATH_HPP_INCLUDED_
@@ -0,0 +1,1391 @@
+#include "common.hpp"
+#include "cpu_shader_program.hpp"
+#include "shader_preprocessor.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cwchar>
+
+static const size_t no_index = static_cast<size_t>(-1);
+
+// what the arguments of an intrinsic are made, and what it gives back.
+enum IntrinsicSignature
+{
+	IS_Float,				// componentwise on floats, scalars splat
+	IS_Integral,			// the same, but ints stay ints
+	IS_Sign,				// componentwise, gives ints
+	IS_Reduce,				// floats of one size, gives a float
+	IS_Test,				// componentwise, gives bools
+	IS_Any,					// any type, gives a bool
+	IS_Cross,				// two float3s
+	IS_Vector,				// floats of one size, the last ones may be scalar
+	IS_Sincos,				// a float and two out floats of its size
+};
+
+static const struct
+{
+	const wchar_t* name;
+	CpuShaderProgram::Intrinsic intrinsic;
+	size_t num_args;
+	IntrinsicSignature signature;
+	size_t num_vector_args;		// for IS_Vector, the rest are scalars
+} intrinsics[] =
+{
+	{L"abs", CpuShaderProgram::IN_Abs, 1, IS_Integral, 0},
+	{L"acos", CpuShaderProgram::IN_Acos, 1, IS_Float, 0},
+	{L"all", CpuShaderProgram::IN_All, 1, IS_Any, 0},
+	{L"any", CpuShaderProgram::IN_Any, 1, IS_Any, 0},
+	{L"asin", CpuShaderProgram::IN_Asin, 1, IS_Float, 0},
+	{L"atan", CpuShaderProgram::IN_Atan, 1, IS_Float, 0},
+	{L"atan2", CpuShaderProgram::IN_Atan2, 2, IS_Float, 0},
+	{L"ceil", CpuShaderProgram::IN_Ceil, 1, IS_Float, 0},
+	{L"clamp", CpuShaderProgram::IN_Clamp, 3, IS_Integral, 0},
+	{L"cos", CpuShaderProgram::IN_Cos, 1, IS_Float, 0},
+	{L"cosh", CpuShaderProgram::IN_Cosh, 1, IS_Float, 0},
+	{L"cross", CpuShaderProgram::IN_Cross, 2, IS_Cross, 0},
+	{L"ddx", CpuShaderProgram::IN_Ddx, 1, IS_Float, 0},
+	{L"ddy", CpuShaderProgram::IN_Ddy, 1, IS_Float, 0},
+	{L"degrees", CpuShaderProgram::IN_Degrees, 1, IS_Float, 0},
+	{L"distance", CpuShaderProgram::IN_Distance, 2, IS_Reduce, 0},
+	{L"dot", CpuShaderProgram::IN_Dot, 2, IS_Reduce, 0},
+	{L"exp", CpuShaderProgram::IN_Exp, 1, IS_Float, 0},
+	{L"exp2", CpuShaderProgram::IN_Exp2, 1, IS_Float, 0},
+	{L"floor", CpuShaderProgram::IN_Floor, 1, IS_Float, 0},
+	{L"fmod", CpuShaderProgram::IN_Fmod, 2, IS_Float, 0},
+	{L"frac", CpuShaderProgram::IN_Frac, 1, IS_Float, 0},
+	{L"fwidth", CpuShaderProgram::IN_Fwidth, 1, IS_Float, 0},
+	{L"isinf", CpuShaderProgram::IN_Isinf, 1, IS_Test, 0},
+	{L"isnan", CpuShaderProgram::IN_Isnan, 1, IS_Test, 0},
+	{L"length", CpuShaderProgram::IN_Length, 1, IS_Reduce, 0},
+	{L"lerp", CpuShaderProgram::IN_Lerp, 3, IS_Float, 0},
+	{L"log", CpuShaderProgram::IN_Log, 1, IS_Float, 0},
+	{L"log10", CpuShaderProgram::IN_Log10, 1, IS_Float, 0},
+	{L"log2", CpuShaderProgram::IN_Log2, 1, IS_Float, 0},
+	{L"max", CpuShaderProgram::IN_Max, 2, IS_Integral, 0},
+	{L"min", CpuShaderProgram::IN_Min, 2, IS_Integral, 0},
+	{L"normalize", CpuShaderProgram::IN_Normalize, 1, IS_Vector, 1},
+	{L"pow", CpuShaderProgram::IN_Pow, 2, IS_Float, 0},
+	{L"radians", CpuShaderProgram::IN_Radians, 1, IS_Float, 0},
+	{L"reflect", CpuShaderProgram::IN_Reflect, 2, IS_Vector, 2},
+	{L"refract", CpuShaderProgram::IN_Refract, 3, IS_Vector, 2},
+	{L"round", CpuShaderProgram::IN_Round, 1, IS_Float, 0},
+	{L"rsqrt", CpuShaderProgram::IN_Rsqrt, 1, IS_Float, 0},
+	{L"saturate", CpuShaderProgram::IN_Saturate, 1, IS_Float, 0},
+	{L"sign", CpuShaderProgram::IN_Sign, 1, IS_Sign, 0},
+	{L"sin", CpuShaderProgram::IN_Sin, 1, IS_Float, 0},
+	{L"sincos", CpuShaderProgram::IN_Sincos, 3, IS_Sincos, 0},
+	{L"sinh", CpuShaderProgram::IN_Sinh, 1, IS_Float, 0},
+	{L"smoothstep", CpuShaderProgram::IN_Smoothstep, 3, IS_Float, 0},
+	{L"sqrt", CpuShaderProgram::IN_Sqrt, 1, IS_Float, 0},
+	{L"step", CpuShaderProgram::IN_Step, 2, IS_Float, 0},
+	{L"tan", CpuShaderProgram::IN_Tan, 1, IS_Float, 0},
+	{L"tanh", CpuShaderProgram::IN_Tanh, 1, IS_Float, 0},
+	{L"trunc", CpuShaderProgram::IN_Trunc, 1, IS_Float, 0},
+};
+
+static const char* intrinsic_names[] =
+{
+	"abs", "acos", "all", "any", "asin", "atan", "atan2", "ceil",
+	"clamp", "cos", "cosh", "cross", "ddx", "ddy", "degrees", "distance",
+	"dot", "exp", "exp2", "floor", "fmod", "frac", "fwidth", "isinf",
+	"isnan", "length", "lerp", "log", "log10", "log2", "max", "min",
+	"normalize", "pow", "radians", "reflect", "refract", "round", "rsqrt", "saturate",
+	"sign", "sin", "sincos", "sinh", "smoothstep", "sqrt", "step", "tan",
+	"tanh", "trunc",
+	"Sample", "SampleLevel",
+};
+
+static const struct
+{
+	const wchar_t* op;
+	CpuShaderProgram::Operator binary;
+} binary_operators[] =
+{
+	{L"+", CpuShaderProgram::OP_Add}, {L"-", CpuShaderProgram::OP_Subtract},
+	{L"*", CpuShaderProgram::OP_Multiply}, {L"/", CpuShaderProgram::OP_Divide},
+	{L"%", CpuShaderProgram::OP_Modulo},
+	{L"<", CpuShaderProgram::OP_Less}, {L"<=", CpuShaderProgram::OP_LessEqual},
+	{L">", CpuShaderProgram::OP_Greater}, {L">=", CpuShaderProgram::OP_GreaterEqual},
+	{L"==", CpuShaderProgram::OP_Equal}, {L"!=", CpuShaderProgram::OP_NotEqual},
+	{L"&&", CpuShaderProgram::OP_And}, {L"||", CpuShaderProgram::OP_Or},
+	{L"&", CpuShaderProgram::OP_BitAnd}, {L"|", CpuShaderProgram::OP_BitOr},
+	{L"^", CpuShaderProgram::OP_BitXor},
+	{L"<<", CpuShaderProgram::OP_ShiftLeft}, {L">>", CpuShaderProgram::OP_ShiftRight},
+};
+
+static const char* base_type_names[] =
+{
+	"void", "bool", "int", "uint", "float", "Texture2D", "SamplerState",
+};
+
+static std::string Narrow(const std::wstring& word)
+{
+	std::string str(word.length(), '?');
+	for (size_t i = 0; i != word.length(); ++i)
+	{
+		if (word[i] < 0x80) str[i] = static_cast<char>(word[i]);
+	}
+	return str;
+}
+
+static CpuShaderProgram::Operator FindOperator(const std::wstring& op)
+{
+	for (size_t i = 0; i != ARRAYSIZE(binary_operators); ++i)
+	{
+		if (op == binary_operators[i].op) return binary_operators[i].binary;
+	}
+	return CpuShaderProgram::OP_None;
+}
+
+static bool IsComparison(CpuShaderProgram::Operator op)
+{
+	return op >= CpuShaderProgram::OP_Less && op <= CpuShaderProgram::OP_NotEqual;
+}
+
+static bool IsBitwise(CpuShaderProgram::Operator op)
+{
+	return op >= CpuShaderProgram::OP_BitAnd && op <= CpuShaderProgram::OP_ShiftRight;
+}
+
+// the components of a swizzle, from one of the two sets only.
+static bool ParseSwizzle(const std::wstring& swizzle, unsigned int size, unsigned char components[4])
+{
+	static const wchar_t* sets[] = {L"xyzw", L"rgba"};
+	if (swizzle.empty() || swizzle.length() > 4) return false;
+
+	for (size_t set = 0; set != ARRAYSIZE(sets); ++set)
+	{
+		size_t i = 0;
+		for (; i != swizzle.length(); ++i)
+		{
+			const wchar_t* found = wcschr(sets[set], swizzle[i]);
+			if (found == NULL || swizzle[i] == 0 || static_cast<unsigned int>(found - sets[set]) >= size) break;
+			components[i] = static_cast<unsigned char>(found - sets[set]);
+		}
+		if (i == swizzle.length()) return true;
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuShaderProgram::CpuShaderProgram()
+	: m_header_lines(0)
+	, m_entry_point(no_index)
+	, m_constant_size(0)
+	, m_global_size(0)
+	, m_num_textures(0)
+	, m_num_samplers(0)
+	, m_global_uses_derivatives(false)
+	, m_function(no_index)
+	, m_loop_depth(0)
+{
+
+}
+
+CpuShaderProgram::~CpuShaderProgram()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool CpuShaderProgram::Build(const std::wstring& header, const std::wstring& text, const std::wstring& entry_point)
+{
+	m_errors.clear();
+	m_variables.clear();
+	m_functions.clear();
+	m_function_names.clear();
+	m_global_inits.clear();
+	m_entry_point = no_index;
+	m_constant_size = 0;
+	m_global_size = 0;
+	m_num_textures = 0;
+	m_num_samplers = 0;
+	m_global_uses_derivatives = false;
+	m_scopes.assign(1, Scope());
+	m_function = no_index;
+	m_loop_depth = 0;
+
+	std::wstring source = header;
+	if (!source.empty() && source[source.length() - 1] != L'\n') source += L'\n';
+	m_header_lines = std::count(source.begin(), source.end(), L'\n');
+	source += text;
+
+	ShaderPreprocessor preprocessor;
+	preprocessor.Preprocess(source);
+	m_source = preprocessor.GetText();
+	m_line_starts.assign(1, 0);
+	for (size_t i = 0; i != m_source.length(); ++i)
+	{
+		if (m_source[i] == L'\n') m_line_starts.push_back(i + 1);
+	}
+
+	const std::vector<ShaderPreprocessor::Error>& preprocessor_errors = preprocessor.GetErrors();
+	for (size_t i = 0; i != preprocessor_errors.size(); ++i)
+	{
+		AddErrorAtLine(preprocessor_errors[i].line, preprocessor_errors[i].message);
+	}
+	if (!m_errors.empty()) return false;
+
+	m_tokenizer.Tokenize(m_source);
+	m_parser.Parse(m_source, m_tokenizer.GetTokens());
+	const std::vector<ShaderParser::Error>& parser_errors = m_parser.GetErrors();
+	for (size_t i = 0; i != parser_errors.size(); ++i) AddError(parser_errors[i].first_item, parser_errors[i].message);
+	if (!m_errors.empty()) return false;
+
+	// declared before used, as in HLSL, so one pass does.
+	const Node& root = *m_parser.GetRoot();
+	for (size_t i = 0; i != root.children.size(); ++i)
+	{
+		const Node& node = *root.children[i].node;
+		size_t first = root.children[i].offset;
+		switch (node.kind)
+		{
+		case ShaderParser::NK_CBuffer:
+			for (size_t j = 0; j != node.children.size(); ++j)
+			{
+				const Child& child = node.children[j];
+				if (child.node->kind == ShaderParser::NK_Declaration) DeclareGlobals(*child.node, first + child.offset, true);
+			}
+			break;
+		case ShaderParser::NK_Declaration:
+			DeclareGlobals(node, first, false);
+			break;
+		case ShaderParser::NK_Function:
+			DeclareFunction(node, first);
+			break;
+		case ShaderParser::NK_Struct:
+			AddError(first, "structs are not supported on the cpu");
+			break;
+		default:
+			break;
+		}
+	}
+
+	// the statics go after the constants, which are all known now.
+	size_t static_base = (m_constant_size + 3) / 4 * 4;
+	for (size_t i = 0; i != m_variables.size(); ++i)
+	{
+		Variable& variable = m_variables[i];
+		if (variable.is_global && !variable.is_uniform && variable.type.base != BT_Texture && variable.type.base != BT_Sampler)
+		{
+			variable.offset += static_base;
+		}
+	}
+	m_global_size += static_base;
+
+	for (size_t i = 0; i != m_functions.size() && m_entry_point == no_index; ++i)
+	{
+		if (m_functions[i].name == entry_point && m_functions[i].body) m_entry_point = i;
+	}
+	if (m_entry_point == no_index) AddErrorAtLine(m_header_lines, "no entry point " + Narrow(entry_point));
+	return m_errors.empty();
+}
+
+const std::vector<CpuShaderProgram::Error>& CpuShaderProgram::GetErrors() const
+{
+	return m_errors;
+}
+
+const std::vector<CpuShaderProgram::Variable>& CpuShaderProgram::GetVariables() const
+{
+	return m_variables;
+}
+
+const std::vector<CpuShaderProgram::Function>& CpuShaderProgram::GetFunctions() const
+{
+	return m_functions;
+}
+
+size_t CpuShaderProgram::GetEntryPoint() const
+{
+	return m_entry_point;
+}
+
+const std::vector<CpuShaderProgram::StmtPtr>& CpuShaderProgram::GetGlobalInits() const
+{
+	return m_global_inits;
+}
+
+size_t CpuShaderProgram::GetConstantSize() const
+{
+	return m_constant_size;
+}
+
+size_t CpuShaderProgram::GetGlobalSize() const
+{
+	return m_global_size;
+}
+
+size_t CpuShaderProgram::GetNumTextures() const
+{
+	return m_num_textures;
+}
+
+bool CpuShaderProgram::UsesDerivatives() const
+{
+	if (m_global_uses_derivatives) return true;
+	return m_entry_point != no_index && m_functions[m_entry_point].uses_derivatives;
+}
+
+CpuShaderProgram::Type CpuShaderProgram::MakeType(BaseType base, unsigned int size)
+{
+	Type type = {base, size};
+	return type;
+}
+
+bool CpuShaderProgram::IsSameType(const Type& lhs, const Type& rhs)
+{
+	return lhs.base == rhs.base && lhs.size == rhs.size;
+}
+
+const char* CpuShaderProgram::GetIntrinsicName(Intrinsic intrinsic)
+{
+	return intrinsic_names[intrinsic];
+}
+
+std::string CpuShaderProgram::GetTypeName(const Type& type)
+{
+	std::string name = base_type_names[type.base];
+	if (type.size > 1) name += static_cast<char>('0' + type.size);
+	return name;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void CpuShaderProgram::AddError(size_t item, const std::string& message)
+{
+	const std::vector<ShaderParser::Item>& items = m_parser.GetItems();
+	size_t pos = item < items.size() ? items[item].token->start_pos : m_source.length();
+	size_t line = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), pos) - m_line_starts.begin() - 1;
+	AddErrorAtLine(line, message);
+}
+
+void CpuShaderProgram::AddErrorAtLine(size_t line, const std::string& message)
+{
+	Error error;
+	error.line = line >= m_header_lines ? line - m_header_lines : 0;
+	error.message = line >= m_header_lines ? message : "in the header: " + message;
+	m_errors.push_back(error);
+}
+
+void CpuShaderProgram::DeclareGlobals(const Node& node, size_t first, bool in_cbuffer)
+{
+	const Child& type_child = node.children[0];
+	Type type;
+	unsigned int qualifiers = 0;
+	if (!ParseType(*type_child.node, first + type_child.offset, type, qualifiers)) return;
+
+	// globals outside a cbuffer are uniform too, unless static or const.
+	bool is_uniform = in_cbuffer || (qualifiers & (QF_Static | QF_Const)) == 0;
+	for (size_t i = 1; i < node.children.size(); ++i)
+	{
+		const Node& variable_node = *node.children[i].node;
+		size_t variable_first = first + node.children[i].offset;
+		if (variable_node.kind != ShaderParser::NK_Variable) continue;
+
+		const Node* initializer = NULL;
+		size_t initializer_first = 0;
+		if (!CheckVariable(variable_node, variable_first, initializer, initializer_first)) continue;
+
+		size_t idx = NewVariable(variable_node.text, type, true);
+		Variable& variable = m_variables[idx];
+		variable.is_uniform = is_uniform && type.base != BT_Texture && type.base != BT_Sampler;
+		if (type.base == BT_Texture) variable.offset = m_num_textures++;
+		else if (type.base == BT_Sampler) variable.offset = m_num_samplers++;
+		else if (variable.is_uniform)
+		{
+			// packed like D3D packs a cbuffer, nothing straddles a register.
+			if (m_constant_size % 4 + type.size > 4) m_constant_size = (m_constant_size + 3) / 4 * 4;
+			variable.offset = m_constant_size;
+			m_constant_size += type.size;
+		}
+		else
+		{
+			variable.offset = m_global_size;
+			m_global_size += type.size;
+		}
+
+		// statics are set up before every invocation, uniforms come as given.
+		if (initializer != NULL && !variable.is_uniform)
+		{
+			StmtPtr stmt = NewStatement(SK_Declare);
+			stmt->variable = idx;
+			stmt->expr = Convert(BuildInitializer(*initializer, initializer_first, type), type, initializer_first);
+			m_global_inits.push_back(stmt);
+		}
+		else if (!variable.is_uniform && type.base != BT_Texture && type.base != BT_Sampler)
+		{
+			StmtPtr stmt = NewStatement(SK_Declare);
+			stmt->variable = idx;
+			m_global_inits.push_back(stmt);
+		}
+		m_scopes.back().names[variable_node.text] = idx;
+	}
+}
+
+void CpuShaderProgram::DeclareFunction(const Node& node, size_t first)
+{
+	Function function;
+	function.name = node.text;
+	function.frame_size = 0;
+	function.uses_derivatives = false;
+
+	unsigned int qualifiers = 0;
+	if (!ParseType(*node.children[0].node, first + node.children[0].offset, function.return_type, qualifiers)) return;
+
+	// the parameters are the first locals of the frame.
+	m_function = m_functions.size();
+	m_scopes.push_back(Scope());
+	m_functions.push_back(function);
+
+	// the tokens are after the preprocessor, so a macro it uses counts too.
+	const std::vector<ShaderParser::Item>& items = m_parser.GetItems();
+	m_digest = ContentHasher();
+	for (size_t i = first; i != first + node.num_items && i < items.size(); ++i)
+	{
+		if (!items[i].in_directive) m_digest.Update(Narrow(items[i].token->word));
+	}
+
+	const Node* body = NULL;
+	size_t body_first = 0;
+	for (size_t i = 1; i < node.children.size(); ++i)
+	{
+		const Node& child = *node.children[i].node;
+		size_t child_first = first + node.children[i].offset;
+		if (child.kind == ShaderParser::NK_Block)
+		{
+			body = &child;
+			body_first = child_first;
+		}
+		if (child.kind != ShaderParser::NK_Parameter) continue;
+
+		Type type;
+		if (!ParseType(*child.children[0].node, child_first + child.children[0].offset, type, qualifiers)) continue;
+		const Node& variable_node = *child.children[1].node;
+		size_t variable_first = child_first + child.children[1].offset;
+		if (type.base == BT_Texture || type.base == BT_Sampler)
+		{
+			AddError(variable_first, "textures and samplers can not be passed on the cpu");
+			continue;
+		}
+
+		const Node* initializer = NULL;
+		size_t initializer_first = 0;
+		if (!CheckVariable(variable_node, variable_first, initializer, initializer_first)) continue;
+		if (initializer != NULL) AddError(initializer_first, "default parameters are not supported on the cpu");
+
+		size_t idx = NewVariable(variable_node.text, type, false);
+		Variable& variable = m_variables[idx];
+		variable.mode = (qualifiers & QF_In) != 0 && (qualifiers & QF_Out) != 0 ? PM_InOut : (qualifiers & QF_Out) != 0 ? PM_Out : PM_In;
+		for (size_t j = 0; j != variable_node.children.size(); ++j)
+		{
+			const Node& semantic = *variable_node.children[j].node;
+			if (semantic.kind == ShaderParser::NK_Semantic) variable.semantic = semantic.text;
+		}
+		m_scopes.back().names[variable_node.text] = idx;
+		m_functions[m_function].params.push_back(idx);
+	}
+
+	// a prototype is filled in by the definition of the same signature.
+	size_t defined = m_function;
+	typedef std::multimap<std::wstring, size_t>::const_iterator Iterator;
+	std::pair<Iterator, Iterator> range = m_function_names.equal_range(node.text);
+	for (Iterator it = range.first; it != range.second; ++it)
+	{
+		const Function& other = m_functions[it->second];
+		const Function& current = m_functions[m_function];
+		if (other.params.size() != current.params.size()) continue;
+
+		bool same = true;
+		for (size_t i = 0; i != other.params.size() && same; ++i)
+		{
+			same = IsSameType(m_variables[other.params[i]].type, m_variables[current.params[i]].type);
+		}
+		if (!same) continue;
+
+		if (other.body || body == NULL) AddError(first + node.token, "'" + Narrow(node.text) + "' is already defined");
+		defined = it->second;
+	}
+
+	if (body != NULL)
+	{
+		m_functions[m_function].body = BuildStatement(*body, body_first);
+		m_functions[m_function].digest = m_digest.Finish();
+		if (defined != m_function)
+		{
+			// the parameters of the definition are the ones named in the body.
+			m_functions[defined] = m_functions[m_function];
+		}
+	}
+	if (defined == m_function) m_function_names.insert(std::make_pair(node.text, m_function));
+	else m_functions.pop_back();
+
+	m_scopes.pop_back();
+	m_function = no_index;
+}
+
+bool CpuShaderProgram::CheckVariable(const Node& node, size_t first, const Node*& initializer, size_t& initializer_first)
+{
+	initializer = NULL;
+	for (size_t i = 0; i != node.children.size(); ++i)
+	{
+		const Node& child = *node.children[i].node;
+		if (child.kind == ShaderParser::NK_Dimension)
+		{
+			AddError(first + node.children[i].offset, "arrays are not supported on the cpu");
+			return false;
+		}
+		if (child.kind != ShaderParser::NK_Semantic)
+		{
+			initializer = &child;
+			initializer_first = first + node.children[i].offset;
+		}
+	}
+	return true;
+}
+
+bool CpuShaderProgram::ParseType(const Node& node, size_t first, Type& type, unsigned int& qualifiers)
+{
+	qualifiers = 0;
+	for (size_t i = 0; i != node.children.size(); ++i)
+	{
+		const std::wstring& qualifier = node.children[i].node->text;
+		if (qualifier == L"static") qualifiers |= QF_Static;
+		else if (qualifier == L"const") qualifiers |= QF_Const;
+		else if (qualifier == L"in") qualifiers |= QF_In;
+		else if (qualifier == L"out") qualifiers |= QF_Out;
+		else if (qualifier == L"inout") qualifiers |= QF_In | QF_Out;
+	}
+
+	if (ParseTypeName(node.text, type)) return true;
+
+	bool is_matrix = node.text.length() > 3 && node.text[node.text.length() - 2] == L'x';
+	AddError(first + node.token, is_matrix ? "matrices are not supported on the cpu" : "unknown type '" + Narrow(node.text) + "'");
+	return false;
+}
+
+bool CpuShaderProgram::ParseTypeName(const std::wstring& name, Type& type) const
+{
+	static const struct
+	{
+		const wchar_t* name;
+		BaseType base;
+	} base_types[] =
+	{
+		{L"void", BT_Void}, {L"bool", BT_Bool}, {L"int", BT_Int}, {L"uint", BT_Uint}, {L"dword", BT_Uint},
+		{L"float", BT_Float}, {L"half", BT_Float}, {L"double", BT_Float},
+		{L"Texture2D", BT_Texture}, {L"texture", BT_Texture}, {L"SamplerState", BT_Sampler}, {L"sampler", BT_Sampler},
+	};
+
+	for (size_t i = 0; i != ARRAYSIZE(base_types); ++i)
+	{
+		std::wstring base_name = base_types[i].name;
+		if (name.compare(0, base_name.length(), base_name) != 0) continue;
+
+		type.base = base_types[i].base;
+		type.size = 1;
+		if (name.length() == base_name.length()) return true;
+
+		bool is_vector = type.base >= BT_Bool && type.base <= BT_Float;
+		if (!is_vector || name.length() != base_name.length() + 1) continue;
+		wchar_t size = name[base_name.length()];
+		if (size < L'1' || size > L'4') continue;
+		type.size = size - L'0';
+		return true;
+	}
+	return false;
+}
+
+size_t CpuShaderProgram::NewVariable(const std::wstring& name, const Type& type, bool is_global)
+{
+	Variable variable;
+	variable.name = name;
+	variable.type = type;
+	variable.is_global = is_global;
+	variable.is_uniform = false;
+	variable.offset = 0;
+	variable.mode = PM_In;
+	if (!is_global)
+	{
+		Function& function = m_functions[m_function];
+		variable.offset = function.frame_size;
+		function.frame_size += type.size;
+	}
+	m_variables.push_back(variable);
+	return m_variables.size() - 1;
+}
+
+CpuShaderProgram::StmtPtr CpuShaderProgram::BuildStatement(const Node& node, size_t first)
+{
+	switch (node.kind)
+	{
+	case ShaderParser::NK_Block:
+		{
+			StmtPtr stmt = NewStatement(SK_Block);
+			m_scopes.push_back(Scope());
+			for (size_t i = 0; i != node.children.size(); ++i)
+			{
+				stmt->body.push_back(BuildStatement(*node.children[i].node, first + node.children[i].offset));
+			}
+			m_scopes.pop_back();
+			return stmt;
+		}
+
+	case ShaderParser::NK_Declaration:
+		return BuildDeclaration(node, first);
+
+	case ShaderParser::NK_ExprStatement:
+		{
+			StmtPtr stmt = NewStatement(SK_Expression);
+			stmt->expr = BuildExpression(*node.children[0].node, first + node.children[0].offset);
+			return stmt;
+		}
+
+	case ShaderParser::NK_If:
+		{
+			StmtPtr stmt = NewStatement(SK_If);
+			stmt->expr = BuildCondition(*node.children[0].node, first + node.children[0].offset);
+			for (size_t i = 1; i < node.children.size(); ++i)
+			{
+				m_scopes.push_back(Scope());
+				stmt->body.push_back(BuildStatement(*node.children[i].node, first + node.children[i].offset));
+				m_scopes.pop_back();
+			}
+			return stmt;
+		}
+
+	case ShaderParser::NK_For:
+		{
+			// the loop variable is scoped to the loop.
+			StmtPtr stmt = NewStatement(SK_For);
+			m_scopes.push_back(Scope());
+			stmt->body.push_back(BuildStatement(*node.children[0].node, first + node.children[0].offset));
+			if (node.children[1].node->kind != ShaderParser::NK_Empty)
+			{
+				stmt->expr = BuildCondition(*node.children[1].node, first + node.children[1].offset);
+			}
+			if (node.children[2].node->kind != ShaderParser::NK_Empty)
+			{
+				stmt->step = BuildExpression(*node.children[2].node, first + node.children[2].offset);
+			}
+			stmt->body.push_back(BuildLoopBody(*node.children[3].node, first + node.children[3].offset));
+			m_scopes.pop_back();
+			return stmt;
+		}
+
+	case ShaderParser::NK_While:
+		{
+			StmtPtr stmt = NewStatement(SK_While);
+			stmt->expr = BuildCondition(*node.children[0].node, first + node.children[0].offset);
+			stmt->body.push_back(BuildLoopBody(*node.children[1].node, first + node.children[1].offset));
+			return stmt;
+		}
+
+	case ShaderParser::NK_Do:
+		{
+			StmtPtr stmt = NewStatement(SK_Do);
+			stmt->body.push_back(BuildLoopBody(*node.children[0].node, first + node.children[0].offset));
+			stmt->expr = BuildCondition(*node.children[1].node, first + node.children[1].offset);
+			return stmt;
+		}
+
+	case ShaderParser::NK_Return:
+		{
+			StmtPtr stmt = NewStatement(SK_Return);
+			const Type& return_type = m_functions[m_function].return_type;
+			if (!node.children.empty())
+			{
+				const Child& child = node.children[0];
+				ExprPtr value = BuildExpression(*child.node, first + child.offset);
+				if (return_type.base == BT_Void) AddError(first + child.offset, "a void function returns no value");
+				else stmt->expr = Convert(value, return_type, first + child.offset);
+			}
+			else if (return_type.base != BT_Void) AddError(first, "the function must return a value");
+			return stmt;
+		}
+
+	case ShaderParser::NK_Break:
+	case ShaderParser::NK_Continue:
+		if (m_loop_depth == 0) AddError(first, "'" + std::string(node.kind == ShaderParser::NK_Break ? "break" : "continue") + "' outside of a loop");
+		return NewStatement(node.kind == ShaderParser::NK_Break ? SK_Break : SK_Continue);
+
+	case ShaderParser::NK_Discard:
+		return NewStatement(SK_Discard);
+
+	case ShaderParser::NK_Switch:
+	case ShaderParser::NK_Case:
+		AddError(first, "switch is not supported on the cpu");
+		return NewStatement(SK_Block);
+
+	default:
+		// empty statements and [attributes], which are only hints here.
+		return NewStatement(SK_Block);
+	}
+}
+
+CpuShaderProgram::StmtPtr CpuShaderProgram::BuildLoopBody(const Node& node, size_t first)
+{
+	++m_loop_depth;
+	m_scopes.push_back(Scope());
+	StmtPtr stmt = BuildStatement(node, first);
+	m_scopes.pop_back();
+	--m_loop_depth;
+	return stmt;
+}
+
+CpuShaderProgram::StmtPtr CpuShaderProgram::BuildDeclaration(const Node& node, size_t first)
+{
+	StmtPtr block = NewStatement(SK_Block);
+	Type type;
+	unsigned int qualifiers = 0;
+	if (!ParseType(*node.children[0].node, first + node.children[0].offset, type, qualifiers)) return block;
+	if (type.base == BT_Void || type.base == BT_Texture || type.base == BT_Sampler)
+	{
+		AddError(first + node.children[0].offset, "no local variable can be of type " + GetTypeName(type));
+		return block;
+	}
+
+	for (size_t i = 1; i < node.children.size(); ++i)
+	{
+		const Node& variable_node = *node.children[i].node;
+		size_t variable_first = first + node.children[i].offset;
+		if (variable_node.kind != ShaderParser::NK_Variable) continue;
+
+		const Node* initializer = NULL;
+		size_t initializer_first = 0;
+		if (!CheckVariable(variable_node, variable_first, initializer, initializer_first)) continue;
+
+		// the name is visible after its initializer.
+		StmtPtr stmt = NewStatement(SK_Declare);
+		if (initializer != NULL) stmt->expr = Convert(BuildInitializer(*initializer, initializer_first, type), type, initializer_first);
+		stmt->variable = NewVariable(variable_node.text, type, false);
+		m_scopes.back().names[variable_node.text] = stmt->variable;
+		block->body.push_back(stmt);
+	}
+	return block->body.size() == 1 ? block->body[0] : block;
+}
+
+CpuShaderProgram::StmtPtr CpuShaderProgram::NewStatement(StmtKind kind) const
+{
+	StmtPtr stmt(new Stmt);
+	stmt->kind = kind;
+	stmt->variable = no_index;
+	return stmt;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildCondition(const Node& node, size_t first)
+{
+	ExprPtr condition = BuildExpression(node, first);
+	if (condition->type.size != 1)
+	{
+		AddError(first, "the condition must be a scalar");
+		return NewConstant(MakeType(BT_Bool, 1), 0.0f);
+	}
+	return Convert(condition, MakeType(BT_Bool, 1), first);
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildInitializer(const Node& node, size_t first, const Type& type)
+{
+	if (node.kind != ShaderParser::NK_InitList) return BuildExpression(node, first);
+
+	// {a, b, c} is taken as a constructor of the declared type.
+	std::vector<ExprPtr> args;
+	for (size_t i = 0; i != node.children.size(); ++i)
+	{
+		args.push_back(BuildInitializer(*node.children[i].node, first + node.children[i].offset, type));
+	}
+	return BuildConstructor(type, args, first);
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildExpression(const Node& node, size_t first)
+{
+	switch (node.kind)
+	{
+	case ShaderParser::NK_Literal:
+		return BuildLiteral(node, first);
+
+	case ShaderParser::NK_Identifier:
+		{
+			size_t idx = FindVariable(node.text);
+			if (idx == no_index)
+			{
+				AddError(first, "unknown name '" + Narrow(node.text) + "'");
+				return NewConstant(MakeType(BT_Float, 1), 0.0f);
+			}
+			ExprPtr expr = NewExpr(EK_Variable, m_variables[idx].type);
+			expr->variable = idx;
+			return expr;
+		}
+
+	case ShaderParser::NK_Paren:
+		return BuildExpression(*node.children[0].node, first + node.children[0].offset);
+
+	case ShaderParser::NK_Member:
+		return BuildSwizzle(node, first);
+
+	case ShaderParser::NK_MethodCall:
+		return BuildMethodCall(node, first);
+
+	case ShaderParser::NK_Unary:
+	case ShaderParser::NK_Postfix:
+		return BuildUnary(node, first);
+
+	case ShaderParser::NK_Binary:
+		return BuildBinary(node, first);
+
+	case ShaderParser::NK_Assign:
+		return BuildAssign(node, first);
+
+	case ShaderParser::NK_Conditional:
+		{
+			ExprPtr condition = BuildExpression(*node.children[0].node, first + node.children[0].offset);
+			ExprPtr lhs = BuildExpression(*node.children[1].node, first + node.children[1].offset);
+			ExprPtr rhs = BuildExpression(*node.children[2].node, first + node.children[2].offset);
+
+			// both sides are evaluated, and a vector condition picks by component.
+			Type type = CommonType(lhs->type, rhs->type, first);
+			if (condition->type.size != 1) type.size = std::min(type.size, condition->type.size);
+			ExprPtr expr = NewExpr(EK_Conditional, type);
+			expr->args.push_back(Convert(condition, MakeType(BT_Bool, condition->type.size == 1 ? 1 : type.size), first));
+			expr->args.push_back(Convert(lhs, type, first));
+			expr->args.push_back(Convert(rhs, type, first));
+			return expr;
+		}
+
+	case ShaderParser::NK_Cast:
+		{
+			Type type;
+			unsigned int qualifiers = 0;
+			const Child& type_child = node.children[0];
+			ExprPtr operand = BuildExpression(*node.children[1].node, first + node.children[1].offset);
+			if (!ParseType(*type_child.node, first + type_child.offset, type, qualifiers)) return operand;
+			return Convert(operand, type, first);
+		}
+
+	case ShaderParser::NK_Constructor:
+		{
+			Type type;
+			std::vector<ExprPtr> args;
+			BuildArguments(node, first, 0, args);
+			if (!ParseTypeName(node.text, type) || type.base < BT_Bool || type.base > BT_Float)
+			{
+				bool is_matrix = node.text.length() > 3 && node.text[node.text.length() - 2] == L'x';
+				AddError(first, is_matrix ? "matrices are not supported on the cpu" : "can not construct '" + Narrow(node.text) + "'");
+				return NewConstant(MakeType(BT_Float, 1), 0.0f);
+			}
+			return BuildConstructor(type, args, first);
+		}
+
+	case ShaderParser::NK_Call:
+		return BuildCall(node, first);
+
+	case ShaderParser::NK_Index:
+		AddError(first, "indexing is not supported on the cpu");
+		return NewConstant(MakeType(BT_Float, 1), 0.0f);
+
+	default:
+		AddError(first, "expected an expression");
+		return NewConstant(MakeType(BT_Float, 1), 0.0f);
+	}
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildLiteral(const Node& node, size_t first)
+{
+	const std::wstring& text = node.text;
+	if (text == L"true" || text == L"false") return NewConstant(MakeType(BT_Bool, 1), text == L"true" ? 1.0f : 0.0f);
+
+	if (text.length() > 2 && text[0] == L'0' && (text[1] == L'x' || text[1] == L'X'))
+	{
+		bool is_unsigned = text.find_first_of(L"uU", 2) != std::wstring::npos;
+		return NewConstant(MakeType(is_unsigned ? BT_Uint : BT_Int, 1), static_cast<float>(wcstoul(text.c_str(), NULL, 16)));
+	}
+
+	bool is_float = text.find_first_of(L".eEfFhH") != std::wstring::npos;
+	bool is_unsigned = !is_float && text.find_first_of(L"uU") != std::wstring::npos;
+	double value = wcstod(text.c_str(), NULL);
+	return NewConstant(MakeType(is_float ? BT_Float : is_unsigned ? BT_Uint : BT_Int, 1), static_cast<float>(value));
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildSwizzle(const Node& node, size_t first)
+{
+	ExprPtr object = BuildExpression(*node.children[0].node, first + node.children[0].offset);
+	if (object->type.base < BT_Bool || object->type.base > BT_Float)
+	{
+		AddError(first + node.token, "no member '" + Narrow(node.text) + "' in " + GetTypeName(object->type));
+		return NewConstant(MakeType(BT_Float, 1), 0.0f);
+	}
+
+	unsigned char components[4] = {0, 0, 0, 0};
+	if (!ParseSwizzle(node.text, object->type.size, components))
+	{
+		AddError(first + node.token, "invalid swizzle '" + Narrow(node.text) + "' of " + GetTypeName(object->type));
+		return NewConstant(MakeType(object->type.base, 1), 0.0f);
+	}
+
+	// a swizzle of a swizzle picks from the first one.
+	ExprPtr expr = NewExpr(EK_Swizzle, MakeType(object->type.base, static_cast<unsigned int>(node.text.length())));
+	if (object->kind == EK_Swizzle)
+	{
+		for (unsigned int i = 0; i != expr->type.size; ++i) expr->components[i] = object->components[components[i]];
+		expr->args.push_back(object->args[0]);
+	}
+	else
+	{
+		for (unsigned int i = 0; i != expr->type.size; ++i) expr->components[i] = components[i];
+		expr->args.push_back(object);
+	}
+	return expr;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildUnary(const Node& node, size_t first)
+{
+	const Child& child = node.children[0];
+	ExprPtr operand = BuildExpression(*child.node, first + child.offset);
+	const std::wstring& op = node.text;
+	if (op == L"++" || op == L"--")
+	{
+		if (!IsLValue(operand)) AddError(first, "'" + Narrow(op) + "' needs a variable");
+		ExprPtr expr = NewExpr(EK_Increment, operand->type);
+		expr->op = op == L"++" ? OP_Add : OP_Subtract;
+		expr->is_prefix = node.kind == ShaderParser::NK_Unary;
+		expr->args.push_back(operand);
+		return expr;
+	}
+
+	if (op == L"+") return operand;
+	if (op == L"!")
+	{
+		Type type = MakeType(BT_Bool, operand->type.size);
+		ExprPtr expr = NewExpr(EK_Unary, type);
+		expr->op = OP_Not;
+		expr->args.push_back(Convert(operand, type, first));
+		return expr;
+	}
+
+	// bools are negated as ints.
+	Type type = operand->type;
+	if (type.base == BT_Bool) type.base = BT_Int;
+	if (op == L"~" && type.base == BT_Float)
+	{
+		AddError(first, "'~' needs an integer");
+		type.base = BT_Int;
+	}
+	ExprPtr expr = NewExpr(EK_Unary, type);
+	expr->op = op == L"-" ? OP_Negate : OP_BitNot;
+	expr->args.push_back(Convert(operand, type, first));
+	return FoldConstant(expr);
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildBinary(const Node& node, size_t first)
+{
+	ExprPtr lhs = BuildExpression(*node.children[0].node, first + node.children[0].offset);
+	ExprPtr rhs = BuildExpression(*node.children[1].node, first + node.children[1].offset);
+	if (node.text == L",")
+	{
+		ExprPtr expr = NewExpr(EK_Comma, rhs->type);
+		expr->args.push_back(lhs);
+		expr->args.push_back(rhs);
+		return expr;
+	}
+	return MakeBinary(FindOperator(node.text), lhs, rhs, first);
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::MakeBinary(Operator op, const ExprPtr& lhs, const ExprPtr& rhs, size_t item)
+{
+	// && and || work by component and do not short circuit.
+	Type type = CommonType(lhs->type, rhs->type, item);
+	if (op == OP_And || op == OP_Or) type.base = BT_Bool;
+	else if (type.base == BT_Bool) type.base = BT_Int;
+	if (IsBitwise(op) && type.base == BT_Float)
+	{
+		AddError(item, "bitwise operators need integers");
+		type.base = BT_Int;
+	}
+
+	ExprPtr expr = NewExpr(EK_Binary, IsComparison(op) ? MakeType(BT_Bool, type.size) : type);
+	expr->op = op;
+	expr->args.push_back(Convert(lhs, type, item));
+	expr->args.push_back(Convert(rhs, type, item));
+	return FoldConstant(expr);
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildAssign(const Node& node, size_t first)
+{
+	ExprPtr target = BuildExpression(*node.children[0].node, first + node.children[0].offset);
+	ExprPtr value = BuildExpression(*node.children[1].node, first + node.children[1].offset);
+	if (!IsLValue(target))
+	{
+		AddError(first, "can not assign to this");
+		return value;
+	}
+
+	// a compound assignment reads the target again, which has no side
+	// effects, being a variable or a swizzle of one.
+	if (node.text != L"=")
+	{
+		Operator op = FindOperator(node.text.substr(0, node.text.length() - 1));
+		value = MakeBinary(op, target, value, first);
+	}
+
+	ExprPtr expr = NewExpr(EK_Assign, target->type);
+	expr->args.push_back(target);
+	expr->args.push_back(Convert(value, target->type, first));
+	return expr;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildConstructor(const Type& type, const std::vector<ExprPtr>& args, size_t item)
+{
+	if (args.size() == 1 && args[0]->type.size == 1) return Convert(args[0], type, item);
+
+	unsigned int size = 0;
+	ExprPtr expr = NewExpr(EK_Construct, type);
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		if (args[i]->type.base < BT_Bool || args[i]->type.base > BT_Float)
+		{
+			AddError(item, "can not construct " + GetTypeName(type) + " from " + GetTypeName(args[i]->type));
+			return NewConstant(type, 0.0f);
+		}
+		size += args[i]->type.size;
+		expr->args.push_back(Convert(args[i], MakeType(type.base, args[i]->type.size), item));
+	}
+	if (size != type.size)
+	{
+		AddError(item, "wrong number of components to construct " + GetTypeName(type));
+		return NewConstant(type, 0.0f);
+	}
+
+	// constructors of constants are constants.
+	bool is_constant = true;
+	for (size_t i = 0; i != expr->args.size(); ++i) is_constant = is_constant && expr->args[i]->kind == EK_Constant;
+	if (!is_constant) return expr;
+
+	ExprPtr constant = NewConstant(type, 0.0f);
+	unsigned int component = 0;
+	for (size_t i = 0; i != expr->args.size(); ++i)
+	{
+		for (unsigned int j = 0; j != expr->args[i]->type.size; ++j) constant->value[component++] = expr->args[i]->value[j];
+	}
+	return constant;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildCall(const Node& node, size_t first)
+{
+	std::vector<ExprPtr> args;
+	BuildArguments(node, first, 0, args);
+
+	typedef std::multimap<std::wstring, size_t>::const_iterator Iterator;
+	std::pair<Iterator, Iterator> range = m_function_names.equal_range(node.text);
+	if (range.first == range.second)
+	{
+		for (size_t i = 0; i != ARRAYSIZE(intrinsics); ++i)
+		{
+			if (node.text == intrinsics[i].name) return BuildIntrinsic(intrinsics[i].intrinsic, args, first);
+		}
+		AddError(first, "unknown function '" + Narrow(node.text) + "'");
+		return NewConstant(MakeType(BT_Float, 1), 0.0f);
+	}
+
+	// the overload taking the arguments with the cheapest conversions.
+	size_t best = no_index;
+	int best_cost = 0;
+	for (Iterator it = range.first; it != range.second; ++it)
+	{
+		const Function& function = m_functions[it->second];
+		if (function.params.size() != args.size()) continue;
+
+		int cost = 0;
+		for (size_t i = 0; i != args.size() && cost >= 0; ++i)
+		{
+			const Variable& param = m_variables[function.params[i]];
+			int arg_cost = ConversionCost(args[i]->type, param.type);
+			if (param.mode != PM_In && arg_cost >= 0) arg_cost += ConversionCost(param.type, args[i]->type);
+			cost = arg_cost < 0 ? -1 : cost + arg_cost;
+		}
+		if (cost >= 0 && (best == no_index || cost < best_cost))
+		{
+			best = it->second;
+			best_cost = cost;
+		}
+	}
+	if (best == no_index)
+	{
+		AddError(first, "no overload of '" + Narrow(node.text) + "' takes these arguments");
+		return NewConstant(MakeType(BT_Float, 1), 0.0f);
+	}
+
+	// out arguments are copied back, converted to their own type.
+	const Function& function = m_functions[best];
+	if (!function.body) AddError(first, "'" + Narrow(node.text) + "' is declared but not defined");
+	if (function.uses_derivatives)
+	{
+		if (m_function != no_index) m_functions[m_function].uses_derivatives = true;
+		else m_global_uses_derivatives = true;
+	}
+	if (m_function != no_index) m_digest.Update(function.digest.ToString());
+
+	ExprPtr expr = NewExpr(EK_Call, function.return_type);
+	expr->function = best;
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		const Variable& param = m_variables[function.params[i]];
+		if (param.mode == PM_In) expr->args.push_back(Convert(args[i], param.type, first));
+		else
+		{
+			if (!IsLValue(args[i])) AddError(first, "the out argument '" + Narrow(param.name) + "' needs a variable");
+			expr->args.push_back(args[i]);
+		}
+	}
+	return expr;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildIntrinsic(Intrinsic intrinsic, std::vector<ExprPtr>& args, size_t item)
+{
+	size_t table_idx = 0;
+	while (intrinsics[table_idx].intrinsic != intrinsic) ++table_idx;
+	const char* name = intrinsic_names[intrinsic];
+	if (args.size() != intrinsics[table_idx].num_args)
+	{
+		AddError(item, std::string("wrong number of arguments to ") + name);
+		return NewConstant(MakeType(BT_Float, 1), 0.0f);
+	}
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		if (args[i]->type.base < BT_Bool || args[i]->type.base > BT_Float)
+		{
+			AddError(item, std::string("wrong type of argument to ") + name);
+			return NewConstant(MakeType(BT_Float, 1), 0.0f);
+		}
+	}
+
+	if (intrinsic == IN_Ddx || intrinsic == IN_Ddy || intrinsic == IN_Fwidth)
+	{
+		if (m_function != no_index) m_functions[m_function].uses_derivatives = true;
+		else m_global_uses_derivatives = true;
+	}
+
+	// the size of a componentwise call, scalars splat.
+	unsigned int size = 1;
+	bool is_integral = true;
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		if (args[i]->type.size != 1) size = size == 1 ? args[i]->type.size : std::min(size, args[i]->type.size);
+		is_integral = is_integral && args[i]->type.base != BT_Float;
+	}
+
+	Type arg_type = MakeType(BT_Float, size);
+	Type type = arg_type;
+	switch (intrinsics[table_idx].signature)
+	{
+	case IS_Float:
+		break;
+	case IS_Integral:
+		if (is_integral) arg_type.base = type.base = BT_Int;
+		break;
+	case IS_Sign:
+		type.base = BT_Int;
+		break;
+	case IS_Reduce:
+		type.size = 1;
+		break;
+	case IS_Test:
+		type.base = BT_Bool;
+		break;
+	case IS_Any:
+		arg_type = args[0]->type;
+		type = MakeType(BT_Bool, 1);
+		break;
+	case IS_Cross:
+		arg_type = type = MakeType(BT_Float, 3);
+		break;
+	case IS_Vector:
+		arg_type = type = MakeType(BT_Float, args[0]->type.size);
+		break;
+	case IS_Sincos:
+		type = MakeType(BT_Void, 1);
+		arg_type = MakeType(BT_Float, args[0]->type.size);
+		break;
+	}
+
+	ExprPtr expr = NewExpr(EK_Intrinsic, type);
+	expr->function = intrinsic;
+	for (size_t i = 0; i != args.size(); ++i)
+	{
+		if (intrinsics[table_idx].signature == IS_Sincos && i != 0)
+		{
+			if (!IsLValue(args[i])) AddError(item, "sincos needs variables for its results");
+			expr->args.push_back(args[i]);
+		}
+		else if (intrinsics[table_idx].signature == IS_Vector && i >= intrinsics[table_idx].num_vector_args)
+		{
+			expr->args.push_back(Convert(args[i], MakeType(BT_Float, 1), item));
+		}
+		else expr->args.push_back(Convert(args[i], arg_type, item));
+	}
+	return expr;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::BuildMethodCall(const Node& node, size_t first)
+{
+	ExprPtr object = BuildExpression(*node.children[0].node, first + node.children[0].offset);
+	std::vector<ExprPtr> args;
+	BuildArguments(node, first, 1, args);
+
+	bool is_sample = node.text == L"Sample";
+	bool is_sample_level = node.text == L"SampleLevel";
+	if (object->type.base != BT_Texture || (!is_sample && !is_sample_level))
+	{
+		AddError(first + node.token, "no method '" + Narrow(node.text) + "' on the cpu");
+		return NewConstant(MakeType(BT_Float, 4), 0.0f);
+	}
+	if (args.size() != (is_sample ? 2u : 3u) || args[0]->type.base != BT_Sampler || args[0]->kind != EK_Variable)
+	{
+		AddError(first + node.token, "wrong arguments to " + Narrow(node.text));
+		return NewConstant(MakeType(BT_Float, 4), 0.0f);
+	}
+
+	// Sample picks its level by the derivatives of the coordinates.
+	if (is_sample)
+	{
+		if (m_function != no_index) m_functions[m_function].uses_derivatives = true;
+		else m_global_uses_derivatives = true;
+	}
+
+	// the texture and the sampler by their variables.
+	ExprPtr expr = NewExpr(EK_Intrinsic, MakeType(BT_Float, 4));
+	expr->function = is_sample ? IN_Sample : IN_SampleLevel;
+	expr->args.push_back(object);
+	expr->args.push_back(args[0]);
+	expr->args.push_back(Convert(args[1], MakeType(BT_Float, 2), first));
+	if (is_sample_level) expr->args.push_back(Convert(args[2], MakeType(BT_Float, 1), first));
+	return expr;
+}
+
+void CpuShaderProgram::BuildArguments(const Node& node, size_t first, size_t first_child, std::vector<ExprPtr>& args)
+{
+	for (size_t i = first_child; i < node.children.size(); ++i)
+	{
+		args.push_back(BuildExpression(*node.children[i].node, first + node.children[i].offset));
+	}
+}
+
+CpuShaderProgram::Type CpuShaderProgram::CommonType(const Type& lhs, const Type& rhs, size_t item)
+{
+	// scalars splat, the longer vector is cut to the shorter one.
+	Type type = MakeType(std::max(lhs.base, rhs.base), 1);
+	if (lhs.size == 1) type.size = rhs.size;
+	else if (rhs.size == 1) type.size = lhs.size;
+	else type.size = std::min(lhs.size, rhs.size);
+
+	if (lhs.base < BT_Bool || lhs.base > BT_Float || rhs.base < BT_Bool || rhs.base > BT_Float)
+	{
+		AddError(item, "can not combine " + GetTypeName(lhs) + " and " + GetTypeName(rhs));
+		type.base = BT_Float;
+	}
+	return type;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::Convert(const ExprPtr& expr, const Type& type, size_t item)
+{
+	if (IsSameType(expr->type, type)) return expr;
+	if (ConversionCost(expr->type, type) < 0)
+	{
+		AddError(item, "can not convert " + GetTypeName(expr->type) + " to " + GetTypeName(type));
+		return NewConstant(type, 0.0f);
+	}
+
+	ExprPtr converted = NewExpr(EK_Convert, type);
+	converted->args.push_back(expr);
+	return FoldConstant(converted);
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::FoldConstant(const ExprPtr& expr)
+{
+	// conversions and negations of literals, so that float x = -1 is a constant.
+	if (expr->kind == EK_Convert && expr->args[0]->kind == EK_Constant)
+	{
+		const Expr& from = *expr->args[0];
+		ExprPtr constant = NewConstant(expr->type, 0.0f);
+		for (unsigned int i = 0; i != expr->type.size; ++i)
+		{
+			float value = from.value[from.type.size == 1 ? 0 : i];
+			if (expr->type.base == BT_Bool) value = value != 0.0f ? 1.0f : 0.0f;
+			else if (expr->type.base == BT_Int || expr->type.base == BT_Uint) value = static_cast<float>(static_cast<int>(value));
+			constant->value[i] = value;
+		}
+		return constant;
+	}
+	if (expr->kind == EK_Unary && expr->op == OP_Negate && expr->args[0]->kind == EK_Constant)
+	{
+		ExprPtr constant = NewConstant(expr->type, 0.0f);
+		for (unsigned int i = 0; i != expr->type.size; ++i) constant->value[i] = -expr->args[0]->value[i];
+		return constant;
+	}
+	return expr;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::NewExpr(ExprKind kind, const Type& type) const
+{
+	ExprPtr expr(new Expr);
+	expr->kind = kind;
+	expr->type = type;
+	expr->op = OP_None;
+	std::fill(expr->value, expr->value + 4, 0.0f);
+	expr->variable = no_index;
+	std::fill(expr->components, expr->components + 4, 0);
+	expr->function = no_index;
+	expr->is_prefix = false;
+	return expr;
+}
+
+CpuShaderProgram::ExprPtr CpuShaderProgram::NewConstant(const Type& type, float value) const
+{
+	ExprPtr expr = NewExpr(EK_Constant, type);
+	std::fill(expr->value, expr->value + type.size, value);
+	return expr;
+}
+
+bool CpuShaderProgram::IsLValue(const ExprPtr& expr) const
+{
+	if (expr->kind == EK_Variable) return !m_variables[expr->variable].is_uniform;
+	if (expr->kind != EK_Swizzle || !IsLValue(expr->args[0])) return false;
+
+	// no component written twice.
+	for (unsigned int i = 0; i != expr->type.size; ++i)
+	{
+		for (unsigned int j = 0; j != i; ++j)
+		{
+			if (expr->components[i] == expr->components[j]) return false;
+		}
+	}
+	return true;
+}
+
+int CpuShaderProgram::ConversionCost(const Type& from, const Type& to) const
+{
+	bool from_numeric = from.base >= BT_Bool && from.base <= BT_Float;
+	bool to_numeric = to.base >= BT_Bool && to.base <= BT_Float;
+	if (!from_numeric || !to_numeric) return from.base == to.base && from.size == to.size ? 0 : -1;
+	if (from.size != 1 && from.size < to.size) return -1;
+
+	// a splat costs more than a change of base, a truncation the most.
+	int cost = from.base == to.base ? 0 : 1;
+	if (from.size == 1 && to.size != 1) cost += 2;
+	else if (from.size > to.size) cost += 4;
+	return cost;
+}
+
+size_t CpuShaderProgram::FindVariable(const std::wstring& name) const
+{
+	for (size_t i = m_scopes.size(); i != 0; --i)
+	{
+		std::map<std::wstring, size_t>::const_iterator it = m_scopes[i - 1].names.find(name);
+		if (it != m_scopes[i - 1].names.end()) return it->second;
+	}
+	return no_index;
+}
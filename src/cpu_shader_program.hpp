@@ -0,0 +1,289 @@
+#ifndef _CPU_SHADER_PROGRAM_HPP_INCLUDED_
+#define _CPU_SHADER_PROGRAM_HPP_INCLUDED_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "content_hash.hpp"
+#include "shader_parser.hpp"
+
+// the subset of HLSL the saved shaders are written in, checked and typed
+// for running on the CPU: scalars and vectors of bool, int, uint and float,
+// cbuffers, static globals, textures and samplers, user functions with
+// in, out and inout parameters, loops, and the intrinsics. every value is
+// kept as up to four floats, ints included, which holds them exactly up
+// to 2^24. matrices, arrays, structs and switch are not supported, and
+// say so in the errors.
+class CpuShaderProgram
+{
+public:
+	enum BaseType
+	{
+		BT_Void,
+		BT_Bool,
+		BT_Int,
+		BT_Uint,
+		BT_Float,
+		BT_Texture,
+		BT_Sampler,
+	};
+
+	struct Type
+	{
+		BaseType base;
+		unsigned int size;		// components, 1 to 4
+	};
+
+	enum Operator
+	{
+		OP_None,
+		OP_Negate,
+		OP_Not,
+		OP_BitNot,
+		OP_Add,
+		OP_Subtract,
+		OP_Multiply,
+		OP_Divide,
+		OP_Modulo,
+		OP_Less,
+		OP_LessEqual,
+		OP_Greater,
+		OP_GreaterEqual,
+		OP_Equal,
+		OP_NotEqual,
+		OP_And,
+		OP_Or,
+		OP_BitAnd,
+		OP_BitOr,
+		OP_BitXor,
+		OP_ShiftLeft,
+		OP_ShiftRight,
+	};
+
+	enum Intrinsic
+	{
+		IN_Abs, IN_Acos, IN_All, IN_Any, IN_Asin, IN_Atan, IN_Atan2, IN_Ceil,
+		IN_Clamp, IN_Cos, IN_Cosh, IN_Cross, IN_Ddx, IN_Ddy, IN_Degrees, IN_Distance,
+		IN_Dot, IN_Exp, IN_Exp2, IN_Floor, IN_Fmod, IN_Frac, IN_Fwidth, IN_Isinf,
+		IN_Isnan, IN_Length, IN_Lerp, IN_Log, IN_Log10, IN_Log2, IN_Max, IN_Min,
+		IN_Normalize, IN_Pow, IN_Radians, IN_Reflect, IN_Refract, IN_Round, IN_Rsqrt, IN_Saturate,
+		IN_Sign, IN_Sin, IN_Sincos, IN_Sinh, IN_Smoothstep, IN_Sqrt, IN_Step, IN_Tan,
+		IN_Tanh, IN_Trunc,
+		IN_Sample,				// texture, sampler, coordinates
+		IN_SampleLevel,			// texture, sampler, coordinates, level
+		Num_Intrinsics,
+	};
+
+	enum ExprKind
+	{
+		EK_Constant,			// value
+		EK_Variable,			// variable
+		EK_Swizzle,				// the vector, components
+		EK_Convert,				// the value, to type
+		EK_Construct,			// the parts, concatenated
+		EK_Unary,				// op, the operand
+		EK_Binary,				// op, both operands of the same type
+		EK_Conditional,			// condition, then, else, of the type
+		EK_Assign,				// op, target, value of the target type
+		EK_Increment,			// op is add or subtract, is_prefix, target
+		EK_Call,				// function, arguments of the parameter types
+		EK_Intrinsic,			// function, arguments
+		EK_Comma,				// both, the value of the right
+	};
+
+	struct Expr;
+	typedef boost::shared_ptr<Expr> ExprPtr;
+
+	struct Expr
+	{
+		ExprKind kind;
+		Type type;
+		Operator op;
+		float value[4];
+		size_t variable;
+		unsigned char components[4];
+		size_t function;		// or the intrinsic
+		bool is_prefix;
+		std::vector<ExprPtr> args;
+	};
+
+	enum StmtKind
+	{
+		SK_Block,				// body
+		SK_Expression,			// expr
+		SK_Declare,				// variable, expr is the initial value or none
+		SK_If,					// expr, body is then and maybe else
+		SK_For,					// body is init and the loop, expr the condition or none, step
+		SK_While,				// expr, body
+		SK_Do,					// body, expr
+		SK_Return,				// expr or none
+		SK_Break,
+		SK_Continue,
+		SK_Discard,
+	};
+
+	struct Stmt;
+	typedef boost::shared_ptr<Stmt> StmtPtr;
+
+	struct Stmt
+	{
+		StmtKind kind;
+		ExprPtr expr;
+		ExprPtr step;
+		size_t variable;
+		std::vector<StmtPtr> body;
+	};
+
+	enum ParameterMode
+	{
+		PM_In,
+		PM_Out,
+		PM_InOut,
+	};
+
+	// globals live in the global frame: the cbuffer first, packed like
+	// D3D packs it, then the statics. locals live in their function's
+	// frame, parameters first. textures and samplers hold their slot.
+	struct Variable
+	{
+		std::wstring name;
+		Type type;
+		bool is_global;
+		bool is_uniform;
+		size_t offset;			// in floats, in the frame
+		ParameterMode mode;
+		std::wstring semantic;	// of a parameter
+	};
+
+	struct Function
+	{
+		std::wstring name;
+		Type return_type;
+		std::vector<size_t> params;
+		StmtPtr body;			// none for a prototype
+		size_t frame_size;
+		bool uses_derivatives;	// ddx, ddy, fwidth or Sample, here or in a callee
+		ContentHash digest;		// of its tokens and of the functions it calls
+	};
+
+	struct Error
+	{
+		size_t line;			// 0-based, in the shader text
+		std::string message;
+	};
+
+public:
+	CpuShaderProgram();
+	virtual ~CpuShaderProgram();
+
+public:
+	// header is put in front of text, as the editor does. false on errors.
+	bool Build(const std::wstring& header, const std::wstring& text, const std::wstring& entry_point = L"ps_main");
+
+	const std::vector<Error>& GetErrors() const;
+
+	const std::vector<Variable>& GetVariables() const;
+	const std::vector<Function>& GetFunctions() const;
+	size_t GetEntryPoint() const;
+
+	// the statements setting the statics up, before every invocation.
+	const std::vector<StmtPtr>& GetGlobalInits() const;
+
+	// floats of the cbuffer and of the whole global frame.
+	size_t GetConstantSize() const;
+	size_t GetGlobalSize() const;
+	size_t GetNumTextures() const;
+
+	// whether a function calls ddx, ddy or fwidth, directly or not.
+	bool UsesDerivatives() const;
+
+	static Type MakeType(BaseType base, unsigned int size);
+	static bool IsSameType(const Type& lhs, const Type& rhs);
+	static const char* GetIntrinsicName(Intrinsic intrinsic);
+	static std::string GetTypeName(const Type& type);
+
+private:
+	enum QualifierFlag
+	{
+		QF_Static	= 1,
+		QF_Const	= 2,
+		QF_In		= 4,
+		QF_Out		= 8,
+	};
+
+	struct Scope
+	{
+		std::map<std::wstring, size_t> names;
+	};
+
+	typedef ShaderParser::Node Node;
+	typedef ShaderParser::Child Child;
+
+	// the nodes are walked with the absolute index of their first item.
+	void AddError(size_t item, const std::string& message);
+	void AddErrorAtLine(size_t line, const std::string& message);
+
+	void DeclareGlobals(const Node& node, size_t first, bool in_cbuffer);
+	void DeclareFunction(const Node& node, size_t first);
+	bool CheckVariable(const Node& node, size_t first, const Node*& initializer, size_t& initializer_first);
+	bool ParseType(const Node& node, size_t first, Type& type, unsigned int& qualifiers);
+	bool ParseTypeName(const std::wstring& name, Type& type) const;
+	size_t NewVariable(const std::wstring& name, const Type& type, bool is_global);
+
+	StmtPtr BuildStatement(const Node& node, size_t first);
+	StmtPtr BuildLoopBody(const Node& node, size_t first);
+	StmtPtr BuildDeclaration(const Node& node, size_t first);
+	StmtPtr NewStatement(StmtKind kind) const;
+
+	ExprPtr BuildCondition(const Node& node, size_t first);
+	ExprPtr BuildInitializer(const Node& node, size_t first, const Type& type);
+	ExprPtr BuildExpression(const Node& node, size_t first);
+	ExprPtr BuildLiteral(const Node& node, size_t first);
+	ExprPtr BuildSwizzle(const Node& node, size_t first);
+	ExprPtr BuildUnary(const Node& node, size_t first);
+	ExprPtr BuildBinary(const Node& node, size_t first);
+	ExprPtr MakeBinary(Operator op, const ExprPtr& lhs, const ExprPtr& rhs, size_t item);
+	ExprPtr BuildAssign(const Node& node, size_t first);
+	ExprPtr BuildConstructor(const Type& type, const std::vector<ExprPtr>& args, size_t item);
+	ExprPtr BuildCall(const Node& node, size_t first);
+	ExprPtr BuildIntrinsic(Intrinsic intrinsic, std::vector<ExprPtr>& args, size_t item);
+	ExprPtr BuildMethodCall(const Node& node, size_t first);
+	void BuildArguments(const Node& node, size_t first, size_t first_child, std::vector<ExprPtr>& args);
+
+	Type CommonType(const Type& lhs, const Type& rhs, size_t item);
+	ExprPtr Convert(const ExprPtr& expr, const Type& type, size_t item);
+	ExprPtr FoldConstant(const ExprPtr& expr);
+	ExprPtr NewExpr(ExprKind kind, const Type& type) const;
+	ExprPtr NewConstant(const Type& type, float value) const;
+	bool IsLValue(const ExprPtr& expr) const;
+	int ConversionCost(const Type& from, const Type& to) const;
+	size_t FindVariable(const std::wstring& name) const;
+
+private:
+	std::wstring m_source;				// preprocessed, header included
+	std::vector<size_t> m_line_starts;
+	size_t m_header_lines;
+	ShaderTokenizer m_tokenizer;
+	ShaderParser m_parser;
+	std::vector<Error> m_errors;
+
+	std::vector<Variable> m_variables;
+	std::vector<Function> m_functions;
+	std::multimap<std::wstring, size_t> m_function_names;
+	std::vector<StmtPtr> m_global_inits;
+	size_t m_entry_point;
+	size_t m_constant_size;
+	size_t m_global_size;
+	size_t m_num_textures;
+	size_t m_num_samplers;
+	bool m_global_uses_derivatives;
+
+	// while building a function.
+	std::vector<Scope> m_scopes;
+	size_t m_function;
+	size_t m_loop_depth;
+	ContentHasher m_digest;
+};
+
+#endif  // _CPU_SHADER_PROGRAM_HPP_INCLUDED_
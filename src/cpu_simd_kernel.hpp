@@ -0,0 +1,921 @@
+#ifndef _CPU_SIMD_KERNEL_HPP_INCLUDED_
+#define _CPU_SIMD_KERNEL_HPP_INCLUDED_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "cpu_bytecode.hpp"
+#include "cpu_shader_interpreter.hpp"
+#include "cpu_shader_math.hpp"
+#include "cpu_simd_math.hpp"
+#include "cpu_simd_noise.hpp"
+#include "cpu_simd_texture.hpp"
+#include "cpu_simd_vm.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// the kernel of CpuSimdVm, written once over a Simd type that wraps the
+// vector instructions of one instruction set. the translation unit of each
+// set includes the headers above first, turns its target on, defines its
+// Simd, and only then includes this, so that nothing but the kernel is
+// compiled for the wider set. the unnamed namespace keeps every copy to its
+// own translation unit.
+//
+// a Simd has the lane count as width, a Value of width floats and a Mask of
+// width booleans, and static functions for the ops below. Min and Max keep
+// the operand order of CpuShaderMath, the compares are false for a nan but
+// for NotEqual, and Floor, Ceil and Truncate keep the sign of a zero, so
+// that every lane gets the bits the scalar vm gets. Pow2, Exponent and
+// Mantissa work on the bits of a float, for SimdMath.
+
+namespace
+{
+	inline unsigned int LowestLane(unsigned int lanes)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, lanes);
+		return index;
+#else
+		return __builtin_ctz(lanes);
+#endif
+	}
+
+	inline unsigned int CountLanes(unsigned int lanes)
+	{
+		unsigned int count = 0;
+		for (; lanes != 0; lanes &= lanes - 1) ++count;
+		return count;
+	}
+
+	// the ops without a vector instruction go one lane at a time.
+	float LaneOp(CpuBytecode::Opcode opcode, unsigned int flags, float a, float b)
+	{
+		using namespace CpuShaderMath;
+		switch (opcode)
+		{
+		case CpuBytecode::OC_Acos: return std::acos(a);
+		case CpuBytecode::OC_Asin: return std::asin(a);
+		case CpuBytecode::OC_Atan: return std::atan(a);
+		case CpuBytecode::OC_Atan2: return std::atan2(a, b);
+		case CpuBytecode::OC_Cos: return std::cos(a);
+		case CpuBytecode::OC_Cosh: return std::cosh(a);
+		case CpuBytecode::OC_Exp: return std::exp(a);
+		case CpuBytecode::OC_Exp2: return Exp2(a);
+		case CpuBytecode::OC_Log: return std::log(a);
+		case CpuBytecode::OC_Log10: return std::log10(a);
+		case CpuBytecode::OC_Log2: return Log2(a);
+		case CpuBytecode::OC_Pow: return std::pow(a, b);
+		case CpuBytecode::OC_Sin: return std::sin(a);
+		case CpuBytecode::OC_Sinh: return std::sinh(a);
+		case CpuBytecode::OC_Tan: return std::tan(a);
+		case CpuBytecode::OC_Tanh: return std::tanh(a);
+		default: return CpuBytecode::BitOp(opcode, flags, a, b);
+		}
+	}
+
+	// the transcendental ops as SimdMath computes them, precise or fast.
+	template <typename Simd>
+	typename Simd::Value Approximate(unsigned int opcode, CpuShaderMath::Precision precision, typename Simd::Value a, typename Simd::Value b)
+	{
+		typedef SimdMath<Simd> Math;
+		bool is_fast = precision == CpuShaderMath::PR_Fast;
+		switch (opcode)
+		{
+		case CpuBytecode::OC_Acos: return is_fast ? Math::FastAcos(a) : Math::Acos(a);
+		case CpuBytecode::OC_Asin: return is_fast ? Math::FastAsin(a) : Math::Asin(a);
+		case CpuBytecode::OC_Atan: return is_fast ? Math::FastAtan(a) : Math::Atan(a);
+		case CpuBytecode::OC_Atan2: return is_fast ? Math::FastAtan2(a, b) : Math::Atan2(a, b);
+		case CpuBytecode::OC_Cos: return is_fast ? Math::FastCos(a) : Math::Cos(a);
+		case CpuBytecode::OC_Exp: return is_fast ? Math::FastExp(a) : Math::Exp(a);
+		case CpuBytecode::OC_Exp2: return is_fast ? Math::FastExp2(a) : Math::Exp2(a);
+		case CpuBytecode::OC_Log: return is_fast ? Math::FastLog(a) : Math::Log(a);
+		case CpuBytecode::OC_Log10: return is_fast ? Math::FastLog10(a) : Math::Log10(a);
+		case CpuBytecode::OC_Log2: return is_fast ? Math::FastLog2(a) : Math::Log2(a);
+		case CpuBytecode::OC_Pow: return is_fast ? Math::FastPow(a, b) : Math::Pow(a, b);
+		case CpuBytecode::OC_Sin: return is_fast ? Math::FastSin(a) : Math::Sin(a);
+		case CpuBytecode::OC_Tan: return is_fast ? Math::FastTan(a) : Math::Tan(a);
+		default: return a;
+		}
+	}
+
+	// a vector of the width of the set through Approximate, for the native
+	// code and for benchmarks.
+	template <typename Simd>
+	void RunMath(unsigned int opcode, unsigned int precision, const float* a, const float* b, float* result)
+	{
+		Simd::Store(result, Approximate<Simd>(opcode, static_cast<CpuShaderMath::Precision>(precision), Simd::Load(a), Simd::Load(b)));
+	}
+
+	// the noise ops as SimdNoise computes them, of components width floats
+	// apart. returns how many components it filled.
+	template <typename Simd>
+	unsigned int Noise(unsigned int opcode, unsigned int size, CpuShaderMath::Precision precision, const float* a, const float* b, typename Simd::Value result[4])
+	{
+		typedef SimdNoise<Simd> Functions;
+		typename Simd::Value x[4], y[4];
+		unsigned int num_read = opcode == CpuBytecode::OC_Grad4 ? 1 : size;
+		for (unsigned int i = 0; i != num_read; ++i) x[i] = Simd::Load(a + i * Simd::width);
+		switch (opcode)
+		{
+		case CpuBytecode::OC_Snoise:
+			result[0] = size == 2 ? Functions::Snoise2(x) : size == 3 ? Functions::Snoise3(x) : Functions::Snoise4(x);
+			return 1;
+
+		case CpuBytecode::OC_Qnoise:
+			result[0] = size == 2 ? Functions::Qnoise2(x, precision) : Functions::Qnoise3(x, precision);
+			return 1;
+
+		case CpuBytecode::OC_Hash:
+			Functions::Hash(x, result, precision);
+			return 4;
+
+		case CpuBytecode::OC_Grad4:
+			for (unsigned int i = 0; i != 4; ++i) y[i] = Simd::Load(b + i * Simd::width);
+			Functions::Grad4(x[0], y, result);
+			return 4;
+
+		default:
+			return 0;
+		}
+	}
+
+	// Noise for the native code.
+	template <typename Simd>
+	void RunNoise(unsigned int opcode, unsigned int size, unsigned int precision, const float* a, const float* b, float* result)
+	{
+		typename Simd::Value r[4];
+		unsigned int num_written = Noise<Simd>(opcode, size, static_cast<CpuShaderMath::Precision>(precision), a, b, r);
+		for (unsigned int i = 0; i != num_written; ++i) Simd::Store(result + i * Simd::width, r[i]);
+	}
+
+	// SimdTexture for the native code and for benchmarks.
+	template <typename Simd>
+	void RunSample(const CpuTexture* texture, unsigned int lanes, const float* u, const float* v, const float* level, float* color)
+	{
+		typename Simd::Value result[4];
+		typename Simd::Value at = level != NULL ? Simd::Load(level) : SimdTexture<Simd>::ImplicitLevel(*texture, Simd::Load(u), Simd::Load(v));
+		SimdTexture<Simd>::Sample(*texture, lanes, Simd::Load(u), Simd::Load(v), at, result);
+		for (unsigned int i = 0; i != 4; ++i) Simd::Store(color + i * Simd::width, result[i]);
+	}
+
+	template <typename Simd>
+	class SimdKernel : public CpuSimdVm::Kernel
+	{
+	public:
+		typedef typename Simd::Value Value;
+		typedef typename Simd::Mask Mask;
+
+		explicit SimdKernel(const CpuBytecode& bytecode);
+		virtual ~SimdKernel();
+
+	public:
+		virtual void SetConstants(const std::vector<float>& constants);
+		virtual void SetTexture(size_t slot, const CpuTexture* texture);
+		virtual unsigned int Run(const float* inputs, unsigned int lanes, float* outputs);
+		virtual size_t GetNumCutOffLoops() const;
+
+	private:
+		enum
+		{
+			width = Simd::width,
+			all_lanes = (1u << Simd::width) - 1,
+		};
+
+		struct Step
+		{
+			unsigned int opcode;
+			unsigned int size;
+			unsigned int flags;
+			unsigned int components[4];	// of the swizzle
+			float* dest;
+			const float* args[3];
+			size_t target;
+			size_t continue_point;		// of a loop
+		};
+
+		// an if, a loop or a call some lanes are in.
+		enum ScopeKind
+		{
+			SC_If,
+			SC_Loop,
+			SC_Call,
+		};
+
+		struct Scope
+		{
+			ScopeKind kind;
+			size_t begin;			// the step that opened it
+			unsigned int waiting;	// lanes for the else, that continued, or that returned
+			unsigned int done;		// lanes through the then, or out of the loop
+		};
+
+		void Execute();
+		size_t Skip(size_t at) const;
+		Scope& Innermost(ScopeKind kind);
+		void Decode();
+
+		float* Register(unsigned int index);
+		void SetLanes(unsigned int lanes);
+		void Write(float* dest, Value value) const;
+
+		template <Value (*Op)(Value)> void Unary(const Step& step)
+		{
+			for (unsigned int i = 0; i != step.size; ++i) Write(step.dest + i * width, Op(Simd::Load(step.args[0] + i * width)));
+		}
+
+		template <Value (*Op)(Value, Value)> void Binary(const Step& step)
+		{
+			for (unsigned int i = 0; i != step.size; ++i)
+			{
+				Write(step.dest + i * width, Op(Simd::Load(step.args[0] + i * width), Simd::Load(step.args[1] + i * width)));
+			}
+		}
+
+		template <Value (*Op)(Value, Value, Value)> void Ternary(const Step& step)
+		{
+			for (unsigned int i = 0; i != step.size; ++i)
+			{
+				Value a = Simd::Load(step.args[0] + i * width);
+				Value b = Simd::Load(step.args[1] + i * width);
+				Write(step.dest + i * width, Op(a, b, Simd::Load(step.args[2] + i * width)));
+			}
+		}
+
+		template <Mask (*Op)(Value, Value)> void Compare(const Step& step)
+		{
+			for (unsigned int i = 0; i != step.size; ++i)
+			{
+				Write(step.dest + i * width, Float(Op(Simd::Load(step.args[0] + i * width), Simd::Load(step.args[1] + i * width))));
+			}
+		}
+
+		void PerLane(const Step& step);
+		void Transcendental(const Step& step);
+		void Modulo(const Step& step);
+		void Derivative(const Step& step);
+		Value Dot(const float* a, const float* b, unsigned int size) const;
+
+		// the componentwise ops, the way CpuShaderMath defines them.
+		static Value One() { return Simd::Splat(1.0f); }
+		static Mask IsTrue(Value a) { return Simd::NotEqual(a, Simd::Zero()); }
+		static Value Float(Mask m) { return Simd::Select(m, One(), Simd::Zero()); }
+		static Value Min(Value a, Value b) { return Simd::Min(a, b); }
+		static Value Max(Value a, Value b) { return Simd::Max(a, b); }
+		static Value And(Value a, Value b) { return Float(Simd::And(IsTrue(a), IsTrue(b))); }
+		static Value Or(Value a, Value b) { return Float(Simd::Or(IsTrue(a), IsTrue(b))); }
+		static Value Not(Value a) { return Float(Simd::Equal(a, Simd::Zero())); }
+		static Value ToBool(Value a) { return Float(IsTrue(a)); }
+		static Value IntDivide(Value a, Value b) { return Simd::Select(IsTrue(b), Simd::Truncate(Simd::Divide(a, b)), Simd::Zero()); }
+		static Value Clamp(Value x, Value lo, Value hi) { return Min(Max(x, lo), hi); }
+		static Value Degrees(Value x) { return Simd::Multiply(x, Simd::Splat(57.295779513082321f)); }
+		static Value Radians(Value x) { return Simd::Multiply(x, Simd::Splat(0.017453292519943295f)); }
+		static Value Frac(Value x) { return Simd::Subtract(x, Simd::Floor(x)); }
+		static Value IsInf(Value x) { return Float(Simd::And(Simd::Equal(x, x), Simd::NotEqual(Simd::Subtract(x, x), Simd::Zero()))); }
+		static Value IsNan(Value x) { return Float(Simd::NotEqual(x, x)); }
+		static Value Lerp(Value a, Value b, Value t) { return Simd::Add(a, Simd::Multiply(Simd::Subtract(b, a), t)); }
+		static Value Round(Value x) { return Simd::Floor(Simd::Add(x, Simd::Splat(0.5f))); }
+		static Value Rsqrt(Value x) { return Simd::Divide(One(), Simd::Sqrt(x)); }
+		static Value StepAt(Value edge, Value x) { return Float(Simd::GreaterEqual(x, edge)); }
+
+		static Value Saturate(Value x)
+		{
+			return Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Zero(), Simd::Select(Simd::Greater(x, One()), One(), x));
+		}
+
+		static Value Sign(Value x)
+		{
+			Value negative = Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Splat(-1.0f), Simd::Zero());
+			return Simd::Select(Simd::Greater(x, Simd::Zero()), One(), negative);
+		}
+
+		static Value Smoothstep(Value lo, Value hi, Value x)
+		{
+			Value t = Saturate(Simd::Divide(Simd::Subtract(x, lo), Simd::Subtract(hi, lo)));
+			return Simd::Multiply(Simd::Multiply(t, t), Simd::Subtract(Simd::Splat(3.0f), Simd::Multiply(Simd::Splat(2.0f), t)));
+		}
+
+	private:
+		const CpuBytecode& m_bytecode;
+		std::vector<float> m_storage;
+		float* m_registers;				// the storage, aligned to a cache line
+		std::vector<Step> m_steps;
+		std::vector<Scope> m_scopes;
+		std::vector<const CpuTexture*> m_textures;
+		unsigned int m_lanes;			// those running
+		bool m_is_full;
+		unsigned int m_discarded;
+		size_t m_num_cut_off_loops;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// constructor / destructor
+	//////////////////////////////////////////////////////////////////////////
+	template <typename Simd>
+	SimdKernel<Simd>::SimdKernel(const CpuBytecode& bytecode)
+		: m_bytecode(bytecode)
+		, m_storage(bytecode.registers.size() * 4 * width + 16, 0.0f)
+		, m_textures(bytecode.num_textures, static_cast<const CpuTexture*>(NULL))
+		, m_lanes(0)
+		, m_is_full(false)
+		, m_discarded(0)
+		, m_num_cut_off_loops(0)
+	{
+		size_t misalignment = reinterpret_cast<size_t>(&m_storage[0]) / sizeof(float) % 16;
+		m_registers = &m_storage[0] + (16 - misalignment) % 16;
+		for (size_t i = 0; i != bytecode.registers.size(); ++i)
+		{
+			const CpuBytecode::Register& reg = bytecode.registers[i];
+			if (reg.kind != CpuBytecode::RK_Constant) continue;
+			for (unsigned int j = 0; j != 4; ++j) std::fill_n(Register(i) + j * width, width, reg.value[j]);
+		}
+		m_scopes.reserve(16);
+		Decode();
+	}
+
+	template <typename Simd>
+	SimdKernel<Simd>::~SimdKernel()
+	{
+
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// public interfaces
+	//////////////////////////////////////////////////////////////////////////
+	template <typename Simd>
+	void SimdKernel<Simd>::SetConstants(const std::vector<float>& constants)
+	{
+		for (size_t i = 0; i != m_bytecode.registers.size(); ++i)
+		{
+			const CpuBytecode::Register& reg = m_bytecode.registers[i];
+			if (reg.kind != CpuBytecode::RK_Uniform) continue;
+			for (unsigned int j = 0; j != reg.type.size; ++j)
+			{
+				float value = reg.offset + j < constants.size() ? constants[reg.offset + j] : 0.0f;
+				std::fill_n(Register(i) + j * width, width, value);
+			}
+		}
+	}
+
+	template <typename Simd>
+	void SimdKernel<Simd>::SetTexture(size_t slot, const CpuTexture* texture)
+	{
+		if (slot < m_textures.size()) m_textures[slot] = texture;
+	}
+
+	template <typename Simd>
+	unsigned int SimdKernel<Simd>::Run(const float* inputs, unsigned int lanes, float* outputs)
+	{
+		// the inputs come a pixel after the other, the registers want them a
+		// component after the other.
+		size_t num_inputs = m_bytecode.inputs.size();
+		for (size_t i = 0; i != num_inputs; ++i)
+		{
+			if (m_bytecode.inputs[i] == CpuBytecode::no_register) continue;
+			float* reg = Register(m_bytecode.inputs[i]);
+			for (unsigned int j = 0; j != 4; ++j)
+			{
+				for (unsigned int lane = 0; lane != width; ++lane) reg[j * width + lane] = inputs[(lane * num_inputs + i) * 4 + j];
+			}
+		}
+
+		lanes &= all_lanes;
+		m_discarded = 0;
+		m_scopes.clear();
+		SetLanes(lanes);
+		if (lanes != 0) Execute();
+
+		unsigned int kept = lanes & ~m_discarded;
+		const float* color = Register(m_bytecode.output);
+		for (unsigned int rest = kept; rest != 0; rest &= rest - 1)
+		{
+			unsigned int lane = LowestLane(rest);
+			for (unsigned int j = 0; j != 4; ++j) outputs[lane * 4 + j] = j < m_bytecode.output_size ? color[j * width + lane] : 0.0f;
+		}
+		return kept;
+	}
+
+	template <typename Simd>
+	size_t SimdKernel<Simd>::GetNumCutOffLoops() const
+	{
+		return m_num_cut_off_loops;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// private subroutines
+	//////////////////////////////////////////////////////////////////////////
+	template <typename Simd>
+	void SimdKernel<Simd>::Execute()
+	{
+		size_t at = 0;
+		for (;;)
+		{
+			const Step& step = m_steps[at];
+			float* d = step.dest;
+			const float* a = step.args[0];
+			const float* b = step.args[1];
+			const float* c = step.args[2];
+			switch (step.opcode)
+			{
+			case CpuBytecode::OC_Move:
+				for (unsigned int i = 0; i != step.size; ++i) Write(d + i * width, Simd::Load(a + i * width));
+				break;
+
+			case CpuBytecode::OC_Swizzle:
+			case CpuBytecode::OC_Scatter:
+				{
+					// the source may be the destination, so it is read first.
+					bool is_swizzle = step.opcode == CpuBytecode::OC_Swizzle;
+					Value x[4];
+					for (unsigned int i = 0; i != step.size; ++i) x[i] = Simd::Load(a + (is_swizzle ? step.components[i] : i) * width);
+					for (unsigned int i = 0; i != step.size; ++i) Write(d + (is_swizzle ? i : step.components[i]) * width, x[i]);
+				}
+				break;
+
+			case CpuBytecode::OC_FloatToInt: Unary<&Simd::Truncate>(step); break;
+			case CpuBytecode::OC_ToBool: Unary<&ToBool>(step); break;
+
+			case CpuBytecode::OC_Add: Binary<&Simd::Add>(step); break;
+			case CpuBytecode::OC_Subtract: Binary<&Simd::Subtract>(step); break;
+			case CpuBytecode::OC_Multiply: Binary<&Simd::Multiply>(step); break;
+			case CpuBytecode::OC_Divide: Binary<&Simd::Divide>(step); break;
+			case CpuBytecode::OC_Modulo: Modulo(step); break;
+			case CpuBytecode::OC_IntDivide: Binary<&IntDivide>(step); break;
+			case CpuBytecode::OC_IntModulo: Modulo(step); break;
+			case CpuBytecode::OC_Negate: Unary<&Simd::Negate>(step); break;
+			case CpuBytecode::OC_Less: Compare<&Simd::Less>(step); break;
+			case CpuBytecode::OC_LessEqual: Compare<&Simd::LessEqual>(step); break;
+			case CpuBytecode::OC_Greater: Compare<&Simd::Greater>(step); break;
+			case CpuBytecode::OC_GreaterEqual: Compare<&Simd::GreaterEqual>(step); break;
+			case CpuBytecode::OC_Equal: Compare<&Simd::Equal>(step); break;
+			case CpuBytecode::OC_NotEqual: Compare<&Simd::NotEqual>(step); break;
+			case CpuBytecode::OC_And: Binary<&And>(step); break;
+			case CpuBytecode::OC_Or: Binary<&Or>(step); break;
+			case CpuBytecode::OC_Not: Unary<&Not>(step); break;
+
+			case CpuBytecode::OC_Select:
+				{
+					Mask condition = IsTrue(Simd::Load(a));
+					for (unsigned int i = 0; i != step.size; ++i)
+					{
+						if ((step.flags & CpuBytecode::IF_ScalarCondition) == 0) condition = IsTrue(Simd::Load(a + i * width));
+						Write(d + i * width, Simd::Select(condition, Simd::Load(b + i * width), Simd::Load(c + i * width)));
+					}
+				}
+				break;
+
+			case CpuBytecode::OC_Abs: Unary<&Simd::Abs>(step); break;
+			case CpuBytecode::OC_Ceil: Unary<&Simd::Ceil>(step); break;
+			case CpuBytecode::OC_Clamp: Ternary<&Clamp>(step); break;
+			case CpuBytecode::OC_Degrees: Unary<&Degrees>(step); break;
+			case CpuBytecode::OC_Floor: Unary<&Simd::Floor>(step); break;
+			case CpuBytecode::OC_Fmod: Modulo(step); break;
+			case CpuBytecode::OC_Frac: Unary<&Frac>(step); break;
+			case CpuBytecode::OC_Isinf: Unary<&IsInf>(step); break;
+			case CpuBytecode::OC_Isnan: Unary<&IsNan>(step); break;
+			case CpuBytecode::OC_Lerp: Ternary<&Lerp>(step); break;
+			case CpuBytecode::OC_Max: Binary<&Max>(step); break;
+			case CpuBytecode::OC_Min: Binary<&Min>(step); break;
+			case CpuBytecode::OC_Radians: Unary<&Radians>(step); break;
+			case CpuBytecode::OC_Round: Unary<&Round>(step); break;
+			case CpuBytecode::OC_Rsqrt: Unary<&Rsqrt>(step); break;
+			case CpuBytecode::OC_Saturate: Unary<&Saturate>(step); break;
+			case CpuBytecode::OC_Sign: Unary<&Sign>(step); break;
+			case CpuBytecode::OC_Smoothstep: Ternary<&Smoothstep>(step); break;
+			case CpuBytecode::OC_Sqrt: Unary<&Simd::Sqrt>(step); break;
+			case CpuBytecode::OC_Step: Binary<&StepAt>(step); break;
+			case CpuBytecode::OC_Trunc: Unary<&Simd::Truncate>(step); break;
+
+			case CpuBytecode::OC_Acos:
+			case CpuBytecode::OC_Asin:
+			case CpuBytecode::OC_Atan:
+			case CpuBytecode::OC_Atan2:
+			case CpuBytecode::OC_Cos:
+			case CpuBytecode::OC_Exp:
+			case CpuBytecode::OC_Exp2:
+			case CpuBytecode::OC_Log:
+			case CpuBytecode::OC_Log10:
+			case CpuBytecode::OC_Log2:
+			case CpuBytecode::OC_Pow:
+			case CpuBytecode::OC_Sin:
+			case CpuBytecode::OC_Tan:
+				Transcendental(step);
+				break;
+
+			case CpuBytecode::OC_Ddx:
+			case CpuBytecode::OC_Ddy:
+			case CpuBytecode::OC_Fwidth:
+				Derivative(step);
+				break;
+
+			case CpuBytecode::OC_Dot:
+				Write(d, Dot(a, b, step.size));
+				break;
+
+			case CpuBytecode::OC_Length:
+				Write(d, Simd::Sqrt(Dot(a, a, step.size)));
+				break;
+
+			case CpuBytecode::OC_Distance:
+				{
+					Value sum = Simd::Zero();
+					for (unsigned int i = 0; i != step.size; ++i)
+					{
+						Value x = Simd::Subtract(Simd::Load(a + i * width), Simd::Load(b + i * width));
+						sum = Simd::Add(sum, Simd::Multiply(x, x));
+					}
+					Write(d, Simd::Sqrt(sum));
+				}
+				break;
+
+			case CpuBytecode::OC_Any:
+			case CpuBytecode::OC_All:
+				{
+					bool is_all = step.opcode == CpuBytecode::OC_All;
+					Mask result = IsTrue(Simd::Load(a));
+					for (unsigned int i = 1; i != step.size; ++i)
+					{
+						Mask x = IsTrue(Simd::Load(a + i * width));
+						result = is_all ? Simd::And(result, x) : Simd::Or(result, x);
+					}
+					Write(d, Float(result));
+				}
+				break;
+
+			case CpuBytecode::OC_Normalize:
+				{
+					Value scale = Simd::Divide(One(), Simd::Sqrt(Dot(a, a, step.size)));
+					for (unsigned int i = 0; i != step.size; ++i) Write(d + i * width, Simd::Multiply(Simd::Load(a + i * width), scale));
+				}
+				break;
+
+			case CpuBytecode::OC_Reflect:
+				{
+					Value twice = Simd::Multiply(Simd::Splat(2.0f), Dot(a, b, step.size));
+					for (unsigned int i = 0; i != step.size; ++i)
+					{
+						Write(d + i * width, Simd::Subtract(Simd::Load(a + i * width), Simd::Multiply(twice, Simd::Load(b + i * width))));
+					}
+				}
+				break;
+
+			case CpuBytecode::OC_Refract:
+				{
+					Value eta = Simd::Load(c);
+					Value dot = Dot(a, b, step.size);
+					Value k = Simd::Subtract(One(), Simd::Multiply(Simd::Multiply(eta, eta), Simd::Subtract(One(), Simd::Multiply(dot, dot))));
+					Mask is_total = Simd::Less(k, Simd::Zero());
+					Value scale = Simd::Add(Simd::Multiply(eta, dot), Simd::Sqrt(k));
+					for (unsigned int i = 0; i != step.size; ++i)
+					{
+						Value x = Simd::Subtract(Simd::Multiply(eta, Simd::Load(a + i * width)), Simd::Multiply(scale, Simd::Load(b + i * width)));
+						Write(d + i * width, Simd::Select(is_total, Simd::Zero(), x));
+					}
+				}
+				break;
+
+			case CpuBytecode::OC_Cross:
+				{
+					Value a0 = Simd::Load(a), a1 = Simd::Load(a + width), a2 = Simd::Load(a + 2 * width);
+					Value b0 = Simd::Load(b), b1 = Simd::Load(b + width), b2 = Simd::Load(b + 2 * width);
+					Value x = Simd::Subtract(Simd::Multiply(a1, b2), Simd::Multiply(a2, b1));
+					Value y = Simd::Subtract(Simd::Multiply(a2, b0), Simd::Multiply(a0, b2));
+					Value z = Simd::Subtract(Simd::Multiply(a0, b1), Simd::Multiply(a1, b0));
+					Write(d, x);
+					Write(d + width, y);
+					Write(d + 2 * width, z);
+				}
+				break;
+
+			case CpuBytecode::OC_Snoise:
+			case CpuBytecode::OC_Qnoise:
+			case CpuBytecode::OC_Hash:
+			case CpuBytecode::OC_Grad4:
+				{
+					Value result[4];
+					unsigned int num_written = Noise<Simd>(step.opcode, step.size, m_bytecode.precision, a, b, result);
+					for (unsigned int i = 0; i != num_written; ++i) Write(d + i * width, result[i]);
+				}
+				break;
+
+			case CpuBytecode::OC_Sample:
+				{
+					const CpuTexture* texture = step.target < m_textures.size() ? m_textures[step.target] : NULL;
+					Value color[4] = {Simd::Zero(), Simd::Zero(), Simd::Zero(), Simd::Zero()};
+					if (texture != NULL)
+					{
+						Value u = Simd::Load(a), v = Simd::Load(a + width);
+						Value level = (step.flags & CpuBytecode::IF_ImplicitLevel) != 0 ? SimdTexture<Simd>::ImplicitLevel(*texture, u, v) : Simd::Load(b);
+						SimdTexture<Simd>::Sample(*texture, m_lanes, u, v, level, color);
+					}
+					for (unsigned int i = 0; i != 4; ++i) Write(d + i * width, color[i]);
+				}
+				break;
+
+			// the lanes a branch turns off wait in the scope of the if, the
+			// loop or the call they are to come back at. when none are left
+			// running, Skip goes to where some may.
+			case CpuBytecode::OC_If:
+				{
+					unsigned int taken = m_lanes & Simd::GetLanes(IsTrue(Simd::Load(a)));
+					Scope scope = {SC_If, at, m_lanes & ~taken, 0};
+					m_scopes.push_back(scope);
+					SetLanes(taken);
+				}
+				break;
+
+			case CpuBytecode::OC_Else:
+				{
+					Scope& scope = m_scopes.back();
+					scope.done = m_lanes;
+					SetLanes(scope.waiting);
+					scope.waiting = 0;
+				}
+				break;
+
+			case CpuBytecode::OC_EndIf:
+				SetLanes(m_lanes | m_scopes.back().waiting | m_scopes.back().done);
+				m_scopes.pop_back();
+				break;
+
+			case CpuBytecode::OC_Loop:
+				{
+					Write(d, Simd::Zero());
+					Scope scope = {SC_Loop, at, 0, 0};
+					m_scopes.push_back(scope);
+				}
+				break;
+
+			case CpuBytecode::OC_Break:
+				Innermost(SC_Loop).done |= m_lanes;
+				SetLanes(0);
+				break;
+
+			case CpuBytecode::OC_BreakIfNot:
+				{
+					unsigned int staying = m_lanes & Simd::GetLanes(IsTrue(Simd::Load(a)));
+					Innermost(SC_Loop).done |= m_lanes & ~staying;
+					SetLanes(staying);
+				}
+				break;
+
+			case CpuBytecode::OC_Continue:
+				Innermost(SC_Loop).waiting |= m_lanes;
+				SetLanes(0);
+				break;
+
+			case CpuBytecode::OC_ContinuePoint:
+				SetLanes(m_lanes | m_scopes.back().waiting);
+				m_scopes.back().waiting = 0;
+				break;
+
+			case CpuBytecode::OC_EndLoop:
+				{
+					Value count = Simd::Add(Simd::Load(d), One());
+					Write(d, count);
+					unsigned int cut_off = m_lanes & Simd::GetLanes(Simd::GreaterEqual(count, Simd::Splat(static_cast<float>(CpuShaderInterpreter::max_loop_iterations))));
+					m_num_cut_off_loops += CountLanes(cut_off);
+
+					Scope& scope = m_scopes.back();
+					scope.done |= cut_off;
+					SetLanes(m_lanes & ~cut_off);
+					if (m_lanes != 0)
+					{
+						at = step.target + 1;
+						continue;
+					}
+					SetLanes(scope.done);
+					m_scopes.pop_back();
+				}
+				break;
+
+			case CpuBytecode::OC_BeginCall:
+				{
+					Scope scope = {SC_Call, at, 0, 0};
+					m_scopes.push_back(scope);
+				}
+				break;
+
+			case CpuBytecode::OC_Return:
+				Innermost(SC_Call).waiting |= m_lanes;
+				SetLanes(0);
+				break;
+
+			case CpuBytecode::OC_EndCall:
+				SetLanes(m_lanes | m_scopes.back().waiting);
+				m_scopes.pop_back();
+				break;
+
+			// with derivatives a discarded lane runs on as a helper, as on a
+			// gpu, so that its quad still has its values to difference with.
+			// Run leaves its output alone either way.
+			case CpuBytecode::OC_Discard:
+				m_discarded |= m_lanes;
+				if (!m_bytecode.uses_derivatives) SetLanes(0);
+				break;
+
+			case CpuBytecode::OC_End:
+				return;
+
+			default:
+				PerLane(step);
+				break;
+			}
+
+			at = m_lanes != 0 ? at + 1 : Skip(at);
+		}
+	}
+
+	// where the lanes turned off may be turned back on, going on from at
+	// with none running.
+	template <typename Simd>
+	size_t SimdKernel<Simd>::Skip(size_t at) const
+	{
+		if (m_scopes.empty()) return m_steps.size() - 1;
+
+		const Scope& scope = m_scopes.back();
+		const Step& begin = m_steps[scope.begin];
+		if (scope.kind == SC_If)
+		{
+			// the else if still ahead, or the endif.
+			const Step& next = m_steps[begin.target];
+			if (next.opcode != CpuBytecode::OC_Else) return begin.target;
+			return at < begin.target ? begin.target : next.target;
+		}
+		if (scope.kind == SC_Loop && scope.waiting != 0 && at < begin.continue_point) return begin.continue_point;
+		return begin.target;
+	}
+
+	template <typename Simd>
+	typename SimdKernel<Simd>::Scope& SimdKernel<Simd>::Innermost(ScopeKind kind)
+	{
+		size_t i = m_scopes.size() - 1;
+		while (m_scopes[i].kind != kind) --i;
+		return m_scopes[i];
+	}
+
+	template <typename Simd>
+	void SimdKernel<Simd>::Decode()
+	{
+		const std::vector<CpuBytecode::Instruction>& code = m_bytecode.code;
+		m_steps.resize(code.size());
+		std::vector<size_t> loops;
+		for (size_t i = 0; i != code.size(); ++i)
+		{
+			const CpuBytecode::Instruction& ins = code[i];
+			CpuBytecode::Opcode opcode = static_cast<CpuBytecode::Opcode>(ins.opcode);
+			Step& step = m_steps[i];
+			step.opcode = opcode;
+			step.size = ins.size;
+			step.flags = ins.flags;
+			for (unsigned int j = 0; j != 4; ++j) step.components[j] = CpuBytecode::GetSwizzleComponent(ins.swizzle, j);
+			step.dest = CpuBytecode::WritesDest(opcode) ? Register(ins.dest) : NULL;
+			for (unsigned int j = 0; j != 3; ++j) step.args[j] = j < CpuBytecode::GetNumArgs(opcode) ? Register(ins.args[j]) : NULL;
+			step.target = ins.target;
+			step.continue_point = 0;
+
+			if (opcode == CpuBytecode::OC_Loop) loops.push_back(i);
+			else if (opcode == CpuBytecode::OC_ContinuePoint) m_steps[loops.back()].continue_point = i;
+			else if (opcode == CpuBytecode::OC_EndLoop) loops.pop_back();
+		}
+	}
+
+	template <typename Simd>
+	float* SimdKernel<Simd>::Register(unsigned int index)
+	{
+		return m_registers + index * 4 * width;
+	}
+
+	template <typename Simd>
+	void SimdKernel<Simd>::SetLanes(unsigned int lanes)
+	{
+		m_lanes = lanes;
+		m_is_full = lanes == all_lanes;
+	}
+
+	// the lanes not running keep what they had.
+	template <typename Simd>
+	void SimdKernel<Simd>::Write(float* dest, Value value) const
+	{
+		if (m_is_full) Simd::Store(dest, value);
+		else Simd::Store(dest, Simd::Select(Simd::FromLanes(m_lanes), value, Simd::Load(dest)));
+	}
+
+	// the lanes not running are not computed, which saves the calls a
+	// branch turned off.
+	template <typename Simd>
+	void SimdKernel<Simd>::PerLane(const Step& step)
+	{
+		CpuBytecode::Opcode opcode = static_cast<CpuBytecode::Opcode>(step.opcode);
+		const float* b = CpuBytecode::GetNumArgs(opcode) == 2 ? step.args[1] : step.args[0];
+		for (unsigned int i = 0; i != step.size; ++i)
+		{
+			const float* x = step.args[0] + i * width;
+			const float* y = b + i * width;
+			float result[width];
+			std::fill_n(result, width, 0.0f);
+			for (unsigned int rest = m_lanes; rest != 0; rest &= rest - 1)
+			{
+				unsigned int lane = LowestLane(rest);
+				result[lane] = LaneOp(opcode, step.flags, x[lane], y[lane]);
+			}
+			Write(step.dest + i * width, Simd::Load(result));
+		}
+	}
+
+	template <typename Simd>
+	void SimdKernel<Simd>::Transcendental(const Step& step)
+	{
+		if (m_bytecode.precision == CpuShaderMath::PR_Libm)
+		{
+			PerLane(step);
+			return;
+		}
+
+		const float* b = CpuBytecode::GetNumArgs(static_cast<CpuBytecode::Opcode>(step.opcode)) == 2 ? step.args[1] : step.args[0];
+		for (unsigned int i = 0; i != step.size; ++i)
+		{
+			Value x = Simd::Load(step.args[0] + i * width);
+			Write(step.dest + i * width, Approximate<Simd>(step.opcode, m_bytecode.precision, x, Simd::Load(b + i * width)));
+		}
+	}
+
+	// the lanes of a quad are 0 1 over 2 3, as the renderer lays pixels out.
+	// both pixels of a row take its difference, and both of a column take
+	// the column's, the fine derivatives of a gpu.
+	template <typename Simd>
+	void SimdKernel<Simd>::Derivative(const Step& step)
+	{
+		for (unsigned int i = 0; i != step.size; ++i)
+		{
+			const float* a = step.args[0] + i * width;
+			float dx[width], dy[width];
+			for (unsigned int lane = 0; lane != width; ++lane)
+			{
+				dx[lane] = a[lane | 1] - a[lane & ~1u];
+				dy[lane] = a[lane | 2] - a[lane & ~2u];
+			}
+
+			Value result;
+			if (step.opcode == CpuBytecode::OC_Ddx) result = Simd::Load(dx);
+			else if (step.opcode == CpuBytecode::OC_Ddy) result = Simd::Load(dy);
+			else result = Simd::Add(Simd::Abs(Simd::Load(dx)), Simd::Abs(Simd::Load(dy)));
+			Write(step.dest + i * width, result);
+		}
+	}
+
+	// fmod is exact, so the remainder Simd works out in doubles has the bits
+	// of libm's, while the quotient is below 2^29. up to 2^53 the remainder
+	// of y * 2^24 is taken first, which leaves the one of y as it was. the
+	// lanes past that, or dividing by zero or an infinity, go to libm.
+	template <typename Simd>
+	void SimdKernel<Simd>::Modulo(const Step& step)
+	{
+		bool is_int = step.opcode == CpuBytecode::OC_IntModulo;
+		if (!is_int && m_bytecode.precision == CpuShaderMath::PR_Fast)
+		{
+			Binary<&SimdMath<Simd>::FastModulo>(step);
+			return;
+		}
+
+		for (unsigned int i = 0; i != step.size; ++i)
+		{
+			const float* x = step.args[0] + i * width;
+			const float* y = step.args[1] + i * width;
+			Value a = Simd::Load(x), b = Simd::Load(y);
+			Value quotient = Simd::Abs(Simd::Divide(a, b));
+			Mask is_exact = Simd::And(Simd::Less(quotient, Simd::Splat(9007199254740992.0f)),
+				Simd::Less(Simd::Abs(b), Simd::Splat(std::numeric_limits<float>::infinity())));
+			unsigned int is_large = m_lanes & ~Simd::GetLanes(Simd::Less(quotient, Simd::Splat(536870912.0f)));
+			if (is_large != 0) a = Simd::Select(Simd::FromLanes(is_large), Simd::Modulo(a, Simd::Multiply(b, Simd::Splat(16777216.0f))), a);
+			Value result = Simd::Modulo(a, b);
+
+			unsigned int rest = m_lanes & ~Simd::GetLanes(is_exact);
+			if (rest != 0)
+			{
+				float values[width];
+				Simd::Store(values, result);
+				for (; rest != 0; rest &= rest - 1)
+				{
+					unsigned int lane = LowestLane(rest);
+					values[lane] = is_int ? CpuShaderMath::IntModulo(x[lane], y[lane]) : std::fmod(x[lane], y[lane]);
+				}
+				result = Simd::Load(values);
+			}
+			Write(step.dest + i * width, result);
+		}
+	}
+
+	template <typename Simd>
+	typename SimdKernel<Simd>::Value SimdKernel<Simd>::Dot(const float* a, const float* b, unsigned int size) const
+	{
+		Value sum = Simd::Zero();
+		for (unsigned int i = 0; i != size; ++i) sum = Simd::Add(sum, Simd::Multiply(Simd::Load(a + i * width), Simd::Load(b + i * width)));
+		return sum;
+	}
+}
+
+#endif  // _CPU_SIMD_KERNEL_HPP_INCLUDED_
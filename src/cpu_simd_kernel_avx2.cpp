@@ -0,0 +1,125 @@
+#include "common.hpp"
+#include "cpu_simd_vm.hpp"
+#include "cpu_bytecode.hpp"
+#include "cpu_shader_interpreter.hpp"
+#include "cpu_shader_math.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// gcc compiles the kernel alone for avx2, the rest of the program runs
+// anywhere. visual c++ takes the intrinsics without a switch.
+#if defined(__AVX2__) || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#define CPU_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__GNUC__) && !defined(__clang__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CPU_SIMD_AVX2
+#include <immintrin.h>
+#pragma GCC target("avx2")
+#endif
+
+#ifdef CPU_SIMD_AVX2
+
+namespace
+{
+	// eight lanes.
+	struct Avx2
+	{
+		enum { width = 8 };
+		typedef __m256 Value;
+		typedef __m256 Mask;
+
+		static Value Load(const float* p) { return _mm256_loadu_ps(p); }
+		static void Store(float* p, Value a) { _mm256_storeu_ps(p, a); }
+		static Value Splat(float a) { return _mm256_set1_ps(a); }
+		static Value Zero() { return _mm256_setzero_ps(); }
+
+		static Value Add(Value a, Value b) { return _mm256_add_ps(a, b); }
+		static Value Subtract(Value a, Value b) { return _mm256_sub_ps(a, b); }
+		static Value Multiply(Value a, Value b) { return _mm256_mul_ps(a, b); }
+		static Value Divide(Value a, Value b) { return _mm256_div_ps(a, b); }
+		static Value Sqrt(Value a) { return _mm256_sqrt_ps(a); }
+		static Value Min(Value a, Value b) { return _mm256_min_ps(b, a); }
+		static Value Max(Value a, Value b) { return _mm256_max_ps(b, a); }
+		static Value Abs(Value a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static Value Negate(Value a) { return _mm256_xor_ps(_mm256_set1_ps(-0.0f), a); }
+		static Value Truncate(Value a) { return _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+		static Value Floor(Value a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+		static Value Ceil(Value a) { return _mm256_round_ps(a, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+
+		static Value Pow2(Value n)
+		{
+			return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23));
+		}
+
+		static Value Exponent(Value a)
+		{
+			return _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(a), 23), _mm256_set1_epi32(127)));
+		}
+
+		static Value Mantissa(Value a)
+		{
+			return _mm256_or_ps(_mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x007fffff))), _mm256_set1_ps(1.0f));
+		}
+
+		// exact while the quotient is below 2^29, which the kernel sees to.
+		static Value Modulo(Value a, Value b)
+		{
+			__m256d a0 = _mm256_cvtps_pd(_mm256_castps256_ps128(a)), a1 = _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1));
+			__m256d b0 = _mm256_cvtps_pd(_mm256_castps256_ps128(b)), b1 = _mm256_cvtps_pd(_mm256_extractf128_ps(b, 1));
+			__m256d q0 = _mm256_round_pd(_mm256_div_pd(a0, b0), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+			__m256d q1 = _mm256_round_pd(_mm256_div_pd(a1, b1), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+			__m128 r0 = _mm256_cvtpd_ps(_mm256_sub_pd(a0, _mm256_mul_pd(q0, b0)));
+			__m128 r1 = _mm256_cvtpd_ps(_mm256_sub_pd(a1, _mm256_mul_pd(q1, b1)));
+			Value r = _mm256_insertf128_ps(_mm256_castps128_ps256(r0), r1, 1);
+			return _mm256_or_ps(Abs(r), _mm256_and_ps(_mm256_set1_ps(-0.0f), a));
+		}
+
+		static Mask Less(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static Mask LessEqual(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static Mask Greater(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		static Mask GreaterEqual(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static Mask Equal(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+		static Mask NotEqual(Value a, Value b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+		static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+		static Mask Or(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+		static Value Select(Mask m, Value a, Value b) { return _mm256_blendv_ps(b, a, m); }
+
+		static unsigned int GetLanes(Mask m) { return static_cast<unsigned int>(_mm256_movemask_ps(m)); }
+
+		static Mask FromLanes(unsigned int lanes)
+		{
+			__m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+			return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(lanes), bits), bits));
+		}
+
+		static void GatherTexels(const float* base, Value index, Value texel[4])
+		{
+			__m256i offsets = _mm256_slli_epi32(_mm256_cvttps_epi32(index), 2);
+			for (int i = 0; i != 4; ++i) texel[i] = _mm256_i32gather_ps(base + i, offsets, 4);
+		}
+	};
+}
+
+#include "cpu_simd_kernel.hpp"
+
+static CpuSimdVm::Kernel* CreateAvx2Kernel(const CpuBytecode& bytecode)
+{
+	return new SimdKernel<Avx2>(bytecode);
+}
+
+extern const CpuSimdVm::KernelFactory create_avx2_kernel = CreateAvx2Kernel;
+extern const CpuSimdVm::MathFunction run_avx2_math = RunMath<Avx2>;
+extern const CpuSimdVm::NoiseFunction run_avx2_noise = RunNoise<Avx2>;
+extern const CpuSimdVm::SampleFunction run_avx2_sample = RunSample<Avx2>;
+
+#else
+
+extern const CpuSimdVm::KernelFactory create_avx2_kernel = NULL;
+extern const CpuSimdVm::MathFunction run_avx2_math = NULL;
+extern const CpuSimdVm::NoiseFunction run_avx2_noise = NULL;
+extern const CpuSimdVm::SampleFunction run_avx2_sample = NULL;
+
+#endif
@@ -0,0 +1,132 @@
+#include "common.hpp"
+#include "cpu_simd_vm.hpp"
+#include "cpu_bytecode.hpp"
+#include "cpu_shader_interpreter.hpp"
+#include "cpu_shader_math.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// gcc compiles the kernel alone for avx-512, the rest of the program runs
+// anywhere. visual c++ takes the intrinsics without a switch.
+#if defined(__AVX512F__) || (defined(_MSC_VER) && _MSC_VER >= 1910)
+#define CPU_SIMD_AVX512
+#include <immintrin.h>
+#elif defined(__GNUC__) && !defined(__clang__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CPU_SIMD_AVX512
+#include <immintrin.h>
+#pragma GCC target("avx512f")
+#endif
+
+// the intrinsics start from an undefined vector, which gcc 12 takes for an
+// uninitialized one.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+
+#ifdef CPU_SIMD_AVX512
+
+namespace
+{
+	// sixteen lanes, with the mask in a mask register. only the foundation
+	// instructions are used, so the float bit ops go through the integers.
+	struct Avx512
+	{
+		enum { width = 16 };
+		typedef __m512 Value;
+		typedef __mmask16 Mask;
+
+		static Value Load(const float* p) { return _mm512_loadu_ps(p); }
+		static void Store(float* p, Value a) { _mm512_storeu_ps(p, a); }
+		static Value Splat(float a) { return _mm512_set1_ps(a); }
+		static Value Zero() { return _mm512_setzero_ps(); }
+
+		static Value Add(Value a, Value b) { return _mm512_add_ps(a, b); }
+		static Value Subtract(Value a, Value b) { return _mm512_sub_ps(a, b); }
+		static Value Multiply(Value a, Value b) { return _mm512_mul_ps(a, b); }
+		static Value Divide(Value a, Value b) { return _mm512_div_ps(a, b); }
+		static Value Sqrt(Value a) { return _mm512_sqrt_ps(a); }
+		static Value Min(Value a, Value b) { return _mm512_min_ps(b, a); }
+		static Value Max(Value a, Value b) { return _mm512_max_ps(b, a); }
+		static Value Abs(Value a) { return _mm512_abs_ps(a); }
+		static Value Negate(Value a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000))); }
+		static Value Truncate(Value a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+		static Value Floor(Value a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+		static Value Ceil(Value a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+
+		static Value Pow2(Value n)
+		{
+			return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvttps_epi32(n), _mm512_set1_epi32(127)), 23));
+		}
+
+		static Value Exponent(Value a)
+		{
+			return _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(_mm512_castps_si512(a), 23), _mm512_set1_epi32(127)));
+		}
+
+		static Value Mantissa(Value a)
+		{
+			__m512i bits = _mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x007fffff));
+			return _mm512_castsi512_ps(_mm512_or_si512(bits, _mm512_set1_epi32(0x3f800000)));
+		}
+
+		// exact while the quotient is below 2^29, which the kernel sees to.
+		static Value Modulo(Value a, Value b)
+		{
+			__m512d a0 = _mm512_cvtps_pd(_mm512_castps512_ps256(a)), a1 = _mm512_cvtps_pd(High(a));
+			__m512d b0 = _mm512_cvtps_pd(_mm512_castps512_ps256(b)), b1 = _mm512_cvtps_pd(High(b));
+			__m512d q0 = _mm512_roundscale_pd(_mm512_div_pd(a0, b0), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+			__m512d q1 = _mm512_roundscale_pd(_mm512_div_pd(a1, b1), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+			__m256 r0 = _mm512_cvtpd_ps(_mm512_sub_pd(a0, _mm512_mul_pd(q0, b0)));
+			__m256 r1 = _mm512_cvtpd_ps(_mm512_sub_pd(a1, _mm512_mul_pd(q1, b1)));
+			__m512d r = _mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_castps_pd(r0)), _mm256_castps_pd(r1), 1);
+			return Or(Abs(_mm512_castpd_ps(r)), _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000))));
+		}
+
+		static __m256 High(Value a) { return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1)); }
+		static Value Or(Value a, Value b) { return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(a), _mm512_castps_si512(b))); }
+
+		static Mask Less(Value a, Value b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+		static Mask LessEqual(Value a, Value b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+		static Mask Greater(Value a, Value b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+		static Mask GreaterEqual(Value a, Value b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+		static Mask Equal(Value a, Value b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+		static Mask NotEqual(Value a, Value b) { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ); }
+		static Mask And(Mask a, Mask b) { return static_cast<Mask>(a & b); }
+		static Mask Or(Mask a, Mask b) { return static_cast<Mask>(a | b); }
+		static Value Select(Mask m, Value a, Value b) { return _mm512_mask_blend_ps(m, b, a); }
+
+		static unsigned int GetLanes(Mask m) { return m; }
+		static Mask FromLanes(unsigned int lanes) { return static_cast<Mask>(lanes); }
+
+		static void GatherTexels(const float* base, Value index, Value texel[4])
+		{
+			__m512i offsets = _mm512_slli_epi32(_mm512_cvttps_epi32(index), 2);
+			for (int i = 0; i != 4; ++i) texel[i] = _mm512_i32gather_ps(offsets, base + i, 4);
+		}
+	};
+}
+
+#include "cpu_simd_kernel.hpp"
+
+static CpuSimdVm::Kernel* CreateAvx512Kernel(const CpuBytecode& bytecode)
+{
+	return new SimdKernel<Avx512>(bytecode);
+}
+
+extern const CpuSimdVm::KernelFactory create_avx512_kernel = CreateAvx512Kernel;
+extern const CpuSimdVm::MathFunction run_avx512_math = RunMath<Avx512>;
+extern const CpuSimdVm::NoiseFunction run_avx512_noise = RunNoise<Avx512>;
+extern const CpuSimdVm::SampleFunction run_avx512_sample = RunSample<Avx512>;
+
+#else
+
+extern const CpuSimdVm::KernelFactory create_avx512_kernel = NULL;
+extern const CpuSimdVm::MathFunction run_avx512_math = NULL;
+extern const CpuSimdVm::NoiseFunction run_avx512_noise = NULL;
+extern const CpuSimdVm::SampleFunction run_avx512_sample = NULL;
+
+#endif
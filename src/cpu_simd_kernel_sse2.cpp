@@ -0,0 +1,140 @@
+#include "common.hpp"
+#include "cpu_simd_vm.hpp"
+#include "cpu_bytecode.hpp"
+#include "cpu_shader_interpreter.hpp"
+#include "cpu_shader_math.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef CPU_SIMD_SSE2
+
+namespace
+{
+	// four lanes. sse2 can not round, so Truncate goes through the integers,
+	// which hold every float below 2^23 that has a fraction.
+	struct Sse2
+	{
+		enum { width = 4 };
+		typedef __m128 Value;
+		typedef __m128 Mask;
+
+		static Value Load(const float* p) { return _mm_loadu_ps(p); }
+		static void Store(float* p, Value a) { _mm_storeu_ps(p, a); }
+		static Value Splat(float a) { return _mm_set1_ps(a); }
+		static Value Zero() { return _mm_setzero_ps(); }
+
+		static Value Add(Value a, Value b) { return _mm_add_ps(a, b); }
+		static Value Subtract(Value a, Value b) { return _mm_sub_ps(a, b); }
+		static Value Multiply(Value a, Value b) { return _mm_mul_ps(a, b); }
+		static Value Divide(Value a, Value b) { return _mm_div_ps(a, b); }
+		static Value Sqrt(Value a) { return _mm_sqrt_ps(a); }
+		static Value Min(Value a, Value b) { return _mm_min_ps(b, a); }
+		static Value Max(Value a, Value b) { return _mm_max_ps(b, a); }
+		static Value Abs(Value a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		static Value Negate(Value a) { return _mm_xor_ps(_mm_set1_ps(-0.0f), a); }
+
+		static Value Truncate(Value a)
+		{
+			Value whole = _mm_or_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(a)), _mm_and_ps(_mm_set1_ps(-0.0f), a));
+			return Select(Less(Abs(a), _mm_set1_ps(8388608.0f)), whole, a);
+		}
+
+		static Value Floor(Value a)
+		{
+			Value whole = Truncate(a);
+			return Select(Greater(whole, a), _mm_sub_ps(whole, _mm_set1_ps(1.0f)), whole);
+		}
+
+		static Value Ceil(Value a)
+		{
+			Value whole = Truncate(a);
+			return Select(Less(whole, a), _mm_add_ps(whole, _mm_set1_ps(1.0f)), whole);
+		}
+
+		static Value Pow2(Value n)
+		{
+			return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23));
+		}
+
+		static Value Exponent(Value a)
+		{
+			return _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(a), 23), _mm_set1_epi32(127)));
+		}
+
+		static Value Mantissa(Value a)
+		{
+			return _mm_or_ps(_mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x007fffff))), _mm_set1_ps(1.0f));
+		}
+
+		// exact while the quotient is below 2^29, which the kernel sees to.
+		static Value Modulo(Value a, Value b)
+		{
+			__m128d a0 = _mm_cvtps_pd(a), a1 = _mm_cvtps_pd(_mm_movehl_ps(a, a));
+			__m128d b0 = _mm_cvtps_pd(b), b1 = _mm_cvtps_pd(_mm_movehl_ps(b, b));
+			__m128d q0 = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(a0, b0)));
+			__m128d q1 = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(a1, b1)));
+			__m128 r0 = _mm_cvtpd_ps(_mm_sub_pd(a0, _mm_mul_pd(q0, b0)));
+			__m128 r1 = _mm_cvtpd_ps(_mm_sub_pd(a1, _mm_mul_pd(q1, b1)));
+			return _mm_or_ps(Abs(_mm_movelh_ps(r0, r1)), _mm_and_ps(_mm_set1_ps(-0.0f), a));
+		}
+
+		static Mask Less(Value a, Value b) { return _mm_cmplt_ps(a, b); }
+		static Mask LessEqual(Value a, Value b) { return _mm_cmple_ps(a, b); }
+		static Mask Greater(Value a, Value b) { return _mm_cmpgt_ps(a, b); }
+		static Mask GreaterEqual(Value a, Value b) { return _mm_cmpge_ps(a, b); }
+		static Mask Equal(Value a, Value b) { return _mm_cmpeq_ps(a, b); }
+		static Mask NotEqual(Value a, Value b) { return _mm_cmpneq_ps(a, b); }
+		static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+		static Mask Or(Mask a, Mask b) { return _mm_or_ps(a, b); }
+		static Value Select(Mask m, Value a, Value b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+		static unsigned int GetLanes(Mask m) { return static_cast<unsigned int>(_mm_movemask_ps(m)); }
+
+		static Mask FromLanes(unsigned int lanes)
+		{
+			__m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+			return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(lanes), bits), bits));
+		}
+
+		// the four floats at base + 4 * index of each lane, a channel a value.
+		// the indices are whole, and a texel each lane may read.
+		static void GatherTexels(const float* base, Value index, Value texel[4])
+		{
+			__m128i i = _mm_cvttps_epi32(index);
+			texel[0] = _mm_loadu_ps(base + 4 * _mm_cvtsi128_si32(i));
+			texel[1] = _mm_loadu_ps(base + 4 * _mm_cvtsi128_si32(_mm_shuffle_epi32(i, 0x55)));
+			texel[2] = _mm_loadu_ps(base + 4 * _mm_cvtsi128_si32(_mm_shuffle_epi32(i, 0xAA)));
+			texel[3] = _mm_loadu_ps(base + 4 * _mm_cvtsi128_si32(_mm_shuffle_epi32(i, 0xFF)));
+			_MM_TRANSPOSE4_PS(texel[0], texel[1], texel[2], texel[3]);
+		}
+	};
+}
+
+#include "cpu_simd_kernel.hpp"
+
+static CpuSimdVm::Kernel* CreateSse2Kernel(const CpuBytecode& bytecode)
+{
+	return new SimdKernel<Sse2>(bytecode);
+}
+
+extern const CpuSimdVm::KernelFactory create_sse2_kernel = CreateSse2Kernel;
+extern const CpuSimdVm::MathFunction run_sse2_math = RunMath<Sse2>;
+extern const CpuSimdVm::NoiseFunction run_sse2_noise = RunNoise<Sse2>;
+extern const CpuSimdVm::SampleFunction run_sse2_sample = RunSample<Sse2>;
+
+#else
+
+extern const CpuSimdVm::KernelFactory create_sse2_kernel = NULL;
+extern const CpuSimdVm::MathFunction run_sse2_math = NULL;
+extern const CpuSimdVm::NoiseFunction run_sse2_noise = NULL;
+extern const CpuSimdVm::SampleFunction run_sse2_sample = NULL;
+
+#endif
@@ -0,0 +1,457 @@
+#ifndef _CPU_SIMD_MATH_HPP_INCLUDED_
+#define _CPU_SIMD_MATH_HPP_INCLUDED_
+
+#include <cmath>
+#include <limits>
+
+// polynomial approximations of the transcendental intrinsics, written once
+// over the Simd of the kernel, which for these also has Pow2, Exponent and
+// Mantissa on the bits of a float. the scalar engines run them on a Simd of
+// one lane, and as nothing is fused or reordered every engine gets the same
+// bits. like the kernel, a translation unit includes this only after its
+// Simd is defined and its target turned on.
+//
+// the precise ones reduce the argument and evaluate the polynomials of
+// cephes' single precision library. the lanes they do not cover, angles past
+// 8192, zeros, infinities, nans and denormals where they matter, go to libm
+// and get its result. the fast ones evaluate shorter polynomials fitted for
+// the least relative error, reduce angles in one step and never go to libm;
+// their specials are those of a gpu. the largest errors in ulps of the float
+// result, against libm in double, as render_shaders --bench-math measures
+// them over the ranges it lists:
+//
+//                     precise     fast
+//   sin, cos               2        -
+//   tan                    3        -
+//   asin, acos             3       33
+//   atan, atan2            3       12
+//   exp, exp2              2       97
+//   log, log2, log10       2       27
+//   pow                   18      113
+//
+// over [-100, 100] the fast sin and cos are off by up to 6.3e-6, and tan
+// by 4e-2 of itself next to its poles: their one step reduction leaves that
+// much, which near the zeros no count of ulps bounds. pow is
+// exp2(y log2 x), whose error grows with y log2 x; the figure is for x in
+// [1/16, 16] and y in [-8, 8]. fmod is exact when precise; fast, it is
+// x - y trunc(x / y), as a gpu computes it.
+template <typename Simd>
+class SimdMath
+{
+public:
+	typedef typename Simd::Value Value;
+	typedef typename Simd::Mask Mask;
+
+	static Value Sin(Value x)
+	{
+		Value a = Simd::Abs(x), j = Octant(a);
+		Value r = SinCos(Reduce(a, j), Simd::Multiply(j, Simd::Splat(0.5f)), false);
+		r = Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Negate(r), r);
+		r = Simd::Select(Simd::Equal(x, Simd::Zero()), x, r);
+		return Fallback<&LibmSin>(IsOutside(x, 8192.0f), x, r);
+	}
+
+	static Value Cos(Value x)
+	{
+		Value a = Simd::Abs(x), j = Octant(a);
+		Value r = SinCos(Reduce(a, j), Simd::Add(Simd::Multiply(j, Simd::Splat(0.5f)), One()), false);
+		return Fallback<&LibmCos>(IsOutside(x, 8192.0f), x, r);
+	}
+
+	static Value Tan(Value x)
+	{
+		static const float c[] = {9.38540185543e-3f, 3.11992232697e-3f, 2.44301354525e-2f, 5.34112807005e-2f, 1.33387994085e-1f, 3.33331568548e-1f};
+		Value a = Simd::Abs(x), j = Octant(a);
+		Value r = Tangent(Reduce(a, j), j, c, 6);
+		r = Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Negate(r), r);
+		r = Simd::Select(Simd::Equal(x, Simd::Zero()), x, r);
+		return Fallback<&LibmTan>(IsOutside(x, 8192.0f), x, r);
+	}
+
+	static Value Asin(Value x)
+	{
+		static const float c[] = {4.2163199048e-2f, 2.4181311049e-2f, 4.5470025998e-2f, 7.4953002686e-2f, 1.6666752422e-1f};
+		return Arcsine(x, c, 5);
+	}
+
+	static Value Acos(Value x)
+	{
+		static const float c[] = {4.2163199048e-2f, 2.4181311049e-2f, 4.5470025998e-2f, 7.4953002686e-2f, 1.6666752422e-1f};
+		return Arccosine(x, c, 5);
+	}
+
+	static Value Atan(Value x)
+	{
+		static const float c[] = {8.05374449538e-2f, -1.38776856032e-1f, 1.99777106478e-1f, -3.33329491539e-1f};
+		return Arctangent(x, c, 4);
+	}
+
+	static Value Atan2(Value y, Value x)
+	{
+		Value r = Quadrant(y, x, Atan(Simd::Divide(y, x)));
+		Mask is_special = Simd::Or(Simd::Or(Simd::Equal(x, Simd::Zero()), Simd::Equal(y, Simd::Zero())), Simd::Or(IsNotFinite(x), IsNotFinite(y)));
+		return Fallback2<&LibmAtan2>(is_special, y, x, r);
+	}
+
+	static Value Exp(Value x)
+	{
+		static const float c[] = {1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f};
+		x = Simd::Min(Simd::Max(x, Simd::Splat(-104.0f)), Simd::Splat(89.0f));
+		Value k = Simd::Floor(Simd::Add(Simd::Multiply(x, Simd::Splat(1.44269504088896341f)), Simd::Splat(0.5f)));
+		Value r = Simd::Subtract(x, Simd::Multiply(k, Simd::Splat(0.693359375f)));
+		r = Simd::Subtract(r, Simd::Multiply(k, Simd::Splat(-2.12194440e-4f)));
+		Value y = Simd::Add(Simd::Add(Simd::Multiply(Horner(r, c, 6), Simd::Multiply(r, r)), r), One());
+		return Scale(y, k);
+	}
+
+	static Value Exp2(Value x)
+	{
+		static const float c[] = {1.535336188319500e-4f, 1.339887440266574e-3f, 9.618437357674640e-3f, 5.550332471162809e-2f, 2.402264791363012e-1f, 6.931472028550421e-1f};
+		return PowerOfTwo(x, c, 6);
+	}
+
+	static Value Log(Value x)
+	{
+		Value e, f, y;
+		LogCore(x, e, f, y, LogCoefficients(), 9);
+		Value r = Simd::Add(f, Simd::Add(y, Simd::Multiply(e, Simd::Splat(-2.12194440e-4f))));
+		r = Simd::Add(r, Simd::Multiply(e, Simd::Splat(0.693359375f)));
+		return Fallback<&LibmLog>(IsNotNormal(x), x, r);
+	}
+
+	static Value Log2(Value x)
+	{
+		Value e, f, y;
+		LogCore(x, e, f, y, LogCoefficients(), 9);
+		Value r = Simd::Add(Simd::Multiply(Simd::Add(f, y), Simd::Splat(1.44269504088896341f)), e);
+		return Fallback<&LibmLog2>(IsNotNormal(x), x, r);
+	}
+
+	static Value Log10(Value x)
+	{
+		return Fallback<&LibmLog10>(IsNotNormal(x), x, Simd::Multiply(Log(x), Simd::Splat(0.434294481903251828f)));
+	}
+
+	static Value Pow(Value x, Value y)
+	{
+		Value r = Exp2(Simd::Multiply(y, Log2(x)));
+		return Fallback2<&LibmPow>(Simd::Or(IsNotNormal(x), IsNotFinite(y)), x, y, r);
+	}
+
+	static Value FastSin(Value x)
+	{
+		Value a = Simd::Abs(x), j = Octant(a);
+		Value r = SinCos(FastReduce(a, j), Simd::Multiply(j, Simd::Splat(0.5f)), true);
+		return Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Negate(r), r);
+	}
+
+	static Value FastCos(Value x)
+	{
+		Value a = Simd::Abs(x), j = Octant(a);
+		return SinCos(FastReduce(a, j), Simd::Add(Simd::Multiply(j, Simd::Splat(0.5f)), One()), true);
+	}
+
+	static Value FastTan(Value x)
+	{
+		static const float c[] = {4.308861867e-2f, 4.139877111e-2f, 1.360649765e-1f, 3.331543505e-1f};
+		Value a = Simd::Abs(x), j = Octant(a);
+		Value r = Tangent(FastReduce(a, j), j, c, 4);
+		return Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Negate(r), r);
+	}
+
+	static Value FastAsin(Value x)
+	{
+		static const float c[] = {6.410717964e-2f, 7.189983875e-2f, 1.668012589e-1f};
+		return Arcsine(x, c, 3);
+	}
+
+	static Value FastAcos(Value x)
+	{
+		static const float c[] = {6.410717964e-2f, 7.189983875e-2f, 1.668012589e-1f};
+		return Arccosine(x, c, 3);
+	}
+
+	static Value FastAtan(Value x)
+	{
+		static const float c[] = {-1.122516394e-1f, 1.971414387e-1f, -3.332550824e-1f};
+		return Arctangent(x, c, 3);
+	}
+
+	// straight along the axes, and zero at the origin.
+	static Value FastAtan2(Value y, Value x)
+	{
+		Value r = Quadrant(y, x, FastAtan(Simd::Divide(y, x)));
+		Mask is_on_y = Simd::Equal(x, Simd::Zero());
+		r = Simd::Select(is_on_y, Simd::Select(Simd::Less(y, Simd::Zero()), Simd::Splat(-half_pi), Simd::Splat(half_pi)), r);
+		return Simd::Select(Simd::And(is_on_y, Simd::Equal(y, Simd::Zero())), Simd::Zero(), r);
+	}
+
+	static Value FastExp(Value x)
+	{
+		return FastExp2(Simd::Multiply(x, Simd::Splat(1.44269504088896341f)));
+	}
+
+	static Value FastExp2(Value x)
+	{
+		static const float c[] = {9.582851082e-3f, 5.590642989e-2f, 2.402409911e-1f, 6.931241751e-1f};
+		return PowerOfTwo(x, c, 4);
+	}
+
+	static Value FastLog(Value x)
+	{
+		Value e, f, y;
+		LogCore(x, e, f, y, FastLogCoefficients(), 5);
+		return LogSpecials(x, Simd::Add(Simd::Add(f, y), Simd::Multiply(e, Simd::Splat(0.693147180559945309f))));
+	}
+
+	static Value FastLog2(Value x)
+	{
+		Value e, f, y;
+		LogCore(x, e, f, y, FastLogCoefficients(), 5);
+		return LogSpecials(x, Simd::Add(Simd::Multiply(Simd::Add(f, y), Simd::Splat(1.44269504088896341f)), e));
+	}
+
+	static Value FastLog10(Value x)
+	{
+		return Simd::Multiply(FastLog(x), Simd::Splat(0.434294481903251828f));
+	}
+
+	// a base below zero gives a nan, as on a gpu.
+	static Value FastPow(Value x, Value y)
+	{
+		return FastExp2(Simd::Multiply(y, FastLog2(x)));
+	}
+
+	static Value FastModulo(Value x, Value y)
+	{
+		return Simd::Subtract(x, Simd::Multiply(y, Simd::Truncate(Simd::Divide(x, y))));
+	}
+
+private:
+	enum { width = Simd::width };
+
+	static const float half_pi;
+	static const float pi;
+	static const float min_normal;
+
+	static float LibmSin(float x) { return std::sin(x); }
+	static float LibmCos(float x) { return std::cos(x); }
+	static float LibmTan(float x) { return std::tan(x); }
+	static float LibmAtan2(float y, float x) { return std::atan2(y, x); }
+	static float LibmLog(float x) { return std::log(x); }
+	static float LibmLog2(float x) { return std::log(x) * 1.4426950408889634f; }
+	static float LibmLog10(float x) { return std::log10(x); }
+	static float LibmPow(float x, float y) { return std::pow(x, y); }
+
+	static Value One() { return Simd::Splat(1.0f); }
+
+	static Value Horner(Value x, const float* c, unsigned int n)
+	{
+		Value r = Simd::Splat(c[0]);
+		for (unsigned int i = 1; i != n; ++i) r = Simd::Add(Simd::Multiply(r, x), Simd::Splat(c[i]));
+		return r;
+	}
+
+	// x - 2 floor(x / 2), one for an odd whole x.
+	static Value Odd(Value x)
+	{
+		return Simd::Subtract(x, Simd::Multiply(Simd::Floor(Simd::Multiply(x, Simd::Splat(0.5f))), Simd::Splat(2.0f)));
+	}
+
+	static Mask IsNotFinite(Value x)
+	{
+		return Simd::NotEqual(Simd::Subtract(x, x), Simd::Zero());
+	}
+
+	static Mask IsOutside(Value x, float limit)
+	{
+		return Simd::Or(Simd::Greater(Simd::Abs(x), Simd::Splat(limit)), IsNotFinite(x));
+	}
+
+	// zero, below zero, denormal, infinite or a nan.
+	static Mask IsNotNormal(Value x)
+	{
+		return Simd::Or(Simd::Less(x, Simd::Splat(min_normal)), IsNotFinite(x));
+	}
+
+	// the lanes of the mask go to libm, one at a time.
+	template <float (*F)(float)> static Value Fallback(Mask mask, Value x, Value result)
+	{
+		unsigned int lanes = Simd::GetLanes(mask);
+		if (lanes == 0) return result;
+		float a[width], r[width];
+		Simd::Store(a, x);
+		Simd::Store(r, result);
+		for (unsigned int lane = 0; lane != width; ++lane) if ((lanes >> lane & 1) != 0) r[lane] = F(a[lane]);
+		return Simd::Load(r);
+	}
+
+	template <float (*F)(float, float)> static Value Fallback2(Mask mask, Value x, Value y, Value result)
+	{
+		unsigned int lanes = Simd::GetLanes(mask);
+		if (lanes == 0) return result;
+		float a[width], b[width], r[width];
+		Simd::Store(a, x);
+		Simd::Store(b, y);
+		Simd::Store(r, result);
+		for (unsigned int lane = 0; lane != width; ++lane) if ((lanes >> lane & 1) != 0) r[lane] = F(a[lane], b[lane]);
+		return Simd::Load(r);
+	}
+
+	// the octant of a, rounded up to even.
+	static Value Octant(Value a)
+	{
+		Value j = Simd::Floor(Simd::Multiply(a, Simd::Splat(1.27323954473516268f)));
+		return Simd::Add(j, Odd(j));
+	}
+
+	// a - j pi/4 in three steps that are exact for a up to 8192.
+	static Value Reduce(Value a, Value j)
+	{
+		Value r = Simd::Subtract(a, Simd::Multiply(j, Simd::Splat(0.78515625f)));
+		r = Simd::Subtract(r, Simd::Multiply(j, Simd::Splat(2.4187564849853515625e-4f)));
+		return Simd::Subtract(r, Simd::Multiply(j, Simd::Splat(3.77489497744594108e-8f)));
+	}
+
+	static Value FastReduce(Value a, Value j)
+	{
+		return Simd::Subtract(a, Simd::Multiply(j, Simd::Splat(0.785398163397448310f)));
+	}
+
+	// the sine of r plus k quarter turns, r within an eighth of one.
+	static Value SinCos(Value r, Value k, bool is_fast)
+	{
+		static const float s[] = {-1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f};
+		static const float c[] = {2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f};
+		static const float fast_s[] = {8.163281716e-3f, -1.666339040e-1f};
+		static const float fast_c[] = {-1.365244971e-3f, 4.166127741e-2f};
+		Value z = Simd::Multiply(r, r);
+		Value sine = Simd::Add(Simd::Multiply(Simd::Multiply(Horner(z, is_fast ? fast_s : s, is_fast ? 2 : 3), z), r), r);
+		Value cosine = Simd::Multiply(Simd::Multiply(Horner(z, is_fast ? fast_c : c, is_fast ? 2 : 3), z), z);
+		cosine = Simd::Add(Simd::Subtract(cosine, Simd::Multiply(z, Simd::Splat(0.5f))), One());
+
+		Value quarter = Simd::Subtract(k, Simd::Multiply(Simd::Floor(Simd::Multiply(k, Simd::Splat(0.25f))), Simd::Splat(4.0f)));
+		Value r2 = Simd::Select(Simd::Equal(Odd(quarter), One()), cosine, sine);
+		return Simd::Select(Simd::GreaterEqual(quarter, Simd::Splat(2.0f)), Simd::Negate(r2), r2);
+	}
+
+	static Value Tangent(Value r, Value j, const float* c, unsigned int n)
+	{
+		Value z = Simd::Multiply(r, r);
+		Value t = Simd::Add(Simd::Multiply(Simd::Multiply(Horner(z, c, n), z), r), r);
+		Mask is_odd = Simd::Equal(Odd(Simd::Multiply(j, Simd::Splat(0.5f))), One());
+		return Simd::Select(is_odd, Simd::Negate(Simd::Divide(One(), t)), t);
+	}
+
+	// s + s z p(z), the arcsine of s for z = s^2, s up to a half.
+	static Value ArcsineCore(Value z, Value s, const float* c, unsigned int n)
+	{
+		return Simd::Add(Simd::Multiply(Simd::Multiply(Horner(z, c, n), z), s), s);
+	}
+
+	// past a half asin(a) = pi/2 - 2 asin(sqrt((1 - a) / 2)).
+	static Value Arcsine(Value x, const float* c, unsigned int n)
+	{
+		Value a = Simd::Abs(x);
+		Mask is_large = Simd::Greater(a, Simd::Splat(0.5f));
+		Value z = Simd::Select(is_large, Simd::Multiply(Simd::Subtract(One(), a), Simd::Splat(0.5f)), Simd::Multiply(a, a));
+		Value s = Simd::Select(is_large, Simd::Sqrt(z), a);
+		Value p = ArcsineCore(z, s, c, n);
+		Value r = Simd::Select(is_large, Simd::Subtract(Simd::Splat(half_pi), Simd::Add(p, p)), p);
+		r = Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Negate(r), r);
+		return Simd::Select(Simd::Equal(x, Simd::Zero()), x, r);
+	}
+
+	static Value Arccosine(Value x, const float* c, unsigned int n)
+	{
+		Value a = Simd::Abs(x);
+		Mask is_large = Simd::Greater(a, Simd::Splat(0.5f));
+		Value z = Simd::Select(is_large, Simd::Multiply(Simd::Subtract(One(), a), Simd::Splat(0.5f)), Simd::Multiply(x, x));
+		Value s = Simd::Select(is_large, Simd::Sqrt(z), x);
+		Value p = ArcsineCore(z, s, c, n);
+		Value twice = Simd::Add(p, p);
+		Value large = Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Subtract(Simd::Splat(pi), twice), twice);
+		return Simd::Select(is_large, large, Simd::Subtract(Simd::Splat(half_pi), p));
+	}
+
+	// brought within tan(pi/8) by atan(a) = pi/2 - atan(1/a) and pi/4 +
+	// atan((a - 1) / (a + 1)).
+	static Value Arctangent(Value x, const float* c, unsigned int n)
+	{
+		Value a = Simd::Abs(x);
+		Mask is_large = Simd::Greater(a, Simd::Splat(2.414213562373095f));
+		Mask is_middle = Simd::Greater(a, Simd::Splat(0.4142135623730950f));
+		Value t = Simd::Select(is_middle, Simd::Divide(Simd::Subtract(a, One()), Simd::Add(a, One())), a);
+		t = Simd::Select(is_large, Simd::Negate(Simd::Divide(One(), a)), t);
+		Value base = Simd::Select(is_large, Simd::Splat(half_pi), Simd::Select(is_middle, Simd::Splat(0.785398163397448310f), Simd::Zero()));
+		Value z = Simd::Multiply(t, t);
+		Value r = Simd::Add(base, Simd::Add(Simd::Multiply(Simd::Multiply(Horner(z, c, n), z), t), t));
+		r = Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Negate(r), r);
+		return Simd::Select(Simd::Equal(x, Simd::Zero()), x, r);
+	}
+
+	// atan(y / x) turned half a turn for the left half plane.
+	static Value Quadrant(Value y, Value x, Value r)
+	{
+		Value turn = Simd::Select(Simd::Less(y, Simd::Zero()), Simd::Splat(-pi), Simd::Splat(pi));
+		return Simd::Add(r, Simd::Select(Simd::Less(x, Simd::Zero()), turn, Simd::Zero()));
+	}
+
+	// y 2^k, in two steps so that neither leaves the normal range before
+	// the result does. k is whole.
+	static Value Scale(Value y, Value k)
+	{
+		Value half = Simd::Floor(Simd::Multiply(k, Simd::Splat(0.5f)));
+		return Simd::Multiply(Simd::Multiply(y, Simd::Pow2(half)), Simd::Pow2(Simd::Subtract(k, half)));
+	}
+
+	// 2^x as 2^k 2^f, f within a half, past which it is zero or infinite.
+	static Value PowerOfTwo(Value x, const float* c, unsigned int n)
+	{
+		x = Simd::Min(Simd::Max(x, Simd::Splat(-160.0f)), Simd::Splat(129.0f));
+		Value k = Simd::Floor(Simd::Add(x, Simd::Splat(0.5f)));
+		Value f = Simd::Subtract(x, k);
+		return Scale(Simd::Add(Simd::Multiply(Horner(f, c, n), f), One()), k);
+	}
+
+	static const float* LogCoefficients()
+	{
+		static const float c[] = {7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f, -1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f};
+		return c;
+	}
+
+	static const float* FastLogCoefficients()
+	{
+		static const float c[] = {1.178178936e-1f, -1.840718091e-1f, 2.044220716e-1f, -2.494383305e-1f, 3.332085907e-1f};
+		return c;
+	}
+
+	// x = 2^e (1 + f), f within [sqrt(1/2) - 1, sqrt(2) - 1], and log(1 + f)
+	// as f + y. x is normal.
+	static void LogCore(Value x, Value& e, Value& f, Value& y, const float* c, unsigned int n)
+	{
+		Value m = Simd::Mantissa(x);
+		Value half = Simd::Multiply(m, Simd::Splat(0.5f));
+		Mask is_large = Simd::GreaterEqual(half, Simd::Splat(0.707106781186547524f));
+		e = Simd::Add(Simd::Exponent(x), Simd::Select(is_large, One(), Simd::Zero()));
+		f = Simd::Subtract(Simd::Select(is_large, half, m), One());
+		Value z = Simd::Multiply(f, f);
+		y = Simd::Multiply(Simd::Multiply(Horner(f, c, n), f), z);
+		y = Simd::Subtract(y, Simd::Multiply(z, Simd::Splat(0.5f)));
+	}
+
+	// denormals are taken for zero, as on a gpu.
+	static Value LogSpecials(Value x, Value r)
+	{
+		r = Simd::Select(Simd::Less(x, Simd::Splat(min_normal)), Simd::Splat(-std::numeric_limits<float>::infinity()), r);
+		r = Simd::Select(Simd::Equal(x, Simd::Splat(std::numeric_limits<float>::infinity())), x, r);
+		r = Simd::Select(Simd::Less(x, Simd::Zero()), Simd::Splat(std::numeric_limits<float>::quiet_NaN()), r);
+		return Simd::Select(Simd::NotEqual(x, x), x, r);
+	}
+};
+
+template <typename Simd> const float SimdMath<Simd>::half_pi = 1.57079632679489662f;
+template <typename Simd> const float SimdMath<Simd>::pi = 3.14159265358979324f;
+template <typename Simd> const float SimdMath<Simd>::min_normal = 1.17549435e-38f;
+
+#endif  // _CPU_SIMD_MATH_HPP_INCLUDED_
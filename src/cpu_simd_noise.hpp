@@ -0,0 +1,367 @@
+#ifndef _CPU_SIMD_NOISE_HPP_INCLUDED_
+#define _CPU_SIMD_NOISE_HPP_INCLUDED_
+
+#include <cmath>
+#include "cpu_shader_math.hpp"
+#include "cpu_simd_math.hpp"
+
+// the functions of fx/snoise.hlsl and fx/qnoise.hlsl over the Simd of the
+// kernel, a vector per component. each does the ops of its HLSL in the same
+// order, on constants read the way the program reads the literals, so that
+// it gives the bits the inlined HLSL gives on any engine. like SimdMath, a
+// translation unit includes this only after its Simd is defined.
+template <typename Simd>
+class SimdNoise
+{
+public:
+	typedef typename Simd::Value Value;
+	typedef typename Simd::Mask Mask;
+
+	static Value Snoise2(const Value* v)
+	{
+		const Value cx = Literal(0.211324865405187), cy = Literal(0.366025403784439);
+		const Value cz = Literal(-0.577350269189626), cw = Literal(0.024390243902439);
+
+		// first corner
+		Value d = Dot2(v[0], v[1], cy, cy);
+		Value i[2] = {Simd::Floor(Simd::Add(v[0], d)), Simd::Floor(Simd::Add(v[1], d))};
+		d = Dot2(i[0], i[1], cx, cx);
+		Value x0[2] = {Simd::Add(Simd::Subtract(v[0], i[0]), d), Simd::Add(Simd::Subtract(v[1], i[1]), d)};
+
+		// other corners
+		Mask is_x = Simd::Greater(x0[0], x0[1]);
+		Value i1[2] = {Simd::Select(is_x, One(), Simd::Zero()), Simd::Select(is_x, Simd::Zero(), One())};
+		Value x12[4] = {Simd::Add(x0[0], cx), Simd::Add(x0[1], cx), Simd::Add(x0[0], cz), Simd::Add(x0[1], cz)};
+		x12[0] = Simd::Subtract(x12[0], i1[0]);
+		x12[1] = Simd::Subtract(x12[1], i1[1]);
+
+		// permutations
+		i[0] = Mod289(i[0]);
+		i[1] = Mod289(i[1]);
+		Value offsets[2][3] = {{Simd::Zero(), i1[1], One()}, {Simd::Zero(), i1[0], One()}};
+		Value p[3];
+		for (int k = 0; k != 3; ++k)
+		{
+			Value q = Permute(Simd::Add(i[1], offsets[0][k]));
+			p[k] = Permute(Simd::Add(Simd::Add(q, i[0]), offsets[1][k]));
+		}
+
+		Value m[3] = {Dot2(x0[0], x0[1], x0[0], x0[1]), Dot2(x12[0], x12[1], x12[0], x12[1]), Dot2(x12[2], x12[3], x12[2], x12[3])};
+		Value g[3];
+		const Value corners[3][2] = {{x0[0], x0[1]}, {x12[0], x12[1]}, {x12[2], x12[3]}};
+		for (int k = 0; k != 3; ++k)
+		{
+			m[k] = Simd::Max(Simd::Subtract(Literal(0.5), m[k]), Simd::Zero());
+			m[k] = Simd::Multiply(m[k], m[k]);
+			m[k] = Simd::Multiply(m[k], m[k]);
+
+			// gradients: 41 points over a line, mapped onto a diamond
+			Value x = Simd::Subtract(Simd::Multiply(Literal(2.0), Frac(Simd::Multiply(p[k], cw))), One());
+			Value h = Simd::Subtract(Simd::Abs(x), Literal(0.5));
+			Value ox = Simd::Floor(Simd::Add(x, Literal(0.5)));
+			Value a0 = Simd::Subtract(x, ox);
+
+			// normalised by scaling m
+			m[k] = Simd::Multiply(m[k], TaylorInvSqrt(Simd::Add(Simd::Multiply(a0, a0), Simd::Multiply(h, h))));
+			g[k] = Simd::Add(Simd::Multiply(a0, corners[k][0]), Simd::Multiply(h, corners[k][1]));
+		}
+		return Simd::Multiply(Literal(130.0), Dot3(m, g));
+	}
+
+	static Value Snoise3(const Value* v)
+	{
+		const Value cx = Simd::Splat(1.0f / 6.0f), cy = Simd::Splat(1.0f / 3.0f);
+		const Value dy = Literal(0.5);
+
+		// first corner
+		Value c[3] = {cy, cy, cy};
+		Value d = Dot3(v, c);
+		Value i[3], x0[3];
+		for (int k = 0; k != 3; ++k) i[k] = Simd::Floor(Simd::Add(v[k], d));
+		for (int k = 0; k != 3; ++k) c[k] = cx;
+		d = Dot3(i, c);
+		for (int k = 0; k != 3; ++k) x0[k] = Simd::Add(Simd::Subtract(v[k], i[k]), d);
+
+		// other corners
+		Value g[3], l[3], i1[3], i2[3];
+		for (int k = 0; k != 3; ++k) g[k] = Step(x0[(k + 1) % 3], x0[k]);
+		for (int k = 0; k != 3; ++k) l[k] = Simd::Subtract(One(), g[k]);
+		for (int k = 0; k != 3; ++k)
+		{
+			i1[k] = Simd::Min(g[k], l[(k + 2) % 3]);
+			i2[k] = Simd::Max(g[k], l[(k + 2) % 3]);
+		}
+
+		Value x1[3], x2[3], x3[3];
+		for (int k = 0; k != 3; ++k)
+		{
+			x1[k] = Simd::Add(Simd::Subtract(x0[k], i1[k]), cx);
+			x2[k] = Simd::Add(Simd::Subtract(x0[k], i2[k]), cy);
+			x3[k] = Simd::Subtract(x0[k], dy);
+		}
+
+		// permutations
+		for (int k = 0; k != 3; ++k) i[k] = Mod289(i[k]);
+		Value p[4];
+		for (int n = 0; n != 4; ++n)
+		{
+			p[n] = Simd::Zero();
+			for (int k = 2; k >= 0; --k)
+			{
+				Value offset = n == 0 ? Simd::Zero() : n == 1 ? i1[k] : n == 2 ? i2[k] : One();
+				Value x = k == 2 ? Simd::Add(i[k], offset) : Simd::Add(Simd::Add(p[n], i[k]), offset);
+				p[n] = Permute(x);
+			}
+		}
+
+		// gradients: 7x7 points over a square, mapped onto an octahedron
+		const float n_ = static_cast<float>(0.142857142857);
+		const Value nsx = Simd::Splat(n_ * 2.0f - 0.0f), nsy = Simd::Splat(n_ * 0.5f - 1.0f), nsz = Simd::Splat(n_ * 1.0f - 0.0f);
+		Value x[4], y[4], h[4], sh[4];
+		for (int n = 0; n != 4; ++n)
+		{
+			Value j = Simd::Subtract(p[n], Simd::Multiply(Literal(49.0), Simd::Floor(Simd::Multiply(Simd::Multiply(p[n], nsz), nsz))));
+			Value x_ = Simd::Floor(Simd::Multiply(j, nsz));
+			Value y_ = Simd::Floor(Simd::Subtract(j, Simd::Multiply(Literal(7.0), x_)));
+			x[n] = Simd::Add(Simd::Multiply(x_, nsx), nsy);
+			y[n] = Simd::Add(Simd::Multiply(y_, nsx), nsy);
+			h[n] = Simd::Subtract(Simd::Subtract(One(), Simd::Abs(x[n])), Simd::Abs(y[n]));
+			sh[n] = Simd::Negate(Step(h[n], Simd::Zero()));
+		}
+
+		// b0 is x.xy y.xy and b1 x.zw y.zw; a0 and a1 take them as xzyw.
+		Value grads[4][3];
+		for (int n = 0; n != 4; ++n)
+		{
+			Value bx = x[n], by = y[n];
+			Value sx = Simd::Add(Simd::Multiply(Simd::Floor(bx), Literal(2.0)), One());
+			Value sy = Simd::Add(Simd::Multiply(Simd::Floor(by), Literal(2.0)), One());
+			grads[n][0] = Simd::Add(bx, Simd::Multiply(sx, sh[n]));
+			grads[n][1] = Simd::Add(by, Simd::Multiply(sy, sh[n]));
+			grads[n][2] = h[n];
+		}
+
+		// normalise gradients
+		for (int n = 0; n != 4; ++n)
+		{
+			Value norm = TaylorInvSqrt(Dot3(grads[n], grads[n]));
+			for (int k = 0; k != 3; ++k) grads[n][k] = Simd::Multiply(grads[n][k], norm);
+		}
+
+		// mix final noise value
+		const Value* corners[4] = {x0, x1, x2, x3};
+		Value m[4], dots[4];
+		for (int n = 0; n != 4; ++n)
+		{
+			m[n] = Simd::Max(Simd::Subtract(Literal(0.6), Dot3(corners[n], corners[n])), Simd::Zero());
+			m[n] = Simd::Multiply(m[n], m[n]);
+			m[n] = Simd::Multiply(m[n], m[n]);
+			dots[n] = Dot3(grads[n], corners[n]);
+		}
+		return Simd::Multiply(Literal(42.0), Dot4(m, dots));
+	}
+
+	static void Grad4(Value j, const Value* ip, Value* p)
+	{
+		for (int k = 0; k != 3; ++k)
+		{
+			Value x = Simd::Multiply(Simd::Floor(Simd::Multiply(Frac(Simd::Multiply(j, ip[k])), Literal(7.0))), ip[2]);
+			p[k] = Simd::Subtract(x, One());
+		}
+		Value a[3] = {Simd::Abs(p[0]), Simd::Abs(p[1]), Simd::Abs(p[2])};
+		Value ones[3] = {One(), One(), One()};
+		p[3] = Simd::Subtract(Literal(1.5), Dot3(a, ones));
+
+		Value s[4];
+		for (int k = 0; k != 4; ++k) s[k] = Simd::Subtract(One(), Step(Simd::Zero(), p[k]));
+		for (int k = 0; k != 3; ++k) p[k] = Simd::Add(p[k], Simd::Multiply(Simd::Subtract(Simd::Multiply(s[k], Literal(2.0)), One()), s[3]));
+	}
+
+	static Value Snoise4(const Value* v)
+	{
+		const Value c[4] = {Literal(0.138196601125011), Literal(0.276393202250021), Literal(0.414589803375032), Literal(-0.447213595499958)};
+		const Value f4 = Literal(0.309016994374947451);
+
+		// first corner
+		Value f[4] = {f4, f4, f4, f4};
+		Value d = Dot4(v, f);
+		Value i[4], x0[4];
+		for (int k = 0; k != 4; ++k) i[k] = Simd::Floor(Simd::Add(v[k], d));
+		Value cx[4] = {c[0], c[0], c[0], c[0]};
+		d = Dot4(i, cx);
+		for (int k = 0; k != 4; ++k) x0[k] = Simd::Add(Simd::Subtract(v[k], i[k]), d);
+
+		// rank sorting, by Bill Licea-Kane
+		Value is_x[3] = {Step(x0[1], x0[0]), Step(x0[2], x0[0]), Step(x0[3], x0[0])};
+		Value is_yz[3] = {Step(x0[2], x0[1]), Step(x0[3], x0[1]), Step(x0[3], x0[2])};
+		Value i0[4];
+		i0[0] = Simd::Add(Simd::Add(is_x[0], is_x[1]), is_x[2]);
+		for (int k = 0; k != 3; ++k) i0[k + 1] = Simd::Subtract(One(), is_x[k]);
+		i0[1] = Simd::Add(i0[1], Simd::Add(is_yz[0], is_yz[1]));
+		i0[2] = Simd::Add(i0[2], Simd::Subtract(One(), is_yz[0]));
+		i0[3] = Simd::Add(i0[3], Simd::Subtract(One(), is_yz[1]));
+		i0[2] = Simd::Add(i0[2], is_yz[2]);
+		i0[3] = Simd::Add(i0[3], Simd::Subtract(One(), is_yz[2]));
+
+		// i0 holds 0, 1, 2 and 3, one in each component
+		Value i1[4], i2[4], i3[4];
+		for (int k = 0; k != 4; ++k)
+		{
+			i3[k] = Clamp(i0[k]);
+			i2[k] = Clamp(Simd::Subtract(i0[k], One()));
+			i1[k] = Clamp(Simd::Subtract(i0[k], Literal(2.0)));
+		}
+
+		Value x1[4], x2[4], x3[4], x4[4];
+		for (int k = 0; k != 4; ++k)
+		{
+			x1[k] = Simd::Add(Simd::Subtract(x0[k], i1[k]), c[0]);
+			x2[k] = Simd::Add(Simd::Subtract(x0[k], i2[k]), c[1]);
+			x3[k] = Simd::Add(Simd::Subtract(x0[k], i3[k]), c[2]);
+			x4[k] = Simd::Add(x0[k], c[3]);
+		}
+
+		// permutations
+		for (int k = 0; k != 4; ++k) i[k] = Mod289(i[k]);
+		Value j[5];
+		j[0] = Permute(Simd::Add(Permute(Simd::Add(Permute(Simd::Add(Permute(i[3]), i[2])), i[1])), i[0]));
+		for (int n = 0; n != 4; ++n)
+		{
+			Value x = Simd::Zero();
+			for (int k = 3; k >= 0; --k)
+			{
+				Value offset = n == 0 ? i1[k] : n == 1 ? i2[k] : n == 2 ? i3[k] : One();
+				x = Permute(k == 3 ? Simd::Add(i[k], offset) : Simd::Add(Simd::Add(x, i[k]), offset));
+			}
+			j[n + 1] = x;
+		}
+
+		// gradients: 7x7x6 points over a cube, mapped onto a 4-cross polytope
+		const Value ip[4] = {Simd::Splat(1.0f / 294.0f), Simd::Splat(1.0f / 49.0f), Simd::Splat(1.0f / 7.0f), Simd::Zero()};
+		Value p[5][4];
+		for (int n = 0; n != 5; ++n) Grad4(j[n], ip, p[n]);
+
+		// normalise gradients
+		for (int n = 0; n != 5; ++n)
+		{
+			Value norm = TaylorInvSqrt(Dot4(p[n], p[n]));
+			for (int k = 0; k != 4; ++k) p[n][k] = Simd::Multiply(p[n][k], norm);
+		}
+
+		// mix contributions from the five corners
+		const Value* corners[5] = {x0, x1, x2, x3, x4};
+		Value m[5], dots[5];
+		for (int n = 0; n != 5; ++n)
+		{
+			m[n] = Simd::Max(Simd::Subtract(Literal(0.6), Dot4(corners[n], corners[n])), Simd::Zero());
+			m[n] = Simd::Multiply(m[n], m[n]);
+			m[n] = Simd::Multiply(m[n], m[n]);
+			dots[n] = Dot4(p[n], corners[n]);
+		}
+		return Simd::Multiply(Literal(49.0), Simd::Add(Dot3(m, dots), Dot2(m[3], m[4], dots[3], dots[4])));
+	}
+
+	static void Hash(const Value* n, Value* r, CpuShaderMath::Precision precision)
+	{
+		for (int k = 0; k != 4; ++k) r[k] = Frac(Simd::Multiply(Sine(n[k], precision), Literal(43758.5453)));
+	}
+
+	static Value Qnoise2(const Value* x, CpuShaderMath::Precision precision)
+	{
+		Value p[2], f[2];
+		for (int k = 0; k != 2; ++k)
+		{
+			p[k] = Simd::Floor(x[k]);
+			f[k] = Smooth(Frac(x[k]));
+		}
+		Value n = Simd::Add(p[0], Simd::Multiply(p[1], Literal(57.0)));
+		Value a[4] = {Simd::Add(n, Literal(113.0)), Simd::Add(n, Literal(114.0)), Simd::Add(n, Literal(170.0)), Simd::Add(n, Literal(171.0))};
+		Value h[4];
+		Hash(a, h, precision);
+		Value v0 = Lerp(h[0], h[1], f[0]), v1 = Lerp(h[2], h[3], f[0]);
+		return Lerp(v0, v1, f[1]);
+	}
+
+	static Value Qnoise3(const Value* x, CpuShaderMath::Precision precision)
+	{
+		Value p[3], f[3];
+		for (int k = 0; k != 3; ++k)
+		{
+			p[k] = Simd::Floor(x[k]);
+			f[k] = Smooth(Frac(x[k]));
+		}
+		Value c[3] = {One(), Literal(57.0), Literal(113.0)};
+		Value n = Dot3(p, c);
+		Value a0[4] = {Simd::Add(n, Simd::Zero()), Simd::Add(n, Literal(57.0)), Simd::Add(n, Literal(113.0)), Simd::Add(n, Literal(170.0))};
+		Value a1[4] = {Simd::Add(n, One()), Simd::Add(n, Literal(58.0)), Simd::Add(n, Literal(114.0)), Simd::Add(n, Literal(171.0))};
+		Value h0[4], h1[4], u[4];
+		Hash(a0, h0, precision);
+		Hash(a1, h1, precision);
+		for (int k = 0; k != 4; ++k) u[k] = Lerp(h0[k], h1[k], f[0]);
+		Value v0 = Lerp(u[0], u[1], f[1]), v1 = Lerp(u[2], u[3], f[1]);
+		return Lerp(v0, v1, f[2]);
+	}
+
+private:
+	enum { width = Simd::width };
+
+	// a literal goes to a double and then to a float, as the program reads it.
+	static Value Literal(double x) { return Simd::Splat(static_cast<float>(x)); }
+	static Value One() { return Simd::Splat(1.0f); }
+
+	// the intrinsics and macros the HLSL calls, as CpuShaderMath defines them.
+	static Value Frac(Value x) { return Simd::Subtract(x, Simd::Floor(x)); }
+	static Value Step(Value edge, Value x) { return Simd::Select(Simd::GreaterEqual(x, edge), One(), Simd::Zero()); }
+	static Value Clamp(Value x) { return Simd::Min(Simd::Max(x, Simd::Zero()), One()); }
+	static Value Lerp(Value a, Value b, Value t) { return Simd::Add(a, Simd::Multiply(Simd::Subtract(b, a), t)); }
+	static Value Smooth(Value f) { return Simd::Multiply(Simd::Multiply(f, f), Simd::Subtract(Literal(3.0), Simd::Multiply(Literal(2.0), f))); }
+
+	static Value Mod289(Value x)
+	{
+		return Simd::Subtract(x, Simd::Multiply(Simd::Floor(Simd::Multiply(x, Simd::Splat(1.0f / 289.0f))), Literal(289.0)));
+	}
+
+	static Value Permute(Value x)
+	{
+		return Mod289(Simd::Multiply(Simd::Add(Simd::Multiply(x, Literal(34.0)), One()), x));
+	}
+
+	static Value TaylorInvSqrt(Value x)
+	{
+		return Simd::Subtract(Literal(1.79284291400159), Simd::Multiply(Literal(0.85373472095314), x));
+	}
+
+	// summed from zero, as Dot is.
+	static Value Dot2(Value ax, Value ay, Value bx, Value by)
+	{
+		return Simd::Add(Simd::Add(Simd::Zero(), Simd::Multiply(ax, bx)), Simd::Multiply(ay, by));
+	}
+
+	static Value Dot3(const Value* a, const Value* b)
+	{
+		Value sum = Simd::Zero();
+		for (int k = 0; k != 3; ++k) sum = Simd::Add(sum, Simd::Multiply(a[k], b[k]));
+		return sum;
+	}
+
+	static Value Dot4(const Value* a, const Value* b)
+	{
+		Value sum = Simd::Zero();
+		for (int k = 0; k != 4; ++k) sum = Simd::Add(sum, Simd::Multiply(a[k], b[k]));
+		return sum;
+	}
+
+	static float LibmSin(float x) { return std::sin(x); }
+
+	static Value Sine(Value x, CpuShaderMath::Precision precision)
+	{
+		if (precision == CpuShaderMath::PR_Precise) return SimdMath<Simd>::Sin(x);
+		if (precision == CpuShaderMath::PR_Fast) return SimdMath<Simd>::FastSin(x);
+		float a[width];
+		Simd::Store(a, x);
+		for (unsigned int lane = 0; lane != width; ++lane) a[lane] = LibmSin(a[lane]);
+		return Simd::Load(a);
+	}
+};
+
+#endif  // _CPU_SIMD_NOISE_HPP_INCLUDED_
@@ -0,0 +1,235 @@
+#ifndef _CPU_SIMD_TEXTURE_HPP_INCLUDED_
+#define _CPU_SIMD_TEXTURE_HPP_INCLUDED_
+
+#include <algorithm>
+#include <cmath>
+#include "cpu_texture.hpp"
+
+// CpuTexture::Sample over the Simd of the kernel. the levels, coordinates,
+// weights and blends are vectors, and the same ops in the same order as the
+// scalar ones, so every lane gets its bits. the wrap and the tiled, morton
+// ordered indices of the texels are whole numbers in float vectors, exact
+// below 2^24, and Simd::GatherTexels reads the texels at them. like
+// SimdMath, a translation unit includes this only after its Simd is defined.
+template <typename Simd>
+class SimdTexture
+{
+public:
+	typedef typename Simd::Value Value;
+	typedef typename Simd::Mask Mask;
+
+	// the lanes not in lanes come out black.
+	static void Sample(const CpuTexture& texture, unsigned int lanes, Value u, Value v, Value level, Value color[4])
+	{
+		for (unsigned int i = 0; i != 4; ++i) color[i] = Simd::Zero();
+		if (texture.GetNumLevels() == 0 || lanes == 0) return;
+		if (!IsGatherable(texture))
+		{
+			SampleLanes(texture, lanes, u, v, level, color);
+			return;
+		}
+
+		// a nan level is the top one.
+		Value last = Simd::Splat(static_cast<float>(texture.GetNumLevels() - 1));
+		Value clamped = Simd::Select(Simd::Greater(level, Simd::Zero()), Simd::Select(Simd::Less(level, last), level, last), Simd::Zero());
+		Value whole = Simd::Floor(clamped);
+		Value fraction = Simd::Subtract(clamped, whole);
+		float indices[width];
+		Simd::Store(indices, whole);
+		SampleLevel(texture, lanes, indices, 0, u, v, color);
+
+		Mask is_blended = Simd::Greater(fraction, Simd::Zero());
+		unsigned int blended = lanes & Simd::GetLanes(is_blended);
+		if (blended == 0) return;
+		Value next[4];
+		SampleLevel(texture, blended, indices, 1, u, v, next);
+		for (unsigned int i = 0; i != 4; ++i)
+		{
+			Value x = Simd::Add(color[i], Simd::Multiply(Simd::Subtract(next[i], color[i]), fraction));
+			color[i] = Simd::Select(is_blended, x, color[i]);
+		}
+	}
+
+	// the level of a Sample without one, as a gpu picks it: the log2 of the
+	// longer of the steps the coordinates take in texels of the top level,
+	// across a quad and down it. a quad is the lanes 0 1 over 2 3, and all
+	// of it takes the steps of its top left lane, so that it reads the same
+	// levels. a log of zero is below the top level, which is then taken.
+	static Value ImplicitLevel(const CpuTexture& texture, Value u, Value v)
+	{
+		float us[width], vs[width], levels[width];
+		Simd::Store(us, u);
+		Simd::Store(vs, v);
+		float texture_width = static_cast<float>(texture.GetWidth()), texture_height = static_cast<float>(texture.GetHeight());
+		for (unsigned int quad = 0; quad != width; quad += 4)
+		{
+			float dudx = (us[quad + 1] - us[quad]) * texture_width, dvdx = (vs[quad + 1] - vs[quad]) * texture_height;
+			float dudy = (us[quad + 2] - us[quad]) * texture_width, dvdy = (vs[quad + 2] - vs[quad]) * texture_height;
+			float across = dudx * dudx + dvdx * dvdx, down = dudy * dudy + dvdy * dvdy;
+			float level = 0.5f * std::log2(across > down ? across : down);
+			std::fill_n(levels + quad, 4, level);
+		}
+		return Simd::Load(levels);
+	}
+
+private:
+	enum { width = Simd::width, tile_size = CpuTexture::tile_size, tile_texels = tile_size * tile_size };
+
+	// the level below indices by step.
+	static void SampleLevel(const CpuTexture& texture, unsigned int lanes, const float* indices, size_t step, Value u, Value v, Value color[4])
+	{
+		const CpuTexture::Level* levels[width];
+		float widths[width], heights[width], rows[width], firsts[width];
+		for (unsigned int lane = 0; lane != width; ++lane)
+		{
+			levels[lane] = &texture.GetLevel((lanes >> lane & 1) != 0 ? static_cast<size_t>(indices[lane]) + step : 0);
+			widths[lane] = static_cast<float>(levels[lane]->width);
+			heights[lane] = static_cast<float>(levels[lane]->height);
+			rows[lane] = static_cast<float>(levels[lane]->tiles_per_row * tile_texels);
+			firsts[lane] = static_cast<float>(levels[lane]->offset / 4);
+		}
+
+		// texel centers sit at half coordinates, the four around are blended.
+		Value level_width = Simd::Load(widths), level_height = Simd::Load(heights);
+		Value half = Simd::Splat(0.5f);
+		Value x = Simd::Subtract(Simd::Multiply(u, level_width), half);
+		Value y = Simd::Subtract(Simd::Multiply(v, level_height), half);
+		Value x0 = Simd::Floor(x), y0 = Simd::Floor(y);
+		Value fx = Simd::Subtract(x, x0), fy = Simd::Subtract(y, y0);
+		Value zero = Simd::Zero(), one = Simd::Splat(1.0f);
+		Mask is_inside = Simd::And(Simd::GreaterEqual(fx, zero), Simd::LessEqual(fx, one));
+		is_inside = Simd::And(is_inside, Simd::And(Simd::GreaterEqual(fy, zero), Simd::LessEqual(fy, one)));
+		Mask is_fetched = Simd::And(is_inside, Simd::FromLanes(lanes));
+		unsigned int fetched = Simd::GetLanes(is_fetched);
+		if (fetched == 0)
+		{
+			for (unsigned int i = 0; i != 4; ++i) color[i] = zero;
+			return;
+		}
+
+		// the corners, wrapped, and the indices of their texels.
+		Value ix = Wrap(x0, level_width, fetched), iy = Wrap(y0, level_height, fetched);
+		Value ix1 = Simd::Add(ix, one), iy1 = Simd::Add(iy, one);
+		ix1 = Simd::Select(Simd::Equal(ix1, level_width), zero, ix1);
+		iy1 = Simd::Select(Simd::Equal(iy1, level_height), zero, iy1);
+		Value row = Simd::Load(rows), first = Simd::Load(firsts);
+		Value upper = RowIndex(iy, row, first), lower = RowIndex(iy1, row, first);
+		Value left = ColumnIndex(ix), right = ColumnIndex(ix1);
+		Value corners[4] = {Simd::Add(upper, left), Simd::Add(upper, right), Simd::Add(lower, left), Simd::Add(lower, right)};
+
+		// past 2^22 the wrap loses bits, so those lanes wrap as the scalar
+		// sampler does. only a coordinate far off the texture gets there.
+		Value far = Simd::Splat(4194304.0f);
+		Mask is_near = Simd::And(Simd::Less(Simd::Abs(x0), far), Simd::Less(Simd::Abs(y0), far));
+		unsigned int far_lanes = fetched & ~Simd::GetLanes(is_near);
+		if (far_lanes != 0)
+		{
+			float xs[width], ys[width], lane_corners[4][width];
+			Simd::Store(xs, x0);
+			Simd::Store(ys, y0);
+			for (unsigned int corner = 0; corner != 4; ++corner) Simd::Store(lane_corners[corner], corners[corner]);
+			for (unsigned int lane = 0; lane != width; ++lane)
+			{
+				if ((far_lanes >> lane & 1) == 0) continue;
+				const CpuTexture::Level& at = *levels[lane];
+				size_t wx = CpuTexture::Wrap(xs[lane], at.width), wy = CpuTexture::Wrap(ys[lane], at.height);
+				size_t wx1 = wx + 1 == at.width ? 0 : wx + 1;
+				size_t wy1 = wy + 1 == at.height ? 0 : wy + 1;
+				lane_corners[0][lane] = static_cast<float>(CpuTexture::GetTexelIndex(at, wx, wy));
+				lane_corners[1][lane] = static_cast<float>(CpuTexture::GetTexelIndex(at, wx1, wy));
+				lane_corners[2][lane] = static_cast<float>(CpuTexture::GetTexelIndex(at, wx, wy1));
+				lane_corners[3][lane] = static_cast<float>(CpuTexture::GetTexelIndex(at, wx1, wy1));
+			}
+			for (unsigned int corner = 0; corner != 4; ++corner) corners[corner] = Simd::Load(lane_corners[corner]);
+		}
+
+		// the lanes not fetched read the first texel, and come out black.
+		Value texels[4][4];
+		for (unsigned int corner = 0; corner != 4; ++corner)
+		{
+			Simd::GatherTexels(texture.GetTexels(), Simd::Select(is_fetched, corners[corner], zero), texels[corner]);
+		}
+
+		for (unsigned int i = 0; i != 4; ++i)
+		{
+			Value t00 = texels[0][i], t10 = texels[1][i];
+			Value t01 = texels[2][i], t11 = texels[3][i];
+			Value top = Simd::Add(t00, Simd::Multiply(Simd::Subtract(t10, t00), fx));
+			Value bottom = Simd::Add(t01, Simd::Multiply(Simd::Subtract(t11, t01), fx));
+			Value blended = Simd::Add(top, Simd::Multiply(Simd::Subtract(bottom, top), fy));
+			color[i] = Simd::Select(is_fetched, blended, zero);
+		}
+	}
+
+	// CpuTexture::Wrap of whole coordinates below 2^22, on sizes below, in
+	// the fetched lanes.
+	static Value Wrap(Value x, Value size, unsigned int fetched)
+	{
+		// most land on the texture or a texel off it, no division needed.
+		Value zero = Simd::Zero();
+		Mask is_near = Simd::And(Simd::GreaterEqual(x, Simd::Splat(-1.0f)), Simd::Less(x, size));
+		if ((fetched & ~Simd::GetLanes(is_near)) == 0) return Simd::Select(Simd::Less(x, zero), Simd::Add(x, size), x);
+
+		Value r = Simd::Subtract(x, Simd::Multiply(Simd::Floor(Simd::Divide(x, size)), size));
+		r = Simd::Select(Simd::Less(r, zero), Simd::Add(r, size), r);
+		return Simd::Select(Simd::GreaterEqual(r, size), Simd::Subtract(r, size), r);
+	}
+
+	// the index of a texel, split in the part its row gives and the part
+	// its column does. see CpuTexture::GetTexelOffset.
+	static Value RowIndex(Value y, Value row, Value first)
+	{
+		Value tile = DivideWhole(y, tile_size);
+		Value within = Simd::Subtract(y, Simd::Multiply(tile, Simd::Splat(static_cast<float>(tile_size))));
+		return Simd::Add(Simd::Add(first, Simd::Multiply(tile, row)), Simd::Multiply(Spread(within), Simd::Splat(2.0f)));
+	}
+
+	static Value ColumnIndex(Value x)
+	{
+		Value tile = DivideWhole(x, tile_size);
+		Value within = Simd::Subtract(x, Simd::Multiply(tile, Simd::Splat(static_cast<float>(tile_size))));
+		return Simd::Add(Simd::Multiply(tile, Simd::Splat(static_cast<float>(tile_texels))), Spread(within));
+	}
+
+	// the three bits of a whole number below 8 moved apart, 0b111 to 0b10101.
+	static Value Spread(Value x)
+	{
+		Value b2 = DivideWhole(x, 4);
+		Value b1 = Simd::Subtract(DivideWhole(x, 2), Simd::Multiply(b2, Simd::Splat(2.0f)));
+		return Simd::Add(x, Simd::Add(Simd::Multiply(b1, Simd::Splat(2.0f)), Simd::Multiply(b2, Simd::Splat(12.0f))));
+	}
+
+	// floor(x / divisor) of a whole x below 2^22 and a power of two divisor,
+	// cheaper than Simd::Floor. the quotient less (divisor - 1) / 2 / divisor
+	// is within a half of the floor, and adding 1.5 * 2^23 rounds it there.
+	static Value DivideWhole(Value x, int divisor)
+	{
+		Value round = Simd::Splat(12582912.0f);
+		Value centered = Simd::Subtract(x, Simd::Splat((divisor - 1) * 0.5f));
+		return Simd::Subtract(Simd::Add(Simd::Multiply(centered, Simd::Splat(1.0f / divisor)), round), round);
+	}
+
+	// a texture whose indices or sizes a float can not hold exactly goes a
+	// lane at a time through CpuTexture::Sample.
+	static bool IsGatherable(const CpuTexture& texture)
+	{
+		return texture.GetNumTexels() < (1u << 24) && texture.GetWidth() < (1u << 22) && texture.GetHeight() < (1u << 22);
+	}
+
+	static void SampleLanes(const CpuTexture& texture, unsigned int lanes, Value u, Value v, Value level, Value color[4])
+	{
+		float us[width], vs[width], levels[width], colors[4][width];
+		Simd::Store(us, u);
+		Simd::Store(vs, v);
+		Simd::Store(levels, level);
+		for (unsigned int lane = 0; lane != width; ++lane)
+		{
+			float texel[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+			if ((lanes >> lane & 1) != 0) texture.Sample(us[lane], vs[lane], levels[lane], texel);
+			for (unsigned int i = 0; i != 4; ++i) colors[i][lane] = texel[i];
+		}
+		for (unsigned int i = 0; i != 4; ++i) color[i] = Simd::Load(colors[i]);
+	}
+};
+
+#endif  // _CPU_SIMD_TEXTURE_HPP_INCLUDED_
@@ -0,0 +1,172 @@
+#include "common.hpp"
+#include "cpu_simd_vm.hpp"
+
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// defined by the kernel of each instruction set.
+extern const CpuSimdVm::KernelFactory create_sse2_kernel;
+extern const CpuSimdVm::KernelFactory create_avx2_kernel;
+extern const CpuSimdVm::KernelFactory create_avx512_kernel;
+extern const CpuSimdVm::MathFunction run_sse2_math;
+extern const CpuSimdVm::MathFunction run_avx2_math;
+extern const CpuSimdVm::MathFunction run_avx512_math;
+extern const CpuSimdVm::NoiseFunction run_sse2_noise;
+extern const CpuSimdVm::NoiseFunction run_avx2_noise;
+extern const CpuSimdVm::NoiseFunction run_avx512_noise;
+extern const CpuSimdVm::SampleFunction run_sse2_sample;
+extern const CpuSimdVm::SampleFunction run_avx2_sample;
+extern const CpuSimdVm::SampleFunction run_avx512_sample;
+
+static CpuSimdVm::KernelFactory GetKernelFactory(CpuSimdVm::InstructionSet instruction_set)
+{
+	switch (instruction_set)
+	{
+	case CpuSimdVm::IS_Sse2: return create_sse2_kernel;
+	case CpuSimdVm::IS_Avx2: return create_avx2_kernel;
+	case CpuSimdVm::IS_Avx512: return create_avx512_kernel;
+	default: return NULL;
+	}
+}
+
+// the wider sets also need the os to save their registers on a switch.
+static bool CpuSupports(CpuSimdVm::InstructionSet instruction_set)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	if (instruction_set == CpuSimdVm::IS_Sse2) return (info[3] & 1 << 26) != 0;
+	if ((info[2] & 1 << 27) == 0 || max_leaf < 7) return false;
+
+	unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	if (instruction_set == CpuSimdVm::IS_Avx2) return (info[1] & 1 << 5) != 0 && (xcr0 & 0x06) == 0x06;
+	return (info[1] & 1 << 16) != 0 && (xcr0 & 0xe6) == 0xe6;
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	__builtin_cpu_init();
+	if (instruction_set == CpuSimdVm::IS_Sse2) return __builtin_cpu_supports("sse2") != 0;
+	if (instruction_set == CpuSimdVm::IS_Avx2) return __builtin_cpu_supports("avx2") != 0;
+	return __builtin_cpu_supports("avx512f") != 0;
+#else
+	return false;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuSimdVm::CpuSimdVm(const CpuBytecode& bytecode, InstructionSet instruction_set)
+	: m_instruction_set(IsSupported(instruction_set) ? instruction_set : GetBestInstructionSet())
+	, m_kernel(GetKernelFactory(m_instruction_set)(bytecode))
+{
+
+}
+
+CpuSimdVm::CpuSimdVm(const boost::shared_ptr<Kernel>& kernel, InstructionSet instruction_set)
+	: m_instruction_set(instruction_set)
+	, m_kernel(kernel)
+{
+
+}
+
+CpuSimdVm::~CpuSimdVm()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool CpuSimdVm::IsSupported(InstructionSet instruction_set)
+{
+	return GetKernelFactory(instruction_set) != NULL && CpuSupports(instruction_set);
+}
+
+CpuSimdVm::InstructionSet CpuSimdVm::GetBestInstructionSet()
+{
+	if (IsSupported(IS_Avx512)) return IS_Avx512;
+	if (IsSupported(IS_Avx2)) return IS_Avx2;
+	return IS_Sse2;
+}
+
+const char* CpuSimdVm::GetInstructionSetName(InstructionSet instruction_set)
+{
+	static const char* names[] = {"sse2", "avx2", "avx512"};
+	return names[instruction_set];
+}
+
+unsigned int CpuSimdVm::GetWidth(InstructionSet instruction_set)
+{
+	return 4u << instruction_set;
+}
+
+CpuSimdVm::MathFunction CpuSimdVm::GetMathFunction(InstructionSet instruction_set)
+{
+	if (!IsSupported(instruction_set)) return NULL;
+	switch (instruction_set)
+	{
+	case IS_Sse2: return run_sse2_math;
+	case IS_Avx2: return run_avx2_math;
+	case IS_Avx512: return run_avx512_math;
+	default: return NULL;
+	}
+}
+
+CpuSimdVm::NoiseFunction CpuSimdVm::GetNoiseFunction(InstructionSet instruction_set)
+{
+	if (!IsSupported(instruction_set)) return NULL;
+	switch (instruction_set)
+	{
+	case IS_Sse2: return run_sse2_noise;
+	case IS_Avx2: return run_avx2_noise;
+	case IS_Avx512: return run_avx512_noise;
+	default: return NULL;
+	}
+}
+
+CpuSimdVm::SampleFunction CpuSimdVm::GetSampleFunction(InstructionSet instruction_set)
+{
+	if (!IsSupported(instruction_set)) return NULL;
+	switch (instruction_set)
+	{
+	case IS_Sse2: return run_sse2_sample;
+	case IS_Avx2: return run_avx2_sample;
+	case IS_Avx512: return run_avx512_sample;
+	default: return NULL;
+	}
+}
+
+CpuSimdVm::InstructionSet CpuSimdVm::GetInstructionSet() const
+{
+	return m_instruction_set;
+}
+
+unsigned int CpuSimdVm::GetWidth() const
+{
+	return GetWidth(m_instruction_set);
+}
+
+void CpuSimdVm::SetConstants(const std::vector<float>& constants)
+{
+	m_kernel->SetConstants(constants);
+}
+
+void CpuSimdVm::SetTexture(size_t slot, const CpuTexture* texture)
+{
+	m_kernel->SetTexture(slot, texture);
+}
+
+unsigned int CpuSimdVm::Run(const float* inputs, unsigned int lanes, float* outputs)
+{
+	return m_kernel->Run(inputs, lanes, outputs);
+}
+
+size_t CpuSimdVm::GetNumCutOffLoops() const
+{
+	return m_kernel->GetNumCutOffLoops();
+}
+
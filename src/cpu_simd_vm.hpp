@@ -0,0 +1,93 @@
+#ifndef _CPU_SIMD_VM_HPP_INCLUDED_
+#define _CPU_SIMD_VM_HPP_INCLUDED_
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "cpu_bytecode.hpp"
+#include "cpu_texture.hpp"
+
+// runs bytecode on several pixels at once, the way a gpu does: a register
+// holds each component for all the lanes side by side, so that one op is
+// one vector instruction per component. lanes that branch apart are turned
+// off by an execution mask, and code that no lane takes is jumped over. the
+// kernel of the widest instruction set both the cpu and the build support
+// is picked at run time. it gives the bits the scalar vm gives.
+class CpuSimdVm
+{
+public:
+	enum InstructionSet
+	{
+		IS_Sse2,			// 4 lanes
+		IS_Avx2,			// 8 lanes
+		IS_Avx512,			// 16 lanes
+		Num_InstructionSets,
+	};
+
+	// the vm built for one instruction set.
+	class Kernel
+	{
+	public:
+		virtual ~Kernel() {}
+		virtual void SetConstants(const std::vector<float>& constants) = 0;
+		virtual void SetTexture(size_t slot, const CpuTexture* texture) = 0;
+		virtual unsigned int Run(const float* inputs, unsigned int lanes, float* outputs) = 0;
+		virtual size_t GetNumCutOffLoops() const = 0;
+	};
+
+	// each instruction set's kernel is compiled on its own, and its factory
+	// is null where the compiler can not target it.
+	typedef Kernel* (*KernelFactory)(const CpuBytecode& bytecode);
+
+	// a transcendental op of the bytecode, precise or fast, on a vector of
+	// the width of the set, the way the kernel computes it.
+	typedef void (*MathFunction)(unsigned int opcode, unsigned int precision, const float* a, const float* b, float* result);
+
+	// a noise op of the bytecode, its components the width of the set apart.
+	typedef void (*NoiseFunction)(unsigned int opcode, unsigned int size, unsigned int precision, const float* a, const float* b, float* result);
+
+	// CpuTexture::Sample on the lanes set, the channels of color the width
+	// of the set apart. a null level is the one Sample picks by the quads.
+	typedef void (*SampleFunction)(const CpuTexture* texture, unsigned int lanes, const float* u, const float* v, const float* level, float* color);
+
+public:
+	explicit CpuSimdVm(const CpuBytecode& bytecode, InstructionSet instruction_set = GetBestInstructionSet());
+
+	// runs a kernel made elsewhere, as the native one, of the width of the
+	// instruction set.
+	CpuSimdVm(const boost::shared_ptr<Kernel>& kernel, InstructionSet instruction_set);
+	virtual ~CpuSimdVm();
+
+public:
+	// whether both the cpu and this build can run it.
+	static bool IsSupported(InstructionSet instruction_set);
+	static InstructionSet GetBestInstructionSet();
+	static const char* GetInstructionSetName(InstructionSet instruction_set);
+	static unsigned int GetWidth(InstructionSet instruction_set);
+
+	// null unless the set is supported.
+	static MathFunction GetMathFunction(InstructionSet instruction_set);
+	static NoiseFunction GetNoiseFunction(InstructionSet instruction_set);
+	static SampleFunction GetSampleFunction(InstructionSet instruction_set);
+
+	InstructionSet GetInstructionSet() const;
+	unsigned int GetWidth() const;
+
+	// the cbuffer, laid out the way the program packed it.
+	void SetConstants(const std::vector<float>& constants);
+	void SetTexture(size_t slot, const CpuTexture* texture);
+
+	// runs the lanes whose bits are set, a pixel each. four floats per
+	// parameter of the entry point per lane come in, a lane's after the one
+	// before, for every lane of the width. a color per lane goes out. returns
+	// the lanes not discarded, the colors of the others are left alone.
+	unsigned int Run(const float* inputs, unsigned int lanes, float* outputs);
+
+	// loops cut off so far, counted per lane.
+	size_t GetNumCutOffLoops() const;
+
+private:
+	InstructionSet m_instruction_set;
+	boost::shared_ptr<Kernel> m_kernel;
+};
+
+#endif  // _CPU_SIMD_VM_HPP_INCLUDED_
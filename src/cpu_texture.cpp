@@ -0,0 +1,166 @@
+#include "common.hpp"
+#include "cpu_texture.hpp"
+#include "image_file.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+const unsigned char CpuTexture::spread[tile_size] = {0, 1, 4, 5, 16, 17, 20, 21};
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+CpuTexture::CpuTexture()
+	: m_width(0)
+	, m_height(0)
+{
+
+}
+
+CpuTexture::~CpuTexture()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void CpuTexture::Create(size_t width, size_t height, const std::vector<unsigned char>& pixels)
+{
+	m_width = width;
+	m_height = height;
+	m_levels.clear();
+	m_texels.clear();
+	if (width == 0 || height == 0) return;
+
+	// each level halves the one above down to a texel, a box filter on the
+	// rgba8 texels as D3DX builds the chain. a side of one stays one.
+	std::vector<unsigned char> bytes(pixels.begin(), pixels.begin() + width * height * 4);
+	for (;;)
+	{
+		Level level;
+		level.width = width;
+		level.height = height;
+		level.tiles_per_row = (width + tile_size - 1) / tile_size;
+		level.offset = m_texels.size();
+		size_t tile_rows = (height + tile_size - 1) / tile_size;
+		m_texels.resize(level.offset + level.tiles_per_row * tile_rows * tile_size * tile_size * 4, 0.0f);
+		m_levels.push_back(level);
+
+		for (size_t y = 0; y != height; ++y)
+		{
+			for (size_t x = 0; x != width; ++x)
+			{
+				const unsigned char* pixel = &bytes[(y * width + x) * 4];
+				float* texel = &m_texels[GetTexelOffset(level, x, y)];
+				for (size_t i = 0; i != 4; ++i) texel[i] = pixel[i] / 255.0f;
+			}
+		}
+		if (width == 1 && height == 1) break;
+
+		size_t next_width = std::max<size_t>(width / 2, 1), next_height = std::max<size_t>(height / 2, 1);
+		std::vector<unsigned char> next(next_width * next_height * 4);
+		for (size_t y = 0; y != next_height; ++y)
+		{
+			size_t y0 = y * 2, y1 = std::min(y * 2 + 1, height - 1);
+			for (size_t x = 0; x != next_width; ++x)
+			{
+				size_t x0 = x * 2, x1 = std::min(x * 2 + 1, width - 1);
+				for (size_t i = 0; i != 4; ++i)
+				{
+					unsigned int sum = bytes[(y0 * width + x0) * 4 + i] + bytes[(y0 * width + x1) * 4 + i];
+					sum += bytes[(y1 * width + x0) * 4 + i] + bytes[(y1 * width + x1) * 4 + i];
+					next[(y * next_width + x) * 4 + i] = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+		bytes.swap(next);
+		width = next_width;
+		height = next_height;
+	}
+}
+
+bool CpuTexture::LoadBmp(const std::string& path)
+{
+	size_t width = 0, height = 0;
+	std::vector<unsigned char> pixels;
+	if (!ImageFile::LoadBmp(path, width, height, pixels)) return false;
+	Create(width, height, pixels);
+	return true;
+}
+
+size_t CpuTexture::GetWidth() const
+{
+	return m_width;
+}
+
+size_t CpuTexture::GetHeight() const
+{
+	return m_height;
+}
+
+size_t CpuTexture::GetNumLevels() const
+{
+	return m_levels.size();
+}
+
+const CpuTexture::Level& CpuTexture::GetLevel(size_t level) const
+{
+	return m_levels[level];
+}
+
+void CpuTexture::Sample(float u, float v, float level, float color[4]) const
+{
+	if (m_levels.empty())
+	{
+		color[0] = color[1] = color[2] = color[3] = 0.0f;
+		return;
+	}
+
+	// a nan level is the top one.
+	float last = static_cast<float>(m_levels.size() - 1);
+	float clamped = level > 0.0f ? (level < last ? level : last) : 0.0f;
+	float whole = std::floor(clamped);
+	float fraction = clamped - whole;
+	size_t index = static_cast<size_t>(whole);
+	SampleLevel(index, u, v, color);
+	if (fraction > 0.0f)
+	{
+		float next[4];
+		SampleLevel(index + 1, u, v, next);
+		for (size_t i = 0; i != 4; ++i) color[i] = color[i] + (next[i] - color[i]) * fraction;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void CpuTexture::SampleLevel(size_t level, float u, float v, float color[4]) const
+{
+	// texel centers sit at half coordinates, the four around are blended.
+	const Level& at = m_levels[level];
+	float x = u * at.width - 0.5f;
+	float y = v * at.height - 0.5f;
+	float x0 = std::floor(x), y0 = std::floor(y);
+	float fx = x - x0, fy = y - y0;
+	if (!(fx >= 0.0f && fx <= 1.0f) || !(fy >= 0.0f && fy <= 1.0f))
+	{
+		color[0] = color[1] = color[2] = color[3] = 0.0f;
+		return;
+	}
+
+	size_t ix = Wrap(x0, at.width), iy = Wrap(y0, at.height);
+	size_t ix1 = ix + 1 == at.width ? 0 : ix + 1;
+	size_t iy1 = iy + 1 == at.height ? 0 : iy + 1;
+
+	const float* t00 = GetTexel(at, ix, iy);
+	const float* t10 = GetTexel(at, ix1, iy);
+	const float* t01 = GetTexel(at, ix, iy1);
+	const float* t11 = GetTexel(at, ix1, iy1);
+	for (size_t i = 0; i != 4; ++i)
+	{
+		float top = t00[i] + (t10[i] - t00[i]) * fx;
+		float bottom = t01[i] + (t11[i] - t01[i]) * fx;
+		color[i] = top + (bottom - top) * fy;
+	}
+}
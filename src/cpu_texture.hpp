@@ -0,0 +1,93 @@
+#ifndef _CPU_TEXTURE_HPP_INCLUDED_
+#define _CPU_TEXTURE_HPP_INCLUDED_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+class CpuTexture;
+typedef boost::shared_ptr<CpuTexture> CpuTexturePtr;
+
+// a texture the cpu renderer samples, rgba8 stored as floats, with the mip
+// chain D3DX builds for the editor's texture. sampled the way the sampler
+// of PostProcess does: trilinear, with wrapped coordinates.
+//
+// a level is stored in tiles of 8x8 texels, row by row, and the texels of
+// a tile in morton order, so that the four a bilinear sample reads are in
+// one cache line or two, and a quad of pixels reads few more.
+class CpuTexture
+{
+public:
+	enum { tile_size = 8 };
+
+	struct Level
+	{
+		size_t width;
+		size_t height;
+		size_t tiles_per_row;
+		size_t offset;			// of its first texel, in floats
+	};
+
+public:
+	CpuTexture();
+	virtual ~CpuTexture();
+
+public:
+	// rgba8 pixels, top row first.
+	void Create(size_t width, size_t height, const std::vector<unsigned char>& pixels);
+	bool LoadBmp(const std::string& path);
+
+	size_t GetWidth() const;
+	size_t GetHeight() const;
+	size_t GetNumLevels() const;
+	const Level& GetLevel(size_t level) const;
+
+	// level is clamped to the chain, and a fraction blends the two around.
+	// a pixel alone has no derivatives to pick the level of a Sample by, so
+	// the scalar engines give it the top one; the quad engines pick it with
+	// SimdTexture::ImplicitLevel.
+	void Sample(float u, float v, float level, float color[4]) const;
+
+	// the four floats of a texel.
+	const float* GetTexel(const Level& level, size_t x, size_t y) const
+	{
+		return &m_texels[GetTexelOffset(level, x, y)];
+	}
+
+	// the texels of every level, four floats each, for the vector samplers
+	// to gather from, and the index of one among them.
+	const float* GetTexels() const { return &m_texels[0]; }
+	size_t GetNumTexels() const { return m_texels.size() / 4; }
+	static size_t GetTexelIndex(const Level& level, size_t x, size_t y) { return GetTexelOffset(level, x, y) / 4; }
+
+	// the texel a whole coordinate wraps to, as fmod would have it.
+	static size_t Wrap(float x, size_t size)
+	{
+		// most land on the texture or a texel off it, no division needed.
+		long n = static_cast<long>(size);
+		if (x >= -1.0f && x < static_cast<float>(size)) return x < 0.0f ? size - 1 : static_cast<size_t>(x);
+		long i = std::fabs(x) < 2147483648.0f ? static_cast<long>(x) % n : static_cast<long>(std::fmod(x, static_cast<float>(size)));
+		return static_cast<size_t>(i < 0 ? i + n : i);
+	}
+
+private:
+	static size_t GetTexelOffset(const Level& level, size_t x, size_t y)
+	{
+		size_t tile = (y / tile_size) * level.tiles_per_row + x / tile_size;
+		size_t morton = spread[x % tile_size] | spread[y % tile_size] << 1;
+		return level.offset + (tile * tile_size * tile_size + morton) * 4;
+	}
+
+	void SampleLevel(size_t level, float u, float v, float color[4]) const;
+
+private:
+	static const unsigned char spread[tile_size];	// the bits of x apart
+
+	size_t m_width;
+	size_t m_height;
+	std::vector<Level> m_levels;
+	std::vector<float> m_texels;
+};
+
+#endif  // _CPU_TEXTURE_HPP_INCLUDED_
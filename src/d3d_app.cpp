@@ -2,10 +2,14 @@
 
 #include <algorithm>
 #include <numeric>
+#include <cstring>
 #include <boost/bind.hpp>
 #include "ayw/vector.hpp"
 #include "ayw/constant.hpp"
 #include "d3d_app.hpp"
+#include "fxc_shader_compiler.hpp"
+#include "cached_shader_compiler.hpp"
+#include "compile_server.hpp"
 using namespace Ayw;
 
 const tstring g_app_title = TEXT("LiVE HLSL");
@@ -13,6 +17,22 @@ const tstring g_app_title = TEXT("LiVE HLSL");
 const int g_aa_sample = 4;
 const float g_aa_warm_time = 0.2f;
 
+const float g_live_compile_delay = 0.5f;
+
+const char g_shader_cache_dir[] = "cache/shaders";
+const size_t g_shader_cache_memory = 16 * 1024 * 1024;
+const size_t g_shader_cache_files = 256;
+
+// with this switch on the command line, shaders compile in worker processes.
+const char g_compile_server_switch[] = "--compile-server";
+#ifdef _DEBUG
+const char g_compile_worker_path[] = "compile_worker_debug.exe";
+#else
+const char g_compile_worker_path[] = "compile_worker.exe";
+#endif
+const size_t g_compile_workers = 2;
+const unsigned int g_compile_timeout = 10000;
+
 struct ShaderParameters
 {
 	float4 time;		// time related parameters
@@ -63,6 +83,11 @@ SoundPlayerPtr D3DApp::GetSoundPlayer()
 	return g_app.m_sound_player;
 }
 
+ShaderCompilerPtr D3DApp::GetShaderCompiler()
+{
+	return g_app.m_shader_compiler;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // constructor / destructor
 //////////////////////////////////////////////////////////////////////////
@@ -280,6 +305,11 @@ LRESULT CALLBACK D3DApp::WindowProc(HWND hwnd, UINT message, WPARAM wparam, LPAR
 				app->m_aa_control_time = 0;
 				return 0;
 			}
+			else if (key_code == VK_F5)
+			{
+				if (editor) editor->SetLiveCompile(!editor->GetLiveCompile(), g_live_compile_delay);
+				return 0;
+			}
 			else if (key_code == VK_OEM_PLUS && held_control)
 			{
 				if (app->m_sound_player) app->m_sound_player->ChangeVolume(0.1f);
@@ -376,12 +406,13 @@ void D3DApp::TimerEventsProc(int cnt, const tstring& tag)
 
 		char title[512] = {0};
 		sprintf_s(title,
-			TEXT("%s     [ ShowEditor(F1):%s | BgMusic(F2):%s | Anti-Aliasing(F3):%s | Half-Res(F4):%s ]     [ FPS:%.1f | CPU:%.1fms | GPU:%.1fms ]"),
+			TEXT("%s     [ ShowEditor(F1):%s | BgMusic(F2):%s | Anti-Aliasing(F3):%s | Half-Res(F4):%s | LiveCompile(F5):%s ]     [ FPS:%.1f | CPU:%.1fms | GPU:%.1fms ]"),
 			g_app_title.c_str(),
 			!m_hide_editor ? TEXT("on") : TEXT("off"),
 			!m_sound_player->GetMute() ? TEXT("on") : TEXT("off"),
 			m_aa_enabled ? TEXT("on") : TEXT("off"),
 			m_half_resolution ? TEXT("on") : TEXT("off"),
+			m_text_editor->GetLiveCompile() ? TEXT("on") : TEXT("off"),
 			fps,
 			cpu_time,
 			gpu_time);
@@ -622,6 +653,20 @@ bool D3DApp::InitializeScene()
 
 bool D3DApp::InitializeShaders()
 {
+	ShaderCachePtr shader_cache(new ShaderCache(g_shader_cache_dir, g_shader_cache_memory, g_shader_cache_files));
+	ShaderCompilerPtr compiler(new FxcShaderCompiler);
+
+	// a compiler crash or hang then only fails that compile. if no worker
+	// comes up, compiling stays in process.
+	if (strstr(GetCommandLineA(), g_compile_server_switch) != NULL)
+	{
+		std::vector<std::string> worker_command(1, g_compile_worker_path);
+		CompileServerPtr compile_server(new CompileServer(worker_command, g_compile_workers));
+		compile_server->SetTimeout(g_compile_timeout);
+		if (compile_server->Start()) compiler = compile_server;
+	}
+	m_shader_compiler = ShaderCompilerPtr(new CachedShaderCompiler(compiler, shader_cache));
+
 	m_custom_pp = PostProcessPtr(new PostProcess);
 
 	m_combine_pp = PostProcessPtr(new PostProcess);
@@ -5,6 +5,7 @@
 #include "post_process.hpp"
 #include "text_editor.hpp"
 #include "sound_player.hpp"
+#include "shader_compiler.hpp"
 
 class D3DApp
 {
@@ -31,6 +32,7 @@ public:
 	static HRTimer* GetTimer();
 	static PostProcessPtr GetPostProcess();
 	static SoundPlayerPtr GetSoundPlayer();
+	static ShaderCompilerPtr GetShaderCompiler();
 
 public:
 	static LRESULT CALLBACK WindowProc(HWND hwnd, UINT message, WPARAM wparam, LPARAM lparam);
@@ -88,6 +90,7 @@ private:
 	IDXGIKeyedMutex* m_keyed_mutex11;
 	IDXGIKeyedMutex* m_keyed_mutex10;
 
+	ShaderCompilerPtr m_shader_compiler;
 	PostProcessPtr m_custom_pp;
 	PostProcessPtr m_resolve_pp;
 	PostProcessPtr m_combine_pp;
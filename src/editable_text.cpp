@@ -7,6 +7,7 @@
 // constructor / destructor
 //////////////////////////////////////////////////////////////////////////
 EditableText::EditableText()
+	: m_revision(0)
 {
 	SetCaretPos(0);
 	SetSelection(0, 0);
@@ -37,6 +38,7 @@ bool EditableText::Selection::IsValid(int text_length /* = -1 */) const
 void EditableText::SetText(const std::wstring& text)
 {
 	m_text = text;
+	++m_revision;
 	SetCaretPos(0);
 	UpdateHorizenPos();
 
@@ -187,6 +189,7 @@ void EditableText::InsertText(const std::wstring& text)
 {
 	DeleteSelection();
 	m_text.insert(m_text.begin() + m_caret_pos, text.begin(), text.end());
+	++m_revision;
 	SetCaretPos(m_caret_pos + text.length());
 
 	EditOperation op = {EO_Insert, m_caret_pos - text.length(), text};
@@ -202,6 +205,7 @@ void EditableText::DeleteSelection()
 	size_t right = std::max(m_selection.start_pos, m_selection.end_pos);
 	std::wstring text_to_del(m_text.begin() + left, m_text.begin() + right);
 	m_text.erase(m_text.begin() + left, m_text.begin() + right);
+	++m_revision;
 	SetCaretPos(left);
 
 	EditOperation op = {EO_Delete, left, text_to_del};
@@ -270,11 +274,13 @@ void EditableText::Undo()
 	if (op.type == EO_Delete)
 	{
 		m_text.insert(m_text.begin() + op.pos, op.text.begin(), op.text.end());
+		++m_revision;
 		SetCaretPos(op.pos + op.text.length());
 	}
 	else if (op.type == EO_Insert)
 	{
 		m_text.erase(m_text.begin() + op.pos, m_text.begin() + op.pos + op.text.length());
+		++m_revision;
 		SetCaretPos(op.pos);
 	}
 }
@@ -290,11 +296,13 @@ void EditableText::Redo()
 	if (op.type == EO_Insert)
 	{
 		m_text.insert(m_text.begin() + op.pos, op.text.begin(), op.text.end());
+		++m_revision;
 		SetCaretPos(op.pos + op.text.length());
 	}
 	else if (op.type == EO_Delete)
 	{
 		m_text.erase(m_text.begin() + op.pos, m_text.begin() + op.pos + op.text.length());
+		++m_revision;
 		SetCaretPos(op.pos);
 	}
 }
@@ -335,6 +343,11 @@ EditableText::Selection EditableText::GetSelection() const
 	return m_selection;
 }
 
+size_t EditableText::GetRevision() const
+{
+	return m_revision;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // private subroutines
 //////////////////////////////////////////////////////////////////////////
@@ -66,6 +66,9 @@ public:
 	size_t GetCaretLine() const;
 	Selection GetSelection() const;
 
+	// increased whenever the text content changes.
+	size_t GetRevision() const;
+
 private:
 	void SetSelection(size_t start, size_t end);
 	void SetSelectionStart(size_t start);
@@ -82,6 +85,7 @@ private:
 	size_t m_caret_pos;
 	size_t m_horizen_pos;
 	Selection m_selection;
+	size_t m_revision;
 
 	std::vector<EditOperation> m_undo_records;
 	std::vector<EditOperation> m_redo_records;
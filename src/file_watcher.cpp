@@ -0,0 +1,70 @@
+#include "common.hpp"
+#include "file_watcher.hpp"
+#include "polling_file_watcher.hpp"
+
+#if defined(_WIN32)
+#include "win32_file_watcher.hpp"
+#elif defined(__linux__)
+#include "inotify_file_watcher.hpp"
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// file watcher
+//////////////////////////////////////////////////////////////////////////
+FileWatcherPtr FileWatcher::Create()
+{
+#if defined(_WIN32)
+	boost::shared_ptr<Win32FileWatcher> native_watcher(new Win32FileWatcher());
+#elif defined(__linux__)
+	boost::shared_ptr<InotifyFileWatcher> native_watcher(new InotifyFileWatcher());
+#endif
+
+#if defined(_WIN32) || defined(__linux__)
+	if (native_watcher->IsValid()) return native_watcher;
+#endif
+	return FileWatcherPtr(new PollingFileWatcher());
+}
+
+//////////////////////////////////////////////////////////////////////////
+// file change debouncer
+//////////////////////////////////////////////////////////////////////////
+FileChangeDebouncer::FileChangeDebouncer(float quiet_time /*= 0.2f*/)
+	: m_quiet_time(quiet_time)
+{
+
+}
+
+void FileChangeDebouncer::SetQuietTime(float quiet_time)
+{
+	m_quiet_time = quiet_time;
+}
+
+void FileChangeDebouncer::AddChanges(const std::vector<std::string>& paths)
+{
+	// another change restarts the wait.
+	for (size_t i = 0; i != paths.size(); ++i)
+	{
+		m_pending[paths[i]] = 0;
+	}
+}
+
+void FileChangeDebouncer::Update(float delta_time, std::vector<std::string>& settled_paths)
+{
+	for (auto it = m_pending.begin(); it != m_pending.end();)
+	{
+		it->second += delta_time;
+		if (it->second < m_quiet_time)
+		{
+			++it;
+			continue;
+		}
+
+		settled_paths.push_back(it->first);
+		m_pending.erase(it++);
+	}
+}
+
+bool FileChangeDebouncer::IsPending() const
+{
+	return !m_pending.empty();
+}
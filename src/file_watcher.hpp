@@ -0,0 +1,52 @@
+#ifndef _FILE_WATCHER_HPP_INCLUDED_
+#define _FILE_WATCHER_HPP_INCLUDED_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+class FileWatcher;
+typedef boost::shared_ptr<FileWatcher> FileWatcherPtr;
+
+// reports files changed on disk, by whatever means the platform offers.
+// paths are narrow, in the platform's file system encoding. a file is
+// watched through its directory, so editors which save by writing a
+// temporary file and renaming it over the original are noticed too.
+class FileWatcher
+{
+public:
+	virtual ~FileWatcher() {}
+
+public:
+	virtual bool Watch(const std::string& path) = 0;
+	virtual void Unwatch(const std::string& path) = 0;
+
+	// never blocks. appends the watched paths changed since the last call,
+	// each once, in no particular order.
+	virtual void ReadChanges(std::vector<std::string>& paths) = 0;
+
+	// the native watcher of this platform, or a polling one.
+	static FileWatcherPtr Create();
+};
+
+// holds changes back until a file stayed quiet for a while, so a save
+// which writes a file in several steps is reported once, after the last.
+class FileChangeDebouncer
+{
+public:
+	explicit FileChangeDebouncer(float quiet_time = 0.2f);
+
+public:
+	void SetQuietTime(float quiet_time);
+
+	void AddChanges(const std::vector<std::string>& paths);
+	void Update(float delta_time, std::vector<std::string>& settled_paths);
+	bool IsPending() const;
+
+private:
+	float m_quiet_time;
+	std::map<std::string, float> m_pending;	// path -> seconds since its last change
+};
+
+#endif  // _FILE_WATCHER_HPP_INCLUDED_
@@ -0,0 +1,61 @@
+#include "common.hpp"
+#include "fxc_shader_compiler.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+FxcShaderCompiler::FxcShaderCompiler()
+{
+
+}
+
+FxcShaderCompiler::~FxcShaderCompiler()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool FxcShaderCompiler::Compile(const ShaderCompileInput& input, ShaderCompileOutput& output)
+{
+	ID3DBlob* error_buffer = NULL;
+	ID3DBlob* shader_buffer = NULL;
+
+	HRESULT hr = D3DX11CompileFromMemory(
+		input.GetSource().c_str(),
+		input.GetSource().length(),
+		NULL,
+		NULL,
+		NULL,
+		input.entry_point.c_str(),
+		input.profile.c_str(),
+		input.flags,
+		0,
+		NULL,
+		&shader_buffer,
+		&error_buffer,
+		NULL);
+
+	output.from_cache = false;
+	output.bytecode.clear();
+	output.error_message.clear();
+
+	if (error_buffer != NULL)
+	{
+		output.error_message = static_cast<const char*>(error_buffer->GetBufferPointer());
+	}
+
+	if (FAILED(hr) || shader_buffer == NULL)
+	{
+		SAFE_RELEASE(shader_buffer);
+		SAFE_RELEASE(error_buffer);
+		return false;
+	}
+
+	const char* code = static_cast<const char*>(shader_buffer->GetBufferPointer());
+	output.bytecode.assign(code, code + shader_buffer->GetBufferSize());
+	SAFE_RELEASE(shader_buffer);
+	SAFE_RELEASE(error_buffer);
+	return true;
+}
@@ -0,0 +1,17 @@
+#ifndef _FXC_SHADER_COMPILER_HPP_INCLUDED_
+#define _FXC_SHADER_COMPILER_HPP_INCLUDED_
+
+#include "shader_compiler.hpp"
+
+// compiles through D3DX11CompileFromMemory.
+class FxcShaderCompiler : public ShaderCompiler
+{
+public:
+	FxcShaderCompiler();
+	virtual ~FxcShaderCompiler();
+
+public:
+	virtual bool Compile(const ShaderCompileInput& input, ShaderCompileOutput& output);
+};
+
+#endif  // _FXC_SHADER_COMPILER_HPP_INCLUDED_
@@ -0,0 +1,94 @@
+#include "common.hpp"
+#include "image_file.hpp"
+
+#include <cstdlib>
+#include <fstream>
+
+static unsigned int ReadLittleEndian(const unsigned char* bytes, size_t num_bytes)
+{
+	unsigned int value = 0;
+	for (size_t i = num_bytes; i != 0; --i) value = value << 8 | bytes[i - 1];
+	return value;
+}
+
+static void WriteLittleEndian(unsigned char* bytes, unsigned int value, size_t num_bytes)
+{
+	for (size_t i = 0; i != num_bytes; ++i, value >>= 8) bytes[i] = static_cast<unsigned char>(value & 0xff);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool ImageFile::LoadBmp(const std::string& path, size_t& width, size_t& height, std::vector<unsigned char>& pixels)
+{
+	std::ifstream ifs(path.c_str(), std::ios::binary);
+	if (!ifs.is_open()) return false;
+
+	// the file header, then a BITMAPINFOHEADER or a later version of it.
+	unsigned char header[54];
+	if (!ifs.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != 'B' || header[1] != 'M') return false;
+	unsigned int data_offset = ReadLittleEndian(header + 10, 4);
+	int signed_width = static_cast<int>(ReadLittleEndian(header + 18, 4));
+	int signed_height = static_cast<int>(ReadLittleEndian(header + 22, 4));
+	unsigned int bits = ReadLittleEndian(header + 28, 2);
+	unsigned int compression = ReadLittleEndian(header + 30, 4);
+	if (signed_width <= 0 || signed_height == 0 || (bits != 24 && bits != 32) || (compression != 0 && compression != 3)) return false;
+
+	width = signed_width;
+	height = std::abs(signed_height);
+	bool is_bottom_up = signed_height > 0;
+	size_t bytes_per_pixel = bits / 8;
+	size_t stride = (width * bytes_per_pixel + 3) / 4 * 4;
+
+	std::vector<unsigned char> row(stride);
+	pixels.resize(width * height * 4);
+	ifs.seekg(data_offset);
+	for (size_t y = 0; y != height; ++y)
+	{
+		if (!ifs.read(reinterpret_cast<char*>(&row[0]), stride)) return false;
+		unsigned char* dest = &pixels[(is_bottom_up ? height - 1 - y : y) * width * 4];
+		for (size_t x = 0; x != width; ++x, dest += 4)
+		{
+			const unsigned char* source = &row[x * bytes_per_pixel];
+			dest[0] = source[2];
+			dest[1] = source[1];
+			dest[2] = source[0];
+			dest[3] = bytes_per_pixel == 4 ? source[3] : 255;
+		}
+	}
+	return true;
+}
+
+bool ImageFile::SaveBmp(const std::string& path, size_t width, size_t height, const std::vector<unsigned char>& pixels)
+{
+	if (pixels.size() < width * height * 4) return false;
+	std::ofstream ofs(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!ofs.is_open()) return false;
+
+	size_t stride = (width * 3 + 3) / 4 * 4;
+	unsigned char header[54] = {'B', 'M'};
+	WriteLittleEndian(header + 2, static_cast<unsigned int>(sizeof(header) + stride * height), 4);
+	WriteLittleEndian(header + 10, sizeof(header), 4);
+	WriteLittleEndian(header + 14, 40, 4);
+	WriteLittleEndian(header + 18, static_cast<unsigned int>(width), 4);
+	WriteLittleEndian(header + 22, static_cast<unsigned int>(height), 4);
+	WriteLittleEndian(header + 26, 1, 2);
+	WriteLittleEndian(header + 28, 24, 2);
+	WriteLittleEndian(header + 34, static_cast<unsigned int>(stride * height), 4);
+	ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	// bottom row first.
+	std::vector<unsigned char> row(stride, 0);
+	for (size_t y = height; y != 0; --y)
+	{
+		const unsigned char* source = &pixels[(y - 1) * width * 4];
+		for (size_t x = 0; x != width; ++x, source += 4)
+		{
+			row[x * 3 + 0] = source[2];
+			row[x * 3 + 1] = source[1];
+			row[x * 3 + 2] = source[0];
+		}
+		ofs.write(reinterpret_cast<const char*>(&row[0]), stride);
+	}
+	return ofs.good();
+}
@@ -0,0 +1,19 @@
+#ifndef _IMAGE_FILE_HPP_INCLUDED_
+#define _IMAGE_FILE_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+
+// reads and writes uncompressed windows bitmaps, the format of the media
+// files, without the platform image libraries. pixels are rgba8, top row
+// first.
+namespace ImageFile
+{
+	// 24 and 32 bit bitmaps, either way up. alpha is opaque for 24 bits.
+	bool LoadBmp(const std::string& path, size_t& width, size_t& height, std::vector<unsigned char>& pixels);
+
+	// a 24 bit bitmap, alpha is dropped.
+	bool SaveBmp(const std::string& path, size_t width, size_t height, const std::vector<unsigned char>& pixels);
+}
+
+#endif  // _IMAGE_FILE_HPP_INCLUDED_
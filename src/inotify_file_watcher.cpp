@@ -0,0 +1,135 @@
+#include "common.hpp"
+#include "inotify_file_watcher.hpp"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+
+static const unsigned int watch_mask =
+	IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM;
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+InotifyFileWatcher::InotifyFileWatcher()
+	: m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+
+}
+
+InotifyFileWatcher::~InotifyFileWatcher()
+{
+	if (m_fd >= 0) close(m_fd);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool InotifyFileWatcher::IsValid() const
+{
+	return m_fd >= 0;
+}
+
+bool InotifyFileWatcher::Watch(const std::string& path)
+{
+	if (m_fd < 0) return false;
+
+	std::string directory, name;
+	SplitPath(path, directory, name);
+
+	auto it = m_directories.find(directory);
+	if (it == m_directories.end())
+	{
+		int descriptor = inotify_add_watch(m_fd, directory.c_str(), watch_mask);
+		if (descriptor < 0) return false;
+
+		it = m_directories.insert(std::make_pair(directory, Directory())).first;
+		it->second.descriptor = descriptor;
+		m_descriptors[descriptor] = directory;
+	}
+
+	it->second.files[name] = path;
+	return true;
+}
+
+void InotifyFileWatcher::Unwatch(const std::string& path)
+{
+	std::string directory, name;
+	SplitPath(path, directory, name);
+
+	auto it = m_directories.find(directory);
+	if (it == m_directories.end()) return;
+
+	it->second.files.erase(name);
+	if (!it->second.files.empty()) return;
+
+	inotify_rm_watch(m_fd, it->second.descriptor);
+	m_descriptors.erase(it->second.descriptor);
+	m_directories.erase(it);
+}
+
+void InotifyFileWatcher::ReadChanges(std::vector<std::string>& paths)
+{
+	if (m_fd < 0) return;
+
+	std::set<std::string> changed;
+	bool overflowed = false;
+
+	// events are aligned to their header, which the buffer has to respect.
+	union
+	{
+		char bytes[4096];
+		struct inotify_event align;
+	} buffer;
+
+	while (true)
+	{
+		ssize_t length = read(m_fd, buffer.bytes, sizeof(buffer.bytes));
+		if (length <= 0) break;
+
+		for (ssize_t offset = 0; offset < length;)
+		{
+			const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer.bytes + offset);
+			offset += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) overflowed = true;
+			if (event->len == 0) continue;
+
+			auto directory = m_descriptors.find(event->wd);
+			if (directory == m_descriptors.end()) continue;
+
+			const std::map<std::string, std::string>& files = m_directories[directory->second].files;
+			auto file = files.find(event->name);
+			if (file != files.end()) changed.insert(file->second);
+		}
+	}
+
+	// events were lost, anything might have changed.
+	if (overflowed)
+	{
+		for (auto it = m_directories.begin(); it != m_directories.end(); ++it)
+		{
+			for (auto file = it->second.files.begin(); file != it->second.files.end(); ++file) changed.insert(file->second);
+		}
+	}
+
+	paths.insert(paths.end(), changed.begin(), changed.end());
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void InotifyFileWatcher::SplitPath(const std::string& path, std::string& directory, std::string& name)
+{
+	size_t slash = path.find_last_of('/');
+	if (slash == std::string::npos)
+	{
+		directory = ".";
+		name = path;
+	}
+	else
+	{
+		directory = slash == 0 ? "/" : path.substr(0, slash);
+		name = path.substr(slash + 1);
+	}
+}
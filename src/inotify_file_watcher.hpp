@@ -0,0 +1,37 @@
+#ifndef _INOTIFY_FILE_WATCHER_HPP_INCLUDED_
+#define _INOTIFY_FILE_WATCHER_HPP_INCLUDED_
+
+#include <set>
+#include "file_watcher.hpp"
+
+// linux change notification, one inotify watch per directory holding
+// watched files. the descriptor is non-blocking, so reads never wait.
+class InotifyFileWatcher : public FileWatcher
+{
+public:
+	InotifyFileWatcher();
+	virtual ~InotifyFileWatcher();
+
+public:
+	bool IsValid() const;
+
+	virtual bool Watch(const std::string& path);
+	virtual void Unwatch(const std::string& path);
+	virtual void ReadChanges(std::vector<std::string>& paths);
+
+private:
+	struct Directory
+	{
+		int descriptor;
+		std::map<std::string, std::string> files;	// file name -> watched path
+	};
+
+	static void SplitPath(const std::string& path, std::string& directory, std::string& name);
+
+private:
+	int m_fd;
+	std::map<std::string, Directory> m_directories;
+	std::map<int, std::string> m_descriptors;
+};
+
+#endif  // _INOTIFY_FILE_WATCHER_HPP_INCLUDED_
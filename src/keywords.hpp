@@ -2,16 +2,22 @@
 #define _KEYWORDS_INCLUDED_HPP_
 
 #include <string>
+#include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/repetition.hpp>
+#include <boost/preprocessor/stringize.hpp>
 
-#define MAKE_SUFFIX_1D(_, i, s) L#s##L#i,
-#define MAKE_SUFFIX_2D_1(_, j, s) L#s##L"1"##L"x"##L#j,
-#define MAKE_SUFFIX_2D_2(_, j, s) L#s##L"2"##L"x"##L#j,
-#define MAKE_SUFFIX_2D_3(_, j, s) L#s##L"3"##L"x"##L#j,
-#define MAKE_SUFFIX_2D_4(_, j, s) L#s##L"4"##L"x"##L#j,
+// wide literals are built by pasting L onto a stringized name, the
+// adjacent pieces are then joined by the compiler.
+#define WIDE_NAME(s) BOOST_PP_CAT(L, BOOST_PP_STRINGIZE(s))
+
+#define MAKE_SUFFIX_1D(_, i, s) WIDE_NAME(s) WIDE_NAME(i),
+#define MAKE_SUFFIX_2D_1(_, j, s) WIDE_NAME(s) L"1x" WIDE_NAME(j),
+#define MAKE_SUFFIX_2D_2(_, j, s) WIDE_NAME(s) L"2x" WIDE_NAME(j),
+#define MAKE_SUFFIX_2D_3(_, j, s) WIDE_NAME(s) L"3x" WIDE_NAME(j),
+#define MAKE_SUFFIX_2D_4(_, j, s) WIDE_NAME(s) L"4x" WIDE_NAME(j),
 
 #define DECLARE_TYPE_1D(type) \
-	L###type, BOOST_PP_REPEAT_FROM_TO(2, 5, MAKE_SUFFIX_1D, type)
+	WIDE_NAME(type), BOOST_PP_REPEAT_FROM_TO(2, 5, MAKE_SUFFIX_1D, type)
 
 #define DECLARE_TYPE_2D(type) \
 	BOOST_PP_REPEAT_FROM_TO(1, 5, MAKE_SUFFIX_2D_1, type) \
@@ -20,27 +26,29 @@
 	BOOST_PP_REPEAT_FROM_TO(1, 5, MAKE_SUFFIX_2D_4, type)
 
 #define DECLARE_SEMANTIC(semantic, n) \
-	L###semantic, BOOST_PP_REPEAT(n, MAKE_SUFFIX_1D, semantic)
+	WIDE_NAME(semantic), BOOST_PP_REPEAT(n, MAKE_SUFFIX_1D, semantic)
 
 static const std::wstring kewords[] =
 {
 	DECLARE_TYPE_1D(bool)
 	DECLARE_TYPE_1D(int)
+	DECLARE_TYPE_1D(uint)
 	DECLARE_TYPE_1D(half)
 	DECLARE_TYPE_1D(float)
 	DECLARE_TYPE_2D(float)
 	L"blendstate", L"break", L"buffer",
-	L"cbuffer", L"class", L"compile", L"const", L"continue",
-	L"depthstencilstate", L"depthstencilview", L"discard", L"do", L"double", L"define",
+	L"case", L"cbuffer", L"centroid", L"class", L"column_major", L"compile", L"const", L"continue",
+	L"depthstencilstate", L"depthstencilview", L"discard", L"do", L"double", L"default", L"define", L"dword",
 	L"else", L"extern", L"endif",
 	L"false", L"for",
-	L"geometryshader",
+	L"geometryshader", L"groupshared",
 	L"if", L"in", L"inline", L"ifdef", L"ifndef", L"inout", L"interface",
+	L"linear",
 	L"matrix",
-	L"namespace", L"nointerpolation",
+	L"namespace", L"nointerpolation", L"noperspective",
 	L"out",
 	L"pass", L"pixelshader", L"precise",
-	L"rasterizerstate", L"rendertargetview", L"return", L"register",
+	L"rasterizerstate", L"rendertargetview", L"return", L"register", L"row_major",
 	L"sampler", L"sampler1D", L"sampler2D", L"sampler3D", L"samplerCUBE", L"SamplerState", L"SamplerComparisonState", L"shared", L"stateblock", L"stateblock_state", L"static", L"string", L"struct", L"switch",
 	L"tbuffer", L"technique", L"technique10", L"texture", L"Texture1D", L"Texture1DArray", L"Texture2D", L"Texture2DArray", L"Texture2DMS", L"Texture2DMSArray", L"Texture3D", L"TextureCube", L"TextureCubeArray", L"true", L"typedef",
 	L"uniform",
@@ -252,6 +260,7 @@ static const std::wstring member_funcs[] =
 	L"SampleLevel",
 };
 
+#undef WIDE_NAME
 #undef MAKE_SUFFIX_1D
 #undef MAKE_SUFFIX_2D_1
 #undef MAKE_SUFFIX_2D_2
@@ -0,0 +1,306 @@
+#include "common.hpp"
+#include "shader_linter.hpp"
+#include "shader_include_graph.hpp"
+#include "shader_symbol_index.hpp"
+#include "shader_autocomplete.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// lints shaders the way the editor does between keystrokes:
+//   lint_shaders [options] [file|directory ...]
+// run from the bin directory, it checks save/ against the headers in fx/.
+// with --benchmark it also times the parse, lint and symbol index after single
+// character edits. test_shader_parser makes sure the reparsed tree and the
+// updated index are the ones a full parse gives.
+
+static const char default_shader_directory[] = "save";
+static const char default_header_directory[] = "fx/";
+static const char header_root[] = "header.hlsl";
+
+static void PrintUsage()
+{
+	std::cerr <<
+		"usage: lint_shaders [options] [file|directory ...]\n"
+		"  --fx DIR             header directory, fx/ by default\n"
+		"  -b, --benchmark N    time N single character edits per file\n"
+		"  -t, --tree           print the syntax tree\n"
+		"  -q, --quiet          no diagnostics, only the exit code\n";
+}
+
+typedef boost::posix_time::ptime TimePoint;
+
+static TimePoint Now()
+{
+	return boost::posix_time::microsec_clock::universal_time();
+}
+
+static double Microseconds(const TimePoint& begin, const TimePoint& end)
+{
+	return static_cast<double>((end - begin).total_microseconds());
+}
+
+static bool ReadShader(const std::string& path, std::wstring& text)
+{
+	std::ifstream ifs(path.c_str(), std::ios::binary);
+	if (!ifs.is_open()) return false;
+
+	// the editor reads one character per byte as well.
+	std::string bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	text.resize(bytes.length());
+	for (size_t i = 0; i != bytes.length(); ++i) text[i] = static_cast<unsigned char>(bytes[i]);
+	text.erase(std::remove(text.begin(), text.end(), L'\r'), text.end());
+	return true;
+}
+
+static void PrintDiagnostics(const std::string& file, const std::wstring& text, const ShaderLinter& linter)
+{
+	const std::vector<ShaderLinter::Diagnostic>& diagnostics = linter.GetDiagnostics();
+	for (size_t i = 0; i != diagnostics.size(); ++i)
+	{
+		const ShaderLinter::Diagnostic& diagnostic = diagnostics[i];
+		std::cout << file;
+		if (diagnostic.is_located)
+		{
+			size_t line_begin = text.rfind(L'\n', diagnostic.start_pos == 0 ? 0 : diagnostic.start_pos - 1);
+			line_begin = line_begin == std::wstring::npos ? 0 : line_begin + 1;
+			size_t line = std::count(text.begin(), text.begin() + line_begin, L'\n') + 1;
+			std::cout << "(" << line << "," << diagnostic.start_pos - line_begin + 1 << ")";
+		}
+		std::cout << ": error: " << diagnostic.message << "\n";
+	}
+}
+
+static void PrintTree(const ShaderParser& parser, const ShaderParser::NodePtr& node, size_t first, size_t level)
+{
+	const std::vector<ShaderParser::Item>& items = parser.GetItems();
+	std::cout << std::string(level * 2, ' ') << ShaderParser::GetKindName(node->kind);
+	if (!node->text.empty()) std::cout << " '" << std::string(node->text.begin(), node->text.end()) << "'";
+	if (first < items.size()) std::cout << " @" << items[first].token->start_pos;
+	std::cout << "\n";
+
+	for (size_t i = 0; i != node->children.size(); ++i)
+	{
+		const ShaderParser::Child& child = node->children[i];
+		PrintTree(parser, child.node, first + child.offset, level + 1);
+	}
+}
+
+struct BenchmarkTotals
+{
+	size_t num_edits;
+	size_t num_items;
+	size_t num_reused_items;
+	double parse_time;
+	double lint_time;
+	double index_time;
+};
+
+// types a character at pseudo random places and takes it back again,
+// timing the tokenizer, parser, linter and symbol index after every keystroke,
+// then the lookups the editor makes on F12, shift+F12 and ctrl+space.
+static void Benchmark(const std::string& file, const std::wstring& text, const ShaderIncludeGraph& header,
+	size_t num_edits, BenchmarkTotals& totals)
+{
+	ShaderLinter linter;
+	linter.SetHeader(header.GetText(), header.GetHash());
+
+	ShaderTokenizer tokenizer;
+	ShaderParser parser;
+	ShaderSymbolIndex index;
+	TimePoint begin = Now();
+	tokenizer.Tokenize(text);
+	TimePoint tokenized = Now();
+	parser.Parse(text, tokenizer.GetTokens());
+	TimePoint parsed = Now();
+	linter.Lint(parser);
+	TimePoint linted = Now();
+	index.Update(parser);
+	double tokenize_time = Microseconds(begin, tokenized);
+	double cold_parse_time = Microseconds(tokenized, parsed);
+	double cold_lint_time = Microseconds(parsed, linted);
+	double cold_index_time = Microseconds(linted, Now());
+
+	double parse_time = 0, max_parse_time = 0;
+	double lint_time = 0, max_lint_time = 0;
+	double index_time = 0, max_index_time = 0;
+	size_t num_items = 0, num_reused_items = 0;
+	size_t num_analyzed = 0, num_checked = 0, num_indexed = 0;
+	unsigned int seed = 12345;
+	std::wstring edited;
+	for (size_t i = 0; i != num_edits * 2; ++i)
+	{
+		if (i % 2 == 0)
+		{
+			seed = seed * 1103515245 + 12345;
+			size_t pos = (seed >> 8) % (text.length() + 1);
+			edited = text;
+			edited.insert(pos, 1, L'a');
+		}
+
+		const std::wstring& current = i % 2 == 0 ? edited : text;
+		tokenizer.Tokenize(current);
+
+		TimePoint parse_begin = Now();
+		parser.Parse(current, tokenizer.GetTokens());
+		TimePoint lint_begin = Now();
+		linter.Lint(parser);
+		TimePoint lint_end = Now();
+		index.Update(parser);
+		TimePoint index_end = Now();
+
+		double time = Microseconds(parse_begin, lint_begin);
+		parse_time += time;
+		max_parse_time = std::max(max_parse_time, time);
+		time = Microseconds(lint_begin, lint_end);
+		lint_time += time;
+		max_lint_time = std::max(max_lint_time, time);
+		time = Microseconds(lint_end, index_end);
+		index_time += time;
+		max_index_time = std::max(max_index_time, time);
+
+		num_items += parser.GetItems().size();
+		num_reused_items += parser.GetNumReusedItems();
+		num_analyzed += linter.GetNumAnalyzedChunks();
+		num_checked += linter.GetNumCheckedChunks();
+		num_indexed += index.GetNumAnalyzedDeclarations();
+	}
+
+	// every item once, names or not.
+	size_t num_lookups = parser.GetItems().size();
+	std::vector<ShaderSymbolIndex::Symbol> definitions;
+	std::vector<size_t> references;
+	TimePoint lookup_begin = Now();
+	for (size_t i = 0; i != num_lookups; ++i) index.FindDefinitions(i, definitions);
+	TimePoint lookup_middle = Now();
+	for (size_t i = 0; i != num_lookups; ++i) index.FindReferences(i, references);
+	double definition_time = Microseconds(lookup_begin, lookup_middle) / std::max<size_t>(num_lookups, 1);
+	double reference_time = Microseconds(lookup_middle, Now()) / std::max<size_t>(num_lookups, 1);
+
+	// every prefix of every name, with the symbols in scope there.
+	ShaderAutocomplete autocomplete;
+	std::vector<ShaderAutocomplete::Candidate> candidates;
+	std::vector<ShaderSymbolIndex::Symbol> symbols;
+	std::vector<std::wstring> names;
+	double symbols_time = 0, complete_time = 0, max_complete_time = 0;
+	size_t num_scopes = 0, num_completions = 0;
+	for (size_t i = 0; i != num_lookups; ++i)
+	{
+		const ShaderTokenizer::Token& token = *parser.GetItems()[i].token;
+		if (token.type != ShaderTokenizer::TT_Word && token.type != ShaderTokenizer::TT_Function) continue;
+
+		index.GetVisibleSymbols(i, symbols);
+		names.clear();
+		for (size_t j = 0; j != symbols.size(); ++j) names.push_back(symbols[j].name);
+		TimePoint symbols_begin = Now();
+		autocomplete.SetSymbols(names);
+		symbols_time += Microseconds(symbols_begin, Now());
+		++num_scopes;
+
+		for (size_t length = 1; length <= token.word.length(); ++length)
+		{
+			TimePoint complete_begin = Now();
+			autocomplete.Complete(token.word.substr(0, length), ShaderAutocomplete::CC_Global, 16, candidates);
+			double time = Microseconds(complete_begin, Now());
+			complete_time += time;
+			max_complete_time = std::max(max_complete_time, time);
+			++num_completions;
+		}
+		autocomplete.NoteUse(token.word);
+	}
+
+	double num_lints = static_cast<double>(num_edits * 2);
+	std::cout << file << ": " << tokenizer.GetNumberTokens() << " tokens, " << linter.GetNumChunks() << " chunks, "
+		<< "tokenize " << tokenize_time << " us\n"
+		<< "  parse: cold " << cold_parse_time << " us, edit " << parse_time / num_lints << " us avg / " << max_parse_time << " us max, "
+		<< 100.0 * (num_items - num_reused_items) / std::max<size_t>(num_items, 1) << "% of items reparsed\n"
+		<< "  lint: cold " << cold_lint_time << " us, edit " << lint_time / num_lints << " us avg / " << max_lint_time << " us max, "
+		<< num_analyzed / num_lints << " chunks analyzed, " << num_checked / num_lints << " checked\n"
+		<< "  index: cold " << cold_index_time << " us, edit " << index_time / num_lints << " us avg / " << max_index_time << " us max, "
+		<< num_indexed / num_lints << " declarations analyzed, lookup " << definition_time << " us definitions / "
+		<< reference_time << " us references\n"
+		<< "  complete: " << num_completions << " prefixes, " << complete_time / std::max<size_t>(num_completions, 1) << " us avg / "
+		<< max_complete_time << " us max, symbols " << symbols_time / std::max<size_t>(num_scopes, 1) << " us avg\n";
+
+	totals.num_edits += num_edits * 2;
+	totals.num_items += num_items;
+	totals.num_reused_items += num_reused_items;
+	totals.parse_time += parse_time;
+	totals.lint_time += lint_time;
+	totals.index_time += index_time;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string header_directory = default_header_directory;
+	size_t num_edits = 0;
+	bool print_tree = false;
+	bool quiet = false;
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--fx" && has_value) header_directory = argv[++i];
+		else if ((arg == "-b" || arg == "--benchmark") && has_value) num_edits = lexical_cast_no_exception<size_t>(std::string(argv[++i]));
+		else if (arg == "-t" || arg == "--tree") print_tree = true;
+		else if (arg == "-q" || arg == "--quiet") quiet = true;
+		else if (arg == "-h" || arg == "--help") {PrintUsage(); return 0;}
+		else if (!arg.empty() && arg[0] == '-') {PrintUsage(); return 2;}
+		else paths.push_back(arg);
+	}
+	if (paths.empty()) paths.push_back(default_shader_directory);
+
+	std::vector<std::string> files;
+	for (size_t i = 0; i != paths.size(); ++i)
+	{
+		if (IsDirectory(paths[i])) ListShaderFiles(paths[i], files);
+		else files.push_back(paths[i]);
+	}
+
+	// the same header the editor puts in front of its text.
+	ShaderIncludeGraph include_graph(header_directory);
+	include_graph.AddRoot(header_root);
+	include_graph.Refresh();
+
+	size_t num_failed = 0;
+	BenchmarkTotals totals = {0, 0, 0, 0, 0, 0};
+	for (size_t i = 0; i != files.size(); ++i)
+	{
+		std::wstring text;
+		if (!ReadShader(files[i], text))
+		{
+			if (!quiet) std::cout << files[i] << ": error: can not be read\n";
+			++num_failed;
+			continue;
+		}
+
+		ShaderTokenizer tokenizer;
+		tokenizer.Tokenize(text);
+		ShaderParser parser;
+		parser.Parse(text, tokenizer.GetTokens());
+		if (print_tree) PrintTree(parser, parser.GetRoot(), 0, 0);
+
+		ShaderLinter linter;
+		linter.SetHeader(include_graph.GetText(), include_graph.GetHash());
+		linter.Lint(parser);
+		if (!linter.GetDiagnostics().empty()) ++num_failed;
+		if (!quiet) PrintDiagnostics(files[i], text, linter);
+
+		if (num_edits != 0) Benchmark(files[i], text, include_graph, num_edits, totals);
+	}
+
+	if (totals.num_edits != 0)
+	{
+		double num_lints = static_cast<double>(totals.num_edits);
+		std::cout << "all: edit parse " << totals.parse_time / num_lints << " us avg, "
+			<< 100.0 * (totals.num_items - totals.num_reused_items) / std::max<size_t>(totals.num_items, 1) << "% of items reparsed, "
+			<< "edit lint " << totals.lint_time / num_lints << " us avg, "
+			<< "edit index " << totals.index_time / num_lints << " us avg\n";
+	}
+	return num_failed == 0 ? 0 : 1;
+}
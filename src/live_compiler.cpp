@@ -0,0 +1,183 @@
+#include "common.hpp"
+#include "live_compiler.hpp"
+
+#include <boost/bind.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+LiveCompiler::LiveCompiler()
+	: m_latest_version(0)
+	, m_has_pending_job(false)
+	, m_busy(false)
+	, m_quit(false)
+{
+	for (int i = 0; i != Num_CompileTiers; ++i) m_tier_flags[i] = 0;
+}
+
+LiveCompiler::~LiveCompiler()
+{
+	Stop();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void LiveCompiler::SetCompiler(ShaderCompilerPtr compiler)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_compiler = compiler;
+}
+
+void LiveCompiler::SetTierFlags(CompileTier tier, unsigned int flags)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_tier_flags[tier] = flags;
+}
+
+unsigned int LiveCompiler::GetTierFlags(CompileTier tier) const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_tier_flags[tier];
+}
+
+void LiveCompiler::Start()
+{
+	if (m_worker.joinable()) return;
+
+	m_quit = false;
+	m_worker = boost::thread(boost::bind(&LiveCompiler::WorkerProc, this));
+}
+
+void LiveCompiler::Stop()
+{
+	if (!m_worker.joinable()) return;
+
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_quit = true;
+	}
+	m_condition.notify_all();
+	m_worker.join();
+}
+
+void LiveCompiler::Submit(size_t version, const ShaderCompileInput& input, CompileTier first_tier /*= CT_Fast*/)
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if (version < m_latest_version) return;
+
+		// a job which has not been started yet is simply replaced.
+		m_latest_version = version;
+		m_pending_job.version = version;
+		m_pending_job.tier = first_tier;
+		m_pending_input = input;
+		m_has_pending_job = true;
+	}
+	m_condition.notify_one();
+}
+
+bool LiveCompiler::FetchResult(Result& result)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	if (m_results.empty()) return false;
+
+	std::swap(result, m_results.front());
+	m_results.pop_front();
+	return true;
+}
+
+bool LiveCompiler::IsBusy() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_busy || m_has_pending_job;
+}
+
+size_t LiveCompiler::GetLatestVersion() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_latest_version;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// worker thread
+//////////////////////////////////////////////////////////////////////////
+void LiveCompiler::WorkerProc()
+{
+	while (true)
+	{
+		Job job;
+		ShaderCompileInput input;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			while (!m_has_pending_job && !m_quit) m_condition.wait(lock);
+			if (m_quit) break;
+
+			job = m_pending_job;
+			std::swap(input, m_pending_input);
+			m_has_pending_job = false;
+			m_busy = true;
+		}
+
+		// when the optimized bytecode is cached already, the fast tier is pointless.
+		bool has_next_job = true;
+		if (job.tier == CT_Fast)
+		{
+			Job optimized_job = {job.version, CT_Optimized};
+			bool has_probed_next = false;
+			if (CompileJob(optimized_job, input, true, &has_probed_next)) has_next_job = false;
+		}
+
+		while (has_next_job)
+		{
+			if (!CompileJob(job, input, false, &has_next_job) || !has_next_job) break;
+
+			// run the next tier unless a newer version is waiting.
+			boost::mutex::scoped_lock lock(m_mutex);
+			if (m_has_pending_job || m_quit) break;
+			job.tier = static_cast<CompileTier>(job.tier + 1);
+		}
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_busy = false;
+	}
+}
+
+bool LiveCompiler::CompileJob(const Job& job, const ShaderCompileInput& input, bool probe_only, bool* has_next_job)
+{
+	*has_next_job = false;
+
+	ShaderCompilerPtr compiler;
+	ShaderCompileInput tier_input = input;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if (job.version != m_latest_version) return false;
+
+		compiler = m_compiler;
+		tier_input.flags = m_tier_flags[job.tier];
+	}
+	if (!compiler) return false;
+
+	ShaderCompileOutput output;
+	bool succeeded = probe_only ?
+		compiler->Probe(tier_input, output) :
+		compiler->Compile(tier_input, output);
+	if (probe_only && !succeeded) return false;
+
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	// drop the result if the document moved on while compiling.
+	if (job.version != m_latest_version) return false;
+
+	Result result;
+	result.version = job.version;
+	result.tier = job.tier;
+	result.succeeded = succeeded;
+
+	// code which failed to compile fails in every tier.
+	*has_next_job = succeeded && job.tier + 1 != Num_CompileTiers;
+	result.bytecode.swap(output.bytecode);
+	result.error_message.swap(output.error_message);
+	m_results.push_back(result);
+	return true;
+}
@@ -0,0 +1,79 @@
+#ifndef _LIVE_COMPILER_HPP_INCLUDED_
+#define _LIVE_COMPILER_HPP_INCLUDED_
+
+#include <deque>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include "shader_compiler.hpp"
+#include "compile_tier_tracker.hpp"
+
+class LiveCompiler;
+typedef boost::shared_ptr<LiveCompiler> LiveCompilerPtr;
+
+// compiles pixel shaders on a worker thread. only the newest submitted
+// version is of interest: a pending job is replaced by a newer submit, and a
+// job that finishes after a newer one was submitted is discarded.
+// each version is first compiled with the fast tier, then recompiled with
+// the optimized tier in the background, unless the optimized bytecode is
+// already at hand. which results replace the running shader is up to the
+// CompileTierTracker of the caller.
+class LiveCompiler
+{
+public:
+	struct Result
+	{
+		size_t version;
+		CompileTier tier;
+		bool succeeded;
+		std::vector<char> bytecode;
+		std::string error_message;
+	};
+
+public:
+	LiveCompiler();
+	virtual ~LiveCompiler();
+
+public:
+	void SetCompiler(ShaderCompilerPtr compiler);
+	void SetTierFlags(CompileTier tier, unsigned int flags);
+	unsigned int GetTierFlags(CompileTier tier) const;
+
+	void Start();
+	void Stop();
+
+	void Submit(size_t version, const ShaderCompileInput& input, CompileTier first_tier = CT_Fast);
+	bool FetchResult(Result& result);
+
+	bool IsBusy() const;
+	size_t GetLatestVersion() const;
+
+private:
+	struct Job
+	{
+		size_t version;
+		CompileTier tier;
+	};
+
+private:
+	void WorkerProc();
+	bool CompileJob(const Job& job, const ShaderCompileInput& input, bool probe_only, bool* has_next_job);
+
+private:
+	boost::thread m_worker;
+	mutable boost::mutex m_mutex;
+	boost::condition_variable m_condition;
+
+	ShaderCompilerPtr m_compiler;
+	unsigned int m_tier_flags[Num_CompileTiers];
+	size_t m_latest_version;
+
+	Job m_pending_job;
+	ShaderCompileInput m_pending_input;
+	bool m_has_pending_job;
+
+	std::deque<Result> m_results;
+	bool m_busy;
+	bool m_quit;
+};
+
+#endif  // _LIVE_COMPILER_HPP_INCLUDED_
@@ -0,0 +1,61 @@
+#include "common.hpp"
+#include "polling_file_watcher.hpp"
+
+#include <sys/stat.h>
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+PollingFileWatcher::PollingFileWatcher()
+{
+
+}
+
+PollingFileWatcher::~PollingFileWatcher()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool PollingFileWatcher::Watch(const std::string& path)
+{
+	m_files[path] = GetFileState(path);
+	return true;
+}
+
+void PollingFileWatcher::Unwatch(const std::string& path)
+{
+	m_files.erase(path);
+}
+
+void PollingFileWatcher::ReadChanges(std::vector<std::string>& paths)
+{
+	for (auto it = m_files.begin(); it != m_files.end(); ++it)
+	{
+		FileState state = GetFileState(it->first);
+		if (state == it->second) continue;
+
+		it->second = state;
+		paths.push_back(it->first);
+	}
+}
+
+bool PollingFileWatcher::FileState::operator == (const FileState& rhs) const
+{
+	return time_stamp == rhs.time_stamp && size == rhs.size && exists == rhs.exists;
+}
+
+PollingFileWatcher::FileState PollingFileWatcher::GetFileState(const std::string& path)
+{
+	FileState state = {0, 0, false};
+
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return state;
+
+	state.time_stamp = static_cast<long long>(info.st_mtime);
+	state.size = static_cast<long long>(info.st_size);
+	state.exists = true;
+	return state;
+}
@@ -0,0 +1,36 @@
+#ifndef _POLLING_FILE_WATCHER_HPP_INCLUDED_
+#define _POLLING_FILE_WATCHER_HPP_INCLUDED_
+
+#include "file_watcher.hpp"
+
+// compares time stamps and sizes on every read, for platforms without a
+// native change notification. cheap for the handful of files watched here.
+class PollingFileWatcher : public FileWatcher
+{
+public:
+	PollingFileWatcher();
+	virtual ~PollingFileWatcher();
+
+public:
+	virtual bool Watch(const std::string& path);
+	virtual void Unwatch(const std::string& path);
+	virtual void ReadChanges(std::vector<std::string>& paths);
+
+	// the state of a file, a missing one has all fields zero.
+	struct FileState
+	{
+		long long time_stamp;
+		long long size;
+		bool exists;
+
+		bool operator == (const FileState& rhs) const;
+		bool operator != (const FileState& rhs) const {return !(*this == rhs);}
+	};
+
+	static FileState GetFileState(const std::string& path);
+
+private:
+	std::map<std::string, FileState> m_files;
+};
+
+#endif  // _POLLING_FILE_WATCHER_HPP_INCLUDED_
@@ -145,58 +145,40 @@ bool PostProcess::LoadPixelShaderFromFile(const tstring& file_name, const tstrin
 	return true;
 }
 
-bool PostProcess::LoadPixelShaderFromMemory(const tstring& shader_content, const tstring& entry_point)
+bool PostProcess::LoadPixelShaderFromInput(const ShaderCompileInput& input)
 {
-	ID3DBlob* error_buffer = NULL;
-	ID3DBlob* pixel_shader_buffer = NULL;
-	ID3D11PixelShader* pixel_shader = NULL;
+	ShaderCompileOutput output;
+	bool compiled_ok = D3DApp::GetShaderCompiler()->Compile(input, output);
+	m_error_message.assign(output.error_message.begin(), output.error_message.end());
+	if (!compiled_ok) return false;
 
-	std::string shader_content_str = to_string(shader_content);
-	HRESULT hr = D3DX11CompileFromMemory(
-		shader_content_str.c_str(),
-		shader_content_str.length(),
-		NULL,
-		NULL,
-		NULL,
-		to_string(entry_point).c_str(),
-		"ps_4_0",
-		D3D10_SHADER_DEBUG,
-		0,
-		NULL,
-		&pixel_shader_buffer,
-		&error_buffer,
-		NULL);
+	return LoadPixelShaderFromBytecode(output.bytecode);
+}
 
-	if (FAILED(hr))
+bool PostProcess::LoadPixelShaderFromBytecode(const std::vector<char>& bytecode)
+{
+	if (bytecode.empty())
 	{
-		if (error_buffer != NULL)
-		{
-			std::string error_message = static_cast<char*>(error_buffer->GetBufferPointer());
-			m_error_message = to_tstring(error_message);
-		}
-		SAFE_RELEASE(pixel_shader_buffer);
-		SAFE_RELEASE(error_buffer);
+		m_error_message = TEXT("empty shader bytecode.");
 		return false;
 	}
 
-	hr = D3DApp::GetD3D11Device()->CreatePixelShader(
-		pixel_shader_buffer->GetBufferPointer(),
-		pixel_shader_buffer->GetBufferSize(),
+	ID3D11PixelShader* pixel_shader = NULL;
+	HRESULT hr = D3DApp::GetD3D11Device()->CreatePixelShader(
+		&bytecode[0],
+		bytecode.size(),
 		NULL,
 		&pixel_shader);
 
 	if (FAILED(hr))
 	{
 		m_error_message = TEXT("create pixel shader failed.");
-		SAFE_RELEASE(pixel_shader_buffer);
-		SAFE_RELEASE(error_buffer);
 		return false;
 	}
 
 	SAFE_RELEASE(m_pixel_shader);
 	m_pixel_shader = pixel_shader;
-	SAFE_RELEASE(pixel_shader_buffer);
-	SAFE_RELEASE(error_buffer);
+	m_error_message.clear();
 	return true;
 }
 
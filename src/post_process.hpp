@@ -2,7 +2,9 @@
 #define _POST_PROCESS_INCLUDED_HPP_
 
 #include <map>
+#include <vector>
 #include <boost/shared_ptr.hpp>
+#include "shader_compiler.hpp"
 
 class PostProcess;
 typedef boost::shared_ptr<PostProcess> PostProcessPtr;
@@ -22,7 +24,8 @@ public:
 	void Apply() const;
 
 	bool LoadPixelShaderFromFile(const tstring& file_name, const tstring& entry_point);
-	bool LoadPixelShaderFromMemory(const tstring& shader_content, const tstring& entry_point);
+	bool LoadPixelShaderFromInput(const ShaderCompileInput& input);
+	bool LoadPixelShaderFromBytecode(const std::vector<char>& bytecode);
 	tstring GetErrorMessage() const;
 
 	void InputPin(int slot, ID3D11ShaderResourceView* srv);
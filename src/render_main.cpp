@@ -0,0 +1,670 @@
+#include "common.hpp"
+#include "cpu_renderer.hpp"
+#include "image_file.hpp"
+#include "shader_include_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// renders shaders on the cpu, without a device:
+//   render_shaders [options] [file|directory ...]
+// run from the bin directory, it renders save/ with the headers in fx/ and
+// media/tex.bmp bound to t0, and reports how many pixels a second each
+// shader runs at. with -o it writes the images as bitmaps. --compare renders
+// with the reference interpreter as well, or with the engine --against
+// names, to time the engine against it and check that both draw the same.
+// --scaling renders each shader on 1, 2, 4 and on up to all the threads,
+// and reports the speedup over one. -e native builds the shaders to machine
+// code first, or loads them from cache/jit/ if built before. --passes
+// reports what each pass of the bytecode optimizer left. --bench-math times
+// the approximations of sin, pow and the like against libm, and measures how
+// many ulps each is off. --bench-texture times sampling the texture, in
+// order and at random. --no-library inlines the noise functions of the
+// headers as written, where by default they run as ops of their own.
+
+static const char default_shader_directory[] = "save";
+static const char default_header_directory[] = "fx/";
+static const char default_texture[] = "media/tex.bmp";
+static const char default_jit_cache[] = "cache/jit";
+static const char header_root[] = "header.hlsl";
+
+static void PrintUsage()
+{
+	std::cerr <<
+		"usage: render_shaders [options] [file|directory ...]\n"
+		"  --fx DIR             header directory, fx/ by default\n"
+		"  --texture FILE       bound to t0, media/tex.bmp by default\n"
+		"  -s, --size WxH       image size, 160x90 by default\n"
+		"  -t, --time T         time.x in seconds, 10 by default\n"
+		"  -m, --mouse X,Y      mpos.xy, 0,0 by default\n"
+		"  -o, --output DIR     write DIR/<shader>.bmp\n"
+		"  -e, --engine E       vm, the bytecode vm by default, simd, native or tree\n"
+		"  --isa NAME           sse2, avx2 or avx512 for simd, the best by default\n"
+		"  --jit-cache DIR      where native builds are kept, cache/jit by default\n"
+		"  --no-wait            render on the simd vm while native code builds\n"
+		"  -j, --threads N      render threads, one per hardware thread by default\n"
+		"  --scaling            time 1 thread up to --threads, doubling\n"
+		"  --compare            render with the tree interpreter too, and compare\n"
+		"  --against E          the engine --compare renders with, tree by default\n"
+		"  --dump               print the bytecode\n"
+		"  --passes             print the instructions after each optimizer pass\n"
+		"  --skip PASS          unroll, fold, cse, hoist or dce, not run\n"
+		"  --no-optimize        none of the passes run\n"
+		"  --math NAME          libm, precise or fast for sin, pow and the like,\n"
+		"                       precise by default\n"
+		"  --bench-math         time and measure them against libm, and exit\n"
+		"  --bench-texture      time sampling the texture, and exit\n"
+		"  --no-library         inline snoise and qnoise rather than run their ops\n"
+		"  -q, --quiet          no report, only the exit code\n";
+}
+
+typedef boost::posix_time::ptime TimePoint;
+
+static TimePoint Now()
+{
+	return boost::posix_time::microsec_clock::universal_time();
+}
+
+static double Microseconds(const TimePoint& begin, const TimePoint& end)
+{
+	return static_cast<double>((end - begin).total_microseconds());
+}
+
+static bool ReadShader(const std::string& path, std::wstring& text)
+{
+	std::ifstream ifs(path.c_str(), std::ios::binary);
+	if (!ifs.is_open()) return false;
+
+	// the editor reads one character per byte as well.
+	std::string bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	text.resize(bytes.length());
+	for (size_t i = 0; i != bytes.length(); ++i) text[i] = static_cast<unsigned char>(bytes[i]);
+	text.erase(std::remove(text.begin(), text.end(), L'\r'), text.end());
+	return true;
+}
+
+// two numbers split by separator, as in 640x360 or 0.5,0.5.
+static bool ParsePair(const std::string& arg, char separator, float& first, float& second)
+{
+	size_t split = arg.find(separator);
+	if (split == std::string::npos) return false;
+	try
+	{
+		first = boost::lexical_cast<float>(arg.substr(0, split));
+		second = boost::lexical_cast<float>(arg.substr(split + 1));
+	}
+	catch (boost::bad_lexical_cast&)
+	{
+		return false;
+	}
+	return true;
+}
+
+static bool ParseEngine(const std::string& name, CpuRenderer::Engine& engine)
+{
+	if (name == "vm") engine = CpuRenderer::EN_Bytecode;
+	else if (name == "simd") engine = CpuRenderer::EN_Simd;
+	else if (name == "native") engine = CpuRenderer::EN_Native;
+	else if (name == "tree") engine = CpuRenderer::EN_Interpreter;
+	else return false;
+	return true;
+}
+
+// an intrinsic over the inputs --bench-math draws for it, the second
+// argument over its own range.
+struct MathBenchmark
+{
+	const char* name;
+	CpuBytecode::Opcode opcode;
+	float (*unary)(float, CpuShaderMath::Precision);
+	float (*binary)(float, float, CpuShaderMath::Precision);
+	double (*reference)(double, double);
+	float lo, hi;
+	float lo2, hi2;
+	bool is_exponent;		// a power of two of the range, as the inputs of log
+};
+
+static double ReferenceAcos(double x, double) { return std::acos(x); }
+static double ReferenceAsin(double x, double) { return std::asin(x); }
+static double ReferenceAtan(double x, double) { return std::atan(x); }
+static double ReferenceAtan2(double y, double x) { return std::atan2(y, x); }
+static double ReferenceCos(double x, double) { return std::cos(x); }
+static double ReferenceExp(double x, double) { return std::exp(x); }
+static double ReferenceExp2(double x, double) { return std::pow(2.0, x); }
+static double ReferenceLog(double x, double) { return std::log(x); }
+static double ReferenceLog10(double x, double) { return std::log10(x); }
+static double ReferenceLog2(double x, double) { return std::log(x) / std::log(2.0); }
+static double ReferencePow(double x, double y) { return std::pow(x, y); }
+static double ReferenceSin(double x, double) { return std::sin(x); }
+static double ReferenceTan(double x, double) { return std::tan(x); }
+
+static const MathBenchmark math_benchmarks[] =
+{
+	{"sin", CpuBytecode::OC_Sin, CpuShaderMath::Sin, NULL, ReferenceSin, -100.0f, 100.0f, 0, 0, false},
+	{"cos", CpuBytecode::OC_Cos, CpuShaderMath::Cos, NULL, ReferenceCos, -100.0f, 100.0f, 0, 0, false},
+	{"tan", CpuBytecode::OC_Tan, CpuShaderMath::Tan, NULL, ReferenceTan, -100.0f, 100.0f, 0, 0, false},
+	{"asin", CpuBytecode::OC_Asin, CpuShaderMath::Asin, NULL, ReferenceAsin, -1.0f, 1.0f, 0, 0, false},
+	{"acos", CpuBytecode::OC_Acos, CpuShaderMath::Acos, NULL, ReferenceAcos, -1.0f, 1.0f, 0, 0, false},
+	{"atan", CpuBytecode::OC_Atan, CpuShaderMath::Atan, NULL, ReferenceAtan, -100.0f, 100.0f, 0, 0, false},
+	{"atan2", CpuBytecode::OC_Atan2, NULL, CpuShaderMath::Atan2, ReferenceAtan2, -10.0f, 10.0f, -10.0f, 10.0f, false},
+	{"exp", CpuBytecode::OC_Exp, CpuShaderMath::Exp, NULL, ReferenceExp, -80.0f, 80.0f, 0, 0, false},
+	{"exp2", CpuBytecode::OC_Exp2, CpuShaderMath::Exp2, NULL, ReferenceExp2, -120.0f, 120.0f, 0, 0, false},
+	{"log", CpuBytecode::OC_Log, CpuShaderMath::Log, NULL, ReferenceLog, -120.0f, 120.0f, 0, 0, true},
+	{"log2", CpuBytecode::OC_Log2, CpuShaderMath::Log2, NULL, ReferenceLog2, -120.0f, 120.0f, 0, 0, true},
+	{"log10", CpuBytecode::OC_Log10, CpuShaderMath::Log10, NULL, ReferenceLog10, -120.0f, 120.0f, 0, 0, true},
+	{"pow", CpuBytecode::OC_Pow, NULL, CpuShaderMath::Pow, ReferencePow, -4.0f, 4.0f, -8.0f, 8.0f, true},
+};
+
+// how many units in the last place of the float nearest the reference x
+// is off from it.
+static double UlpError(float x, double reference)
+{
+	if (x == reference) return 0;
+	int exponent;
+	std::frexp(reference, &exponent);
+	return std::fabs(x - reference) / std::ldexp(1.0, std::max(exponent - 24, -149));
+}
+
+// each intrinsic over the same inputs a lane at a time from libm, and a
+// vector at a time in each precision, on the widest set there is.
+static int BenchMath(bool quiet)
+{
+	CpuSimdVm::InstructionSet instruction_set = CpuSimdVm::GetBestInstructionSet();
+	CpuSimdVm::MathFunction math = CpuSimdVm::GetMathFunction(instruction_set);
+	if (math == NULL)
+	{
+		if (!quiet) std::cerr << "error: no simd here to time\n";
+		return 1;
+	}
+	unsigned int width = CpuSimdVm::GetWidth(instruction_set);
+
+	const size_t num_values = 1 << 16, num_runs = 16;
+	std::vector<float> a(num_values), b(num_values), result(num_values);
+	volatile float sink = 0;
+	if (!quiet) std::cout << "over " << num_values << " inputs, " << num_runs << " runs, simd on " << CpuSimdVm::GetInstructionSetName(instruction_set) << "\n";
+	for (size_t i = 0; i != sizeof(math_benchmarks) / sizeof(math_benchmarks[0]); ++i)
+	{
+		const MathBenchmark& bench = math_benchmarks[i];
+		unsigned int seed = 1;
+		for (size_t j = 0; j != num_values; ++j)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			a[j] = bench.lo + (bench.hi - bench.lo) * static_cast<float>(seed >> 8) / 16777216.0f;
+			if (bench.is_exponent) a[j] = std::pow(2.0f, a[j]);
+			seed = seed * 1664525u + 1013904223u;
+			b[j] = bench.lo2 + (bench.hi2 - bench.lo2) * static_cast<float>(seed >> 8) / 16777216.0f;
+		}
+
+		double ulps[CpuShaderMath::Num_Precisions];
+		double errors[CpuShaderMath::Num_Precisions];	// absolute below one, relative above
+		double times[CpuShaderMath::Num_Precisions];
+		for (int k = 0; k != CpuShaderMath::Num_Precisions; ++k)
+		{
+			CpuShaderMath::Precision precision = static_cast<CpuShaderMath::Precision>(k);
+			TimePoint begin = Now();
+			for (size_t run = 0; run != num_runs; ++run)
+			{
+				if (precision == CpuShaderMath::PR_Libm)
+				{
+					if (bench.unary != NULL) for (size_t j = 0; j != num_values; ++j) result[j] = bench.unary(a[j], precision);
+					else for (size_t j = 0; j != num_values; ++j) result[j] = bench.binary(a[j], b[j], precision);
+				}
+				else
+				{
+					for (size_t j = 0; j != num_values; j += width) math(bench.opcode, precision, &a[j], &b[j], &result[j]);
+				}
+				sink = sink + result[run];
+			}
+			times[k] = Microseconds(begin, Now()) * 1000.0 / (num_values * num_runs);
+
+			ulps[k] = 0;
+			errors[k] = 0;
+			for (size_t j = 0; j != num_values; ++j)
+			{
+				double reference = bench.reference(a[j], b[j]);
+				ulps[k] = std::max(ulps[k], UlpError(result[j], reference));
+				errors[k] = std::max(errors[k], std::fabs(result[j] - reference) / std::max(std::fabs(reference), 1.0));
+			}
+		}
+
+		if (quiet) continue;
+		std::cout << bench.name << " over [" << bench.lo << ", " << bench.hi << "]" << (bench.is_exponent ? " as powers of two" : "");
+		if (bench.binary != NULL) std::cout << " by [" << bench.lo2 << ", " << bench.hi2 << "]";
+		std::cout << ":\n";
+		for (int k = 0; k != CpuShaderMath::Num_Precisions; ++k)
+		{
+			std::cout << "  " << CpuShaderMath::GetPrecisionName(static_cast<CpuShaderMath::Precision>(k)) << ": " << times[k] << " ns, "
+				<< std::ceil(ulps[k]) << " ulps, " << errors[k] << " error";
+			if (k != CpuShaderMath::PR_Libm) std::cout << ", " << times[0] / std::max(times[k], 1e-3) << "x libm";
+			std::cout << "\n";
+		}
+	}
+	return 0;
+}
+
+// the uvs and levels of a pattern --bench-texture samples at.
+enum SamplePattern
+{
+	SP_Coherent,			// the pixels of a screen a texel apart, in quads
+	SP_Incoherent,			// anywhere on the texture
+	Num_SamplePatterns,
+};
+
+static void MakeSamples(SamplePattern pattern, bool is_trilinear, const CpuTexture& texture, std::vector<float>& u, std::vector<float>& v, std::vector<float>& level)
+{
+	size_t num_values = u.size();
+	size_t side = static_cast<size_t>(std::sqrt(static_cast<double>(num_values)));
+	unsigned int seed = 1;
+	for (size_t j = 0; j != num_values; ++j)
+	{
+		if (pattern == SP_Coherent)
+		{
+			size_t quad = j / 4, x = quad % (side / 2) * 2 + (j & 1), y = quad / (side / 2) * 2 + (j >> 1 & 1);
+			u[j] = (x + 0.5f) / texture.GetWidth();
+			v[j] = (y + 0.5f) / texture.GetHeight();
+			level[j] = is_trilinear ? 0.5f : 0.0f;
+		}
+		else
+		{
+			seed = seed * 1664525u + 1013904223u;
+			u[j] = static_cast<float>(seed >> 8) / 16777216.0f;
+			seed = seed * 1664525u + 1013904223u;
+			v[j] = static_cast<float>(seed >> 8) / 16777216.0f;
+			seed = seed * 1664525u + 1013904223u;
+			level[j] = is_trilinear ? 4.0f * static_cast<float>(seed >> 8) / 16777216.0f : 0.0f;
+		}
+	}
+}
+
+// the texture bilinear at the top level and trilinear between levels, in
+// each pattern, a sample at a time and a vector at a time on every set the
+// cpu has. the vectors have to give the bits the samples do.
+static int BenchTexture(const CpuTexture& texture, bool quiet)
+{
+	if (texture.GetNumLevels() == 0)
+	{
+		if (!quiet) std::cerr << "error: no texture to sample\n";
+		return 1;
+	}
+
+	const size_t num_values = 1 << 16, num_runs = 16;
+	static const char* pattern_names[] = {"coherent", "incoherent"};
+	std::vector<float> u(num_values), v(num_values), level(num_values), expected(num_values * 4), result(num_values * 4);
+	std::vector<float> color(4 * 16);
+	volatile float sink = 0;
+	int status = 0;
+	if (!quiet)
+	{
+		std::cout << texture.GetWidth() << "x" << texture.GetHeight() << " in " << texture.GetNumLevels() << " levels, over "
+			<< num_values << " samples, " << num_runs << " runs\n";
+	}
+	for (int k = 0; k != Num_SamplePatterns * 2; ++k)
+	{
+		SamplePattern pattern = static_cast<SamplePattern>(k / 2);
+		bool is_trilinear = k % 2 != 0;
+		MakeSamples(pattern, is_trilinear, texture, u, v, level);
+
+		TimePoint begin = Now();
+		for (size_t run = 0; run != num_runs; ++run)
+		{
+			for (size_t j = 0; j != num_values; ++j) texture.Sample(u[j], v[j], level[j], &expected[j * 4]);
+			sink = sink + expected[run];
+		}
+		double scalar_time = Microseconds(begin, Now()) * 1000.0 / (num_values * num_runs);
+		if (!quiet) std::cout << pattern_names[pattern] << (is_trilinear ? " trilinear" : " bilinear") << ":\n  scalar: " << scalar_time << " ns\n";
+
+		for (int i = 0; i != CpuSimdVm::Num_InstructionSets; ++i)
+		{
+			CpuSimdVm::InstructionSet instruction_set = static_cast<CpuSimdVm::InstructionSet>(i);
+			CpuSimdVm::SampleFunction sample = CpuSimdVm::GetSampleFunction(instruction_set);
+			if (sample == NULL) continue;
+			unsigned int width = CpuSimdVm::GetWidth(instruction_set);
+			unsigned int lanes = (1u << width) - 1;
+
+			begin = Now();
+			for (size_t run = 0; run != num_runs; ++run)
+			{
+				for (size_t j = 0; j != num_values; j += width)
+				{
+					sample(&texture, lanes, &u[j], &v[j], &level[j], &color[0]);
+					for (unsigned int lane = 0; lane != width; ++lane)
+					{
+						for (unsigned int c = 0; c != 4; ++c) result[(j + lane) * 4 + c] = color[c * width + lane];
+					}
+				}
+				sink = sink + result[run];
+			}
+			double time = Microseconds(begin, Now()) * 1000.0 / (num_values * num_runs);
+
+			float difference = 0;
+			for (size_t j = 0; j != result.size(); ++j)
+			{
+				float d = std::fabs(result[j] - expected[j]);
+				if (!(d <= difference)) difference = d;
+			}
+			if (difference != 0) status = 1;
+			if (quiet) continue;
+			std::cout << "  " << CpuSimdVm::GetInstructionSetName(instruction_set) << ": " << time << " ns, "
+				<< scalar_time / std::max(time, 1e-3) << "x scalar, max difference " << difference << "\n";
+		}
+	}
+	return status;
+}
+
+static std::string BaseName(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.rfind('.');
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+int main(int argc, char* argv[])
+{
+	std::string header_directory = default_header_directory;
+	std::string texture_path = default_texture;
+	std::string output_directory;
+	float width = 160, height = 90;
+	float time = 10;
+	float4 mpos(0, 0, 0, 0);
+	bool quiet = false;
+	CpuRenderer::Engine engine = CpuRenderer::EN_Bytecode;
+	CpuSimdVm::InstructionSet instruction_set = CpuSimdVm::GetBestInstructionSet();
+	std::string jit_cache = default_jit_cache;
+	bool wait_for_native = true;
+	size_t num_threads = 0;
+	bool scaling = false;
+	bool compare = false;
+	CpuRenderer::Engine reference_engine = CpuRenderer::EN_Interpreter;
+	std::string reference_name = "tree";
+	CpuShaderMath::Precision precision = CpuShaderMath::PR_Precise;
+	bool bench_math = false;
+	bool bench_texture = false;
+	bool use_library = true;
+	bool dump = false;
+	bool print_passes = false;
+	bool is_pass_enabled[CpuBytecodeOptimizer::Num_Passes];
+	std::fill(is_pass_enabled, is_pass_enabled + CpuBytecodeOptimizer::Num_Passes, true);
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--fx" && has_value) header_directory = argv[++i];
+		else if (arg == "--texture" && has_value) texture_path = argv[++i];
+		else if ((arg == "-s" || arg == "--size") && has_value)
+		{
+			if (!ParsePair(argv[++i], 'x', width, height) || width < 1 || height < 1) {PrintUsage(); return 2;}
+		}
+		else if ((arg == "-t" || arg == "--time") && has_value) time = lexical_cast_no_exception<float>(std::string(argv[++i]));
+		else if ((arg == "-m" || arg == "--mouse") && has_value)
+		{
+			if (!ParsePair(argv[++i], ',', mpos.x, mpos.y)) {PrintUsage(); return 2;}
+		}
+		else if ((arg == "-o" || arg == "--output") && has_value) output_directory = argv[++i];
+		else if ((arg == "-e" || arg == "--engine") && has_value)
+		{
+			if (!ParseEngine(argv[++i], engine)) {PrintUsage(); return 2;}
+		}
+		else if (arg == "--isa" && has_value)
+		{
+			std::string name = argv[++i];
+			int found = CpuSimdVm::Num_InstructionSets;
+			for (int j = 0; j != CpuSimdVm::Num_InstructionSets; ++j)
+			{
+				if (name == CpuSimdVm::GetInstructionSetName(static_cast<CpuSimdVm::InstructionSet>(j))) found = j;
+			}
+			if (found == CpuSimdVm::Num_InstructionSets) {PrintUsage(); return 2;}
+			instruction_set = static_cast<CpuSimdVm::InstructionSet>(found);
+			if (!CpuSimdVm::IsSupported(instruction_set) && !quiet) std::cerr << name << ": warning: not supported here\n";
+		}
+		else if (arg == "--jit-cache" && has_value) jit_cache = argv[++i];
+		else if (arg == "--no-wait") wait_for_native = false;
+		else if ((arg == "-j" || arg == "--threads") && has_value) num_threads = lexical_cast_no_exception<size_t>(std::string(argv[++i]));
+		else if (arg == "--scaling") scaling = true;
+		else if (arg == "--compare") compare = true;
+		else if (arg == "--against" && has_value)
+		{
+			reference_name = argv[++i];
+			if (!ParseEngine(reference_name, reference_engine)) {PrintUsage(); return 2;}
+		}
+		else if (arg == "--math" && has_value)
+		{
+			std::string name = argv[++i];
+			int found = CpuShaderMath::Num_Precisions;
+			for (int j = 0; j != CpuShaderMath::Num_Precisions; ++j)
+			{
+				if (name == CpuShaderMath::GetPrecisionName(static_cast<CpuShaderMath::Precision>(j))) found = j;
+			}
+			if (found == CpuShaderMath::Num_Precisions) {PrintUsage(); return 2;}
+			precision = static_cast<CpuShaderMath::Precision>(found);
+		}
+		else if (arg == "--bench-math") bench_math = true;
+		else if (arg == "--bench-texture") bench_texture = true;
+		else if (arg == "--no-library") use_library = false;
+		else if (arg == "--dump") dump = true;
+		else if (arg == "--passes") print_passes = true;
+		else if (arg == "--skip" && has_value)
+		{
+			std::string name = argv[++i];
+			int found = CpuBytecodeOptimizer::Num_Passes;
+			for (int j = 0; j != CpuBytecodeOptimizer::Num_Passes; ++j)
+			{
+				if (name == CpuBytecodeOptimizer::GetPassName(static_cast<CpuBytecodeOptimizer::Pass>(j))) found = j;
+			}
+			if (found == CpuBytecodeOptimizer::Num_Passes) {PrintUsage(); return 2;}
+			is_pass_enabled[found] = false;
+		}
+		else if (arg == "--no-optimize") std::fill(is_pass_enabled, is_pass_enabled + CpuBytecodeOptimizer::Num_Passes, false);
+		else if (arg == "-q" || arg == "--quiet") quiet = true;
+		else if (arg == "-h" || arg == "--help") {PrintUsage(); return 0;}
+		else if (!arg.empty() && arg[0] == '-') {PrintUsage(); return 2;}
+		else paths.push_back(arg);
+	}
+	if (bench_math) return BenchMath(quiet);
+	if (paths.empty()) paths.push_back(default_shader_directory);
+	if (!output_directory.empty()) MakeDirectory(output_directory);
+
+	std::vector<std::string> files;
+	for (size_t i = 0; i != paths.size(); ++i)
+	{
+		if (IsDirectory(paths[i])) ListShaderFiles(paths[i], files);
+		else files.push_back(paths[i]);
+	}
+
+	// the same header the editor puts in front of its text.
+	ShaderIncludeGraph include_graph(header_directory);
+	include_graph.AddRoot(header_root);
+	include_graph.Refresh();
+	const std::string& header_bytes = include_graph.GetText();
+	std::wstring header(header_bytes.begin(), header_bytes.end());
+
+	CpuTexturePtr texture(new CpuTexture);
+	if (!texture->LoadBmp(texture_path) && !quiet) std::cerr << texture_path << ": warning: can not be read, t0 is black\n";
+	if (bench_texture) return BenchTexture(*texture, quiet);
+
+	size_t image_width = static_cast<size_t>(width), image_height = static_cast<size_t>(height);
+	size_t num_failed = 0;
+	size_t total_pixels = 0;
+	double total_time = 0;
+	double total_reference_time = 0;
+	for (size_t i = 0; i != files.size(); ++i)
+	{
+		std::wstring text;
+		if (!ReadShader(files[i], text))
+		{
+			if (!quiet) std::cout << files[i] << ": error: can not be read\n";
+			++num_failed;
+			continue;
+		}
+
+		CpuRenderer renderer;
+		CpuBytecodeOptimizer& optimizer = renderer.GetOptimizer();
+		for (int j = 0; j != CpuBytecodeOptimizer::Num_Passes; ++j)
+		{
+			optimizer.EnablePass(static_cast<CpuBytecodeOptimizer::Pass>(j), is_pass_enabled[j]);
+		}
+		renderer.SetPrecision(precision);
+		renderer.EnableLibrary(use_library);
+		if (!renderer.SetShader(header, text))
+		{
+			const std::vector<CpuShaderProgram::Error>& errors = renderer.GetErrors();
+			for (size_t j = 0; j != errors.size() && !quiet; ++j)
+			{
+				std::cout << files[i] << "(" << errors[j].line + 1 << "): error: " << errors[j].message << "\n";
+			}
+			++num_failed;
+			continue;
+		}
+		renderer.SetTexture(0, texture);
+		renderer.SetTime(time);
+		renderer.SetMousePosition(mpos);
+		renderer.SetEngine(engine);
+		renderer.SetInstructionSet(instruction_set);
+		renderer.SetNumThreads(num_threads);
+		renderer.SetJitCache(jit_cache);
+		if (dump && !quiet)
+		{
+			std::cout << files[i] << ":\n";
+			renderer.GetBytecode().Dump(std::cout);
+		}
+
+		// the native build is not part of the render.
+		if (engine == CpuRenderer::EN_Native && wait_for_native && !renderer.WaitForNative() && !quiet)
+		{
+			std::cerr << files[i] << ": warning: no native code, on the simd vm\n" << renderer.GetJit()->GetError();
+		}
+
+		std::vector<float> pixels;
+		TimePoint begin = Now();
+		renderer.Render(image_width, image_height, pixels);
+		double elapsed = Microseconds(begin, Now());
+		CpuRenderer::Engine rendered_engine = renderer.GetRenderedEngine();
+		total_pixels += image_width * image_height;
+		total_time += elapsed;
+
+		// the largest difference of a component from the reference's.
+		double reference_elapsed = 0;
+		float difference = 0;
+		if (compare)
+		{
+			std::vector<float> reference;
+			renderer.SetEngine(reference_engine);
+			begin = Now();
+			renderer.Render(image_width, image_height, reference);
+			reference_elapsed = Microseconds(begin, Now());
+			total_reference_time += reference_elapsed;
+			for (size_t j = 0; j != pixels.size(); ++j)
+			{
+				float d = std::fabs(pixels[j] - reference[j]);
+				if (!(d <= difference)) difference = d;
+			}
+			renderer.SetEngine(engine);
+		}
+
+		// the same frame on ever more threads, each timed against one.
+		std::vector<std::pair<size_t, double> > scaling_times;
+		size_t scaling_stolen = 0;
+		bool is_same_on_threads = true;
+		if (scaling)
+		{
+			size_t max_threads = renderer.GetNumThreads();
+			for (size_t threads = 1; ; threads = std::min(threads * 2, max_threads))
+			{
+				std::vector<float> threaded;
+				renderer.SetNumThreads(threads);
+				begin = Now();
+				renderer.Render(image_width, image_height, threaded);
+				scaling_times.push_back(std::make_pair(threads, Microseconds(begin, Now())));
+				scaling_stolen += renderer.GetNumStolenTiles();
+				// by the bits, as a nan is not equal to itself.
+				if (std::memcmp(&threaded[0], &pixels[0], pixels.size() * sizeof(float)) != 0) is_same_on_threads = false;
+				if (threads == max_threads) break;
+			}
+			renderer.SetNumThreads(num_threads);
+		}
+
+		if (!output_directory.empty())
+		{
+			std::string output_path = output_directory + "/" + BaseName(files[i]) + ".bmp";
+			std::vector<unsigned char> bytes;
+			CpuRenderer::ToBytes(pixels, bytes);
+			if (!ImageFile::SaveBmp(output_path, image_width, image_height, bytes))
+			{
+				if (!quiet) std::cout << output_path << ": error: can not be written\n";
+				++num_failed;
+			}
+		}
+
+		if (quiet) continue;
+		std::cout << files[i] << ": " << elapsed / 1000.0 << " ms, "
+			<< image_width * image_height / std::max(elapsed, 1.0) << " Mpixels/s";
+		if (renderer.GetNumDiscarded() != 0) std::cout << ", " << renderer.GetNumDiscarded() << " discarded";
+		if (renderer.GetNumCutOffLoops() != 0) std::cout << ", " << renderer.GetNumCutOffLoops() << " loops cut off";
+		if (engine == CpuRenderer::EN_Native)
+		{
+			const CpuShaderJit* jit = renderer.GetJit();
+			if (rendered_engine != CpuRenderer::EN_Native) std::cout << ", on the simd vm while native code builds";
+			else if (jit->IsCached()) std::cout << ", native from the cache";
+			else std::cout << ", native built in " << jit->GetBuildTime() / 1000.0 << " ms";
+		}
+		if (compare) std::cout << ", " << reference_elapsed / std::max(elapsed, 1.0) << "x the " << reference_name << ", max difference " << difference;
+		std::cout << "\n";
+		if (scaling)
+		{
+			double single = std::max(scaling_times[0].second, 1.0);
+			for (size_t j = 0; j != scaling_times.size(); ++j)
+			{
+				size_t threads = scaling_times[j].first;
+				double speedup = single / std::max(scaling_times[j].second, 1.0);
+				std::cout << "  " << threads << (threads == 1 ? " thread: " : " threads: ") << scaling_times[j].second / 1000.0 << " ms, "
+					<< speedup << "x, " << static_cast<int>(speedup / threads * 100.0 + 0.5) << "% efficient\n";
+			}
+			std::cout << "  " << renderer.GetNumTiles() << " tiles, " << scaling_stolen << " stolen";
+			if (!is_same_on_threads) std::cout << ", error: the threads drew it differently";
+			std::cout << "\n";
+		}
+		if (print_passes)
+		{
+			const CpuBytecodeOptimizer& optimizer = renderer.GetOptimizer();
+			std::cout << " ";
+			for (int j = 0; j != CpuBytecodeOptimizer::Num_Passes; ++j)
+			{
+				CpuBytecodeOptimizer::Pass pass = static_cast<CpuBytecodeOptimizer::Pass>(j);
+				std::cout << (j == 0 ? " " : ", ") << CpuBytecodeOptimizer::GetPassName(pass) << " "
+					<< optimizer.GetNumInstructionsBefore(pass) << " -> " << optimizer.GetNumInstructionsAfter(pass);
+				if (pass == CpuBytecodeOptimizer::OP_Unroll) std::cout << " (" << optimizer.GetNumUnrolledLoops() << " loops)";
+				if (pass == CpuBytecodeOptimizer::OP_Hoist) std::cout << " (" << optimizer.GetNumHoisted() << " once a frame)";
+			}
+			std::cout << " instructions\n";
+		}
+		if (!is_same_on_threads) ++num_failed;
+	}
+
+	if (!quiet)
+	{
+		std::cout << files.size() - num_failed << "/" << files.size() << " shaders rendered at " << image_width << "x" << image_height
+			<< ", " << total_pixels / std::max(total_time, 1.0) << " Mpixels/s overall";
+		if (compare) std::cout << ", " << total_reference_time / std::max(total_time, 1.0) << "x the " << reference_name;
+		size_t threads = num_threads != 0 ? num_threads : std::max<size_t>(boost::thread::hardware_concurrency(), 1);
+		std::cout << " on " << threads << (threads == 1 ? " thread" : " threads");
+		if (engine == CpuRenderer::EN_Simd || engine == CpuRenderer::EN_Native)
+		{
+			if (!CpuSimdVm::IsSupported(CpuSimdVm::GetBestInstructionSet())) std::cout << ", simd on the scalar vm";
+			else
+			{
+				if (!CpuSimdVm::IsSupported(instruction_set)) instruction_set = CpuSimdVm::GetBestInstructionSet();
+				if (engine == CpuRenderer::EN_Native) instruction_set = CpuSimdVm::GetBestInstructionSet();
+				std::cout << (engine == CpuRenderer::EN_Native ? ", native on " : ", simd on ") << CpuSimdVm::GetInstructionSetName(instruction_set) << " with " << CpuSimdVm::GetWidth(instruction_set) << " lanes";
+			}
+		}
+		std::cout << "\n";
+	}
+	return num_failed == 0 ? 0 : 1;
+}
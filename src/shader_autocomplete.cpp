@@ -0,0 +1,218 @@
+#include "common.hpp"
+#include "shader_autocomplete.hpp"
+#include "keywords.hpp"
+
+#include <algorithm>
+#include <cwctype>
+
+// the components a swizzle is made of, up to four of them.
+static const wchar_t* swizzle_sets[] = {L"xyzw", L"rgba"};
+
+static void AddSwizzles(const std::wstring& swizzle, const wchar_t* components, std::vector<std::wstring>& swizzles)
+{
+	if (swizzle.length() == 4) return;
+	for (const wchar_t* c = components; *c != 0; ++c)
+	{
+		std::wstring longer = swizzle + *c;
+		swizzles.push_back(longer);
+		AddSwizzles(longer, components, swizzles);
+	}
+}
+
+static std::wstring ToUpper(const std::wstring& word)
+{
+	std::wstring upper = word;
+	for (size_t i = 0; i != upper.length(); ++i) upper[i] = towupper(upper[i]);
+	return upper;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderAutocomplete::ShaderAutocomplete()
+{
+	WordList words;
+	for (size_t i = 0; i != ARRAYSIZE(kewords); ++i) words.push_back(std::make_pair(kewords[i], CK_Keyword));
+	for (size_t i = 0; i != ARRAYSIZE(global_funcs); ++i) words.push_back(std::make_pair(global_funcs[i], CK_Intrinsic));
+	for (size_t i = 0; i != ARRAYSIZE(extend_funcs); ++i) words.push_back(std::make_pair(extend_funcs[i], CK_Intrinsic));
+	BuildTrie(m_global_trie, words);
+
+	words.clear();
+	std::vector<std::wstring> swizzles;
+	for (size_t i = 0; i != ARRAYSIZE(swizzle_sets); ++i) AddSwizzles(L"", swizzle_sets[i], swizzles);
+	for (size_t i = 0; i != swizzles.size(); ++i) words.push_back(std::make_pair(swizzles[i], CK_Member));
+	for (size_t i = 0; i != ARRAYSIZE(member_funcs); ++i) words.push_back(std::make_pair(member_funcs[i], CK_Member));
+	BuildTrie(m_member_trie, words);
+
+	// the tokenizer knows them in lower case, they are written in upper.
+	words.clear();
+	for (size_t i = 0; i != ARRAYSIZE(semantics); ++i) words.push_back(std::make_pair(ToUpper(semantics[i]), CK_Semantic));
+	BuildTrie(m_semantic_trie, words);
+
+	words.clear();
+	BuildTrie(m_symbol_trie, words);
+}
+
+ShaderAutocomplete::~ShaderAutocomplete()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderAutocomplete::SetSymbols(const std::vector<std::wstring>& symbols)
+{
+	std::vector<std::wstring> sorted = symbols;
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+	if (sorted == m_symbols) return;
+	m_symbols.swap(sorted);
+
+	WordList words;
+	for (size_t i = 0; i != m_symbols.size(); ++i) words.push_back(std::make_pair(m_symbols[i], CK_Symbol));
+	BuildTrie(m_symbol_trie, words);
+}
+
+void ShaderAutocomplete::Complete(const std::wstring& prefix, CompletionContext context, size_t max_candidates,
+	std::vector<Candidate>& candidates) const
+{
+	candidates.clear();
+	std::vector<std::pair<const Trie*, unsigned int> > found;
+	if (context == CC_Global)
+	{
+		CollectCandidates(m_global_trie, prefix, found);
+		CollectCandidates(m_symbol_trie, prefix, found);
+	}
+	else if (context == CC_Member) CollectCandidates(m_member_trie, prefix, found);
+	else CollectCandidates(m_semantic_trie, ToUpper(prefix), found);
+
+	// most used first, then the shortest, then by name.
+	auto better = [](const std::pair<const Trie*, unsigned int>& a, const std::pair<const Trie*, unsigned int>& b) -> bool
+	{
+		size_t a_uses = a.first->uses[a.second], b_uses = b.first->uses[b.second];
+		if (a_uses != b_uses) return a_uses > b_uses;
+		const std::wstring& a_word = a.first->words[a.second];
+		const std::wstring& b_word = b.first->words[b.second];
+		if (a_word.length() != b_word.length()) return a_word.length() < b_word.length();
+		return a_word < b_word;
+	};
+	size_t num_sorted = std::min(found.size(), max_candidates * 2);
+	std::partial_sort(found.begin(), found.begin() + num_sorted, found.end(), better);
+
+	// a user function may be named like an intrinsic.
+	for (size_t i = 0; i != num_sorted && candidates.size() != max_candidates; ++i)
+	{
+		const Trie& trie = *found[i].first;
+		unsigned int idx = found[i].second;
+		if (!candidates.empty() && candidates.back().word == trie.words[idx]) continue;
+
+		Candidate candidate;
+		candidate.word = trie.words[idx];
+		candidate.kind = static_cast<CandidateKind>(trie.kinds[idx]);
+		candidate.uses = trie.uses[idx];
+		candidates.push_back(candidate);
+	}
+}
+
+void ShaderAutocomplete::NoteUse(const std::wstring& word)
+{
+	++m_uses[word];
+	CountUse(m_global_trie, word);
+	CountUse(m_member_trie, word);
+	CountUse(m_semantic_trie, word);
+	CountUse(m_symbol_trie, word);
+}
+
+size_t ShaderAutocomplete::GetNumWords() const
+{
+	return m_global_trie.words.size() + m_member_trie.words.size() + m_semantic_trie.words.size() + m_symbol_trie.words.size();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderAutocomplete::BuildTrie(Trie& trie, WordList& words) const
+{
+	std::sort(words.begin(), words.end());
+	trie.nodes.clear();
+	trie.labels.clear();
+	trie.words.clear();
+	trie.kinds.clear();
+	trie.uses.clear();
+	for (size_t i = 0; i != words.size(); ++i)
+	{
+		if (!trie.words.empty() && trie.words.back() == words[i].first) continue;
+		trie.words.push_back(words[i].first);
+		trie.kinds.push_back(static_cast<unsigned char>(words[i].second));
+
+		auto it = m_uses.find(words[i].first);
+		trie.uses.push_back(it != m_uses.end() ? it->second : 0);
+	}
+
+	// breadth first, so that the children of a node are made one after
+	// another. a word ending at a node sorts before the ones going on.
+	TrieNode root = {0, 0, 0, static_cast<unsigned int>(trie.words.size())};
+	trie.nodes.push_back(root);
+	trie.labels.push_back(0);
+	std::vector<size_t> depths(1, 0);
+	for (size_t i = 0; i != trie.nodes.size(); ++i)
+	{
+		size_t depth = depths[i];
+		unsigned int begin = trie.nodes[i].word_begin;
+		unsigned int end = trie.nodes[i].word_end;
+		while (begin != end && trie.words[begin].length() == depth) ++begin;
+
+		trie.nodes[i].first_child = static_cast<unsigned int>(trie.nodes.size());
+		while (begin != end)
+		{
+			wchar_t label = trie.words[begin][depth];
+			unsigned int group_end = begin + 1;
+			while (group_end != end && trie.words[group_end][depth] == label) ++group_end;
+
+			TrieNode child = {0, 0, begin, group_end};
+			trie.nodes.push_back(child);
+			trie.labels.push_back(label);
+			depths.push_back(depth + 1);
+			begin = group_end;
+		}
+		trie.nodes[i].num_children = static_cast<unsigned int>(trie.nodes.size()) - trie.nodes[i].first_child;
+	}
+}
+
+unsigned int ShaderAutocomplete::FindNode(const Trie& trie, const std::wstring& prefix) const
+{
+	unsigned int node = 0;
+	for (size_t i = 0; i != prefix.length(); ++i)
+	{
+		const TrieNode& parent = trie.nodes[node];
+		auto first = trie.labels.begin() + parent.first_child;
+		auto last = first + parent.num_children;
+		auto it = std::lower_bound(first, last, prefix[i]);
+		if (it == last || *it != prefix[i]) return no_node;
+		node = static_cast<unsigned int>(it - trie.labels.begin());
+	}
+	return node;
+}
+
+void ShaderAutocomplete::CollectCandidates(const Trie& trie, const std::wstring& prefix,
+	std::vector<std::pair<const Trie*, unsigned int> >& found) const
+{
+	unsigned int node = FindNode(trie, prefix);
+	if (node == no_node) return;
+
+	// the prefix itself, if it is a word, sorts first.
+	unsigned int begin = trie.nodes[node].word_begin;
+	unsigned int end = trie.nodes[node].word_end;
+	if (begin != end && trie.words[begin].length() == prefix.length()) ++begin;
+	for (unsigned int i = begin; i != end; ++i) found.push_back(std::make_pair(&trie, i));
+}
+
+void ShaderAutocomplete::CountUse(Trie& trie, const std::wstring& word) const
+{
+	unsigned int node = FindNode(trie, word);
+	if (node == no_node) return;
+
+	unsigned int idx = trie.nodes[node].word_begin;
+	if (idx != trie.nodes[node].word_end && trie.words[idx].length() == word.length()) ++trie.uses[idx];
+}
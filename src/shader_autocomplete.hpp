@@ -0,0 +1,99 @@
+#ifndef _SHADER_AUTOCOMPLETE_HPP_INCLUDED_
+#define _SHADER_AUTOCOMPLETE_HPP_INCLUDED_
+
+#include <map>
+#include <string>
+#include <vector>
+
+// completes the word being typed from the keywords, intrinsics, semantics
+// and swizzles the tokenizer knows, and from the symbols of the document.
+// the words sit in prefix tries flattened into arrays, where the words
+// below a node are a range of the sorted word list, so a lookup walks the
+// prefix and ranks one range: the words used most in this session first,
+// then the shorter ones.
+class ShaderAutocomplete
+{
+public:
+	// what the word is completed as, told by the character before it.
+	enum CompletionContext
+	{
+		CC_Global,
+		CC_Member,			// after a '.', methods and swizzles
+		CC_Semantic,		// after a ':', matched in any case
+	};
+
+	enum CandidateKind
+	{
+		CK_Keyword,
+		CK_Intrinsic,
+		CK_Member,
+		CK_Semantic,
+		CK_Symbol,
+	};
+
+	struct Candidate
+	{
+		std::wstring word;
+		CandidateKind kind;
+		size_t uses;
+	};
+
+public:
+	ShaderAutocomplete();
+	virtual ~ShaderAutocomplete();
+
+public:
+	// the symbols of the document visible where the word is typed. the
+	// trie of them is rebuilt only if they changed.
+	void SetSymbols(const std::vector<std::wstring>& symbols);
+
+	// the best candidates starting with prefix, the prefix itself left out.
+	void Complete(const std::wstring& prefix, CompletionContext context, size_t max_candidates,
+		std::vector<Candidate>& candidates) const;
+
+	// a word typed or picked, ranking it higher from now on.
+	void NoteUse(const std::wstring& word);
+
+	size_t GetNumWords() const;
+
+private:
+	static const unsigned int no_node = static_cast<unsigned int>(-1);
+
+	// children of a node are consecutive, their labels sorted.
+	struct TrieNode
+	{
+		unsigned int first_child;
+		unsigned int num_children;
+		unsigned int word_begin;		// the words below, in the sorted list
+		unsigned int word_end;
+	};
+
+	struct Trie
+	{
+		std::vector<TrieNode> nodes;
+		std::vector<wchar_t> labels;		// by node
+		std::vector<std::wstring> words;
+		std::vector<unsigned char> kinds;	// by word
+		std::vector<size_t> uses;			// by word
+	};
+
+	typedef std::vector<std::pair<std::wstring, CandidateKind> > WordList;
+
+	void BuildTrie(Trie& trie, WordList& words) const;
+	unsigned int FindNode(const Trie& trie, const std::wstring& prefix) const;
+	void CollectCandidates(const Trie& trie, const std::wstring& prefix,
+		std::vector<std::pair<const Trie*, unsigned int> >& found) const;
+	void CountUse(Trie& trie, const std::wstring& word) const;
+
+private:
+	Trie m_global_trie;
+	Trie m_member_trie;
+	Trie m_semantic_trie;
+	Trie m_symbol_trie;
+	std::vector<std::wstring> m_symbols;
+
+	// uses by word, kept for the symbols across rebuilds.
+	std::map<std::wstring, size_t> m_uses;
+};
+
+#endif  // _SHADER_AUTOCOMPLETE_HPP_INCLUDED_
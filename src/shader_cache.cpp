@@ -0,0 +1,294 @@
+#include "common.hpp"
+#include "shader_cache.hpp"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+static const char cache_file_magic[4] = {'L', 'C', 'S', '2'};
+static const char index_file_name[] = "index.txt";
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderCache::ShaderCache(const std::string& directory /*= ""*/,
+	size_t max_memory_bytes /*= 16 * 1024 * 1024*/,
+	size_t max_disk_entries /*= 256*/)
+	: m_memory_bytes(0)
+	, m_max_memory_bytes(max_memory_bytes)
+	, m_directory(directory)
+	, m_max_disk_entries(max_disk_entries)
+	, m_index_dirty(false)
+{
+	memset(&m_statistics, 0, sizeof(m_statistics));
+
+	if (!m_directory.empty())
+	{
+		MakeDirectory(m_directory);
+		LoadIndex();
+	}
+}
+
+ShaderCache::~ShaderCache()
+{
+	if (m_index_dirty) SaveIndex();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+ContentHash ShaderCache::MakeKey(const ShaderCompileInput& input)
+{
+	ContentHasher hasher;
+	hasher.Update(input.GetSource());
+	hasher.Update(input.entry_point);
+	hasher.Update(input.profile);
+	hasher.UpdateValue(input.flags);
+	return hasher.Finish();
+}
+
+bool ShaderCache::Lookup(const ContentHash& key, std::vector<char>& bytecode, std::string& messages)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	auto it = m_memory_entries.find(key);
+	if (it != m_memory_entries.end())
+	{
+		m_memory_lru.splice(m_memory_lru.end(), m_memory_lru, it->second.lru_pos);
+		bytecode = it->second.bytecode;
+		messages = it->second.messages;
+		++m_statistics.memory_hits;
+		return true;
+	}
+
+	if (m_disk_entries.find(key) != m_disk_entries.end())
+	{
+		if (ReadDiskEntry(key, bytecode, messages))
+		{
+			TouchDiskEntry(key);
+			InsertMemory(key, bytecode, messages);
+			++m_statistics.disk_hits;
+			return true;
+		}
+
+		// the file is gone or damaged, forget about it.
+		m_disk_lru.erase(m_disk_entries[key]);
+		m_disk_entries.erase(key);
+		m_index_dirty = true;
+	}
+
+	++m_statistics.misses;
+	return false;
+}
+
+void ShaderCache::Insert(const ContentHash& key, const std::vector<char>& bytecode, const std::string& messages)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	InsertMemory(key, bytecode, messages);
+
+	if (!m_directory.empty() && m_disk_entries.find(key) == m_disk_entries.end())
+	{
+		if (WriteDiskEntry(key, bytecode, messages))
+		{
+			m_disk_entries[key] = m_disk_lru.insert(m_disk_lru.end(), key);
+			m_index_dirty = true;
+			EvictDisk();
+		}
+	}
+
+	if (m_index_dirty) SaveIndex();
+	m_index_dirty = false;
+}
+
+void ShaderCache::Clear()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	for (auto it = m_disk_lru.begin(); it != m_disk_lru.end(); ++it)
+	{
+		std::remove(GetEntryPath(*it).c_str());
+	}
+	m_disk_entries.clear();
+	m_disk_lru.clear();
+
+	m_memory_entries.clear();
+	m_memory_lru.clear();
+	m_memory_bytes = 0;
+
+	if (!m_directory.empty()) SaveIndex();
+	m_index_dirty = false;
+}
+
+size_t ShaderCache::GetMemoryEntries() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_memory_entries.size();
+}
+
+size_t ShaderCache::GetMemoryBytes() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_memory_bytes;
+}
+
+size_t ShaderCache::GetDiskEntries() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_disk_entries.size();
+}
+
+ShaderCache::Statistics ShaderCache::GetStatistics() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_statistics;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderCache::InsertMemory(const ContentHash& key, const std::vector<char>& bytecode, const std::string& messages)
+{
+	auto it = m_memory_entries.find(key);
+	if (it != m_memory_entries.end())
+	{
+		m_memory_lru.splice(m_memory_lru.end(), m_memory_lru, it->second.lru_pos);
+		return;
+	}
+
+	// never keep a single entry which is larger than the whole budget.
+	size_t size = bytecode.size() + messages.size();
+	if (size > m_max_memory_bytes) return;
+
+	MemoryEntry& entry = m_memory_entries[key];
+	entry.bytecode = bytecode;
+	entry.messages = messages;
+	entry.lru_pos = m_memory_lru.insert(m_memory_lru.end(), key);
+	m_memory_bytes += size;
+	EvictMemory();
+}
+
+void ShaderCache::EvictMemory()
+{
+	while (m_memory_bytes > m_max_memory_bytes && !m_memory_lru.empty())
+	{
+		ContentHash oldest = m_memory_lru.front();
+		m_memory_lru.pop_front();
+
+		auto it = m_memory_entries.find(oldest);
+		m_memory_bytes -= it->second.bytecode.size() + it->second.messages.size();
+		m_memory_entries.erase(it);
+		++m_statistics.memory_evictions;
+	}
+}
+
+bool ShaderCache::ReadDiskEntry(const ContentHash& key, std::vector<char>& bytecode, std::string& messages) const
+{
+	std::ifstream ifs(GetEntryPath(key).c_str(), std::ios::binary);
+	if (!ifs.is_open()) return false;
+
+	char magic[4];
+	ContentHash stored_key;
+	unsigned long long size = 0;
+	ifs.read(magic, sizeof(magic));
+	ifs.read(reinterpret_cast<char*>(&stored_key.hi), sizeof(stored_key.hi));
+	ifs.read(reinterpret_cast<char*>(&stored_key.lo), sizeof(stored_key.lo));
+	ifs.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if (!ifs.good() || memcmp(magic, cache_file_magic, sizeof(magic)) != 0) return false;
+	if (stored_key != key || size == 0 || size > (1ULL << 30)) return false;
+
+	bytecode.resize(static_cast<size_t>(size));
+	ifs.read(&bytecode[0], bytecode.size());
+	if (ifs.gcount() != static_cast<std::streamsize>(bytecode.size())) return false;
+
+	// the warnings follow the bytecode, length first.
+	unsigned long long messages_size = 0;
+	ifs.read(reinterpret_cast<char*>(&messages_size), sizeof(messages_size));
+	if (!ifs.good() || messages_size > (1ULL << 24)) return false;
+	messages.assign(static_cast<size_t>(messages_size), '\0');
+	if (messages.empty()) return true;
+	ifs.read(&messages[0], messages.size());
+	return ifs.gcount() == static_cast<std::streamsize>(messages.size());
+}
+
+bool ShaderCache::WriteDiskEntry(const ContentHash& key, const std::vector<char>& bytecode, const std::string& messages) const
+{
+	if (bytecode.empty()) return false;
+
+	// write aside and rename, so a crash never leaves a half written entry.
+	std::string path = GetEntryPath(key);
+	std::string temp_path = path + ".tmp";
+	{
+		std::ofstream ofs(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+		if (!ofs.is_open()) return false;
+
+		unsigned long long size = bytecode.size();
+		ofs.write(cache_file_magic, sizeof(cache_file_magic));
+		ofs.write(reinterpret_cast<const char*>(&key.hi), sizeof(key.hi));
+		ofs.write(reinterpret_cast<const char*>(&key.lo), sizeof(key.lo));
+		ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		ofs.write(&bytecode[0], bytecode.size());
+		unsigned long long messages_size = messages.size();
+		ofs.write(reinterpret_cast<const char*>(&messages_size), sizeof(messages_size));
+		ofs.write(messages.data(), messages.size());
+		if (!ofs.good()) return false;
+	}
+
+	std::remove(path.c_str());
+	return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+void ShaderCache::TouchDiskEntry(const ContentHash& key)
+{
+	auto it = m_disk_entries.find(key);
+	if (it == m_disk_entries.end()) return;
+
+	m_disk_lru.splice(m_disk_lru.end(), m_disk_lru, it->second);
+	m_index_dirty = true;
+}
+
+void ShaderCache::EvictDisk()
+{
+	while (m_disk_entries.size() > m_max_disk_entries && !m_disk_lru.empty())
+	{
+		ContentHash oldest = m_disk_lru.front();
+		m_disk_lru.pop_front();
+		m_disk_entries.erase(oldest);
+		std::remove(GetEntryPath(oldest).c_str());
+		m_index_dirty = true;
+		++m_statistics.disk_evictions;
+	}
+}
+
+void ShaderCache::LoadIndex()
+{
+	// one key per line, least recently used first.
+	std::ifstream ifs((m_directory + "/" + index_file_name).c_str());
+	if (!ifs.is_open()) return;
+
+	std::string line;
+	while (std::getline(ifs, line))
+	{
+		ContentHash key;
+		if (!key.FromString(line)) continue;
+		if (m_disk_entries.find(key) != m_disk_entries.end()) continue;
+		m_disk_entries[key] = m_disk_lru.insert(m_disk_lru.end(), key);
+	}
+	EvictDisk();
+}
+
+void ShaderCache::SaveIndex() const
+{
+	std::ofstream ofs((m_directory + "/" + index_file_name).c_str(), std::ios::trunc);
+	if (!ofs.is_open()) return;
+
+	for (auto it = m_disk_lru.begin(); it != m_disk_lru.end(); ++it)
+	{
+		ofs << it->ToString() << '\n';
+	}
+}
+
+std::string ShaderCache::GetEntryPath(const ContentHash& key) const
+{
+	return m_directory + "/" + key.ToString() + ".cso";
+}
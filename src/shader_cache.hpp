@@ -0,0 +1,89 @@
+#ifndef _SHADER_CACHE_HPP_INCLUDED_
+#define _SHADER_CACHE_HPP_INCLUDED_
+
+#include <map>
+#include <list>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "content_hash.hpp"
+#include "shader_compiler.hpp"
+
+class ShaderCache;
+typedef boost::shared_ptr<ShaderCache> ShaderCachePtr;
+
+// compiled shader bytecode addressed by a hash of the full compile input,
+// with the warnings the compile printed, so a hit can show them again.
+// entries live in a size bounded LRU in memory, and are also written to
+// one file per entry under the cache directory, bounded by entry count.
+class ShaderCache
+{
+public:
+	struct Statistics
+	{
+		size_t memory_hits;
+		size_t disk_hits;
+		size_t misses;
+		size_t memory_evictions;
+		size_t disk_evictions;
+	};
+
+public:
+	// an empty directory keeps the cache in memory only.
+	ShaderCache(const std::string& directory = "",
+		size_t max_memory_bytes = 16 * 1024 * 1024,
+		size_t max_disk_entries = 256);
+	virtual ~ShaderCache();
+
+public:
+	static ContentHash MakeKey(const ShaderCompileInput& input);
+
+	bool Lookup(const ContentHash& key, std::vector<char>& bytecode, std::string& messages);
+	void Insert(const ContentHash& key, const std::vector<char>& bytecode, const std::string& messages);
+	void Clear();
+
+	size_t GetMemoryEntries() const;
+	size_t GetMemoryBytes() const;
+	size_t GetDiskEntries() const;
+	Statistics GetStatistics() const;
+
+private:
+	typedef std::list<ContentHash> LRUList;
+
+	struct MemoryEntry
+	{
+		std::vector<char> bytecode;
+		std::string messages;
+		LRUList::iterator lru_pos;
+	};
+
+	void InsertMemory(const ContentHash& key, const std::vector<char>& bytecode, const std::string& messages);
+	void EvictMemory();
+
+	bool ReadDiskEntry(const ContentHash& key, std::vector<char>& bytecode, std::string& messages) const;
+	bool WriteDiskEntry(const ContentHash& key, const std::vector<char>& bytecode, const std::string& messages) const;
+	void TouchDiskEntry(const ContentHash& key);
+	void EvictDisk();
+
+	void LoadIndex();
+	void SaveIndex() const;
+	std::string GetEntryPath(const ContentHash& key) const;
+
+private:
+	mutable boost::mutex m_mutex;
+
+	std::map<ContentHash, MemoryEntry> m_memory_entries;
+	LRUList m_memory_lru;
+	size_t m_memory_bytes;
+	size_t m_max_memory_bytes;
+
+	std::string m_directory;
+	std::map<ContentHash, LRUList::iterator> m_disk_entries;
+	LRUList m_disk_lru;
+	size_t m_max_disk_entries;
+	bool m_index_dirty;
+
+	Statistics m_statistics;
+};
+
+#endif  // _SHADER_CACHE_HPP_INCLUDED_
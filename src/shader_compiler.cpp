@@ -0,0 +1,44 @@
+#include "common.hpp"
+#include "shader_compiler.hpp"
+
+static const std::string empty_source;
+
+//////////////////////////////////////////////////////////////////////////
+// compile input / output
+//////////////////////////////////////////////////////////////////////////
+ShaderCompileInput::ShaderCompileInput()
+	: flags(0)
+{
+
+}
+
+ShaderCompileInput::ShaderCompileInput(const std::string& source, const std::string& entry_point,
+	const std::string& profile, unsigned int flags)
+	: source(new std::string(source))
+	, entry_point(entry_point)
+	, profile(profile)
+	, flags(flags)
+{
+
+}
+
+ShaderCompileInput::ShaderCompileInput(ShaderSourcePtr source, const std::string& entry_point,
+	const std::string& profile, unsigned int flags)
+	: source(source)
+	, entry_point(entry_point)
+	, profile(profile)
+	, flags(flags)
+{
+
+}
+
+const std::string& ShaderCompileInput::GetSource() const
+{
+	return source ? *source : empty_source;
+}
+
+ShaderCompileOutput::ShaderCompileOutput()
+	: from_cache(false)
+{
+
+}
@@ -0,0 +1,62 @@
+#ifndef _SHADER_COMPILER_HPP_INCLUDED_
+#define _SHADER_COMPILER_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+class ShaderCompiler;
+typedef boost::shared_ptr<ShaderCompiler> ShaderCompilerPtr;
+
+// the source is shared and never modified once handed to a compile input,
+// so inputs are cheap to copy between threads.
+typedef boost::shared_ptr<const std::string> ShaderSourcePtr;
+
+// the D3D10_SHADER_* flags the tools use, spelled out for other platforms.
+enum ShaderCompileFlag
+{
+	SCF_Debug = 1 << 0,
+	SCF_SkipOptimization = 1 << 2,
+	SCF_OptimizationLevel3 = 1 << 15,
+};
+
+struct ShaderCompileInput
+{
+	ShaderSourcePtr source;		// the full text handed to the compiler, headers included
+	std::string entry_point;
+	std::string profile;
+	unsigned int flags;
+
+	ShaderCompileInput();
+	ShaderCompileInput(const std::string& source, const std::string& entry_point,
+		const std::string& profile, unsigned int flags);
+	ShaderCompileInput(ShaderSourcePtr source, const std::string& entry_point,
+		const std::string& profile, unsigned int flags);
+
+	const std::string& GetSource() const;
+};
+
+struct ShaderCompileOutput
+{
+	std::vector<char> bytecode;
+	std::string error_message;	// fxc formatted diagnostics
+	bool from_cache;
+
+	ShaderCompileOutput();
+};
+
+// the interface every shader compiler backend implements.
+// implementations must be safe to call from several threads at once.
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler() {}
+
+public:
+	virtual bool Compile(const ShaderCompileInput& input, ShaderCompileOutput& output) = 0;
+
+	// answers only if the result is at hand without compiling, e.g. cached.
+	virtual bool Probe(const ShaderCompileInput& input, ShaderCompileOutput& output) {return false;}
+};
+
+#endif  // _SHADER_COMPILER_HPP_INCLUDED_
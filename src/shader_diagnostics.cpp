@@ -0,0 +1,246 @@
+#include "common.hpp"
+#include "shader_diagnostics.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+static bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+// reads an unsigned number at pos, advancing pos past it.
+static bool ReadNumber(const char* line, size_t length, size_t& pos, size_t& value)
+{
+	if (pos >= length || !IsDigit(line[pos])) return false;
+
+	value = 0;
+	while (pos < length && IsDigit(line[pos])) value = value * 10 + (line[pos++] - '0');
+	return true;
+}
+
+// parses "(line,column)" or "(line,column-end_column)" ending right before end.
+static bool ReadLocation(const char* line, size_t begin, size_t end, ShaderDiagnostic& diagnostic)
+{
+	size_t pos = begin + 1;
+	if (begin >= end || line[begin] != '(' || line[end - 1] != ')') return false;
+
+	if (!ReadNumber(line, end, pos, diagnostic.line)) return false;
+	if (pos < end && line[pos] == ',')
+	{
+		++pos;
+		if (!ReadNumber(line, end, pos, diagnostic.column)) return false;
+		if (pos < end && line[pos] == '-')
+		{
+			++pos;
+			if (!ReadNumber(line, end, pos, diagnostic.end_column)) return false;
+		}
+	}
+	return pos == end - 1;
+}
+
+// parses "error|warning [code]: message" starting at pos.
+static bool ReadDiagnosticBody(const char* line, size_t length, size_t pos, ShaderDiagnostic& diagnostic)
+{
+	while (pos < length && IsSpace(line[pos])) ++pos;
+
+	if (length - pos >= 5 && strncmp(line + pos, "error", 5) == 0)
+	{
+		diagnostic.severity = DS_Error;
+		pos += 5;
+	}
+	else if (length - pos >= 7 && strncmp(line + pos, "warning", 7) == 0)
+	{
+		diagnostic.severity = DS_Warning;
+		pos += 7;
+	}
+	else return false;
+
+	size_t code_begin = pos;
+	while (pos < length && IsSpace(line[pos])) ++pos;
+	if (pos == code_begin && pos < length && line[pos] != ':') return false;
+
+	code_begin = pos;
+	while (pos < length && line[pos] != ':' && !IsSpace(line[pos])) ++pos;
+	diagnostic.code.assign(line + code_begin, pos - code_begin);
+
+	while (pos < length && IsSpace(line[pos])) ++pos;
+	if (pos >= length || line[pos] != ':') return false;
+	++pos;
+
+	while (pos < length && IsSpace(line[pos])) ++pos;
+	size_t message_end = length;
+	while (message_end > pos && IsSpace(line[message_end - 1])) --message_end;
+	diagnostic.message.assign(line + pos, message_end - pos);
+	return true;
+}
+
+static bool ParseLine(const char* line, size_t length, ShaderDiagnostic& diagnostic)
+{
+	// without a location the line starts with the severity.
+	if (ReadDiagnosticBody(line, length, 0, diagnostic)) return true;
+
+	// otherwise the location is the last "(...)" before the first "): ".
+	// searching from the location side keeps parentheses in paths harmless.
+	for (size_t close = 0; close + 2 < length; ++close)
+	{
+		if (line[close] != ')' || line[close + 1] != ':') continue;
+
+		size_t open = close;
+		while (open > 0 && line[open] != '(') --open;
+		if (line[open] != '(') continue;
+
+		ShaderDiagnostic located;
+		if (!ReadLocation(line, open, close + 1, located)) continue;
+		if (!ReadDiagnosticBody(line, length, close + 2, located)) continue;
+
+		located.file.assign(line, open);
+		diagnostic = located;
+		return true;
+	}
+
+	// dxc and other clang based compilers write "file:line:column: ".
+	for (size_t colon = 0; colon + 2 < length; ++colon)
+	{
+		if (line[colon] != ':' || !IsDigit(line[colon + 1])) continue;
+
+		ShaderDiagnostic located;
+		size_t pos = colon + 1;
+		if (!ReadNumber(line, length, pos, located.line)) continue;
+		if (pos + 1 < length && line[pos] == ':' && IsDigit(line[pos + 1]))
+		{
+			++pos;
+			ReadNumber(line, length, pos, located.column);
+		}
+		if (pos >= length || line[pos] != ':') continue;
+		if (!ReadDiagnosticBody(line, length, pos + 1, located)) continue;
+
+		located.file.assign(line, colon);
+		diagnostic = located;
+		return true;
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// shader diagnostic
+//////////////////////////////////////////////////////////////////////////
+ShaderDiagnostic::ShaderDiagnostic()
+	: severity(DS_Error)
+	, line(0)
+	, column(0)
+	, end_column(0)
+	, source_line(0)
+	, is_mapped(false)
+{
+
+}
+
+bool ShaderDiagnostic::HasLocation() const
+{
+	return line != 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+size_t ParseShaderDiagnostics(const std::string& text, ShaderDiagnostics& diagnostics)
+{
+	size_t num_parsed = 0;
+	const char* data = text.c_str();
+
+	size_t line_begin = 0;
+	while (line_begin < text.length())
+	{
+		size_t line_end = text.find('\n', line_begin);
+		if (line_end == std::string::npos) line_end = text.length();
+
+		ShaderDiagnostic diagnostic;
+		if (ParseLine(data + line_begin, line_end - line_begin, diagnostic))
+		{
+			diagnostics.push_back(diagnostic);
+			++num_parsed;
+		}
+		line_begin = line_end + 1;
+	}
+	return num_parsed;
+}
+
+void MapShaderDiagnostics(const ShaderSourceMap& source_map, ShaderDiagnostics& diagnostics)
+{
+	for (size_t i = 0; i != diagnostics.size(); ++i)
+	{
+		ShaderDiagnostic& diagnostic = diagnostics[i];
+		ShaderSourceMap::Location location;
+
+		diagnostic.is_mapped = diagnostic.HasLocation() && source_map.Resolve(diagnostic.line, location);
+		if (diagnostic.is_mapped)
+		{
+			diagnostic.source = location.source;
+			diagnostic.source_line = location.line;
+		}
+	}
+}
+
+size_t CountShaderDiagnostics(const ShaderDiagnostics& diagnostics, DiagnosticSeverity severity)
+{
+	size_t count = 0;
+	for (size_t i = 0; i != diagnostics.size(); ++i)
+	{
+		if (diagnostics[i].severity == severity) ++count;
+	}
+	return count;
+}
+
+ShaderErrorTip MakeShaderErrorTip(const std::string& output, const ShaderSourceMap& source_map, const std::string& editor_source)
+{
+	ShaderDiagnostics diagnostics;
+	ParseShaderDiagnostics(output, diagnostics);
+	MapShaderDiagnostics(source_map, diagnostics);
+
+	// prefer an error inside the editor text, it is the one that can be pointed at.
+	const ShaderDiagnostic* shown = NULL;
+	for (size_t i = 0; i != diagnostics.size(); ++i)
+	{
+		const ShaderDiagnostic& diagnostic = diagnostics[i];
+		if (diagnostic.severity != DS_Error) continue;
+		if (shown == NULL) shown = &diagnostic;
+		if (diagnostic.is_mapped && diagnostic.source == editor_source)
+		{
+			shown = &diagnostic;
+			break;
+		}
+	}
+
+	ShaderErrorTip tip;
+	tip.row = -1;
+	tip.column = -1;
+	std::ostringstream message;
+	if (shown == NULL)
+	{
+		// nothing fxc formatted, show the first line as it is.
+		message << std::string(output.begin(), std::find(output.begin(), output.end(), '\n'));
+	}
+	else if (shown->is_mapped && shown->source == editor_source)
+	{
+		tip.row = static_cast<int>(shown->source_line) - 1;
+		tip.column = shown->column > 0 ? static_cast<int>(shown->column) - 1 : 0;
+		message << shown->message;
+	}
+	else
+	{
+		if (shown->is_mapped && !shown->source.empty()) message << shown->source << "(" << shown->source_line << "): ";
+		message << shown->message;
+	}
+
+	size_t num_errors = CountShaderDiagnostics(diagnostics, DS_Error);
+	if (num_errors > 1) message << " (+" << num_errors - 1 << " more)";
+	tip.message = message.str();
+	return tip;
+}
@@ -0,0 +1,62 @@
+#ifndef _SHADER_DIAGNOSTICS_HPP_INCLUDED_
+#define _SHADER_DIAGNOSTICS_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+#include "shader_source_map.hpp"
+
+enum DiagnosticSeverity
+{
+	DS_Error,
+	DS_Warning,
+};
+
+// one error or warning reported by the compiler. line and column are
+// 1-based and zero when the compiler gave no location.
+struct ShaderDiagnostic
+{
+	DiagnosticSeverity severity;
+	std::string file;		// as reported, may be empty or "memory"
+	size_t line;
+	size_t column;
+	size_t end_column;		// fxc reports column ranges for some warnings
+	std::string code;		// e.g. "X3000", empty if there is none
+	std::string message;
+
+	// filled in by MapShaderDiagnostics.
+	std::string source;
+	size_t source_line;
+	bool is_mapped;
+
+	ShaderDiagnostic();
+	bool HasLocation() const;
+};
+
+typedef std::vector<ShaderDiagnostic> ShaderDiagnostics;
+
+// extracts every diagnostic from compiler output, one per line:
+//   file(line,column[-end_column]): error|warning [code]: message
+//   file:line[:column]: error|warning [code]: message
+//   error|warning [code]: message
+// lines of any other shape are skipped. returns the number appended.
+size_t ParseShaderDiagnostics(const std::string& text, ShaderDiagnostics& diagnostics);
+
+// translates compile input lines to source lines through the source map.
+void MapShaderDiagnostics(const ShaderSourceMap& source_map, ShaderDiagnostics& diagnostics);
+
+size_t CountShaderDiagnostics(const ShaderDiagnostics& diagnostics, DiagnosticSeverity severity);
+
+// what the error tip of the editor shows for a failed compile. the first
+// error inside the source named editor_source is pointed at by its 0-based
+// row and column, else the first error anywhere is named by its file and
+// line, with row and column -1. output fxc did not format is shown as is.
+struct ShaderErrorTip
+{
+	int row;
+	int column;
+	std::string message;
+};
+
+ShaderErrorTip MakeShaderErrorTip(const std::string& output, const ShaderSourceMap& source_map, const std::string& editor_source);
+
+#endif  // _SHADER_DIAGNOSTICS_HPP_INCLUDED_
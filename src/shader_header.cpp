@@ -1,52 +1,48 @@
 #include "common.hpp"
 #include "shader_header.hpp"
-
-#include <fstream>
-#include <vector>
-#include <algorithm>
+#include "shader_include_graph.hpp"
 
 namespace ShaderHeader
 {
-	static const tstring headers[] =
-	{
-		TEXT("snoise.hlsl"),
-		TEXT("qnoise.hlsl"),
-	};
+	// the root header, everything it includes is prepended to the shader.
+	static const char header_directory[] = "fx/";
+	static const char header_root[] = "header.hlsl";
 
-	static tstring g_shader_header;
-	static size_t g_num_lines;
+	static ShaderIncludeGraph g_include_graph(header_directory);
 
 	void InitShaderHeader()
 	{
-		for (int i = 0;  i != ARRAYSIZE(headers); ++i)
-		{
-			tstring file_path = TEXT("fx/") + headers[i];
-			std::ifstream ifs(file_path.c_str());
-			if (!ifs.is_open()) return;
-
-			ifs.seekg(0, std::ios::end);
-			int length = static_cast<int>(ifs.tellg());
-
-			std::vector<tchar> buffer(length + 1);
-			ifs.seekg(0, std::ios::beg);
-			ifs.read(&buffer[0], length);
-			ifs.close();
-
-			g_shader_header.append(&buffer[0]);
-		}
-
-		g_shader_header.append(1, '\n');
-		g_num_lines = std::count_if(g_shader_header.begin(), g_shader_header.end(),
-			[](tchar c){return c == '\n';});
+		g_include_graph.AddRoot(header_root);
+		g_include_graph.Refresh();
+	}
+
+	bool RefreshShaderHeader()
+	{
+		return g_include_graph.Refresh();
+	}
+
+	void InvalidateHeaderFile(const std::string& path)
+	{
+		g_include_graph.Invalidate(path);
+	}
+
+	void GetHeaderFiles(std::vector<std::string>& paths)
+	{
+		g_include_graph.GetFilePaths(paths);
+	}
+
+	const std::string& GetHeaderText()
+	{
+		return g_include_graph.GetText();
 	}
 
-	const tstring& GetHeaderText()
+	const ShaderSourceMap& GetSourceMap()
 	{
-		return g_shader_header;
+		return g_include_graph.GetSourceMap();
 	}
 
-	size_t GetHeaderLines()
+	const ContentHash& GetHeaderHash()
 	{
-		return g_num_lines;
+		return g_include_graph.GetHash();
 	}
 }
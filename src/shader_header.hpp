@@ -2,14 +2,30 @@
 #define _SHADER_HEADER_HPP_INCLUDED_
 
 #include "common.hpp"
+#include <vector>
+#include "content_hash.hpp"
+#include "shader_source_map.hpp"
 
 namespace ShaderHeader
 {
 	void InitShaderHeader();
 
-	const tstring& GetHeaderText();
+	// reloads the header files changed on disk, returns true if the header changed.
+	bool RefreshShaderHeader();
 
-	size_t GetHeaderLines();
+	// a watcher saw the file at path change, the next refresh reads it.
+	void InvalidateHeaderFile(const std::string& path);
+
+	// the header files to watch for changes.
+	void GetHeaderFiles(std::vector<std::string>& paths);
+
+	// already encoded the way the compiler reads it.
+	const std::string& GetHeaderText();
+
+	// where each header file sits in the header text.
+	const ShaderSourceMap& GetSourceMap();
+
+	const ContentHash& GetHeaderHash();
 }
 
 #endif  // _SHADER_HEADER_HPP_INCLUDED_
@@ -0,0 +1,433 @@
+#include "common.hpp"
+#include "shader_header_stripper.hpp"
+
+#include <cstring>
+
+template <typename CharType>
+static bool IsIdentifierBegin(CharType c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+template <typename CharType>
+static bool IsIdentifierChar(CharType c)
+{
+	return IsIdentifierBegin(c) || (c >= '0' && c <= '9');
+}
+
+// skips a comment or a string literal starting at pos, counting newlines.
+// returns false if there is none at pos.
+template <typename CharType>
+static bool SkipCommentOrString(const std::basic_string<CharType>& text, size_t& pos, size_t& line)
+{
+	CharType c = text[pos];
+	CharType next = pos + 1 < text.length() ? text[pos + 1] : 0;
+
+	if (c == '/' && next == '/')
+	{
+		while (pos < text.length() && text[pos] != '\n') ++pos;
+		return true;
+	}
+
+	if (c == '/' && next == '*')
+	{
+		for (pos += 2; pos < text.length(); ++pos)
+		{
+			if (text[pos] == '\n') ++line;
+			if (text[pos] == '*' && pos + 1 < text.length() && text[pos + 1] == '/') {pos += 2; break;}
+		}
+		return true;
+	}
+
+	if (c == '"')
+	{
+		for (++pos; pos < text.length() && text[pos] != '"' && text[pos] != '\n'; ++pos)
+		{
+			if (text[pos] == '\\') ++pos;
+		}
+		if (pos < text.length() && text[pos] == '"') ++pos;
+		return true;
+	}
+	return false;
+}
+
+// blanks every comment, newlines aside, so that no comment runs from one
+// line into the next: lines are kept or dropped a chunk at a time, and half
+// a comment would take the rest of the input with it, or close nothing.
+// lines and columns stay where they were.
+static void BlankComments(std::string& text)
+{
+	size_t line = 0;
+	size_t pos = 0;
+	while (pos < text.length())
+	{
+		bool is_comment = text[pos] == '/' && pos + 1 < text.length() && (text[pos + 1] == '/' || text[pos + 1] == '*');
+		size_t begin = pos;
+		if (!SkipCommentOrString(text, pos, line))
+		{
+			++pos;
+			continue;
+		}
+		if (!is_comment) continue;
+
+		for (size_t i = begin; i != pos; ++i)
+		{
+			if (text[i] != '\n') text[i] = ' ';
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderHeaderStripper::ShaderHeaderStripper()
+	: m_has_header(false)
+	, m_num_kept(0)
+	, m_source_map(new ShaderSourceMap())
+	, m_is_built(false)
+{
+
+}
+
+ShaderHeaderStripper::~ShaderHeaderStripper()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderHeaderStripper::SetHeader(const std::string& header, const ShaderSourceMap& source_map, const ContentHash& header_hash)
+{
+	if (m_has_header && header_hash == m_header_hash) return;
+
+	m_header = header;
+	BlankComments(m_header);
+	m_header_map = source_map;
+	m_header_hash = header_hash;
+	m_has_header = true;
+
+	SplitChunks();
+	m_is_built = false;
+}
+
+bool ShaderHeaderStripper::Strip(const std::wstring& document)
+{
+	std::vector<bool> kept(m_chunks.size(), false);
+	std::vector<size_t> pending;
+
+	for (size_t i = 0; i != m_chunks.size(); ++i)
+	{
+		if (m_chunks[i].always_keep) pending.push_back(i);
+	}
+
+	std::vector<std::string> identifiers;
+	CollectIdentifiers(document, identifiers);
+	for (size_t i = 0; i != identifiers.size(); ++i)
+	{
+		auto it = m_definitions.find(identifiers[i]);
+		if (it != m_definitions.end()) pending.insert(pending.end(), it->second.begin(), it->second.end());
+	}
+
+	// every reached chunk reaches whatever its own identifiers name. lines
+	// are kept whole, so it also reaches the chunks sharing a line with it,
+	// which would be cut in half otherwise.
+	while (!pending.empty())
+	{
+		size_t idx = pending.back();
+		pending.pop_back();
+		if (kept[idx]) continue;
+		kept[idx] = true;
+
+		const std::vector<std::string>& references = m_chunks[idx].references;
+		for (size_t i = 0; i != references.size(); ++i)
+		{
+			auto it = m_definitions.find(references[i]);
+			if (it != m_definitions.end()) pending.insert(pending.end(), it->second.begin(), it->second.end());
+		}
+
+		if (idx != 0 && m_chunks[idx - 1].last_line == m_chunks[idx].first_line) pending.push_back(idx - 1);
+		if (idx + 1 != m_chunks.size() && m_chunks[idx + 1].first_line == m_chunks[idx].last_line) pending.push_back(idx + 1);
+	}
+
+	if (m_is_built && kept == m_kept) return false;
+
+	m_kept.swap(kept);
+	Rebuild();
+	return true;
+}
+
+const std::string& ShaderHeaderStripper::GetText() const
+{
+	return m_text;
+}
+
+ShaderSourceMapPtr ShaderHeaderStripper::GetSourceMap() const
+{
+	return m_source_map;
+}
+
+const ContentHash& ShaderHeaderStripper::GetHash() const
+{
+	return m_hash;
+}
+
+size_t ShaderHeaderStripper::GetNumChunks() const
+{
+	return m_chunks.size();
+}
+
+size_t ShaderHeaderStripper::GetNumKeptChunks() const
+{
+	return m_num_kept;
+}
+
+template <typename CharType>
+void ShaderHeaderStripper::CollectIdentifiers(const std::basic_string<CharType>& text, std::vector<std::string>& identifiers)
+{
+	size_t line = 0;
+	size_t pos = 0;
+	while (pos < text.length())
+	{
+		if (SkipCommentOrString(text, pos, line)) continue;
+
+		if (IsIdentifierChar(text[pos]))
+		{
+			size_t begin = pos;
+			while (pos < text.length() && IsIdentifierChar(text[pos])) ++pos;
+
+			// numbers such as 1.0f or 0x1F are not identifiers.
+			if (IsIdentifierBegin(text[begin])) identifiers.push_back(std::string(text.begin() + begin, text.begin() + pos));
+			continue;
+		}
+		++pos;
+	}
+}
+
+template void ShaderHeaderStripper::CollectIdentifiers<char>(const std::string&, std::vector<std::string>&);
+template void ShaderHeaderStripper::CollectIdentifiers<wchar_t>(const std::wstring&, std::vector<std::string>&);
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderHeaderStripper::SplitChunks()
+{
+	m_chunks.clear();
+	m_definitions.clear();
+
+	m_line_offsets.assign(1, 0);
+	for (size_t i = 0; i != m_header.length(); ++i)
+	{
+		if (m_header[i] == '\n') m_line_offsets.push_back(i + 1);
+	}
+	if (m_line_offsets.back() != m_header.length()) m_line_offsets.push_back(m_header.length());
+
+	const std::string& text = m_header;
+	size_t pos = 0;
+	size_t line = 0;
+	bool at_line_start = true;
+
+	bool in_chunk = false;
+	Chunk chunk;
+	int depth = 0;
+	bool name_found = false;
+	bool function_like = false;
+	bool brace_found = false;
+	std::string last_identifier;
+
+	while (pos < text.length())
+	{
+		char c = text[pos];
+		if (c == '\n')
+		{
+			++line;
+			++pos;
+			at_line_start = true;
+			continue;
+		}
+		if (c == ' ' || c == '\t' || c == '\r') {++pos; continue;}
+		if (SkipCommentOrString(text, pos, line)) continue;
+
+		// a preprocessor directive is a chunk of its own, up to its unescaped newline.
+		if (c == '#' && at_line_start && !in_chunk)
+		{
+			size_t end = pos;
+			size_t end_line = line;
+			while (end < text.length() && text[end] != '\n')
+			{
+				if (text[end] == '\\' && end + 1 < text.length() && (text[end + 1] == '\n' || text[end + 1] == '\r'))
+				{
+					end = text.find('\n', end + 1);
+					if (end == std::string::npos) end = text.length();
+					else {++end; ++end_line;}
+					continue;
+				}
+				++end;
+			}
+
+			Chunk directive;
+			directive.first_line = line;
+			directive.last_line = end_line;
+			CollectIdentifiers(text.substr(pos + 1, end - pos - 1), directive.references);
+
+			// only #define names something, every other directive stays.
+			directive.always_keep = directive.references.size() < 2 || directive.references[0] != "define";
+			if (!directive.always_keep)
+			{
+				directive.names.push_back(directive.references[1]);
+				directive.references.erase(directive.references.begin(), directive.references.begin() + 2);
+			}
+			m_chunks.push_back(directive);
+
+			pos = end;
+			line = end_line;
+			continue;
+		}
+		at_line_start = false;
+
+		if (!in_chunk)
+		{
+			in_chunk = true;
+			chunk = Chunk();
+			chunk.first_line = line;
+			chunk.always_keep = false;
+			depth = 0;
+			name_found = false;
+			function_like = false;
+			brace_found = false;
+			last_identifier.clear();
+		}
+
+		bool chunk_ends = false;
+		if (IsIdentifierChar(c))
+		{
+			size_t begin = pos;
+			while (pos < text.length() && IsIdentifierChar(text[pos])) ++pos;
+			if (!IsIdentifierBegin(c)) continue;
+
+			std::string identifier = text.substr(begin, pos - begin);
+			if (identifier == "cbuffer" || identifier == "tbuffer") chunk.always_keep = true;
+			if (depth == 0) last_identifier = identifier;
+			chunk.references.push_back(identifier);
+			continue;
+		}
+
+		if (depth == 0 && !name_found && !last_identifier.empty() && strchr("([{=:;", c) != NULL)
+		{
+			// the identifier right before the first delimiter is the declared one.
+			chunk.names.push_back(last_identifier);
+			name_found = true;
+		}
+
+		switch (c)
+		{
+		case '(':
+			if (depth == 0 && !brace_found) function_like = true;
+			++depth;
+			break;
+		case '[':
+			++depth;
+			break;
+		case '{':
+			if (depth == 0) brace_found = true;
+			++depth;
+			break;
+		case ')':
+		case ']':
+			if (depth > 0) --depth;
+			break;
+		case '}':
+			if (depth > 0) --depth;
+			if (depth == 0 && function_like) chunk_ends = true;
+			break;
+		case ',':
+			// more declarators follow, each naming something.
+			if (depth == 0) name_found = false;
+			break;
+		case ';':
+			if (depth == 0) chunk_ends = true;
+			break;
+		}
+		++pos;
+
+		if (chunk_ends)
+		{
+			chunk.last_line = line;
+			m_chunks.push_back(chunk);
+			in_chunk = false;
+		}
+	}
+
+	if (in_chunk)
+	{
+		chunk.last_line = line;
+		m_chunks.push_back(chunk);
+	}
+
+	for (size_t i = 0; i != m_chunks.size(); ++i)
+	{
+		const std::vector<std::string>& names = m_chunks[i].names;
+		for (size_t j = 0; j != names.size(); ++j) m_definitions[names[j]].push_back(i);
+		if (names.empty()) m_chunks[i].always_keep = true;
+	}
+}
+
+void ShaderHeaderStripper::Rebuild()
+{
+	m_text.clear();
+	ShaderSourceMapPtr source_map(new ShaderSourceMap());
+
+	// a line is kept if any kept chunk covers it, and emitted once.
+	size_t num_lines = m_line_offsets.size() - 1;
+	std::vector<bool> kept_lines(num_lines, false);
+	m_num_kept = 0;
+	for (size_t i = 0; i != m_chunks.size(); ++i)
+	{
+		if (!m_kept[i]) continue;
+		++m_num_kept;
+		for (size_t l = m_chunks[i].first_line; l <= m_chunks[i].last_line && l < num_lines; ++l) kept_lines[l] = true;
+	}
+
+	// consecutive lines of one source are merged into one segment.
+	std::string run_source;
+	size_t run_line = 0;
+	size_t run_length = 0;
+	for (size_t l = 0; l != num_lines; ++l)
+	{
+		if (!kept_lines[l]) continue;
+		m_text.append(m_header, m_line_offsets[l], m_line_offsets[l + 1] - m_line_offsets[l]);
+
+		ShaderSourceMap::Location location;
+		if (!m_header_map.Resolve(l + 1, location))
+		{
+			location.source.clear();
+			location.line = l + 1;
+		}
+
+		if (run_length != 0 && location.source == run_source && location.line == run_line + run_length)
+		{
+			++run_length;
+			continue;
+		}
+
+		source_map->AddSegment(run_source, run_length, run_line);
+		run_source = location.source;
+		run_line = location.line;
+		run_length = 1;
+	}
+	source_map->AddSegment(run_source, run_length, run_line);
+
+	// a header lacking its final newline must not run into the document.
+	if (!m_text.empty() && m_text[m_text.length() - 1] != '\n') m_text.append(1, '\n');
+
+	ContentHasher hasher;
+	hasher.Update(&m_header_hash, sizeof(m_header_hash));
+	for (size_t i = 0; i != m_kept.size(); ++i)
+	{
+		if (m_kept[i]) hasher.UpdateValue(i);
+	}
+	m_hash = hasher.Finish();
+
+	m_source_map = source_map;
+	m_is_built = true;
+}
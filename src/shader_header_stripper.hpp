@@ -0,0 +1,72 @@
+#ifndef _SHADER_HEADER_STRIPPER_HPP_INCLUDED_
+#define _SHADER_HEADER_STRIPPER_HPP_INCLUDED_
+
+#include <map>
+#include <vector>
+#include "content_hash.hpp"
+#include "shader_source_map.hpp"
+
+// drops the header definitions a document can not reach. the header is
+// split into top level chunks (functions, macros, globals, ...) once per
+// header change; a strip then starts from the identifiers the document
+// uses and follows the identifiers each reached chunk uses in turn.
+// chunks it can not name are always kept, as are chunks sharing a line
+// with a kept one, and kept lines stay in their original order, so the
+// result compiles like the full header does. the comments of the header
+// are blanked, so none can span a dropped line.
+class ShaderHeaderStripper
+{
+public:
+	ShaderHeaderStripper();
+	virtual ~ShaderHeaderStripper();
+
+public:
+	// does nothing if header_hash did not change since the last call.
+	void SetHeader(const std::string& header, const ShaderSourceMap& source_map, const ContentHash& header_hash);
+
+	// returns true if the stripped header changed.
+	bool Strip(const std::wstring& document);
+
+	const std::string& GetText() const;
+	ShaderSourceMapPtr GetSourceMap() const;
+	const ContentHash& GetHash() const;
+
+	size_t GetNumChunks() const;
+	size_t GetNumKeptChunks() const;
+
+	// the identifiers outside comments and strings, in order of appearance.
+	template <typename CharType>
+	static void CollectIdentifiers(const std::basic_string<CharType>& text, std::vector<std::string>& identifiers);
+
+private:
+	struct Chunk
+	{
+		size_t first_line;		// 0-based lines of the header
+		size_t last_line;
+		std::vector<std::string> names;
+		std::vector<std::string> references;
+		bool always_keep;
+	};
+
+	void SplitChunks();
+	void Rebuild();
+
+private:
+	std::string m_header;
+	ShaderSourceMap m_header_map;
+	ContentHash m_header_hash;
+	bool m_has_header;
+
+	std::vector<Chunk> m_chunks;
+	std::vector<size_t> m_line_offsets;
+	std::map<std::string, std::vector<size_t> > m_definitions;
+
+	std::vector<bool> m_kept;
+	size_t m_num_kept;
+	std::string m_text;
+	ShaderSourceMapPtr m_source_map;
+	ContentHash m_hash;
+	bool m_is_built;
+};
+
+#endif  // _SHADER_HEADER_STRIPPER_HPP_INCLUDED_
@@ -0,0 +1,450 @@
+#include "common.hpp"
+#include "shader_include_graph.hpp"
+
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+
+// file systems stamp to the second or two at worst, a file read within
+// that of its stamp may still change without the stamp moving.
+static const long long racy_seconds = 2;
+
+static bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static bool IsIdentifierChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// copies the line from begin to end with its comments blanked. in_comment
+// carries a block comment over from one line to the next.
+static void BlankComments(const std::string& text, size_t begin, size_t end, bool& in_comment, std::string& line)
+{
+	line.assign(text, begin, end - begin);
+
+	size_t pos = 0;
+	while (pos < line.length())
+	{
+		if (in_comment)
+		{
+			size_t close = line.find("*/", pos);
+			size_t blank_end = close == std::string::npos ? line.length() : close + 2;
+			for (; pos != blank_end; ++pos)
+			{
+				if (line[pos] != '\n') line[pos] = ' ';
+			}
+			in_comment = close == std::string::npos;
+		}
+		else if (line[pos] == '"')
+		{
+			size_t close = line.find('"', pos + 1);
+			pos = close == std::string::npos ? line.length() : close + 1;
+		}
+		else if (line.compare(pos, 2, "//") == 0)
+		{
+			for (; pos != line.length(); ++pos)
+			{
+				if (line[pos] != '\n') line[pos] = ' ';
+			}
+		}
+		else if (line.compare(pos, 2, "/*") == 0)
+		{
+			line[pos++] = ' ';
+			line[pos++] = ' ';
+			in_comment = true;
+		}
+		else ++pos;
+	}
+}
+
+// matches #directive at the start of a line, and returns where its
+// arguments start.
+static bool MatchDirective(const std::string& line, const char* directive, size_t& args)
+{
+	size_t pos = 0;
+	while (pos < line.length() && IsBlank(line[pos])) ++pos;
+	if (pos >= line.length() || line[pos] != '#') return false;
+
+	++pos;
+	while (pos < line.length() && IsBlank(line[pos])) ++pos;
+	size_t length = strlen(directive);
+	if (line.compare(pos, length, directive) != 0) return false;
+
+	pos += length;
+	if (pos < line.length() && IsIdentifierChar(line[pos])) return false;
+
+	while (pos < line.length() && IsBlank(line[pos])) ++pos;
+	args = pos;
+	return true;
+}
+
+// matches #include "name" or #include <name>.
+static bool MatchInclude(const std::string& line, std::string& name)
+{
+	size_t pos = 0;
+	if (!MatchDirective(line, "include", pos)) return false;
+	if (pos >= line.length() || (line[pos] != '"' && line[pos] != '<')) return false;
+
+	char close = line[pos] == '"' ? '"' : '>';
+	size_t name_end = line.find(close, pos + 1);
+	if (name_end == std::string::npos) return false;
+
+	name = line.substr(pos + 1, name_end - pos - 1);
+	return !name.empty();
+}
+
+// matches #if 0, which nothing defined can turn on.
+static bool MatchIfZero(const std::string& line)
+{
+	size_t pos = 0;
+	if (!MatchDirective(line, "if", pos)) return false;
+	if (pos >= line.length() || line[pos] != '0') return false;
+
+	for (++pos; pos < line.length(); ++pos)
+	{
+		if (!IsBlank(line[pos]) && line[pos] != '\r' && line[pos] != '\n') return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderIncludeGraph::ShaderIncludeGraph(const std::string& directory /*= ""*/)
+	: m_directory(directory)
+	, m_is_built(false)
+	, m_num_loads(0)
+{
+	if (!m_directory.empty() && m_directory[m_directory.length() - 1] != '/') m_directory.append(1, '/');
+}
+
+ShaderIncludeGraph::~ShaderIncludeGraph()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderIncludeGraph::AddRoot(const std::string& name)
+{
+	m_roots.push_back(name);
+	m_is_built = false;
+}
+
+void ShaderIncludeGraph::Invalidate(const std::string& path)
+{
+	std::string name = path.compare(0, m_directory.length(), m_directory) == 0 ? path.substr(m_directory.length()) : path;
+	auto it = m_files.find(name);
+	if (it != m_files.end()) it->second.is_invalid = true;
+}
+
+bool ShaderIncludeGraph::Refresh()
+{
+	bool content_changed = !m_is_built;
+
+	// only files whose time stamp or size moved are read again, unless the
+	// stamp can not be trusted. the hash then tells if the content moved.
+	for (auto it = m_files.begin(); it != m_files.end(); ++it)
+	{
+		File& file = it->second;
+
+		long long time_stamp = 0, size = 0;
+		bool exists = StatFile(it->first, time_stamp, size);
+		bool is_racy = exists && file.read_time - time_stamp / 1000000000 <= racy_seconds;
+		if (!file.is_invalid && !is_racy && exists == file.exists && time_stamp == file.time_stamp && size == file.size) continue;
+
+		ContentHash old_hash = file.hash;
+		bool old_exists = file.exists;
+		LoadFile(it->first, file);
+		if (file.exists != old_exists || file.hash != old_hash) content_changed = true;
+	}
+
+	for (size_t i = 0; i != m_roots.size(); ++i)
+	{
+		if (m_files.find(m_roots[i]) != m_files.end()) continue;
+		LoadFile(m_roots[i], m_files[m_roots[i]]);
+		content_changed = true;
+	}
+
+	if (!content_changed) return false;
+
+	// a changed file may include new ones.
+	while (LoadMissingIncludes()) {}
+
+	ContentHash old_hash = m_hash;
+	bool was_built = m_is_built;
+	Rebuild();
+	return !was_built || m_hash != old_hash;
+}
+
+const std::string& ShaderIncludeGraph::GetText() const
+{
+	return m_text;
+}
+
+const ShaderSourceMap& ShaderIncludeGraph::GetSourceMap() const
+{
+	return m_source_map;
+}
+
+const ContentHash& ShaderIncludeGraph::GetHash() const
+{
+	return m_hash;
+}
+
+size_t ShaderIncludeGraph::GetNumFiles() const
+{
+	return m_files.size();
+}
+
+void ShaderIncludeGraph::GetFilePaths(std::vector<std::string>& paths) const
+{
+	paths.clear();
+	for (auto it = m_files.begin(); it != m_files.end(); ++it)
+	{
+		paths.push_back(m_directory + it->first);
+	}
+}
+
+bool ShaderIncludeGraph::GetFileHash(const std::string& name, ContentHash& hash) const
+{
+	auto it = m_files.find(name);
+	if (it == m_files.end() || !it->second.exists) return false;
+
+	hash = it->second.hash;
+	return true;
+}
+
+void ShaderIncludeGraph::GetIncludes(const std::string& name, std::vector<std::string>& includes) const
+{
+	includes.clear();
+
+	auto it = m_files.find(name);
+	if (it == m_files.end()) return;
+
+	for (size_t i = 0; i != it->second.includes.size(); ++i)
+	{
+		includes.push_back(it->second.includes[i].name);
+	}
+}
+
+void ShaderIncludeGraph::GetDependents(const std::string& name, std::vector<std::string>& dependents) const
+{
+	dependents.clear();
+
+	// walk the include edges backwards, breadth first.
+	std::set<std::string> visited;
+	std::vector<std::string> pending(1, name);
+	while (!pending.empty())
+	{
+		std::string current = pending.back();
+		pending.pop_back();
+
+		for (auto it = m_files.begin(); it != m_files.end(); ++it)
+		{
+			const std::vector<Include>& includes = it->second.includes;
+			for (size_t i = 0; i != includes.size(); ++i)
+			{
+				if (includes[i].name != current || !visited.insert(it->first).second) continue;
+				dependents.push_back(it->first);
+				pending.push_back(it->first);
+			}
+		}
+	}
+}
+
+size_t ShaderIncludeGraph::GetNumLoads() const
+{
+	return m_num_loads;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+bool ShaderIncludeGraph::LoadFile(const std::string& name, File& file)
+{
+	++m_num_loads;
+
+	file.content.clear();
+	file.includes.clear();
+	file.hash = ContentHash();
+	file.read_time = static_cast<long long>(time(NULL));
+	file.is_invalid = false;
+	file.exists = StatFile(name, file.time_stamp, file.size);
+	if (!file.exists) return false;
+
+	std::ifstream ifs((m_directory + name).c_str(), std::ios::binary);
+	if (!ifs.is_open())
+	{
+		file.exists = false;
+		return false;
+	}
+
+	file.content.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+
+	// terminate the last line, so whatever follows starts on a line of its own.
+	if (!file.content.empty() && file.content[file.content.length() - 1] != '\n') file.content.append(1, '\n');
+
+	ContentHasher hasher;
+	hasher.Update(file.content);
+	file.hash = hasher.Finish();
+
+	ParseIncludes(file);
+	return true;
+}
+
+bool ShaderIncludeGraph::StatFile(const std::string& name, long long& time_stamp, long long& size) const
+{
+	time_stamp = 0;
+	size = 0;
+
+	struct stat info;
+	if (stat((m_directory + name).c_str(), &info) != 0) return false;
+
+#if defined(_WIN32)
+	time_stamp = static_cast<long long>(info.st_mtime) * 1000000000;
+#elif defined(__APPLE__)
+	time_stamp = static_cast<long long>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	time_stamp = static_cast<long long>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+	size = static_cast<long long>(info.st_size);
+	return true;
+}
+
+void ShaderIncludeGraph::ParseIncludes(File& file)
+{
+	const std::string& text = file.content;
+
+	// includes in comments or in #if 0 sections are not followed. other
+	// conditions are not evaluated, their includes are all followed.
+	bool in_comment = false;
+	size_t skip_depth = 0;
+	std::string blanked;
+
+	size_t line = 0;
+	size_t begin = 0;
+	while (begin < text.length())
+	{
+		size_t end = text.find('\n', begin);
+		end = end == std::string::npos ? text.length() : end + 1;
+		BlankComments(text, begin, end, in_comment, blanked);
+
+		size_t args = 0;
+		Include include;
+		if (skip_depth != 0)
+		{
+			if (MatchDirective(blanked, "if", args) || MatchDirective(blanked, "ifdef", args) || MatchDirective(blanked, "ifndef", args))
+			{
+				++skip_depth;
+			}
+			else if (MatchDirective(blanked, "endif", args) ||
+				(skip_depth == 1 && (MatchDirective(blanked, "else", args) || MatchDirective(blanked, "elif", args))))
+			{
+				--skip_depth;
+			}
+		}
+		else if (MatchIfZero(blanked))
+		{
+			skip_depth = 1;
+		}
+		else if (MatchInclude(blanked, include.name))
+		{
+			include.line = line;
+			include.begin = begin;
+			include.end = end;
+			file.includes.push_back(include);
+		}
+
+		begin = end;
+		++line;
+	}
+}
+
+bool ShaderIncludeGraph::LoadMissingIncludes()
+{
+	std::vector<std::string> missing;
+	for (auto it = m_files.begin(); it != m_files.end(); ++it)
+	{
+		const std::vector<Include>& includes = it->second.includes;
+		for (size_t i = 0; i != includes.size(); ++i)
+		{
+			if (m_files.find(includes[i].name) == m_files.end()) missing.push_back(includes[i].name);
+		}
+	}
+
+	for (size_t i = 0; i != missing.size(); ++i)
+	{
+		if (m_files.find(missing[i]) != m_files.end()) continue;
+		LoadFile(missing[i], m_files[missing[i]]);
+	}
+	return !missing.empty();
+}
+
+void ShaderIncludeGraph::Rebuild()
+{
+	m_text.clear();
+	m_source_map.Clear();
+
+	std::set<std::string> emitted;
+	for (size_t i = 0; i != m_roots.size(); ++i)
+	{
+		Emit(m_roots[i], emitted);
+	}
+
+	// files nobody includes any more are forgotten, they need no watching.
+	for (auto it = m_files.begin(); it != m_files.end();)
+	{
+		if (emitted.find(it->first) == emitted.end()) m_files.erase(it++);
+		else ++it;
+	}
+
+	ContentHasher hasher;
+	hasher.Update(m_text);
+	m_hash = hasher.Finish();
+	m_is_built = true;
+}
+
+void ShaderIncludeGraph::Emit(const std::string& name, std::set<std::string>& emitted)
+{
+	// every file is expanded once, which also breaks include cycles.
+	if (!emitted.insert(name).second) return;
+
+	auto it = m_files.find(name);
+	if (it == m_files.end() || !it->second.exists) return;
+	const File& file = it->second;
+
+	size_t copied = 0;
+	size_t copied_line = 0;
+	for (size_t i = 0; i <= file.includes.size(); ++i)
+	{
+		bool at_end = i == file.includes.size();
+		size_t end = at_end ? file.content.length() : file.includes[i].begin;
+		size_t end_line = at_end ? ShaderSourceMap::CountLines(file.content) : file.includes[i].line;
+
+		m_text.append(file.content, copied, end - copied);
+		m_source_map.AddSegment(name, end_line - copied_line, copied_line + 1);
+		if (at_end) break;
+
+		// a missing include keeps its directive, so the compiler reports it in place.
+		const Include& include = file.includes[i];
+		auto included = m_files.find(include.name);
+		if (included == m_files.end() || !included->second.exists)
+		{
+			emitted.insert(include.name);
+			copied = include.begin;
+			copied_line = include.line;
+			continue;
+		}
+
+		Emit(include.name, emitted);
+		copied = include.end;
+		copied_line = include.line + 1;
+	}
+}
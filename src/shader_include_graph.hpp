@@ -0,0 +1,93 @@
+#ifndef _SHADER_INCLUDE_GRAPH_HPP_INCLUDED_
+#define _SHADER_INCLUDE_GRAPH_HPP_INCLUDED_
+
+#include <map>
+#include <set>
+#include <vector>
+#include "content_hash.hpp"
+#include "shader_source_map.hpp"
+
+// the shader header files and the #include "name" edges between them,
+// leaving out those in comments and in #if 0 sections.
+// the roots are expanded into one text, every file at its first include
+// only, with a source map telling which file each line came from.
+// Refresh only reloads files whose time stamp or size changed, those a
+// watcher reported through Invalidate, and those stamped so close to when
+// they were read that an edit in the same tick could hide behind an equal
+// stamp and size. it only rebuilds the text when some content changed.
+class ShaderIncludeGraph
+{
+public:
+	// file names are relative to directory, which includes resolve against too.
+	explicit ShaderIncludeGraph(const std::string& directory = "");
+	virtual ~ShaderIncludeGraph();
+
+public:
+	void AddRoot(const std::string& name);
+
+	// the file at path, as GetFilePaths gives it, is read again by the next
+	// Refresh whatever its time stamp says.
+	void Invalidate(const std::string& path);
+
+	// returns true if the expanded text changed.
+	bool Refresh();
+
+	const std::string& GetText() const;
+	const ShaderSourceMap& GetSourceMap() const;
+	const ContentHash& GetHash() const;
+
+	size_t GetNumFiles() const;
+
+	// the paths of every file in the graph, missing ones included.
+	void GetFilePaths(std::vector<std::string>& paths) const;
+	bool GetFileHash(const std::string& name, ContentHash& hash) const;
+	void GetIncludes(const std::string& name, std::vector<std::string>& includes) const;
+
+	// every file which includes name, directly or not.
+	void GetDependents(const std::string& name, std::vector<std::string>& dependents) const;
+
+	// how many times a file was read, so re-work can be observed.
+	size_t GetNumLoads() const;
+
+private:
+	struct Include
+	{
+		std::string name;
+		size_t line;		// 0-based line of the directive
+		size_t begin;		// the directive line, newline included
+		size_t end;
+	};
+
+	struct File
+	{
+		std::string content;
+		ContentHash hash;
+		long long time_stamp;	// in nanoseconds
+		long long size;
+		long long read_time;	// in seconds, like time()
+		bool exists;
+		bool is_invalid;
+		std::vector<Include> includes;
+	};
+
+	bool LoadFile(const std::string& name, File& file);
+	bool StatFile(const std::string& name, long long& time_stamp, long long& size) const;
+	static void ParseIncludes(File& file);
+
+	bool LoadMissingIncludes();
+	void Rebuild();
+	void Emit(const std::string& name, std::set<std::string>& emitted);
+
+private:
+	std::string m_directory;
+	std::vector<std::string> m_roots;
+	std::map<std::string, File> m_files;
+
+	std::string m_text;
+	ShaderSourceMap m_source_map;
+	ContentHash m_hash;
+	bool m_is_built;
+	size_t m_num_loads;
+};
+
+#endif  // _SHADER_INCLUDE_GRAPH_HPP_INCLUDED_
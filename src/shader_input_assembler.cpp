@@ -0,0 +1,136 @@
+#include "common.hpp"
+#include "shader_input_assembler.hpp"
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderInputAssembler::ShaderInputAssembler(size_t max_pooled_buffers /*= 4*/)
+	: m_has_header(false)
+	, m_header_version(0)
+	, m_free_list(new FreeList)
+{
+	m_free_list->max_buffers = max_pooled_buffers;
+}
+
+ShaderInputAssembler::ShaderInputAssembler(const ShaderInputAssembler& rhs)
+	: m_header(rhs.m_header)
+	, m_header_hash(rhs.m_header_hash)
+	, m_has_header(rhs.m_has_header)
+	, m_header_version(rhs.m_header_version)
+	, m_free_list(new FreeList)
+{
+	m_free_list->max_buffers = rhs.m_free_list->max_buffers;
+}
+
+ShaderInputAssembler& ShaderInputAssembler::operator = (const ShaderInputAssembler& rhs)
+{
+	// the buffers of this one stay, they hold a header of this one.
+	m_header = rhs.m_header;
+	m_header_hash = rhs.m_header_hash;
+	m_has_header = rhs.m_has_header;
+	++m_header_version;
+	return *this;
+}
+
+ShaderInputAssembler::~ShaderInputAssembler()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderInputAssembler::SetHeader(const std::string& header, const ContentHash& header_hash)
+{
+	if (m_has_header && header_hash == m_header_hash) return;
+
+	m_header = header;
+	m_header_hash = header_hash;
+	m_has_header = true;
+	++m_header_version;
+}
+
+const std::string& ShaderInputAssembler::GetHeader() const
+{
+	return m_header;
+}
+
+ShaderCompileInput ShaderInputAssembler::Assemble(const std::wstring& document, const std::string& entry_point,
+	const std::string& profile, unsigned int flags)
+{
+	PooledBuffer* buffer = AcquireBuffer();
+	boost::shared_ptr<PooledBuffer> owner(buffer, ReleaseBuffer(m_free_list));
+	std::string& text = buffer->text;
+
+	// the header is only written into a buffer which does not hold it yet.
+	if (buffer->header_version != m_header_version)
+	{
+		text.reserve(m_header.length() + document.length());
+		text.assign(m_header);
+		buffer->header_version = m_header_version;
+	}
+	text.resize(m_header.length());
+	EncodeDocument(document, text);
+
+	return ShaderCompileInput(ShaderSourcePtr(owner, &buffer->text), entry_point, profile, flags);
+}
+
+void ShaderInputAssembler::EncodeDocument(const std::wstring& document, std::string& encoded)
+{
+	size_t offset = encoded.length();
+	encoded.resize(offset + document.length());
+
+	char* dest = &encoded[0] + offset;
+	const wchar_t* src = document.c_str();
+	for (size_t i = 0; i != document.length(); ++i)
+	{
+		wchar_t c = src[i];
+		dest[i] = c < 0x100 ? static_cast<char>(c) : '?';
+	}
+}
+
+size_t ShaderInputAssembler::GetNumPooledBuffers() const
+{
+	boost::mutex::scoped_lock lock(m_free_list->mutex);
+	return m_free_list->buffers.size();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+ShaderInputAssembler::PooledBuffer* ShaderInputAssembler::AcquireBuffer()
+{
+	{
+		boost::mutex::scoped_lock lock(m_free_list->mutex);
+		if (!m_free_list->buffers.empty())
+		{
+			PooledBuffer* buffer = m_free_list->buffers.back();
+			m_free_list->buffers.pop_back();
+			return buffer;
+		}
+	}
+
+	PooledBuffer* buffer = new PooledBuffer;
+	buffer->header_version = 0;
+	return buffer;
+}
+
+void ShaderInputAssembler::ReleaseBuffer::operator () (PooledBuffer* buffer) const
+{
+	{
+		boost::mutex::scoped_lock lock(free_list->mutex);
+		if (free_list->buffers.size() < free_list->max_buffers)
+		{
+			free_list->buffers.push_back(buffer);
+			return;
+		}
+	}
+
+	// enough buffers are waiting already.
+	delete buffer;
+}
+
+ShaderInputAssembler::FreeList::~FreeList()
+{
+	for (size_t i = 0; i != buffers.size(); ++i) delete buffers[i];
+}
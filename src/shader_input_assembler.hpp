@@ -0,0 +1,76 @@
+#ifndef _SHADER_INPUT_ASSEMBLER_HPP_INCLUDED_
+#define _SHADER_INPUT_ASSEMBLER_HPP_INCLUDED_
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "content_hash.hpp"
+#include "shader_compiler.hpp"
+
+// builds compile inputs of the form header + document. the header is
+// encoded once when it changes; each assemble only encodes the document,
+// straight behind the header kept in a pooled buffer. a buffer goes back
+// to the pool when the last compile input referring to it is released, on
+// whichever thread that happens. a copy starts with a pool of its own.
+class ShaderInputAssembler
+{
+public:
+	explicit ShaderInputAssembler(size_t max_pooled_buffers = 4);
+	ShaderInputAssembler(const ShaderInputAssembler& rhs);
+	ShaderInputAssembler& operator = (const ShaderInputAssembler& rhs);
+	virtual ~ShaderInputAssembler();
+
+public:
+	// does nothing if header_hash did not change since the last call.
+	void SetHeader(const std::string& header, const ContentHash& header_hash);
+	const std::string& GetHeader() const;
+
+	ShaderCompileInput Assemble(const std::wstring& document, const std::string& entry_point,
+		const std::string& profile, unsigned int flags);
+
+	// one byte per character, as the editor counts columns. characters
+	// beyond latin-1 never appear outside comments and become '?'.
+	static void EncodeDocument(const std::wstring& document, std::string& encoded);
+
+	// the buffers waiting for reuse.
+	size_t GetNumPooledBuffers() const;
+
+private:
+	struct PooledBuffer
+	{
+		std::string text;
+		size_t header_version;
+	};
+
+	// shared with the buffers handed out, which may outlive the assembler.
+	struct FreeList
+	{
+		boost::mutex mutex;
+		std::vector<PooledBuffer*> buffers;
+		size_t max_buffers;
+
+		~FreeList();
+	};
+	typedef boost::shared_ptr<FreeList> FreeListPtr;
+
+	// the deleter of a buffer handed out.
+	struct ReleaseBuffer
+	{
+		FreeListPtr free_list;
+
+		explicit ReleaseBuffer(FreeListPtr free_list) : free_list(free_list) {}
+		void operator () (PooledBuffer* buffer) const;
+	};
+
+	PooledBuffer* AcquireBuffer();
+
+private:
+	std::string m_header;
+	ContentHash m_header_hash;
+	bool m_has_header;
+	size_t m_header_version;
+
+	FreeListPtr m_free_list;
+};
+
+#endif  // _SHADER_INPUT_ASSEMBLER_HPP_INCLUDED_
@@ -0,0 +1,673 @@
+#include "common.hpp"
+#include "shader_linter.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+// how many arguments each intrinsic takes, at least and at most.
+static const struct
+{
+	const wchar_t* name;
+	size_t min_args;
+	size_t max_args;
+} intrinsic_args[] =
+{
+	{L"abs", 1, 1}, {L"acos", 1, 1}, {L"all", 1, 1}, {L"AllMemoryBarrier", 0, 0},
+	{L"AllMemoryBarrierWithGroupSync", 0, 0}, {L"any", 1, 1}, {L"asdouble", 2, 2}, {L"asfloat", 1, 1},
+	{L"asin", 1, 1}, {L"asint", 1, 1}, {L"asuint", 1, 3}, {L"atan", 1, 1},
+	{L"atan2", 2, 2}, {L"ceil", 1, 1}, {L"clamp", 3, 3}, {L"clip", 1, 1},
+	{L"cos", 1, 1}, {L"cosh", 1, 1}, {L"countbits", 1, 1}, {L"cross", 2, 2},
+	{L"D3DCOLORtoUBYTE4", 1, 1}, {L"ddx", 1, 1}, {L"ddx_coarse", 1, 1}, {L"ddx_fine", 1, 1},
+	{L"ddy", 1, 1}, {L"ddy_coarse", 1, 1}, {L"ddy_fine", 1, 1}, {L"degrees", 1, 1},
+	{L"determinant", 1, 1}, {L"DeviceMemoryBarrier", 0, 0}, {L"DeviceMemoryBarrierWithGroupSync", 0, 0}, {L"distance", 2, 2},
+	{L"dot", 2, 2}, {L"dst", 2, 2}, {L"EvaluateAttributeAtCentroid", 1, 1}, {L"EvaluateAttributeAtSample", 2, 2},
+	{L"EvaluateAttributeSnapped", 2, 2}, {L"exp", 1, 1}, {L"exp2", 1, 1}, {L"f16tof32", 1, 1},
+	{L"f32tof16", 1, 1}, {L"faceforward", 3, 3}, {L"firstbithigh", 1, 1}, {L"firstbitlow", 1, 1},
+	{L"floor", 1, 1}, {L"fmod", 2, 2}, {L"frac", 1, 1}, {L"frexp", 2, 2},
+	{L"fwidth", 1, 1}, {L"GetRenderTargetSampleCount", 0, 0}, {L"GetRenderTargetSamplePosition", 1, 1}, {L"GroupMemoryBarrier", 0, 0},
+	{L"GroupMemoryBarrierWithGroupSync", 0, 0}, {L"InterlockedAdd", 2, 3}, {L"InterlockedAnd", 2, 3}, {L"InterlockedCompareExchange", 4, 4},
+	{L"InterlockedCompareStore", 3, 3}, {L"InterlockedExchange", 3, 3}, {L"InterlockedMax", 2, 3}, {L"InterlockedMin", 2, 3},
+	{L"InterlockedOr", 2, 3}, {L"InterlockedXor", 2, 3}, {L"isfinite", 1, 1}, {L"isinf", 1, 1},
+	{L"isnan", 1, 1}, {L"ldexp", 2, 2}, {L"length", 1, 1}, {L"lerp", 3, 3},
+	{L"lit", 3, 3}, {L"log", 1, 1}, {L"log10", 1, 1}, {L"log2", 1, 1},
+	{L"mad", 3, 3}, {L"max", 2, 2}, {L"min", 2, 2}, {L"modf", 2, 2},
+	{L"mul", 2, 2}, {L"noise", 1, 1}, {L"normalize", 1, 1}, {L"pow", 2, 2},
+	{L"radians", 1, 1}, {L"rcp", 1, 1}, {L"reflect", 2, 2}, {L"refract", 3, 3},
+	{L"reversebits", 1, 1}, {L"round", 1, 1}, {L"rsqrt", 1, 1}, {L"saturate", 1, 1},
+	{L"sign", 1, 1}, {L"sin", 1, 1}, {L"sincos", 3, 3}, {L"sinh", 1, 1},
+	{L"smoothstep", 3, 3}, {L"sqrt", 1, 1}, {L"step", 2, 2}, {L"tan", 1, 1},
+	{L"tanh", 1, 1}, {L"transpose", 1, 1}, {L"trunc", 1, 1},
+	{L"tex1D", 2, 4}, {L"tex1Dbias", 2, 2}, {L"tex1Dgrad", 4, 4}, {L"tex1Dlod", 2, 2}, {L"tex1Dproj", 2, 2},
+	{L"tex2D", 2, 4}, {L"tex2Dbias", 2, 2}, {L"tex2Dgrad", 4, 4}, {L"tex2Dlod", 2, 2}, {L"tex2Dproj", 2, 2},
+	{L"tex3D", 2, 4}, {L"tex3Dbias", 2, 2}, {L"tex3Dgrad", 4, 4}, {L"tex3Dlod", 2, 2}, {L"tex3Dproj", 2, 2},
+	{L"texCUBE", 2, 4}, {L"texCUBEbias", 2, 2}, {L"texCUBEgrad", 4, 4}, {L"texCUBElod", 2, 2}, {L"texCUBEproj", 2, 2},
+};
+
+// keywords which can not start a declaration: statements and qualifiers.
+static const wchar_t* plain_keywords[] =
+{
+	L"break", L"case", L"cbuffer", L"centroid", L"class", L"column_major", L"compile", L"const",
+	L"continue", L"default", L"define", L"discard", L"do", L"else", L"endif", L"extern",
+	L"false", L"for", L"groupshared", L"if", L"ifdef", L"ifndef", L"in", L"inline",
+	L"inout", L"interface", L"linear", L"namespace", L"nointerpolation", L"noperspective", L"out", L"pass",
+	L"precise", L"register", L"return", L"row_major", L"shared", L"static", L"struct", L"switch",
+	L"tbuffer", L"technique", L"technique10", L"true", L"typedef", L"uniform", L"volatile", L"while",
+};
+
+// attributes are written in brackets before a statement, [unroll] etc.
+static const wchar_t* attributes[] =
+{
+	L"allow_uav_condition", L"branch", L"call", L"earlydepthstencil", L"fastopt",
+	L"flatten", L"forcecase", L"loop", L"maxvertexcount", L"numthreads", L"unroll",
+};
+
+// keywords which introduce a type name.
+static const wchar_t* type_introducers[] =
+{
+	L"cbuffer", L"class", L"interface", L"namespace", L"struct", L"tbuffer",
+};
+
+static const size_t no_args = static_cast<size_t>(-1);
+
+static bool IsOneOf(const std::wstring& word, const wchar_t* const* words, size_t num_words)
+{
+	for (size_t i = 0; i != num_words; ++i)
+	{
+		if (word == words[i]) return true;
+	}
+	return false;
+}
+
+static bool IsOpenBracket(const std::wstring& word)
+{
+	return word == L"(" || word == L"[" || word == L"{";
+}
+
+static bool IsCloseBracket(const std::wstring& word)
+{
+	return word == L")" || word == L"]" || word == L"}";
+}
+
+static wchar_t MatchingBracket(wchar_t c)
+{
+	switch (c)
+	{
+	case '(': return ')';
+	case '[': return ']';
+	case '{': return '}';
+	case ')': return '(';
+	case ']': return '[';
+	case '}': return '{';
+	}
+	return 0;
+}
+
+static std::string Narrow(const std::wstring& word)
+{
+	std::string str(word.length(), '?');
+	for (size_t i = 0; i != word.length(); ++i)
+	{
+		if (word[i] < 0x80) str[i] = static_cast<char>(word[i]);
+	}
+	return str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderLinter::ShaderLinter(const std::wstring& entry_point)
+	: m_entry_point(entry_point)
+	, m_has_header(false)
+	, m_symbols_version(1)
+	, m_num_analyzed(0)
+	, m_num_checked(0)
+{
+	m_plain_keywords.insert(plain_keywords, plain_keywords + ARRAYSIZE(plain_keywords));
+
+	for (size_t i = 0; i != ARRAYSIZE(intrinsic_args); ++i)
+	{
+		m_intrinsic_args[intrinsic_args[i].name] = std::make_pair(intrinsic_args[i].min_args, intrinsic_args[i].max_args);
+	}
+}
+
+ShaderLinter::~ShaderLinter()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderLinter::SetHeader(const std::string& header, const ContentHash& header_hash)
+{
+	if (m_has_header && header_hash == m_header_hash) return;
+	m_header_hash = header_hash;
+	m_has_header = true;
+
+	std::wstring text(header.length(), L' ');
+	for (size_t i = 0; i != header.length(); ++i) text[i] = static_cast<unsigned char>(header[i]);
+
+	ShaderTokenizer tokenizer;
+	tokenizer.Tokenize(text);
+	ShaderParser parser;
+	parser.Parse(text, tokenizer.GetTokens());
+
+	const std::vector<Item>& items = parser.GetItems();
+	std::vector<ChunkSpan> spans;
+	SplitChunks(parser, spans);
+
+	// the header is not checked, only its declarations matter.
+	m_header_globals.clear();
+	m_header_functions.clear();
+	for (size_t i = 0; i != spans.size(); ++i)
+	{
+		Chunk chunk;
+		AnalyzeChunk(&items[spans[i].first_item], spans[i].num_items, chunk);
+		m_header_globals.insert(chunk.globals.begin(), chunk.globals.end());
+		for (size_t j = 0; j != chunk.functions.size(); ++j)
+		{
+			m_header_functions.insert(std::make_pair(chunk.functions[j].name, chunk.functions[j]));
+		}
+	}
+}
+
+void ShaderLinter::Lint(const ShaderParser& parser)
+{
+	m_num_analyzed = 0;
+	m_num_checked = 0;
+
+	const std::vector<Item>& items = parser.GetItems();
+	SplitChunks(parser, m_spans);
+
+	// chunks of the last lint are taken over, the others are forgotten.
+	ChunkCache chunks;
+	for (size_t i = 0; i != m_spans.size(); ++i)
+	{
+		ChunkSpan& span = m_spans[i];
+		ChunkPtr& chunk = chunks[span.hash];
+		if (!chunk)
+		{
+			auto it = m_chunks.find(span.hash);
+			if (it != m_chunks.end())
+			{
+				chunk = it->second;
+			}
+			else
+			{
+				chunk.reset(new Chunk);
+				AnalyzeChunk(&items[span.first_item], span.num_items, *chunk);
+				++m_num_analyzed;
+			}
+		}
+		span.chunk = chunk;
+	}
+	m_chunks.swap(chunks);
+
+	UpdateSymbols();
+
+	// with brackets amiss the syntax errors are mostly echoes, and the
+	// entry point may just be swallowed.
+	m_diagnostics.clear();
+	CheckBrackets(items);
+	if (m_diagnostics.empty())
+	{
+		CheckSyntax(parser);
+		CheckEntryPoint(items);
+	}
+
+	for (size_t i = 0; i != m_spans.size(); ++i)
+	{
+		const ChunkSpan& span = m_spans[i];
+		CheckChunk(*span.chunk);
+
+		for (size_t j = 0; j != span.chunk->diagnostics.size(); ++j)
+		{
+			const ChunkDiagnostic& chunk_diagnostic = span.chunk->diagnostics[j];
+			const Token& tok = *items[span.first_item + chunk_diagnostic.offset].token;
+			Diagnostic diagnostic = {true, tok.start_pos, tok.end_pos, chunk_diagnostic.message};
+			m_diagnostics.push_back(diagnostic);
+		}
+	}
+
+	std::stable_sort(m_diagnostics.begin(), m_diagnostics.end(), [](const Diagnostic& lhs, const Diagnostic& rhs)
+	{
+		if (lhs.is_located != rhs.is_located) return !lhs.is_located;
+		return lhs.start_pos < rhs.start_pos;
+	});
+}
+
+const std::vector<ShaderLinter::Diagnostic>& ShaderLinter::GetDiagnostics() const
+{
+	return m_diagnostics;
+}
+
+size_t ShaderLinter::GetNumChunks() const
+{
+	return m_spans.size();
+}
+
+size_t ShaderLinter::GetNumAnalyzedChunks() const
+{
+	return m_num_analyzed;
+}
+
+size_t ShaderLinter::GetNumCheckedChunks() const
+{
+	return m_num_checked;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderLinter::SplitChunks(const ShaderParser& parser, std::vector<ChunkSpan>& spans) const
+{
+	const std::vector<Item>& items = parser.GetItems();
+	const std::vector<ShaderParser::Child>& declarations = parser.GetRoot()->children;
+
+	spans.resize(declarations.size());
+	for (size_t i = 0; i != declarations.size(); ++i)
+	{
+		spans[i].first_item = declarations[i].offset;
+		spans[i].num_items = declarations[i].node->num_items;
+	}
+
+	// hashed a byte per character, words are ascii outside comments.
+	std::string bytes;
+	for (size_t i = 0; i != spans.size(); ++i)
+	{
+		bytes.clear();
+		for (size_t j = spans[i].first_item; j != spans[i].first_item + spans[i].num_items; ++j)
+		{
+			const Item& item = items[j];
+			const std::wstring& word = item.token->word;
+			bytes += static_cast<char>(item.token->type | (item.in_directive ? 0x10 : 0) | (item.starts_directive ? 0x20 : 0));
+			for (size_t k = 0; k != word.length(); ++k) bytes += static_cast<char>(word[k] ^ (word[k] >> 8));
+		}
+
+		ContentHasher hasher;
+		hasher.Update(bytes);
+		spans[i].hash = hasher.Finish();
+	}
+}
+
+bool ShaderLinter::ScanArguments(const Item* items, size_t num_items, size_t open,
+	size_t& num_args, size_t& num_defaults, size_t& close)
+{
+	num_args = 0;
+	num_defaults = 0;
+
+	size_t depth = 0;
+	bool is_empty = true;
+	bool has_default = false;
+	for (size_t i = open; i != num_items; ++i)
+	{
+		if (items[i].in_directive) continue;
+		const std::wstring& word = items[i].token->word;
+
+		if (IsOpenBracket(word)) ++depth;
+		else if (IsCloseBracket(word) && --depth == 0)
+		{
+			if (!is_empty) ++num_args;
+			if (has_default) ++num_defaults;
+			close = i;
+			return true;
+		}
+
+		if (i != open) is_empty = false;
+		if (depth == 1 && word == L"=") has_default = true;
+		if (depth == 1 && word == L",")
+		{
+			++num_args;
+			if (has_default) ++num_defaults;
+			has_default = false;
+		}
+	}
+	return false;
+}
+
+void ShaderLinter::AnalyzeChunk(const Item* items, size_t num_items, Chunk& chunk) const
+{
+	chunk.checked_version = 0;
+
+	std::vector<wchar_t> brackets;
+	bool in_buffer = num_items != 0 && (items[0].token->word == L"cbuffer" || items[0].token->word == L"tbuffer");
+	size_t declaration_depth = no_args;
+	size_t num_ternaries = 0;
+	bool after_colon = false;
+
+	for (size_t i = 0; i != num_items; ++i)
+	{
+		const Item& item = items[i];
+		const Token& tok = *item.token;
+		const std::wstring& word = tok.word;
+
+		if (item.in_directive)
+		{
+			// #define NAME, with or without parameters.
+			if (item.starts_directive && i + 2 < num_items && items[i + 1].token->word == L"define" &&
+				items[i + 2].in_directive && !items[i + 2].starts_directive && items[i + 2].token->type == ShaderTokenizer::TT_Word)
+			{
+				chunk.globals.push_back(items[i + 2].token->word);
+			}
+			continue;
+		}
+
+		const Token* prev = i > 0 && !items[i - 1].in_directive ? items[i - 1].token : NULL;
+		const Token* next = i + 1 < num_items && !items[i + 1].in_directive ? items[i + 1].token : NULL;
+
+		if (tok.type == ShaderTokenizer::TT_Separator)
+		{
+			if (IsOpenBracket(word))
+			{
+				brackets.push_back(word[0]);
+			}
+			else if (IsCloseBracket(word))
+			{
+				if (!brackets.empty()) brackets.pop_back();
+				if (declaration_depth != no_args && brackets.size() < declaration_depth) declaration_depth = no_args;
+			}
+			else if (word == L";")
+			{
+				declaration_depth = no_args;
+				num_ternaries = 0;
+			}
+			else if (word == L"?")
+			{
+				++num_ternaries;
+			}
+			else if (word == L":")
+			{
+				if (num_ternaries != 0) --num_ternaries;
+				else after_colon = true;
+			}
+			continue;
+		}
+
+		// semantics, registers and pack offsets name no symbol.
+		if (after_colon)
+		{
+			after_colon = false;
+			if ((word == L"register" || word == L"packoffset") && next != NULL && next->word == L"(")
+			{
+				size_t num_args = 0, num_defaults = 0, close = i + 1;
+				if (ScanArguments(items, num_items, i + 1, num_args, num_defaults, close)) i = close;
+				continue;
+			}
+			if (tok.type == ShaderTokenizer::TT_Word || tok.type == ShaderTokenizer::TT_Semantic) continue;
+		}
+
+		// intrinsic names are only ever called, or overloaded by the header.
+		bool is_intrinsic = tok.type == ShaderTokenizer::TT_Function;
+		if (tok.type != ShaderTokenizer::TT_Word && !is_intrinsic) continue;
+		if (is_intrinsic && (next == NULL || next->word != L"(")) continue;
+
+		// members, swizzles and attributes.
+		if (prev != NULL && prev->word == L".") continue;
+		if (prev != NULL && prev->word == L"[" && IsOneOf(word, attributes, ARRAYSIZE(attributes))) continue;
+
+		if (prev != NULL && prev->type == ShaderTokenizer::TT_Keyword && IsOneOf(prev->word, type_introducers, ARRAYSIZE(type_introducers)))
+		{
+			chunk.globals.push_back(word);
+			continue;
+		}
+
+		bool ends_declarator = next == NULL ||
+			(next->type == ShaderTokenizer::TT_Separator && next->word.find_first_of(L"=;,)[:(") != std::wstring::npos);
+		bool is_declaration = ends_declarator && prev != NULL && IsTypeName(*prev);
+		if (!is_declaration && ends_declarator && next != NULL && next->word != L"(")
+		{
+			// the next name of "float a = 1, b = 2;".
+			is_declaration = prev != NULL && prev->word == L"," && declaration_depth == brackets.size();
+		}
+
+		if (is_declaration)
+		{
+			if (next != NULL && next->word == L"(" && brackets.empty())
+			{
+				Function function = {word, i, 0, 0, false};
+				size_t num_args = 0, num_defaults = 0, close = i + 1;
+				if (ScanArguments(items, num_items, i + 1, num_args, num_defaults, close))
+				{
+					// "f(void)" takes nothing.
+					if (num_args == 1 && close == i + 3 && items[i + 2].token->word == L"void") num_args = 0;
+					function.min_args = num_args - num_defaults;
+					function.max_args = num_args;
+					function.has_semantic = close + 1 < num_items && items[close + 1].token->word == L":";
+				}
+				chunk.globals.push_back(word);
+				chunk.functions.push_back(function);
+				continue;
+			}
+
+			if (brackets.empty() || (in_buffer && brackets.size() == 1)) chunk.globals.push_back(word);
+			else chunk.locals.insert(word);
+
+			if (next == NULL || next->word != L"(") declaration_depth = brackets.size();
+			continue;
+		}
+
+		if (!is_intrinsic)
+		{
+			Reference use = {i, word, no_args};
+			chunk.uses.push_back(use);
+		}
+
+		if (next != NULL && next->word == L"(")
+		{
+			Reference call = {i, word, no_args};
+			size_t num_defaults = 0, close = i + 1;
+			if (!ScanArguments(items, num_items, i + 1, call.num_args, num_defaults, close)) call.num_args = no_args;
+			chunk.calls.push_back(call);
+		}
+	}
+}
+
+void ShaderLinter::CheckChunk(Chunk& chunk)
+{
+	if (chunk.checked_version == m_symbols_version) return;
+	chunk.checked_version = m_symbols_version;
+	chunk.diagnostics.clear();
+	++m_num_checked;
+
+	for (size_t i = 0; i != chunk.uses.size(); ++i)
+	{
+		const Reference& use = chunk.uses[i];
+		if (chunk.locals.find(use.name) != chunk.locals.end()) continue;
+		if (m_globals.find(use.name) != m_globals.end()) continue;
+
+		ChunkDiagnostic diagnostic = {use.offset, "undeclared identifier '" + Narrow(use.name) + "'"};
+		chunk.diagnostics.push_back(diagnostic);
+	}
+
+	for (size_t i = 0; i != chunk.calls.size(); ++i)
+	{
+		ChunkDiagnostic diagnostic = {chunk.calls[i].offset};
+		if (!CheckArguments(chunk.calls[i], diagnostic.message)) chunk.diagnostics.push_back(diagnostic);
+	}
+
+	std::stable_sort(chunk.diagnostics.begin(), chunk.diagnostics.end(), [](const ChunkDiagnostic& lhs, const ChunkDiagnostic& rhs)
+	{
+		return lhs.offset < rhs.offset;
+	});
+}
+
+void ShaderLinter::CheckBrackets(const std::vector<Item>& items)
+{
+	std::vector<size_t> open;
+	for (size_t i = 0; i != items.size(); ++i)
+	{
+		const Item& item = items[i];
+		if (item.in_directive || item.token->type != ShaderTokenizer::TT_Separator) continue;
+
+		const std::wstring& word = item.token->word;
+		if (IsOpenBracket(word))
+		{
+			open.push_back(i);
+		}
+		else if (IsCloseBracket(word))
+		{
+			std::string message;
+			if (open.empty())
+			{
+				message = "unmatched '" + Narrow(word) + "'";
+			}
+			else if (items[open.back()].token->word[0] != MatchingBracket(word[0]))
+			{
+				message = "'" + Narrow(word) + "' does not close '" + Narrow(items[open.back()].token->word) + "'";
+				open.pop_back();
+			}
+			else
+			{
+				open.pop_back();
+			}
+
+			if (!message.empty())
+			{
+				Diagnostic diagnostic = {true, item.token->start_pos, item.token->end_pos, message};
+				m_diagnostics.push_back(diagnostic);
+			}
+		}
+	}
+
+	for (size_t i = 0; i != open.size(); ++i)
+	{
+		const Token& tok = *items[open[i]].token;
+		Diagnostic diagnostic = {true, tok.start_pos, tok.end_pos, "'" + Narrow(tok.word) + "' is never closed"};
+		m_diagnostics.push_back(diagnostic);
+	}
+}
+
+void ShaderLinter::CheckSyntax(const ShaderParser& parser)
+{
+	const std::vector<Item>& items = parser.GetItems();
+	const std::vector<ShaderParser::Error>& errors = parser.GetErrors();
+	for (size_t i = 0; i != errors.size(); ++i)
+	{
+		// a missing token is reported at the one after it.
+		const ShaderParser::Error& error = errors[i];
+		size_t last_item = error.first_item + std::max<size_t>(error.num_items, 1) - 1;
+
+		Diagnostic diagnostic = {true, 0, 0, error.message};
+		if (last_item < items.size())
+		{
+			diagnostic.start_pos = items[error.first_item].token->start_pos;
+			diagnostic.end_pos = items[last_item].token->end_pos;
+		}
+		else
+		{
+			diagnostic.start_pos = items.back().token->end_pos;
+			diagnostic.end_pos = diagnostic.start_pos;
+		}
+		m_diagnostics.push_back(diagnostic);
+	}
+}
+
+void ShaderLinter::CheckEntryPoint(const std::vector<Item>& items)
+{
+	for (size_t i = 0; i != m_spans.size(); ++i)
+	{
+		const ChunkSpan& span = m_spans[i];
+		for (size_t j = 0; j != span.chunk->functions.size(); ++j)
+		{
+			const Function& function = span.chunk->functions[j];
+			if (function.name != m_entry_point) continue;
+
+			if (!function.has_semantic)
+			{
+				const Token& tok = *items[span.first_item + function.offset].token;
+				Diagnostic diagnostic = {true, tok.start_pos, tok.end_pos,
+					"'" + Narrow(m_entry_point) + "' has no output semantic, e.g. ': SV_TARGET'"};
+				m_diagnostics.push_back(diagnostic);
+			}
+			return;
+		}
+	}
+
+	Diagnostic diagnostic = {false, 0, 0, "no entry point, expected e.g. 'float4 " + Narrow(m_entry_point) + "(in float2 tc : TEXCOORD) : SV_TARGET'"};
+	m_diagnostics.push_back(diagnostic);
+}
+
+void ShaderLinter::UpdateSymbols()
+{
+	std::set<std::wstring> globals = m_header_globals;
+	std::multimap<std::wstring, Function> functions = m_header_functions;
+	for (size_t i = 0; i != m_spans.size(); ++i)
+	{
+		const Chunk& chunk = *m_spans[i].chunk;
+		globals.insert(chunk.globals.begin(), chunk.globals.end());
+		for (size_t j = 0; j != chunk.functions.size(); ++j)
+		{
+			functions.insert(std::make_pair(chunk.functions[j].name, chunk.functions[j]));
+		}
+	}
+
+	// chunks are only checked again once the symbols they see changed.
+	ContentHasher hasher;
+	for (auto it = globals.begin(); it != globals.end(); ++it)
+	{
+		hasher.UpdateValue(it->length());
+		hasher.Update(it->c_str(), it->length() * sizeof(wchar_t));
+	}
+	for (auto it = functions.begin(); it != functions.end(); ++it)
+	{
+		hasher.UpdateValue(it->first.length());
+		hasher.Update(it->first.c_str(), it->first.length() * sizeof(wchar_t));
+		hasher.UpdateValue(it->second.min_args);
+		hasher.UpdateValue(it->second.max_args);
+	}
+
+	ContentHash hash = hasher.Finish();
+	if (hash == m_symbols_hash) return;
+
+	m_symbols_hash = hash;
+	m_globals.swap(globals);
+	m_functions.swap(functions);
+	++m_symbols_version;
+}
+
+bool ShaderLinter::IsTypeName(const Token& tok) const
+{
+	if (tok.type == ShaderTokenizer::TT_Word) return true;
+	return tok.type == ShaderTokenizer::TT_Keyword && m_plain_keywords.find(tok.word) == m_plain_keywords.end();
+}
+
+bool ShaderLinter::CheckArguments(const Reference& call, std::string& message) const
+{
+	if (call.num_args == no_args) return true;
+
+	// declared functions, which may overload intrinsics.
+	size_t num_overloads = 0;
+	size_t min_args = 0, max_args = 0;
+	auto range = m_functions.equal_range(call.name);
+	for (auto it = range.first; it != range.second; ++it, ++num_overloads)
+	{
+		if (call.num_args >= it->second.min_args && call.num_args <= it->second.max_args) return true;
+		min_args = it->second.min_args;
+		max_args = it->second.max_args;
+	}
+
+	if (num_overloads == 0)
+	{
+		auto it = m_intrinsic_args.find(call.name);
+		if (it == m_intrinsic_args.end()) return true;
+		if (call.num_args >= it->second.first && call.num_args <= it->second.second) return true;
+
+		num_overloads = 1;
+		min_args = it->second.first;
+		max_args = it->second.second;
+	}
+
+	std::ostringstream oss;
+	if (num_overloads > 1)
+	{
+		oss << "no overload of '" << Narrow(call.name) << "' takes " << call.num_args << " arguments";
+	}
+	else
+	{
+		oss << "'" << Narrow(call.name) << "' takes " << min_args;
+		if (max_args != min_args) oss << " to " << max_args;
+		oss << (max_args == 1 ? " argument" : " arguments") << ", not " << call.num_args;
+	}
+	message = oss.str();
+	return false;
+}
@@ -0,0 +1,139 @@
+#ifndef _SHADER_LINTER_HPP_INCLUDED_
+#define _SHADER_LINTER_HPP_INCLUDED_
+
+#include <map>
+#include <set>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "content_hash.hpp"
+#include "shader_parser.hpp"
+
+// checks a document between keystrokes, from the tokens the highlighter
+// made anyway: undeclared identifiers, calls with the wrong number of
+// arguments, a missing or incomplete entry point, mismatched brackets and
+// syntax errors. the top level declarations of the parse tree (functions,
+// globals, macros) are analyzed once and remembered by their content, so
+// an edit only costs the declaration it touched. declarations count
+// regardless of their order, which keeps chunks independent; the compiler
+// is stricter than this.
+class ShaderLinter
+{
+public:
+	struct Diagnostic
+	{
+		bool is_located;
+		size_t start_pos;		// of the document text
+		size_t end_pos;
+		std::string message;
+	};
+
+public:
+	explicit ShaderLinter(const std::wstring& entry_point = L"ps_main");
+	virtual ~ShaderLinter();
+
+public:
+	// does nothing if header_hash did not change since the last call.
+	void SetHeader(const std::string& header, const ContentHash& header_hash);
+
+	// parser must have parsed the text just now.
+	void Lint(const ShaderParser& parser);
+
+	// ordered by position, the unlocated ones first.
+	const std::vector<Diagnostic>& GetDiagnostics() const;
+
+	// of the last lint: all chunks, and the ones analyzed or checked anew.
+	size_t GetNumChunks() const;
+	size_t GetNumAnalyzedChunks() const;
+	size_t GetNumCheckedChunks() const;
+
+private:
+	typedef ShaderTokenizer::Token Token;
+	typedef ShaderParser::Item Item;
+
+	struct Function
+	{
+		std::wstring name;
+		size_t offset;			// of the name, in items from the chunk begin
+		size_t min_args;
+		size_t max_args;
+		bool has_semantic;
+	};
+
+	struct Reference
+	{
+		size_t offset;
+		std::wstring name;
+		size_t num_args;		// calls only
+	};
+
+	struct ChunkDiagnostic
+	{
+		size_t offset;
+		std::string message;
+	};
+
+	struct Chunk
+	{
+		std::vector<std::wstring> globals;
+		std::vector<Function> functions;
+		std::set<std::wstring> locals;
+		std::vector<Reference> uses;
+		std::vector<Reference> calls;
+
+		// the check depends on the global symbols as well.
+		size_t checked_version;
+		std::vector<ChunkDiagnostic> diagnostics;
+	};
+
+	typedef boost::shared_ptr<Chunk> ChunkPtr;
+	typedef std::map<ContentHash, ChunkPtr> ChunkCache;
+
+	struct ChunkSpan
+	{
+		size_t first_item;
+		size_t num_items;
+		ContentHash hash;
+		ChunkPtr chunk;
+	};
+
+	void SplitChunks(const ShaderParser& parser, std::vector<ChunkSpan>& spans) const;
+	void AnalyzeChunk(const Item* items, size_t num_items, Chunk& chunk) const;
+	void CheckChunk(Chunk& chunk);
+	void CheckBrackets(const std::vector<Item>& items);
+	void CheckSyntax(const ShaderParser& parser);
+	void CheckEntryPoint(const std::vector<Item>& items);
+	void UpdateSymbols();
+
+	// counts the arguments in the brackets opened at items[open]. returns
+	// false if they are not closed within the chunk.
+	static bool ScanArguments(const Item* items, size_t num_items, size_t open,
+		size_t& num_args, size_t& num_defaults, size_t& close);
+
+	bool IsTypeName(const Token& tok) const;
+	bool CheckArguments(const Reference& call, std::string& message) const;
+
+private:
+	std::wstring m_entry_point;
+	std::set<std::wstring> m_plain_keywords;
+	std::map<std::wstring, std::pair<size_t, size_t> > m_intrinsic_args;
+
+	ContentHash m_header_hash;
+	bool m_has_header;
+	std::set<std::wstring> m_header_globals;
+	std::multimap<std::wstring, Function> m_header_functions;
+
+	std::vector<ChunkSpan> m_spans;
+	ChunkCache m_chunks;
+
+	// every global declaration, of the header and the document.
+	std::set<std::wstring> m_globals;
+	std::multimap<std::wstring, Function> m_functions;
+	ContentHash m_symbols_hash;
+	size_t m_symbols_version;
+
+	std::vector<Diagnostic> m_diagnostics;
+	size_t m_num_analyzed;
+	size_t m_num_checked;
+};
+
+#endif  // _SHADER_LINTER_HPP_INCLUDED_
@@ -0,0 +1,1191 @@
+#include "common.hpp"
+#include "shader_parser.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// keywords which qualify the type following them.
+static const wchar_t* qualifiers[] =
+{
+	L"centroid", L"column_major", L"const", L"extern", L"groupshared", L"in", L"inline", L"inout",
+	L"linear", L"nointerpolation", L"noperspective", L"out", L"precise", L"row_major", L"shared", L"static",
+	L"uniform", L"volatile",
+};
+
+// keywords which are neither qualifiers nor type names.
+static const wchar_t* statement_keywords[] =
+{
+	L"break", L"case", L"cbuffer", L"class", L"compile", L"continue", L"default", L"define",
+	L"discard", L"do", L"else", L"endif", L"false", L"for", L"if", L"ifdef",
+	L"ifndef", L"interface", L"namespace", L"pass", L"register", L"return", L"struct", L"switch",
+	L"tbuffer", L"technique", L"technique10", L"true", L"typedef", L"while",
+};
+
+// the tokenizer makes a token of every separator, operators are glued
+// together again. the longer ones come first.
+static const wchar_t* compound_operators[] =
+{
+	L"<<=", L">>=",
+	L"++", L"--", L"+=", L"-=", L"*=", L"/=", L"%=", L"&=", L"|=", L"^=",
+	L"==", L"!=", L"<=", L">=", L"&&", L"||", L"<<", L">>",
+};
+
+static const wchar_t* assignment_operators[] =
+{
+	L"=", L"+=", L"-=", L"*=", L"/=", L"%=", L"&=", L"|=", L"^=", L"<<=", L">>=",
+};
+
+static const wchar_t* unary_operators[] =
+{
+	L"++", L"--", L"+", L"-", L"!", L"~",
+};
+
+// the higher the tighter.
+static const struct
+{
+	const wchar_t* op;
+	int precedence;
+} binary_operators[] =
+{
+	{L"||", 1}, {L"&&", 2}, {L"|", 3}, {L"^", 4}, {L"&", 5},
+	{L"==", 6}, {L"!=", 6}, {L"<", 7}, {L">", 7}, {L"<=", 7}, {L">=", 7},
+	{L"<<", 8}, {L">>", 8}, {L"+", 9}, {L"-", 9}, {L"*", 10}, {L"/", 10}, {L"%", 10},
+};
+
+static const char* kind_names[] =
+{
+	"unit", "directive", "function", "parameter", "struct", "cbuffer", "declaration", "type",
+	"qualifier", "variable", "dimension", "semantic", "attribute",
+	"block", "empty", "expression statement", "if", "for", "while", "do", "switch", "case",
+	"return", "break", "continue", "discard",
+	"literal", "identifier", "paren", "unary", "postfix", "binary", "assign", "conditional",
+	"cast", "call", "constructor", "method call", "member", "index", "init list",
+	"error",
+};
+
+static bool IsOneOf(const std::wstring& word, const wchar_t* const* words, size_t num_words)
+{
+	for (size_t i = 0; i != num_words; ++i)
+	{
+		if (word == words[i]) return true;
+	}
+	return false;
+}
+
+static bool IsOpenBracket(const std::wstring& word)
+{
+	return word == L"(" || word == L"[" || word == L"{";
+}
+
+static bool IsCloseBracket(const std::wstring& word)
+{
+	return word == L")" || word == L"]" || word == L"}";
+}
+
+static int BinaryPrecedence(const std::wstring& op)
+{
+	for (size_t i = 0; i != ARRAYSIZE(binary_operators); ++i)
+	{
+		if (op == binary_operators[i].op) return binary_operators[i].precedence;
+	}
+	return 0;
+}
+
+static std::string Narrow(const std::wstring& word)
+{
+	std::string str(word.length(), '?');
+	for (size_t i = 0; i != word.length(); ++i)
+	{
+		if (word[i] < 0x80) str[i] = static_cast<char>(word[i]);
+	}
+	return str;
+}
+
+// nodes which statements and member declarations can be found in.
+static bool HoldsStatements(ShaderParser::NodeKind kind)
+{
+	switch (kind)
+	{
+	case ShaderParser::NK_Unit:
+	case ShaderParser::NK_Function:
+	case ShaderParser::NK_Struct:
+	case ShaderParser::NK_CBuffer:
+	case ShaderParser::NK_Block:
+	case ShaderParser::NK_If:
+	case ShaderParser::NK_For:
+	case ShaderParser::NK_While:
+	case ShaderParser::NK_Do:
+	case ShaderParser::NK_Switch:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderParser::ShaderParser()
+	: m_pos(0)
+	, m_num_reused_nodes(0)
+	, m_num_reused_items(0)
+{
+
+}
+
+ShaderParser::~ShaderParser()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderParser::Parse(const std::wstring& text, const std::vector<ShaderTokenizer::Token>& tokens)
+{
+	std::vector<unsigned long long> last_keys;
+	last_keys.swap(m_item_keys);
+	CollectItems(text, tokens);
+
+	// the edit lies between an unchanged prefix and suffix. the keys end
+	// with one for the document end, which nodes at the end look ahead to.
+	size_t num_keys = std::min(last_keys.size(), m_item_keys.size());
+	size_t prefix = 0;
+	while (prefix != num_keys && last_keys[prefix] == m_item_keys[prefix]) ++prefix;
+	size_t suffix = 0;
+	while (suffix != num_keys - prefix && last_keys[last_keys.size() - 1 - suffix] == m_item_keys[m_item_keys.size() - 1 - suffix]) ++suffix;
+
+	m_reusable.clear();
+	m_num_reused_nodes = 0;
+	m_num_reused_items = 0;
+	if (m_root) CollectReusable(m_root, 0, prefix, last_keys.size() - suffix, m_item_keys.size() - suffix);
+
+	m_pos = 0;
+	NodeBuilder unit = NewNode(NK_Unit);
+	while (m_pos < m_items.size())
+	{
+		unit->children.push_back(ParseTopLevel());
+	}
+	m_root = MakeChild(0, unit).node;
+	m_reusable.clear();
+
+	m_errors.clear();
+	if (m_root->has_error) CollectErrors(m_root, 0);
+}
+
+const std::vector<ShaderParser::Item>& ShaderParser::GetItems() const
+{
+	return m_items;
+}
+
+const ShaderParser::NodePtr& ShaderParser::GetRoot() const
+{
+	return m_root;
+}
+
+const std::vector<ShaderParser::Error>& ShaderParser::GetErrors() const
+{
+	return m_errors;
+}
+
+void ShaderParser::FindPath(size_t item, std::vector<Child>& path) const
+{
+	path.clear();
+	if (!m_root || item >= m_items.size()) return;
+
+	Child current = {0, m_root};
+	path.push_back(current);
+	for (;;)
+	{
+		const std::vector<Child>& children = current.node->children;
+		size_t i = 0;
+		for (; i != children.size(); ++i)
+		{
+			size_t first = current.offset + children[i].offset;
+			if (item >= first && item < first + children[i].node->num_items) break;
+		}
+		if (i == children.size()) return;
+
+		Child child = {current.offset + children[i].offset, children[i].node};
+		path.push_back(child);
+		current = child;
+	}
+}
+
+bool ShaderParser::FindItem(size_t pos, size_t& item) const
+{
+	auto it = std::lower_bound(m_items.begin(), m_items.end(), pos,
+		[](const Item& item, size_t pos) { return item.token->end_pos < pos; });
+	if (it == m_items.end() || it->token->start_pos > pos) return false;
+
+	item = it - m_items.begin();
+	return true;
+}
+
+size_t ShaderParser::GetNumReusedNodes() const
+{
+	return m_num_reused_nodes;
+}
+
+size_t ShaderParser::GetNumReusedItems() const
+{
+	return m_num_reused_items;
+}
+
+const char* ShaderParser::GetKindName(NodeKind kind)
+{
+	return kind < Num_NodeKinds ? kind_names[kind] : "";
+}
+
+bool ShaderParser::IsExpression(NodeKind kind)
+{
+	return kind >= NK_Literal && kind <= NK_InitList;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderParser::CollectItems(const std::wstring& text, const std::vector<Token>& tokens)
+{
+	m_items.clear();
+	m_items.reserve(tokens.size());
+
+	const Token* prev = NULL;
+	bool in_directive = false;
+	for (size_t i = 0; i != tokens.size(); ++i)
+	{
+		const Token& tok = tokens[i];
+
+		bool new_line = prev == NULL;
+		if (prev != NULL)
+		{
+			auto gap_begin = text.begin() + std::min(prev->end_pos, text.length());
+			auto gap_end = text.begin() + std::min(tok.start_pos, text.length());
+			new_line = std::find(gap_begin, gap_end, L'\n') != gap_end;
+		}
+		prev = &tok;
+
+		// a line break ends a preprocessor directive unless it is escaped.
+		if (new_line && in_directive && (m_items.empty() || m_items.back().token->word != L"\\")) in_directive = false;
+		if (tok.type == ShaderTokenizer::TT_Comment) continue;
+
+		Item item = {&tok, false, false};
+		if (new_line && tok.word == L"#")
+		{
+			in_directive = true;
+			item.starts_directive = true;
+		}
+		item.in_directive = in_directive;
+		m_items.push_back(item);
+	}
+
+	// an item is the same as in the last parse if its key is. separators
+	// remember whether the next item is glued to them, '+ =' is not '+='.
+	m_item_keys.resize(m_items.size() + 1);
+	for (size_t i = 0; i != m_items.size(); ++i)
+	{
+		const Item& item = m_items[i];
+		const std::wstring& word = item.token->word;
+
+		unsigned long long key = 14695981039346656037ULL;
+		for (size_t j = 0; j != word.length(); ++j)
+		{
+			key = (key ^ static_cast<unsigned long long>(word[j])) * 1099511628211ULL;
+		}
+
+		bool glued = i + 1 != m_items.size() && item.token->end_pos == m_items[i + 1].token->start_pos;
+		unsigned long long flags = item.token->type | (item.in_directive ? 0x10 : 0) | (item.starts_directive ? 0x20 : 0) | (glued ? 0x40 : 0);
+		m_item_keys[i] = (key ^ flags) * 1099511628211ULL;
+	}
+	m_item_keys.back() = 0;
+}
+
+void ShaderParser::CollectReusable(const NodePtr& node, size_t first, size_t prefix, size_t suffix, size_t new_suffix)
+{
+	for (size_t i = 0; i != node->children.size(); ++i)
+	{
+		const Child& child = node->children[i];
+		size_t begin = first + child.offset;
+		size_t end = begin + child.node->num_items;
+		if (begin == end) continue;
+
+		// the item after a node is looked at as well, to end it.
+		if (!child.node->has_error && (end < prefix || begin >= suffix))
+		{
+			m_reusable[begin < prefix ? begin : begin - suffix + new_suffix] = child.node;
+		}
+		else if (HoldsStatements(child.node->kind))
+		{
+			CollectReusable(child.node, begin, prefix, suffix, new_suffix);
+		}
+	}
+}
+
+void ShaderParser::CollectErrors(const NodePtr& node, size_t first)
+{
+	for (size_t i = 0; i != node->children.size(); ++i)
+	{
+		const Child& child = node->children[i];
+		if (!child.node->has_error) continue;
+
+		if (child.node->kind == NK_Error)
+		{
+			Error error = {first + child.offset, child.node->num_items, Narrow(child.node->text)};
+			m_errors.push_back(error);
+		}
+		else CollectErrors(child.node, first + child.offset);
+	}
+}
+
+ShaderParser::NodeBuilder ShaderParser::NewNode(NodeKind kind) const
+{
+	NodeBuilder node(new Node);
+	node->kind = kind;
+	node->token = m_pos;
+	node->num_items = 0;
+	node->has_error = kind == NK_Error;
+	return node;
+}
+
+ShaderParser::Child ShaderParser::MakeChild(size_t first, const NodeBuilder& node) const
+{
+	node->num_items = m_pos - first;
+	node->token = node->token > first ? node->token - first : 0;
+	for (size_t i = 0; i != node->children.size(); ++i)
+	{
+		Child& child = node->children[i];
+		child.offset -= first;
+		if (child.node->has_error) node->has_error = true;
+	}
+
+	Child child = {first, node};
+	return child;
+}
+
+ShaderParser::Child ShaderParser::MakeError(size_t first, const std::string& message) const
+{
+	NodeBuilder node = NewNode(NK_Error);
+	node->text.assign(message.begin(), message.end());
+	return MakeChild(first, node);
+}
+
+bool ShaderParser::TakeReusable(ParseContext context, Child& child)
+{
+	if (m_reusable.empty()) return false;
+
+	auto it = m_reusable.find(m_pos);
+	if (it == m_reusable.end()) return false;
+
+	// declarations and directives read the same everywhere, the rest only
+	// where they were found.
+	NodeKind kind = it->second->kind;
+	bool fits = kind == NK_Declaration || kind == NK_Directive;
+	if (context == PC_TopLevel)
+	{
+		fits = fits || kind == NK_Function || kind == NK_Struct || kind == NK_CBuffer || kind == NK_Empty || kind == NK_Attribute;
+	}
+	else if (context == PC_Statement)
+	{
+		fits = fits || (kind >= NK_Block && kind <= NK_Discard) || kind == NK_Attribute;
+	}
+	if (!fits) return false;
+
+	child.offset = m_pos;
+	child.node = it->second;
+	m_pos += child.node->num_items;
+
+	++m_num_reused_nodes;
+	m_num_reused_items += child.node->num_items;
+	return true;
+}
+
+ShaderParser::Child ShaderParser::ParseTopLevel()
+{
+	Child child;
+	if (TakeReusable(PC_TopLevel, child)) return child;
+
+	size_t first = m_pos;
+	const std::wstring& word = Word(m_pos);
+	if (m_items[m_pos].starts_directive) return ParseDirective();
+	if (word == L"[") return ParseAttribute();
+	if (word == L"struct") return ParseStruct();
+	if (word == L"cbuffer" || word == L"tbuffer") return ParseCBuffer();
+	if (word == L";")
+	{
+		NodeBuilder node = NewNode(NK_Empty);
+		++m_pos;
+		return MakeChild(first, node);
+	}
+
+	if (IsQualifier(m_pos) || IsTypeName(m_pos) || IsName(m_pos))
+	{
+		Child type = ParseType();
+		if (IsName(m_pos) && Word(m_pos + 1) == L"(") return ParseFunction(first, type);
+		if (IsName(m_pos)) return ParseDeclaration(first, type);
+		m_pos = first;
+	}
+	return SkipStatement(false);
+}
+
+ShaderParser::Child ShaderParser::ParseDirective()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Directive);
+	++m_pos;
+
+	if (m_pos < m_items.size() && m_items[m_pos].in_directive && !m_items[m_pos].starts_directive)
+	{
+		node->text = Word(m_pos);
+		node->token = m_pos;
+	}
+	while (m_pos < m_items.size() && m_items[m_pos].in_directive && !m_items[m_pos].starts_directive) ++m_pos;
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseAttribute()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Attribute);
+	++m_pos;
+
+	if (IsName(m_pos))
+	{
+		node->text = Word(m_pos);
+		node->token = m_pos;
+		++m_pos;
+	}
+	else node->children.push_back(MakeError(m_pos, "expected an attribute"));
+
+	if (Word(m_pos) == L"(") ParseArguments(node);
+	SkipTo(node, L"]");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseStruct()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Struct);
+	++m_pos;
+
+	if (IsName(m_pos))
+	{
+		node->text = Word(m_pos);
+		node->token = m_pos;
+		++m_pos;
+	}
+	else node->children.push_back(MakeError(m_pos, "expected a name"));
+
+	if (Word(m_pos) == L"{") ParseMembers(node);
+	else Expect(node, L"{");
+	Expect(node, L";");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseCBuffer()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_CBuffer);
+	++m_pos;
+
+	if (IsName(m_pos))
+	{
+		node->text = Word(m_pos);
+		node->token = m_pos;
+		++m_pos;
+	}
+	else node->children.push_back(MakeError(m_pos, "expected a name"));
+
+	while (Word(m_pos) == L":") node->children.push_back(ParseSemantic());
+	if (Word(m_pos) == L"{") ParseMembers(node);
+	else Expect(node, L"{");
+	if (Word(m_pos) == L";") ++m_pos;
+	return MakeChild(first, node);
+}
+
+void ShaderParser::ParseMembers(const NodeBuilder& node)
+{
+	++m_pos;
+	while (m_pos < m_items.size() && Word(m_pos) != L"}")
+	{
+		Child child;
+		if (TakeReusable(PC_Member, child)) {}
+		else if (m_items[m_pos].starts_directive) child = ParseDirective();
+		else if (IsDeclarationStart(m_pos))
+		{
+			size_t first = m_pos;
+			Child type = ParseType();
+			child = ParseDeclaration(first, type);
+		}
+		else child = SkipStatement(true);
+		node->children.push_back(child);
+	}
+	Expect(node, L"}");
+}
+
+ShaderParser::Child ShaderParser::ParseFunction(size_t first, const Child& type)
+{
+	NodeBuilder node = NewNode(NK_Function);
+	node->children.push_back(type);
+	node->text = Word(m_pos);
+	node->token = m_pos;
+	m_pos += 2;
+
+	if (Word(m_pos) == L"void" && Word(m_pos + 1) == L")") ++m_pos;
+	else if (Word(m_pos) != L")")
+	{
+		for (;;)
+		{
+			node->children.push_back(ParseParameter());
+			if (Word(m_pos) != L",") break;
+			++m_pos;
+		}
+	}
+	SkipTo(node, L")");
+
+	while (Word(m_pos) == L":") node->children.push_back(ParseSemantic());
+	if (Word(m_pos) == L"{") node->children.push_back(ParseBlock());
+	else Expect(node, L";");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseParameter()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Parameter);
+	node->children.push_back(ParseType());
+	node->children.push_back(ParseVariable());
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseDeclaration(size_t first, const Child& type)
+{
+	NodeBuilder node = NewNode(NK_Declaration);
+	node->children.push_back(type);
+	for (;;)
+	{
+		node->children.push_back(ParseVariable());
+		if (Word(m_pos) != L",") break;
+		++m_pos;
+	}
+	Expect(node, L";");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseType()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Type);
+	while (IsQualifier(m_pos))
+	{
+		NodeBuilder qualifier = NewNode(NK_Qualifier);
+		qualifier->text = Word(m_pos);
+		++m_pos;
+		node->children.push_back(MakeChild(m_pos - 1, qualifier));
+	}
+
+	if (!IsTypeName(m_pos) && !IsName(m_pos))
+	{
+		node->children.push_back(MakeError(m_pos, "expected a type"));
+		return MakeChild(first, node);
+	}
+
+	node->text = Word(m_pos);
+	node->token = m_pos;
+	++m_pos;
+
+	// template arguments, as in vector<float, 3>, are part of the name.
+	if (IsTypeName(m_pos - 1) && Word(m_pos) == L"<")
+	{
+		for (size_t level = 0; m_pos < m_items.size(); )
+		{
+			const std::wstring& word = Word(m_pos);
+			if (word == L"<") ++level;
+			else if (word == L">") --level;
+			else if (word != L"," && !IsName(m_pos) && !IsTypeName(m_pos) && m_items[m_pos].token->type != ShaderTokenizer::TT_Constant) break;
+
+			node->text += word;
+			++m_pos;
+			if (level == 0) break;
+		}
+		if (node->text[node->text.length() - 1] != L'>') node->children.push_back(MakeError(m_pos, "expected '>'"));
+	}
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseVariable()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Variable);
+	if (!IsName(m_pos))
+	{
+		node->children.push_back(MakeError(m_pos, "expected a name"));
+		return MakeChild(first, node);
+	}
+
+	node->text = Word(m_pos);
+	node->token = m_pos;
+	++m_pos;
+
+	while (Word(m_pos) == L"[")
+	{
+		size_t dimension_first = m_pos;
+		NodeBuilder dimension = NewNode(NK_Dimension);
+		++m_pos;
+		if (Word(m_pos) != L"]") dimension->children.push_back(ParseExpression());
+		SkipTo(dimension, L"]");
+		node->children.push_back(MakeChild(dimension_first, dimension));
+	}
+
+	while (Word(m_pos) == L":") node->children.push_back(ParseSemantic());
+
+	if (Word(m_pos) == L"=")
+	{
+		++m_pos;
+		node->children.push_back(Word(m_pos) == L"{" ? ParseInitList() : ParseAssignment());
+	}
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseSemantic()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Semantic);
+	++m_pos;
+
+	const std::wstring& word = Word(m_pos);
+	if (word == L"register" || word == L"packoffset")
+	{
+		node->text = word;
+		node->token = m_pos;
+		++m_pos;
+
+		// the arguments are slots like b0 or c1.x, no expressions.
+		Expect(node, L"(");
+		while (m_pos < m_items.size() && Word(m_pos) != L")" && Word(m_pos) != L";" && !m_items[m_pos].starts_directive) ++m_pos;
+		Expect(node, L")");
+	}
+	else if (m_pos < m_items.size() && (IsName(m_pos) || m_items[m_pos].token->type == ShaderTokenizer::TT_Keyword))
+	{
+		node->text = word;
+		node->token = m_pos;
+		++m_pos;
+	}
+	else node->children.push_back(MakeError(m_pos, "expected a semantic"));
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseStatement()
+{
+	Child child;
+	if (TakeReusable(PC_Statement, child)) return child;
+
+	size_t first = m_pos;
+	const std::wstring& word = Word(m_pos);
+	if (m_pos == m_items.size() || word == L"}") return MakeError(m_pos, "expected a statement");
+	if (m_items[m_pos].starts_directive) return ParseDirective();
+
+	if (word == L"{") return ParseBlock();
+	if (word == L"[") return ParseAttribute();
+	if (word == L"if") return ParseIf();
+	if (word == L"for") return ParseFor();
+	if (word == L"while" || word == L"switch") return ParseWhile();
+	if (word == L"do") return ParseDo();
+	if (word == L"case" || word == L"default") return ParseCase();
+	if (word == L"return" || word == L"break" || word == L"continue" || word == L"discard") return ParseJump();
+	if (word == L";")
+	{
+		NodeBuilder node = NewNode(NK_Empty);
+		++m_pos;
+		return MakeChild(first, node);
+	}
+
+	if (IsDeclarationStart(m_pos))
+	{
+		Child type = ParseType();
+		return ParseDeclaration(first, type);
+	}
+	return ParseExpressionStatement();
+}
+
+ShaderParser::Child ShaderParser::ParseBlock()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Block);
+	++m_pos;
+
+	while (m_pos < m_items.size() && Word(m_pos) != L"}")
+	{
+		node->children.push_back(ParseStatement());
+	}
+	Expect(node, L"}");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseIf()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_If);
+	++m_pos;
+
+	ParseCondition(node);
+	node->children.push_back(ParseStatement());
+	if (Word(m_pos) == L"else")
+	{
+		++m_pos;
+		node->children.push_back(ParseStatement());
+	}
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseFor()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_For);
+	++m_pos;
+	Expect(node, L"(");
+
+	// the init clause ends with its ';', the others are empty if missing.
+	size_t init_first = m_pos;
+	if (Word(m_pos) == L";")
+	{
+		NodeBuilder init = NewNode(NK_Empty);
+		++m_pos;
+		node->children.push_back(MakeChild(init_first, init));
+	}
+	else if (IsDeclarationStart(m_pos))
+	{
+		Child type = ParseType();
+		node->children.push_back(ParseDeclaration(init_first, type));
+	}
+	else node->children.push_back(ParseExpressionStatement());
+
+	if (Word(m_pos) == L";") node->children.push_back(MakeChild(m_pos, NewNode(NK_Empty)));
+	else node->children.push_back(ParseExpression());
+	Expect(node, L";");
+
+	if (Word(m_pos) == L")") node->children.push_back(MakeChild(m_pos, NewNode(NK_Empty)));
+	else node->children.push_back(ParseExpression());
+	SkipTo(node, L")");
+
+	node->children.push_back(ParseStatement());
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseWhile()
+{
+	// a switch reads like a while loop.
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(Word(m_pos) == L"while" ? NK_While : NK_Switch);
+	++m_pos;
+
+	ParseCondition(node);
+	node->children.push_back(ParseStatement());
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseDo()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Do);
+	++m_pos;
+
+	node->children.push_back(ParseStatement());
+	Expect(node, L"while");
+	ParseCondition(node);
+	Expect(node, L";");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseJump()
+{
+	size_t first = m_pos;
+	const std::wstring& word = Word(m_pos);
+	NodeKind kind = word == L"return" ? NK_Return : word == L"break" ? NK_Break : word == L"continue" ? NK_Continue : NK_Discard;
+	NodeBuilder node = NewNode(kind);
+	++m_pos;
+
+	if (kind == NK_Return && Word(m_pos) != L";") node->children.push_back(ParseExpression());
+	Expect(node, L";");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseCase()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_Case);
+	node->text = Word(m_pos);
+	++m_pos;
+
+	if (node->text == L"case") node->children.push_back(ParseExpression());
+	Expect(node, L":");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseExpressionStatement()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_ExprStatement);
+	Child expression = ParseExpression();
+	if (m_pos == first) return SkipStatement(true);
+
+	node->children.push_back(expression);
+	Expect(node, L";");
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseExpression()
+{
+	size_t first = m_pos;
+	Child left = ParseAssignment();
+	while (Word(m_pos) == L",")
+	{
+		NodeBuilder node = NewNode(NK_Binary);
+		node->text = L",";
+		++m_pos;
+		node->children.push_back(left);
+		node->children.push_back(ParseAssignment());
+		left = MakeChild(first, node);
+	}
+	return left;
+}
+
+ShaderParser::Child ShaderParser::ParseAssignment()
+{
+	size_t first = m_pos;
+	Child left = ParseConditional();
+	if (m_pos == first) return left;
+
+	std::wstring op;
+	size_t length = MatchOperator(m_pos, op);
+	if (length == 0 || !IsOneOf(op, assignment_operators, ARRAYSIZE(assignment_operators))) return left;
+
+	NodeBuilder node = NewNode(NK_Assign);
+	node->text = op;
+	m_pos += length;
+	node->children.push_back(left);
+	node->children.push_back(ParseAssignment());
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseConditional()
+{
+	size_t first = m_pos;
+	Child condition = ParseBinary(1);
+	if (m_pos == first || Word(m_pos) != L"?") return condition;
+
+	NodeBuilder node = NewNode(NK_Conditional);
+	++m_pos;
+	node->children.push_back(condition);
+	node->children.push_back(ParseAssignment());
+	Expect(node, L":");
+	node->children.push_back(ParseConditional());
+	return MakeChild(first, node);
+}
+
+ShaderParser::Child ShaderParser::ParseBinary(int min_precedence)
+{
+	size_t first = m_pos;
+	Child left = ParseUnary();
+	if (m_pos == first) return left;
+
+	for (;;)
+	{
+		std::wstring op;
+		size_t length = MatchOperator(m_pos, op);
+		int precedence = length != 0 ? BinaryPrecedence(op) : 0;
+		if (precedence == 0 || precedence < min_precedence) break;
+
+		NodeBuilder node = NewNode(NK_Binary);
+		node->text = op;
+		m_pos += length;
+		node->children.push_back(left);
+		node->children.push_back(ParseBinary(precedence + 1));
+		left = MakeChild(first, node);
+	}
+	return left;
+}
+
+ShaderParser::Child ShaderParser::ParseUnary()
+{
+	size_t first = m_pos;
+	std::wstring op;
+	size_t length = MatchOperator(m_pos, op);
+	if (length != 0 && IsOneOf(op, unary_operators, ARRAYSIZE(unary_operators)))
+	{
+		NodeBuilder node = NewNode(NK_Unary);
+		node->text = op;
+		m_pos += length;
+		node->children.push_back(ParseUnary());
+		return MakeChild(first, node);
+	}
+
+	// a type name alone in brackets, (float3)x.
+	if (Word(m_pos) == L"(" && IsTypeName(m_pos + 1) && Word(m_pos + 2) == L")")
+	{
+		NodeBuilder node = NewNode(NK_Cast);
+		++m_pos;
+		Child type = ParseType();
+		node->text = type.node->text;
+		node->children.push_back(type);
+		Expect(node, L")");
+		node->children.push_back(ParseUnary());
+		return MakeChild(first, node);
+	}
+	return ParsePostfix();
+}
+
+ShaderParser::Child ShaderParser::ParsePostfix()
+{
+	size_t first = m_pos;
+	Child left = ParsePrimary();
+	if (m_pos == first) return left;
+
+	for (;;)
+	{
+		const std::wstring& word = Word(m_pos);
+		std::wstring op;
+		size_t length = MatchOperator(m_pos, op);
+
+		NodeBuilder node;
+		if (word == L".")
+		{
+			node = NewNode(NK_Member);
+			++m_pos;
+			node->children.push_back(left);
+			if (IsName(m_pos) || (m_pos < m_items.size() && m_items[m_pos].token->type == ShaderTokenizer::TT_Keyword))
+			{
+				node->text = Word(m_pos);
+				node->token = m_pos;
+				++m_pos;
+			}
+			else node->children.push_back(MakeError(m_pos, "expected a member"));
+
+			if (Word(m_pos) == L"(")
+			{
+				node->kind = NK_MethodCall;
+				ParseArguments(node);
+			}
+		}
+		else if (word == L"[")
+		{
+			node = NewNode(NK_Index);
+			++m_pos;
+			node->children.push_back(left);
+			node->children.push_back(ParseExpression());
+			SkipTo(node, L"]");
+		}
+		else if (op == L"++" || op == L"--")
+		{
+			node = NewNode(NK_Postfix);
+			node->text = op;
+			m_pos += length;
+			node->children.push_back(left);
+		}
+		else break;
+
+		left = MakeChild(first, node);
+	}
+	return left;
+}
+
+ShaderParser::Child ShaderParser::ParsePrimary()
+{
+	size_t first = m_pos;
+	if (m_pos == m_items.size()) return MakeError(m_pos, "expected an expression");
+
+	const std::wstring& word = Word(m_pos);
+	if (m_items[m_pos].token->type == ShaderTokenizer::TT_Constant || word == L"true" || word == L"false")
+	{
+		NodeBuilder node = NewNode(NK_Literal);
+		node->text = word;
+		++m_pos;
+		return MakeChild(first, node);
+	}
+
+	if (word == L"(")
+	{
+		NodeBuilder node = NewNode(NK_Paren);
+		++m_pos;
+		node->children.push_back(ParseExpression());
+		SkipTo(node, L")");
+		return MakeChild(first, node);
+	}
+
+	if (IsTypeName(m_pos) || IsName(m_pos))
+	{
+		bool is_call = Word(m_pos + 1) == L"(";
+		NodeBuilder node = NewNode(!is_call ? NK_Identifier : IsTypeName(m_pos) ? NK_Constructor : NK_Call);
+		node->text = word;
+		++m_pos;
+		if (is_call) ParseArguments(node);
+		return MakeChild(first, node);
+	}
+	return MakeError(m_pos, "expected an expression");
+}
+
+ShaderParser::Child ShaderParser::ParseInitList()
+{
+	size_t first = m_pos;
+	NodeBuilder node = NewNode(NK_InitList);
+	++m_pos;
+
+	while (m_pos < m_items.size() && Word(m_pos) != L"}")
+	{
+		node->children.push_back(Word(m_pos) == L"{" ? ParseInitList() : ParseAssignment());
+		if (Word(m_pos) != L",") break;
+		++m_pos;
+	}
+	SkipTo(node, L"}");
+	return MakeChild(first, node);
+}
+
+void ShaderParser::ParseCondition(const NodeBuilder& node)
+{
+	Expect(node, L"(");
+	node->children.push_back(ParseExpression());
+	SkipTo(node, L")");
+}
+
+void ShaderParser::ParseArguments(const NodeBuilder& node)
+{
+	++m_pos;
+	if (Word(m_pos) != L")")
+	{
+		for (;;)
+		{
+			node->children.push_back(ParseAssignment());
+			if (Word(m_pos) != L",") break;
+			++m_pos;
+		}
+	}
+	SkipTo(node, L")");
+}
+
+void ShaderParser::Expect(const NodeBuilder& node, const wchar_t* word)
+{
+	if (Word(m_pos) == word)
+	{
+		++m_pos;
+		return;
+	}
+	node->children.push_back(MakeError(m_pos, "expected '" + Narrow(word) + "'"));
+}
+
+void ShaderParser::SkipTo(const NodeBuilder& node, const wchar_t* close)
+{
+	// brackets in between are skipped whole. a statement end or another
+	// closing bracket stops early, the close is likely missing then.
+	size_t first = m_pos;
+	size_t level = 0;
+	while (m_pos < m_items.size())
+	{
+		const std::wstring& word = Word(m_pos);
+		if (level == 0)
+		{
+			if (word == close || word == L";" || word == L"{" || IsCloseBracket(word)) break;
+			if (m_items[m_pos].starts_directive) break;
+		}
+
+		if (IsOpenBracket(word)) ++level;
+		else if (IsCloseBracket(word)) --level;
+		++m_pos;
+	}
+
+	if (m_pos != first) node->children.push_back(MakeError(first, "unexpected '" + Narrow(Word(first)) + "'"));
+	Expect(node, close);
+}
+
+ShaderParser::Child ShaderParser::SkipStatement(bool in_block)
+{
+	// up to the end of the statement, or past the brace closing a block in
+	// it. a '}' which is not ours ends the skip, at top level it is skipped.
+	size_t first = m_pos;
+	size_t level = 0;
+	while (m_pos < m_items.size())
+	{
+		const std::wstring& word = Word(m_pos);
+		if (level == 0 && m_pos != first && m_items[m_pos].starts_directive) break;
+		if (level == 0 && word == L"}" && (in_block || m_pos != first)) break;
+		++m_pos;
+
+		if (IsOpenBracket(word)) ++level;
+		else if (IsCloseBracket(word))
+		{
+			if (level != 0) --level;
+			if (level == 0 && word == L"}") break;
+		}
+		if (level == 0 && word == L";") break;
+	}
+	return MakeError(first, "unexpected '" + Narrow(Word(first)) + "'");
+}
+
+const std::wstring& ShaderParser::Word(size_t idx) const
+{
+	static const std::wstring none;
+	return idx < m_items.size() ? m_items[idx].token->word : none;
+}
+
+bool ShaderParser::IsName(size_t idx) const
+{
+	if (idx >= m_items.size()) return false;
+
+	// words after a '.' or ':' are classified by what they may be there.
+	ShaderTokenizer::TokenType type = m_items[idx].token->type;
+	return type == ShaderTokenizer::TT_Word || type == ShaderTokenizer::TT_Function
+		|| type == ShaderTokenizer::TT_Member || type == ShaderTokenizer::TT_Semantic;
+}
+
+bool ShaderParser::IsQualifier(size_t idx) const
+{
+	if (idx >= m_items.size() || m_items[idx].token->type != ShaderTokenizer::TT_Keyword) return false;
+	return IsOneOf(Word(idx), qualifiers, ARRAYSIZE(qualifiers));
+}
+
+bool ShaderParser::IsTypeName(size_t idx) const
+{
+	if (idx >= m_items.size() || m_items[idx].token->type != ShaderTokenizer::TT_Keyword) return false;
+
+	const std::wstring& word = Word(idx);
+	return !IsOneOf(word, qualifiers, ARRAYSIZE(qualifiers)) && !IsOneOf(word, statement_keywords, ARRAYSIZE(statement_keywords));
+}
+
+bool ShaderParser::IsDeclarationStart(size_t idx) const
+{
+	// user type names can only be told by a name following them.
+	if (IsQualifier(idx)) return true;
+	if (IsTypeName(idx)) return IsName(idx + 1) || Word(idx + 1) == L"<";
+	return IsName(idx) && IsName(idx + 1);
+}
+
+size_t ShaderParser::MatchOperator(size_t idx, std::wstring& op) const
+{
+	if (idx >= m_items.size() || m_items[idx].token->type != ShaderTokenizer::TT_Separator) return 0;
+	if (wcschr(L"+-*/%&|^=!<>", m_items[idx].token->word[0]) == NULL || idx + 1 == m_items.size())
+	{
+		op = Word(idx);
+		return 1;
+	}
+
+	for (size_t i = 0; i != ARRAYSIZE(compound_operators); ++i)
+	{
+		const wchar_t* candidate = compound_operators[i];
+		size_t length = wcslen(candidate);
+		if (idx + length > m_items.size()) continue;
+
+		size_t j = 0;
+		for (; j != length; ++j)
+		{
+			const Item& item = m_items[idx + j];
+			if (item.token->word.length() != 1 || item.token->word[0] != candidate[j]) break;
+			if (j != 0 && m_items[idx + j - 1].token->end_pos != item.token->start_pos) break;
+		}
+		if (j == length)
+		{
+			op = candidate;
+			return length;
+		}
+	}
+
+	op = Word(idx);
+	return 1;
+}
@@ -0,0 +1,215 @@
+#ifndef _SHADER_PARSER_HPP_INCLUDED_
+#define _SHADER_PARSER_HPP_INCLUDED_
+
+#include <map>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "shader_tokenizer.hpp"
+
+// parses the tokens of the tokenizer into a concrete syntax tree. every
+// significant token belongs to exactly one node, and broken text still
+// gives a whole tree, with error nodes where something was missing or had
+// to be skipped. nodes only know offsets from their parent, so a subtree
+// fits wherever its tokens moved to. after an edit, the declarations and
+// statements lying entirely before or after the changed tokens are taken
+// over from the last tree, only their ancestors are parsed again.
+class ShaderParser
+{
+public:
+	// a significant token, comments left out.
+	struct Item
+	{
+		const ShaderTokenizer::Token* token;
+		bool in_directive;
+		bool starts_directive;
+	};
+
+	enum NodeKind
+	{
+		// declarations, text is the name.
+		NK_Unit,				// the document
+		NK_Directive,			// a preprocessor line, text is the directive
+		NK_Function,			// type, parameters, semantics, body
+		NK_Parameter,			// type, variable
+		NK_Struct,				// declarations
+		NK_CBuffer,				// semantics, declarations
+		NK_Declaration,			// type, variables
+		NK_Type,				// qualifiers
+		NK_Qualifier,
+		NK_Variable,			// dimensions, semantics, initializer
+		NK_Dimension,			// the size expression, if any
+		NK_Semantic,			// register(...) and packoffset(...) too
+		NK_Attribute,			// [unroll] and the like, arguments
+
+		// statements.
+		NK_Block,
+		NK_Empty,				// ';', or a missing for clause
+		NK_ExprStatement,
+		NK_If,					// condition, then, else
+		NK_For,					// init, condition, step, body
+		NK_While,				// condition, body
+		NK_Do,					// body, condition
+		NK_Switch,				// condition, body
+		NK_Case,				// text is case or default, the value
+		NK_Return,
+		NK_Break,
+		NK_Continue,
+		NK_Discard,
+
+		// expressions, text is the operator, name or literal.
+		NK_Literal,
+		NK_Identifier,
+		NK_Paren,
+		NK_Unary,
+		NK_Postfix,
+		NK_Binary,				// ',' as well
+		NK_Assign,
+		NK_Conditional,
+		NK_Cast,				// text is the type
+		NK_Call,
+		NK_Constructor,
+		NK_MethodCall,			// object, arguments
+		NK_Member,				// object
+		NK_Index,				// object, index
+		NK_InitList,
+
+		NK_Error,				// text is the message
+		Num_NodeKinds,
+	};
+
+	struct Node;
+	typedef boost::shared_ptr<const Node> NodePtr;
+
+	struct Child
+	{
+		size_t offset;			// in items, from the first item of the parent
+		NodePtr node;
+	};
+
+	struct Node
+	{
+		NodeKind kind;
+		std::wstring text;
+		size_t token;			// the item text came from, from the first item
+		size_t num_items;
+		bool has_error;			// anywhere in the subtree
+		std::vector<Child> children;
+	};
+
+	struct Error
+	{
+		size_t first_item;
+		size_t num_items;		// none if something is missing before first_item
+		std::string message;
+	};
+
+public:
+	ShaderParser();
+	virtual ~ShaderParser();
+
+public:
+	// tokens must be what ShaderTokenizer made of text, and outlive the items.
+	void Parse(const std::wstring& text, const std::vector<ShaderTokenizer::Token>& tokens);
+
+	const std::vector<Item>& GetItems() const;
+	const NodePtr& GetRoot() const;
+
+	// ordered by position.
+	const std::vector<Error>& GetErrors() const;
+
+	// the nodes from the root down to the innermost one holding item, with
+	// the offsets made absolute. empty if item is out of the document.
+	void FindPath(size_t item, std::vector<Child>& path) const;
+
+	// the item at a text position, or the one ending there.
+	bool FindItem(size_t pos, size_t& item) const;
+
+	// of the last parse: nodes taken over and the items they hold.
+	size_t GetNumReusedNodes() const;
+	size_t GetNumReusedItems() const;
+
+	static const char* GetKindName(NodeKind kind);
+	static bool IsExpression(NodeKind kind);
+
+private:
+	typedef ShaderTokenizer::Token Token;
+	typedef boost::shared_ptr<Node> NodeBuilder;
+
+	// where a node is parsed, which decides the nodes that can be taken over.
+	enum ParseContext
+	{
+		PC_TopLevel,
+		PC_Statement,
+		PC_Member,
+	};
+
+	void CollectItems(const std::wstring& text, const std::vector<Token>& tokens);
+	void CollectReusable(const NodePtr& node, size_t first, size_t prefix, size_t suffix, size_t new_suffix);
+	void CollectErrors(const NodePtr& node, size_t first);
+
+	// the parse, with children at absolute offsets until MakeChild.
+	NodeBuilder NewNode(NodeKind kind) const;
+	Child MakeChild(size_t first, const NodeBuilder& node) const;
+	Child MakeError(size_t first, const std::string& message) const;
+	bool TakeReusable(ParseContext context, Child& child);
+
+	Child ParseTopLevel();
+	Child ParseDirective();
+	Child ParseAttribute();
+	Child ParseStruct();
+	Child ParseCBuffer();
+	void ParseMembers(const NodeBuilder& node);
+	Child ParseFunction(size_t first, const Child& type);
+	Child ParseParameter();
+	Child ParseDeclaration(size_t first, const Child& type);
+	Child ParseType();
+	Child ParseVariable();
+	Child ParseSemantic();
+	Child ParseStatement();
+	Child ParseBlock();
+	Child ParseIf();
+	Child ParseFor();
+	Child ParseWhile();
+	Child ParseDo();
+	Child ParseJump();
+	Child ParseCase();
+	Child ParseExpressionStatement();
+	Child ParseExpression();
+	Child ParseAssignment();
+	Child ParseConditional();
+	Child ParseBinary(int min_precedence);
+	Child ParseUnary();
+	Child ParsePostfix();
+	Child ParsePrimary();
+	Child ParseInitList();
+	void ParseCondition(const NodeBuilder& node);
+	void ParseArguments(const NodeBuilder& node);
+
+	// error recovery: a missing token, junk before a closing one, and
+	// a statement which can not be made sense of.
+	void Expect(const NodeBuilder& node, const wchar_t* word);
+	void SkipTo(const NodeBuilder& node, const wchar_t* close);
+	Child SkipStatement(bool in_block);
+
+	const std::wstring& Word(size_t idx) const;
+	bool IsName(size_t idx) const;
+	bool IsQualifier(size_t idx) const;
+	bool IsTypeName(size_t idx) const;
+	bool IsDeclarationStart(size_t idx) const;
+	size_t MatchOperator(size_t idx, std::wstring& op) const;
+
+private:
+	std::vector<Item> m_items;
+	std::vector<unsigned long long> m_item_keys;
+	NodePtr m_root;
+	std::vector<Error> m_errors;
+
+	// nodes of the last tree which can be taken over, by new item.
+	std::map<size_t, NodePtr> m_reusable;
+	size_t m_pos;
+
+	size_t m_num_reused_nodes;
+	size_t m_num_reused_items;
+};
+
+#endif  // _SHADER_PARSER_HPP_INCLUDED_
@@ -0,0 +1,577 @@
+#include "common.hpp"
+#include "shader_preprocessor.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+// the states of a conditional section.
+enum ConditionState
+{
+	CS_Waiting,			// no branch taken yet
+	CS_Active,
+	CS_Done,			// a branch was taken, or the outer section is inactive
+};
+
+static bool IsNameStart(wchar_t c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool IsNameChar(wchar_t c)
+{
+	return IsNameStart(c) || (c >= '0' && c <= '9');
+}
+
+static bool IsDigit(wchar_t c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static bool IsSpace(wchar_t c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static std::wstring Trim(const std::wstring& text)
+{
+	size_t begin = 0, end = text.length();
+	while (begin != end && IsSpace(text[begin])) ++begin;
+	while (end != begin && IsSpace(text[end - 1])) --end;
+	return text.substr(begin, end - begin);
+}
+
+static std::string Narrow(const std::wstring& text)
+{
+	return std::string(text.begin(), text.end());
+}
+
+// the end of the comment, string or number starting at pos, or pos.
+static size_t SkipOpaque(const std::wstring& text, size_t pos)
+{
+	size_t n = text.length();
+	wchar_t c = text[pos];
+	wchar_t next = pos + 1 < n ? text[pos + 1] : 0;
+	if (c == '/' && next == '/')
+	{
+		size_t end = text.find(L'\n', pos);
+		return end == std::wstring::npos ? n : end;
+	}
+	if (c == '/' && next == '*')
+	{
+		size_t end = text.find(L"*/", pos + 2);
+		return end == std::wstring::npos ? n : end + 2;
+	}
+	if (c == '"')
+	{
+		size_t end = pos + 1;
+		while (end < n && text[end] != '"' && text[end] != '\n') end += text[end] == '\\' ? 2 : 1;
+		return std::min(end + 1, n);
+	}
+	if (IsDigit(c) || (c == '.' && IsDigit(next)))
+	{
+		// exponents carry a sign, 1e-5 is one number.
+		size_t end = pos + 1;
+		while (end < n && (IsNameChar(text[end]) || text[end] == '.'
+			|| ((text[end] == '-' || text[end] == '+') && (text[end - 1] == 'e' || text[end - 1] == 'E')))) ++end;
+		return end;
+	}
+	return pos;
+}
+
+// a tiny evaluator for the expressions of #if, on integers.
+class ConditionEvaluator
+{
+public:
+	explicit ConditionEvaluator(const std::wstring& text) : m_text(text), m_pos(0), m_failed(false) {}
+
+	bool Evaluate(long long& value)
+	{
+		value = Binary(0);
+		Skip();
+		return !m_failed && m_pos == m_text.length();
+	}
+
+private:
+	void Skip()
+	{
+		while (m_pos < m_text.length() && IsSpace(m_text[m_pos])) ++m_pos;
+	}
+
+	bool Match(const wchar_t* op)
+	{
+		Skip();
+		size_t length = wcslen(op);
+		if (m_text.compare(m_pos, length, op) != 0) return false;
+
+		// '|' is not the start of '||', nor '<' of '<='.
+		wchar_t next = m_pos + 1 < m_text.length() ? m_text[m_pos + 1] : 0;
+		if (length == 1 && next == op[0] && wcschr(L"|&<>", op[0]) != NULL) return false;
+		if (length == 1 && next == '=' && wcschr(L"<>!=", op[0]) != NULL) return false;
+		m_pos += length;
+		return true;
+	}
+
+	long long Binary(int level)
+	{
+		static const wchar_t* levels[][4] =
+		{
+			{L"||"}, {L"&&"}, {L"|"}, {L"^"}, {L"&"}, {L"==", L"!="}, {L"<=", L">=", L"<", L">"},
+			{L"<<", L">>"}, {L"+", L"-"}, {L"*", L"/", L"%"},
+		};
+		if (level == ARRAYSIZE(levels)) return Unary();
+
+		long long value = Binary(level + 1);
+		for (;;)
+		{
+			const wchar_t* op = NULL;
+			for (size_t i = 0; i != 4 && levels[level][i] != NULL && op == NULL; ++i)
+			{
+				if (Match(levels[level][i])) op = levels[level][i];
+			}
+			if (op == NULL) return value;
+
+			long long rhs = Binary(level + 1);
+			std::wstring o = op;
+			if (o == L"||") value = value || rhs;
+			else if (o == L"&&") value = value && rhs;
+			else if (o == L"|") value |= rhs;
+			else if (o == L"^") value ^= rhs;
+			else if (o == L"&") value &= rhs;
+			else if (o == L"==") value = value == rhs;
+			else if (o == L"!=") value = value != rhs;
+			else if (o == L"<=") value = value <= rhs;
+			else if (o == L">=") value = value >= rhs;
+			else if (o == L"<") value = value < rhs;
+			else if (o == L">") value = value > rhs;
+			else if (o == L"<<") value <<= rhs;
+			else if (o == L">>") value >>= rhs;
+			else if (o == L"+") value += rhs;
+			else if (o == L"-") value -= rhs;
+			else if (o == L"*") value *= rhs;
+			else if (rhs == 0) m_failed = true;
+			else if (o == L"/") value /= rhs;
+			else value %= rhs;
+		}
+	}
+
+	long long Unary()
+	{
+		if (Match(L"!")) return !Unary();
+		if (Match(L"-")) return -Unary();
+		if (Match(L"+")) return Unary();
+		if (Match(L"~")) return ~Unary();
+		if (Match(L"("))
+		{
+			long long value = Binary(0);
+			if (!Match(L")")) m_failed = true;
+			return value;
+		}
+
+		Skip();
+		size_t begin = m_pos;
+		if (m_pos < m_text.length() && IsDigit(m_text[m_pos]))
+		{
+			while (m_pos < m_text.length() && IsNameChar(m_text[m_pos])) ++m_pos;
+			std::string number = Narrow(m_text.substr(begin, m_pos - begin));
+			return strtoll(number.c_str(), NULL, 0);
+		}
+
+		// names left after the expansion are not macros.
+		while (m_pos < m_text.length() && IsNameChar(m_text[m_pos])) ++m_pos;
+		if (m_pos == begin) m_failed = true;
+		return 0;
+	}
+
+private:
+	const std::wstring& m_text;
+	size_t m_pos;
+	bool m_failed;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderPreprocessor::ShaderPreprocessor()
+{
+
+}
+
+ShaderPreprocessor::~ShaderPreprocessor()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderPreprocessor::Define(const std::wstring& name, const std::wstring& value)
+{
+	Macro macro;
+	macro.is_function = false;
+	macro.body = value;
+	m_predefined[name] = macro;
+}
+
+bool ShaderPreprocessor::Preprocess(const std::wstring& text)
+{
+	m_macros = m_predefined;
+	m_text.clear();
+	m_text.reserve(text.length());
+	m_errors.clear();
+
+	std::vector<int> conditions;
+	std::wstring pending;
+	size_t pending_line = 0;
+	size_t line_idx = 0;
+	for (size_t pos = 0; pos < text.length(); )
+	{
+		// a directive goes on past escaped line breaks.
+		size_t end = text.find(L'\n', pos);
+		size_t num_lines = 1;
+		while (end != std::wstring::npos && end != pos && text[end - 1] == '\\')
+		{
+			end = text.find(L'\n', end + 1);
+			++num_lines;
+		}
+		if (end == std::wstring::npos) end = text.length();
+		std::wstring line = text.substr(pos, end - pos);
+		bool has_newline = end != text.length();
+		pos = end + 1;
+
+		bool active = std::find_if(conditions.begin(), conditions.end(), [](int state) { return state != CS_Active; }) == conditions.end();
+		std::wstring trimmed = Trim(line);
+		if (!trimmed.empty() && trimmed[0] == '#')
+		{
+			Flush(pending, pending_line);
+			std::wstring directive = trimmed.substr(1);
+			for (size_t i = 0; (i = directive.find(L"\\\n", i)) != std::wstring::npos; ) directive.replace(i, 2, L" ");
+
+			// only the nesting counts in an inactive section.
+			std::wstring word = Trim(directive);
+			word = word.substr(0, std::find_if(word.begin(), word.end(), [](wchar_t c) { return !IsNameChar(c); }) - word.begin());
+			if (active) Directive(directive, line_idx, conditions);
+			else if (word == L"if" || word == L"ifdef" || word == L"ifndef") conditions.push_back(CS_Done);
+			else if (word == L"elif" || word == L"else" || word == L"endif") Directive(directive, line_idx, conditions);
+			m_text.append(num_lines - (has_newline ? 0 : 1), L'\n');
+		}
+		else
+		{
+			if (pending.empty()) pending_line = line_idx;
+			if (active) pending += line;
+			else pending.append(num_lines - 1, L'\n');
+			if (has_newline) pending += L'\n';
+		}
+		line_idx += num_lines;
+	}
+	Flush(pending, pending_line);
+
+	if (!conditions.empty())
+	{
+		Error error = {line_idx, "unterminated conditional directive"};
+		m_errors.push_back(error);
+	}
+	return m_errors.empty();
+}
+
+const std::wstring& ShaderPreprocessor::GetText() const
+{
+	return m_text;
+}
+
+const std::vector<ShaderPreprocessor::Error>& ShaderPreprocessor::GetErrors() const
+{
+	return m_errors;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderPreprocessor::Directive(const std::wstring& line, size_t line_idx, std::vector<int>& conditions)
+{
+	std::wstring text = Trim(line);
+	size_t word_end = 0;
+	while (word_end < text.length() && IsNameChar(text[word_end])) ++word_end;
+	std::wstring word = text.substr(0, word_end);
+	std::wstring rest = Trim(text.substr(word_end));
+
+	if (word == L"define") DefineMacro(rest, line_idx);
+	else if (word == L"undef") m_macros.erase(rest);
+	else if (word == L"ifdef" || word == L"ifndef")
+	{
+		bool defined = m_macros.find(rest) != m_macros.end();
+		conditions.push_back(defined == (word == L"ifdef") ? CS_Active : CS_Waiting);
+	}
+	else if (word == L"if") conditions.push_back(Evaluate(rest, line_idx) ? CS_Active : CS_Waiting);
+	else if (word == L"elif" || word == L"else" || word == L"endif")
+	{
+		if (conditions.empty())
+		{
+			Error error = {line_idx, "#" + Narrow(word) + " without #if"};
+			m_errors.push_back(error);
+			return;
+		}
+
+		int& state = conditions.back();
+		if (word == L"endif") conditions.pop_back();
+		else if (state != CS_Waiting) state = CS_Done;
+		else if (word == L"else") state = CS_Active;
+		else if (Evaluate(rest, line_idx)) state = CS_Active;
+	}
+	else if (word == L"error")
+	{
+		Error error = {line_idx, "#error " + Narrow(rest)};
+		m_errors.push_back(error);
+	}
+	else if (word != L"include" && word != L"pragma" && word != L"line" && !word.empty())
+	{
+		Error error = {line_idx, "unknown directive #" + Narrow(word)};
+		m_errors.push_back(error);
+	}
+}
+
+void ShaderPreprocessor::DefineMacro(const std::wstring& rest, size_t line_idx)
+{
+	size_t name_end = 0;
+	while (name_end < rest.length() && IsNameChar(rest[name_end])) ++name_end;
+	if (name_end == 0 || !IsNameStart(rest[0]))
+	{
+		Error error = {line_idx, "expected a macro name"};
+		m_errors.push_back(error);
+		return;
+	}
+
+	Macro macro;
+	macro.is_function = name_end < rest.length() && rest[name_end] == '(';
+	size_t body_begin = name_end;
+	if (macro.is_function)
+	{
+		size_t close = rest.find(L')', name_end);
+		if (close == std::wstring::npos)
+		{
+			Error error = {line_idx, "expected ')' in macro parameter list"};
+			m_errors.push_back(error);
+			return;
+		}
+
+		std::wstring params = rest.substr(name_end + 1, close - name_end - 1);
+		for (size_t begin = 0; begin <= params.length(); )
+		{
+			size_t comma = params.find(L',', begin);
+			if (comma == std::wstring::npos) comma = params.length();
+			std::wstring param = Trim(params.substr(begin, comma - begin));
+			if (!param.empty()) macro.params.push_back(param);
+			begin = comma + 1;
+		}
+		body_begin = close + 1;
+	}
+
+	// comments are no part of the body.
+	std::wstring body;
+	std::wstring source = rest.substr(body_begin);
+	for (size_t i = 0; i < source.length(); )
+	{
+		size_t end = SkipOpaque(source, i);
+		if (end != i && source[i] == '/')
+		{
+			body += L' ';
+			i = end;
+		}
+		else if (end != i)
+		{
+			body += source.substr(i, end - i);
+			i = end;
+		}
+		else body += source[i++];
+	}
+	macro.body = Trim(body);
+	m_macros[rest.substr(0, name_end)] = macro;
+}
+
+bool ShaderPreprocessor::Evaluate(const std::wstring& expression, size_t line_idx)
+{
+	// defined(NAME) and defined NAME are decided before the expansion.
+	std::wstring text;
+	for (size_t i = 0; i < expression.length(); )
+	{
+		if (expression.compare(i, 7, L"defined") == 0 && (i == 0 || !IsNameChar(expression[i - 1]))
+			&& (i + 7 == expression.length() || !IsNameChar(expression[i + 7])))
+		{
+			size_t pos = i + 7;
+			while (pos < expression.length() && IsSpace(expression[pos])) ++pos;
+			bool in_brackets = pos < expression.length() && expression[pos] == '(';
+			if (in_brackets) ++pos;
+			while (pos < expression.length() && IsSpace(expression[pos])) ++pos;
+			size_t name_begin = pos;
+			while (pos < expression.length() && IsNameChar(expression[pos])) ++pos;
+			std::wstring name = expression.substr(name_begin, pos - name_begin);
+			while (pos < expression.length() && IsSpace(expression[pos])) ++pos;
+			if (in_brackets && pos < expression.length() && expression[pos] == ')') ++pos;
+
+			text += m_macros.find(name) != m_macros.end() ? L" 1 " : L" 0 ";
+			i = pos;
+		}
+		else text += expression[i++];
+	}
+
+	std::set<std::wstring> disabled;
+	std::wstring expanded = Expand(text, disabled, line_idx);
+	long long value = 0;
+	if (!ConditionEvaluator(expanded).Evaluate(value))
+	{
+		Error error = {line_idx, "invalid #if expression"};
+		m_errors.push_back(error);
+		return false;
+	}
+	return value != 0;
+}
+
+void ShaderPreprocessor::Flush(std::wstring& pending, size_t line_idx)
+{
+	if (pending.empty()) return;
+
+	std::set<std::wstring> disabled;
+	m_text += Expand(pending, disabled, line_idx);
+	pending.clear();
+}
+
+std::wstring ShaderPreprocessor::Expand(const std::wstring& text, std::set<std::wstring>& disabled, size_t line_idx)
+{
+	std::wstring result;
+	result.reserve(text.length());
+	size_t n = text.length();
+	for (size_t i = 0; i < n; )
+	{
+		size_t opaque_end = SkipOpaque(text, i);
+		if (opaque_end != i)
+		{
+			result.append(text, i, opaque_end - i);
+			i = opaque_end;
+			continue;
+		}
+		if (!IsNameStart(text[i]))
+		{
+			result += text[i++];
+			continue;
+		}
+
+		size_t name_end = i;
+		while (name_end < n && IsNameChar(text[name_end])) ++name_end;
+		std::wstring name = text.substr(i, name_end - i);
+		auto it = m_macros.find(name);
+		if (it == m_macros.end() || disabled.count(name) != 0)
+		{
+			result += name;
+			i = name_end;
+			continue;
+		}
+
+		const Macro& macro = it->second;
+		std::wstring body = macro.body;
+		size_t end = name_end;
+		if (macro.is_function)
+		{
+			// a function like macro without arguments is a plain name.
+			size_t open = name_end;
+			while (open < n && IsSpace(text[open])) ++open;
+			if (open == n || text[open] != '(')
+			{
+				result += name;
+				i = name_end;
+				continue;
+			}
+
+			end = open;
+			std::vector<std::wstring> args;
+			if (!CollectArguments(text, end, args))
+			{
+				Error error = {line_idx + std::count(text.begin(), text.begin() + i, L'\n'), "unterminated call of macro " + Narrow(name)};
+				m_errors.push_back(error);
+				result += text.substr(i);
+				break;
+			}
+			if (args.size() != macro.params.size())
+			{
+				Error error = {line_idx + std::count(text.begin(), text.begin() + i, L'\n'), "wrong number of arguments to macro " + Narrow(name)};
+				m_errors.push_back(error);
+			}
+
+			// arguments are expanded before they are put in.
+			for (size_t j = 0; j != args.size(); ++j) args[j] = Expand(args[j], disabled, line_idx);
+			body = Substitute(macro, args);
+		}
+
+		disabled.insert(name);
+		std::wstring expansion = Expand(body, disabled, line_idx);
+		disabled.erase(name);
+
+		// the line breaks of the call go after the expansion.
+		std::replace(expansion.begin(), expansion.end(), L'\n', L' ');
+		result += expansion;
+		result.append(std::count(text.begin() + i, text.begin() + end, L'\n'), L'\n');
+		i = end;
+	}
+	return result;
+}
+
+bool ShaderPreprocessor::CollectArguments(const std::wstring& text, size_t& pos, std::vector<std::wstring>& args) const
+{
+	// pos is at the '(', it ends past the ')'.
+	size_t level = 0;
+	size_t arg_begin = pos + 1;
+	for (size_t i = pos; i < text.length(); )
+	{
+		size_t opaque_end = SkipOpaque(text, i);
+		if (opaque_end != i)
+		{
+			i = opaque_end;
+			continue;
+		}
+
+		wchar_t c = text[i];
+		if (c == '(') ++level;
+		else if (c == ')' && --level == 0)
+		{
+			std::wstring arg = Trim(text.substr(arg_begin, i - arg_begin));
+			if (!arg.empty() || !args.empty()) args.push_back(arg);
+			pos = i + 1;
+			return true;
+		}
+		else if (c == ',' && level == 1)
+		{
+			args.push_back(Trim(text.substr(arg_begin, i - arg_begin)));
+			arg_begin = i + 1;
+		}
+		++i;
+	}
+	return false;
+}
+
+std::wstring ShaderPreprocessor::Substitute(const Macro& macro, const std::vector<std::wstring>& args) const
+{
+	std::wstring result;
+	const std::wstring& body = macro.body;
+	for (size_t i = 0; i < body.length(); )
+	{
+		size_t opaque_end = SkipOpaque(body, i);
+		if (opaque_end != i)
+		{
+			result.append(body, i, opaque_end - i);
+			i = opaque_end;
+			continue;
+		}
+		if (!IsNameStart(body[i]))
+		{
+			result += body[i++];
+			continue;
+		}
+
+		size_t name_end = i;
+		while (name_end < body.length() && IsNameChar(body[name_end])) ++name_end;
+		std::wstring name = body.substr(i, name_end - i);
+		auto param = std::find(macro.params.begin(), macro.params.end(), name);
+		size_t idx = param - macro.params.begin();
+		result += param != macro.params.end() && idx < args.size() ? args[idx] : name;
+		i = name_end;
+	}
+	return result;
+}
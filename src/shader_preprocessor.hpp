@@ -0,0 +1,60 @@
+#ifndef _SHADER_PREPROCESSOR_HPP_INCLUDED_
+#define _SHADER_PREPROCESSOR_HPP_INCLUDED_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// expands the #define macros of a shader, object and function like, and
+// drops the sections #if, #ifdef and friends leave out. directive lines
+// and dropped lines are left empty, and a macro call over several lines
+// keeps its line breaks after the expansion, so every line keeps its
+// number. #include is left to ShaderIncludeGraph, # and ## are not done.
+class ShaderPreprocessor
+{
+public:
+	struct Error
+	{
+		size_t line;			// 0-based
+		std::string message;
+	};
+
+public:
+	ShaderPreprocessor();
+	virtual ~ShaderPreprocessor();
+
+public:
+	// defined before every text, like a /D of the compiler.
+	void Define(const std::wstring& name, const std::wstring& value);
+
+	bool Preprocess(const std::wstring& text);
+
+	const std::wstring& GetText() const;
+	const std::vector<Error>& GetErrors() const;
+
+private:
+	struct Macro
+	{
+		bool is_function;
+		std::vector<std::wstring> params;
+		std::wstring body;
+	};
+
+	void Directive(const std::wstring& line, size_t line_idx, std::vector<int>& conditions);
+	void DefineMacro(const std::wstring& rest, size_t line_idx);
+	bool Evaluate(const std::wstring& expression, size_t line_idx);
+	void Flush(std::wstring& pending, size_t line_idx);
+
+	std::wstring Expand(const std::wstring& text, std::set<std::wstring>& disabled, size_t line_idx);
+	bool CollectArguments(const std::wstring& text, size_t& pos, std::vector<std::wstring>& args) const;
+	std::wstring Substitute(const Macro& macro, const std::vector<std::wstring>& args) const;
+
+private:
+	std::map<std::wstring, Macro> m_predefined;
+	std::map<std::wstring, Macro> m_macros;
+	std::wstring m_text;
+	std::vector<Error> m_errors;
+};
+
+#endif  // _SHADER_PREPROCESSOR_HPP_INCLUDED_
@@ -0,0 +1,79 @@
+#include "common.hpp"
+#include "shader_source_map.hpp"
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////////
+// constructor
+//////////////////////////////////////////////////////////////////////////
+ShaderSourceMap::ShaderSourceMap()
+	: m_num_lines(0)
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderSourceMap::AddSegment(const std::string& source, size_t num_lines, size_t source_line /*= 1*/)
+{
+	if (num_lines == 0) return;
+
+	Segment segment;
+	segment.source = source;
+	segment.first_line = m_num_lines + 1;
+	segment.num_lines = num_lines;
+	segment.source_line = source_line;
+	m_segments.push_back(segment);
+
+	m_num_lines += num_lines;
+}
+
+void ShaderSourceMap::Clear()
+{
+	m_segments.clear();
+	m_num_lines = 0;
+}
+
+bool ShaderSourceMap::Resolve(size_t line, Location& location) const
+{
+	if (line == 0 || line > m_num_lines) return false;
+
+	// segments are sorted by first line, find the last one starting at or before line.
+	size_t lo = 0, hi = m_segments.size();
+	while (hi - lo > 1)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (m_segments[mid].first_line <= line) lo = mid;
+		else hi = mid;
+	}
+
+	const Segment& segment = m_segments[lo];
+	location.source = segment.source;
+	location.line = segment.source_line + (line - segment.first_line);
+	return true;
+}
+
+size_t ShaderSourceMap::GetNumLines() const
+{
+	return m_num_lines;
+}
+
+size_t ShaderSourceMap::GetNumSegments() const
+{
+	return m_segments.size();
+}
+
+const ShaderSourceMap::Segment& ShaderSourceMap::GetSegment(size_t idx) const
+{
+	return m_segments[idx];
+}
+
+size_t ShaderSourceMap::CountLines(const std::string& text)
+{
+	if (text.empty()) return 0;
+
+	size_t num_lines = std::count(text.begin(), text.end(), '\n');
+	if (text[text.length() - 1] != '\n') ++num_lines;
+	return num_lines;
+}
@@ -0,0 +1,53 @@
+#ifndef _SHADER_SOURCE_MAP_HPP_INCLUDED_
+#define _SHADER_SOURCE_MAP_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+class ShaderSourceMap;
+typedef boost::shared_ptr<ShaderSourceMap> ShaderSourceMapPtr;
+
+// describes how the text handed to the compiler was assembled from its
+// sources, so a line of the compile input can be traced back to the file
+// and line it came from. lines are 1-based, as fxc reports them.
+class ShaderSourceMap
+{
+public:
+	struct Segment
+	{
+		std::string source;		// file name, or any name the caller picks
+		size_t first_line;		// first line of the segment in the compile input
+		size_t num_lines;
+		size_t source_line;		// line in the source the segment starts at
+	};
+
+	struct Location
+	{
+		std::string source;
+		size_t line;
+	};
+
+public:
+	ShaderSourceMap();
+
+public:
+	// appends num_lines lines of source right after the previous segment.
+	void AddSegment(const std::string& source, size_t num_lines, size_t source_line = 1);
+	void Clear();
+
+	bool Resolve(size_t line, Location& location) const;
+
+	size_t GetNumLines() const;
+	size_t GetNumSegments() const;
+	const Segment& GetSegment(size_t idx) const;
+
+	// counts lines the way the compiler does, a trailing partial line included.
+	static size_t CountLines(const std::string& text);
+
+private:
+	std::vector<Segment> m_segments;
+	size_t m_num_lines;
+};
+
+#endif  // _SHADER_SOURCE_MAP_HPP_INCLUDED_
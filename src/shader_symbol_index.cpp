@@ -0,0 +1,418 @@
+#include "common.hpp"
+#include "shader_symbol_index.hpp"
+
+#include <algorithm>
+
+typedef ShaderParser::Node Node;
+typedef ShaderParser::Child Child;
+
+static bool IsNameToken(const ShaderParser::Item& item)
+{
+	ShaderTokenizer::TokenType type = item.token->type;
+	return type == ShaderTokenizer::TT_Word || type == ShaderTokenizer::TT_Function;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderSymbolIndex::ShaderSymbolIndex()
+	: m_num_analyzed(0)
+{
+
+}
+
+ShaderSymbolIndex::~ShaderSymbolIndex()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderSymbolIndex::Update(const ShaderParser& parser)
+{
+	m_num_analyzed = 0;
+	const std::vector<ShaderParser::Item>& items = parser.GetItems();
+	const std::vector<Child>& children = parser.GetRoot()->children;
+
+	// declarations the parser took over keep their analysis, they only moved.
+	DeclarationCache cache;
+	m_declarations.clear();
+	for (size_t i = 0; i != children.size(); ++i)
+	{
+		const Child& child = children[i];
+		DeclarationPtr declaration;
+		auto it = m_cache.find(child.node.get());
+		if (it != m_cache.end())
+		{
+			declaration = it->second;
+			m_cache.erase(it);
+		}
+		else
+		{
+			declaration.reset(new Declaration);
+			declaration->node = child.node;
+
+			Analysis analysis;
+			analysis.items = &items[child.offset];
+			analysis.declaration = declaration.get();
+			analysis.variables = SK_Global;
+			Analyze(analysis, *child.node, 0);
+
+			std::stable_sort(declaration->occurrences.begin(), declaration->occurrences.end(),
+				[](const Occurrence& a, const Occurrence& b) { return a.offset < b.offset; });
+			Register(declaration);
+			++m_num_analyzed;
+		}
+
+		declaration->first_item = child.offset;
+		cache[child.node.get()] = declaration;
+		m_declarations.push_back(declaration);
+	}
+
+	// what is left was edited or removed.
+	for (auto it = m_cache.begin(); it != m_cache.end(); ++it)
+	{
+		Unregister(it->second);
+	}
+	m_cache.swap(cache);
+}
+
+bool ShaderSymbolIndex::FindDefinitions(size_t item, std::vector<Symbol>& definitions) const
+{
+	definitions.clear();
+	const Declaration* declaration = FindDeclaration(item);
+	if (declaration == NULL) return false;
+	const Occurrence* occurrence = FindOccurrence(*declaration, item);
+	if (occurrence == NULL) return false;
+
+	if (occurrence->definition != no_definition)
+	{
+		const Definition& definition = declaration->definitions[occurrence->definition];
+		if (!definition.is_global)
+		{
+			definitions.push_back(MakeSymbol(*declaration, definition));
+			return true;
+		}
+	}
+
+	auto range = m_definitions.equal_range(occurrence->name);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const Declaration* owner = it->second.first;
+		definitions.push_back(MakeSymbol(*owner, owner->definitions[it->second.second]));
+	}
+	std::sort(definitions.begin(), definitions.end(), [](const Symbol& a, const Symbol& b) { return a.item < b.item; });
+	return !definitions.empty();
+}
+
+bool ShaderSymbolIndex::FindReferences(size_t item, std::vector<size_t>& references) const
+{
+	references.clear();
+	const Declaration* declaration = FindDeclaration(item);
+	if (declaration == NULL) return false;
+	const Occurrence* occurrence = FindOccurrence(*declaration, item);
+	if (occurrence == NULL) return false;
+
+	if (occurrence->definition != no_definition)
+	{
+		const Definition& definition = declaration->definitions[occurrence->definition];
+		if (!definition.is_global)
+		{
+			references.push_back(declaration->first_item + definition.offset);
+			for (size_t i = 0; i != definition.uses.size(); ++i)
+			{
+				references.push_back(declaration->first_item + definition.uses[i]);
+			}
+			std::sort(references.begin(), references.end());
+			return true;
+		}
+	}
+
+	// a global name, intrinsics and other undefined ones included.
+	auto range = m_definitions.equal_range(occurrence->name);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const Declaration* owner = it->second.first;
+		references.push_back(owner->first_item + owner->definitions[it->second.second].offset);
+	}
+
+	auto users = m_users.find(occurrence->name);
+	if (users != m_users.end())
+	{
+		for (auto it = users->second.begin(); it != users->second.end(); ++it)
+		{
+			const Declaration* user = *it;
+			const std::vector<size_t>& uses = user->global_uses.find(occurrence->name)->second;
+			for (size_t i = 0; i != uses.size(); ++i)
+			{
+				references.push_back(user->first_item + uses[i]);
+			}
+		}
+	}
+	std::sort(references.begin(), references.end());
+	return true;
+}
+
+void ShaderSymbolIndex::GetVisibleSymbols(size_t item, std::vector<Symbol>& symbols) const
+{
+	symbols.clear();
+	for (auto it = m_definitions.begin(); it != m_definitions.end(); ++it)
+	{
+		const Declaration* owner = it->second.first;
+		symbols.push_back(MakeSymbol(*owner, owner->definitions[it->second.second]));
+	}
+
+	const Declaration* declaration = FindDeclaration(item);
+	if (declaration == NULL) return;
+
+	size_t offset = item - declaration->first_item;
+	for (size_t i = 0; i != declaration->definitions.size(); ++i)
+	{
+		const Definition& definition = declaration->definitions[i];
+		if (definition.is_global || definition.offset >= offset || definition.scope_end <= offset) continue;
+		symbols.push_back(MakeSymbol(*declaration, definition));
+	}
+}
+
+size_t ShaderSymbolIndex::GetNumAnalyzedDeclarations() const
+{
+	return m_num_analyzed;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderSymbolIndex::Analyze(Analysis& analysis, const Node& node, size_t offset) const
+{
+	switch (node.kind)
+	{
+	case ShaderParser::NK_Directive:
+		AnalyzeDirective(analysis, node, offset);
+		break;
+
+	case ShaderParser::NK_Function:
+		if (!node.text.empty()) Define(analysis, node.text, SK_Function, offset + node.token);
+		AnalyzeScope(analysis, node, offset, SK_Parameter);
+		break;
+
+	case ShaderParser::NK_Struct:
+		if (!node.text.empty()) Define(analysis, node.text, SK_Struct, offset + node.token);
+		AnalyzeScope(analysis, node, offset, SK_Field);
+		break;
+
+	case ShaderParser::NK_CBuffer:
+	{
+		// the fields of a cbuffer are globals.
+		SymbolKind variables = analysis.variables;
+		analysis.variables = SK_Field;
+		AnalyzeChildren(analysis, node, offset);
+		analysis.variables = variables;
+		break;
+	}
+
+	case ShaderParser::NK_Block:
+	case ShaderParser::NK_For:
+		AnalyzeScope(analysis, node, offset, SK_Local);
+		break;
+
+	case ShaderParser::NK_Variable:
+		// the initializer can not see the variable yet.
+		AnalyzeChildren(analysis, node, offset);
+		if (!node.text.empty()) Define(analysis, node.text, analysis.variables, offset + node.token);
+		break;
+
+	case ShaderParser::NK_Type:
+		if (!node.text.empty() && analysis.items[offset + node.token].token->type == ShaderTokenizer::TT_Word)
+		{
+			Use(analysis, node.text, offset + node.token);
+		}
+		break;
+
+	case ShaderParser::NK_Identifier:
+	case ShaderParser::NK_Call:
+		Use(analysis, node.text, offset + node.token);
+		AnalyzeChildren(analysis, node, offset);
+		break;
+
+	case ShaderParser::NK_Semantic:
+	case ShaderParser::NK_Error:
+		break;
+
+	default:
+		AnalyzeChildren(analysis, node, offset);
+		break;
+	}
+}
+
+void ShaderSymbolIndex::AnalyzeDirective(Analysis& analysis, const Node& node, size_t offset) const
+{
+	const ShaderParser::Item* items = analysis.items + offset;
+	size_t end = node.num_items;
+	if (node.text == L"include") return;
+
+	size_t pos = node.token + 1;
+	if (node.text != L"define")
+	{
+		// #ifdef NAME, #if defined(NAME) and the like.
+		for (; pos < end; ++pos)
+		{
+			if (IsNameToken(items[pos])) Use(analysis, items[pos].token->word, offset + pos);
+		}
+		return;
+	}
+	if (pos >= end || !IsNameToken(items[pos])) return;
+	Define(analysis, items[pos].token->word, SK_Macro, offset + pos);
+	++pos;
+
+	// the parameters of a function like macro are seen by its body only.
+	Scope scope;
+	scope.end = offset + end;
+	analysis.scopes.push_back(scope);
+	if (pos < end && items[pos].token->word == L"(" && items[pos].token->start_pos == items[pos - 1].token->end_pos)
+	{
+		for (++pos; pos < end && items[pos].token->word != L")"; ++pos)
+		{
+			if (IsNameToken(items[pos])) Define(analysis, items[pos].token->word, SK_Parameter, offset + pos);
+		}
+		++pos;
+	}
+
+	for (; pos < end; ++pos)
+	{
+		if (IsNameToken(items[pos])) Use(analysis, items[pos].token->word, offset + pos);
+	}
+	analysis.scopes.pop_back();
+}
+
+void ShaderSymbolIndex::AnalyzeChildren(Analysis& analysis, const Node& node, size_t offset) const
+{
+	for (size_t i = 0; i != node.children.size(); ++i)
+	{
+		const Child& child = node.children[i];
+		Analyze(analysis, *child.node, offset + child.offset);
+	}
+}
+
+void ShaderSymbolIndex::AnalyzeScope(Analysis& analysis, const Node& node, size_t offset, SymbolKind variables) const
+{
+	Scope scope;
+	scope.end = offset + node.num_items;
+	analysis.scopes.push_back(scope);
+	SymbolKind outer_variables = analysis.variables;
+	analysis.variables = variables;
+
+	AnalyzeChildren(analysis, node, offset);
+
+	analysis.variables = outer_variables;
+	analysis.scopes.pop_back();
+}
+
+void ShaderSymbolIndex::Define(Analysis& analysis, const std::wstring& name, SymbolKind kind, size_t offset) const
+{
+	// macros are not scoped, wherever they are defined.
+	Definition definition;
+	definition.name = name;
+	definition.kind = kind;
+	definition.is_global = kind == SK_Macro || analysis.scopes.empty();
+	definition.offset = offset;
+	definition.scope_end = definition.is_global ? 0 : analysis.scopes.back().end;
+
+	Declaration* declaration = analysis.declaration;
+	size_t idx = declaration->definitions.size();
+	declaration->definitions.push_back(definition);
+	if (!definition.is_global) analysis.scopes.back().names.push_back(std::make_pair(name, idx));
+
+	Occurrence occurrence = {offset, name, idx};
+	declaration->occurrences.push_back(occurrence);
+}
+
+void ShaderSymbolIndex::Use(Analysis& analysis, const std::wstring& name, size_t offset) const
+{
+	// the innermost, latest definition hides the others.
+	Declaration* declaration = analysis.declaration;
+	size_t idx = no_definition;
+	for (size_t i = analysis.scopes.size(); i != 0 && idx == no_definition; --i)
+	{
+		const Scope& scope = analysis.scopes[i - 1];
+		for (size_t j = scope.names.size(); j != 0; --j)
+		{
+			if (scope.names[j - 1].first != name) continue;
+			idx = scope.names[j - 1].second;
+			break;
+		}
+	}
+
+	if (idx != no_definition) declaration->definitions[idx].uses.push_back(offset);
+	else declaration->global_uses[name].push_back(offset);
+
+	Occurrence occurrence = {offset, name, idx};
+	declaration->occurrences.push_back(occurrence);
+}
+
+void ShaderSymbolIndex::Register(const DeclarationPtr& declaration)
+{
+	for (size_t i = 0; i != declaration->definitions.size(); ++i)
+	{
+		const Definition& definition = declaration->definitions[i];
+		if (definition.is_global) m_definitions.insert(std::make_pair(definition.name, std::make_pair(declaration.get(), i)));
+	}
+
+	for (auto it = declaration->global_uses.begin(); it != declaration->global_uses.end(); ++it)
+	{
+		m_users[it->first].insert(declaration.get());
+	}
+}
+
+void ShaderSymbolIndex::Unregister(const DeclarationPtr& declaration)
+{
+	for (size_t i = 0; i != declaration->definitions.size(); ++i)
+	{
+		const Definition& definition = declaration->definitions[i];
+		if (!definition.is_global) continue;
+
+		auto range = m_definitions.equal_range(definition.name);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second.first != declaration.get()) continue;
+			m_definitions.erase(it);
+			break;
+		}
+	}
+
+	for (auto it = declaration->global_uses.begin(); it != declaration->global_uses.end(); ++it)
+	{
+		auto users = m_users.find(it->first);
+		users->second.erase(declaration.get());
+		if (users->second.empty()) m_users.erase(users);
+	}
+}
+
+const ShaderSymbolIndex::Declaration* ShaderSymbolIndex::FindDeclaration(size_t item) const
+{
+	auto it = std::upper_bound(m_declarations.begin(), m_declarations.end(), item,
+		[](size_t item, const DeclarationPtr& declaration) { return item < declaration->first_item; });
+	if (it == m_declarations.begin()) return NULL;
+
+	const Declaration* declaration = (--it)->get();
+	if (item >= declaration->first_item + declaration->node->num_items) return NULL;
+	return declaration;
+}
+
+const ShaderSymbolIndex::Occurrence* ShaderSymbolIndex::FindOccurrence(const Declaration& declaration, size_t item) const
+{
+	size_t offset = item - declaration.first_item;
+	auto it = std::lower_bound(declaration.occurrences.begin(), declaration.occurrences.end(), offset,
+		[](const Occurrence& occurrence, size_t offset) { return occurrence.offset < offset; });
+	if (it == declaration.occurrences.end() || it->offset != offset) return NULL;
+	return &*it;
+}
+
+ShaderSymbolIndex::Symbol ShaderSymbolIndex::MakeSymbol(const Declaration& declaration, const Definition& definition) const
+{
+	Symbol symbol;
+	symbol.name = definition.name;
+	symbol.kind = definition.kind;
+	symbol.item = declaration.first_item + definition.offset;
+	return symbol;
+}
@@ -0,0 +1,134 @@
+#ifndef _SHADER_SYMBOL_INDEX_HPP_INCLUDED_
+#define _SHADER_SYMBOL_INDEX_HPP_INCLUDED_
+
+#include <map>
+#include <set>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "shader_parser.hpp"
+
+// where the symbols of a document are defined and used: functions, structs,
+// globals and cbuffer fields, macros, and the parameters and locals of
+// functions, bound by scope. each top level declaration is analyzed once
+// and kept while the parser takes its node over, so an edit only costs the
+// declaration it touched. lookups are binary searches and map finds.
+class ShaderSymbolIndex
+{
+public:
+	enum SymbolKind
+	{
+		SK_Macro,
+		SK_Function,
+		SK_Struct,
+		SK_Field,			// of a cbuffer or struct
+		SK_Global,
+		SK_Parameter,
+		SK_Local,
+	};
+
+	struct Symbol
+	{
+		std::wstring name;
+		SymbolKind kind;
+		size_t item;		// of the name, in the parser's items
+	};
+
+public:
+	ShaderSymbolIndex();
+	virtual ~ShaderSymbolIndex();
+
+public:
+	// parser must have parsed the text just now.
+	void Update(const ShaderParser& parser);
+
+	// the definitions of the name at item, more than one for overloads.
+	// false if it is no name, or one the document does not define.
+	bool FindDefinitions(size_t item, std::vector<Symbol>& definitions) const;
+
+	// the items of every use of the symbol named at item, its definitions
+	// included, by position.
+	bool FindReferences(size_t item, std::vector<size_t>& references) const;
+
+	// the symbols visible from item: the globals, and the parameters and
+	// locals declared before it in its scopes.
+	void GetVisibleSymbols(size_t item, std::vector<Symbol>& symbols) const;
+
+	// of the last update: the declarations analyzed anew.
+	size_t GetNumAnalyzedDeclarations() const;
+
+private:
+	static const size_t no_definition = static_cast<size_t>(-1);
+
+	struct Definition
+	{
+		std::wstring name;
+		SymbolKind kind;
+		bool is_global;
+		size_t offset;					// from the declaration begin
+		size_t scope_end;				// not global ones
+		std::vector<size_t> uses;		// not global ones
+	};
+
+	// a definition or use of a name.
+	struct Occurrence
+	{
+		size_t offset;
+		std::wstring name;
+		size_t definition;				// the one bound to, or no_definition
+	};
+
+	struct Declaration
+	{
+		ShaderParser::NodePtr node;		// holds the node the cache is keyed by
+		size_t first_item;
+		std::vector<Definition> definitions;
+		std::vector<Occurrence> occurrences;	// by offset
+
+		// uses of names not bound within the declaration.
+		std::map<std::wstring, std::vector<size_t> > global_uses;
+	};
+
+	typedef boost::shared_ptr<Declaration> DeclarationPtr;
+	typedef std::map<const ShaderParser::Node*, DeclarationPtr> DeclarationCache;
+
+	// the names defined in a block, and where it ends.
+	struct Scope
+	{
+		size_t end;
+		std::vector<std::pair<std::wstring, size_t> > names;
+	};
+
+	struct Analysis
+	{
+		const ShaderParser::Item* items;	// from the declaration begin
+		Declaration* declaration;
+		std::vector<Scope> scopes;		// innermost last
+		SymbolKind variables;			// what variables declared here are
+	};
+
+	void Analyze(Analysis& analysis, const ShaderParser::Node& node, size_t offset) const;
+	void AnalyzeDirective(Analysis& analysis, const ShaderParser::Node& node, size_t offset) const;
+	void AnalyzeChildren(Analysis& analysis, const ShaderParser::Node& node, size_t offset) const;
+	void AnalyzeScope(Analysis& analysis, const ShaderParser::Node& node, size_t offset, SymbolKind variables) const;
+	void Define(Analysis& analysis, const std::wstring& name, SymbolKind kind, size_t offset) const;
+	void Use(Analysis& analysis, const std::wstring& name, size_t offset) const;
+
+	void Register(const DeclarationPtr& declaration);
+	void Unregister(const DeclarationPtr& declaration);
+
+	const Declaration* FindDeclaration(size_t item) const;
+	const Occurrence* FindOccurrence(const Declaration& declaration, size_t item) const;
+	Symbol MakeSymbol(const Declaration& declaration, const Definition& definition) const;
+
+private:
+	std::vector<DeclarationPtr> m_declarations;		// in document order
+	DeclarationCache m_cache;
+
+	// global definitions, and the declarations using a global name.
+	std::multimap<std::wstring, std::pair<const Declaration*, size_t> > m_definitions;
+	std::map<std::wstring, std::set<const Declaration*> > m_users;
+
+	size_t m_num_analyzed;
+};
+
+#endif  // _SHADER_SYMBOL_INDEX_HPP_INCLUDED_
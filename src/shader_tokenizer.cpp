@@ -0,0 +1,371 @@
+#include "common.hpp"
+#include "shader_tokenizer.hpp"
+
+#include "keywords.hpp"
+#include <cctype>
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderTokenizer::ShaderTokenizer()
+{
+	m_keywords_set.insert(kewords, kewords + ARRAYSIZE(kewords));
+	m_semantics_set.insert(semantics, semantics + ARRAYSIZE(semantics));
+
+	m_global_funcs_set.insert(global_funcs, global_funcs + ARRAYSIZE(global_funcs));
+	m_global_funcs_set.insert(extend_funcs, extend_funcs + ARRAYSIZE(extend_funcs));
+
+	m_member_funcs_set.insert(member_funcs, member_funcs + ARRAYSIZE(member_funcs));
+}
+
+ShaderTokenizer::~ShaderTokenizer()
+{
+
+}
+
+ShaderTokenizer::
+Token::Token(const std::wstring& text, size_t start, size_t end,
+			 TokenType type, size_t depth, size_t indent)
+	: start_pos(start)
+	, end_pos(end)
+	, type(type)
+	, depth(depth)
+	, indent(indent)
+{
+	word = text.substr(start_pos, end_pos - start_pos);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderTokenizer::Tokenize(const std::wstring& text)
+{
+	m_tokens.clear();
+
+	size_t pos = 0;
+	TokenContext context = {TE_Normal, 0, 0};
+
+	while(pos < text.length())
+	{
+		ParseToken(pos, context, text);
+	}
+}
+
+size_t ShaderTokenizer::GetNumberTokens() const
+{
+	return m_tokens.size();
+}
+
+const ShaderTokenizer::Token& ShaderTokenizer::GetToken(size_t idx) const
+{
+	return m_tokens[idx];
+}
+
+int ShaderTokenizer::FetchTokenForward(size_t pos) const
+{
+	auto it = std::upper_bound(m_tokens.begin(), m_tokens.end(), pos,
+		[](size_t lhs, const Token& rhs) {return lhs < rhs.end_pos;});
+	return it - m_tokens.begin();
+}
+
+int ShaderTokenizer::FetchTokenBackward(size_t pos) const
+{
+	auto it = std::upper_bound(m_tokens.begin(), m_tokens.end(), pos,
+		[](size_t lhs, const Token& rhs) {return lhs < rhs.start_pos + 1;});
+
+	if (it == m_tokens.begin()) return -1;
+	else return it - 1 - m_tokens.begin();
+}
+
+size_t ShaderTokenizer::FetchIndent(size_t pos) const
+{
+	int idx = FetchTokenBackward(pos);
+	if (idx == -1) return 0;
+
+	const Token& tok = m_tokens[idx];
+	if (tok.type == TT_Separator && (tok.word == L"{" || tok.word == L"("))
+	{
+		return tok.indent + 1;
+	}
+	return tok.indent;
+}
+
+size_t ShaderTokenizer::FetchDepth(size_t pos) const
+{
+	int idx = FetchTokenBackward(pos);
+	if (idx == -1) return 0;
+
+	const Token& tok = m_tokens[idx];
+	if (tok.type == TT_Separator && (tok.word == L"{" || tok.word == L"("))
+	{
+		return tok.depth + 1;
+	}
+	return tok.depth;
+}
+
+ContentHash ShaderTokenizer::GetFingerprint(const std::wstring& text) const
+{
+	const unsigned long long gap_marker = 0x20;
+	const unsigned long long line_marker = 0x0A;
+
+	ContentHasher hasher;
+	const Token* prev = NULL;
+	bool in_directive = false;
+
+	for (size_t i = 0; i != m_tokens.size(); ++i)
+	{
+		const Token& tok = m_tokens[i];
+		if (tok.type == TT_Comment) continue;
+
+		bool new_line = prev == NULL;
+		if (prev != NULL)
+		{
+			auto gap_begin = text.begin() + std::min(prev->end_pos, text.length());
+			auto gap_end = text.begin() + std::min(tok.start_pos, text.length());
+			new_line = std::find(gap_begin, gap_end, L'\n') != gap_end;
+
+			// a line break ends a preprocessor directive unless it is escaped.
+			if (in_directive && new_line && prev->word != L"\\")
+			{
+				hasher.UpdateValue(line_marker);
+				in_directive = false;
+			}
+
+			// separators are single chars, keep '+ +' apart from '++'.
+			else if (gap_begin != gap_end && prev->type == TT_Separator && tok.type == TT_Separator)
+			{
+				hasher.UpdateValue(gap_marker);
+			}
+		}
+
+		if (new_line && tok.word == L"#") in_directive = true;
+
+		hasher.UpdateValue(tok.word.length());
+		hasher.Update(tok.word.c_str(), tok.word.length() * sizeof(wchar_t));
+		prev = &tok;
+	}
+
+	return hasher.Finish();
+}
+
+bool ShaderTokenizer::GetSignificantTokenAnchor(size_t pos, size_t& ordinal, size_t& offset) const
+{
+	ordinal = 0;
+	for (size_t i = 0; i != m_tokens.size(); ++i)
+	{
+		const Token& tok = m_tokens[i];
+		if (tok.type == TT_Comment) continue;
+
+		if (pos < tok.end_pos)
+		{
+			offset = pos > tok.start_pos ? pos - tok.start_pos : 0;
+			return true;
+		}
+		++ordinal;
+	}
+	return false;
+}
+
+bool ShaderTokenizer::GetSignificantTokenPos(size_t ordinal, size_t offset, size_t& pos) const
+{
+	for (size_t i = 0; i != m_tokens.size(); ++i)
+	{
+		const Token& tok = m_tokens[i];
+		if (tok.type == TT_Comment) continue;
+
+		if (ordinal-- == 0)
+		{
+			pos = tok.start_pos + std::min(offset, tok.end_pos - tok.start_pos);
+			return true;
+		}
+	}
+	return false;
+}
+
+const std::vector<ShaderTokenizer::Token>& ShaderTokenizer::GetTokens() const
+{
+	return m_tokens;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderTokenizer::ParseToken(size_t &pos, TokenContext& context, const std::wstring& text)
+{
+	wchar_t current_char = text[pos];
+	wchar_t next_char = pos + 1 < text.length() ? text[pos + 1] : 0;
+
+	// space
+	if (isspace(current_char))
+	{
+		if (context.env == TE_LineComment && current_char == '\n')
+		{
+			context.env = TE_Normal; 
+		}
+		pos += 1;
+		return;
+	}
+
+	// block comment begin
+	if (current_char == '/' && next_char == '*')
+	{
+		if (context.env != TE_LineComment) context.env = TE_BlockComment;
+		Token tok(text, pos, pos + 2, TT_Comment);
+		m_tokens.push_back(tok);
+		ResolveToken(context, tok);
+		pos += 2;
+		return;
+	}
+
+	// block comment end
+	if (current_char == '*' && next_char == '/')
+	{
+		Token tok(text, pos, pos + 2, TT_Comment);
+		if (context.env != TE_BlockComment && context.env != TE_LineComment) tok.type = TT_Illegal;
+		if (context.env == TE_BlockComment) context.env = TE_Normal;
+		m_tokens.push_back(tok);
+		ResolveToken(context, tok);
+		pos += 2;
+		return;
+	}
+
+	// line comment
+	if (current_char == '/' && next_char == '/')
+	{
+		if (context.env != TE_BlockComment) context.env = TE_LineComment;
+		Token tok(text, pos, pos + 2, TT_Comment);
+		m_tokens.push_back(tok);
+		ResolveToken(context, tok);
+		pos += 2;
+		return;
+	}
+
+	// word
+	if (isalpha(current_char) || current_char == '_')
+	{
+		int start_pos = pos;
+		for (pos = pos + 1; pos < text.length(); ++pos)
+		{
+			if (!isalnum(text[pos]) && text[pos] != '_') break;
+		}
+
+		Token tok(text, start_pos, pos, TT_Word);
+		ResolveToken(context, tok);
+		m_tokens.push_back(tok);
+		return;
+	}
+
+	// literal constant
+	if (isdigit(current_char) || (current_char == '.' && isdigit(next_char)))
+	{
+		int start_pos = pos;
+		bool meet_digit = false;
+		bool meet_dot = false;
+		bool meet_exp = false;
+		bool meet_suffix = false;
+		bool illegal = false;
+		for (; pos < text.length() && (isalnum(text[pos]) || text[pos] == '.'); ++pos)
+		{
+			if (illegal) continue;
+			if (meet_suffix) {illegal = true; continue;}
+
+			if (isdigit(text[pos]))
+			{
+				meet_digit = true;
+			}
+			else if (text[pos] == '.')
+			{
+				if (!meet_dot && !meet_exp) meet_dot = true;
+				else illegal = true;
+			}
+			else if (isalpha(text[pos]))
+			{
+				if (!meet_digit) illegal = true;
+				else if (tolower(text[pos]) == 'f') meet_suffix = true;
+				else if (!meet_exp && tolower(text[pos]) == 'e')
+				{
+					if (pos + 1 < text.length() && text[pos + 1] == '-') ++pos;
+					if (pos + 1 < text.length() && isdigit(text[pos + 1])) meet_exp = true;
+					else illegal = true;
+				}
+				else illegal = true;
+			}
+		}
+
+		Token tok(text, start_pos, pos);
+		tok.type = illegal ? TT_Illegal : TT_Constant;
+		ResolveToken(context, tok);
+		m_tokens.push_back(tok);
+		return;
+	}
+
+	// other separators
+	{
+		Token tok(text, pos, pos + 1, TT_Separator);
+		ResolveToken(context, tok);
+		m_tokens.push_back(tok);
+		pos += 1;
+		return;
+	}
+}
+
+void ShaderTokenizer::ResolveToken(TokenContext& context, Token &tok)
+{
+	tok.depth = context.depth;
+	tok.indent = context.indent;
+
+	const std::wstring& word = tok.word; 
+	if (context.env == TE_LineComment || context.env == TE_BlockComment)
+	{
+		tok.type = TT_Comment;
+	}
+	else if (context.env == TE_Dot)
+	{
+		context.env = TE_Normal;
+		if (tok.type == TT_Word)
+		{
+			if (m_member_funcs_set.find(word) != m_member_funcs_set.end()) tok.type = TT_Member;
+		}
+		else tok.type = TT_Illegal;
+	}
+	else if (context.env == TE_Colon)
+	{
+		context.env = TE_Normal;
+		if (tok.type == TT_Word)
+		{
+			std::wstring word_lower_case = word;
+			std::transform(word.begin(), word.end(), word_lower_case.begin(), ::tolower);
+			
+			if (m_semantics_set.find(word_lower_case) != m_semantics_set.end()) tok.type = TT_Semantic;
+			else if (m_keywords_set.find(word) != m_keywords_set.end()) tok.type = TT_Keyword;
+			else if (m_global_funcs_set.find(word) != m_global_funcs_set.end()) tok.type = TT_Function;
+		}
+	}
+	else if (context.env == TE_Normal)
+	{
+		if (tok.type == TT_Separator)
+		{
+			if (word == L".") context.env = TE_Dot;
+			else if (word == L":") context.env = TE_Colon;
+			else if (word == L"{" || word == L"(")
+			{
+				context.depth += 1;
+				if (word == L"{") context.indent += 1;
+			}
+			else if (word == L"}" || word == L")")
+			{
+				if (context.depth > 0) context.depth -= 1;
+				if (word == L"}" && context.indent > 0) context.indent -= 1;
+				tok.depth = context.depth;
+				tok.indent = context.indent;
+			}
+		}
+
+		if (tok.type == TT_Word)
+		{
+			if (m_keywords_set.find(word) != m_keywords_set.end()) tok.type = TT_Keyword;
+			else if (m_global_funcs_set.find(word) != m_global_funcs_set.end()) tok.type = TT_Function;
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef _SHADER_TOKENIZER_HPP_INCLUDED_
+#define _SHADER_TOKENIZER_HPP_INCLUDED_
+
+#include <vector>
+#include <set>
+#include "content_hash.hpp"
+
+// splits shader text into words, constants, separators and comments, and
+// classifies words by the keyword tables. every token knows its bracket
+// depth and indent. shared by the highlighter and the linter, so both see
+// the text the same way.
+class ShaderTokenizer
+{
+public:
+	enum TokenEnv
+	{
+		TE_Normal,
+		TE_Dot,
+		TE_Colon,
+		TE_LineComment,
+		TE_BlockComment,
+	};
+
+	struct TokenContext
+	{
+		TokenEnv env;
+		size_t depth;
+		size_t indent;
+	};
+
+	enum TokenType
+	{
+		TT_Word,
+		TT_Keyword,
+		TT_Constant,
+		TT_Function,
+		TT_Member,
+		TT_Semantic,
+		TT_Comment,
+		TT_Separator,
+		TT_Illegal,
+		Num_TokenTypes,
+	};
+
+	struct Token
+	{
+		size_t start_pos;
+		size_t end_pos;
+		std::wstring word;
+
+		TokenType type;
+		size_t depth;
+		size_t indent;
+
+		Token(const std::wstring& text, size_t start, size_t end,
+			  TokenType type = TT_Word, size_t depth = 0, size_t indent = 0);
+	};
+
+public:
+	ShaderTokenizer();
+	virtual ~ShaderTokenizer();
+
+public:
+	void Tokenize(const std::wstring& text);
+
+	size_t GetNumberTokens() const;
+	const Token& GetToken(size_t idx) const;
+	const std::vector<Token>& GetTokens() const;
+
+	int FetchTokenForward(size_t pos) const;
+	int FetchTokenBackward(size_t pos) const;
+
+	size_t FetchIndent(size_t pos) const;
+	size_t FetchDepth(size_t pos) const;
+
+	// hash of the token stream without comments and whitespace. texts with
+	// equal fingerprints compile to the same shader.
+	ContentHash GetFingerprint(const std::wstring& text) const;
+
+	// addresses a text position by the significant (non comment) token it
+	// falls in, which survives comment and whitespace only edits.
+	bool GetSignificantTokenAnchor(size_t pos, size_t& ordinal, size_t& offset) const;
+	bool GetSignificantTokenPos(size_t ordinal, size_t offset, size_t& pos) const;
+
+private:
+	void ParseToken(size_t &pos, TokenContext& context, const std::wstring& text);
+
+	void ResolveToken(TokenContext& context, Token& tok);
+
+protected:
+	std::set<std::wstring> m_keywords_set;
+	std::set<std::wstring> m_semantics_set;
+	std::set<std::wstring> m_global_funcs_set;
+	std::set<std::wstring> m_member_funcs_set;
+
+	std::vector<Token> m_tokens;
+};
+
+#endif  // _SHADER_TOKENIZER_HPP_INCLUDED_
@@ -0,0 +1,263 @@
+#include "common.hpp"
+#include "shader_validator.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <cstdio>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+typedef boost::posix_time::ptime TimePoint;
+
+static TimePoint Now()
+{
+	return boost::posix_time::microsec_clock::universal_time();
+}
+
+static double Milliseconds(const TimePoint& begin, const TimePoint& end)
+{
+	return (end - begin).total_microseconds() / 1000.0;
+}
+
+static void WriteJsonString(std::ostream& os, const std::string& str)
+{
+	os << '"';
+	for (size_t i = 0; i != str.length(); ++i)
+	{
+		unsigned char c = static_cast<unsigned char>(str[i]);
+		switch (c)
+		{
+		case '"':  os << "\\\""; break;
+		case '\\': os << "\\\\"; break;
+		case '\n': os << "\\n"; break;
+		case '\r': os << "\\r"; break;
+		case '\t': os << "\\t"; break;
+		default:
+			if (c < 0x20 || c >= 0x80)
+			{
+				// shader text is latin-1, so every byte is one code point.
+				char escaped[8];
+				sprintf(escaped, "\\u%04x", c);
+				os << escaped;
+			}
+			else os << static_cast<char>(c);
+		}
+	}
+	os << '"';
+}
+
+static const char* GetStatusName(ValidationStatus status)
+{
+	switch (status)
+	{
+	case VS_Succeeded: return "ok";
+	case VS_Failed:    return "error";
+	default:           return "unreadable";
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// shader validation
+//////////////////////////////////////////////////////////////////////////
+ShaderValidation::ShaderValidation()
+	: status(VS_Unreadable)
+	, bytecode_size(0)
+	, header_lines(0)
+	, num_errors(0)
+	, num_warnings(0)
+	, read_time(0)
+	, assemble_time(0)
+	, compile_time(0)
+	, total_time(0)
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+ShaderValidator::ShaderValidator(ShaderCompilerPtr compiler, size_t num_threads /*= 0*/)
+	: m_compiler(compiler)
+	, m_pool(num_threads)
+	, m_entry_point("ps_main")
+	, m_profile("ps_4_0")
+	, m_flags(0)
+{
+	m_worker_states.resize(m_pool.GetNumThreads());
+}
+
+ShaderValidator::~ShaderValidator()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void ShaderValidator::SetHeader(const std::string& header, const ShaderSourceMap& source_map, const ContentHash& header_hash)
+{
+	m_header = header;
+	m_header_map = source_map;
+	m_header_hash = header_hash;
+}
+
+void ShaderValidator::SetEntryPoint(const std::string& entry_point, const std::string& profile)
+{
+	m_entry_point = entry_point;
+	m_profile = profile;
+}
+
+void ShaderValidator::SetCompileFlags(unsigned int flags)
+{
+	m_flags = flags;
+}
+
+void ShaderValidator::Validate(const std::vector<std::string>& files, ShaderValidations& results)
+{
+	// the header is split once per worker, not once per file.
+	for (size_t i = 0; i != m_worker_states.size(); ++i)
+	{
+		m_worker_states[i].stripper.SetHeader(m_header, m_header_map, m_header_hash);
+	}
+
+	results.clear();
+	results.resize(files.size());
+	for (size_t i = 0; i != files.size(); ++i)
+	{
+		results[i].file = files[i];
+		m_pool.Submit(boost::bind(&ShaderValidator::ValidateFile, this, &results[i]));
+	}
+	m_pool.Wait();
+}
+
+size_t ShaderValidator::GetNumThreads() const
+{
+	return m_pool.GetNumThreads();
+}
+
+WorkStealingPool::Statistics ShaderValidator::GetPoolStatistics() const
+{
+	return m_pool.GetStatistics();
+}
+
+void ShaderValidator::WriteReport(std::ostream& os, const ShaderValidations& results,
+	const std::string& compiler_name, size_t num_threads, double total_time)
+{
+	size_t num_succeeded = 0;
+	for (size_t i = 0; i != results.size(); ++i)
+	{
+		if (results[i].status == VS_Succeeded) ++num_succeeded;
+	}
+
+	os << "{\n";
+	os << "  \"compiler\": ";
+	WriteJsonString(os, compiler_name);
+	os << ",\n";
+	os << "  \"threads\": " << num_threads << ",\n";
+	os << "  \"total_ms\": " << total_time << ",\n";
+	os << "  \"succeeded\": " << num_succeeded << ",\n";
+	os << "  \"failed\": " << results.size() - num_succeeded << ",\n";
+	os << "  \"files\": [";
+
+	for (size_t i = 0; i != results.size(); ++i)
+	{
+		const ShaderValidation& result = results[i];
+		os << (i == 0 ? "\n" : ",\n");
+		os << "    {\n";
+		os << "      \"file\": ";
+		WriteJsonString(os, result.file);
+		os << ",\n";
+		os << "      \"status\": \"" << GetStatusName(result.status) << "\",\n";
+		os << "      \"bytecode_size\": " << result.bytecode_size << ",\n";
+		os << "      \"header_lines\": " << result.header_lines << ",\n";
+		os << "      \"errors\": " << result.num_errors << ",\n";
+		os << "      \"warnings\": " << result.num_warnings << ",\n";
+		os << "      \"read_ms\": " << result.read_time << ",\n";
+		os << "      \"assemble_ms\": " << result.assemble_time << ",\n";
+		os << "      \"compile_ms\": " << result.compile_time << ",\n";
+		os << "      \"total_ms\": " << result.total_time << ",\n";
+		os << "      \"diagnostics\": [";
+
+		for (size_t j = 0; j != result.diagnostics.size(); ++j)
+		{
+			const ShaderDiagnostic& diagnostic = result.diagnostics[j];
+			os << (j == 0 ? "\n" : ",\n");
+			os << "        {\"severity\": \"" << (diagnostic.severity == DS_Error ? "error" : "warning") << "\"";
+			os << ", \"source\": ";
+			WriteJsonString(os, diagnostic.is_mapped ? diagnostic.source : diagnostic.file);
+			os << ", \"line\": " << (diagnostic.is_mapped ? diagnostic.source_line : diagnostic.line);
+			os << ", \"column\": " << diagnostic.column;
+			os << ", \"code\": ";
+			WriteJsonString(os, diagnostic.code);
+			os << ", \"message\": ";
+			WriteJsonString(os, diagnostic.message);
+			os << "}";
+		}
+		os << (result.diagnostics.empty() ? "]\n" : "\n      ]\n");
+		os << "    }";
+	}
+	os << (results.empty() ? "]\n" : "\n  ]\n");
+	os << "}\n";
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+void ShaderValidator::ValidateFile(ShaderValidation* result)
+{
+	WorkerState& state = m_worker_states[m_pool.GetWorkerIndex()];
+	TimePoint begin = Now();
+
+	std::wstring document;
+	bool is_read = ReadDocument(result->file, document);
+	TimePoint read_end = Now();
+	result->read_time = Milliseconds(begin, read_end);
+	if (!is_read)
+	{
+		result->status = VS_Unreadable;
+		result->total_time = result->read_time;
+		return;
+	}
+
+	// exactly what the editor hands to the compiler for the same text.
+	state.stripper.Strip(document);
+	state.assembler.SetHeader(state.stripper.GetText(), state.stripper.GetHash());
+	ShaderCompileInput input = state.assembler.Assemble(document, m_entry_point, m_profile, m_flags);
+	result->header_lines = ShaderSourceMap::CountLines(state.stripper.GetText());
+	TimePoint assemble_end = Now();
+	result->assemble_time = Milliseconds(read_end, assemble_end);
+
+	ShaderCompileOutput output;
+	bool succeeded = m_compiler->Compile(input, output);
+	TimePoint compile_end = Now();
+	result->compile_time = Milliseconds(assemble_end, compile_end);
+
+	ShaderSourceMap source_map = *state.stripper.GetSourceMap();
+	source_map.AddSegment(result->file, static_cast<size_t>(std::count(document.begin(), document.end(), L'\n')) + 1);
+	ParseShaderDiagnostics(output.error_message, result->diagnostics);
+	MapShaderDiagnostics(source_map, result->diagnostics);
+
+	result->status = succeeded ? VS_Succeeded : VS_Failed;
+	result->bytecode_size = output.bytecode.size();
+	result->num_errors = CountShaderDiagnostics(result->diagnostics, DS_Error);
+	result->num_warnings = CountShaderDiagnostics(result->diagnostics, DS_Warning);
+	result->total_time = Milliseconds(begin, Now());
+}
+
+bool ShaderValidator::ReadDocument(const std::string& path, std::wstring& document)
+{
+	std::ifstream ifs(path.c_str(), std::ios::binary);
+	if (!ifs.is_open()) return false;
+
+	std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+	// byte for byte, the inverse of how the assembler encodes documents.
+	document.resize(content.length());
+	for (size_t i = 0; i != content.length(); ++i)
+	{
+		document[i] = static_cast<wchar_t>(static_cast<unsigned char>(content[i]));
+	}
+	return true;
+}
@@ -0,0 +1,89 @@
+#ifndef _SHADER_VALIDATOR_HPP_INCLUDED_
+#define _SHADER_VALIDATOR_HPP_INCLUDED_
+
+#include <iosfwd>
+#include <vector>
+#include "shader_compiler.hpp"
+#include "shader_diagnostics.hpp"
+#include "shader_header_stripper.hpp"
+#include "shader_input_assembler.hpp"
+#include "work_stealing_pool.hpp"
+
+enum ValidationStatus
+{
+	VS_Succeeded,
+	VS_Failed,
+	VS_Unreadable,
+};
+
+struct ShaderValidation
+{
+	std::string file;
+	ValidationStatus status;
+	size_t bytecode_size;
+	size_t header_lines;		// lines of the stripped header in front of the file
+	size_t num_errors;
+	size_t num_warnings;
+	ShaderDiagnostics diagnostics;
+
+	// milliseconds spent in each step.
+	double read_time;
+	double assemble_time;
+	double compile_time;
+	double total_time;
+
+	ShaderValidation();
+};
+
+typedef std::vector<ShaderValidation> ShaderValidations;
+
+// compiles a batch of shader files on a work stealing pool, each one the
+// way the editor compiles its text: the header stripped down to what the
+// file reaches, assembled in front of it, and the diagnostics parsed and
+// mapped back to the header files and the shader file.
+class ShaderValidator
+{
+public:
+	explicit ShaderValidator(ShaderCompilerPtr compiler, size_t num_threads = 0);
+	virtual ~ShaderValidator();
+
+public:
+	void SetHeader(const std::string& header, const ShaderSourceMap& source_map, const ContentHash& header_hash);
+	void SetEntryPoint(const std::string& entry_point, const std::string& profile);
+	void SetCompileFlags(unsigned int flags);
+
+	// results come in the order of the files.
+	void Validate(const std::vector<std::string>& files, ShaderValidations& results);
+
+	size_t GetNumThreads() const;
+	WorkStealingPool::Statistics GetPoolStatistics() const;
+
+	// a JSON document with a summary and one entry per file.
+	static void WriteReport(std::ostream& os, const ShaderValidations& results,
+		const std::string& compiler_name, size_t num_threads, double total_time);
+
+private:
+	struct WorkerState
+	{
+		ShaderHeaderStripper stripper;
+		ShaderInputAssembler assembler;
+	};
+
+	void ValidateFile(ShaderValidation* result);
+	static bool ReadDocument(const std::string& path, std::wstring& document);
+
+private:
+	ShaderCompilerPtr m_compiler;
+	WorkStealingPool m_pool;
+	std::vector<WorkerState> m_worker_states;
+
+	std::string m_header;
+	ShaderSourceMap m_header_map;
+	ContentHash m_header_hash;
+
+	std::string m_entry_point;
+	std::string m_profile;
+	unsigned int m_flags;
+};
+
+#endif  // _SHADER_VALIDATOR_HPP_INCLUDED_
@@ -0,0 +1,170 @@
+#include "common.hpp"
+#include "stub_shader_compiler.hpp"
+#include "content_hash.hpp"
+
+#include <sstream>
+#include <cctype>
+#include <boost/thread/thread.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+StubShaderCompiler::StubShaderCompiler()
+	: m_compile_count(0)
+	, m_default_delay(0)
+{
+
+}
+
+StubShaderCompiler::~StubShaderCompiler()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool StubShaderCompiler::Compile(const ShaderCompileInput& input, ShaderCompileOutput& output)
+{
+	unsigned int delay = 0;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		++m_compile_count;
+		auto it = m_delays.find(input.flags);
+		delay = it != m_delays.end() ? it->second : m_default_delay;
+	}
+	if (delay != 0) boost::this_thread::sleep(boost::posix_time::milliseconds(delay));
+
+	output.from_cache = false;
+	output.bytecode.clear();
+	output.error_message.clear();
+
+	if (!CheckBrackets(input.GetSource(), output.error_message)) return false;
+	if (!CheckEntryPoint(input.GetSource(), input.entry_point, output.error_message)) return false;
+
+	ContentHasher hasher;
+	hasher.Update(input.GetSource());
+	hasher.Update(input.entry_point);
+	hasher.Update(input.profile);
+	hasher.UpdateValue(input.flags);
+	ContentHash hash = hasher.Finish();
+
+	const char magic[4] = {'D', 'X', 'B', 'C'};
+	output.bytecode.assign(magic, magic + sizeof(magic));
+	output.bytecode.insert(output.bytecode.end(),
+		reinterpret_cast<const char*>(&hash), reinterpret_cast<const char*>(&hash) + sizeof(hash));
+	return true;
+}
+
+size_t StubShaderCompiler::GetCompileCount() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_compile_count;
+}
+
+void StubShaderCompiler::SetDefaultDelay(unsigned int milliseconds)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_default_delay = milliseconds;
+}
+
+void StubShaderCompiler::SetCompileDelay(unsigned int flags, unsigned int milliseconds)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_delays[flags] = milliseconds;
+}
+
+unsigned int StubShaderCompiler::GetCompileDelay(unsigned int flags) const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	auto it = m_delays.find(flags);
+	return it != m_delays.end() ? it->second : m_default_delay;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+bool StubShaderCompiler::CheckBrackets(const std::string& source, std::string& error_message) const
+{
+	struct Bracket
+	{
+		char c;
+		int line;
+		int column;
+	};
+
+	std::vector<Bracket> stack;
+	int line = 1;
+	int column = 1;
+	for (size_t i = 0; i < source.length(); ++i, ++column)
+	{
+		char c = source[i];
+		char next = i + 1 < source.length() ? source[i + 1] : 0;
+
+		if (c == '\n')
+		{
+			++line;
+			column = 0;
+		}
+		else if (c == '/' && next == '/')
+		{
+			while (i + 1 < source.length() && source[i + 1] != '\n') ++i;
+		}
+		else if (c == '/' && next == '*')
+		{
+			for (i += 2, column += 2; i < source.length(); ++i, ++column)
+			{
+				if (source[i] == '\n') {++line; column = 0;}
+				if (source[i] == '*' && i + 1 < source.length() && source[i + 1] == '/') {++i; ++column; break;}
+			}
+		}
+		else if (c == '(' || c == '[' || c == '{')
+		{
+			Bracket bracket = {c, line, column};
+			stack.push_back(bracket);
+		}
+		else if (c == ')' || c == ']' || c == '}')
+		{
+			char open = c == ')' ? '(' : (c == ']' ? '[' : '{');
+			if (stack.empty() || stack.back().c != open)
+			{
+				std::ostringstream oss;
+				oss << "memory(" << line << "," << column << "): error X3000: syntax error: unexpected token '" << c << "'\n";
+				error_message = oss.str();
+				return false;
+			}
+			stack.pop_back();
+		}
+	}
+
+	if (!stack.empty())
+	{
+		std::ostringstream oss;
+		oss << "memory(" << line << "," << column << "): error X3000: syntax error: unexpected end of file\n";
+		error_message = oss.str();
+		return false;
+	}
+	return true;
+}
+
+bool StubShaderCompiler::CheckEntryPoint(const std::string& source, const std::string& entry_point, std::string& error_message) const
+{
+	// look for "<entry_point> (" outside of any braces.
+	int depth = 0;
+	for (size_t i = 0; i < source.length(); ++i)
+	{
+		char c = source[i];
+		if (c == '{') ++depth;
+		else if (c == '}') --depth;
+		else if (depth == 0 && source.compare(i, entry_point.length(), entry_point) == 0)
+		{
+			bool word_begin = i == 0 || !(isalnum(source[i - 1]) || source[i - 1] == '_');
+			size_t pos = i + entry_point.length();
+			while (pos < source.length() && isspace(source[pos])) ++pos;
+			if (word_begin && pos < source.length() && source[pos] == '(') return true;
+		}
+	}
+
+	error_message = "error X3501: '" + entry_point + "': entrypoint not found\n";
+	return false;
+}
@@ -0,0 +1,40 @@
+#ifndef _STUB_SHADER_COMPILER_HPP_INCLUDED_
+#define _STUB_SHADER_COMPILER_HPP_INCLUDED_
+
+#include "shader_compiler.hpp"
+#include <map>
+#include <boost/thread/mutex.hpp>
+
+// a local stand-in for the real compiler, for machines without the
+// D3D compiler and for exercising the compile pipeline. it only checks
+// that brackets balance and that the entry point is defined, reports
+// problems in fxc's format, and produces bytecode derived from the input
+// hash, so equal inputs give equal bytecode. a delay can be configured per
+// flag combination, to mimic how much longer optimized compiles take.
+class StubShaderCompiler : public ShaderCompiler
+{
+public:
+	StubShaderCompiler();
+	virtual ~StubShaderCompiler();
+
+public:
+	virtual bool Compile(const ShaderCompileInput& input, ShaderCompileOutput& output);
+
+	size_t GetCompileCount() const;
+
+	void SetDefaultDelay(unsigned int milliseconds);
+	void SetCompileDelay(unsigned int flags, unsigned int milliseconds);
+	unsigned int GetCompileDelay(unsigned int flags) const;
+
+private:
+	bool CheckBrackets(const std::string& source, std::string& error_message) const;
+	bool CheckEntryPoint(const std::string& source, const std::string& entry_point, std::string& error_message) const;
+
+private:
+	mutable boost::mutex m_mutex;
+	size_t m_compile_count;
+	unsigned int m_default_delay;
+	std::map<unsigned int, unsigned int> m_delays;
+};
+
+#endif  // _STUB_SHADER_COMPILER_HPP_INCLUDED_
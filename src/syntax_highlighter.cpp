@@ -1,10 +1,6 @@
 #include "common.hpp"
 #include "syntax_highlighter.hpp"
 
-#include "keywords.hpp"
-#include <cctype>
-#include <algorithm>
-
 //////////////////////////////////////////////////////////////////////////
 // constructor / destructor
 //////////////////////////////////////////////////////////////////////////
@@ -18,18 +14,6 @@ SyntaxHighlighter::~SyntaxHighlighter()
 
 }
 
-SyntaxHighlighter::
-Token::Token(const std::wstring& text, size_t start, size_t end,
-			 TokenType type, size_t depth, size_t indent)
-	: start_pos(start)
-	, end_pos(end)
-	, type(type)
-	, depth(depth)
-	, indent(indent)
-{
-	word = text.substr(start_pos, end_pos - start_pos);
-}
-
 SyntaxHighlighter::
 DrawStyle::DrawStyle(const float3& color, bool bold, bool underlined)
 	: color(color)
@@ -51,25 +35,12 @@ DrawStyle::~DrawStyle()
 //////////////////////////////////////////////////////////////////////////
 void SyntaxHighlighter::Intialize(ID2D1RenderTarget* d2d_rt)
 {
-	m_keywords_set.clear();
-	m_keywords_set.insert(kewords, kewords + ARRAYSIZE(kewords));
-
-	m_semantics_set.clear();
-	m_semantics_set.insert(semantics, semantics + ARRAYSIZE(semantics));
-
-	m_global_funcs_set.clear();
-	m_global_funcs_set.insert(global_funcs, global_funcs + ARRAYSIZE(global_funcs));
-	m_global_funcs_set.insert(extend_funcs, extend_funcs + ARRAYSIZE(extend_funcs));
-
-	m_member_funcs_set.clear();
-	m_member_funcs_set.insert(member_funcs, member_funcs + ARRAYSIZE(member_funcs));
-
 	InitDrawStyles(d2d_rt);
 }
 
 void SyntaxHighlighter::Hightlight(const std::wstring& text, size_t start_pos, size_t end_pos, size_t caret_pos, IDWriteTextLayout* layout)
 {
-	Parse(text);
+	Tokenize(text);
 
 	for (int i = 0; i != m_tokens.size(); ++i)
 	{
@@ -132,58 +103,6 @@ void SyntaxHighlighter::Hightlight(const std::wstring& text, size_t start_pos, s
 	return;
 }
 
-size_t SyntaxHighlighter::GetNumberTokens() const
-{
-	return m_tokens.size();
-}
-
-const SyntaxHighlighter::Token& SyntaxHighlighter::GetToken(size_t idx) const
-{
-	return m_tokens[idx];
-}
-
-int SyntaxHighlighter::FetchTokenForward(size_t pos) const
-{
-	auto it = std::upper_bound(m_tokens.begin(), m_tokens.end(), pos,
-		[](size_t lhs, const Token& rhs) {return lhs < rhs.end_pos;});
-	return it - m_tokens.begin();
-}
-
-int SyntaxHighlighter::FetchTokenBackward(size_t pos) const
-{
-	auto it = std::upper_bound(m_tokens.begin(), m_tokens.end(), pos,
-		[](size_t lhs, const Token& rhs) {return lhs < rhs.start_pos + 1;});
-
-	if (it == m_tokens.begin()) return -1;
-	else return it - 1 - m_tokens.begin();
-}
-
-size_t SyntaxHighlighter::FetchIndent(size_t pos) const
-{
-	int idx = FetchTokenBackward(pos);
-	if (idx == -1) return 0;
-
-	const Token& tok = m_tokens[idx];
-	if (tok.type == TT_Separator && (tok.word == L"{" || tok.word == L"("))
-	{
-		return tok.indent + 1;
-	}
-	return tok.indent;
-}
-
-size_t SyntaxHighlighter::FetchDepth(size_t pos) const
-{
-	int idx = FetchTokenBackward(pos);
-	if (idx == -1) return 0;
-
-	const Token& tok = m_tokens[idx];
-	if (tok.type == TT_Separator && (tok.word == L"{" || tok.word == L"("))
-	{
-		return tok.depth + 1;
-	}
-	return tok.depth;
-}
-
 //////////////////////////////////////////////////////////////////////////
 // private subroutines
 //////////////////////////////////////////////////////////////////////////
@@ -209,195 +128,3 @@ void SyntaxHighlighter::InitDrawStyles(ID2D1RenderTarget* d2d_rt)
 		d2d_rt->CreateSolidColorBrush(d2d_color, &style.brush);
 	}
 }
-
-void SyntaxHighlighter::Parse(const std::wstring& text)
-{
-	m_tokens.clear();
-
-	size_t pos = 0;
-	TokenContext context = {TE_Normal, 0, 0};
-
-	while(pos < text.length())
-	{
-		ParseToken(pos, context, text);
-	}
-}
-
-void SyntaxHighlighter::ParseToken(size_t &pos, TokenContext& context, const std::wstring& text)
-{
-	wchar_t current_char = text[pos];
-	wchar_t next_char = pos + 1 < text.length() ? text[pos + 1] : 0;
-
-	// space
-	if (isspace(current_char))
-	{
-		if (context.env == TE_LineComment && current_char == '\n')
-		{
-			context.env = TE_Normal; 
-		}
-		pos += 1;
-		return;
-	}
-
-	// block comment begin
-	if (current_char == '/' && next_char == '*')
-	{
-		if (context.env != TE_LineComment) context.env = TE_BlockComment;
-		Token tok(text, pos, pos + 2, TT_Comment);
-		m_tokens.push_back(tok);
-		ResolveToken(context, tok);
-		pos += 2;
-		return;
-	}
-
-	// block comment end
-	if (current_char == '*' && next_char == '/')
-	{
-		Token tok(text, pos, pos + 2, TT_Comment);
-		if (context.env != TE_BlockComment && context.env != TE_LineComment) tok.type = TT_Illegal;
-		if (context.env == TE_BlockComment) context.env = TE_Normal;
-		m_tokens.push_back(tok);
-		ResolveToken(context, tok);
-		pos += 2;
-		return;
-	}
-
-	// line comment
-	if (current_char == '/' && next_char == '/')
-	{
-		if (context.env != TE_BlockComment) context.env = TE_LineComment;
-		Token tok(text, pos, pos + 2, TT_Comment);
-		m_tokens.push_back(tok);
-		ResolveToken(context, tok);
-		pos += 2;
-		return;
-	}
-
-	// word
-	if (isalpha(current_char) || current_char == '_')
-	{
-		int start_pos = pos;
-		for (pos = pos + 1; pos < text.length(); ++pos)
-		{
-			if (!isalnum(text[pos]) && text[pos] != '_') break;
-		}
-
-		Token tok(text, start_pos, pos, TT_Word);
-		ResolveToken(context, tok);
-		m_tokens.push_back(tok);
-		return;
-	}
-
-	// literal constant
-	if (isdigit(current_char) || current_char == '.' && isdigit(next_char))
-	{
-		int start_pos = pos;
-		bool meet_digit = false;
-		bool meet_dot = false;
-		bool meet_exp = false;
-		bool meet_suffix = false;
-		bool illegal = false;
-		for (; pos < text.length() && (isalnum(text[pos]) || text[pos] == '.'); ++pos)
-		{
-			if (illegal) continue;
-			if (meet_suffix) {illegal = true; continue;}
-
-			if (isdigit(text[pos]))
-			{
-				meet_digit = true;
-			}
-			else if (text[pos] == '.')
-			{
-				if (!meet_dot && !meet_exp) meet_dot = true;
-				else illegal = true;
-			}
-			else if (isalpha(text[pos]))
-			{
-				if (!meet_digit) illegal = true;
-				else if (tolower(text[pos]) == 'f') meet_suffix = true;
-				else if (!meet_exp && tolower(text[pos]) == 'e')
-				{
-					if (pos + 1 < text.length() && text[pos + 1] == '-') ++pos;
-					if (pos + 1 < text.length() && isdigit(text[pos + 1])) meet_exp = true;
-					else illegal = true;
-				}
-				else illegal = true;
-			}
-		}
-
-		Token tok(text, start_pos, pos);
-		tok.type = illegal ? TT_Illegal : TT_Constant;
-		ResolveToken(context, tok);
-		m_tokens.push_back(tok);
-		return;
-	}
-
-	// other separators
-	{
-		Token tok(text, pos, pos + 1, TT_Separator);
-		ResolveToken(context, tok);
-		m_tokens.push_back(tok);
-		pos += 1;
-		return;
-	}
-}
-
-void SyntaxHighlighter::ResolveToken(TokenContext& context, Token &tok)
-{
-	tok.depth = context.depth;
-	tok.indent = context.indent;
-
-	const std::wstring& word = tok.word; 
-	if (context.env == TE_LineComment || context.env == TE_BlockComment)
-	{
-		tok.type = TT_Comment;
-	}
-	else if (context.env == TE_Dot)
-	{
-		context.env = TE_Normal;
-		if (tok.type == TT_Word)
-		{
-			if (m_member_funcs_set.find(word) != m_member_funcs_set.end()) tok.type = TT_Member;
-		}
-		else tok.type = TT_Illegal;
-	}
-	else if (context.env == TE_Colon)
-	{
-		context.env = TE_Normal;
-		if (tok.type == TT_Word)
-		{
-			std::wstring word_lower_case = word;
-			std::transform(word.begin(), word.end(), word_lower_case.begin(), ::tolower);
-			
-			if (m_semantics_set.find(word_lower_case) != m_semantics_set.end()) tok.type = TT_Semantic;
-			else if (m_keywords_set.find(word) != m_keywords_set.end()) tok.type = TT_Keyword;
-			else if (m_global_funcs_set.find(word) != m_global_funcs_set.end()) tok.type = TT_Function;
-		}
-	}
-	else if (context.env == TE_Normal)
-	{
-		if (tok.type == TT_Separator)
-		{
-			if (word == L".") context.env = TE_Dot;
-			else if (word == L":") context.env = TE_Colon;
-			else if (word == L"{" || word == L"(")
-			{
-				context.depth += 1;
-				if (word == L"{") context.indent += 1;
-			}
-			else if (word == L"}" || word == L")")
-			{
-				if (context.depth > 0) context.depth -= 1;
-				if (word == L"}" && context.indent > 0) context.indent -= 1;
-				tok.depth = context.depth;
-				tok.indent = context.indent;
-			}
-		}
-
-		if (tok.type == TT_Word)
-		{
-			if (m_keywords_set.find(word) != m_keywords_set.end()) tok.type = TT_Keyword;
-			else if (m_global_funcs_set.find(word) != m_global_funcs_set.end()) tok.type = TT_Function;
-		}
-	}
-}
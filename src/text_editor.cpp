@@ -2,10 +2,19 @@
 #include "text_editor.hpp"
 #include "d3d_app.hpp"
 #include "shader_header.hpp"
+#include "shader_diagnostics.hpp"
 
 #include <commdlg.h>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+static bool IsNameChar(wchar_t c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
 
 //////////////////////////////////////////////////////////////////////////
 // default shader content
@@ -27,6 +36,27 @@ const wchar_t default_shader_content[] =
 
 const size_t MAX_NUM_LINES = 25;
 
+// with this switch on the command line, the opened file and the header
+// files are watched and reloaded on change. without it the header files
+// are polled, and the opened file is left alone.
+const char watch_files_switch[] = "--watch";
+
+// seconds a changed file has to stay quiet before it is reloaded.
+const float file_change_quiet_time = 0.2f;
+
+// seconds between two checks for changed header files, when not watching.
+const float header_poll_interval = 1.0f;
+
+// names the editor text in the compile input source map.
+const char editor_source_name[] = "<editor>";
+
+// the fast tier gets the edit on screen, the optimized one replaces it later.
+const unsigned int compile_tier_flags[Num_CompileTiers] =
+{
+	D3D10_SHADER_SKIP_OPTIMIZATION,
+	D3D10_SHADER_OPTIMIZATION_LEVEL3,
+};
+
 //////////////////////////////////////////////////////////////////////////
 // constructor / destructor
 //////////////////////////////////////////////////////////////////////////
@@ -36,12 +66,25 @@ TextEditor::TextEditor()
 	, m_text_layout(NULL)
 	, m_default_brush(NULL)
 	, m_line_offset(0)
+	, m_live_compile(false)
+	, m_live_idle_delay(0.5f)
+	, m_live_idle_time(0)
+	, m_live_revision(0)
+	, m_submitted_revision(0)
+	, m_linted_revision(0)
+	, m_completion_index(0)
+	, m_completion_begin(0)
+	, m_completion_revision(0)
+	, m_file_debouncer(file_change_quiet_time)
+	, m_header_poll_time(0)
+	, m_compile_succeeded(false)
 {
 
 }
 
 TextEditor::~TextEditor()
 {
+	m_live_compiler.Stop();
 	SAFE_RELEASE(m_text_format);
 	SAFE_RELEASE(m_text_format_small);
 	SAFE_RELEASE(m_text_layout);
@@ -59,6 +102,10 @@ void TextEditor::CompileError::Clear()
 	column = -1;
 	message.clear();
 
+	has_anchor = false;
+	anchor_ordinal = 0;
+	anchor_offset = 0;
+
 	remain_time = 0;
 	is_located = false;
 	location = float2(0, 0);
@@ -115,6 +162,14 @@ bool TextEditor::Initialize(ID2D1RenderTarget* d2d_rt)
 	// init editable text
 	m_editable_text.SetText(default_shader_content);
 
+	// init live compiler, also used to optimize shaders compiled on save
+	m_live_compiler.SetCompiler(D3DApp::GetShaderCompiler());
+	for (int i = 0; i != Num_CompileTiers; ++i)
+	{
+		m_live_compiler.SetTierFlags(static_cast<CompileTier>(i), compile_tier_flags[i]);
+	}
+	m_live_compiler.Start();
+
 	// create text layout
 	const int text_box_width = D3DApp::GetApp()->GetWidth() - 300;
 	const int text_box_height = D3DApp::GetApp()->GetHeight() - 300;
@@ -145,6 +200,13 @@ bool TextEditor::Initialize(ID2D1RenderTarget* d2d_rt)
 	// init common headers for shader
 	ShaderHeader::InitShaderHeader();
 
+	// init file watcher
+	if (strstr(GetCommandLineA(), watch_files_switch) != NULL)
+	{
+		m_file_watcher = FileWatcher::Create();
+		WatchFiles();
+	}
+
 	return true;
 }
 
@@ -152,19 +214,35 @@ void TextEditor::Update(float delta_time)
 {
 	m_caret_idle_time += delta_time;
 
-	if (m_compile_error.remain_time > 0)
-	{
-		m_compile_error.remain_time -= delta_time;
+	// checked on every edit, long before a compile would report back.
+	UpdateLint();
 
-		if (m_compile_error.remain_time > 1.0f)
+	if (m_live_compile)
+	{
+		size_t revision = m_editable_text.GetRevision();
+		if (revision != m_live_revision)
 		{
-			m_compile_error.alpha = 1.0f;
+			m_live_revision = revision;
+			m_live_idle_time = 0;
 		}
 		else
 		{
-			m_compile_error.alpha = m_compile_error.remain_time;
+			m_live_idle_time += delta_time;
+		}
+
+		if (revision != m_submitted_revision && m_live_idle_time >= m_live_idle_delay)
+		{
+			ReloadPixelShader();
 		}
 	}
+
+	// pick up edits made by other programs, to the document or the headers.
+	UpdateFileWatcher(delta_time);
+
+	ApplyLiveCompileResult();
+
+	UpdateCompileError(m_compile_error, delta_time);
+	UpdateCompileError(m_lint_error, delta_time);
 }
 
 void TextEditor::Render(ID2D1RenderTarget* d2d_rt) const
@@ -208,40 +286,14 @@ void TextEditor::Render(ID2D1RenderTarget* d2d_rt) const
 	D2D1_POINT_2F pt2 = D2D1::Point2F(m_caret_loc_hight.x + 150, m_caret_loc_hight.y + m_caret_loc_hight.z + 150);
 	d2d_rt->DrawLine(pt1, pt2, m_default_brush, 2.0f);
 
-	// draw compile error tip
+	// draw compile error tip, a lint finding only while no compile error shows
 	if (m_compile_error.alpha > 0)
 	{
-		m_default_brush->SetColor(D2D1::ColorF(1.0f, 1.0f, 1.0f, 0.9f * m_compile_error.alpha));
-		d2d_rt->SetAntialiasMode(D2D1_ANTIALIAS_MODE_PER_PRIMITIVE);
-		float2 error_loc = m_compile_error.location + float2(150, 150);
-		D2D1_RECT_F err_rect = D2D1::RectF(rect.left, error_loc.y - 16.0f, rect.right, error_loc.y);
-		D2D1_ROUNDED_RECT tip_rect = D2D1::RoundedRect(err_rect, 3.0f, 3.0f);
-		d2d_rt->FillRoundedRectangle(tip_rect, m_default_brush);
-
-		m_default_brush->SetColor(D2D1::ColorF(0.7f, 0.0f, 0.0f, m_compile_error.alpha));
-		if (!m_compile_error.is_located)
-		{
-			m_text_format_small->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_CENTER);
-		}
-		else if (m_compile_error.location.x > m_text_layout->GetMaxWidth() / 2.0f)
-		{
-			m_text_format_small->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-		}
-		else
-		{
-			m_text_format_small->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_TRAILING);
-		}
-		
-		D2D1_RECT_F msg_rect =D2D1::RectF(err_rect.left + 10.0f, err_rect.top, err_rect.right - 10.0f, err_rect.bottom);
-		d2d_rt->DrawTextA(m_compile_error.message.c_str(), m_compile_error.message.length(), m_text_format_small, msg_rect, m_default_brush);
-		
-		if (m_compile_error.is_located)
-		{
-			float2 arrow_loc = error_loc + float2(0, cos(D3DApp::GetTimer()->GetTime() * 5.0f) * 3.0f - 2.0f);
-			d2d_rt->DrawLine(D2D1::Point2F(arrow_loc.x, arrow_loc.y),  D2D1::Point2F(arrow_loc.x, arrow_loc.y - 12.0f), m_default_brush);
-			d2d_rt->DrawLine(D2D1::Point2F(arrow_loc.x, arrow_loc.y),  D2D1::Point2F(arrow_loc.x - 4.0f, arrow_loc.y - 5.0f), m_default_brush);
-			d2d_rt->DrawLine(D2D1::Point2F(arrow_loc.x, arrow_loc.y),  D2D1::Point2F(arrow_loc.x + 4.0f, arrow_loc.y - 5.0f), m_default_brush);
-		}
+		DrawCompileError(d2d_rt, rect, m_compile_error);
+	}
+	else if (m_lint_error.alpha > 0)
+	{
+		DrawCompileError(d2d_rt, rect, m_lint_error);
 	}
 }
 
@@ -250,12 +302,30 @@ const std::wstring& TextEditor::GetText() const
 	return m_editable_text.GetText();
 }
 
+void TextEditor::SetLiveCompile(bool enable, float idle_time /*= 0.5f*/)
+{
+	m_live_compile = enable;
+	m_live_idle_delay = idle_time;
+	m_live_idle_time = 0;
+
+	if (m_live_compile)
+	{
+		m_live_compiler.Start();
+	}
+}
+
+bool TextEditor::GetLiveCompile() const
+{
+	return m_live_compile;
+}
+
 void TextEditor::NewFile()
 {
 	if (!m_file_path.empty())
 	{
 		SaveFile();
 		m_file_path.clear();
+		WatchFiles();
 	}
 	m_editable_text.MoveTextBegin();
 	m_editable_text.MoveTextEnd(true);
@@ -295,6 +365,7 @@ void TextEditor::OpenFile()
 		ifs.close();
 
 		m_editable_text.SetText(std::wstring(&buffer[0]));
+		WatchFiles();
 	}
 	RefreshTextLayout();
 	ReloadPixelShader();
@@ -330,6 +401,7 @@ void TextEditor::SaveFile(bool save_as_new /*= false*/)
 	ofs.write(m_editable_text.GetText().c_str(), m_editable_text.GetText().length());
 	ofs.close();
 
+	WatchFiles();
 	ReloadPixelShader();
 }
 
@@ -713,6 +785,20 @@ void TextEditor::OnKeyPress(UINT32 key_code)
 		ReloadPixelShader();
 		break;
 
+	case VK_SPACE:
+		if (held_control)
+		{
+			AutoComplete();
+			RefreshTextLayout();
+		}
+		break;
+
+	case VK_F12:
+		if (held_shift) GoToNextReference();
+		else GoToDefinition();
+		RefreshTextLayout();
+		break;
+
 	default:
 		break;
 	}
@@ -720,10 +806,24 @@ void TextEditor::OnKeyPress(UINT32 key_code)
 
 void TextEditor::OnKeyCharacter(UINT32 char_code)
 {
+	// ctrl+space completes instead.
+	bool held_control = (GetKeyState(VK_CONTROL) & 0x80) != 0;
+	if (char_code == ' ' && held_control) return;
+
 	// only handle normal characters
 	if (char_code >= 0x20 && char_code < 0x7F)
 	{
 		wchar_t c = static_cast<wchar_t>(char_code);
+
+		// a word just finished counts as used, for the completion ranking.
+		const std::wstring& text = m_editable_text.GetText();
+		size_t pos = m_editable_text.GetCaretPos();
+		if (!IsNameChar(c) && pos != 0 && IsNameChar(text[pos - 1]))
+		{
+			size_t begin = pos - 1;
+			while (begin != 0 && IsNameChar(text[begin - 1])) --begin;
+			m_autocomplete.NoteUse(text.substr(begin, pos - begin));
+		}
 		if (c == '{')
 		{
 			m_editable_text.InsertText(L"{\n}");
@@ -871,16 +971,39 @@ void TextEditor::AutoJumpOut()
 	}
 }
 
-void TextEditor::ReloadPixelShader()
+void TextEditor::ReloadPixelShader(bool in_background /*= false*/)
 {
-	const std::wstring &text = m_editable_text.GetText();
-	tstring shader_content = ShaderHeader::GetHeaderText();
-	shader_content.append(text.begin(), text.end());
+	ContentHash fingerprint = ComputeFingerprint();
+	if (SkipUnchangedCompile(fingerprint)) return;
+
+	// only the header definitions the text can reach go to the compiler,
+	// and the header is only encoded again after that set changed.
+	const std::wstring& text = m_editable_text.GetText();
+	m_header_stripper.SetHeader(ShaderHeader::GetHeaderText(), ShaderHeader::GetSourceMap(), ShaderHeader::GetHeaderHash());
+	m_header_stripper.Strip(text);
+	m_input_assembler.SetHeader(m_header_stripper.GetText(), m_header_stripper.GetHash());
+	ShaderCompileInput input = m_input_assembler.Assemble(
+		text, "ps_main", "ps_4_0", compile_tier_flags[CT_Fast]);
+
+	if (m_live_compile || in_background)
+	{
+		SubmitLiveCompile(fingerprint, input, CT_Fast);
+		return;
+	}
+
+	m_submitted_revision = m_editable_text.GetRevision();
+	CompileTierTracker::Compile compile = {m_submitted_revision, fingerprint, m_header_stripper.GetSourceMap()};
+	m_tier_tracker.OnCompiledInPlace(compile);
+
+	bool compiled_ok = D3DApp::GetPostProcess()->LoadPixelShaderFromInput(input);
+	m_compile_succeeded = compiled_ok;
 
-	bool compiled_ok = D3DApp::GetPostProcess()->LoadPixelShaderFromMemory(shader_content, TEXT("ps_main"));
 	if (compiled_ok)
 	{
 		m_compile_error.Clear();
+
+		// swap in the optimized shader once the background compile is done.
+		SubmitLiveCompile(fingerprint, input, CT_Optimized);
 	}
 	else
 	{
@@ -888,59 +1011,436 @@ void TextEditor::ReloadPixelShader()
 	}
 }
 
-void TextEditor::ParseCompileError(const tstring& fxc_error)
+void TextEditor::SubmitLiveCompile(const ContentHash& fingerprint, const ShaderCompileInput& input, CompileTier first_tier)
 {
-	m_compile_error.Clear();
+	m_submitted_revision = m_editable_text.GetRevision();
+	CompileTierTracker::Compile compile = {m_submitted_revision, fingerprint, m_header_stripper.GetSourceMap()};
+	m_tier_tracker.OnSubmitted(compile);
+	m_live_compiler.Submit(m_submitted_revision, input, first_tier);
+}
 
-	if (!fxc_error.empty())
+void TextEditor::ApplyLiveCompileResult()
+{
+	LiveCompiler::Result result;
+	while (m_live_compiler.FetchResult(result))
 	{
-		std::istringstream iss(fxc_error);
-		
-		if (fxc_error[0] == '(')
+		if (!m_tier_tracker.OnResult(result.version, result.tier, result.succeeded)) continue;
+
+		// on failure the last good shader keeps running.
+		m_compile_succeeded = result.succeeded && D3DApp::GetPostProcess()->LoadPixelShaderFromBytecode(result.bytecode);
+		if (m_compile_succeeded)
+		{
+			m_compile_error.Clear();
+		}
+		else if (result.version == m_editable_text.GetRevision())
 		{
-			char igored_char;
-			iss >> igored_char;
-			iss >> m_compile_error.row >> igored_char >> m_compile_error.column;
-			iss >> igored_char >> igored_char;
+			// error locations are only meaningful for the text they came from.
+			ParseCompileError(result.succeeded ? D3DApp::GetPostProcess()->GetErrorMessage() :
+				tstring(result.error_message.begin(), result.error_message.end()));
+		}
+		else
+		{
+			// the error can not be located any more, so never skip its recompile.
+			m_compile_error.Clear();
+			m_tier_tracker.ForgetApplied();
+		}
+	}
+}
+
+void TextEditor::WatchFiles()
+{
+	if (!m_file_watcher) return;
+
+	std::vector<std::string> paths;
+	ShaderHeader::GetHeaderFiles(paths);
 
-			m_compile_error.row -= 1 + ShaderHeader::GetHeaderLines();
-			m_compile_error.column -= 1;
+	if (!m_file_path.empty())
+	{
+		// the watcher takes paths in the file system's narrow encoding.
+		int length = WideCharToMultiByte(CP_ACP, 0, m_file_path.c_str(), -1, NULL, 0, NULL, NULL);
+		std::vector<char> path(length + 1);
+		WideCharToMultiByte(CP_ACP, 0, m_file_path.c_str(), -1, &path[0], length, NULL, NULL);
+		paths.push_back(&path[0]);
+	}
+
+	std::set<std::string> watched(paths.begin(), paths.end());
+	for (auto it = m_watched_files.begin(); it != m_watched_files.end(); ++it)
+	{
+		if (watched.find(*it) == watched.end()) m_file_watcher->Unwatch(*it);
+	}
+	for (auto it = watched.begin(); it != watched.end(); ++it)
+	{
+		if (m_watched_files.find(*it) == m_watched_files.end()) m_file_watcher->Watch(*it);
+	}
+	m_watched_files.swap(watched);
+	m_document_file = m_file_path.empty() ? std::string() : paths.back();
+}
+
+void TextEditor::UpdateFileWatcher(float delta_time)
+{
+	if (!m_file_watcher)
+	{
+		// only changed header files are reloaded.
+		m_header_poll_time += delta_time;
+		if (m_header_poll_time >= header_poll_interval)
+		{
+			m_header_poll_time = 0;
+			if (ShaderHeader::RefreshShaderHeader()) ReloadPixelShader();
 		}
+		return;
+	}
 
-		std::string ignored_word;
-		iss >> ignored_word >> ignored_word;
+	std::vector<std::string> changed;
+	m_file_watcher->ReadChanges(changed);
+	m_file_debouncer.AddChanges(changed);
 
-		assert(iss.good());
-		std::wstring message(fxc_error.begin() + static_cast<int>(iss.tellg()), fxc_error.end());
-		m_compile_error.message = message.substr(1, message.find_first_of('\n'));
+	std::vector<std::string> settled;
+	m_file_debouncer.Update(delta_time, settled);
+	if (settled.empty()) return;
 
-		// calculate error location
-		if (m_compile_error.row < static_cast<int>(m_line_offset))
+	bool document_changed = false;
+	bool header_changed = false;
+	for (size_t i = 0; i != settled.size(); ++i)
+	{
+		if (!m_document_file.empty() && settled[i] == m_document_file) document_changed = true;
+		else
 		{
-			m_compile_error.location = float2(0, -20.0f);
+			// the watcher knows better than a time stamp of a second.
+			ShaderHeader::InvalidateHeaderFile(settled[i]);
+			header_changed = true;
 		}
-		else if (m_compile_error.row >= static_cast<int>(m_line_offset + MAX_NUM_LINES))
+	}
+
+	if (header_changed && ShaderHeader::RefreshShaderHeader())
+	{
+		// the header may include other files now.
+		WatchFiles();
+	}
+
+	bool text_changed = document_changed && ReloadDocument();
+	if (text_changed || header_changed)
+	{
+		// never stall the frame for a change made elsewhere.
+		ReloadPixelShader(true);
+	}
+}
+
+bool TextEditor::ReloadDocument()
+{
+	std::wifstream ifs(m_file_path.c_str());
+	if (!ifs.is_open()) return false;
+
+	std::wstring text((std::istreambuf_iterator<wchar_t>(ifs)), std::istreambuf_iterator<wchar_t>());
+	ifs.close();
+
+	// our own saves come back here as well.
+	if (text == m_editable_text.GetText()) return false;
+
+	// replace the text as an edit, so it can be undone.
+	size_t caret_pos = m_editable_text.GetCaretPos();
+	m_editable_text.MoveTextBegin();
+	m_editable_text.MoveTextEnd(true);
+	m_editable_text.InsertText(text);
+	m_editable_text.SetCaretPos(std::min(caret_pos, text.length()));
+	RefreshTextLayout();
+	return true;
+}
+
+ContentHash TextEditor::ComputeFingerprint() const
+{
+	ContentHash tokens_hash = m_syntax_hightlighter.GetFingerprint(m_editable_text.GetText());
+
+	ContentHasher hasher;
+	hasher.Update(&ShaderHeader::GetHeaderHash(), sizeof(ContentHash));
+	hasher.Update(&tokens_hash, sizeof(ContentHash));
+	return hasher.Finish();
+}
+
+bool TextEditor::SkipUnchangedCompile(const ContentHash& fingerprint)
+{
+	if (!m_tier_tracker.IsApplied(fingerprint)) return false;
+
+	// a failed compile can only be skipped if its error can follow the edit.
+	if (!m_compile_succeeded && m_compile_error.row >= 0 && !m_compile_error.has_anchor) return false;
+
+	// nothing but comments or whitespace changed. results still in flight
+	// for other code are stale, but a pending optimized tier of this code is not.
+	m_submitted_revision = m_editable_text.GetRevision();
+	m_tier_tracker.OnUnchanged(fingerprint);
+
+	if (!m_compile_succeeded)
+	{
+		RelocateCompileError(m_compile_error);
+	}
+	return true;
+}
+
+void TextEditor::UpdateLint()
+{
+	size_t revision = m_editable_text.GetRevision();
+	if (revision == m_linted_revision) return;
+	m_linted_revision = revision;
+
+	// the highlighter tokenized the text already, on the edit, and the
+	// parser takes over the parts of the last tree the edit left alone.
+	m_shader_parser.Parse(m_editable_text.GetText(), m_syntax_hightlighter.GetTokens());
+	m_shader_linter.SetHeader(ShaderHeader::GetHeaderText(), ShaderHeader::GetHeaderHash());
+	m_shader_linter.Lint(m_shader_parser);
+	m_symbol_index.Update(m_shader_parser);
+	ShowLintDiagnostic();
+}
+
+void TextEditor::ShowLintDiagnostic()
+{
+	const std::vector<ShaderLinter::Diagnostic>& diagnostics = m_shader_linter.GetDiagnostics();
+	if (diagnostics.empty())
+	{
+		// the problem is gone, while compile errors stay until the next compile.
+		m_lint_error.Clear();
+		return;
+	}
+
+	const ShaderLinter::Diagnostic& shown = diagnostics.front();
+	std::ostringstream message;
+	message << shown.message;
+	if (diagnostics.size() > 1) message << " (+" << diagnostics.size() - 1 << " more)";
+
+	m_lint_error.Clear();
+	std::string message_text = message.str();
+	m_lint_error.message.assign(message_text.begin(), message_text.end());
+
+	if (shown.is_located)
+	{
+		SetCompileErrorPos(m_lint_error, shown.start_pos);
+		m_lint_error.has_anchor = m_syntax_hightlighter.GetSignificantTokenAnchor(
+			shown.start_pos, m_lint_error.anchor_ordinal, m_lint_error.anchor_offset);
+	}
+
+	LocateCompileError(m_lint_error);
+}
+
+void TextEditor::GoToDefinition()
+{
+	size_t item = 0;
+	std::vector<ShaderSymbolIndex::Symbol> definitions;
+	if (!FindCaretItem(item) || !m_symbol_index.FindDefinitions(item, definitions)) return;
+
+	size_t next = 0;
+	while (next != definitions.size() && definitions[next].item <= item) ++next;
+	SelectItem(definitions[next != definitions.size() ? next : 0].item);
+}
+
+void TextEditor::GoToNextReference()
+{
+	size_t item = 0;
+	std::vector<size_t> references;
+	if (!FindCaretItem(item) || !m_symbol_index.FindReferences(item, references)) return;
+
+	auto next = std::upper_bound(references.begin(), references.end(), item);
+	SelectItem(next != references.end() ? *next : references.front());
+}
+
+bool TextEditor::FindCaretItem(size_t& item)
+{
+	// the key may come before the update of this frame.
+	UpdateLint();
+
+	size_t pos = m_editable_text.GetCaretPos();
+	if (!m_shader_parser.FindItem(pos, item)) return false;
+
+	// right between a bracket and a name, the name is meant.
+	const std::vector<ShaderParser::Item>& items = m_shader_parser.GetItems();
+	bool is_separator = items[item].token->type == ShaderTokenizer::TT_Separator;
+	if (is_separator && item + 1 < items.size() && items[item + 1].token->start_pos == pos) ++item;
+	return true;
+}
+
+void TextEditor::SelectItem(size_t item)
+{
+	const ShaderTokenizer::Token* token = m_shader_parser.GetItems()[item].token;
+	m_editable_text.SetCaretPos(token->start_pos);
+	m_editable_text.SetCaretPos(token->end_pos, true);
+}
+
+void TextEditor::AutoComplete()
+{
+	UpdateLint();
+	const std::wstring& text = m_editable_text.GetText();
+	size_t pos = m_editable_text.GetCaretPos();
+
+	if (m_completions.empty() || m_editable_text.GetRevision() != m_completion_revision)
+	{
+		size_t begin = pos;
+		while (begin != 0 && IsNameChar(text[begin - 1])) --begin;
+
+		// a member after a '.', a semantic after a ':' and maybe spaces.
+		size_t before = begin;
+		while (before != 0 && (text[before - 1] == ' ' || text[before - 1] == '\t')) --before;
+		ShaderAutocomplete::CompletionContext context = ShaderAutocomplete::CC_Global;
+		if (begin != 0 && text[begin - 1] == '.') context = ShaderAutocomplete::CC_Member;
+		else if (before != 0 && text[before - 1] == ':' && (before == 1 || text[before - 2] != ':')) context = ShaderAutocomplete::CC_Semantic;
+
+		// the symbols in scope at the nearest item before the caret.
+		std::vector<std::wstring> names;
+		size_t item = 0;
+		size_t item_pos = begin;
+		while (item_pos != 0 && !m_shader_parser.FindItem(item_pos, item)) --item_pos;
+		if (m_shader_parser.FindItem(item_pos, item))
 		{
-			m_compile_error.location = float2(0, m_text_layout->GetMaxHeight() + 30.0f);
+			std::vector<ShaderSymbolIndex::Symbol> symbols;
+			m_symbol_index.GetVisibleSymbols(item, symbols);
+			for (size_t i = 0; i != symbols.size(); ++i) names.push_back(symbols[i].name);
 		}
-		else
+		m_autocomplete.SetSymbols(names);
+
+		m_autocomplete.Complete(text.substr(begin, pos - begin), context, 16, m_completions);
+		if (m_completions.empty()) return;
+		m_completion_begin = begin;
+		m_completion_index = 0;
+	}
+	else m_completion_index = (m_completion_index + 1) % m_completions.size();
+
+	m_editable_text.SetCaretPos(m_completion_begin);
+	m_editable_text.SetCaretPos(pos, true);
+	m_editable_text.InsertText(m_completions[m_completion_index].word);
+	m_completion_revision = m_editable_text.GetRevision();
+}
+
+void TextEditor::ParseCompileError(const tstring& fxc_error)
+{
+	m_compile_error.Clear();
+
+	if (!fxc_error.empty())
+	{
+		// the compile input is the stripped header followed by the editor text.
+		const std::wstring& text = m_editable_text.GetText();
+		ShaderSourceMap source_map;
+		const ShaderSourceMapPtr& header_map = m_tier_tracker.GetApplied().header_map;
+		if (header_map) source_map = *header_map;
+		source_map.AddSegment(editor_source_name, static_cast<size_t>(std::count(text.begin(), text.end(), '\n')) + 1);
+
+		ShaderErrorTip tip = MakeShaderErrorTip(std::string(fxc_error.begin(), fxc_error.end()), source_map, editor_source_name);
+		m_compile_error.row = tip.row;
+		m_compile_error.column = tip.column;
+		m_compile_error.message.assign(tip.message.begin(), tip.message.end());
+
+		// remember the error by token, so it can be relocated after comment edits.
+		if (m_compile_error.row >= 0)
 		{
-			size_t subtext_begin = m_editable_text.GetTextPos(m_line_offset, 0);
 			size_t error_pos = m_editable_text.GetTextPos(m_compile_error.row, m_compile_error.column);
+			m_compile_error.has_anchor = m_syntax_hightlighter.GetSignificantTokenAnchor(
+				error_pos, m_compile_error.anchor_ordinal, m_compile_error.anchor_offset);
+		}
 
-			assert(error_pos >= subtext_begin);
-			DWRITE_HIT_TEST_METRICS hit_test_metrics;
-			m_text_layout->HitTestTextPosition(
-				error_pos - subtext_begin,
-				false,
-				&m_compile_error.location.x,
-				&m_compile_error.location.y,
-				&hit_test_metrics);
+		LocateCompileError(m_compile_error);
+	}
+}
 
-			m_compile_error.is_located = true;
+void TextEditor::SetCompileErrorPos(CompileError& error, size_t pos)
+{
+	const std::wstring& text = m_editable_text.GetText();
+	size_t line_begin = std::min(pos, text.length());
+	while (line_begin > 0 && text[line_begin - 1] != '\n') --line_begin;
+	error.row = static_cast<int>(std::count(text.begin(), text.begin() + line_begin, '\n'));
+	error.column = static_cast<int>(pos - line_begin);
+}
+
+void TextEditor::RelocateCompileError(CompileError& error)
+{
+	if (error.row >= 0)
+	{
+		size_t error_pos = 0;
+		if (!m_syntax_hightlighter.GetSignificantTokenPos(
+			error.anchor_ordinal, error.anchor_offset, error_pos)) return;
+
+		SetCompileErrorPos(error, error_pos);
+	}
+
+	LocateCompileError(error);
+}
+
+void TextEditor::LocateCompileError(CompileError& error)
+{
+	error.is_located = false;
+
+	// calculate error location
+	if (error.row < static_cast<int>(m_line_offset))
+	{
+		error.location = float2(0, -20.0f);
+	}
+	else if (error.row >= static_cast<int>(m_line_offset + MAX_NUM_LINES))
+	{
+		error.location = float2(0, m_text_layout->GetMaxHeight() + 30.0f);
+	}
+	else
+	{
+		size_t subtext_begin = m_editable_text.GetTextPos(m_line_offset, 0);
+		size_t error_pos = m_editable_text.GetTextPos(error.row, error.column);
+
+		assert(error_pos >= subtext_begin);
+		DWRITE_HIT_TEST_METRICS hit_test_metrics;
+		m_text_layout->HitTestTextPosition(
+			error_pos - subtext_begin,
+			false,
+			&error.location.x,
+			&error.location.y,
+			&hit_test_metrics);
+
+		error.is_located = true;
+	}
+
+	error.remain_time = 3.0f;
+	error.alpha = 1.0f;
+}
+
+void TextEditor::UpdateCompileError(CompileError& error, float delta_time)
+{
+	if (error.remain_time > 0)
+	{
+		error.remain_time -= delta_time;
+
+		if (error.remain_time > 1.0f)
+		{
+			error.alpha = 1.0f;
+		}
+		else
+		{
+			error.alpha = error.remain_time;
 		}
+	}
+}
 
-		m_compile_error.remain_time = 3.0f;
-		m_compile_error.alpha = 1.0f;
+void TextEditor::DrawCompileError(ID2D1RenderTarget* d2d_rt, const D2D1_RECT_F& rect, const CompileError& error) const
+{
+	m_default_brush->SetColor(D2D1::ColorF(1.0f, 1.0f, 1.0f, 0.9f * error.alpha));
+	d2d_rt->SetAntialiasMode(D2D1_ANTIALIAS_MODE_PER_PRIMITIVE);
+	float2 error_loc = error.location + float2(150, 150);
+	D2D1_RECT_F err_rect = D2D1::RectF(rect.left, error_loc.y - 16.0f, rect.right, error_loc.y);
+	D2D1_ROUNDED_RECT tip_rect = D2D1::RoundedRect(err_rect, 3.0f, 3.0f);
+	d2d_rt->FillRoundedRectangle(tip_rect, m_default_brush);
+
+	m_default_brush->SetColor(D2D1::ColorF(0.7f, 0.0f, 0.0f, error.alpha));
+	if (!error.is_located)
+	{
+		m_text_format_small->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_CENTER);
+	}
+	else if (error.location.x > m_text_layout->GetMaxWidth() / 2.0f)
+	{
+		m_text_format_small->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
+	}
+	else
+	{
+		m_text_format_small->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_TRAILING);
+	}
+	
+	D2D1_RECT_F msg_rect =D2D1::RectF(err_rect.left + 10.0f, err_rect.top, err_rect.right - 10.0f, err_rect.bottom);
+	d2d_rt->DrawTextA(error.message.c_str(), error.message.length(), m_text_format_small, msg_rect, m_default_brush);
+	
+	if (error.is_located)
+	{
+		float2 arrow_loc = error_loc + float2(0, cos(D3DApp::GetTimer()->GetTime() * 5.0f) * 3.0f - 2.0f);
+		d2d_rt->DrawLine(D2D1::Point2F(arrow_loc.x, arrow_loc.y),  D2D1::Point2F(arrow_loc.x, arrow_loc.y - 12.0f), m_default_brush);
+		d2d_rt->DrawLine(D2D1::Point2F(arrow_loc.x, arrow_loc.y),  D2D1::Point2F(arrow_loc.x - 4.0f, arrow_loc.y - 5.0f), m_default_brush);
+		d2d_rt->DrawLine(D2D1::Point2F(arrow_loc.x, arrow_loc.y),  D2D1::Point2F(arrow_loc.x + 4.0f, arrow_loc.y - 5.0f), m_default_brush);
 	}
 }
@@ -3,8 +3,16 @@
 
 #include <boost/shared_ptr.hpp>
 #include <map>
+#include <set>
 #include "syntax_highlighter.hpp"
 #include "editable_text.hpp"
+#include "live_compiler.hpp"
+#include "shader_input_assembler.hpp"
+#include "shader_header_stripper.hpp"
+#include "shader_linter.hpp"
+#include "shader_symbol_index.hpp"
+#include "shader_autocomplete.hpp"
+#include "file_watcher.hpp"
 
 class TextEditor;
 typedef boost::shared_ptr<TextEditor> TextEditorPtr;
@@ -17,6 +25,10 @@ class TextEditor
 		int column;
 		std::wstring message;
 
+		bool has_anchor;
+		size_t anchor_ordinal;
+		size_t anchor_offset;
+
 		bool is_located;
 		float2 location;
 		float remain_time;
@@ -43,6 +55,10 @@ public:
 	void OpenFile();
 	void SaveFile(bool save_as_new = false);
 
+	// recompile in background once the text stays unchanged for idle_time seconds.
+	void SetLiveCompile(bool enable, float idle_time = 0.5f);
+	bool GetLiveCompile() const;
+
 private:
 	void RefreshTextLayout();
 
@@ -51,8 +67,35 @@ private:
 	void AutoJumpInto();
 	void AutoJumpOut();
 
-	void ReloadPixelShader();
+	void ReloadPixelShader(bool in_background = false);
+	void SubmitLiveCompile(const ContentHash& fingerprint, const ShaderCompileInput& input, CompileTier first_tier);
+	void ApplyLiveCompileResult();
+
+	void WatchFiles();
+	void UpdateFileWatcher(float delta_time);
+	bool ReloadDocument();
+
+	ContentHash ComputeFingerprint() const;
+	bool SkipUnchangedCompile(const ContentHash& fingerprint);
+
+	void UpdateLint();
+	void ShowLintDiagnostic();
+
+	// F12 and shift+F12, each press moves on to the next overload or use.
+	void GoToDefinition();
+	void GoToNextReference();
+	bool FindCaretItem(size_t& item);
+	void SelectItem(size_t item);
+
+	// ctrl+space, pressed again for the next candidate.
+	void AutoComplete();
+
 	void ParseCompileError(const tstring& fxc_error);
+	void SetCompileErrorPos(CompileError& error, size_t pos);
+	void RelocateCompileError(CompileError& error);
+	void LocateCompileError(CompileError& error);
+	void UpdateCompileError(CompileError& error, float delta_time);
+	void DrawCompileError(ID2D1RenderTarget* d2d_rt, const D2D1_RECT_F& rect, const CompileError& error) const;
 
 	void OnMousePress(UINT message, float x, float y);
 	void OnMouseRelease(UINT message, float x, float y);
@@ -67,8 +110,38 @@ private:
 	EditableText m_editable_text;
 	std::wstring m_file_path;
 
+	FileWatcherPtr m_file_watcher;
+	FileChangeDebouncer m_file_debouncer;
+	std::set<std::string> m_watched_files;
+	std::string m_document_file;
+	float m_header_poll_time;
+
 	SyntaxHighlighter m_syntax_hightlighter;
+	// lint findings never replace a compile error, which is drawn first.
 	CompileError m_compile_error;
+	CompileError m_lint_error;
+
+	ShaderParser m_shader_parser;
+	ShaderLinter m_shader_linter;
+	ShaderSymbolIndex m_symbol_index;
+	size_t m_linted_revision;
+
+	ShaderAutocomplete m_autocomplete;
+	std::vector<ShaderAutocomplete::Candidate> m_completions;
+	size_t m_completion_index;
+	size_t m_completion_begin;		// of the word completed
+	size_t m_completion_revision;	// of the text completed last
+
+	ShaderHeaderStripper m_header_stripper;
+	ShaderInputAssembler m_input_assembler;
+	LiveCompiler m_live_compiler;
+	bool m_live_compile;
+	float m_live_idle_delay;
+	float m_live_idle_time;
+	size_t m_live_revision;
+	size_t m_submitted_revision;
+	CompileTierTracker m_tier_tracker;
+	bool m_compile_succeeded;
 
 	size_t m_line_offset;
 	float3 m_caret_loc_hight;
@@ -0,0 +1,213 @@
+#include "common.hpp"
+#include "shader_validator.hpp"
+#include "shader_include_graph.hpp"
+#include "stub_shader_compiler.hpp"
+#include "command_shader_compiler.hpp"
+#include "compile_server.hpp"
+#include "cached_shader_compiler.hpp"
+#ifdef _WIN32
+#include "fxc_shader_compiler.hpp"
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// validates shaders in a batch, e.g. every saved shader before a show:
+//   validate_shaders [options] [file|directory ...]
+// run from the bin directory, it checks save/ against the headers in fx/.
+
+static const char default_shader_directory[] = "save";
+static const char default_header_directory[] = "fx/";
+static const char header_root[] = "header.hlsl";
+static const char command_work_directory[] = "cache/validate";
+#ifdef _WIN32
+static const char compile_worker_name[] = "compile_worker.exe";
+#else
+static const char compile_worker_name[] = "compile_worker";
+#endif
+
+static void PrintUsage()
+{
+	std::cerr <<
+		"usage: validate_shaders [options] [file|directory ...]\n"
+		"  -j, --jobs N         worker threads, one per hardware thread by default\n"
+		"  -o, --output FILE    write the JSON report to FILE instead of stdout\n"
+		"  --fx DIR             header directory, fx/ by default\n"
+		"  --compiler NAME      stub, command"
+#ifdef _WIN32
+		" or fxc, fxc by default\n"
+#else
+		", stub by default\n"
+#endif
+		"  --command TEMPLATE   the command line of the command compiler, e.g.\n"
+		"                       \"dxc -T {profile} -E {entry} {flags} -Fo {output} {input}\"\n"
+		"  --optimize           compile with the optimized flags instead of the fast ones\n"
+		"  --server             compile in worker processes, one per thread\n"
+		"  --timeout MS         with --server, fail compiles which take longer\n"
+		"  --worker-delay MS    with --server and the stub compiler, make every\n"
+		"                       compile take that long, e.g. to try --timeout\n"
+		"  --cache DIR          answer unchanged inputs from the shader cache in DIR\n"
+		"  -q, --quiet          no per file summary on stderr\n";
+}
+
+static ShaderCompilerPtr CreateCompiler(const std::string& name, const std::string& command)
+{
+	if (name == "stub") return ShaderCompilerPtr(new StubShaderCompiler);
+	if (name == "command" && !command.empty()) return ShaderCompilerPtr(new CommandShaderCompiler(command, command_work_directory));
+#ifdef _WIN32
+	if (name == "fxc") return ShaderCompilerPtr(new FxcShaderCompiler);
+#endif
+	return ShaderCompilerPtr();
+}
+
+// the worker runs the chosen compiler, and sits next to this program.
+static std::vector<std::string> MakeWorkerCommand(const std::string& program, const std::string& compiler_name, const std::string& command, unsigned int delay)
+{
+	size_t separator = program.find_last_of("/\\");
+	std::string directory = separator == std::string::npos ? "." : program.substr(0, separator);
+
+	std::vector<std::string> worker_command;
+	worker_command.push_back(directory + "/" + compile_worker_name);
+	worker_command.push_back("--compiler");
+	worker_command.push_back(compiler_name);
+	if (!command.empty())
+	{
+		worker_command.push_back("--command");
+		worker_command.push_back(command);
+	}
+	if (delay != 0)
+	{
+		worker_command.push_back("--delay");
+		worker_command.push_back(boost::lexical_cast<std::string>(delay));
+	}
+	return worker_command;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t num_threads = 0;
+	std::string output_path;
+	std::string header_directory = default_header_directory;
+#ifdef _WIN32
+	std::string compiler_name = "fxc";
+#else
+	std::string compiler_name = "stub";
+#endif
+	std::string command;
+	unsigned int flags = SCF_SkipOptimization;
+	bool quiet = false;
+	bool use_server = false;
+	unsigned int timeout = 0;
+	unsigned int worker_delay = 0;
+	std::string cache_directory;
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if ((arg == "-j" || arg == "--jobs") && has_value) num_threads = lexical_cast_no_exception<size_t>(std::string(argv[++i]));
+		else if ((arg == "-o" || arg == "--output") && has_value) output_path = argv[++i];
+		else if (arg == "--fx" && has_value) header_directory = argv[++i];
+		else if (arg == "--compiler" && has_value) compiler_name = argv[++i];
+		else if (arg == "--command" && has_value) {command = argv[++i]; compiler_name = "command";}
+		else if (arg == "--optimize") flags = SCF_OptimizationLevel3;
+		else if (arg == "--server") use_server = true;
+		else if (arg == "--timeout" && has_value) timeout = lexical_cast_no_exception<unsigned int>(std::string(argv[++i]));
+		else if (arg == "--worker-delay" && has_value) worker_delay = lexical_cast_no_exception<unsigned int>(std::string(argv[++i]));
+		else if (arg == "--cache" && has_value) cache_directory = argv[++i];
+		else if (arg == "-q" || arg == "--quiet") quiet = true;
+		else if (arg == "-h" || arg == "--help") {PrintUsage(); return 0;}
+		else if (!arg.empty() && arg[0] == '-') {PrintUsage(); return 2;}
+		else paths.push_back(arg);
+	}
+	if (paths.empty()) paths.push_back(default_shader_directory);
+
+	ShaderCompilerPtr compiler = CreateCompiler(compiler_name, command);
+	if (!compiler)
+	{
+		std::cerr << "unknown compiler '" << compiler_name << "'" << (compiler_name == "command" ? ", --command is missing" : "") << "\n";
+		return 2;
+	}
+
+	if (use_server)
+	{
+		size_t num_workers = num_threads != 0 ? num_threads : boost::thread::hardware_concurrency();
+		CompileServerPtr compile_server(new CompileServer(MakeWorkerCommand(argv[0], compiler_name, command, worker_delay), num_workers));
+		if (timeout != 0) compile_server->SetTimeout(timeout);
+		if (!compile_server->Start())
+		{
+			std::cerr << "the compile workers could not be started\n";
+			return 2;
+		}
+		compiler = compile_server;
+		compiler_name = "server/" + compiler_name;
+	}
+	if (!cache_directory.empty())
+	{
+		compiler = ShaderCompilerPtr(new CachedShaderCompiler(compiler, ShaderCachePtr(new ShaderCache(cache_directory))));
+		compiler_name = "cached/" + compiler_name;
+	}
+
+	std::vector<std::string> files;
+	for (size_t i = 0; i != paths.size(); ++i)
+	{
+		if (IsDirectory(paths[i])) ListShaderFiles(paths[i], files);
+		else files.push_back(paths[i]);
+	}
+
+	// the same header the editor puts in front of its text.
+	ShaderIncludeGraph include_graph(header_directory);
+	include_graph.AddRoot(header_root);
+	include_graph.Refresh();
+
+	boost::posix_time::ptime begin = boost::posix_time::microsec_clock::universal_time();
+
+	ShaderValidator validator(compiler, num_threads);
+	validator.SetHeader(include_graph.GetText(), include_graph.GetSourceMap(), include_graph.GetHash());
+	validator.SetCompileFlags(flags);
+
+	ShaderValidations results;
+	validator.Validate(files, results);
+
+	double total_time = (boost::posix_time::microsec_clock::universal_time() - begin).total_microseconds() / 1000.0;
+
+	size_t num_failed = 0;
+	for (size_t i = 0; i != results.size(); ++i)
+	{
+		const ShaderValidation& result = results[i];
+		if (result.status != VS_Succeeded) ++num_failed;
+		if (quiet) continue;
+
+		std::cerr << result.file << ": " << (result.status == VS_Succeeded ? "ok" : (result.status == VS_Failed ? "FAILED" : "UNREADABLE"));
+		std::cerr << " (" << result.total_time << " ms)\n";
+		for (size_t j = 0; j != result.diagnostics.size(); ++j)
+		{
+			const ShaderDiagnostic& diagnostic = result.diagnostics[j];
+			std::cerr << "  ";
+			if (diagnostic.is_mapped) std::cerr << diagnostic.source << "(" << diagnostic.source_line << "): ";
+			std::cerr << (diagnostic.severity == DS_Error ? "error" : "warning");
+			if (!diagnostic.code.empty()) std::cerr << " " << diagnostic.code;
+			std::cerr << ": " << diagnostic.message << "\n";
+		}
+	}
+	if (!quiet)
+	{
+		WorkStealingPool::Statistics statistics = validator.GetPoolStatistics();
+		std::cerr << results.size() - num_failed << "/" << results.size() << " shaders ok, "
+			<< validator.GetNumThreads() << " threads, " << statistics.stolen << " stolen, " << total_time << " ms\n";
+	}
+
+	if (output_path.empty())
+	{
+		ShaderValidator::WriteReport(std::cout, results, compiler_name, validator.GetNumThreads(), total_time);
+	}
+	else
+	{
+		std::ofstream ofs(output_path.c_str(), std::ios::trunc);
+		ShaderValidator::WriteReport(ofs, results, compiler_name, validator.GetNumThreads(), total_time);
+	}
+	return num_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+#include "common.hpp"
+#include "win32_file_watcher.hpp"
+
+static const DWORD notify_filter =
+	FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+Win32FileWatcher::Win32FileWatcher()
+{
+
+}
+
+Win32FileWatcher::~Win32FileWatcher()
+{
+	for (auto it = m_directories.begin(); it != m_directories.end(); ++it)
+	{
+		FindCloseChangeNotification(it->second.notification);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+bool Win32FileWatcher::IsValid() const
+{
+	return true;
+}
+
+bool Win32FileWatcher::Watch(const std::string& path)
+{
+	std::string directory = GetDirectory(path);
+
+	auto it = m_directories.find(directory);
+	if (it == m_directories.end())
+	{
+		HANDLE notification = FindFirstChangeNotificationA(directory.c_str(), FALSE, notify_filter);
+		if (notification == INVALID_HANDLE_VALUE) return false;
+
+		it = m_directories.insert(std::make_pair(directory, Directory())).first;
+		it->second.notification = notification;
+	}
+
+	it->second.files[path] = PollingFileWatcher::GetFileState(path);
+	return true;
+}
+
+void Win32FileWatcher::Unwatch(const std::string& path)
+{
+	auto it = m_directories.find(GetDirectory(path));
+	if (it == m_directories.end()) return;
+
+	it->second.files.erase(path);
+	if (!it->second.files.empty()) return;
+
+	FindCloseChangeNotification(it->second.notification);
+	m_directories.erase(it);
+}
+
+void Win32FileWatcher::ReadChanges(std::vector<std::string>& paths)
+{
+	for (auto it = m_directories.begin(); it != m_directories.end(); ++it)
+	{
+		Directory& directory = it->second;
+		if (WaitForSingleObject(directory.notification, 0) != WAIT_OBJECT_0) continue;
+		FindNextChangeNotification(directory.notification);
+
+		for (auto file = directory.files.begin(); file != directory.files.end(); ++file)
+		{
+			PollingFileWatcher::FileState state = PollingFileWatcher::GetFileState(file->first);
+			if (state == file->second) continue;
+
+			file->second = state;
+			paths.push_back(file->first);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// private subroutines
+//////////////////////////////////////////////////////////////////////////
+std::string Win32FileWatcher::GetDirectory(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	if (slash == std::string::npos) return ".";
+	return path.substr(0, slash + 1);
+}
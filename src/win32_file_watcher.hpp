@@ -0,0 +1,35 @@
+#ifndef _WIN32_FILE_WATCHER_HPP_INCLUDED_
+#define _WIN32_FILE_WATCHER_HPP_INCLUDED_
+
+#include "polling_file_watcher.hpp"
+
+// windows change notification, one per directory holding watched files.
+// a signaled directory only tells something in it changed, so its files
+// are then compared against their last known state.
+class Win32FileWatcher : public FileWatcher
+{
+public:
+	Win32FileWatcher();
+	virtual ~Win32FileWatcher();
+
+public:
+	bool IsValid() const;
+
+	virtual bool Watch(const std::string& path);
+	virtual void Unwatch(const std::string& path);
+	virtual void ReadChanges(std::vector<std::string>& paths);
+
+private:
+	struct Directory
+	{
+		HANDLE notification;
+		std::map<std::string, PollingFileWatcher::FileState> files;	// watched path -> last state
+	};
+
+	static std::string GetDirectory(const std::string& path);
+
+private:
+	std::map<std::string, Directory> m_directories;
+};
+
+#endif  // _WIN32_FILE_WATCHER_HPP_INCLUDED_
@@ -0,0 +1,163 @@
+#include "common.hpp"
+#include "work_stealing_pool.hpp"
+
+#include <boost/bind.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+WorkStealingPool::WorkStealingPool(size_t num_threads /*= 0*/)
+	: m_num_queued(0)
+	, m_num_pending(0)
+	, m_next_worker(0)
+	, m_quit(false)
+{
+	m_statistics.executed = 0;
+	m_statistics.stolen = 0;
+
+	if (num_threads == 0) num_threads = boost::thread::hardware_concurrency();
+	if (num_threads == 0) num_threads = 1;
+
+	for (size_t i = 0; i != num_threads; ++i)
+	{
+		m_workers.push_back(boost::shared_ptr<Worker>(new Worker()));
+	}
+	for (size_t i = 0; i != num_threads; ++i)
+	{
+		m_threads.create_thread(boost::bind(&WorkStealingPool::WorkerProc, this, i));
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_quit = true;
+	}
+	m_work_condition.notify_all();
+	m_threads.join_all();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+void WorkStealingPool::Submit(const Task& task)
+{
+	size_t index = 0;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		int worker_index = GetWorkerIndex();
+		if (worker_index >= 0)
+		{
+			index = static_cast<size_t>(worker_index);
+		}
+		else
+		{
+			index = m_next_worker;
+			m_next_worker = (m_next_worker + 1) % m_workers.size();
+		}
+		++m_num_pending;
+	}
+
+	{
+		Worker& worker = *m_workers[index];
+		boost::mutex::scoped_lock lock(worker.mutex);
+		worker.tasks.push_back(task);
+	}
+
+	// counted only once the task can be found, so no worker sleeps past it.
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		++m_num_queued;
+	}
+	m_work_condition.notify_one();
+}
+
+void WorkStealingPool::Wait()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	while (m_num_pending != 0) m_idle_condition.wait(lock);
+}
+
+size_t WorkStealingPool::GetNumThreads() const
+{
+	return m_workers.size();
+}
+
+WorkStealingPool::Statistics WorkStealingPool::GetStatistics() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_statistics;
+}
+
+int WorkStealingPool::GetWorkerIndex() const
+{
+	const int* index = m_worker_index.get();
+	return index != NULL ? *index : -1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// worker thread
+//////////////////////////////////////////////////////////////////////////
+void WorkStealingPool::WorkerProc(size_t index)
+{
+	m_worker_index.reset(new int(static_cast<int>(index)));
+
+	while (true)
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			while (m_num_queued == 0 && !m_quit) m_work_condition.wait(lock);
+			if (m_quit) break;
+
+			// reserve a task, some queue is sure to hold it.
+			--m_num_queued;
+		}
+
+		Task task;
+		bool stolen = false;
+		while (!PopTask(index, task))
+		{
+			if (StealTask(index, task))
+			{
+				stolen = true;
+				break;
+			}
+		}
+
+		task();
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		++m_statistics.executed;
+		if (stolen) ++m_statistics.stolen;
+		if (--m_num_pending == 0) m_idle_condition.notify_all();
+	}
+}
+
+bool WorkStealingPool::PopTask(size_t index, Task& task)
+{
+	Worker& worker = *m_workers[index];
+	boost::mutex::scoped_lock lock(worker.mutex);
+	if (worker.tasks.empty()) return false;
+
+	// the newest task of its own queue is the warmest one.
+	task.swap(worker.tasks.back());
+	worker.tasks.pop_back();
+	return true;
+}
+
+bool WorkStealingPool::StealTask(size_t index, Task& task)
+{
+	for (size_t i = 1; i < m_workers.size(); ++i)
+	{
+		Worker& victim = *m_workers[(index + i) % m_workers.size()];
+		boost::mutex::scoped_lock lock(victim.mutex);
+		if (victim.tasks.empty()) continue;
+
+		// the oldest task of a victim is the one it would run last.
+		task.swap(victim.tasks.front());
+		victim.tasks.pop_front();
+		return true;
+	}
+	return false;
+}
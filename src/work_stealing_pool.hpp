@@ -0,0 +1,73 @@
+#ifndef _WORK_STEALING_POOL_HPP_INCLUDED_
+#define _WORK_STEALING_POOL_HPP_INCLUDED_
+
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+class WorkStealingPool;
+typedef boost::shared_ptr<WorkStealingPool> WorkStealingPoolPtr;
+
+// runs tasks on a fixed set of worker threads. every worker owns a queue:
+// it takes its own newest task first, and when its queue runs dry it steals
+// the oldest task of another worker. tasks submitted from outside are dealt
+// round robin, tasks submitted by a worker go to its own queue.
+class WorkStealingPool
+{
+public:
+	typedef boost::function<void()> Task;
+
+	struct Statistics
+	{
+		size_t executed;
+		size_t stolen;
+	};
+
+public:
+	// zero threads means one per hardware thread.
+	explicit WorkStealingPool(size_t num_threads = 0);
+	virtual ~WorkStealingPool();
+
+public:
+	void Submit(const Task& task);
+
+	// blocks until every submitted task has finished.
+	void Wait();
+
+	size_t GetNumThreads() const;
+	Statistics GetStatistics() const;
+
+	// the index of the worker running the calling thread, or -1 outside the
+	// pool. lets tasks keep per worker state without locking.
+	int GetWorkerIndex() const;
+
+private:
+	struct Worker
+	{
+		boost::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void WorkerProc(size_t index);
+	bool PopTask(size_t index, Task& task);
+	bool StealTask(size_t index, Task& task);
+
+private:
+	std::vector<boost::shared_ptr<Worker> > m_workers;
+	boost::thread_group m_threads;
+	boost::thread_specific_ptr<int> m_worker_index;
+
+	mutable boost::mutex m_mutex;
+	boost::condition_variable m_work_condition;
+	boost::condition_variable m_idle_condition;
+	size_t m_num_queued;
+	size_t m_num_pending;
+	size_t m_next_worker;
+	bool m_quit;
+
+	Statistics m_statistics;
+};
+
+#endif  // _WORK_STEALING_POOL_HPP_INCLUDED_
@@ -0,0 +1,277 @@
+#include "common.hpp"
+#include "worker_process.hpp"
+
+#include <algorithm>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+#ifdef _WIN32
+// quotes an argument the way the c runtime splits command lines again.
+static std::string QuoteArgument(const std::string& argument)
+{
+	if (!argument.empty() && argument.find_first_of(" \t\"") == std::string::npos) return argument;
+
+	std::string quoted = "\"";
+	size_t num_backslashes = 0;
+	for (size_t i = 0; i != argument.length(); ++i)
+	{
+		char c = argument[i];
+		if (c == '\\')
+		{
+			++num_backslashes;
+			continue;
+		}
+		quoted.append(c == '"' ? num_backslashes * 2 + 1 : num_backslashes, '\\');
+		quoted.push_back(c);
+		num_backslashes = 0;
+	}
+	quoted.append(num_backslashes * 2, '\\');
+	quoted.push_back('"');
+	return quoted;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// constructor / destructor
+//////////////////////////////////////////////////////////////////////////
+WorkerProcess::WorkerProcess()
+#ifdef _WIN32
+	: m_process(NULL)
+	, m_input(NULL)
+	, m_output(NULL)
+#else
+	: m_pid(-1)
+	, m_socket(-1)
+#endif
+{
+
+}
+
+WorkerProcess::~WorkerProcess()
+{
+	Kill();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// public interfaces
+//////////////////////////////////////////////////////////////////////////
+#ifdef _WIN32
+
+bool WorkerProcess::Start(const std::vector<std::string>& arguments)
+{
+	Kill();
+	if (arguments.empty()) return false;
+
+	// only the child's ends are inheritable. the input pipe holds a whole
+	// request, so writing one never waits for the child to read.
+	SECURITY_ATTRIBUTES attributes = {sizeof(attributes), NULL, TRUE};
+	HANDLE child_input = NULL, child_output = NULL;
+	if (!CreatePipe(&child_input, &m_input, &attributes, 1024 * 1024)) return false;
+	if (!CreatePipe(&m_output, &child_output, &attributes, 0))
+	{
+		CloseHandle(child_input);
+		CloseHandle(m_input);
+		m_input = NULL;
+		return false;
+	}
+	SetHandleInformation(m_input, HANDLE_FLAG_INHERIT, 0);
+	SetHandleInformation(m_output, HANDLE_FLAG_INHERIT, 0);
+
+	std::string command_line;
+	for (size_t i = 0; i != arguments.size(); ++i)
+	{
+		if (i != 0) command_line += " ";
+		command_line += QuoteArgument(arguments[i]);
+	}
+	std::vector<char> command_buffer(command_line.begin(), command_line.end());
+	command_buffer.push_back(0);
+
+	STARTUPINFOA startup_info;
+	ZeroMemory(&startup_info, sizeof(startup_info));
+	startup_info.cb = sizeof(startup_info);
+	startup_info.dwFlags = STARTF_USESTDHANDLES;
+	startup_info.hStdInput = child_input;
+	startup_info.hStdOutput = child_output;
+	startup_info.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+	PROCESS_INFORMATION process_info;
+	BOOL created = CreateProcessA(NULL, &command_buffer[0], NULL, NULL, TRUE,
+		CREATE_NO_WINDOW, NULL, NULL, &startup_info, &process_info);
+
+	CloseHandle(child_input);
+	CloseHandle(child_output);
+	if (!created)
+	{
+		Kill();
+		return false;
+	}
+
+	CloseHandle(process_info.hThread);
+	m_process = process_info.hProcess;
+	return true;
+}
+
+void WorkerProcess::Kill()
+{
+	if (m_process != NULL)
+	{
+		TerminateProcess(m_process, 1);
+		WaitForSingleObject(m_process, 1000);
+		CloseHandle(m_process);
+		m_process = NULL;
+	}
+	if (m_input != NULL) CloseHandle(m_input);
+	if (m_output != NULL) CloseHandle(m_output);
+	m_input = NULL;
+	m_output = NULL;
+}
+
+bool WorkerProcess::IsStarted() const
+{
+	return m_process != NULL;
+}
+
+bool WorkerProcess::Write(const char* data, size_t size)
+{
+	while (size != 0)
+	{
+		DWORD written = 0;
+		if (m_input == NULL || !WriteFile(m_input, data, static_cast<DWORD>(size), &written, NULL)) return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+int WorkerProcess::Read(char* buffer, size_t size, unsigned int timeout)
+{
+	if (m_output == NULL) return -1;
+
+	// anonymous pipes can not wait with a timeout, so peek until data shows up.
+	DWORD start = GetTickCount();
+	while (true)
+	{
+		DWORD available = 0;
+		if (!PeekNamedPipe(m_output, NULL, 0, NULL, &available, NULL)) return -1;
+		if (available != 0)
+		{
+			DWORD num_read = 0;
+			DWORD to_read = static_cast<DWORD>(std::min<size_t>(size, available));
+			if (!ReadFile(m_output, buffer, to_read, &num_read, NULL) || num_read == 0) return -1;
+			return static_cast<int>(num_read);
+		}
+		if (GetTickCount() - start >= timeout) return 0;
+		Sleep(1);
+	}
+}
+
+#else
+
+bool WorkerProcess::Start(const std::vector<std::string>& arguments)
+{
+	Kill();
+	if (arguments.empty()) return false;
+
+	// one socket for both directions. the parent's end must not leak into
+	// other children, or they would keep this one's input open.
+	int sockets[2];
+#ifdef SOCK_CLOEXEC
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) return false;
+#else
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) return false;
+	fcntl(sockets[0], F_SETFD, FD_CLOEXEC);
+	fcntl(sockets[1], F_SETFD, FD_CLOEXEC);
+#endif
+#ifdef SO_NOSIGPIPE
+	int no_sigpipe = 1;
+	setsockopt(sockets[0], SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+
+	// built before forking, the child may only call async signal safe functions.
+	std::vector<char*> argv;
+	for (size_t i = 0; i != arguments.size(); ++i) argv.push_back(const_cast<char*>(arguments[i].c_str()));
+	argv.push_back(NULL);
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		// dup2 clears close-on-exec for the new descriptors.
+		dup2(sockets[1], STDIN_FILENO);
+		dup2(sockets[1], STDOUT_FILENO);
+		execvp(argv[0], &argv[0]);
+		_exit(127);
+	}
+
+	close(sockets[1]);
+	if (pid < 0)
+	{
+		close(sockets[0]);
+		return false;
+	}
+
+	m_pid = pid;
+	m_socket = sockets[0];
+	return true;
+}
+
+void WorkerProcess::Kill()
+{
+	if (m_pid > 0)
+	{
+		kill(m_pid, SIGKILL);
+		while (waitpid(m_pid, NULL, 0) < 0 && errno == EINTR);
+		m_pid = -1;
+	}
+	if (m_socket >= 0) close(m_socket);
+	m_socket = -1;
+}
+
+bool WorkerProcess::IsStarted() const
+{
+	return m_pid > 0;
+}
+
+bool WorkerProcess::Write(const char* data, size_t size)
+{
+	while (size != 0)
+	{
+		if (m_socket < 0) return false;
+
+		// a child which died must not take the parent down with SIGPIPE.
+		ssize_t written = send(m_socket, data, size, MSG_NOSIGNAL);
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+int WorkerProcess::Read(char* buffer, size_t size, unsigned int timeout)
+{
+	if (m_socket < 0) return -1;
+
+	pollfd poll_fd = {m_socket, POLLIN, 0};
+	int num_ready = poll(&poll_fd, 1, static_cast<int>(timeout));
+	if (num_ready == 0 || (num_ready < 0 && errno == EINTR)) return 0;
+	if (num_ready < 0) return -1;
+
+	ssize_t num_read = recv(m_socket, buffer, size, 0);
+	if (num_read < 0 && errno == EINTR) return 0;
+	return num_read > 0 ? static_cast<int>(num_read) : -1;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _WORKER_PROCESS_HPP_INCLUDED_
+#define _WORKER_PROCESS_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+
+// a child process which reads from its standard input and writes to its
+// standard output, both connected to the parent: a socket pair on posix,
+// two anonymous pipes on windows. the child's standard error is shared.
+class WorkerProcess
+{
+public:
+	WorkerProcess();
+	virtual ~WorkerProcess();
+
+public:
+	// arguments[0] is the program. kills the current child, if any.
+	bool Start(const std::vector<std::string>& arguments);
+	void Kill();
+
+	// true from a successful start until the kill, even if the child died.
+	bool IsStarted() const;
+
+	// writes everything or fails, e.g. when the child is gone.
+	bool Write(const char* data, size_t size);
+
+	// reads what is there, waiting at most timeout milliseconds for it.
+	// returns the bytes read, 0 on timeout, and -1 once the child closed
+	// its output or died.
+	int Read(char* buffer, size_t size, unsigned int timeout);
+
+private:
+	// not copyable, it owns the child.
+	WorkerProcess(const WorkerProcess&);
+	WorkerProcess& operator = (const WorkerProcess&);
+
+private:
+#ifdef _WIN32
+	HANDLE m_process;
+	HANDLE m_input;			// the child's standard input, written by us
+	HANDLE m_output;		// the child's standard output, read by us
+#else
+	int m_pid;
+	int m_socket;
+#endif
+};
+
+#endif  // _WORKER_PROCESS_HPP_INCLUDED_
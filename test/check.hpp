@@ -0,0 +1,41 @@
+#ifndef _CHECK_HPP_INCLUDED_
+#define _CHECK_HPP_INCLUDED_
+
+#include <iostream>
+
+// the few macros the tests need. a test is a program run from bin/ by
+// make check, which prints each failed check and exits non zero if any.
+
+static int g_num_checks = 0;
+static int g_num_failures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		++g_num_checks; \
+		if (!(condition)) \
+		{ \
+			++g_num_failures; \
+			std::cerr << __FILE__ << "(" << __LINE__ << "): check failed: " #condition "\n"; \
+		} \
+	} while (false)
+
+#define CHECK_EQUAL(expected, actual) \
+	do \
+	{ \
+		++g_num_checks; \
+		if (!((expected) == (actual))) \
+		{ \
+			++g_num_failures; \
+			std::cerr << __FILE__ << "(" << __LINE__ << "): check failed: " #expected " == " #actual \
+				<< ", got " << (actual) << "\n"; \
+		} \
+	} while (false)
+
+static int CheckReport(const char* name)
+{
+	std::cerr << name << ": " << g_num_checks - g_num_failures << "/" << g_num_checks << " checks passed\n";
+	return g_num_failures == 0 ? 0 : 1;
+}
+
+#endif  // _CHECK_HPP_INCLUDED_
@@ -0,0 +1,254 @@
+#include "common.hpp"
+#include "compile_server.hpp"
+#include "compile_protocol.hpp"
+#include "check.hpp"
+
+#include <boost/bind.hpp>
+
+// the worker validate_shaders --worker-delay starts, from bin/ like the
+// test. every compile it does takes worker_delay.
+static const unsigned int worker_delay = 300;
+
+static std::vector<std::string> MakeWorkerCommand()
+{
+	std::vector<std::string> worker_command;
+	worker_command.push_back("./compile_worker");
+	worker_command.push_back("--compiler");
+	worker_command.push_back("stub");
+	worker_command.push_back("--delay");
+	worker_command.push_back(boost::lexical_cast<std::string>(worker_delay));
+	return worker_command;
+}
+
+static ShaderCompileInput MakeInput(const std::string& name)
+{
+	return ShaderCompileInput("float4 ps_main() : SV_Target {return 0; } // " + name + "\n", "ps_main", "ps_4_0", SCF_SkipOptimization);
+}
+
+static CompileResponse MakeResponse()
+{
+	CompileResponse response;
+	response.id = 7;
+	response.succeeded = true;
+	response.bytecode.assign(3, 'b');
+	response.error_message = "warning: none";
+	return response;
+}
+
+// a ready, a request and a response frame, back to back.
+static std::string MakeStream()
+{
+	std::string stream;
+	EncodeReadyFrame(stream);
+	CompileRequest request = {5, MakeInput("request")};
+	EncodeRequestFrame(request, stream);
+	EncodeResponseFrame(MakeResponse(), stream);
+	return stream;
+}
+
+static void TestFrameReader()
+{
+	std::string stream = MakeStream();
+	CompileFrameType type;
+	std::string payload;
+
+	// a byte at a time, each frame comes out once its last byte is in.
+	CompileFrameReader reader;
+	std::vector<CompileFrameType> types;
+	std::vector<size_t> ends;
+	for (size_t i = 0; i != stream.length(); ++i)
+	{
+		reader.Append(&stream[i], 1);
+		while (reader.NextFrame(type, payload))
+		{
+			types.push_back(type);
+			ends.push_back(i + 1);
+		}
+	}
+	CHECK_EQUAL(3u, types.size());
+	if (types.size() == 3)
+	{
+		CHECK(types[0] == CF_Ready && types[1] == CF_Request && types[2] == CF_Response);
+		CHECK_EQUAL(compile_frame_header_size + 4, ends[0]);
+		CHECK_EQUAL(stream.length(), ends[2]);
+	}
+
+	// all of them in one read.
+	reader.Clear();
+	reader.Append(stream.data(), stream.length());
+	size_t num_frames = 0;
+	while (reader.NextFrame(type, payload)) ++num_frames;
+	CHECK_EQUAL(3u, num_frames);
+	CHECK(type == CF_Response);
+	CompileResponse response;
+	CHECK(DecodeResponsePayload(payload, response));
+	CHECK_EQUAL(7u, response.id);
+	CHECK_EQUAL(std::string("warning: none"), response.error_message);
+
+	// a length beyond any valid frame breaks the stream for good.
+	reader.Clear();
+	const char oversized[] = {'\xFF', '\xFF', '\xFF', '\x7F', CF_Response};
+	reader.Append(oversized, sizeof(oversized));
+	CHECK(!reader.NextFrame(type, payload));
+	CHECK(reader.IsBroken());
+	reader.Append(stream.data(), stream.length());
+	CHECK(!reader.NextFrame(type, payload));
+
+	reader.Clear();
+	CHECK(!reader.IsBroken());
+	reader.Append(stream.data(), stream.length());
+	CHECK(reader.NextFrame(type, payload));
+}
+
+// a payload is only good with every field present and nothing behind.
+static void TestDecodeBrokenPayloads()
+{
+	std::string stream = MakeStream();
+	CompileFrameReader reader;
+	reader.Append(stream.data(), stream.length());
+
+	CompileFrameType type;
+	std::vector<std::string> payloads;
+	std::string payload;
+	while (reader.NextFrame(type, payload)) payloads.push_back(payload);
+	CHECK_EQUAL(3u, payloads.size());
+	if (payloads.size() != 3) return;
+
+	unsigned int version = 0;
+	CompileRequest request;
+	CompileResponse response;
+	CHECK(DecodeReadyPayload(payloads[0], version));
+	CHECK_EQUAL(compile_protocol_version, version);
+	CHECK(DecodeRequestPayload(payloads[1], request));
+	CHECK_EQUAL(5u, request.id);
+	CHECK(request.input.GetSource() == MakeInput("request").GetSource());
+	CHECK(DecodeResponsePayload(payloads[2], response));
+
+	size_t num_accepted = 0;
+	for (size_t length = 0; length != payloads[0].length(); ++length)
+	{
+		if (DecodeReadyPayload(payloads[0].substr(0, length), version)) ++num_accepted;
+	}
+	for (size_t length = 0; length != payloads[1].length(); ++length)
+	{
+		if (DecodeRequestPayload(payloads[1].substr(0, length), request)) ++num_accepted;
+	}
+	for (size_t length = 0; length != payloads[2].length(); ++length)
+	{
+		if (DecodeResponsePayload(payloads[2].substr(0, length), response)) ++num_accepted;
+	}
+	CHECK_EQUAL(0u, num_accepted);
+
+	CHECK(!DecodeReadyPayload(payloads[0] + '\0', version));
+	CHECK(!DecodeRequestPayload(payloads[1] + '\0', request));
+	CHECK(!DecodeResponsePayload(payloads[2] + '\0', response));
+}
+
+// a job running past the timeout fails, its worker is killed and started
+// again, and the next job is compiled by the new one.
+static void TestTimeoutRestartsWorker()
+{
+	CompileServer server(MakeWorkerCommand(), 1);
+	CHECK(server.Start());
+	CHECK_EQUAL(1u, server.GetStatistics().num_started);
+
+	server.SetTimeout(worker_delay / 3);
+	ShaderCompileOutput output;
+	CHECK(!server.Compile(MakeInput("slow"), output));
+	CHECK(output.error_message.find("timed out") != std::string::npos);
+	CHECK_EQUAL(1u, server.GetStatistics().num_timeouts);
+
+	server.SetTimeout(worker_delay * 10);
+	CHECK(server.Compile(MakeInput("next"), output));
+	CHECK(!output.bytecode.empty());
+
+	CompileServer::Statistics statistics = server.GetStatistics();
+	CHECK_EQUAL(2u, statistics.num_started);
+	CHECK_EQUAL(1u, statistics.num_completed);
+	CHECK_EQUAL(1u, statistics.num_timeouts);
+	CHECK_EQUAL(0u, statistics.num_crashes);
+	server.Stop();
+}
+
+// a worker dying mid-request costs that request only. the stub worker
+// dies on the marker of compile_worker_main.cpp.
+static void TestCrashRestartsWorker()
+{
+	CompileServer server(MakeWorkerCommand(), 1);
+	CHECK(server.Start());
+	server.SetTimeout(worker_delay * 10);
+
+	ShaderCompileOutput output;
+	CHECK(!server.Compile(MakeInput("compile_worker: crash here"), output));
+	CHECK(output.error_message.find("crashed") != std::string::npos);
+
+	unsigned int id = server.Submit(MakeInput("crash again, compile_worker: crash here"));
+	CompileServer::Result result;
+	CHECK(server.WaitResult(id, result));
+	CHECK(result.crashed && !result.succeeded && !result.timed_out);
+
+	CHECK(server.Compile(MakeInput("next"), output));
+	CompileServer::Statistics statistics = server.GetStatistics();
+	CHECK_EQUAL(3u, statistics.num_started);
+	CHECK_EQUAL(1u, statistics.num_completed);
+	CHECK_EQUAL(2u, statistics.num_crashes);
+	server.Stop();
+}
+
+static void WaitForResult(CompileServer* server, unsigned int id, CompileServer::Result* result, bool* has_result)
+{
+	*has_result = server->WaitResult(id, *result);
+}
+
+// submitted requests are fetched in any order, except those somebody
+// waits for, which go to the waiter only.
+static void TestAsyncResults()
+{
+	CompileServer server(MakeWorkerCommand(), 2);
+	CHECK(server.Start());
+	server.SetTimeout(worker_delay * 10);
+
+	unsigned int first = server.Submit(MakeInput("first"));
+	unsigned int awaited = server.Submit(MakeInput("awaited"));
+	unsigned int last = server.Submit(MakeInput("last"));
+	CHECK(first != awaited && awaited != last && first != last);
+
+	CompileServer::Result awaited_result;
+	bool has_awaited_result = false;
+	boost::thread waiter(boost::bind(&WaitForResult, &server, awaited, &awaited_result, &has_awaited_result));
+
+	std::set<unsigned int> fetched;
+	for (int i = 0; i != 100 && fetched.size() != 2; ++i)
+	{
+		CompileServer::Result result;
+		while (server.FetchResult(result))
+		{
+			CHECK(result.succeeded);
+			fetched.insert(result.id);
+		}
+		boost::this_thread::sleep(boost::posix_time::milliseconds(worker_delay / 10));
+	}
+	waiter.join();
+
+	CHECK_EQUAL(2u, fetched.size());
+	CHECK(fetched.count(first) == 1 && fetched.count(last) == 1);
+	CHECK(has_awaited_result);
+	CHECK_EQUAL(awaited, awaited_result.id);
+	CHECK(awaited_result.succeeded);
+
+	// nothing is left, and what was fetched can not be waited for.
+	CompileServer::Result result;
+	CHECK(!server.FetchResult(result));
+	CHECK(!server.WaitResult(first, result));
+	server.Stop();
+}
+
+int main()
+{
+	TestFrameReader();
+	TestDecodeBrokenPayloads();
+	TestTimeoutRestartsWorker();
+	TestCrashRestartsWorker();
+	TestAsyncResults();
+	return CheckReport("test_compile_server");
+}
@@ -0,0 +1,111 @@
+#include "common.hpp"
+#include "compile_tier_tracker.hpp"
+#include "check.hpp"
+
+static ContentHash MakeFingerprint(const std::string& code)
+{
+	ContentHasher hasher;
+	hasher.Update(code);
+	return hasher.Finish();
+}
+
+static CompileTierTracker::Compile MakeCompile(size_t version, const std::string& code)
+{
+	CompileTierTracker::Compile compile = {version, MakeFingerprint(code), ShaderSourceMapPtr(new ShaderSourceMap)};
+	return compile;
+}
+
+// both tiers of a version are applied, in turn.
+static void TestTiersAreApplied()
+{
+	CompileTierTracker tracker;
+	tracker.OnSubmitted(MakeCompile(1, "one"));
+	CHECK(tracker.OnResult(1, CT_Fast, true));
+	CHECK_EQUAL(1u, tracker.GetApplied().version);
+	CHECK(tracker.IsApplied(MakeFingerprint("one")));
+	CHECK(tracker.OnResult(1, CT_Optimized, true));
+	CHECK_EQUAL(1u, tracker.GetApplied().version);
+}
+
+// a failed fast compile is shown, a failed optimized one is not, the fast
+// shader keeps running.
+static void TestFailedOptimizedTierIsDropped()
+{
+	CompileTierTracker tracker;
+	tracker.OnSubmitted(MakeCompile(1, "one"));
+	CHECK(tracker.OnResult(1, CT_Fast, false));
+	CHECK(!tracker.OnResult(1, CT_Optimized, false));
+	CHECK_EQUAL(1u, tracker.GetApplied().version);
+}
+
+// the late optimized tier of an older version does not replace a newer one.
+static void TestOlderResultIsDropped()
+{
+	CompileTierTracker tracker;
+	tracker.OnSubmitted(MakeCompile(1, "one"));
+	tracker.OnSubmitted(MakeCompile(2, "two"));
+
+	CHECK(tracker.OnResult(1, CT_Fast, true));
+	CHECK(tracker.OnResult(2, CT_Fast, true));
+	CHECK_EQUAL(1u, tracker.GetNumInflight());
+	CHECK(!tracker.OnResult(1, CT_Optimized, true));
+	CHECK_EQUAL(2u, tracker.GetApplied().version);
+	CHECK(tracker.IsApplied(MakeFingerprint("two")));
+
+	// nor does a version the tracker was never told of.
+	CHECK(!tracker.OnResult(3, CT_Fast, true));
+}
+
+// a compile in place overtakes whatever is still in flight.
+static void TestCompileInPlaceOvertakesInflight()
+{
+	CompileTierTracker tracker;
+	tracker.OnSubmitted(MakeCompile(1, "one"));
+	tracker.OnCompiledInPlace(MakeCompile(2, "two"));
+	CHECK_EQUAL(0u, tracker.GetNumInflight());
+	CHECK(!tracker.OnResult(1, CT_Fast, true));
+	CHECK(tracker.IsApplied(MakeFingerprint("two")));
+
+	// its own optimized tier follows as a submit.
+	tracker.OnSubmitted(MakeCompile(2, "two"));
+	CHECK(tracker.OnResult(2, CT_Optimized, true));
+}
+
+// an edit back to the applied code drops the compiles of the code in
+// between, but not the optimized tier of the applied one.
+static void TestRevertKeepsOptimizedTier()
+{
+	CompileTierTracker tracker;
+	tracker.OnSubmitted(MakeCompile(1, "one"));
+	CHECK(tracker.OnResult(1, CT_Fast, true));
+	tracker.OnSubmitted(MakeCompile(2, "two"));
+	CHECK(!tracker.IsApplied(MakeFingerprint("two")));
+	CHECK(tracker.IsApplied(MakeFingerprint("one")));
+	tracker.OnUnchanged(MakeFingerprint("one"));
+	CHECK_EQUAL(1u, tracker.GetNumInflight());
+
+	CHECK(!tracker.OnResult(2, CT_Fast, true));
+	CHECK(tracker.OnResult(1, CT_Optimized, true));
+	CHECK(tracker.IsApplied(MakeFingerprint("one")));
+}
+
+// once forgotten, the applied code is compiled again even if unchanged.
+static void TestForgetApplied()
+{
+	CompileTierTracker tracker;
+	tracker.OnCompiledInPlace(MakeCompile(1, "one"));
+	CHECK(tracker.IsApplied(MakeFingerprint("one")));
+	tracker.ForgetApplied();
+	CHECK(!tracker.IsApplied(MakeFingerprint("one")));
+}
+
+int main()
+{
+	TestTiersAreApplied();
+	TestFailedOptimizedTierIsDropped();
+	TestOlderResultIsDropped();
+	TestCompileInPlaceOvertakesInflight();
+	TestRevertKeepsOptimizedTier();
+	TestForgetApplied();
+	return CheckReport("test_compile_tier_tracker");
+}
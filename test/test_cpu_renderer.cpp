@@ -0,0 +1,202 @@
+#include "common.hpp"
+#include "cpu_renderer.hpp"
+#include "check.hpp"
+
+#include <cmath>
+
+static const char jit_cache[] = "cache/test/jit";
+
+// the engines that run pixels in quads must take a derivative the same way,
+// whatever the lanes of the quad did before it.
+static const wchar_t discard_shader[] =
+	L"cbuffer Parameters { float4 time; float4 view; float4 freq; float4 mpos; }\n"
+	L"float4 ps_main(in float2 tc : TEXCOORD) : SV_TARGET\n"
+	L"{\n"
+	L"  if (tc.x < 0.25 && tc.y < 0.25) discard;\n"
+	L"  return float4(ddx(tc.x * 8), ddy(tc.y * 4), fwidth(tc.x * 8), 1);\n"
+	L"}\n";
+
+// a 4x4 frame is a quad or two in every engine, the top left pixel of which
+// is discarded. the others still have it to difference with, as on a gpu.
+static void CheckDerivativesAfterDiscard(CpuRenderer& renderer, const char* engine)
+{
+	std::vector<float> pixels;
+	renderer.Render(4, 4, pixels);
+	CHECK_EQUAL(1u, renderer.GetNumDiscarded());
+	CHECK_EQUAL(0.0f, pixels[3]);
+
+	size_t num_wrong = 0;
+	for (size_t i = 1; i != 16; ++i)
+	{
+		const float* color = &pixels[i * 4];
+		if (color[0] == 2.0f && color[1] == 1.0f && color[2] == 2.0f && color[3] == 1.0f) continue;
+		if (num_wrong++ == 0) std::cerr << "  with " << engine << ", pixel " << i << " is " << color[0] << " " << color[1] << " " << color[2] << "\n";
+	}
+	CHECK_EQUAL(0u, num_wrong);
+}
+
+static void TestDerivativesAfterDiscard()
+{
+	CpuRenderer renderer;
+	CHECK(renderer.SetShader(L"", discard_shader));
+	CHECK(renderer.GetBytecode().uses_derivatives);
+	renderer.SetNumThreads(1);
+
+	renderer.SetEngine(CpuRenderer::EN_Simd);
+	for (int i = 0; i != CpuSimdVm::Num_InstructionSets; ++i)
+	{
+		CpuSimdVm::InstructionSet instruction_set = static_cast<CpuSimdVm::InstructionSet>(i);
+		if (!CpuSimdVm::IsSupported(instruction_set)) continue;
+		renderer.SetInstructionSet(instruction_set);
+		CheckDerivativesAfterDiscard(renderer, CpuSimdVm::GetInstructionSetName(instruction_set));
+	}
+
+	// without a system compiler there is nothing native to check.
+	renderer.SetInstructionSet(CpuSimdVm::GetBestInstructionSet());
+	renderer.SetJitCache(jit_cache);
+	renderer.SetEngine(CpuRenderer::EN_Native);
+	if (renderer.WaitForNative())
+	{
+		CheckDerivativesAfterDiscard(renderer, "native");
+		CHECK(renderer.GetRenderedEngine() == CpuRenderer::EN_Native);
+	}
+	else std::cerr << "test_cpu_renderer: no native code, skipped\n" << renderer.GetJit()->GetError();
+}
+
+static const wchar_t sample_shader[] =
+	L"Texture2D tex : register(t0);\n"
+	L"SamplerState samp;\n"
+	L"float4 ps_main(in float2 tc : TEXCOORD) : SV_TARGET\n"
+	L"{\n"
+	L"  return tex.Sample(samp, tc);\n"
+	L"}\n";
+
+// a 64x64 texture drawn on 16x16 pixels steps 4 texels a pixel, so Sample
+// reads level 2, whose texel centers are the pixel centers.
+static void CheckMinifiedSample(CpuRenderer& renderer, const std::vector<unsigned char>& bytes, const char* engine)
+{
+	std::vector<float> pixels;
+	renderer.Render(16, 16, pixels);
+
+	// the 4x4 texels under a pixel, averaged. the chain rounds to bytes on
+	// the way down, twice.
+	size_t num_wrong = 0;
+	for (size_t y = 0; y != 16; ++y)
+	{
+		for (size_t x = 0; x != 16; ++x)
+		{
+			for (size_t i = 0; i != 4; ++i)
+			{
+				float sum = 0;
+				for (size_t j = 0; j != 16; ++j) sum += bytes[((y * 4 + j / 4) * 64 + x * 4 + j % 4) * 4 + i];
+				float expected = sum / 16.0f / 255.0f;
+				float actual = pixels[(y * 16 + x) * 4 + i];
+				if (std::fabs(actual - expected) <= 1.5f / 255.0f) continue;
+				if (num_wrong++ == 0) std::cerr << "  with " << engine << ", pixel " << x << " " << y << " is " << actual << " for " << expected << "\n";
+			}
+		}
+	}
+	CHECK_EQUAL(0u, num_wrong);
+}
+
+static void TestImplicitLevel()
+{
+	std::vector<unsigned char> bytes(64 * 64 * 4);
+	unsigned int seed = 1;
+	for (size_t i = 0; i != bytes.size(); ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		bytes[i] = static_cast<unsigned char>(seed >> 16);
+	}
+	CpuTexturePtr texture(new CpuTexture);
+	texture->Create(64, 64, bytes);
+	CHECK_EQUAL(7u, texture->GetNumLevels());
+
+	CpuRenderer renderer;
+	CHECK(renderer.SetShader(L"", sample_shader));
+	CHECK(renderer.GetBytecode().uses_derivatives);
+	renderer.SetTexture(0, texture);
+	renderer.SetNumThreads(1);
+
+	renderer.SetEngine(CpuRenderer::EN_Simd);
+	for (int i = 0; i != CpuSimdVm::Num_InstructionSets; ++i)
+	{
+		CpuSimdVm::InstructionSet instruction_set = static_cast<CpuSimdVm::InstructionSet>(i);
+		if (!CpuSimdVm::IsSupported(instruction_set)) continue;
+		renderer.SetInstructionSet(instruction_set);
+		CheckMinifiedSample(renderer, bytes, CpuSimdVm::GetInstructionSetName(instruction_set));
+	}
+
+	renderer.SetInstructionSet(CpuSimdVm::GetBestInstructionSet());
+	renderer.SetJitCache(jit_cache);
+	renderer.SetEngine(CpuRenderer::EN_Native);
+	if (renderer.WaitForNative()) CheckMinifiedSample(renderer, bytes, "native");
+
+	// the scalar vm has no quad, and reads the top level.
+	std::vector<float> pixels;
+	renderer.SetEngine(CpuRenderer::EN_Bytecode);
+	renderer.Render(16, 16, pixels);
+	float top[4];
+	texture->Sample(0.5f / 16.0f, 0.5f / 16.0f, 0.0f, top);
+	CHECK_EQUAL(top[0], pixels[0]);
+}
+
+// coordinates wrapping many times over, or so far off that the vector wrap
+// leaves them to the scalar one, and lanes left out, on a texture whose
+// levels are not whole tiles. every lane has to give the bits the scalar
+// sampler does.
+static void TestSampleWrapped()
+{
+	std::vector<unsigned char> bytes(20 * 12 * 4);
+	for (size_t i = 0; i != bytes.size(); ++i) bytes[i] = static_cast<unsigned char>(i * 7);
+	CpuTexture texture;
+	texture.Create(20, 12, bytes);
+
+	const size_t num_values = 256;
+	std::vector<float> u(num_values), v(num_values), level(num_values);
+	unsigned int seed = 1;
+	for (size_t j = 0; j != num_values; ++j)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		float scale = j % 4 == 3 ? 1e7f : j % 4 == 2 ? -300.0f : 3.0f;
+		u[j] = scale * (static_cast<float>(seed >> 8) / 16777216.0f - 0.25f);
+		seed = seed * 1664525u + 1013904223u;
+		v[j] = (j % 8 < 4 ? -scale : scale) * (static_cast<float>(seed >> 8) / 16777216.0f);
+		level[j] = static_cast<float>(j % 10) * 0.5f;
+	}
+
+	for (int i = 0; i != CpuSimdVm::Num_InstructionSets; ++i)
+	{
+		CpuSimdVm::InstructionSet instruction_set = static_cast<CpuSimdVm::InstructionSet>(i);
+		CpuSimdVm::SampleFunction sample = CpuSimdVm::GetSampleFunction(instruction_set);
+		if (sample == NULL || !CpuSimdVm::IsSupported(instruction_set)) continue;
+		unsigned int width = CpuSimdVm::GetWidth(instruction_set);
+
+		size_t num_wrong = 0;
+		std::vector<float> color(4 * width);
+		for (size_t j = 0; j != num_values; j += width)
+		{
+			unsigned int lanes = ((1u << width) - 1) & ~(1u << (j / width % width));
+			sample(&texture, lanes, &u[j], &v[j], &level[j], &color[0]);
+			for (unsigned int lane = 0; lane != width; ++lane)
+			{
+				float expected[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+				if ((lanes >> lane & 1) != 0) texture.Sample(u[j + lane], v[j + lane], level[j + lane], expected);
+				for (unsigned int c = 0; c != 4; ++c)
+				{
+					if (color[c * width + lane] == expected[c]) continue;
+					if (num_wrong++ == 0) std::cerr << "  with " << CpuSimdVm::GetInstructionSetName(instruction_set) << ", " << u[j + lane] << " " << v[j + lane] << " is " << color[c * width + lane] << " for " << expected[c] << "\n";
+				}
+			}
+		}
+		CHECK_EQUAL(0u, num_wrong);
+	}
+}
+
+int main()
+{
+	TestDerivativesAfterDiscard();
+	TestImplicitLevel();
+	TestSampleWrapped();
+	return CheckReport("test_cpu_renderer");
+}
@@ -0,0 +1,92 @@
+#include "common.hpp"
+#include "file_watcher.hpp"
+#include "polling_file_watcher.hpp"
+#include "check.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <boost/thread/thread.hpp>
+
+static const char watch_directory[] = "cache/test/file_watcher";
+static const float step_time = 0.02f;
+
+// the paths a watcher reports as settled within a second, the debouncer
+// stepped the way the editor steps it, once a frame.
+static std::vector<std::string> WaitForSettled(FileWatcher& watcher, FileChangeDebouncer& debouncer)
+{
+	std::vector<std::string> settled;
+	for (int i = 0; i != 50; ++i)
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(static_cast<int>(step_time * 1000)));
+
+		std::vector<std::string> changed;
+		watcher.ReadChanges(changed);
+		debouncer.AddChanges(changed);
+		debouncer.Update(step_time, settled);
+	}
+	return settled;
+}
+
+// a save in several writes, as some editors do it.
+static void WriteInSteps(const std::string& path)
+{
+	std::ofstream ofs(path.c_str(), std::ios::trunc);
+	for (int i = 0; i != 3; ++i)
+	{
+		ofs << "float f" << i << ";\n";
+		ofs.flush();
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+}
+
+static void TestWriteIsReportedOnce(FileWatcher& watcher)
+{
+	std::string path = std::string(watch_directory) + "/header.hlsl";
+	std::string other_path = std::string(watch_directory) + "/other.hlsl";
+	std::ofstream(path.c_str()) << "float f;\n";
+	CHECK(watcher.Watch(path));
+
+	FileChangeDebouncer debouncer(0.2f);
+	CHECK(WaitForSettled(watcher, debouncer).empty());
+
+	WriteInSteps(path);
+	std::ofstream(other_path.c_str()) << "not watched\n";
+	std::vector<std::string> settled = WaitForSettled(watcher, debouncer);
+	CHECK_EQUAL(1u, settled.size());
+	if (!settled.empty()) CHECK_EQUAL(path, settled[0]);
+	CHECK(!debouncer.IsPending());
+
+	watcher.Unwatch(path);
+}
+
+static void TestRenameOverIsReported(FileWatcher& watcher)
+{
+	// editors which save to a temporary file and rename it over the original.
+	std::string path = std::string(watch_directory) + "/renamed.hlsl";
+	std::string temp_path = path + ".tmp";
+	std::ofstream(path.c_str()) << "float f;\n";
+	CHECK(watcher.Watch(path));
+
+	FileChangeDebouncer debouncer(0.2f);
+	WaitForSettled(watcher, debouncer);
+	std::ofstream(temp_path.c_str()) << "float g;\n";
+	CHECK_EQUAL(0, std::rename(temp_path.c_str(), path.c_str()));
+	std::vector<std::string> settled = WaitForSettled(watcher, debouncer);
+	CHECK_EQUAL(1u, settled.size());
+
+	watcher.Unwatch(path);
+}
+
+int main()
+{
+	MakeDirectory(watch_directory);
+
+	// the native watcher of the platform, then the polling one.
+	FileWatcherPtr native_watcher = FileWatcher::Create();
+	TestWriteIsReportedOnce(*native_watcher);
+	TestRenameOverIsReported(*native_watcher);
+
+	PollingFileWatcher polling_watcher;
+	TestWriteIsReportedOnce(polling_watcher);
+	return CheckReport("test_file_watcher");
+}
@@ -0,0 +1,176 @@
+#include "common.hpp"
+#include "live_compiler.hpp"
+#include "check.hpp"
+
+static const unsigned int fast_flags = SCF_SkipOptimization;
+static const unsigned int optimized_flags = SCF_OptimizationLevel3;
+
+// a compiler the test steps through: only the first compiles it allows
+// get past the gate, the others wait there. a source containing "error"
+// fails the fast tier.
+class GatedCompiler : public ShaderCompiler
+{
+public:
+	struct Call
+	{
+		std::string source;
+		unsigned int flags;
+	};
+
+public:
+	GatedCompiler() : m_num_allowed(static_cast<size_t>(-1)) {}
+
+	virtual bool Compile(const ShaderCompileInput& input, ShaderCompileOutput& output)
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			Call call = {input.GetSource(), input.flags};
+			size_t index = m_calls.size();
+			m_calls.push_back(call);
+			m_condition.notify_all();
+			while (index >= m_num_allowed) m_condition.wait(lock);
+		}
+
+		output.from_cache = false;
+		output.bytecode.assign(input.GetSource().begin(), input.GetSource().end());
+		output.error_message.clear();
+		if (input.flags == fast_flags && input.GetSource().find("error") != std::string::npos)
+		{
+			output.bytecode.clear();
+			output.error_message = "memory(1,1): error X3000: syntax error\n";
+			return false;
+		}
+		return true;
+	}
+
+	void Allow(size_t count)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_num_allowed = count;
+		m_condition.notify_all();
+	}
+
+	void Release()
+	{
+		Allow(static_cast<size_t>(-1));
+	}
+
+	// waits until the count-th compile reached the gate.
+	bool WaitForCalls(size_t count)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(10);
+		while (m_calls.size() < count)
+		{
+			if (!m_condition.timed_wait(lock, deadline)) return false;
+		}
+		return true;
+	}
+
+	std::vector<Call> GetCalls()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_calls;
+	}
+
+private:
+	boost::mutex m_mutex;
+	boost::condition_variable m_condition;
+	size_t m_num_allowed;
+	std::vector<Call> m_calls;
+};
+
+static void SetUp(LiveCompiler& live_compiler, GatedCompiler* compiler)
+{
+	live_compiler.SetCompiler(ShaderCompilerPtr(compiler));
+	live_compiler.SetTierFlags(CT_Fast, fast_flags);
+	live_compiler.SetTierFlags(CT_Optimized, optimized_flags);
+	live_compiler.Start();
+}
+
+// every result until the worker runs dry.
+static std::vector<LiveCompiler::Result> WaitForResults(LiveCompiler& live_compiler)
+{
+	std::vector<LiveCompiler::Result> results;
+	for (int i = 0; i != 1000 && live_compiler.IsBusy(); ++i) boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+
+	LiveCompiler::Result result;
+	while (live_compiler.FetchResult(result)) results.push_back(result);
+	return results;
+}
+
+static ShaderCompileInput MakeInput(const std::string& source)
+{
+	return ShaderCompileInput(source, "ps_main", "ps_4_0", 0);
+}
+
+static void TestStaleOptimizedResultIsDropped()
+{
+	GatedCompiler* compiler = new GatedCompiler;
+	LiveCompiler live_compiler;
+	SetUp(live_compiler, compiler);
+
+	// the optimized build of version 1 is still running when 2 comes in.
+	compiler->Allow(1);
+	live_compiler.Submit(1, MakeInput("one"));
+	CHECK(compiler->WaitForCalls(2));
+	live_compiler.Submit(2, MakeInput("two"));
+	compiler->Release();
+
+	std::vector<LiveCompiler::Result> results = WaitForResults(live_compiler);
+	CHECK_EQUAL(3u, results.size());
+	if (results.size() != 3) return;
+	CHECK(results[0].version == 1 && results[0].tier == CT_Fast && results[0].succeeded);
+	CHECK(results[1].version == 2 && results[1].tier == CT_Fast && results[1].succeeded);
+	CHECK(results[2].version == 2 && results[2].tier == CT_Optimized && results[2].succeeded);
+}
+
+static void TestFastFailureIsReported()
+{
+	GatedCompiler* compiler = new GatedCompiler;
+	LiveCompiler live_compiler;
+	SetUp(live_compiler, compiler);
+
+	live_compiler.Submit(1, MakeInput("error"));
+	std::vector<LiveCompiler::Result> results = WaitForResults(live_compiler);
+	CHECK_EQUAL(1u, results.size());
+	if (results.empty()) return;
+	CHECK(!results[0].succeeded);
+	CHECK(results[0].tier == CT_Fast);
+	CHECK(!results[0].error_message.empty());
+
+	// a failed fast build is not followed by an optimized one.
+	CHECK_EQUAL(1u, compiler->GetCalls().size());
+}
+
+static void TestNewerSubmitSupersedesInFlightJob()
+{
+	GatedCompiler* compiler = new GatedCompiler;
+	LiveCompiler live_compiler;
+	SetUp(live_compiler, compiler);
+
+	// 2 waits behind the running 1 and is replaced by 3 before it starts.
+	compiler->Allow(0);
+	live_compiler.Submit(1, MakeInput("one"));
+	CHECK(compiler->WaitForCalls(1));
+	live_compiler.Submit(2, MakeInput("two"));
+	live_compiler.Submit(3, MakeInput("three"));
+	live_compiler.Submit(2, MakeInput("two again"));
+	compiler->Release();
+
+	std::vector<LiveCompiler::Result> results = WaitForResults(live_compiler);
+	CHECK_EQUAL(2u, results.size());
+	for (size_t i = 0; i != results.size(); ++i) CHECK_EQUAL(3u, results[i].version);
+	CHECK_EQUAL(3u, live_compiler.GetLatestVersion());
+
+	std::vector<GatedCompiler::Call> calls = compiler->GetCalls();
+	for (size_t i = 0; i != calls.size(); ++i) CHECK(calls[i].source != "two" && calls[i].source != "two again");
+}
+
+int main()
+{
+	TestStaleOptimizedResultIsDropped();
+	TestFastFailureIsReported();
+	TestNewerSubmitSupersedesInFlightJob();
+	return CheckReport("test_live_compiler");
+}
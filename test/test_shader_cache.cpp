@@ -0,0 +1,136 @@
+#include "common.hpp"
+#include "cached_shader_compiler.hpp"
+#include "check.hpp"
+
+static const char cache_directory[] = "cache/test/shader_cache";
+
+// compiles anything, with a warning, and counts how often it was asked.
+class WarningCompiler : public ShaderCompiler
+{
+public:
+	WarningCompiler() : m_num_compiles(0) {}
+
+	virtual bool Compile(const ShaderCompileInput& input, ShaderCompileOutput& output)
+	{
+		++m_num_compiles;
+		output.bytecode.assign(input.GetSource().begin(), input.GetSource().end());
+		output.error_message = "memory(1,1): warning X3206: implicit truncation of vector type\n";
+		output.from_cache = false;
+		return true;
+	}
+
+	size_t m_num_compiles;
+};
+
+static std::vector<char> MakeBytecode(size_t size, char fill)
+{
+	return std::vector<char>(size, fill);
+}
+
+static ContentHash MakeKey(const std::string& source)
+{
+	return ShaderCache::MakeKey(ShaderCompileInput(source, "ps_main", "ps_4_0", 0));
+}
+
+static void TestHitAndMiss()
+{
+	ShaderCache cache;
+	std::vector<char> bytecode;
+	std::string messages;
+	CHECK(!cache.Lookup(MakeKey("a"), bytecode, messages));
+
+	cache.Insert(MakeKey("a"), MakeBytecode(16, 'a'), "warning");
+	CHECK(cache.Lookup(MakeKey("a"), bytecode, messages));
+	CHECK(bytecode == MakeBytecode(16, 'a'));
+	CHECK_EQUAL(std::string("warning"), messages);
+	CHECK(!cache.Lookup(MakeKey("b"), bytecode, messages));
+
+	ShaderCache::Statistics statistics = cache.GetStatistics();
+	CHECK_EQUAL(1u, statistics.memory_hits);
+	CHECK_EQUAL(2u, statistics.misses);
+}
+
+static void TestMemoryEviction()
+{
+	// room for two entries, the least recently used goes first.
+	ShaderCache cache("", 64);
+	std::vector<char> bytecode;
+	std::string messages;
+	cache.Insert(MakeKey("a"), MakeBytecode(32, 'a'), "");
+	cache.Insert(MakeKey("b"), MakeBytecode(32, 'b'), "");
+	CHECK(cache.Lookup(MakeKey("a"), bytecode, messages));
+	cache.Insert(MakeKey("c"), MakeBytecode(32, 'c'), "");
+
+	CHECK_EQUAL(2u, cache.GetMemoryEntries());
+	CHECK_EQUAL(64u, cache.GetMemoryBytes());
+	CHECK(cache.Lookup(MakeKey("a"), bytecode, messages));
+	CHECK(!cache.Lookup(MakeKey("b"), bytecode, messages));
+	CHECK(cache.Lookup(MakeKey("c"), bytecode, messages));
+	CHECK_EQUAL(1u, cache.GetStatistics().memory_evictions);
+
+	// the warnings count against the budget too.
+	cache.Insert(MakeKey("d"), MakeBytecode(8, 'd'), std::string(64, 'w'));
+	CHECK(!cache.Lookup(MakeKey("d"), bytecode, messages));
+}
+
+static void TestDiskEvictionAndReload()
+{
+	{
+		ShaderCache cache(cache_directory);
+		cache.Clear();
+	}
+	{
+		ShaderCache cache(cache_directory, 16 * 1024 * 1024, 2);
+		cache.Insert(MakeKey("a"), MakeBytecode(16, 'a'), "warning a");
+		cache.Insert(MakeKey("b"), MakeBytecode(16, 'b'), "");
+		cache.Insert(MakeKey("c"), MakeBytecode(16, 'c'), "warning c");
+		CHECK_EQUAL(2u, cache.GetDiskEntries());
+		CHECK_EQUAL(1u, cache.GetStatistics().disk_evictions);
+	}
+
+	// a new cache on the same directory has what the old one left on disk.
+	ShaderCache cache(cache_directory, 16 * 1024 * 1024, 2);
+	CHECK_EQUAL(2u, cache.GetDiskEntries());
+	CHECK_EQUAL(0u, cache.GetMemoryEntries());
+
+	std::vector<char> bytecode;
+	std::string messages;
+	CHECK(!cache.Lookup(MakeKey("a"), bytecode, messages));
+	CHECK(cache.Lookup(MakeKey("b"), bytecode, messages));
+	CHECK(bytecode == MakeBytecode(16, 'b'));
+	CHECK(messages.empty());
+	CHECK(cache.Lookup(MakeKey("c"), bytecode, messages));
+	CHECK(bytecode == MakeBytecode(16, 'c'));
+	CHECK_EQUAL(std::string("warning c"), messages);
+	CHECK_EQUAL(2u, cache.GetStatistics().disk_hits);
+	CHECK_EQUAL(2u, cache.GetMemoryEntries());
+	cache.Clear();
+}
+
+static void TestCachedCompilerReplaysWarnings()
+{
+	WarningCompiler* warning_compiler = new WarningCompiler;
+	CachedShaderCompiler compiler(ShaderCompilerPtr(warning_compiler), ShaderCachePtr(new ShaderCache));
+	ShaderCompileInput input("float4 ps_main() : SV_Target {return 0;}", "ps_main", "ps_4_0", 0);
+
+	ShaderCompileOutput first;
+	CHECK(compiler.Compile(input, first));
+	CHECK(!first.from_cache);
+
+	ShaderCompileOutput second;
+	second.error_message = "left over";
+	CHECK(compiler.Compile(input, second));
+	CHECK(second.from_cache);
+	CHECK(second.bytecode == first.bytecode);
+	CHECK_EQUAL(first.error_message, second.error_message);
+	CHECK_EQUAL(1u, warning_compiler->m_num_compiles);
+}
+
+int main()
+{
+	TestHitAndMiss();
+	TestMemoryEviction();
+	TestDiskEvictionAndReload();
+	TestCachedCompilerReplaysWarnings();
+	return CheckReport("test_shader_cache");
+}
@@ -0,0 +1,180 @@
+#include "common.hpp"
+#include "shader_diagnostics.hpp"
+#include "shader_header_stripper.hpp"
+#include "check.hpp"
+
+static const char editor_source[] = "<editor>";
+
+struct ParseCase
+{
+	const char* text;
+	bool is_parsed;
+	DiagnosticSeverity severity;
+	const char* file;
+	size_t line;
+	size_t column;
+	size_t end_column;
+	const char* code;
+	const char* message;
+};
+
+static const ParseCase parse_cases[] =
+{
+	{"memory(12,5): error X3004: undeclared identifier 'foo'", true, DS_Error, "memory", 12, 5, 0, "X3004", "undeclared identifier 'foo'"},
+	{"memory(3,10-14): warning X3206: implicit truncation of vector type", true, DS_Warning, "memory", 3, 10, 14, "X3206", "implicit truncation of vector type"},
+	{"C:\\shaders (old)\\a.hlsl(7,1): error X3000: syntax error", true, DS_Error, "C:\\shaders (old)\\a.hlsl", 7, 1, 0, "X3000", "syntax error"},
+	{"a.hlsl:4:2: error: unknown type name 'flaot'", true, DS_Error, "a.hlsl", 4, 2, 0, "", "unknown type name 'flaot'"},
+	{"error X3501: 'ps_main': entrypoint not found", true, DS_Error, "", 0, 0, 0, "X3501", "'ps_main': entrypoint not found"},
+	{"compilation failed; no code produced", false, DS_Error, "", 0, 0, 0, "", ""},
+};
+
+static void TestParse()
+{
+	for (size_t i = 0; i != ARRAYSIZE(parse_cases); ++i)
+	{
+		const ParseCase& c = parse_cases[i];
+		ShaderDiagnostics diagnostics;
+		CHECK_EQUAL(c.is_parsed ? 1u : 0u, ParseShaderDiagnostics(c.text, diagnostics));
+		if (diagnostics.empty()) continue;
+
+		const ShaderDiagnostic& diagnostic = diagnostics[0];
+		CHECK(diagnostic.severity == c.severity);
+		CHECK_EQUAL(std::string(c.file), diagnostic.file);
+		CHECK_EQUAL(c.line, diagnostic.line);
+		CHECK_EQUAL(c.column, diagnostic.column);
+		CHECK_EQUAL(c.end_column, diagnostic.end_column);
+		CHECK_EQUAL(std::string(c.code), diagnostic.code);
+		CHECK_EQUAL(std::string(c.message), diagnostic.message);
+	}
+}
+
+// two header files, the document behind them.
+static ShaderSourceMap MakeSourceMap(size_t num_document_lines)
+{
+	ShaderSourceMap source_map;
+	source_map.AddSegment("fx/header.hlsl", 3);
+	source_map.AddSegment("fx/noise.hlsl", 10);
+	source_map.AddSegment("fx/header.hlsl", 2, 5);
+	source_map.AddSegment(editor_source, num_document_lines);
+	return source_map;
+}
+
+struct MapCase
+{
+	size_t line;
+	bool is_mapped;
+	const char* source;
+	size_t source_line;
+};
+
+static const MapCase map_cases[] =
+{
+	{0, false, "", 0},
+	{1, true, "fx/header.hlsl", 1},
+	{3, true, "fx/header.hlsl", 3},
+	{4, true, "fx/noise.hlsl", 1},
+	{13, true, "fx/noise.hlsl", 10},
+	{14, true, "fx/header.hlsl", 5},
+	{15, true, "fx/header.hlsl", 6},
+	{16, true, editor_source, 1},
+	{35, true, editor_source, 20},
+	{36, false, "", 0},
+};
+
+static void TestMap()
+{
+	ShaderSourceMap source_map = MakeSourceMap(20);
+	CHECK_EQUAL(35u, source_map.GetNumLines());
+	for (size_t i = 0; i != ARRAYSIZE(map_cases); ++i)
+	{
+		const MapCase& c = map_cases[i];
+		ShaderSourceMap::Location location;
+		CHECK_EQUAL(c.is_mapped, source_map.Resolve(c.line, location));
+		if (!c.is_mapped) continue;
+		CHECK_EQUAL(std::string(c.source), location.source);
+		CHECK_EQUAL(c.source_line, location.line);
+	}
+}
+
+struct TipCase
+{
+	const char* output;
+	int row;
+	int column;
+	const char* message;
+};
+
+// against MakeSourceMap(20): the document starts at line 16.
+static const TipCase tip_cases[] =
+{
+	// inside the document, rows and columns are 0-based.
+	{"memory(16,1): error X3000: syntax error", 0, 0, "syntax error"},
+	{"memory(18,9): error X3004: undeclared identifier 'p'", 2, 8, "undeclared identifier 'p'"},
+	{"memory(35,4): error X3000: unexpected end of file", 19, 3, "unexpected end of file"},
+	// inside a header, above the document: named, never placed on a row.
+	{"memory(3,1): error X3000: syntax error", -1, -1, "fx/header.hlsl(3): syntax error"},
+	{"memory(9,5): error X3004: undeclared identifier 'n'", -1, -1, "fx/noise.hlsl(6): undeclared identifier 'n'"},
+	{"memory(15,2): error X3000: syntax error", -1, -1, "fx/header.hlsl(6): syntax error"},
+	// the document is preferred over the header, warnings never shown.
+	{"memory(5,1): error X3000: a\nmemory(17,3): warning X3206: w\nmemory(20,2): error X3000: b\n", 4, 1, "b (+1 more)"},
+	{"memory(17,3): warning X3206: w\nmemory(5,1): error X3000: a\n", -1, -1, "fx/noise.hlsl(2): a"},
+	// out of the map, or not formatted at all.
+	{"memory(99,1): error X3000: lost", -1, -1, "lost"},
+	{"the compiler crashed\nsomewhere", -1, -1, "the compiler crashed"},
+};
+
+static void TestTip()
+{
+	ShaderSourceMap source_map = MakeSourceMap(20);
+	for (size_t i = 0; i != ARRAYSIZE(tip_cases); ++i)
+	{
+		const TipCase& c = tip_cases[i];
+		ShaderErrorTip tip = MakeShaderErrorTip(c.output, source_map, editor_source);
+		CHECK_EQUAL(c.row, tip.row);
+		CHECK_EQUAL(c.column, tip.column);
+		CHECK_EQUAL(std::string(c.message), tip.message);
+	}
+}
+
+static void TestStrippedHeader()
+{
+	const char header[] =
+		"float unused(float x)\n"
+		"{\n"
+		"	return x;\n"
+		"}\n"
+		"float used(float x)\n"
+		"{\n"
+		"	return x * 2;\n"
+		"}\n";
+	ShaderSourceMap header_map;
+	header_map.AddSegment("fx/a.hlsl", 4);
+	header_map.AddSegment("fx/b.hlsl", 4, 10);
+
+	ShaderHeaderStripper stripper;
+	stripper.SetHeader(header, header_map, ContentHash());
+	stripper.Strip(L"float4 ps_main() : SV_Target\n{\n\treturn used(1);\n}\n");
+	std::string kept = header;
+	CHECK_EQUAL(kept.substr(kept.find("float used")), stripper.GetText());
+
+	// the stripped lines keep their files and lines, the document follows them.
+	ShaderSourceMap source_map = *stripper.GetSourceMap();
+	source_map.AddSegment(editor_source, 4);
+
+	ShaderErrorTip tip = MakeShaderErrorTip("memory(3,9): error X3004: undeclared identifier 'y'", source_map, editor_source);
+	CHECK_EQUAL(-1, tip.row);
+	CHECK_EQUAL(std::string("fx/b.hlsl(12): undeclared identifier 'y'"), tip.message);
+
+	tip = MakeShaderErrorTip("memory(7,9): error X3004: undeclared identifier 'usd'", source_map, editor_source);
+	CHECK_EQUAL(2, tip.row);
+	CHECK_EQUAL(8, tip.column);
+}
+
+int main()
+{
+	TestParse();
+	TestMap();
+	TestTip();
+	TestStrippedHeader();
+	return CheckReport("test_shader_diagnostics");
+}
@@ -0,0 +1,98 @@
+#include "common.hpp"
+#include "shader_header_stripper.hpp"
+#include "check.hpp"
+
+static const char document[] = "float4 ps_main() : SV_Target\n{\n\treturn kept(1);\n}\n";
+
+static std::string Strip(const std::string& header)
+{
+	ShaderSourceMap source_map;
+	source_map.AddSegment("fx/header.hlsl", ShaderSourceMap::CountLines(header));
+
+	ShaderHeaderStripper stripper;
+	ContentHasher hasher;
+	hasher.Update(header);
+	stripper.SetHeader(header, source_map, hasher.Finish());
+	stripper.Strip(std::wstring(document, document + sizeof(document) - 1));
+	return stripper.GetText();
+}
+
+static bool HasComment(const std::string& text)
+{
+	return text.find("/*") != std::string::npos || text.find("*/") != std::string::npos;
+}
+
+static void TestCommentAfterKeptChunk()
+{
+	// the comment opens on the last line of the kept function and closes
+	// on the first line of the dropped one.
+	std::string text = Strip(
+		"float kept(float x)\n"
+		"{\n"
+		"	return x;\n"
+		"} /* starts behind kept\n"
+		"   and ends in front of dropped */ float dropped(float x)\n"
+		"{\n"
+		"	return x;\n"
+		"}\n");
+	CHECK(!HasComment(text));
+	CHECK(text.find("kept") != std::string::npos);
+	CHECK(text.find("dropped") == std::string::npos);
+	CHECK_EQUAL(4u, ShaderSourceMap::CountLines(text));
+}
+
+static void TestCommentBeforeKeptChunk()
+{
+	// the other way around, the close would be left without its open.
+	std::string text = Strip(
+		"float dropped(float x)\n"
+		"{\n"
+		"	return x;\n"
+		"} /* starts behind dropped\n"
+		"   and ends in front of kept */ float kept(float x)\n"
+		"{\n"
+		"	return x; // a line comment\n"
+		"}\n");
+	CHECK(!HasComment(text));
+	CHECK(text.find("a line comment") == std::string::npos);
+	CHECK(text.find("float kept(float x)") != std::string::npos);
+	CHECK(text.find("dropped") == std::string::npos);
+}
+
+static void TestStringsStay()
+{
+	std::string text = Strip(
+		"#define NAME \"/* not a comment */\"\n"
+		"float kept(float x) {return NAME, x;}\n");
+	CHECK(text.find("\"/* not a comment */\"") != std::string::npos);
+}
+
+static void TestChunksSharingALine()
+{
+	// the dropped function starts on the line the kept one ends on, and
+	// the lines of both are kept whole.
+	std::string header =
+		"float kept(float x) { return x; } float shares_line(float y) {\n"
+		"  return y * 2;\n"
+		"}\n"
+		"float dropped(float z) { return z; }\n";
+	std::string text = Strip(header);
+	CHECK_EQUAL(header.substr(0, header.find("float dropped")), text);
+
+	// a chunk pulled in by its line reaches what it uses too.
+	text = Strip(
+		"float used_by_neighbour(float w) { return w; }\n"
+		"float kept(float x) { return x; } float shares_line(float y) {\n"
+		"  return used_by_neighbour(y);\n"
+		"}\n");
+	CHECK(text.find("float used_by_neighbour(float w)") != std::string::npos);
+}
+
+int main()
+{
+	TestCommentAfterKeptChunk();
+	TestCommentBeforeKeptChunk();
+	TestStringsStay();
+	TestChunksSharingALine();
+	return CheckReport("test_shader_header_stripper");
+}
@@ -0,0 +1,121 @@
+#include "common.hpp"
+#include "shader_include_graph.hpp"
+#include "check.hpp"
+
+#include <ctime>
+#include <fstream>
+#include <utime.h>
+
+static const char graph_directory[] = "cache/test/include_graph";
+
+// writes text and stamps the file with time, so edits can share a stamp.
+static void WriteFile(const std::string& name, const std::string& text, time_t time)
+{
+	std::string path = std::string(graph_directory) + "/" + name;
+	{
+		std::ofstream ofs(path.c_str(), std::ios::binary | std::ios::trunc);
+		ofs << text;
+	}
+	utimbuf times = {time, time};
+	utime(path.c_str(), &times);
+}
+
+static void TestIncludes()
+{
+	time_t now = time(NULL);
+	WriteFile("root.hlsl", "#include \"a.hlsl\"\nfloat r;\n", now);
+	WriteFile("a.hlsl", "float a;\n", now);
+
+	ShaderIncludeGraph graph(graph_directory);
+	graph.AddRoot("root.hlsl");
+	CHECK(graph.Refresh());
+	CHECK_EQUAL(std::string("float a;\nfloat r;\n"), graph.GetText());
+	CHECK_EQUAL(2u, graph.GetNumFiles());
+
+	ShaderSourceMap::Location location;
+	CHECK(graph.GetSourceMap().Resolve(2, location));
+	CHECK_EQUAL(std::string("root.hlsl"), location.source);
+	CHECK_EQUAL(2u, location.line);
+}
+
+static void TestSameStampEdit()
+{
+	// an edit of the same size within the same second as the last one.
+	time_t now = time(NULL);
+	WriteFile("root.hlsl", "float x = 1;\n", now);
+
+	ShaderIncludeGraph graph(graph_directory);
+	graph.AddRoot("root.hlsl");
+	graph.Refresh();
+	WriteFile("root.hlsl", "float x = 2;\n", now);
+	CHECK(graph.Refresh());
+	CHECK_EQUAL(std::string("float x = 2;\n"), graph.GetText());
+
+	// reading it again finds nothing new.
+	CHECK(!graph.Refresh());
+}
+
+static void TestInvalidate()
+{
+	// an old stamp is trusted, until a watcher says otherwise.
+	time_t then = time(NULL) - 3600;
+	WriteFile("root.hlsl", "float y = 1;\n", then);
+
+	ShaderIncludeGraph graph(graph_directory);
+	graph.AddRoot("root.hlsl");
+	graph.Refresh();
+	size_t num_loads = graph.GetNumLoads();
+	CHECK(!graph.Refresh());
+	CHECK_EQUAL(num_loads, graph.GetNumLoads());
+
+	WriteFile("root.hlsl", "float y = 2;\n", then);
+	std::vector<std::string> paths;
+	graph.GetFilePaths(paths);
+	CHECK_EQUAL(1u, paths.size());
+	if (!paths.empty()) graph.Invalidate(paths[0]);
+	CHECK(graph.Refresh());
+	CHECK_EQUAL(std::string("float y = 2;\n"), graph.GetText());
+}
+
+static void TestSkippedIncludes()
+{
+	// none of these can be reached, the files are not even there.
+	time_t now = time(NULL);
+	WriteFile("root.hlsl",
+		"/* #include \"comment.hlsl\"\n"
+		"#include \"block.hlsl\" */\n"
+		"// #include \"line.hlsl\"\n"
+		"#if 0\n"
+		"#ifdef NESTED\n"
+		"#endif\n"
+		"#include \"if_zero.hlsl\"\n"
+		"#else\n"
+		"#include \"a.hlsl\" /* after */\n"
+		"#endif\n"
+		"float r;\n", now);
+	WriteFile("a.hlsl", "float a;\n", now);
+
+	ShaderIncludeGraph graph(graph_directory);
+	graph.AddRoot("root.hlsl");
+	CHECK(graph.Refresh());
+	CHECK_EQUAL(2u, graph.GetNumFiles());
+
+	std::vector<std::string> paths;
+	graph.GetFilePaths(paths);
+	CHECK_EQUAL(2u, paths.size());
+	for (size_t i = 0; i != paths.size(); ++i)
+	{
+		CHECK(paths[i].find("root.hlsl") != std::string::npos || paths[i].find("a.hlsl") != std::string::npos);
+	}
+	CHECK(graph.GetText().find("float a;\n") != std::string::npos);
+}
+
+int main()
+{
+	MakeDirectory(graph_directory);
+	TestIncludes();
+	TestSameStampEdit();
+	TestInvalidate();
+	TestSkippedIncludes();
+	return CheckReport("test_shader_include_graph");
+}
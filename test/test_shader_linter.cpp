@@ -0,0 +1,130 @@
+#include "common.hpp"
+#include "shader_linter.hpp"
+#include "shader_include_graph.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+static const char shader_directory[] = "save";
+static const char header_directory[] = "fx/";
+static const char header_root[] = "header.hlsl";
+
+struct LintCase
+{
+	const wchar_t* text;
+	const char* message;	// of the first diagnostic, none if NULL
+	const wchar_t* at;		// where it starts, unlocated if NULL
+};
+
+static const LintCase lint_cases[] =
+{
+	{L"float4 ps_main() : SV_TARGET { return undeclared_thing; }\n",
+		"undeclared identifier 'undeclared_thing'", L"undeclared_thing"},
+	{L"float4 ps_main() : SV_TARGET { return lerp(1, 2); }\n",
+		"'lerp' takes 3 arguments, not 2", L"lerp"},
+	{L"float4 ps_main() : SV_TARGET { return lerp(1, 2, 0.5) + saturate(1); }\n",
+		NULL, NULL},
+	{L"float f(float a, float b = 1) { return a + b; }\n"
+		L"float4 ps_main() : SV_TARGET { return f(1) + f(1, 2); }\n",
+		NULL, NULL},
+	{L"float f(float a, float b = 1) { return a + b; }\n"
+		L"float4 ps_main() : SV_TARGET { return f(1, 2, 3); }\n",
+		"'f' takes 1 to 2 arguments, not 3", L"f(1, 2, 3)"},
+	{L"float f(float a, float b = 1) { return a + b; }\n"
+		L"float4 ps_main() : SV_TARGET { return f(); }\n",
+		"'f' takes 1 to 2 arguments, not 0", L"f()"},
+	// declarations count regardless of their order.
+	{L"float4 ps_main() : SV_TARGET { return g(1); }\n"
+		L"float g(float a) { return a; }\n",
+		NULL, NULL},
+	{L"float4 main() : SV_TARGET { return 1; }\n",
+		"no entry point, expected e.g. 'float4 ps_main(in float2 tc : TEXCOORD) : SV_TARGET'", NULL},
+	{L"float4 ps_main() { return 1; }\n",
+		"'ps_main' has no output semantic, e.g. ': SV_TARGET'", L"ps_main"},
+	{L"float4 ps_main() : SV_TARGET { return (1; }\n",
+		"'{' is never closed", L"{"},
+	{L"float4 ps_main() : SV_TARGET { return float4(1, 1, 1, 1)]; }\n",
+		"']' does not close '{'", L"]"},
+};
+
+static void Lint(const std::wstring& text, const std::string& header, const ContentHash& header_hash, ShaderLinter& linter)
+{
+	ShaderTokenizer tokenizer;
+	tokenizer.Tokenize(text);
+	ShaderParser parser;
+	parser.Parse(text, tokenizer.GetTokens());
+	linter.SetHeader(header, header_hash);
+	linter.Lint(parser);
+}
+
+static void TestDiagnostics()
+{
+	for (size_t i = 0; i != ARRAYSIZE(lint_cases); ++i)
+	{
+		const LintCase& c = lint_cases[i];
+		std::wstring text = c.text;
+		ShaderLinter linter;
+		Lint(text, "", ContentHash(), linter);
+
+		const std::vector<ShaderLinter::Diagnostic>& diagnostics = linter.GetDiagnostics();
+		if (c.message == NULL)
+		{
+			CHECK_EQUAL(0u, diagnostics.size());
+			if (!diagnostics.empty()) std::cerr << "  case " << i << ": " << diagnostics[0].message << "\n";
+			continue;
+		}
+
+		CHECK(!diagnostics.empty());
+		if (diagnostics.empty()) continue;
+		CHECK_EQUAL(std::string(c.message), diagnostics[0].message);
+		CHECK_EQUAL(c.at != NULL, diagnostics[0].is_located);
+		if (c.at != NULL && diagnostics[0].is_located) CHECK_EQUAL(text.find(c.at), diagnostics[0].start_pos);
+	}
+}
+
+static bool ReadShader(const std::string& path, std::wstring& text)
+{
+	std::ifstream ifs(path.c_str(), std::ios::binary);
+	if (!ifs.is_open()) return false;
+
+	std::string bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	text.assign(bytes.begin(), bytes.end());
+	text.erase(std::remove(text.begin(), text.end(), L'\r'), text.end());
+	return true;
+}
+
+// the shaders which come with the editor compile, so they lint clean too.
+static void TestNoFalsePositives()
+{
+	ShaderIncludeGraph include_graph(header_directory);
+	include_graph.AddRoot(header_root);
+	include_graph.Refresh();
+	CHECK(!include_graph.GetText().empty());
+
+	std::vector<std::string> files;
+	ListShaderFiles(shader_directory, files);
+	CHECK(!files.empty());
+
+	size_t num_diagnostics = 0;
+	for (size_t i = 0; i != files.size(); ++i)
+	{
+		std::wstring text;
+		CHECK(ReadShader(files[i], text));
+
+		ShaderLinter linter;
+		Lint(text, include_graph.GetText(), include_graph.GetHash(), linter);
+		const std::vector<ShaderLinter::Diagnostic>& diagnostics = linter.GetDiagnostics();
+		if (!diagnostics.empty()) std::cerr << "  " << files[i] << ": " << diagnostics[0].message << "\n";
+		num_diagnostics += diagnostics.size();
+	}
+	CHECK_EQUAL(0u, num_diagnostics);
+}
+
+int main()
+{
+	TestDiagnostics();
+	TestNoFalsePositives();
+	return CheckReport("test_shader_linter");
+}
@@ -0,0 +1,183 @@
+#include "common.hpp"
+#include "shader_parser.hpp"
+#include "shader_symbol_index.hpp"
+#include "check.hpp"
+
+// declarations of every kind, with strings, comments and nested blocks to
+// edit in and around.
+static const wchar_t document[] =
+	L"#define NAME \"a } string\"\n"
+	L"cbuffer Parameters { float4 time; float4 view; }\n"
+	L"struct Ray { float3 origin; float3 dir; };\n"
+	L"// a line comment { with a brace\n"
+	L"float scale = 2.0;\n"
+	L"/* a block comment\n"
+	L"   over two lines } */\n"
+	L"float twice(float x, float y = 1)\n"
+	L"{\n"
+	L"  if (x > 0) { x *= scale; } else { for (int i = 0; i < 2; ++i) x += y; }\n"
+	L"  return x;\n"
+	L"}\n"
+	L"float4 ps_main(in float2 tc : TEXCOORD) : SV_TARGET\n"
+	L"{\n"
+	L"  Ray ray;\n"
+	L"  ray.origin = float3(tc, twice(tc.x));\n"
+	L"  return float4(ray.origin, 1);\n"
+	L"}\n";
+
+// the snippets inserted everywhere, most of them change what follows them.
+static const wchar_t* const snippets[] =
+{
+	L"{", L"}", L"(", L")", L"\"", L"/*", L"*/", L"//", L"\n", L";", L"#", L"a",
+};
+
+static bool IsSameTree(const ShaderParser::NodePtr& lhs, const ShaderParser::NodePtr& rhs)
+{
+	if (lhs == rhs) return true;
+	if (lhs->kind != rhs->kind || lhs->text != rhs->text || lhs->token != rhs->token) return false;
+	if (lhs->num_items != rhs->num_items || lhs->children.size() != rhs->children.size()) return false;
+
+	for (size_t i = 0; i != lhs->children.size(); ++i)
+	{
+		if (lhs->children[i].offset != rhs->children[i].offset) return false;
+		if (!IsSameTree(lhs->children[i].node, rhs->children[i].node)) return false;
+	}
+	return true;
+}
+
+// whether both indices resolve every item the same.
+static bool IsSameIndex(const ShaderSymbolIndex& lhs, const ShaderSymbolIndex& rhs, size_t num_items)
+{
+	std::vector<ShaderSymbolIndex::Symbol> lhs_definitions, rhs_definitions;
+	std::vector<size_t> lhs_references, rhs_references;
+	for (size_t i = 0; i != num_items; ++i)
+	{
+		if (lhs.FindDefinitions(i, lhs_definitions) != rhs.FindDefinitions(i, rhs_definitions)) return false;
+		if (lhs_definitions.size() != rhs_definitions.size()) return false;
+		for (size_t j = 0; j != lhs_definitions.size(); ++j)
+		{
+			if (lhs_definitions[j].item != rhs_definitions[j].item || lhs_definitions[j].kind != rhs_definitions[j].kind) return false;
+		}
+
+		if (lhs.FindReferences(i, lhs_references) != rhs.FindReferences(i, rhs_references)) return false;
+		if (lhs_references != rhs_references) return false;
+	}
+	return true;
+}
+
+// the editor parses after every keystroke, taking over what it can from
+// the last tree. the tree and index must be the ones a full parse gives.
+class Reparser
+{
+public:
+	Reparser() : m_num_parses(0), m_num_mismatches(0), m_num_reused_items(0) {}
+
+public:
+	void Parse(const std::wstring& text, const char* edit)
+	{
+		m_tokenizer.Tokenize(text);
+		m_parser.Parse(text, m_tokenizer.GetTokens());
+		m_index.Update(m_parser);
+		++m_num_parses;
+		m_num_reused_items += m_parser.GetNumReusedItems();
+
+		ShaderParser full_parser;
+		full_parser.Parse(text, m_tokenizer.GetTokens());
+		ShaderSymbolIndex full_index;
+		full_index.Update(full_parser);
+		if (IsSameTree(m_parser.GetRoot(), full_parser.GetRoot()) && IsSameIndex(m_index, full_index, m_parser.GetItems().size())) return;
+
+		if (m_num_mismatches++ == 0) std::cerr << "  the reparse after " << edit << " differs from a full parse\n";
+	}
+
+	size_t GetNumParses() const {return m_num_parses;}
+	size_t GetNumMismatches() const {return m_num_mismatches;}
+	size_t GetNumReusedItems() const {return m_num_reused_items;}
+
+private:
+	ShaderTokenizer m_tokenizer;
+	ShaderParser m_parser;
+	ShaderSymbolIndex m_index;
+	size_t m_num_parses;
+	size_t m_num_mismatches;
+	size_t m_num_reused_items;
+};
+
+static std::string DescribeEdit(const char* what, const wchar_t* snippet, size_t pos)
+{
+	std::wstring wide = snippet;
+	return std::string(what) + " '" + std::string(wide.begin(), wide.end()) + "' at " + boost::lexical_cast<std::string>(pos);
+}
+
+// every snippet at every position, taken back again after each.
+static void TestSingleEdits()
+{
+	const std::wstring text = document;
+	Reparser reparser;
+	reparser.Parse(text, "the first parse");
+
+	for (size_t pos = 0; pos <= text.length(); ++pos)
+	{
+		for (size_t i = 0; i != ARRAYSIZE(snippets); ++i)
+		{
+			std::wstring edited = text;
+			edited.insert(pos, snippets[i]);
+			reparser.Parse(edited, DescribeEdit("inserting", snippets[i], pos).c_str());
+			reparser.Parse(text, DescribeEdit("taking back", snippets[i], pos).c_str());
+		}
+
+		if (pos == text.length()) break;
+		std::wstring edited = text;
+		edited.erase(pos, 1);
+		std::wstring erased = text.substr(pos, 1);
+		reparser.Parse(edited, DescribeEdit("erasing", erased.c_str(), pos).c_str());
+		reparser.Parse(text, DescribeEdit("taking back", erased.c_str(), pos).c_str());
+	}
+	CHECK_EQUAL(0u, reparser.GetNumMismatches());
+
+	// most of the tree is taken over, or the test tests nothing.
+	CHECK(reparser.GetNumReusedItems() > reparser.GetNumParses());
+}
+
+// a declaration typed in a character at a time and erased again, at the
+// boundaries between declarations, and inside a body, where each brace
+// moves the nesting of everything after it.
+static void TestTypedDeclarations()
+{
+	const std::wstring text = document;
+	const wchar_t* anchors[] =
+	{
+		L"cbuffer", L"struct", L"float scale", L"float twice", L"float4 ps_main", L"  return x;",
+	};
+	const std::wstring typed = L"float typed(float a) { if (a > 0) { return \"}\"; } /* } */ return a; }\n";
+
+	Reparser reparser;
+	reparser.Parse(text, "the first parse");
+	for (size_t i = 0; i != ARRAYSIZE(anchors); ++i)
+	{
+		size_t pos = text.find(anchors[i]);
+		CHECK(pos != std::wstring::npos);
+		if (pos == std::wstring::npos) continue;
+
+		std::wstring edited = text;
+		for (size_t length = 1; length <= typed.length(); ++length)
+		{
+			edited.insert(pos + length - 1, 1, typed[length - 1]);
+			reparser.Parse(edited, DescribeEdit("typing", typed.substr(0, length).c_str(), pos).c_str());
+		}
+		for (size_t length = typed.length(); length != 0; --length)
+		{
+			edited.erase(pos + length - 1, 1);
+			reparser.Parse(edited, DescribeEdit("erasing back to", typed.substr(0, length - 1).c_str(), pos).c_str());
+		}
+		CHECK(edited == text);
+	}
+	CHECK_EQUAL(0u, reparser.GetNumMismatches());
+}
+
+int main()
+{
+	TestSingleEdits();
+	TestTypedDeclarations();
+	return CheckReport("test_shader_parser");
+}